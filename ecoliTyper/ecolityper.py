@@ -29,6 +29,42 @@ except (ImportError, SystemError):
     sys.path.insert(0, str(Path(__file__).parent.parent))
     from core.banner import EcoliTyperBanner
 
+# Relative cost of each parallel module, used to split the core budget
+MODULE_COSTS = {
+    "MLST": 2,
+    "Serotyping": 1,
+    "CH Typing": 1,
+    "Phylogrouping": 1,
+    "ABRicate": 3
+}
+
+class CoreBudget:
+    """Global pool of cores shared by the modules running in parallel"""
+    
+    def __init__(self, cores: int, pending_cost: int):
+        self.free = max(1, cores)
+        self.pending_cost = pending_cost
+        self.condition = threading.Condition()
+    
+    def acquire(self, cost: int) -> int:
+        """Block until cores are free, then take this module's share of them"""
+        with self.condition:
+            while self.free == 0:
+                self.condition.wait()
+            
+            # Share of the free cores relative to the modules not yet started
+            cores = max(1, (self.free * cost) // max(1, self.pending_cost))
+            cores = min(cores, self.free)
+            self.free -= cores
+            self.pending_cost -= cost
+            return cores
+    
+    def release(self, cores: int):
+        """Hand the cores of a finished module back to the waiting ones"""
+        with self.condition:
+            self.free += cores
+            self.condition.notify_all()
+
 class EcoliTyperOrchestrator:
     """EcoliTyper orchestrator with comprehensive cleanup and interrupt handling"""
     
@@ -304,7 +340,8 @@ class EcoliTyperOrchestrator:
             cmd = [
                 sys.executable, str(sero_script),
                 "-i", file_pattern,
-                "-o", "Serotype"
+                "-o", "Serotype",
+                "-t", str(threads)
             ]
             
             with self.output_lock:
@@ -376,7 +413,8 @@ class EcoliTyperOrchestrator:
             cmd = [
                 sys.executable, str(chtyper_script),
                 "-i", file_pattern,
-                "-o", "CH_results"
+                "-o", "CH_results",
+                "-t", str(threads)
             ]
             
             with self.output_lock:
@@ -448,7 +486,8 @@ class EcoliTyperOrchestrator:
             cmd = [
                 sys.executable, str(phylo_script),
                 "-i", file_pattern,
-                "-o", "Phylo"
+                "-o", "Phylo",
+                "-t", str(threads)
             ]
             
             with self.output_lock:
@@ -590,7 +629,8 @@ class EcoliTyperOrchestrator:
             # Build command - use direct command list
             cmd = [
                 sys.executable, str(amr_script),
-                file_pattern
+                file_pattern,
+                "--cpus", str(threads)
             ]
             
             with self.output_lock:
@@ -684,6 +724,17 @@ class EcoliTyperOrchestrator:
                 self.banner.display_error(f"Lineage database generation failed: {str(e)}")
             return False
 
+    def _run_with_budget(self, budget: CoreBudget, func, name: str, 
+                         fasta_files: List[Path], output_dir: Path) -> bool:
+        """Run one analysis on the cores it gets from the budget"""
+        cores = budget.acquire(MODULE_COSTS.get(name, 1))
+        try:
+            with self.output_lock:
+                self.banner.display_info(f"{name} running on {cores} core(s)")
+            return func(fasta_files, output_dir, cores)
+        finally:
+            budget.release(cores)
+
     def run_parallel_analyses(self, fasta_files: List[Path], output_dir: Path, threads: int, 
                             skip_modules: Dict[str, bool]) -> Dict[str, bool]:
         """Run analyses in parallel with synchronized output"""
@@ -708,10 +759,13 @@ class EcoliTyperOrchestrator:
         
         results = {}
         
+        # Modules take their share of one core budget, and wait for cores when it is spent
+        budget = CoreBudget(threads, sum(MODULE_COSTS.get(name, 1) for func, name in active_analyses))
+        
         # Run analyses in parallel
-        with ThreadPoolExecutor(max_workers=min(len(active_analyses), max(1, threads // 2))) as executor:
+        with ThreadPoolExecutor(max_workers=len(active_analyses)) as executor:
             future_to_analysis = {
-                executor.submit(func, fasta_files, output_dir, max(1, threads // len(active_analyses))): name 
+                executor.submit(self._run_with_budget, budget, func, name, fasta_files, output_dir): name 
                 for func, name in active_analyses
             }
             
@@ -1983,6 +1983,82 @@ COMPREHENSIVE_REFERENCES = {
 }
 
 
+# =============================================================================
+# PATHOTYPE LOOKUP INDEX
+# =============================================================================
+
+class PathotypeIndex:
+    """Inverted index from virulence gene to pathotypes, scored with bitsets"""
+    
+    def __init__(self, pathotypes: dict):
+        self.names = list(pathotypes)
+        self.key_genes = [pathotypes[name].get("key_virulence_genes", []) for name in self.names]
+        self.common_serotypes = [
+            set(pathotypes[name]["serotypes"].get("common", [])) if "serotypes" in pathotypes[name] else set()
+            for name in self.names
+        ]
+        self.summaries = [
+            {
+                "primary_name": pathotypes[name]["primary_name"],
+                "category": pathotypes[name]["category"],
+                "risk_level": pathotypes[name]["risk_level"]
+            }
+            for name in self.names
+        ]
+        
+        # One bit per distinct gene, one key gene mask per pathotype
+        self.gene_bits = {}
+        self.masks = []
+        for genes in self.key_genes:
+            mask = 0
+            for gene in genes:
+                if gene not in self.gene_bits:
+                    self.gene_bits[gene] = 1 << len(self.gene_bits)
+                mask |= self.gene_bits[gene]
+            self.masks.append(mask)
+        
+        # Inverted indexes, pathotypes that a gene or serotype scores for
+        self.gene_pathotypes = {}
+        for i, genes in enumerate(self.key_genes):
+            for gene in set(genes):
+                self.gene_pathotypes.setdefault(gene, []).append(i)
+        self.serotype_pathotypes = {}
+        for i, serotypes in enumerate(self.common_serotypes):
+            for serotype in serotypes:
+                self.serotype_pathotypes.setdefault(serotype, []).append(i)
+        self.epec = self.names.index("EPEC") if "EPEC" in self.names else None
+        self.ehec = self.names.index("EHEC") if "EHEC" in self.names else None
+    
+    def sample_mask(self, virulence_genes) -> int:
+        """Bitset of the indexed genes found in a sample"""
+        mask = 0
+        for gene in virulence_genes:
+            mask |= self.gene_bits.get(gene, 0)
+        return mask
+    
+    def candidates(self, virulence_genes, serotype: str = None) -> list:
+        """Pathotypes that can score for a sample, in database order"""
+        hits = set()
+        for gene in virulence_genes:
+            hits.update(self.gene_pathotypes.get(gene, ()))
+            if self.ehec is not None and gene.startswith('stx'):
+                hits.add(self.ehec)
+        if self.epec is not None and "eae" in virulence_genes:
+            hits.add(self.epec)
+        if serotype:
+            hits.update(self.serotype_pathotypes.get(serotype, ()))
+        return sorted(hits)
+
+_PATHOTYPE_INDEX = None
+
+def get_pathotype_index() -> PathotypeIndex:
+    """Build the pathotype index once per process"""
+    global _PATHOTYPE_INDEX
+    if _PATHOTYPE_INDEX is None:
+        _PATHOTYPE_INDEX = PathotypeIndex(PATHOTYPE_DATABASE)
+    return _PATHOTYPE_INDEX
+
+
 # =============================================================================
 # COMBINED DATABASE CLASS
 # =============================================================================
@@ -1997,6 +2073,7 @@ class EcoliLineageDB:
         self.pathotypes = PATHOTYPE_DATABASE
         self.specialized_profiles = SPECIALIZED_PROFILES
         self.references = COMPREHENSIVE_REFERENCES
+        self.index = get_pathotype_index() if self.pathotypes is PATHOTYPE_DATABASE else PathotypeIndex(self.pathotypes)
     
     def get_lineage_by_st(self, st: int) -> dict:
         """Get lineage data by sequence type"""
@@ -2013,57 +2090,52 @@ class EcoliLineageDB:
     
     def predict_pathotype(self, virulence_genes: list, serotype: str = None) -> dict:
         """Predict pathotype based on virulence genes and optional serotype"""
+        index = self.index
         predictions = {}
         
-        for pt_name, pt_data in self.pathotypes.items():
-            score = 0
-            matched_genes = []
+        sample_mask = index.sample_mask(virulence_genes)
+        stx_genes = [g for g in virulence_genes if g.startswith('stx')]
+        has_eae = "eae" in virulence_genes
+        
+        for i in index.candidates(virulence_genes, serotype):
+            pt_name = index.names[i]
             
-            # Check key virulence genes
-            key_genes = pt_data.get("key_virulence_genes", [])
-            for gene in key_genes:
-                if gene in virulence_genes:
-                    score += 1
-                    matched_genes.append(gene)
+            # Key virulence genes found in the sample
+            key_genes = index.key_genes[i]
+            hits = index.masks[i] & sample_mask
+            matched_genes = [gene for gene in key_genes if index.gene_bits[gene] & hits] if hits else []
+            score = len(matched_genes)
             
             # Check subtype markers for EPEC
-            if pt_name == "EPEC":
-                if "eae" in virulence_genes:
-                    score += 2
-                    if "bfpA" in virulence_genes:
-                        subtype = "tEPEC"
-                    else:
-                        subtype = "aEPEC"
-                    matched_genes.append(f"subtype: {subtype}")
+            if pt_name == "EPEC" and has_eae:
+                score += 2
+                subtype = "tEPEC" if "bfpA" in virulence_genes else "aEPEC"
+                matched_genes.append(f"subtype: {subtype}")
             
             # Check for EHEC
-            if pt_name == "EHEC":
-                stx_genes = [g for g in virulence_genes if g.startswith('stx')]
-                if stx_genes:
-                    score += 2
-                    matched_genes.extend(stx_genes)
+            if pt_name == "EHEC" and stx_genes:
+                score += 2
+                matched_genes.extend(stx_genes)
             
             # Check serotype if provided
-            if serotype and "serotypes" in pt_data:
-                common_serotypes = pt_data["serotypes"].get("common", [])
-                if serotype in common_serotypes:
-                    score += 1
-                    matched_genes.append(f"serotype_match: {serotype}")
+            if serotype and serotype in index.common_serotypes[i]:
+                score += 1
+                matched_genes.append(f"serotype_match: {serotype}")
             
             if score > 0:
                 predictions[pt_name] = {
                     "score": score,
                     "matched_genes": matched_genes,
                     "confidence": self._get_confidence_level(score, len(key_genes)),
-                    "pathotype_data": {
-                        "primary_name": pt_data["primary_name"],
-                        "category": pt_data["category"],
-                        "risk_level": pt_data["risk_level"]
-                    }
+                    "pathotype_data": dict(index.summaries[i])
                 }
         
         return dict(sorted(predictions.items(), key=lambda x: x[1]["score"], reverse=True))
     
+    def predict_pathotypes(self, samples: list) -> list:
+        """Predict pathotypes for a batch of (virulence_genes, serotype) pairs"""
+        return [self.predict_pathotype(genes, serotype) for genes, serotype in samples]
+    
     def _get_confidence_level(self, score: int, total_key_genes: int) -> str:
         """Determine confidence level based on matching score"""
         if total_key_genes == 0:
@@ -23,13 +23,554 @@
 #include "align.h"
 #include "chain.h"
 #include "compdna.h"
+#include "fuzzymatch.h"
 #include "hashmapcci.h"
 #include "nw.h"
+#include "pherror.h"
 #include "stdnuc.h"
 #include "stdstat.h"
 
 AlnScore (*leadTailAlnPtr)(Aln *, Aln *, const long unsigned*, const unsigned char*, int, int, int, const int, NWmat *) = &leadTailAln;
 void (*trailTailAlnPtr)(Aln *, Aln *, AlnScore *, const long unsigned *, const unsigned char *, int, int, int, int, const int, NWmat *) = &trailTailAln;
+static int xDrop = 0;
+static long unsigned xDropTails = 0, xDropBands = 0;
+static int fuzzyMM = -1;
+static int alnStride = 0;
+static long unsigned fuzzyReads = 0;
+static long unsigned nwWindow = 0, nwWindows = 0;
+
+void setXdrop(int X) {
+	xDrop = X;
+}
+
+void xDropReport(FILE *out) {
+	
+	if(xDrop) {
+		fprintf(out, "# X-drop clipped %lu tails and narrowed %lu gap bands.\n", xDropTails, xDropBands);
+	}
+}
+
+void setFuzzy(int mm) {
+	fuzzyMM = mm;
+}
+
+void setAlnStride(int stride) {
+	
+	/* only probe every stride'th k-mer of long reads when seeding, hits are still extended to full MEMs */
+	alnStride = 1 < stride ? stride : 0;
+}
+
+void fuzzyReport(FILE *out) {
+	
+	if(0 <= fuzzyMM) {
+		fprintf(out, "# Fuzzy seeds anchored %lu alignments without exact seeds.\n", fuzzyReads);
+	}
+}
+
+void setNWwindow(long unsigned cells) {
+	nwWindow = cells;
+}
+
+void nwWindowReport(FILE *out) {
+	
+	if(nwWindow) {
+		fprintf(out, "# Aligned %lu seed gaps in windows.\n", nwWindows);
+	}
+}
+
+static long unsigned nwCells(int t_l, int q_l, int band) {
+	
+	/* traceback cells of the NW or NW_band call, for a gap of t_l by q_l */
+	if(q_l <= band || t_l <= band) {
+		return (long unsigned)(q_l + 1) * (t_l + 1);
+	}
+	return (long unsigned)(band + 2) * (t_l + 1);
+}
+
+static AlnScore NW_window(const long unsigned *tseq, const unsigned char *qseq, int t_s, int t_e, int q_s, int q_e, Aln *aligned, int offset, int bandwidth, NWmat *matrices, int t_len) {
+	
+	static __thread int size = 0;
+	static __thread Aln window;
+	int k, n, rt, rq, wt, wq, lt, lq, ti, qi, band, last, prev, W1, U, **d;
+	AlnScore Stat, NWstat;
+	
+	/*
+	The gap is aligned in windows reaching twice as far as they step, only
+	the first half of each is kept, so the forced end of one window is
+	aligned again by the next. The matrices stay below nwWindow cells, and
+	the kept columns are scored as one alignment.
+	*/
+	W1 = matrices->rewards->W1;
+	U = matrices->rewards->U;
+	d = matrices->rewards->d;
+	Stat.score = 0;
+	Stat.len = 0;
+	Stat.pos = 0;
+	Stat.match = 0;
+	Stat.tGaps = 0;
+	Stat.qGaps = 0;
+	prev = 0;
+	last = 0;
+	__sync_add_and_fetch(&nwWindows, 1);
+	while(!last) {
+		/* step along what is left of the gap */
+		rt = t_e - t_s;
+		rq = q_e - q_s;
+		k = 1;
+		do {
+			k <<= 1;
+			wt = (rt + k - 1) / k;
+			wq = (rq + k - 1) / k;
+			lt = rt < (wt << 1) ? rt : (wt << 1);
+			lq = rq < (wq << 1) ? rq : (wq << 1);
+			band = abs(lt - lq) + bandwidth;
+		} while(nwWindow < nwCells(lt, lq, band) && 1 < wt + wq);
+		if(!rt || !rq || nwCells(rt, rq, abs(rt - rq) + bandwidth) <= nwWindow || (lt == rt && lq == rq)) {
+			lt = rt;
+			lq = rq;
+			band = abs(lt - lq) + bandwidth;
+			last = 1;
+		}
+		
+		/* align window */
+		if(size <= lt + lq) {
+			free(window.t);
+			free(window.s);
+			free(window.q);
+			size = (lt + lq + 1) << 1;
+			window.t = smalloc(size);
+			window.s = smalloc(size);
+			window.q = smalloc(size);
+		}
+		window.pos = 0;
+		if(lq <= band || lt <= band) {
+			NWstat = NW(tseq, qseq, 0, t_s, t_s + lt, q_s, q_s + lq, &window, matrices, t_len);
+		} else {
+			NWstat = NW_band(tseq, qseq, 0, t_s, t_s + lt, q_s, q_s + lq, &window, band, matrices, t_len);
+		}
+		
+		/* keep the first half, or all of the last window */
+		ti = 0;
+		qi = 0;
+		for(n = 0; n < NWstat.len && (last || (ti < wt && qi < wq)); ++n) {
+			if(window.t[n] == 5) {
+				Stat.score += prev == 1 ? U : W1;
+				prev = 1;
+				++Stat.tGaps;
+				++qi;
+			} else if(window.q[n] == 5) {
+				Stat.score += prev == 2 ? U : W1;
+				prev = 2;
+				++Stat.qGaps;
+				++ti;
+			} else {
+				Stat.score += d[window.t[n]][window.q[n]];
+				prev = 0;
+				++Stat.match;
+				++ti;
+				++qi;
+			}
+		}
+		if(aligned) {
+			memcpy(aligned->t + offset + Stat.len, window.t, n);
+			memcpy(aligned->s + offset + Stat.len, window.s, n);
+			memcpy(aligned->q + offset + Stat.len, window.q, n);
+		}
+		Stat.len += n;
+		t_s += ti;
+		q_s += qi;
+	}
+	
+	return Stat;
+}
+
+static int fuzzyAnchor(const HashMapCCI *template_index, const unsigned char *qseq, int q_end, int q, int t, AlnPoints *points, int mem_count) {
+	
+	int i, j, k, v, t_len;
+	
+	/* extend the exact run through (q, t) */
+	t_len = template_index->len;
+	if(t < 0 || t_len <= t || qseq[q] != getNuc(template_index->seq, t)) {
+		return mem_count;
+	}
+	for(j = q - 1, v = t - 1; 0 <= j && 0 <= v && qseq[j] == getNuc(template_index->seq, v); --j) {
+		--v;
+	}
+	++j;
+	++v;
+	for(k = q + 1, t = t + 1; k < q_end && t < t_len && qseq[k] == getNuc(template_index->seq, t); ++k) {
+		++t;
+	}
+	if(k - j < (template_index->kmerindex >> 1)) {
+		return mem_count;
+	}
+	
+	/* skip runs already seeded, and keep seeds sorted on the query */
+	i = mem_count;
+	while(i && j < points->qStart[i - 1]) {
+		--i;
+	}
+	for(k = i; k && points->qStart[k - 1] == j; --k) {
+		if(points->tStart[k - 1] == v + 1) {
+			return mem_count;
+		}
+	}
+	for(k = mem_count; i < k; --k) {
+		points->qStart[k] = points->qStart[k - 1];
+		points->qEnd[k] = points->qEnd[k - 1];
+		points->tStart[k] = points->tStart[k - 1];
+		points->tEnd[k] = points->tEnd[k - 1];
+		points->weight[k] = points->weight[k - 1];
+	}
+	points->qStart[i] = j;
+	points->tStart[i] = v + 1;
+	points->qEnd[i] = j + (t - v);
+	points->tEnd[i] = t + 1;
+	points->weight[i] = t - v;
+	
+	/* realloc seeding points */
+	if(++mem_count == points->size) {
+		seedPoint_realloc(points, points->size << 1);
+	}
+	
+	return mem_count;
+}
+
+static int originSeed(const HashMapCCI *template_index, const unsigned char *qseq, int q, int q_end, AlnPoints *points, int n) {
+	
+	/* continue seed n - 1 over the origin of a circular template */
+	int t, t_len;
+	
+	t_len = template_index->len;
+	if(chainSeedsPtr != &chainSeeds_circular || q_end <= q || points->tEnd[n - 1] != t_len + 1 || qseq[q] != getNuc(template_index->seq, 0)) {
+		return 0;
+	}
+	points->qStart[n] = q;
+	points->tStart[n] = 1;
+	for(t = 0; q < q_end && t < t_len && qseq[q] == getNuc(template_index->seq, t); ++t) {
+		++q;
+	}
+	points->qEnd[n] = q;
+	points->tEnd[n] = t + 1;
+	points->weight[n] = t;
+	
+	/* realloc seeding points */
+	if(n + 1 == points->size) {
+		seedPoint_realloc(points, points->size << 1);
+	}
+	
+	return t;
+}
+
+static int fuzzySeed(const HashMapCCI *template_index, const unsigned char *qseq, int q_start, int q_end, AlnPoints *points) {
+	
+	int i, j, n, t, hit, nHits, mem_count, kmersize, t_len, hits[16];
+	long unsigned key, mask, *words;
+	
+	/* seed divergent reads with the template k-mers within fuzzyMM 
+	   mismatches or one indel of non-overlapping query k-mers */
+	kmersize = template_index->kmerindex;
+	t_len = template_index->len;
+	n = t_len - kmersize + 1;
+	if(fuzzyMM < 0 || n < 2 || FUZZY_MAXLEN < t_len) {
+		return 0;
+	}
+	mask = 0;
+	mask = (~mask) >> (sizeof(long unsigned) * sizeof(long unsigned) - (kmersize << 1));
+	words = smalloc(n * sizeof(long unsigned));
+	key = 0;
+	for(i = 0; i < t_len; ++i) {
+		key = ((key << 2) | getNuc(template_index->seq, i)) & mask;
+		if(kmersize <= i + 1) {
+			words[i + 1 - kmersize] = key;
+		}
+	}
+	
+	mem_count = 0;
+	for(i = q_start; i + kmersize <= q_end; i += kmersize) {
+		key = 0;
+		for(j = i; j < i + kmersize && qseq[j] < 4; ++j) {
+			key = (key << 2) | qseq[j];
+		}
+		if(j < i + kmersize) {
+			/* restart after N */
+			i = j + 1 - kmersize;
+			continue;
+		}
+		
+		/* the head is on the diagonal of t, the tail may be shifted by the indel */
+		nHits = fuzzyScan(words, n, key, fuzzyMM, hits, 16);
+		for(hit = 0; hit < nHits; ++hit) {
+			t = hits[hit] >> 2;
+			mem_count = fuzzyAnchor(template_index, qseq, q_end, i, t, points, mem_count);
+			t += kmersize - 1;
+			if((hits[hit] & 3) == FUZZY_DEL) {
+				++t;
+			} else if((hits[hit] & 3) == FUZZY_INS) {
+				--t;
+			}
+			mem_count = fuzzyAnchor(template_index, qseq, q_end, i + kmersize - 1, t, points, mem_count);
+		}
+	}
+	free(words);
+	if(mem_count) {
+		__sync_add_and_fetch(&fuzzyReads, 1);
+	}
+	
+	return mem_count;
+}
+
+static int xDropExtend(const long unsigned *tseq, const unsigned char *qseq, int t_p, int q_p, int len, int dir, int **d) {
+	
+	int i, t, score, best, keep;
+	
+	/* ungapped extension along the seed diagonal, return length at best score */
+	score = 0;
+	best = 0;
+	keep = 0;
+	for(i = 0; i < len; ++i) {
+		t = t_p + dir * i;
+		score += d[getNuc(tseq, t)][qseq[q_p + dir * i]];
+		if(best < score) {
+			best = score;
+			keep = i + 1;
+		} else if(score < best - xDrop) {
+			return keep;
+		}
+	}
+	
+	return len;
+}
+
+static int xDropBand(const long unsigned *tseq, const unsigned char *qseq, int t_s, int q_s, int len, int band, Penalties *rewards) {
+	
+	int i, t, score, w;
+	
+	/*
+	on a collinear gap any gapped path needs a gap both ways, w wide,
+	which costs at least 2 * (W1 + (w - 1) * U). Paths wider than what
+	the ungapped diagonal leaves room for can never win.
+	*/
+	if(0 <= rewards->U || 0 <= rewards->W1) {
+		return band;
+	}
+	score = 0;
+	for(i = 0; i < len; ++i) {
+		t = t_s + i;
+		score += rewards->d[getNuc(tseq, t)][qseq[q_s + i]];
+	}
+	w = (len * rewards->M - score + 2 * (rewards->W1 - rewards->U)) / (rewards->M - 2 * rewards->U);
+	w = (w < 4 ? 4 : w + 1) << 1;
+	if(w < band) {
+		__sync_add_and_fetch(&xDropBands, 1);
+		return w;
+	}
+	
+	return band;
+}
+
+static int editDist(const long unsigned *tseq, const unsigned char *qseq, int q_len, int t_s, int t_e, int maxEd, int global) {
+	
+	int i, j, w, W, c, hin, hout, score, best, last;
+	long unsigned *Peq, *Pv, *Mv, Eq, Xv, Xh, Ph, Mh, neg, stack[24];
+	
+	/*
+	Myers / Hyyro bit-parallel edit distance, with the query global
+	and the template local. Stops once maxEd is reached.
+	With global, the template is global too and maxEd is not used.
+	*/
+	W = (q_len + 63) >> 6;
+	Peq = W <= 4 ? stack : smalloc(6 * W * sizeof(long unsigned));
+	Pv = Peq + (W << 2);
+	Mv = Pv + W;
+	memset(Peq, 0, (W << 2) * sizeof(long unsigned));
+	for(i = 0; i < q_len; ++i) {
+		if(qseq[i] < 4) {
+			Peq[qseq[i] * W + (i >> 6)] |= 1UL << (i & 63);
+		} else {
+			/* N matches anything */
+			for(c = 0; c < 4; ++c) {
+				Peq[c * W + (i >> 6)] |= 1UL << (i & 63);
+			}
+		}
+	}
+	for(w = 0; w < W; ++w) {
+		Pv[w] = ~0UL;
+		Mv[w] = 0;
+	}
+	last = (q_len - 1) & 63;
+	score = q_len;
+	best = q_len;
+	for(j = t_s; j < t_e && (global || maxEd < best); ++j) {
+		c = getNuc(tseq, j) * W;
+		hin = global;
+		for(w = 0; w < W; ++w) {
+			Eq = Peq[c + w];
+			neg = hin < 0;
+			Xv = Eq | Mv[w];
+			Eq |= neg;
+			Xh = (((Eq & Pv[w]) + Pv[w]) ^ Pv[w]) | Eq;
+			Ph = Mv[w] | ~(Xh | Pv[w]);
+			Mh = Pv[w] & Xh;
+			hout = (int)(Ph >> 63) - (int)(Mh >> 63);
+			if(w == W - 1) {
+				score += (int)((Ph >> last) & 1) - (int)((Mh >> last) & 1);
+			}
+			Ph = (Ph << 1) | (0 < hin);
+			Mh = (Mh << 1) | neg;
+			Pv[w] = Mh | ~(Xv | Ph);
+			Mv[w] = Ph & Xv;
+			hin = hout;
+		}
+		if(score < best) {
+			best = score;
+		}
+	}
+	if(Peq != stack) {
+		free(Peq);
+	}
+	
+	return global ? score : best;
+}
+
+static int editChain(const long unsigned *tseq, const unsigned char *qseq, int q_len, AlnPoints *points, int start, int maxEd) {
+	
+	int j, q_c, t_c, q_s, t_s, d, ed;
+	
+	/*
+	edit distance of the alignment forced through the seed chain, with the
+	tails inserted. It bounds the edit distance of the query from above.
+	Overlapping seeds are clipped along their diagonal.
+	*/
+	q_c = points->qEnd[start];
+	t_c = points->tEnd[start] - 1;
+	ed = points->qStart[start];
+	j = start;
+	while(ed <= maxEd && (j = points->next[j])) {
+		q_s = points->qStart[j];
+		t_s = points->tStart[j] - 1;
+		d = q_c - q_s < t_c - t_s ? t_c - t_s : q_c - q_s;
+		if(points->qEnd[j] <= q_s + d) {
+			continue;
+		} else if(0 < d) {
+			q_s += d;
+			t_s += d;
+		}
+		if(q_s == q_c || t_s == t_c) {
+			ed += (q_s - q_c) + (t_s - t_c);
+		} else {
+			ed += editDist(tseq, qseq + q_c, q_s - q_c, t_c, t_s, 0, 1);
+		}
+		q_c = points->qEnd[j];
+		t_c = points->tEnd[j] - 1;
+	}
+	
+	return ed + q_len - q_c;
+}
+
+static double editBound(int ed, int q_len, int M, int MM, int B) {
+	
+	double ub1, ub2;
+	
+	/* best relative score of a full query alignment with ed edits */
+	ub1 = ((double)(q_len - ed) * M + (double)(ed) * MM + B) / q_len;
+	ub2 = ((double)(q_len) * M + (double)(ed) * MM + B) / (q_len + ed);
+	
+	return ub1 < ub2 ? ub2 : ub1;
+}
+
+static int editReject(const HashMapCCI *template_index, const unsigned char *qseq, int q_len, double scoreT, AlnPoints *points, int start, Penalties *rewards) {
+	
+	int i, j, M, MM, B, bw, ws, we, q_e, t_e, ed, maxEd, lo, hi, mem;
+	
+	/* tails may be clipped or overhang, no bound on the full query */
+	if(xDrop || scoreT <= 0) {
+		return 0;
+	}
+	
+	/* best match and least penalty of a single edit */
+	M = rewards->d[4][4];
+	MM = rewards->U < rewards->W1 ? rewards->W1 : rewards->U;
+	for(i = 0; i < 5; ++i) {
+		for(j = 0; j < 5; ++j) {
+			if(i == j || i == 4 || j == 4) {
+				M = M < rewards->d[i][j] ? rewards->d[i][j] : M;
+			} else if(MM < rewards->d[i][j]) {
+				MM = rewards->d[i][j];
+			}
+		}
+	}
+	if(0 <= MM || M <= MM) {
+		return 0;
+	}
+	B = rewards->Wl < 0 ? -2 * rewards->Wl : 0;
+	
+	/* largest edit distance that may still reach scoreT */
+	if(scoreT <= editBound(q_len, q_len, M, MM, B)) {
+		return 0;
+	}
+	lo = 0;
+	hi = q_len;
+	while(lo < hi) {
+		ed = (lo + hi + 1) >> 1;
+		if(scoreT <= editBound(ed, q_len, M, MM, B)) {
+			lo = ed;
+		} else {
+			hi = ed - 1;
+		}
+	}
+	maxEd = lo;
+	
+	/* get template window, the tails must be forced onto the full query */
+	bw = template_index->bandwidth;
+	q_e = points->qStart[start];
+	t_e = points->tStart[start] - 1;
+	if(q_e == 0) {
+		ws = t_e;
+	} else if((q_e << 1) < t_e || (q_e + bw) < t_e) {
+		ws = t_e - (q_e + (q_e < bw ? q_e : bw));
+	} else {
+		return 0;
+	}
+	
+	/* upper bound on the edit distance from the seed chain */
+	mem = 0;
+	ed = 0;
+	i = start;
+	while(points->next[i]) {
+		j = points->next[i];
+		if(points->tEnd[j] < points->tEnd[i]) {
+			/* circular */
+			return 0;
+		} else if(points->qStart[j] < points->qEnd[i] || points->tStart[j] < points->tEnd[i]) {
+			ed = -1;
+		} else if(0 <= ed && (points->qStart[j] - points->qEnd[i]) < (points->tStart[j] - points->tEnd[i])) {
+			ed += (points->tStart[j] - points->tEnd[i]) - (points->qStart[j] - points->qEnd[i]);
+		}
+		mem += points->qEnd[i] - points->qStart[i];
+		i = j;
+	}
+	mem += points->qEnd[i] - points->qStart[i];
+	
+	q_e = q_len - points->qEnd[i];
+	t_e = template_index->len - (points->tEnd[i] - 1);
+	if(q_e == 0) {
+		we = points->tEnd[i] - 1;
+	} else if((q_e << 1) < t_e || (q_e + bw) < t_e) {
+		we = points->tEnd[i] - 1 + q_e + (q_e < bw ? q_e : bw);
+	} else {
+		return 0;
+	}
+	if(0 <= ed && ed + q_len - mem <= maxEd) {
+		return 0;
+	} else if(we <= ws) {
+		return 0;
+	} else if(editChain(template_index->seq, qseq, q_len, points, start, maxEd) <= maxEd) {
+		return 0;
+	}
+	
+	return maxEd < editDist(template_index->seq, qseq, q_len, ws, we, maxEd, 0);
+}
 
 AlnScore skipLeadAln(Aln *aligned, Aln *Frag_align, const long unsigned *tseq, const unsigned char *qseq, int t_e, int t_len, int q_e, const int bandwidth, NWmat *matrices) {
 	
@@ -52,7 +593,7 @@ AlnScore skipLeadAln(Aln *aligned, Aln *Frag_align, const long unsigned *tseq, c
 
 AlnScore leadTailAln(Aln *aligned, Aln *Frag_align, const long unsigned *tseq, const unsigned char *qseq, int t_e, int t_len, int q_e, const int bandwidth, NWmat *matrices) {
 	
-	int bias, band, t_s, q_s;
+	int bias, band, t_s, q_s, clip, keep;
 	AlnScore Stat, NWstat;
 	
 	/* initialize */
@@ -75,20 +616,33 @@ AlnScore leadTailAln(Aln *aligned, Aln *Frag_align, const long unsigned *tseq, c
 			q_s = q_e - (t_e + (t_e < bandwidth ? t_e : bandwidth));
 		}
 		
+		/* X-drop, clip what the seed cannot be extended into */
+		clip = 0;
+		if(xDrop) {
+			keep = (t_e - t_s < q_e - q_s) ? t_e - t_s : q_e - q_s;
+			keep = xDropExtend(tseq, qseq, t_e - 1, q_e - 1, keep, -1, matrices->rewards->d) + bandwidth;
+			if(keep < t_e - t_s && keep < q_e - q_s) {
+				t_s = t_e - keep;
+				q_s = q_e - keep;
+				clip = 1;
+				__sync_add_and_fetch(&xDropTails, 1);
+			}
+		}
+		
 		/* align */
 		if(t_e - t_s > 0 && q_e - q_s > 0) {
 			band = abs(t_e - t_s - q_e + q_s) + bandwidth;
 			if(q_e - q_s <= band || t_e - t_s <= band) {// || abs(t_e - t_s - q_e - q_s) >= 32) {
 				if(Frag_align) {
-					NWstat = NW(tseq, qseq, -1 - (t_s == 0), t_s, t_e, q_s, q_e, Frag_align, matrices, t_len);
+					NWstat = NW(tseq, qseq, -1 - (t_s == 0 || clip), t_s, t_e, q_s, q_e, Frag_align, matrices, t_len);
 				} else {
-					NWstat = NW_score(tseq, qseq, -1 - (t_s == 0), t_s, t_e, q_s, q_e, matrices, t_len);
+					NWstat = NW_score(tseq, qseq, -1 - (t_s == 0 || clip), t_s, t_e, q_s, q_e, matrices, t_len);
 				}
 			} else if(Frag_align) {
-				NWstat = NW_band(tseq, qseq, -1 - (t_s == 0), t_s, t_e, q_s, q_e, Frag_align, band, matrices, t_len);
+				NWstat = NW_band(tseq, qseq, -1 - (t_s == 0 || clip), t_s, t_e, q_s, q_e, Frag_align, band, matrices, t_len);
 				//NWstat = NW(tseq, qseq, -1 - (t_s == 0), t_s, t_e, q_s, q_e, Frag_align, matrices, t_len);
 			} else {
-				NWstat = NW_band_score(tseq, qseq, -1 - (t_s == 0), t_s, t_e, q_s, q_e, band, matrices, t_len);
+				NWstat = NW_band_score(tseq, qseq, -1 - (t_s == 0 || clip), t_s, t_e, q_s, q_e, band, matrices, t_len);
 				//NWstat = NW_score(tseq, qseq, -1 - (t_s == 0), t_s, t_e, q_s, q_e, matrices, t_len);
 			}
 			
@@ -139,7 +693,8 @@ void skipTrailAln(Aln *aligned, Aln *Frag_align, AlnScore *Stat, const long unsi
 
 void trailTailAln(Aln *aligned, Aln *Frag_align, AlnScore *Stat, const long unsigned *tseq, const unsigned char *qseq, int t_s, int t_len, int q_s, int q_len, const int bandwidth, NWmat *matrices) {
 	
-	int band, bias, q_e, t_e;
+	int i, j, band, bias, q_e, t_e, clip, keep, score, **d;
+	unsigned char nuc;
 	AlnScore NWstat;
 	
 	/* Get intervals in query and template to align */
@@ -155,20 +710,56 @@ void trailTailAln(Aln *aligned, Aln *Frag_align, AlnScore *Stat, const long unsi
 		q_e = q_s + (q_e + (q_e < bandwidth ? q_e : bandwidth));
 	}
 	
+	/* exact trailing tail, the ungapped match is the optimal alignment */
+	if(q_s < q_e && q_e == q_len && q_len - q_s <= t_e - t_s) {
+		d = matrices->rewards->d;
+		score = 0;
+		for(i = q_s, j = t_s; i < q_len && qseq[i] == (nuc = getNuc(tseq, j)); ++i, ++j) {
+			score += d[nuc][nuc];
+		}
+		if(i == q_len) {
+			i -= q_s;
+			if(Frag_align) {
+				memcpy(aligned->t + Stat->len, qseq + q_s, i);
+				memset(aligned->s + Stat->len, '|', i);
+				memcpy(aligned->q + Stat->len, qseq + q_s, i);
+				Frag_align->end = 0;
+				aligned->end = 0;
+			}
+			Stat->score += score;
+			Stat->len += i;
+			Stat->match += i;
+			return;
+		}
+	}
+	
+	/* X-drop, clip what the seed cannot be extended into */
+	clip = 0;
+	if(xDrop) {
+		keep = (t_e - t_s < q_e - q_s) ? t_e - t_s : q_e - q_s;
+		keep = xDropExtend(tseq, qseq, t_s, q_s, keep, 1, matrices->rewards->d) + bandwidth;
+		if(keep < t_e - t_s && keep < q_e - q_s) {
+			t_e = t_s + keep;
+			q_e = q_s + keep;
+			clip = 1;
+			__sync_add_and_fetch(&xDropTails, 1);
+		}
+	}
+	
 	/* align trailing gap */
 	if(t_e - t_s > 0 && q_e - q_s > 0) {
 		band = abs(t_e - t_s - q_e + q_s) + bandwidth;
 		if(q_e - q_s <= band || t_e - t_s <= band) {//|| abs(t_e - t_s - q_e - q_s) >= 32) {
 			if(Frag_align) {
-				NWstat = NW(tseq, qseq, 1 + (t_e == t_len), t_s, t_e, q_s, q_e, Frag_align, matrices, t_len);
+				NWstat = NW(tseq, qseq, 1 + (t_e == t_len || clip), t_s, t_e, q_s, q_e, Frag_align, matrices, t_len);
 			} else {
-				NWstat = NW_score(tseq, qseq, 1 + (t_e == t_len), t_s, t_e, q_s, q_e, matrices, t_len);
+				NWstat = NW_score(tseq, qseq, 1 + (t_e == t_len || clip), t_s, t_e, q_s, q_e, matrices, t_len);
 			}
 		} else if(Frag_align) {
-			NWstat = NW_band(tseq, qseq, 1 + (t_e == t_len), t_s, t_e, q_s, q_e, Frag_align, band, matrices, t_len);
+			NWstat = NW_band(tseq, qseq, 1 + (t_e == t_len || clip), t_s, t_e, q_s, q_e, Frag_align, band, matrices, t_len);
 			//NWstat = NW(tseq, qseq, 1 + (t_e == t_len), t_s, t_e, q_s, q_e, Frag_align, matrices, t_len);
 		} else {
-			NWstat = NW_band_score(tseq, qseq, 1 + (t_e == t_len), t_s, t_e, q_s, q_e, band, matrices, t_len);
+			NWstat = NW_band_score(tseq, qseq, 1 + (t_e == t_len || clip), t_s, t_e, q_s, q_e, band, matrices, t_len);
 		}
 		
 		if(Frag_align) {
@@ -213,7 +804,7 @@ void trailTailAln(Aln *aligned, Aln *Frag_align, AlnScore *Stat, const long unsi
 
 AlnScore KMA(const HashMapCCI *template_index, const unsigned char *qseq, int q_len, int q_start, int q_end, Aln *aligned, Aln *Frag_align, int min, int max, int mq, double scoreT, AlnPoints *points, NWmat *matrices) {
 	
-	int i, j, k, bias, prev, start, stop, t_len, value, end, mem_count, band;
+	int i, j, k, bias, prev, start, stop, t_len, value, end, mem_count, band, stride;
 	int t_l, t_s, t_e, q_s, q_e, score, shifter, kmersize, U, M, *seeds, **d;
 	long unsigned key, mask;
 	unsigned char nuc;
@@ -232,6 +823,8 @@ AlnScore KMA(const HashMapCCI *template_index, const unsigned char *qseq, int q_
 	mask = (~mask) >> (sizeof(long unsigned) * sizeof(long unsigned) - (kmersize << 1));
 	key = 0;
 	
+	stride = (alnStride && ALNSTRIDELEN <= q_len) ? alnStride : 1;
+	
 	/* circular, skip boundaries */
 	if(min < max) {
 		min = 0;
@@ -264,7 +857,10 @@ AlnScore KMA(const HashMapCCI *template_index, const unsigned char *qseq, int q_
 				value = hashMapCCI_get_bound(template_index, key, min, max, shifter);
 				
 				if(value == 0) {
-					++i;
+					/* roll over the k-mers not probed */
+					for(k = i + stride; ++i < k && i < end;) {
+						key = ((key << 2) | qseq[i]) & mask;
+					}
 				} else if(0 < value) {
 					i -= (kmersize - 1);
 					
@@ -301,6 +897,12 @@ AlnScore KMA(const HashMapCCI *template_index, const unsigned char *qseq, int q_
 						seedPoint_realloc(points, points->size << 1);
 					}
 					
+					/* continue over the origin */
+					if((value = originSeed(template_index, qseq, i, end, points, mem_count))) {
+						i += value;
+						++mem_count;
+					}
+					
 					/* update position */
 					if(i < end - kmersize) {
 						key = makeKmer(qseq, i, kmersize - 1);
@@ -374,6 +976,9 @@ AlnScore KMA(const HashMapCCI *template_index, const unsigned char *qseq, int q_
 			}
 			i = end + 1;
 		}
+		if(!mem_count) {
+			mem_count = fuzzySeed(template_index, qseq, q_start, q_end, points);
+		}
 	}
 	aligned->mapQ = 0;
 	
@@ -475,15 +1080,22 @@ AlnScore KMA(const HashMapCCI *template_index, const unsigned char *qseq, int q_
 			}
 			if((t_l > 0 || q_e - q_s > 0)) {
 				band = abs(t_l - q_e + q_s) + template_index->bandwidth;
-				if(q_e - q_s <= band || t_l <= band) {// || abs(t_e - t_s - q_e - q_s) >= 32) {
-					NWstat = NW(template_index->seq, qseq, 0, t_s, t_e, q_s, q_e, Frag_align, matrices, t_len);
+				if(xDrop && t_l == q_e - q_s && t_s <= t_e) {
+					band = xDropBand(template_index->seq, qseq, t_s, q_s, t_l, band, rewards);
+				}
+				if(nwWindow && t_s <= t_e && nwWindow < nwCells(t_l, q_e - q_s, band)) {
+					NWstat = NW_window(template_index->seq, qseq, t_s, t_e, q_s, q_e, aligned, Stat.len, template_index->bandwidth, matrices, t_len);
 				} else {
-					NWstat = NW_band(template_index->seq, qseq, 0, t_s, t_e, q_s, q_e, Frag_align, band, matrices, t_len);
-					//NWstat = NW(template_index->seq, qseq, 0, t_s, t_e, q_s, q_e, Frag_align, matrices, t_len);
+					if(q_e - q_s <= band || t_l <= band) {// || abs(t_e - t_s - q_e - q_s) >= 32) {
+						NWstat = NW(template_index->seq, qseq, 0, t_s, t_e, q_s, q_e, Frag_align, matrices, t_len);
+					} else {
+						NWstat = NW_band(template_index->seq, qseq, 0, t_s, t_e, q_s, q_e, Frag_align, band, matrices, t_len);
+						//NWstat = NW(template_index->seq, qseq, 0, t_s, t_e, q_s, q_e, Frag_align, matrices, t_len);
+					}
+					memcpy(aligned->t + Stat.len, Frag_align->t, NWstat.len);
+					memcpy(aligned->s + Stat.len, Frag_align->s, NWstat.len);
+					memcpy(aligned->q + Stat.len, Frag_align->q, NWstat.len);
 				}
-				memcpy(aligned->t + Stat.len, Frag_align->t, NWstat.len);
-				memcpy(aligned->s + Stat.len, Frag_align->s, NWstat.len);
-				memcpy(aligned->q + Stat.len, Frag_align->q, NWstat.len);
 				Stat.score += NWstat.score;
 				Stat.len += NWstat.len;
 				Stat.match += NWstat.match;
@@ -506,7 +1118,7 @@ AlnScore KMA(const HashMapCCI *template_index, const unsigned char *qseq, int q_
 
 AlnScore KMA_score(const HashMapCCI *template_index, const unsigned char *qseq, int q_len, int q_start, int q_end, const CompDNA *qseq_comp, int mq, double scoreT, AlnPoints *points, NWmat *matrices) {
 	
-	int i, j, k, l, bias, prev, start, stop, t_len, value, end, U, M, band;
+	int i, j, k, l, bias, prev, start, stop, t_len, value, end, U, M, band, stride;
 	int t_l, t_s, t_e, q_s, q_e, mem_count, score, kmersize, *seeds, **d;
 	unsigned mapQ, shifter, cPos, iPos;
 	long unsigned key;
@@ -522,6 +1134,7 @@ AlnScore KMA_score(const HashMapCCI *template_index, const unsigned char *qseq,
 	t_len = template_index->len;
 	kmersize = template_index->kmerindex;
 	shifter = sizeof(long unsigned) * sizeof(long unsigned) - (kmersize << 1);
+	stride = (alnStride && ALNSTRIDELEN <= q_len) ? alnStride : 1;
 	
 	/* find seeds */
 	if(points->len) {
@@ -540,7 +1153,7 @@ AlnScore KMA_score(const HashMapCCI *template_index, const unsigned char *qseq,
 				value = hashMapCCI_get(template_index, key, shifter);
 				
 				if(value == 0) {
-					++j;
+					j += stride;
 				} else if(0 < value) {
 					/* backseed for ambiguos seeds */
 					prev = value - 2;
@@ -577,6 +1190,12 @@ AlnScore KMA_score(const HashMapCCI *template_index, const unsigned char *qseq,
 					if(mem_count == points->size) {
 						seedPoint_realloc(points, points->size << 1);
 					}
+					
+					/* continue over the origin */
+					if((value = originSeed(template_index, qseq, j, end + kmersize - 1, points, mem_count))) {
+						j += value;
+						++mem_count;
+					}
 				} else {
 					/* get position in hashmap */
 					seeds = hashMapCCI_getDubPos(template_index, key, value, shifter);
@@ -633,6 +1252,9 @@ AlnScore KMA_score(const HashMapCCI *template_index, const unsigned char *qseq,
 			}
 			j = qseq_comp->N[i] + 1;
 		}
+		if(!mem_count) {
+			mem_count = fuzzySeed(template_index, qseq, q_start, q_end, points);
+		}
 	}
 	mapQ = 0;
 	
@@ -652,7 +1274,7 @@ AlnScore KMA_score(const HashMapCCI *template_index, const unsigned char *qseq,
 	/* get best seed chain, returns best starting point */
 	start = chainSeedsPtr(points, q_len, t_len, kmersize, &mapQ);
 	score = points->score[start];
-	if(mapQ < mq || score < kmersize) {
+	if(mapQ < mq || score < kmersize || editReject(template_index, qseq, q_len, scoreT, points, start, rewards)) {
 		Stat.score = 0;
 		Stat.len = 1;
 		Stat.match = 0;
@@ -721,7 +1343,12 @@ AlnScore KMA_score(const HashMapCCI *template_index, const unsigned char *qseq,
 			}
 			if((t_l > 0 || q_e - q_s > 0)) {
 				band = abs(t_l - q_e + q_s) + template_index->bandwidth;
-				if(q_e - q_s <= band || t_l <= band) {
+				if(xDrop && t_l == q_e - q_s && t_s <= t_e) {
+					band = xDropBand(template_index->seq, qseq, t_s, q_s, t_l, band, rewards);
+				}
+				if(nwWindow && t_s <= t_e && nwWindow < nwCells(t_l, q_e - q_s, band)) {
+					NWstat = NW_window(template_index->seq, qseq, t_s, t_e, q_s, q_e, 0, 0, template_index->bandwidth, matrices, t_len);
+				} else if(q_e - q_s <= band || t_l <= band) {
 					NWstat = NW_score(template_index->seq, qseq, 0, t_s, t_e, q_s, q_e, matrices, t_len);
 				} else {
 					NWstat = NW_band_score(template_index->seq, qseq, 0, t_s, t_e, q_s, q_e, band, matrices, t_len);
@@ -747,18 +1374,28 @@ AlnScore KMA_score(const HashMapCCI *template_index, const unsigned char *qseq,
 int preseed(const HashMapCCI *template_index, unsigned char *qseq, int q_len) {
 	
 	static int exhaustive = 1;
-	int i, shifter, kmersize, len;
+	int i, n, shifter, kmersize, len;
+	long unsigned keys[CCIBATCH];
 	
-	if(exhaustive) {
+	if(!template_index) {
 		exhaustive = q_len;
 		return 0;
+	} else if(exhaustive) {
+		return 0;
 	}
 	
 	kmersize = template_index->kmerindex;
 	len = template_index->len;
 	shifter = sizeof(long unsigned) * sizeof(long unsigned) - (kmersize << 1);
-	for(i = 0; i < q_len; i += kmersize) {
-		if(hashMapCCI_get_bound(template_index, makeKmer(qseq, i, kmersize), 0, len, shifter)) {
+	i = 0;
+	while(i < q_len) {
+		/* gather a block of seeds, and probe them together */
+		n = 0;
+		while(n < CCIBATCH && i < q_len) {
+			keys[n++] = makeKmer(qseq, i, kmersize);
+			i += kmersize;
+		}
+		if(hashMapCCI_get_bound_batch(template_index, keys, n, 0, len, shifter) != n) {
 			return 0;
 		}
 	}
@@ -778,7 +1415,7 @@ int anker_rc(const HashMapCCI *template_index, unsigned char *qseq, int q_len, i
 	
 	static int one2one = 0;
 	int i, j, k, rc, end, score, score_r, value, t_len, prev, bias;
-	int bestScore, mem_count, totMems, shifter, kmersize, *seeds;
+	int bestScore, mem_count, totMems, shifter, kmersize, stride, *seeds;
 	long unsigned key, mask;
 	
 	if(!template_index) {
@@ -792,6 +1429,7 @@ int anker_rc(const HashMapCCI *template_index, unsigned char *qseq, int q_len, i
 	mask = 0;
 	mask = (~mask) >> (sizeof(long unsigned) * sizeof(long unsigned) - (kmersize << 1));
 	key = 0;
+	stride = (alnStride && ALNSTRIDELEN <= q_len) ? alnStride : 1;
 	
 	/* find seeds */
 	bestScore = 0;
@@ -832,7 +1470,10 @@ int anker_rc(const HashMapCCI *template_index, unsigned char *qseq, int q_len, i
 				value = hashMapCCI_get(template_index, key, shifter);
 				
 				if(value == 0) {
-					++i;
+					/* roll over the k-mers not probed */
+					for(k = i + stride; ++i < k && i < end;) {
+						key = ((key << 2) | qseq[i]) & mask;
+					}
 				} else if(0 < value) {
 					i -= (kmersize - 1);
 					
@@ -873,6 +1514,14 @@ int anker_rc(const HashMapCCI *template_index, unsigned char *qseq, int q_len, i
 						seedPoint_realloc(points, points->size << 1);
 					}
 					
+					/* continue over the origin */
+					if((value = originSeed(template_index, qseq, i, end, points, totMems))) {
+						i += value;
+						score_r += value;
+						++mem_count;
+						++totMems;
+					}
+					
 					/* update position */
 					if(i < end - kmersize) {
 						key = makeKmer(qseq, i, kmersize - 1);
@@ -989,7 +1638,7 @@ int anker_rc_comp(const HashMapCCI *template_index, unsigned char *qseq, unsigne
 	
 	static int one2one = 0;
 	int i, j, k, rc, end, score, score_r, value, t_len, q_len, prev;
-	int bestScore, mem_count, totMems, shifter, kmersize, bias, *Ns, *seeds;
+	int bestScore, mem_count, totMems, shifter, kmersize, bias, stride, *Ns, *seeds;
 	unsigned cPos, iPos;
 	long unsigned key, mask, *seq;
 	
@@ -999,6 +1648,7 @@ int anker_rc_comp(const HashMapCCI *template_index, unsigned char *qseq, unsigne
 	}
 	
 	q_len = qseq_comp->seqlen;
+	stride = (alnStride && ALNSTRIDELEN <= q_len) ? alnStride : 1;
 	t_len = template_index->len;
 	kmersize = template_index->kmerindex;
 	shifter = sizeof(long unsigned) * sizeof(long unsigned) - (kmersize << 1);
@@ -1043,7 +1693,7 @@ int anker_rc_comp(const HashMapCCI *template_index, unsigned char *qseq, unsigne
 				value = hashMapCCI_get(template_index, key, shifter);
 				
 				if(value == 0) {
-					++i;
+					i += stride;
 				} else if(0 < value) {
 					/* backseed for ambiguos seeds */
 					prev = value - 2;
@@ -1082,6 +1732,14 @@ int anker_rc_comp(const HashMapCCI *template_index, unsigned char *qseq, unsigne
 						seedPoint_realloc(points, points->size << 1);
 					}
 					
+					/* continue over the origin */
+					if((value = originSeed(template_index, qseq, i, end, points, totMems))) {
+						i += value;
+						score_r += value;
+						++mem_count;
+						++totMems;
+					}
+					
 					/* update position */
 					++i;
 				} else {
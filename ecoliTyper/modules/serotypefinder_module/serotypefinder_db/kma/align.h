@@ -17,14 +17,24 @@
  * limitations under the License.
 */
 #define _XOPEN_SOURCE 600
+#include <stdio.h>
 #include "chain.h"
 #include "compdna.h"
 #include "hashmapcci.h"
 #include "nw.h"
 
+#define ALNSTRIDELEN 1024 /* query length from which -astride applies */
+
 extern AlnScore (*leadTailAlnPtr)(Aln *, Aln *, const long unsigned*, const unsigned char*, int, int, int, const int, NWmat *);
 extern void (*trailTailAlnPtr)(Aln *, Aln *, AlnScore *, const long unsigned *, const unsigned char *, int, int, int, int, const int, NWmat *);
 
+void setXdrop(int X);
+void xDropReport(FILE *out);
+void setFuzzy(int mm);
+void setAlnStride(int stride);
+void fuzzyReport(FILE *out);
+void setNWwindow(long unsigned cells);
+void nwWindowReport(FILE *out);
 AlnScore skipLeadAln(Aln *aligned, Aln *Frag_align, const long unsigned *tseq, const unsigned char *qseq, int t_e, int t_len, int q_e, const int bandwidth, NWmat *matrices);
 AlnScore leadTailAln(Aln *aligned, Aln *Frag_align, const long unsigned *tseq, const unsigned char *qseq, int t_e, int t_len, int q_e, const int bandwidth, NWmat *matrices);
 void skipTrailAln(Aln *aligned, Aln *Frag_align, AlnScore *Stat, const long unsigned *tseq, const unsigned char *qseq, int t_s, int t_len, int q_s, int q_len, const int bandwidth, NWmat *matrices);
@@ -27,6 +27,7 @@
 #include "frags.h"
 #include "filebuff.h"
 #include "hashmapcci.h"
+#include "kmastat.h"
 #include "pherror.h"
 #include "qseqs.h"
 #include "sam.h"
@@ -38,6 +39,7 @@
 #define mrcheck(mrc, Stat, q_len, t_len) ((mrc * q_len <= Stat.len - Stat.qGaps) || (mrc * t_len <= Stat.len - Stat.tGaps))
 
 int (*alnFragsPE)(HashMapCCI**, int*, int*, int, double, double, double, int, CompDNA*, CompDNA*, CompDNA*, CompDNA*, unsigned char*, unsigned char*, unsigned char*, unsigned char*, Qseqs*, Qseqs*, int, int*, int*, long unsigned*, long unsigned*, int*, int*, int*, int*, int*, int*, int, long*, FILE*, AlnPoints*, NWmat*, volatile int*, volatile int*) = alnFragsUnionPE;
+static int alnBatch = 0;
 
 int alnFragsSE_old(HashMapCCI **templates_index, int *matched_templates, int *template_lengths, int mq, double scoreT, double mrc, int minlen, int rc_flag, CompDNA *qseq_comp, CompDNA *qseq_r_comp, unsigned char *qseq, unsigned char *qseq_r, int q_len, int kmersize, Qseqs *header, int *bestTemplates, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, int *best_start_pos, int *best_end_pos, int *flag, int *best_read_score, int seq_in, long *seq_indexes, FILE *frag_out_raw, AlnPoints *points, NWmat *NWmatrices, volatile int *excludeOut, volatile int *excludeDB) {
 	
@@ -2028,11 +2030,11 @@ int alnFragsForcePE(HashMapCCI **templates_index, int *matched_templates, int *t
 			rc = anker_rc_comp(templates_index[template], qseq, qseq_fr, qseq_comp, qseq_fr_comp, 0, qseq_comp->seqlen, points);
 			if(rc < 0) {
 				/* rc */
-				alnStat = KMA_score(templates_index[template], qseq_fr, qseq_fr_comp->seqlen, 0, qseq_fr_comp->seqlen, qseq_fr_comp, mq, scoreT, points, NWmatrices);
+				alnStat = KMA_score(templates_index[template], qseq_fr, qseq_fr_comp->seqlen, 0, qseq_fr_comp->seqlen, qseq_fr_comp, mq, 0, points, NWmatrices);
 			} else if(rc) {
 				/* forward */
 				matched_templates[t_i] = -matched_templates[t_i];;
-				alnStat = KMA_score(templates_index[template], qseq, qseq_comp->seqlen, 0, qseq_comp->seqlen, qseq_comp, mq, scoreT, points, NWmatrices);
+				alnStat = KMA_score(templates_index[template], qseq, qseq_comp->seqlen, 0, qseq_comp->seqlen, qseq_comp, mq, 0, points, NWmatrices);
 			} else {
 				alnStat.score = 0;
 				alnStat.pos = 0;
@@ -2042,7 +2044,7 @@ int alnFragsForcePE(HashMapCCI **templates_index, int *matched_templates, int *t
 				points->len = 0;
 			}
 		} else {
-			alnStat = KMA_score(templates_index[template], qseq, qseq_comp->seqlen, 0, qseq_comp->seqlen, qseq_comp, mq, scoreT, points, NWmatrices);
+			alnStat = KMA_score(templates_index[template], qseq, qseq_comp->seqlen, 0, qseq_comp->seqlen, qseq_comp, mq, 0, points, NWmatrices);
 		}
 		
 		t_len = template_lengths[abs(template)];
@@ -2050,10 +2052,10 @@ int alnFragsForcePE(HashMapCCI **templates_index, int *matched_templates, int *t
 			if(arc) {
 				if(rc < 0) {
 					/* rc */
-					alnStat_r = KMA_score(templates_index[template], qseq_rr, qseq_rr_comp->seqlen, 0, qseq_rr_comp->seqlen, qseq_rr_comp, mq, scoreT, points, NWmatrices);
+					alnStat_r = KMA_score(templates_index[template], qseq_rr, qseq_rr_comp->seqlen, 0, qseq_rr_comp->seqlen, qseq_rr_comp, mq, 0, points, NWmatrices);
 				} else if(rc) {
 					/* forward */
-					alnStat_r = KMA_score(templates_index[template], qseq_r, qseq_r_comp->seqlen, 0, qseq_r_comp->seqlen, qseq_r_comp, mq, scoreT, points, NWmatrices);
+					alnStat_r = KMA_score(templates_index[template], qseq_r, qseq_r_comp->seqlen, 0, qseq_r_comp->seqlen, qseq_r_comp, mq, 0, points, NWmatrices);
 				} else {
 					alnStat_r.score = 0;
 					alnStat_r.pos = 0;
@@ -2063,7 +2065,7 @@ int alnFragsForcePE(HashMapCCI **templates_index, int *matched_templates, int *t
 				}
 				rc = 1;
 			} else {
-				alnStat_r = KMA_score(templates_index[template], qseq_r, qseq_r_comp->seqlen, 0, qseq_r_comp->seqlen, qseq_r_comp, mq, scoreT, points, NWmatrices);
+				alnStat_r = KMA_score(templates_index[template], qseq_r, qseq_r_comp->seqlen, 0, qseq_r_comp->seqlen, qseq_r_comp, mq, 0, points, NWmatrices);
 			}
 			
 			/* get read score */
@@ -2143,6 +2145,10 @@ int alnFragsForcePE(HashMapCCI **templates_index, int *matched_templates, int *t
 	return 3;
 }
 
+void setAlnBatch(int size) {
+	alnBatch = size;
+}
+
 void * alnFrags_threaded(void * arg) {
 	
 	static volatile int Lock[3] = {0, 0, 0};
@@ -2150,6 +2156,7 @@ void * alnFrags_threaded(void * arg) {
 	Aln_thread *thread = arg;
 	int rc_flag, read_score, delta, seq_in, kmersize, minlen;
 	int flag, flag_r, mq, sam, unmapped, best_read_score, stats[2];
+	long unsigned mapped, cpu[STAT_TIMER];
 	int *matched_templates, *bestTemplates, *bestTemplates_r;
 	int *template_lengths, *best_start_pos, *best_end_pos, *Lengths;
 	long *seq_indexes;
@@ -2163,8 +2170,10 @@ void * alnFrags_threaded(void * arg) {
 	AlnPoints *points;
 	NWmat *NWmatrices;
 	HashMapCCI **templates_index;
+	AnkerBatch *batch;
 	
 	/* get input */
+	kmaStat_start(cpu);
 	matched_templates = thread->matched_templates;
 	bestTemplates = thread->bestTemplates;
 	bestTemplates_r = thread->bestTemplates_r;
@@ -2202,20 +2211,33 @@ void * alnFrags_threaded(void * arg) {
 	qseq_rr = smalloc(32);
 	delta = qseq->size;
 	read_score = 0;
+	mapped = 0;
 	stats[0] = 0;
+	batch = alnBatch ? ankerBatch_init(alnBatch) : 0;
 	//lock(excludeIn);
-	lockTime(excludeIn, 65536);
-	while((rc_flag = get_ankers(matched_templates, qseq_comp, header, &flag, inputfile)) != 0) {
+	if(batch) {
+		rc_flag = get_ankers_batch(batch, matched_templates, qseq_comp, header, &flag, inputfile, excludeIn);
+	} else {
+		lockTime(excludeIn, 65536);
+		rc_flag = get_ankers(matched_templates, qseq_comp, header, &flag, inputfile);
+	}
+	while(rc_flag != 0) {
 		points->len = rc_flag < 0;
 		if(*matched_templates) { // SE
 			read_score = 0;
 			qseq_r->len = 0;
+		} else if(batch) { // PE
+			read_score = get_ankers_batch(batch, matched_templates, qseq_r_comp, header_r, &flag_r, inputfile, excludeIn);
+			read_score = labs(read_score);
+			qseq_r->len = qseq_r_comp->seqlen;
 		} else { // PE
 			read_score = get_ankers(matched_templates, qseq_r_comp, header_r, &flag_r, inputfile);
 			read_score = labs(read_score);
 			qseq_r->len = qseq_r_comp->seqlen;
 		}
-		unlock(excludeIn);
+		if(!batch) {
+			unlock(excludeIn);
+		}
 		qseq->len = qseq_comp->seqlen;
 		
 		if(delta <= MAX(qseq->len, qseq_r->len)) {
@@ -2247,8 +2269,10 @@ void * alnFrags_threaded(void * arg) {
 		if(kmersize <= qseq->len) {
 			if(read_score && kmersize <= qseq_r->len) { // PE
 				unmapped = alnFragsPE(templates_index, matched_templates, template_lengths, mq, scoreT, mrc, minFrac, minlen, qseq_comp, qseq_r_comp, qseq_fr_comp, qseq_rr_comp, qseq->seq, qseq_r->seq, qseq_fr, qseq_rr, header, header_r, kmersize, bestTemplates, bestTemplates_r, alignment_scores, uniq_alignment_scores, best_start_pos, best_end_pos, &flag, &flag_r, &best_read_score, &read_score, seq_in, seq_indexes, frag_out_raw, points, NWmatrices, excludeOut, excludeDB);
+				mapped += unmapped != 3;
 			} else { // SE
 				unmapped = alnFragsSE(templates_index, matched_templates, template_lengths, mq, scoreT, mrc, minFrac, minlen, rc_flag, qseq_comp, qseq_r_comp, qseq->seq, qseq_r->seq, qseq->len, kmersize, header, bestTemplates, alignment_scores, uniq_alignment_scores, bestTemplates_r, Lengths, best_start_pos, best_end_pos, &flag, &best_read_score, seq_in, seq_indexes, frag_out_raw, points, NWmatrices, excludeOut, excludeDB);
+				mapped += !(unmapped & 1);
 				//unmapped = alnFragsSE(templates_index, matched_templates, template_lengths, mq, scoreT, mrc, minlen, rc_flag, qseq_comp, qseq_r_comp, qseq->seq, qseq_r->seq, qseq->len, kmersize, header, bestTemplates, alignment_scores, uniq_alignment_scores, best_start_pos, best_end_pos, &flag, &best_read_score, seq_in, seq_indexes, frag_out_raw, points, NWmatrices, excludeOut, excludeDB);
 			}
 		} else {
@@ -2277,14 +2301,28 @@ void * alnFrags_threaded(void * arg) {
 				updateAllFrag(qseq_r->seq, qseq_r->len, *matched_templates, read_score, best_start_pos, best_end_pos, bestTemplates, header_r, frag_out_all);
 			}
 		}
-		lock(excludeIn);
+		if(batch) {
+			rc_flag = get_ankers_batch(batch, matched_templates, qseq_comp, header, &flag, inputfile, excludeIn);
+		} else {
+			lock(excludeIn);
+			rc_flag = get_ankers(matched_templates, qseq_comp, header, &flag, inputfile);
+		}
+	}
+	if(batch) {
+		ankerBatch_destroy(batch);
+	} else {
+		unlock(excludeIn);
 	}
-	unlock(excludeIn);
+	lock(excludeOut);
+	fragFlush();
+	unlock(excludeOut);
 	
 	destroyComp(qseq_fr_comp);
 	destroyComp(qseq_rr_comp);
 	free(qseq_fr);
 	free(qseq_rr);
+	kmaStat_add(STAT_MAPPED, mapped);
+	kmaStat_cpu(STAT_ALIGNMENT, cpu);
 	
 	return NULL;
 }
@@ -16,61 +16,134 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
 */
+#define _GNU_SOURCE /* fopencookie */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#undef _XOPEN_SOURCE
 #include "ankers.h"
 #include "compdna.h"
+#include "kmatrace.h"
 #include "pherror.h"
 #include "qseqs.h"
+#include "threader.h"
 
 int (*printPtr)(int*, CompDNA*, int, const Qseqs*, const int, FILE *out) = &print_ankers;
 int (*printPairPtr)(int*, CompDNA*, int, const Qseqs*, CompDNA*, int, const Qseqs*, const int flag, const int flag_r, FILE *out) = &printPair;
 int (*deConPrintPtr)(int*, CompDNA*, int, const Qseqs*, const int flag, FILE *out) = &print_ankers;
 
-int print_ankers(int *out_Tem, CompDNA *qseq, int rc_flag, const Qseqs *header, const int flag, FILE *out) {
+static __thread unsigned char *ankerLocal = 0;
+static __thread long unsigned ankerSize = 0;
+
+static inline unsigned char * putVar(unsigned char *dest, unsigned num) {
+	
+	while(128 <= num) {
+		*dest++ = num | 128;
+		num >>= 7;
+	}
+	*dest++ = num;
 	
-	int infoSize[7];
+	return dest;
+}
+
+static inline unsigned char * putZig(unsigned char *dest, int num) {
+	return putVar(dest, ((unsigned) num << 1) ^ (unsigned)(num >> 31));
+}
+
+static inline unsigned getVar(unsigned char **src) {
 	
-	infoSize[0] = qseq->seqlen;
-	infoSize[1] = qseq->complen;
-	infoSize[2] = *(qseq->N);
-	infoSize[3] = rc_flag;
-	infoSize[4] = *out_Tem;
-	infoSize[5] = header->len;
-	infoSize[6] = flag;
-	sfwrite(infoSize, sizeof(int), 7, out);
-	sfwrite(qseq->seq, sizeof(long unsigned), qseq->complen, out);
-	if(*(qseq->N)) {
-		sfwrite(qseq->N + 1, sizeof(int), *(qseq->N), out);
+	unsigned num, shift;
+	unsigned char *ptr;
+	
+	ptr = *src;
+	num = *ptr & 127;
+	shift = 0;
+	while(*ptr++ & 128) {
+		shift += 7;
+		num |= (unsigned)(*ptr & 127) << shift;
 	}
-	sfwrite(out_Tem + 1, sizeof(int), *out_Tem, out);
-	sfwrite(header->seq, 1, header->len, out);
+	*src = ptr;
 	
-	return 0;
+	return num;
 }
 
-int print_ankers_Sparse(int *out_Tem, CompDNA *qseq, int rc_flag, const Qseqs *header, const int flag, FILE *out) {
+static inline int getZig(unsigned char **src) {
+	
+	unsigned num;
 	
-	int infoSize[7];
+	num = getVar(src);
+	
+	return (num >> 1) ^ -(num & 1);
+}
+
+static int ankerWrite(int *out_Tem, CompDNA *qseq, int rc_flag, const Qseqs *header, const int flag, FILE *out) {
 	
-	infoSize[0] = qseq->seqlen;
-	infoSize[1] = qseq->complen;
-	infoSize[2] = *(qseq->N);
-	infoSize[3] = rc_flag < 0 ? rc_flag : -rc_flag;
-	infoSize[4] = *out_Tem;
-	infoSize[5] = header->len;
-	infoSize[6] = flag;
-	sfwrite(infoSize, sizeof(int), 7, out);
-	sfwrite(qseq->seq, sizeof(long unsigned), qseq->complen, out);
-	if(*(qseq->N)) {
-		sfwrite(qseq->N + 1, sizeof(int), *(qseq->N), out);
+	int i, pos, *N;
+	long unsigned size;
+	unsigned char *ptr, *start;
+	
+	/*
+	Record: varint length, followed by the varint fields seqlen, complen,
+	N, score, templates, header length and flag, the packed sequence,
+	delta coded N positions, zigzag templates and the header.
+	*/
+	size = 45 + qseq->complen * sizeof(long unsigned) + 5 * (*(qseq->N) + *out_Tem) + header->len;
+	if(ankerSize < size) {
+		free(ankerLocal);
+		ankerSize = size << 1;
+		ankerLocal = smalloc(ankerSize);
+	}
+	ptr = ankerLocal + 5;
+	ptr = putVar(ptr, qseq->seqlen);
+	ptr = putVar(ptr, qseq->complen);
+	ptr = putVar(ptr, *(qseq->N));
+	ptr = putZig(ptr, rc_flag);
+	ptr = putVar(ptr, *out_Tem);
+	ptr = putVar(ptr, header->len);
+	ptr = putVar(ptr, flag);
+	memcpy(ptr, qseq->seq, qseq->complen * sizeof(long unsigned));
+	ptr += qseq->complen * sizeof(long unsigned);
+	N = qseq->N;
+	for(i = 1, pos = 0; i <= *N; ++i) {
+		ptr = putZig(ptr, N[i] - pos);
+		pos = N[i];
 	}
-	sfwrite(out_Tem + 1, sizeof(int), *out_Tem, out);
-	sfwrite(header->seq, 1, header->len, out);
+	for(i = 1; i <= *out_Tem; ++i) {
+		ptr = putZig(ptr, out_Tem[i]);
+	}
+	memcpy(ptr, header->seq, header->len);
+	ptr += header->len;
+	
+	/* prefix the length */
+	size = ptr - (ankerLocal + 5);
+	start = putVar(ankerLocal, size);
+	i = start - ankerLocal;
+	start = ankerLocal + 5 - i;
+	putVar(start, size);
+	sfwrite(start, 1, size + i, out);
 	
 	return 0;
 }
 
+int print_ankers(int *out_Tem, CompDNA *qseq, int rc_flag, const Qseqs *header, const int flag, FILE *out) {
+	return ankerWrite(out_Tem, qseq, rc_flag, header, flag, out);
+}
+
+int print_ankers_Sparse(int *out_Tem, CompDNA *qseq, int rc_flag, const Qseqs *header, const int flag, FILE *out) {
+	return ankerWrite(out_Tem, qseq, rc_flag < 0 ? rc_flag : -rc_flag, header, flag, out);
+}
+
+void print_ankers_head(FILE *out) {
+	sfwrite(&(int){ANKERVERSION}, sizeof(int), 1, out);
+}
+
+void print_ankers_tail(int fragCount, FILE *out) {
+	
+	/* empty record, followed by the number of fragments */
+	sfwrite(&(unsigned char){0}, 1, 1, out);
+	sfwrite(&fragCount, sizeof(int), 1, out);
+}
+
 int find_contamination(int *out_Tem, const int contamination) {
 	
 	int i;
@@ -162,59 +235,331 @@ int printPair(int *out_Tem, CompDNA *qseq, int bestScore, const Qseqs *header, C
 
 int get_ankers(int *out_Tem, CompDNA *qseq, Qseqs *header, int *flag, FILE *inputfile) {
 	
-	static int infoSize[7] = {0, 0, 0, 0, 0, 0, 0};
+	static int head = 0, tail = -1;
+	static long unsigned size = 0;
+	static unsigned char *buff = 0;
+	int i, c, pos, version, score, *N;
+	unsigned len, shift;
+	unsigned char *ptr;
 	
-	if(infoSize[0] < 0) {
-		*out_Tem = -infoSize[0];
+	if(!inputfile) {
+		/* new stream */
+		head = 0;
+		tail = -1;
+		return 0;
+	} else if(0 <= tail) {
+		*out_Tem = tail;
 		return 0;
-	} else if(fread(infoSize, sizeof(int), 7, inputfile) == 7) {
-		if(infoSize[0] < 0) {
-			*out_Tem = -infoSize[0];
+	} else if(!head) {
+		head = 1;
+		if(fread(&version, sizeof(int), 1, inputfile) != 1) {
+			*out_Tem = (tail = 0);
 			return 0;
+		} else if(version != ANKERVERSION) {
+			fprintf(stderr, "Anker stream is of another version.\n");
+			exit(1);
+		}
+	}
+	
+	/* get record length */
+	len = 0;
+	shift = 0;
+	while((c = getc(inputfile)) != EOF) {
+		len |= (unsigned)(c & 127) << shift;
+		if(c & 128) {
+			shift += 7;
+		} else {
+			break;
+		}
+	}
+	if(c == EOF) {
+		*out_Tem = (tail = 0);
+		return 0;
+	} else if(len == 0) {
+		if(fread(&tail, sizeof(int), 1, inputfile) != 1) {
+			tail = 0;
+		}
+		*out_Tem = tail;
+		return 0;
+	} else if(size < len) {
+		free(buff);
+		size = len << 1;
+		buff = smalloc(size);
+	}
+	sfread(buff, 1, len, inputfile);
+	
+	ptr = buff;
+	qseq->seqlen = getVar(&ptr);
+	qseq->complen = getVar(&ptr);
+	i = getVar(&ptr);
+	score = getZig(&ptr);
+	*out_Tem = getVar(&ptr);
+	header->len = getVar(&ptr);
+	*flag = getVar(&ptr);
+	
+	/* reallocate */
+	if(qseq->size <= qseq->seqlen) {
+		free(qseq->N);
+		free(qseq->seq);
+		if(qseq->seqlen & 31) {
+			qseq->size = (qseq->seqlen >> 5) + 1;
+			qseq->size <<= 6;
+		} else {
+			qseq->size = qseq->seqlen << 1;
 		}
-		qseq->seqlen = infoSize[0];
-		qseq->complen = infoSize[1];
-		*out_Tem = infoSize[4];
-		header->len = infoSize[5];
-		*flag = infoSize[6];
 		
-		/* reallocate */
-		if(qseq->size <= qseq->seqlen) {
-			free(qseq->N);
-			free(qseq->seq);
-			if(qseq->seqlen & 31) {
-				qseq->size = (qseq->seqlen >> 5) + 1;
-				qseq->size <<= 6;
-			} else {
-				qseq->size = qseq->seqlen << 1;
-			}
-			
-			qseq->seq = calloc(qseq->size >> 5, sizeof(long unsigned));
-			qseq->N = malloc((qseq->size + 1) * sizeof(int));
-			if(!qseq->seq || !qseq->N) {
-				ERROR();
-			}
+		qseq->seq = calloc(qseq->size >> 5, sizeof(long unsigned));
+		qseq->N = malloc((qseq->size + 1) * sizeof(int));
+		if(!qseq->seq || !qseq->N) {
+			ERROR();
+		}
+	}
+	if(header->size <= header->len) {
+		free(header->seq);
+		header->size = header->len << 1;
+		header->seq = malloc(header->size);
+		if(!header->seq) {
+			ERROR();
+		}
+	}
+	
+	memcpy(qseq->seq, ptr, qseq->complen * sizeof(long unsigned));
+	ptr += qseq->complen * sizeof(long unsigned);
+	N = qseq->N;
+	*N = i;
+	for(i = 1, pos = 0; i <= *N; ++i) {
+		pos += getZig(&ptr);
+		N[i] = pos;
+	}
+	for(i = 1; i <= *out_Tem; ++i) {
+		out_Tem[i] = getZig(&ptr);
+	}
+	memcpy(header->seq, ptr, header->len);
+	
+	/* return score */
+	return score;
+}
+
+AnkerBatch * ankerBatch_init(int size) {
+	
+	int i;
+	AnkerBatch *dest;
+	
+	/* size + 1 reads, as a pair may start on the last slot */
+	dest = smalloc(sizeof(AnkerBatch));
+	dest->size = size;
+	dest->n = 0;
+	dest->next = 0;
+	dest->len = 0;
+	dest->avail = 1024;
+	dest->mate = -1;
+	dest->t = 0;
+	dest->score = smalloc(3 * (size + 1) * sizeof(int));
+	dest->flag = dest->score + size + 1;
+	dest->order = dest->flag + size + 1;
+	dest->tem = smalloc(dest->avail * sizeof(int));
+	dest->keys = smalloc((size + 1) * sizeof(long unsigned));
+	dest->qseq = smalloc((size + 1) * sizeof(CompDNA));
+	dest->header = smalloc((size + 1) * sizeof(Qseqs));
+	for(i = 0; i <= size; ++i) {
+		allocComp(dest->qseq + i, 1024);
+		dest->header[i].size = 256;
+		dest->header[i].len = 0;
+		dest->header[i].seq = smalloc(256);
+	}
+	
+	return dest;
+}
+
+void ankerBatch_destroy(AnkerBatch *src) {
+	
+	int i;
+	
+	for(i = 0; i <= src->size; ++i) {
+		freeComp(src->qseq + i);
+		free(src->header[i].seq);
+	}
+	free(src->score);
+	free(src->tem);
+	free(src->keys);
+	free(src->qseq);
+	free(src->header);
+	free(src);
+}
+
+static int ankerKeyCmp(const void *a, const void *b) {
+	
+	long unsigned x, y;
+	
+	x = *((const long unsigned *) a);
+	y = *((const long unsigned *) b);
+	
+	return (x > y) - (x < y);
+}
+
+static int fillAnkerBatch(AnkerBatch *batch, int *out_Tem, FILE *inputfile) {
+	
+	int i, n, units, rc, template;
+	
+	/* read reads, keeping the pairs together */
+	n = 0;
+	units = 0;
+	batch->len = 0;
+	while(n < batch->size) {
+		i = n;
+		if(!(rc = get_ankers(out_Tem, batch->qseq + i, batch->header + i, batch->flag + i, inputfile))) {
+			break;
+		} else if(*out_Tem == 0) {
+			/* PE, the templates follow the mate */
+			batch->score[i] = rc;
+			batch->order[i] = batch->len;
+			batch->tem[batch->len++] = 0;
+			++i;
+			rc = get_ankers(out_Tem, batch->qseq + i, batch->header + i, batch->flag + i, inputfile);
 		}
+		batch->score[i] = rc;
+		batch->order[i] = batch->len;
 		
-		qseq->N[0] = infoSize[2];
-		if(header->size <= header->len) {
-			free(header->seq);
-			header->size = header->len << 1;
-			header->seq = malloc(header->size);
-			if(!header->seq) {
+		/* keep templates */
+		if(batch->avail <= batch->len + *out_Tem + 1) {
+			batch->avail = (batch->len + *out_Tem + 1) << 1;
+			batch->tem = realloc(batch->tem, batch->avail * sizeof(int));
+			if(!batch->tem) {
 				ERROR();
 			}
 		}
+		memcpy(batch->tem + batch->len, out_Tem, (*out_Tem + 1) * sizeof(int));
+		batch->len += *out_Tem + 1;
 		
-		sfread(qseq->seq, sizeof(long unsigned), qseq->complen, inputfile);
-		sfread(qseq->N + 1, sizeof(int), qseq->N[0], inputfile);
-		sfread(out_Tem + 1, sizeof(int), *out_Tem, inputfile);
-		sfread(header->seq, 1, header->len, inputfile);
-	} else {
-		*out_Tem = -infoSize[0];
-		return 0;
+		/* group on best template, keep input order within a template */
+		template = *out_Tem ? abs(out_Tem[1]) : 0;
+		batch->keys[units++] = ((long unsigned)(template) << 32) | (n << 1) | (i != n);
+		n = i + 1;
 	}
+	qsort(batch->keys, units, sizeof(long unsigned), &ankerKeyCmp);
+	batch->n = units;
+	batch->next = 0;
 	
-	/* return score */
-	return infoSize[3];
+	return units;
+}
+
+static int serveAnker(AnkerBatch *batch, int i, int *out_Tem, CompDNA *qseq, Qseqs *header, int *flag) {
+	
+	CompDNA tmpComp;
+	Qseqs tmpHeader;
+	
+	/* swap buffers with the slot, instead of copying */
+	tmpComp = *qseq;
+	*qseq = batch->qseq[i];
+	batch->qseq[i] = tmpComp;
+	tmpHeader = *header;
+	*header = batch->header[i];
+	batch->header[i] = tmpHeader;
+	*flag = batch->flag[i];
+	memcpy(out_Tem, batch->tem + batch->order[i], (batch->tem[batch->order[i]] + 1) * sizeof(int));
+	
+	return batch->score[i];
+}
+
+int get_ankers_batch(AnkerBatch *batch, int *out_Tem, CompDNA *qseq, Qseqs *header, int *flag, FILE *inputfile, volatile int *excludeIn) {
+	
+	int i;
+	long unsigned t;
+	
+	/*
+	Reads are served template wise from batches, a pair is served as
+	two calls in a row. Only one thread may use a batch.
+	*/
+	if(0 <= batch->mate) {
+		i = batch->mate;
+		batch->mate = -1;
+		return serveAnker(batch, i, out_Tem, qseq, header, flag);
+	} else if(batch->n <= batch->next) {
+		kmaTrace_end("align batch", "batch", batch->t, batch->n);
+		t = kmaTrace_begin();
+		lock(excludeIn);
+		i = fillAnkerBatch(batch, out_Tem, inputfile);
+		unlock(excludeIn);
+		kmaTrace_end("read batch", "io", t, batch->n);
+		batch->t = i ? kmaTrace_begin() : 0;
+		if(!i) {
+			return 0;
+		}
+	}
+	
+	i = (batch->keys[batch->next] & 0xFFFFFFFF) >> 1;
+	if(batch->keys[batch->next++] & 1) {
+		batch->mate = i + 1;
+	}
+	
+	return serveAnker(batch, i, out_Tem, qseq, header, flag);
+}
+
+#ifdef __GLIBC__
+static ssize_t ankerBuffWrite(void *cookie, const char *src, size_t size) {
+	
+	AnkerBuff *dest = cookie;
+	
+	if(dest->size < dest->len + size) {
+		dest->size = (dest->len + size) << 1;
+		dest->buff = realloc(dest->buff, dest->size);
+		if(!dest->buff) {
+			ERROR();
+		}
+	}
+	memcpy(dest->buff + dest->len, src, size);
+	dest->len += size;
+	
+	return size;
+}
+#endif
+
+AnkerBuff * ankerBuff_init(FILE *out, volatile int *excludeOut) {
+	
+#ifdef __GLIBC__
+	AnkerBuff *dest;
+	cookie_io_functions_t wfuncs = {NULL, &ankerBuffWrite, NULL, NULL};
+	
+	/* private sink, drained to out in whole records */
+	dest = smalloc(sizeof(AnkerBuff));
+	dest->out = out;
+	dest->excludeOut = excludeOut;
+	dest->len = 0;
+	dest->size = ANKERBUFF + (ANKERBUFF >> 2);
+	dest->buff = smalloc(dest->size);
+	if(!(dest->sink = fopencookie(dest, "wb", wfuncs))) {
+		ERROR();
+	}
+	setvbuf(dest->sink, NULL, _IONBF, 0);
+	
+	return dest;
+#else
+	return 0;
+#endif
+}
+
+void ankerBuff_drain(AnkerBuff *dest, int force) {
+	
+	long unsigned t;
+	
+	if(dest->len && (force || ANKERBUFF <= dest->len)) {
+		t = kmaTrace_begin();
+		lock(dest->excludeOut);
+		sfwrite(dest->buff, 1, dest->len, dest->out);
+		unlock(dest->excludeOut);
+		kmaTrace_end("write", "io", t, dest->len);
+		dest->len = 0;
+	}
+}
+
+void ankerBuff_destroy(AnkerBuff *dest) {
+	
+	fflush(dest->sink);
+	ankerBuff_drain(dest, 1);
+	fclose(dest->sink);
+	free(dest->buff);
+	free(dest);
+	free(ankerLocal);
+	ankerLocal = 0;
+	ankerSize = 0;
 }
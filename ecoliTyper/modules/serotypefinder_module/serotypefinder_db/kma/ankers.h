@@ -20,14 +20,55 @@
 #include "compdna.h"
 #include "qseqs.h"
 
+#ifndef ANKERS
+typedef struct ankerBuff AnkerBuff;
+struct ankerBuff {
+	FILE *sink;
+	FILE *out;
+	volatile int *excludeOut;
+	long unsigned len;
+	long unsigned size;
+	unsigned char *buff;
+};
+
+typedef struct ankerBatch AnkerBatch;
+struct ankerBatch {
+	int size;
+	int n;
+	int next;
+	int len;
+	int avail;
+	int mate;
+	long unsigned t; /* start of the batch, when traced */
+	int *score;
+	int *flag;
+	int *tem;
+	int *order;
+	long unsigned *keys;
+	CompDNA *qseq;
+	Qseqs *header;
+};
+#define ANKERS 1
+#define ANKERBUFF 1048576
+#define ANKERVERSION -2 /* negative, never a read length of the unversioned stream */
+#endif
+
 extern int (*printPtr)(int*, CompDNA*, int, const Qseqs*, const int, FILE *out);
 extern int (*printPairPtr)(int*, CompDNA*, int, const Qseqs*, CompDNA*, int, const Qseqs*, const int flag, const int flag_r, FILE *out);
 extern int (*deConPrintPtr)(int*, CompDNA*, int, const Qseqs*, const int flag, FILE *out);
 int print_ankers(int *out_Tem, CompDNA *qseq, int rc_flag, const Qseqs *header, const int flag, FILE *out);
 int print_ankers_Sparse(int *out_Tem, CompDNA *qseq, int rc_flag, const Qseqs *header, const int flag, FILE *out);
+void print_ankers_head(FILE *out);
+void print_ankers_tail(int fragCount, FILE *out);
 int find_contamination(int *out_Tem, const int contamination);
 int find_contamination2(int *out_Tem, const int contamination);
 int deConPrint(int *out_Tem, CompDNA *qseq, int rc_flag, const Qseqs *header, const int flag, FILE *out);
 int deConPrintPair(int *out_Tem, CompDNA *qseq, int bestScore, const Qseqs *header, CompDNA *qseq_r, int bestScore_r, const Qseqs *header_r, const int flag, const int flag_r, FILE *out);
 int printPair(int *out_Tem, CompDNA *qseq, int bestScore, const Qseqs *header, CompDNA *qseq_r, int bestScore_r, const Qseqs *header_r, const int flag, const int flag_r, FILE *out);
 int get_ankers(int *out_Tem, CompDNA *qseq, Qseqs *header, int *flag, FILE *inputfile);
+AnkerBatch * ankerBatch_init(int size);
+void ankerBatch_destroy(AnkerBatch *src);
+int get_ankers_batch(AnkerBatch *batch, int *out_Tem, CompDNA *qseq, Qseqs *header, int *flag, FILE *inputfile, volatile int *excludeIn);
+AnkerBuff * ankerBuff_init(FILE *out, volatile int *excludeOut);
+void ankerBuff_drain(AnkerBuff *dest, int force);
+void ankerBuff_destroy(AnkerBuff *dest);
@@ -0,0 +1,179 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _GNU_SOURCE /* fopencookie */
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#undef _XOPEN_SOURCE
+#include "aout.h"
+#include "kmatrace.h"
+#include "pherror.h"
+#include "threader.h"
+
+FILE * (*outFopenPtr)(const char *, const char *) = &sfopen;
+static long unsigned aoutBlock = 1048576;
+static long unsigned aoutSync = 0;
+
+#ifdef __GLIBC__
+static void aoutFlush(AoutFile *dest, long unsigned len) {
+	
+	long unsigned t, start;
+	
+	/* write up to the end of the ring at a time */
+	t = kmaTrace_begin();
+	start = dest->tail % dest->size;
+	if(dest->size - start < len) {
+		len = dest->size - start;
+	}
+	sfwrite(dest->buff + start, 1, len, dest->file);
+	kmaTrace_end("write", "io", t, len);
+	__sync_synchronize();
+	dest->tail += len;
+	
+	/* sync every aoutSync bytes */
+	if(1 < aoutSync && aoutSync <= dest->tail - dest->synced) {
+		if(fsync(fileno(dest->file))) {
+			ERROR();
+		}
+		dest->synced = dest->tail;
+	}
+}
+
+static void * aoutWriter(void *arg) {
+	
+	int idle;
+	long unsigned avail;
+	AoutFile *dest = arg;
+	
+	/*
+	Small writes are gathered into blocks, pending data is written
+	anyway when no more has come for AOUTIDLE polls.
+	*/
+	idle = 0;
+	while(!dest->closed) {
+		avail = dest->head - dest->tail;
+		if(aoutBlock <= avail || (avail && AOUTIDLE <= ++idle)) {
+			aoutFlush(dest, avail);
+			idle = 0;
+		} else {
+			nanosleep(sleepSpec(100000), NULL);
+		}
+	}
+	__sync_synchronize();
+	while((avail = dest->head - dest->tail)) {
+		aoutFlush(dest, avail);
+	}
+	
+	return NULL;
+}
+
+static ssize_t aoutWrite(void *cookie, const char *buf, size_t size) {
+	
+	long unsigned avail, start, len, written;
+	AoutFile *dest = cookie;
+	
+	written = 0;
+	while(written < size) {
+		/* wait for the writer to make room */
+		while((avail = dest->size - (dest->head - dest->tail)) == 0) {
+			nanosleep(sleepSpec(100000), NULL);
+		}
+		__sync_synchronize();
+		if(size - written < avail) {
+			avail = size - written;
+		}
+		
+		start = dest->head % dest->size;
+		len = dest->size - start;
+		if(avail <= len) {
+			memcpy(dest->buff + start, buf, avail);
+		} else {
+			memcpy(dest->buff + start, buf, len);
+			memcpy(dest->buff, buf + len, avail - len);
+		}
+		__sync_synchronize();
+		dest->head += avail;
+		buf += avail;
+		written += avail;
+	}
+	
+	return written;
+}
+
+static int aoutClose(void *cookie) {
+	
+	int status;
+	AoutFile *dest = cookie;
+	
+	/* let the writer drain the ring */
+	__sync_synchronize();
+	dest->closed = 1;
+	if((errno = pthread_join(dest->id, NULL))) {
+		ERROR();
+	}
+	if(aoutSync && (fflush(dest->file) || fsync(fileno(dest->file)))) {
+		ERROR();
+	}
+	status = fclose(dest->file);
+	free(dest->buff);
+	free(dest);
+	
+	return status;
+}
+#endif
+
+void aoutInit(long unsigned block, long unsigned sync) {
+	
+	aoutBlock = block;
+	aoutSync = sync;
+	outFopenPtr = &aoutOpen;
+}
+
+FILE * aoutOpen(const char *filename, const char *mode) {
+	
+#ifdef __GLIBC__
+	FILE *out;
+	AoutFile *dest;
+	cookie_io_functions_t wfuncs = {NULL, &aoutWrite, NULL, &aoutClose};
+	
+	dest = smalloc(sizeof(AoutFile));
+	dest->head = 0;
+	dest->tail = 0;
+	dest->closed = 0;
+	dest->synced = 0;
+	dest->size = AOUTRING < (aoutBlock << 2) ? (aoutBlock << 2) : AOUTRING;
+	dest->buff = smalloc(dest->size);
+	dest->file = sfopen(filename, mode);
+	setvbuf(dest->file, NULL, _IONBF, 0);
+	if(!(out = fopencookie(dest, mode, wfuncs))) {
+		ERROR();
+	}
+	if((errno = pthread_create(&dest->id, NULL, &aoutWriter, dest))) {
+		ERROR();
+	}
+	
+	return out;
+#else
+	return sfopen(filename, mode);
+#endif
+}
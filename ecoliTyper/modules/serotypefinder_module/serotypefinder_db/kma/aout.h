@@ -0,0 +1,44 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#include <pthread.h>
+#include <stdio.h>
+
+#ifndef AOUT
+typedef struct aoutFile AoutFile;
+struct aoutFile {
+	volatile long unsigned head; /* bytes queued */
+	volatile long unsigned tail; /* bytes written */
+	volatile int closed;
+	long unsigned size;
+	long unsigned synced;
+	unsigned char *buff;
+	FILE *file;
+	pthread_t id;
+};
+#define AOUT 1
+#define AOUTRING 8388608
+#define AOUTIDLE 1000
+#endif
+
+/* open result files, sfopen unless set by aoutInit */
+extern FILE * (*outFopenPtr)(const char *, const char *);
+/* write outputs from a thread per file in blocks of at least block bytes,
+   fsync on close when sync is set, and every sync bytes when above one */
+void aoutInit(long unsigned block, long unsigned sync);
+FILE * aoutOpen(const char *filename, const char *mode);
@@ -0,0 +1,181 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _GNU_SOURCE /* fopencookie, O_DIRECT */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#undef _XOPEN_SOURCE
+#include "aread.h"
+#include "kmatrace.h"
+#include "pherror.h"
+#include "threader.h"
+
+FILE * (*inFopenPtr)(const char *, const char *) = &sfopen;
+static int areadDepth = 4;
+static int areadDirect = 0;
+
+#ifdef __GLIBC__
+static void * areadReader(void *arg) {
+	
+	int len, n;
+	long unsigned t;
+	AreadFile *src = arg;
+	AreadSlot *slot;
+	
+	/* fill blocks ahead of the parser, a short block ends the file */
+	do {
+		slot = src->slots + (src->filled % src->depth);
+		wait_atomic(slot->status && !src->stop);
+		if(src->stop) {
+			break;
+		}
+		t = kmaTrace_begin();
+		len = 0;
+		while(len < AREADBLOCK && (n = read(src->fd, slot->buff + len, AREADBLOCK - len))) {
+			if(n < 0) {
+				if(errno == EINTR) {
+					continue;
+				}
+				ERROR();
+			}
+			len += n;
+		}
+		kmaTrace_end("read ahead", "io", t, len);
+		slot->len = len;
+		++src->filled;
+		__sync_synchronize();
+		slot->status = 1;
+	} while(len == AREADBLOCK);
+	
+	return NULL;
+}
+
+static ssize_t areadRead(void *cookie, char *buf, size_t size) {
+	
+	int n;
+	AreadFile *src = cookie;
+	AreadSlot *slot;
+	
+	while(1) {
+		slot = src->slots + (src->consumed % src->depth);
+		wait_atomic(!slot->status);
+		__sync_synchronize();
+		if(src->pos < slot->len) {
+			n = slot->len - src->pos;
+			if(size < n) {
+				n = size;
+			}
+			memcpy(buf, slot->buff + src->pos, n);
+			src->pos += n;
+			return n;
+		} else if(slot->len < AREADBLOCK) {
+			return 0;
+		}
+		
+		/* hand the block back to the reader */
+		src->pos = 0;
+		++src->consumed;
+		__sync_synchronize();
+		slot->status = 0;
+	}
+}
+
+static int areadClose(void *cookie) {
+	
+	int i, status;
+	AreadFile *src = cookie;
+	
+	src->stop = 1;
+	if((errno = pthread_join(src->id, NULL))) {
+		ERROR();
+	}
+	status = close(src->fd);
+	for(i = 0; i < src->depth; ++i) {
+		free(src->slots[i].buff);
+	}
+	free(src->slots);
+	free(src);
+	
+	return status;
+}
+#endif
+
+void areadInit(int depth, int direct) {
+	
+	areadDepth = depth;
+	areadDirect = direct;
+	inFopenPtr = &areadOpen;
+}
+
+FILE * areadOpen(const char *filename, const char *mode) {
+	
+#ifdef __GLIBC__
+	int i, fd;
+	FILE *in;
+	AreadFile *src;
+	cookie_io_functions_t rfuncs = {&areadRead, NULL, NULL, &areadClose};
+	
+	/* files of a DB may be in its container */
+	if((in = packFopenPtr(filename))) {
+		return in;
+	}
+	
+	/* not all filesystems take O_DIRECT */
+	fd = -1;
+	if(areadDirect) {
+		fd = open(filename, O_RDONLY | O_DIRECT);
+	}
+	if(fd < 0 && (fd = open(filename, O_RDONLY)) < 0) {
+		fprintf(stderr, "Filename:\t%s\n", filename);
+		ERROR();
+	}
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	
+	src = smalloc(sizeof(AreadFile));
+	src->fd = fd;
+	src->depth = areadDepth;
+	src->pos = 0;
+	src->stop = 0;
+	src->filled = 0;
+	src->consumed = 0;
+	src->slots = smalloc(src->depth * sizeof(AreadSlot));
+	for(i = 0; i < src->depth; ++i) {
+		src->slots[i].status = 0;
+		src->slots[i].len = 0;
+		if((errno = posix_memalign((void **) &src->slots[i].buff, AREADALIGN, AREADBLOCK))) {
+			ERROR();
+		}
+	}
+	if(!(in = fopencookie(src, mode, rfuncs))) {
+		ERROR();
+	}
+	if((errno = pthread_create(&src->id, NULL, &areadReader, src))) {
+		ERROR();
+	}
+	
+	return in;
+#else
+	return sfopen(filename, mode);
+#endif
+}
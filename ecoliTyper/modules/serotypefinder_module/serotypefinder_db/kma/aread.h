@@ -0,0 +1,51 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#include <pthread.h>
+#include <stdio.h>
+
+#ifndef AREAD
+typedef struct areadSlot AreadSlot;
+typedef struct areadFile AreadFile;
+struct areadSlot {
+	volatile int status; /* 0 free, 1 filled */
+	int len;
+	unsigned char *buff;
+};
+
+struct areadFile {
+	int fd;
+	int depth;
+	int pos;
+	volatile int stop;
+	long unsigned filled;
+	long unsigned consumed;
+	AreadSlot *slots;
+	pthread_t id;
+};
+#define AREAD 1
+#define AREADBLOCK 4194304
+#define AREADALIGN 4096
+#endif
+
+/* open input files, sfopen unless set by areadInit */
+extern FILE * (*inFopenPtr)(const char *, const char *);
+/* read inputs from a thread per file, keeping depth blocks in flight
+   ahead of the parser, with O_DIRECT when direct is set */
+void areadInit(int depth, int direct);
+FILE * areadOpen(const char *filename, const char *mode);
@@ -31,6 +31,7 @@
 #include "filebuff.h"
 #include "hashmapcci.h"
 #include "kmapipe.h"
+#include "kmastat.h"
 #include "nw.h"
 #include "pherror.h"
 #include "qseqs.h"
@@ -45,6 +46,7 @@ void * (*assembly_KMA_Ptr)(void *) = &assemble_KMA;
 int (*significantBase)(int, int, double) = &significantNuc;
 unsigned char (*baseCall)(unsigned char, unsigned char, int, int, double, Assembly*) = &baseCaller;
 void (*alnToMatPtr)(AssemInfo *, Assem *, Aln *, AlnScore, int, int) = &alnToMat;
+void (*updateMatrixPtr)(FileBuff *, char *, long unsigned *, AssemInfo *, int) = &updateMatrix;
 
 void updateFrags(FileBuff *dest, Qseqs *qseq, Qseqs *header, char *template_name, int *stats) {
 	
@@ -141,11 +143,11 @@ void updateMatrix(FileBuff *dest, char *template_name, long unsigned *template_s
 
 
 int significantNuc(int X, int Y, double evalue) {
-	return (Y < X && p_chisqr(pow(X - Y, 2) / (X + Y)) <= evalue);
+	return (Y < X && chisqrTest(pow(X - Y, 2) / (X + Y), evalue));
 }
 
 int significantAnd90Nuc(int X, int Y, double evalue) {
-	return (Y < X && (9 * (X + Y) <= 10 * X) && p_chisqr(pow(X - Y, 2) / (X + Y)) <= evalue);
+	return (Y < X && (9 * (X + Y) <= 10 * X) && chisqrTest(pow(X - Y, 2) / (X + Y), evalue));
 }
 
 int significantAndSupport(int X, int Y, double evalue) {
@@ -156,7 +158,7 @@ int significantAndSupport(int X, int Y, double evalue) {
 		support = evalue;
 	}
 	
-	return (Y < X && (support * (X + Y) <= X) && p_chisqr(pow(X - Y, 2) / (X + Y)) <= evalue);
+	return (Y < X && (support * (X + Y) <= X) && chisqrTest(pow(X - Y, 2) / (X + Y), evalue));
 }
 
 unsigned char baseCaller(unsigned char bestNuc, unsigned char tNuc, int bestScore, int depthUpdate, double evalue, Assembly *calls) {
@@ -282,7 +284,7 @@ void * assemble_KMA_threaded(void *arg) {
 	int nextTemplate, file_i, file_count, delta, thread_num, mq, status, bcd;
 	int minlen, q_start, q_end, stats[5], buffer[8], *qBoundPtr;
 	unsigned coverScore;
-	long unsigned depth, depthVar;
+	long unsigned depth, depthVar, cpu[STAT_TIMER];
 	short unsigned *counts;
 	const char bases[6] = "ACGTN-";
 	double score, scoreT, mrc, evalue;
@@ -299,6 +301,7 @@ void * assemble_KMA_threaded(void *arg) {
 	NWmat *NWmatrices;
 	
 	/* get input */
+	kmaStat_start(cpu);
 	template = thread->template;
 	file_count = thread->file_count;
 	files = thread->files;
@@ -328,8 +331,13 @@ void * assemble_KMA_threaded(void *arg) {
 		signal threads to return */
 		if(template == -1) {
 			lock(excludeMatrix);
+			thread_wait = thread_num - 1;
 			mainTemplate = template;
 			unlock(excludeMatrix);
+			
+			/* reset for the next run, once the threads have left */
+			wait_atomic(thread_wait);
+			mainTemplate = -2;
 			return NULL;
 		}
 		
@@ -361,6 +369,10 @@ void * assemble_KMA_threaded(void *arg) {
 		}
 		unlock(excludeMatrix);
 		if(template == -1) {
+			lock(excludeMatrix);
+			--thread_wait;
+			unlock(excludeMatrix);
+			kmaStat_cpu(STAT_ASSEMBLY, cpu);
 			return NULL;
 		}
 		
@@ -454,7 +466,7 @@ void * assemble_KMA_threaded(void *arg) {
 							}
 							/* Update backbone and counts */
 							//lock(excludeMatrix);
-							lockTime(excludeMatrix, 10)
+							lockTime(excludeMatrix, 10);
 							aligned_assem->score += read_score;
 							if(!(stats[4] & 2) || (stats[4] & 64)) {
 								++aligned_assem->fragmentCountAln;
@@ -465,9 +477,9 @@ void * assemble_KMA_threaded(void *arg) {
 							if(!matrix->len) {
 								matrix->len = t_len;
 								if(matrix->size < (t_len << 1)) {
+									sfree_tag(MEM_ASSEMBLY, matrix->assmb, matrix->size * sizeof(Assembly));
 									matrix->size = (t_len << 1);
-									free(matrix->assmb);
-									matrix->assmb = smalloc(matrix->size * sizeof(Assembly));
+									matrix->assmb = smalloc_tag(MEM_ASSEMBLY, matrix->size * sizeof(Assembly));
 								}
 								
 								/* cpy template seq */
@@ -541,6 +553,7 @@ void * assemble_KMA_threaded(void *arg) {
 														ERROR();
 													}
 												}
+												memAcc_add(MEM_ASSEMBLY, (matrix->size - matrix->len) * sizeof(Assembly));
 												assembly = matrix->assmb;
 											}
 											pos = assembly[pos].next;
@@ -788,7 +801,7 @@ void * assemble_KMA_dense_threaded(void *arg) {
 	int sam, thread_num, mq, status, bcd, minlen, q_start, q_end, *qBoundPtr;
 	int stats[5], buffer[8];
 	unsigned coverScore, delta;
-	long unsigned depth, depthVar;
+	long unsigned depth, depthVar, cpu[STAT_TIMER];
 	short unsigned *counts;
 	const char bases[6] = "ACGTN-";
 	double score, scoreT, mrc, evalue;
@@ -805,6 +818,7 @@ void * assemble_KMA_dense_threaded(void *arg) {
 	NWmat *NWmatrices;
 	
 	/* get input */
+	kmaStat_start(cpu);
 	template = thread->template;
 	file_count = thread->file_count;
 	files = thread->files;
@@ -834,8 +848,13 @@ void * assemble_KMA_dense_threaded(void *arg) {
 		signal threads to return */
 		if(template == -1) {
 			lock(excludeOut);
+			thread_wait = thread_num - 1;
 			mainTemplate = template;
 			unlock(excludeOut);
+			
+			/* reset for the next run, once the threads have left */
+			wait_atomic(thread_wait);
+			mainTemplate = -2;
 			return NULL;
 		}
 		
@@ -857,9 +876,9 @@ void * assemble_KMA_dense_threaded(void *arg) {
 			aligned_assem->q = smalloc(t_len + 1);
 		}
 		if(matrix->size <= t_len) {
+			sfree_tag(MEM_ASSEMBLY, matrix->assmb, matrix->size * sizeof(Assembly));
 			matrix->size = t_len + 1;
-			free(matrix->assmb);
-			matrix->assmb = smalloc(matrix->size * sizeof(Assembly));
+			matrix->assmb = smalloc_tag(MEM_ASSEMBLY, matrix->size * sizeof(Assembly));
 		}
 		
 		/* cpy template seq */
@@ -914,6 +933,10 @@ void * assemble_KMA_dense_threaded(void *arg) {
 		}
 		unlock(excludeOut);
 		if(template == -1) {
+			lock(excludeOut);
+			--thread_wait;
+			unlock(excludeOut);
+			kmaStat_cpu(STAT_ASSEMBLY, cpu);
 			return NULL;
 		}
 		
@@ -1016,7 +1039,7 @@ void * assemble_KMA_dense_threaded(void *arg) {
 							}
 							/* Update backbone and counts */
 							//lock(excludeMatrix);
-							lockTime(excludeMatrix, 10)
+							lockTime(excludeMatrix, 10);
 							aligned_assem->score += read_score;
 							if(!(stats[4] & 2) || (stats[4] & 64)) {
 								++aligned_assem->fragmentCountAln;
@@ -1319,9 +1342,17 @@ void * skip_assemble_KMA(void *arg) {
 	return NULL;
 }
 
+static void countInc(short unsigned *count) {
+	
+	/* saturating increment, shared between threads */
+	short unsigned c;
+	
+	while((c = *count) != USHRT_MAX && !__sync_bool_compare_and_swap(count, c, c + 1));
+}
+
 void alnToMat(AssemInfo *matrix, Assem *aligned_assem, Aln *aligned, AlnScore alnStat, int t_len, int flag) {
 	
-	static volatile int Lock = 0;
+	static volatile int Lock = 0, readers = 0;
 	volatile int *excludeMatrix = &Lock;
 	int i, pos, aln_len, start, read_score, myBias, tmp, gaps;
 	short unsigned *counts;
@@ -1332,16 +1363,6 @@ void alnToMat(AssemInfo *matrix, Assem *aligned_assem, Aln *aligned, AlnScore al
 	start = alnStat.pos;
 	read_score = alnStat.score;
 	
-	
-	/* Update backbone and counts */
-	//lockTime(excludeMatrix, 10)
-	lock(excludeMatrix);
-	aligned_assem->score += read_score;
-	if(!(flag & 2) || (flag & 64)) {
-		++aligned_assem->fragmentCountAln;
-	}
-	++aligned_assem->readCountAln;
-	
 	/* trim trailing gaps */
 	i = aln_len - 1;
 	while(i && (aligned->t[i] == 5 || aligned->q[i] == 5)) {
@@ -1358,6 +1379,42 @@ void alnToMat(AssemInfo *matrix, Assem *aligned_assem, Aln *aligned, AlnScore al
 		++i;
 	}
 	
+	/* reads without insertions only touch counts, 
+	   and share the matrix with atomic updates */
+	gaps = i;
+	while(gaps < aln_len && aligned->t[gaps] != 5) {
+		++gaps;
+	}
+	
+	/* Update backbone and counts */
+	lock(excludeMatrix);
+	aligned_assem->score += read_score;
+	if(!(flag & 2) || (flag & 64)) {
+		++aligned_assem->fragmentCountAln;
+	}
+	++aligned_assem->readCountAln;
+	if(gaps == aln_len) {
+		__sync_add_and_fetch(&readers, 1);
+		unlock(excludeMatrix);
+		
+		pos = start;
+		assembly = matrix->assmb;
+		while(i < aln_len) {
+			if(t_len <= pos) { // Old template gap, not present in this read
+				countInc(assembly[pos].counts + 5);
+			} else {
+				countInc(assembly[pos].counts + aligned->q[i]);
+				++i;
+			}
+			pos = assembly[pos].next;
+		}
+		__sync_sub_and_fetch(&readers, 1);
+		return;
+	}
+	
+	/* insertions alter the backbone, wait for shared updates */
+	wait_atomic(readers);
+	
 	/* diff */
 	pos = start;
 	assembly = matrix->assmb;
@@ -1415,6 +1472,7 @@ void alnToMat(AssemInfo *matrix, Assem *aligned_assem, Aln *aligned, AlnScore al
 								ERROR();
 							}
 						}
+						memAcc_add(MEM_ASSEMBLY, (matrix->size - matrix->len) * sizeof(Assembly));
 						assembly = matrix->assmb;
 					}
 					pos = assembly[pos].next;
@@ -1450,8 +1508,6 @@ void alnToMat(AssemInfo *matrix, Assem *aligned_assem, Aln *aligned, AlnScore al
 
 void alnToMatDense(AssemInfo *matrix, Assem *aligned_assem, Aln *aligned, AlnScore alnStat, int t_len, int flag) {
 	
-	static volatile int Lock = 0;
-	volatile int *excludeMatrix = &Lock;
 	int i, pos, aln_len, start, read_score;
 	Assembly *assembly;
 	
@@ -1461,14 +1517,12 @@ void alnToMatDense(AssemInfo *matrix, Assem *aligned_assem, Aln *aligned, AlnSco
 	read_score = alnStat.score;
 	
 	
-	/* Update backbone and counts */
-	//lockTime(excludeMatrix, 10)
-	lock(excludeMatrix);
-	aligned_assem->score += read_score;
+	/* Update counts, the backbone is fixed so no lock is needed */
+	__sync_add_and_fetch(&aligned_assem->score, read_score);
 	if(!(flag & 2) || (flag & 64)) {
-		++aligned_assem->fragmentCountAln;
+		__sync_add_and_fetch(&aligned_assem->fragmentCountAln, 1);
 	}
-	++aligned_assem->readCountAln;
+	__sync_add_and_fetch(&aligned_assem->readCountAln, 1);
 	
 	/* trim trailing gaps */
 	i = aln_len - 1;
@@ -1491,14 +1545,11 @@ void alnToMatDense(AssemInfo *matrix, Assem *aligned_assem, Aln *aligned, AlnSco
 	assembly = matrix->assmb;
 	while(i < aln_len) {
 		if(aligned->t[i] != 5) {
-			if(!++assembly[pos].counts[aligned->q[i]]) {
-				assembly[pos].counts[aligned->q[i]] = USHRT_MAX;	
-			}
+			countInc(assembly[pos].counts + aligned->q[i]);
 			pos = assembly[pos].next;
 		}
 		++i;
 	}
-	unlock(excludeMatrix);
 }
 
 void callConsensus(AssemInfo *matrix, Assem *aligned_assem, long unsigned *seq, int t_len, int bcd, double evalue, int thread_num) {
@@ -1702,13 +1753,64 @@ void fixVarOverflow(Assem *aligned_assem, Assembly *assembly, int t_len, int thr
 	wait_atomic(thread_wait);
 }
 
+static void fragBatch_fill(FragBatch *batch, FILE *file, int template, int *peek, FILE **peekFile) {
+	
+	int i, size, buffer[8];
+	
+	/* read ahead while reads belong to this template, called under excludeIn */
+	batch->n = 0;
+	batch->next = 0;
+	batch->len = 0;
+	if(*peekFile) {
+		return;
+	}
+	for(i = 0; i < FRAGBATCH; ++i) {
+		if(fread(buffer, sizeof(int), 8, file) != 8 || buffer[0] != template) {
+			/* leave the header for the next locked read */
+			memcpy(peek, buffer, 8 * sizeof(int));
+			*peekFile = file;
+			return;
+		}
+		size = batch->len + 8 * sizeof(int) + buffer[1] + buffer[6];
+		if(batch->size < size) {
+			batch->size = size << 1;
+			batch->buff = realloc(batch->buff, batch->size);
+			if(!batch->buff) {
+				ERROR();
+			}
+		}
+		memcpy(batch->buff + batch->len, buffer, 8 * sizeof(int));
+		batch->len += 8 * sizeof(int);
+		sfread(batch->buff + batch->len, 1, buffer[1] + buffer[6], file);
+		batch->len += buffer[1] + buffer[6];
+		++batch->n;
+	}
+}
+
+static unsigned char * fragBatch_get(FragBatch *batch, int *buffer) {
+	
+	unsigned char *frag;
+	
+	if(!batch->n) {
+		return 0;
+	}
+	--batch->n;
+	frag = batch->buff + batch->next;
+	memcpy(buffer, frag, 8 * sizeof(int));
+	frag += 8 * sizeof(int);
+	batch->next += 8 * sizeof(int) + buffer[1] + buffer[6];
+	
+	return frag;
+}
+
 void * assemble_KMA(void *arg) {
 	
 	const char bases[6] = "ACGTN-";
 	static volatile int thread_wait = 0, thread_init = 0, thread_begin = 0;
 	static volatile int mainTemplate = -2, next, Lock[3] = {0, 0, 0};
-	static int t_len, load, seq_in;
+	static int t_len, load, seq_in, peek[8];
 	static char *template_name;
+	static FILE *peekFile = 0;
 	static HashMapCCI *template_index;
 	volatile int *excludeIn = &Lock[0], *excludeOut = &Lock[1], *excludeMatrix = &Lock[2];
 	Assemble_thread *thread = arg;
@@ -1716,13 +1818,15 @@ void * assemble_KMA(void *arg) {
 	int read_score, asm_len, nextTemplate, file_i, file_count, delta, status;
 	int thread_num, mq, bcd, start, end, q_start, q_end, Wl;
 	int stats[5], buffer[8], *qBoundPtr;
+	long unsigned cpu[STAT_TIMER];
 	short unsigned *counts;
 	double score, scoreT, mrc, evalue;
-	unsigned char *q;
+	unsigned char *q, *frag;
 	FILE **files, *file, *xml_out;
 	AlnScore alnStat;
 	Assembly *assembly;
 	FileBuff *frag_out;
+	FragBatch batch;
 	Assem *aligned_assem;
 	Aln *aligned, *gap_align;
 	Qseqs *qseq, *header;
@@ -1731,6 +1835,7 @@ void * assemble_KMA(void *arg) {
 	NWmat *NWmatrices;
 	
 	/* get input */
+	kmaStat_start(cpu);
 	template = thread->template;
 	file_count = thread->file_count;
 	files = thread->files;
@@ -1766,8 +1871,13 @@ void * assemble_KMA(void *arg) {
 		signal threads to return */
 		if(template == -1) {
 			lock(excludeMatrix);
+			thread_wait = thread_num - 1;
 			mainTemplate = template;
 			unlock(excludeMatrix);
+			
+			/* reset for the next run, once the threads have left */
+			wait_atomic(thread_wait);
+			mainTemplate = -2;
 			return NULL;
 		}
 		
@@ -1806,6 +1916,13 @@ void * assemble_KMA(void *arg) {
 		template = -2;
 	}
 	
+	/* reads are taken FRAGBATCH at a time, to keep excludeIn short */
+	batch.n = 0;
+	batch.next = 0;
+	batch.len = 0;
+	batch.size = 0;
+	batch.buff = 0;
+	
 	do {
 		while(template == mainTemplate) {
 			usleep(100);
@@ -1814,6 +1931,11 @@ void * assemble_KMA(void *arg) {
 		template = mainTemplate;
 		unlock(excludeMatrix);
 		if(template == -1) {
+			lock(excludeMatrix);
+			--thread_wait;
+			unlock(excludeMatrix);
+			kmaStat_cpu(STAT_ASSEMBLY, cpu);
+			free(batch.buff);
 			return NULL;
 		}
 		
@@ -1827,9 +1949,9 @@ void * assemble_KMA(void *arg) {
 		if(matrix->len == 0) {
 			matrix->len = t_len;
 			if(matrix->size < (t_len << 1)) {
+				sfree_tag(MEM_ASSEMBLY, matrix->assmb, matrix->size * sizeof(Assembly));
 				matrix->size = (t_len << 1);
-				free(matrix->assmb);
-				matrix->assmb = smalloc(matrix->size * sizeof(Assembly));
+				matrix->assmb = smalloc_tag(MEM_ASSEMBLY, matrix->size * sizeof(Assembly));
 			}
 			next = 0;
 		}
@@ -1883,10 +2005,17 @@ void * assemble_KMA(void *arg) {
 		file_i = 0;
 		while(file_i < file_count) {
 			//lockTime(excludeIn, spin);
-			lock(excludeIn);
-			file = files[file_i];
-			if(file != 0) {
-				read_score = fread(buffer, sizeof(int), 8, file);
+			if(!(frag = fragBatch_get(&batch, buffer))) {
+				lock(excludeIn);
+				file = files[file_i];
+				if(file != 0 && file == peekFile) {
+					memcpy(buffer, peek, 8 * sizeof(int));
+					peekFile = 0;
+				} else if(file != 0) {
+					read_score = fread(buffer, sizeof(int), 8, file);
+				}
+			}
+			if(frag || file != 0) {
 				if((nextTemplate = buffer[0]) == template) {
 					/* load frag */
 					qseq->len = buffer[1];
@@ -1907,9 +2036,15 @@ void * assemble_KMA(void *arg) {
 						free(header->seq);
 						header->seq = smalloc(header->size);
 					}
-					sfread(qseq->seq, 1, qseq->len, file);
-					sfread(header->seq, 1, header->len, file);
-					unlock(excludeIn);
+					if(frag) {
+						memcpy(qseq->seq, frag, qseq->len);
+						memcpy(header->seq, frag + qseq->len, header->len);
+					} else {
+						sfread(qseq->seq, 1, qseq->len, file);
+						sfread(header->seq, 1, header->len, file);
+						fragBatch_fill(&batch, file, template, peek, &peekFile);
+						unlock(excludeIn);
+					}
 					
 					if(delta < qseq->len) {
 						delta = qseq->len << 1;
@@ -2095,6 +2230,7 @@ void * assemble_KMA(void *arg) {
 		--thread_begin;
 		unlock(excludeMatrix);
 	} while(thread->num != 0);
+	free(batch.buff);
 	
 	/* Terminate alignment on consensus */
 	aligned_assem->t[asm_len] = 0;
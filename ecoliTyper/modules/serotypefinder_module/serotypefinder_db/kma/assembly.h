@@ -22,6 +22,7 @@
 #include "chain.h"
 #include "filebuff.h"
 #include "hashmapcci.h"
+#include "kmapool.h"
 #include "nw.h"
 #include "qseqs.h"
 
@@ -30,6 +31,7 @@ typedef struct assem Assem;
 typedef struct assembly Assembly;
 typedef struct assemInfo AssemInfo;
 typedef struct assemble_thread Assemble_thread;
+typedef struct fragBatch FragBatch;
 
 struct assem {
 	unsigned char *t;  /* template */
@@ -64,7 +66,7 @@ struct assemInfo {
 };
 
 struct assemble_thread {
-	pthread_t id;
+	KmaWorker *id;
 	int num;
 	int template;
 	int file_count;
@@ -94,13 +96,23 @@ struct assemble_thread {
 	HashMapCCI *template_index;
 	Assemble_thread *next;
 };
+
+struct fragBatch {
+	int n;
+	int next;
+	int len;
+	int size;
+	unsigned char *buff;
+};
 #define ASSEMBLY 1
+#define FRAGBATCH 64
 #endif
 
 extern void * (*assembly_KMA_Ptr)(void *);
 extern int (*significantBase)(int, int, double);
 extern unsigned char (*baseCall)(unsigned char, unsigned char, int, int, double, Assembly*);
 extern void (*alnToMatPtr)(AssemInfo *, Assem *, Aln *, AlnScore, int, int);
+extern void (*updateMatrixPtr)(FileBuff *, char *, long unsigned *, AssemInfo *, int);
 void updateMatrix(FileBuff *dest, char *template_name, long unsigned *template_seq, AssemInfo *matrix, int t_len);
 int significantNuc(int X, int Y, double evalue);
 int significantAnd90Nuc(int X, int Y, double evalue);
@@ -0,0 +1,572 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _GNU_SOURCE /* MAP_ANONYMOUS */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#endif
+#undef _XOPEN_SOURCE
+#include "batch.h"
+#include "kma.h"
+#include "pherror.h"
+#include "serve.h"
+#include "version.h"
+
+BatchSample * loadManifest(char *filename) {
+	
+	int line, len;
+	long size;
+	char *buff, *ptr, *next, *token;
+	FILE *file;
+	BatchSample *dest, *last, *sample;
+	
+	/* read the manifest */
+	file = sfopen(filename, "rb");
+	sfseek(file, 0, SEEK_END);
+	size = ftell(file);
+	sfseek(file, 0, SEEK_SET);
+	buff = smalloc(size + 1);
+	if(size && fread(buff, 1, size, file) != size) {
+		ERROR();
+	}
+	buff[size] = 0;
+	fclose(file);
+	
+	/* a sample per line, buff is kept for the strings */
+	dest = 0;
+	last = 0;
+	line = 0;
+	for(ptr = buff; ptr && *ptr; ptr = next) {
+		++line;
+		if((next = strchr(ptr, '\n'))) {
+			*next++ = 0;
+		}
+		len = strlen(ptr);
+		if(!(token = strtok(ptr, " \t\r")) || *token == '#') {
+			continue;
+		}
+		sample = smalloc(sizeof(BatchSample));
+		sample->name = token;
+		sample->files = smalloc((len / 2 + 1) * sizeof(char *));
+		sample->fileCount = 0;
+		sample->status = -1;
+		sample->pid = 0;
+		sample->next = 0;
+		if(!(token = strtok(0, " \t\r"))) {
+			sample->layout = 0;
+		} else if(strcmp(token, "se") == 0) {
+			sample->layout = "-i";
+		} else if(strcmp(token, "pe") == 0) {
+			sample->layout = "-ipe";
+		} else if(strcmp(token, "int") == 0) {
+			sample->layout = "-int";
+		} else if(strcmp(token, "pk") == 0) {
+			sample->layout = "-ipk";
+		} else {
+			sample->layout = 0;
+		}
+		while((token = strtok(0, " \t\r"))) {
+			sample->files[sample->fileCount++] = token;
+		}
+		if(!sample->layout || !sample->fileCount || (strcmp(sample->layout, "-ipe") == 0 && (sample->fileCount & 1))) {
+			fprintf(stderr, "Invalid sample on line %d of manifest:\t%s\n", line, filename);
+			exit(1);
+		}
+		if(last) {
+			last->next = sample;
+		} else {
+			dest = sample;
+		}
+		last = sample;
+	}
+	
+	return dest;
+}
+
+#ifdef _WIN32
+BatchSample * loadFsaSamples(char *path) {
+	return 0;
+}
+
+int runSample(BatchSample *sample, char *outdir, int argc, char **argv) {
+	return 1;
+}
+
+int batch_main(int argc, char *argv[]) {
+	fprintf(stderr, "kma batch is not available on windows.\n");
+	return 1;
+}
+#else
+static int isFsa(const char *filename) {
+	
+	int len, ext_len;
+	const char **ext;
+	static const char *exts[] = {".fsa", ".fasta", ".fa", ".fna", ".fas", 0};
+	
+	/* fasta extension, possibly gzipped */
+	len = strlen(filename);
+	if(3 < len && strcmp(filename + len - 3, ".gz") == 0) {
+		len -= 3;
+	}
+	for(ext = exts; *ext; ++ext) {
+		ext_len = strlen(*ext);
+		if(ext_len < len && strncmp(filename + len - ext_len, *ext, ext_len) == 0) {
+			return 1;
+		}
+	}
+	
+	return 0;
+}
+
+static int cmpFilename(const void *a, const void *b) {
+	return strcmp(*((char **) a), *((char **) b));
+}
+
+BatchSample * loadFsaSamples(char *path) {
+	
+	int i, n, size;
+	char *buff, *ptr, *next, *token, *name, **filenames;
+	DIR *dir;
+	FILE *file;
+	struct dirent *entry;
+	struct stat st;
+	BatchSample *dest, *last, *sample;
+	
+	/* the fasta files of a directory, or a list of them */
+	if(stat(path, &st)) {
+		fprintf(stderr, "Could not open:\t%s\n", path);
+		exit(1);
+	}
+	size = 1024;
+	n = 0;
+	filenames = smalloc(size * sizeof(char *));
+	if(S_ISDIR(st.st_mode)) {
+		if(!(dir = opendir(path))) {
+			ERROR();
+		}
+		while((entry = readdir(dir))) {
+			if(*entry->d_name != '.' && isFsa(entry->d_name)) {
+				if(n == size) {
+					size <<= 1;
+					if(!(filenames = realloc(filenames, size * sizeof(char *)))) {
+						ERROR();
+					}
+				}
+				filenames[n] = smalloc(strlen(path) + strlen(entry->d_name) + 2);
+				sprintf(filenames[n++], "%s/%s", path, entry->d_name);
+			}
+		}
+		closedir(dir);
+		qsort(filenames, n, sizeof(char *), cmpFilename);
+	} else {
+		file = sfopen(path, "rb");
+		buff = smalloc(st.st_size + 1);
+		if(st.st_size && fread(buff, 1, st.st_size, file) != st.st_size) {
+			ERROR();
+		}
+		buff[st.st_size] = 0;
+		fclose(file);
+		for(ptr = buff; ptr && *ptr; ptr = next) {
+			if((next = strchr(ptr, '\n'))) {
+				*next++ = 0;
+			}
+			if(!(token = strtok(ptr, " \t\r")) || *token == '#') {
+				continue;
+			}
+			if(n == size) {
+				size <<= 1;
+				if(!(filenames = realloc(filenames, size * sizeof(char *)))) {
+					ERROR();
+				}
+			}
+			filenames[n++] = token;
+		}
+	}
+	
+	/* a single end sample per file, named by the file */
+	dest = 0;
+	last = 0;
+	for(i = 0; i < n; ++i) {
+		sample = smalloc(sizeof(BatchSample));
+		sample->files = smalloc(sizeof(char *));
+		*sample->files = filenames[i];
+		sample->fileCount = 1;
+		sample->layout = "-i";
+		sample->status = -1;
+		sample->pid = 0;
+		sample->next = 0;
+		if((name = strrchr(filenames[i], '/'))) {
+			++name;
+		} else {
+			name = filenames[i];
+		}
+		sample->name = smalloc(strlen(name) + 1);
+		strcpy(sample->name, name);
+		if((ptr = strrchr(sample->name, '.')) && strcmp(ptr, ".gz") == 0) {
+			*ptr = 0;
+		}
+		if((ptr = strrchr(sample->name, '.')) && ptr != sample->name) {
+			*ptr = 0;
+		}
+		if(last) {
+			last->next = sample;
+		} else {
+			dest = sample;
+		}
+		last = sample;
+	}
+	free(filenames);
+	
+	return dest;
+}
+
+int runSample(BatchSample *sample, char *outdir, int argc, char **argv) {
+	
+	int i, fd, mapped, kargc, status;
+	char *outputfilename, *logfilename, **kargv;
+	
+	/* kma options... layout files -o outdir/name -mmap */
+	kargv = smalloc((argc + sample->fileCount + 6) * sizeof(char *));
+	kargc = 0;
+	kargv[kargc++] = "kma";
+	mapped = 0;
+	for(i = 0; i < argc; ++i) {
+		if(strcmp(argv[i], "-shm") == 0 || strcmp(argv[i], "-mmap") == 0) {
+			mapped = 1;
+		}
+		kargv[kargc++] = argv[i];
+	}
+	kargv[kargc++] = sample->layout;
+	for(i = 0; i < sample->fileCount; ++i) {
+		kargv[kargc++] = sample->files[i];
+	}
+	outputfilename = smalloc(strlen(outdir) + strlen(sample->name) + 8);
+	sprintf(outputfilename, "%s/%s", outdir, sample->name);
+	kargv[kargc++] = "-o";
+	kargv[kargc++] = outputfilename;
+	
+	/* use the resident files through mmap, unless told otherwise */
+	if(!mapped) {
+		kargv[kargc++] = "-mmap";
+	}
+	kargv[kargc] = 0;
+	
+	/* log to outdir/name.log */
+	logfilename = smalloc(strlen(outdir) + strlen(sample->name) + 8);
+	sprintf(logfilename, "%s/%s.log", outdir, sample->name);
+	if((fd = open(logfilename, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0) {
+		ERROR();
+	}
+	free(logfilename);
+	fflush(stdout);
+	fflush(stderr);
+	dup2(fd, STDOUT_FILENO);
+	dup2(fd, STDERR_FILENO);
+	close(fd);
+	
+	status = kma_main(kargc, kargv);
+	free(outputfilename);
+	free(kargv);
+	
+	return status;
+}
+
+static void batchWorker(BatchSample **samples, int n, volatile int *shared, char *outdir, int argc, char **argv) {
+	
+	int i;
+	
+	/* map samples in turn in this process, until none are left */
+	while((i = __sync_fetch_and_add(shared, 1)) < n) {
+		shared[i + 1] = runSample(samples[i], outdir, argc, argv);
+		errno = 0;
+	}
+	exit(0);
+}
+
+static void batchTable(BatchSample *samples, char *outdir, char *tablename, int keep) {
+	
+	int header, start, skip;
+	char *filename, *line, buff[1024];
+	FILE *in, *out;
+	BatchSample *sample;
+	
+	/* the result rows of all samples, headed by the sample name */
+	out = sfopen(tablename, "wb");
+	header = 0;
+	for(sample = samples; sample; sample = sample->next) {
+		filename = smalloc(strlen(outdir) + strlen(sample->name) + 8);
+		sprintf(filename, "%s/%s.res", outdir, sample->name);
+		if(sample->status || !(in = fopen(filename, "rb"))) {
+			free(filename);
+			errno = 0;
+			continue;
+		}
+		start = 1;
+		skip = 0;
+		while(fgets(buff, sizeof(buff), in)) {
+			line = buff;
+			if(start) {
+				skip = *buff == '#' && header;
+				if(*buff != '#') {
+					fprintf(out, "%s\t", sample->name);
+				} else if(!header) {
+					fputs("#Sample\t", out);
+					++line;
+					header = 1;
+				}
+			}
+			if(!skip) {
+				fputs(line, out);
+			}
+			start = strchr(buff, '\n') != 0;
+		}
+		fclose(in);
+		if(!keep) {
+			remove(filename);
+		}
+		free(filename);
+	}
+	fclose(out);
+}
+
+static void helpMessage(int exeStatus) {
+	FILE *helpOut;
+	if(exeStatus == 0) {
+		helpOut = stdout;
+	} else {
+		helpOut = stderr;
+	}
+	fprintf(helpOut, "# kma batch maps the samples of a manifest, against databases loaded once.\n");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "Options:", "Desc:", "Default:");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-manifest", "Samples: name se|pe|int files", "");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-fsa", "Fasta dir or list, one per sample", "");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-t_db", "DB(s)", "");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-o", "Output directory", "");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-j", "Samples mapped at once", "1");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-t", "Threads shared by the samples", "1");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-table", "Join results in one table", "");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-keep_res", "Keep -o/name.res with -table", "False");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-v", "Version", "");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-h", "Shows this help message", "");
+	fprintf(helpOut, "#\n");
+	fprintf(helpOut, "# Other options are passed on to kma for every sample.\n");
+	fprintf(helpOut, "# Output goes to -o/name.*, with the log in -o/name.log.\n");
+	exit(exeStatus);
+}
+
+int batch_main(int argc, char *argv[]) {
+	
+	int i, n, args, jobs, threads, running, failed, status, kargc, keep;
+	volatile int *shared;
+	char *manifest, *fsa, *outdir, *tablename, *exeBasic, **kargv, threadStr[16];
+	pid_t pid;
+	BatchSample *samples, *sample, *next, **sampleList;
+	
+	/* init */
+	manifest = 0;
+	fsa = 0;
+	outdir = 0;
+	tablename = 0;
+	keep = 0;
+	jobs = 1;
+	threads = 1;
+	kargv = smalloc((argc + 3) * sizeof(char *));
+	kargc = 0;
+	
+	/* PARSE COMMAND LINE OPTIONS */
+	args = 1;
+	while(args < argc) {
+		if(strcmp(argv[args], "-manifest") == 0) {
+			if(++args < argc) {
+				manifest = argv[args];
+			}
+		} else if(strcmp(argv[args], "-fsa") == 0) {
+			if(++args < argc) {
+				fsa = argv[args];
+			}
+		} else if(strcmp(argv[args], "-table") == 0) {
+			if(++args < argc) {
+				tablename = argv[args];
+			}
+		} else if(strcmp(argv[args], "-keep_res") == 0) {
+			keep = 1;
+		} else if(strcmp(argv[args], "-t_db") == 0) {
+			kargv[kargc++] = argv[args];
+			while(++args < argc && *argv[args] != '-') {
+				kargv[kargc++] = argv[args];
+				if(!serveDB(argv[args], argv[args])) {
+					exit(1);
+				}
+			}
+			--args;
+		} else if(strcmp(argv[args], "-o") == 0) {
+			if(++args < argc) {
+				outdir = argv[args];
+			}
+		} else if(strcmp(argv[args], "-j") == 0) {
+			++args;
+			if(args < argc && argv[args][0] != '-') {
+				jobs = strtoul(argv[args], &exeBasic, 10);
+				if(*exeBasic != 0 || jobs < 1) {
+					fprintf(stderr, "Invalid number of jobs specified.\n");
+					exit(1);
+				}
+			} else {
+				--args;
+			}
+		} else if(strcmp(argv[args], "-t") == 0) {
+			++args;
+			if(args < argc && argv[args][0] != '-') {
+				threads = strtoul(argv[args], &exeBasic, 10);
+				if(*exeBasic != 0 || threads < 1) {
+					fprintf(stderr, "Invalid number of threads specified.\n");
+					exit(1);
+				}
+			} else {
+				--args;
+			}
+		} else if(strcmp(argv[args], "-v") == 0) {
+			fprintf(stdout, "KMA_batch-%s\n", KMA_VERSION);
+			exit(0);
+		} else if(strcmp(argv[args], "-h") == 0) {
+			helpMessage(0);
+		} else {
+			/* kma option */
+			kargv[kargc++] = argv[args];
+		}
+		++args;
+	}
+	if(!(manifest || fsa) || (manifest && fsa) || !outdir) {
+		fprintf(stderr, "Insufficient number of agruments parsed.\n");
+		helpMessage(1);
+	} else if(mkdir(outdir, 0777) && errno != EEXIST) {
+		fprintf(stderr, "Could not use output directory:\t%s\n", outdir);
+		exit(1);
+	}
+	errno = 0;
+	samples = manifest ? loadManifest(manifest) : loadFsaSamples(fsa);
+	
+	/* split the threads between the samples running at once */
+	for(running = 0, sample = samples; sample && running < jobs; sample = sample->next) {
+		++running;
+	}
+	jobs = running ? running : 1;
+	threads = threads < jobs ? 1 : threads / jobs;
+	sprintf(threadStr, "%d", threads);
+	kargv[kargc++] = "-t";
+	kargv[kargc++] = threadStr;
+	
+	/* fork a sample at a time, at most jobs at once */
+	running = 0;
+	for(sample = fsa ? 0 : samples; sample || running; ) {
+		if(sample && running < jobs) {
+			fprintf(stderr, "# Mapping:\t%s\n", sample->name);
+			fflush(stderr);
+			if((pid = fork()) < 0) {
+				ERROR();
+			} else if(pid == 0) {
+				exit(runSample(sample, outdir, kargc, kargv));
+			}
+			sample->pid = pid;
+			++running;
+			sample = sample->next;
+		} else if(0 < (pid = waitpid(-1, &status, 0))) {
+			next = samples;
+			while(next && next->pid != pid) {
+				next = next->next;
+			}
+			if(next) {
+				next->status = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+				next->pid = 0;
+				--running;
+			}
+		} else if(errno != EINTR) {
+			ERROR();
+		}
+	}
+	errno = 0;
+	
+	/* fasta samples are taken in turn by jobs workers, mapping them in
+	   process, a worker dying on a sample is replaced by a new one */
+	if(fsa) {
+		for(n = 0, sample = samples; sample; sample = sample->next) {
+			++n;
+		}
+		fprintf(stderr, "# Mapping %d samples in %d workers.\n", n, jobs);
+		fflush(stderr);
+		sampleList = smalloc((n + 1) * sizeof(BatchSample *));
+		shared = mmap(0, (n + 1) * sizeof(int), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if(shared == MAP_FAILED) {
+			ERROR();
+		}
+		*shared = 0;
+		for(i = 0, sample = samples; sample; sample = sample->next) {
+			sampleList[i] = sample;
+			shared[++i] = -1;
+		}
+		running = 0;
+		while(*shared < n || running) {
+			if(*shared < n && running < jobs) {
+				if((pid = fork()) < 0) {
+					ERROR();
+				} else if(pid == 0) {
+					batchWorker(sampleList, n, shared, outdir, kargc, kargv);
+				}
+				++running;
+			} else if(0 < waitpid(-1, &status, 0)) {
+				--running;
+			} else if(errno != EINTR) {
+				ERROR();
+			}
+		}
+		errno = 0;
+		for(i = 0; i < n; ++i) {
+			sampleList[i]->status = shared[i + 1] < 0 ? 1 : shared[i + 1];
+		}
+		munmap((void *) shared, (n + 1) * sizeof(int));
+		free(sampleList);
+	}
+	
+	/* join results */
+	if(tablename) {
+		batchTable(samples, outdir, tablename, keep);
+	}
+	
+	/* report */
+	failed = 0;
+	for(sample = samples; sample; sample = next) {
+		next = sample->next;
+		fprintf(stderr, "# %s\t%s\n", sample->name, sample->status ? "failed" : "done");
+		failed += sample->status != 0;
+		free(sample->files);
+		free(sample);
+	}
+	free(kargv);
+	
+	return failed != 0;
+}
+#endif
@@ -0,0 +1,48 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <sys/types.h>
+
+#ifndef BATCH
+typedef struct batchSample BatchSample;
+struct batchSample {
+	char *name;
+	char *layout;
+	char **files;
+	int fileCount;
+	int status;
+	pid_t pid;
+	BatchSample *next;
+};
+#define BATCH 1
+#endif
+
+/*
+ A manifest has a sample per line: the name, the layout (se, pe or int)
+ and the input files, separated by white space. Lines starting with #
+ are skipped.
+*/
+BatchSample * loadManifest(char *filename);
+/*
+ Fasta samples are the fasta files of a directory, or the files listed in
+ a file, named by the file without directory and extension.
+*/
+BatchSample * loadFsaSamples(char *path);
+int runSample(BatchSample *sample, char *outdir, int argc, char **argv);
+int batch_main(int argc, char *argv[]);
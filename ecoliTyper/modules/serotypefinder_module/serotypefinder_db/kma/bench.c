@@ -0,0 +1,476 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _GNU_SOURCE /* wait4 */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#endif
+#undef _XOPEN_SOURCE
+#include "bench.h"
+#include "kma.h"
+#include "kmastat.h"
+#include "pherror.h"
+#include "seq2fasta.h"
+#include "stdnuc.h"
+#include "version.h"
+
+long unsigned benchRand(long unsigned *state) {
+	
+	/* xorshift64* */
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	
+	return *state * 2685821657736338717UL;
+}
+
+static double benchUniform(long unsigned *state) {
+	return (benchRand(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int benchMutate(char *dest, const char *src, int src_len, int len, double error, long unsigned *state) {
+	
+	const char bases[4] = "ACGT";
+	int i, j;
+	double r;
+	
+	/* copy src into at most len bases, with errors */
+	for(i = 0, j = 0; i < len && j < src_len; ) {
+		if((r = benchUniform(state)) < error) {
+			r /= error;
+			if(r < 0.1) {
+				/* insertion */
+				dest[i++] = bases[benchRand(state) & 3];
+			} else if(r < 0.2) {
+				/* deletion */
+				++j;
+			} else {
+				/* substitution */
+				dest[i++] = bases[(strchr(bases, src[j++]) - bases + 1 + benchRand(state) % 3) & 3];
+			}
+		} else {
+			dest[i++] = src[j++];
+		}
+	}
+	dest[i] = 0;
+	
+	return i;
+}
+
+static void benchRc(char *seq, int len) {
+	
+	int i, j;
+	char c;
+	
+	for(i = 0, j = len - 1; i <= j; ++i, --j) {
+		c = seq[i];
+		seq[i] = seq[j] == 'A' ? 'T' : seq[j] == 'C' ? 'G' : seq[j] == 'G' ? 'C' : 'A';
+		seq[j] = c == 'A' ? 'T' : c == 'C' ? 'G' : c == 'G' ? 'C' : 'A';
+	}
+}
+
+static void benchPrint(FILE *out, long unsigned n, int template, int pos, int mate, const char *seq, int len, char *qual) {
+	
+	if(mate) {
+		fprintf(out, "@bench_%lu_%d_%d/%d\n%s\n+\n%.*s\n", n, template, pos, mate, seq, len, qual);
+	} else {
+		fprintf(out, "@bench_%lu_%d_%d\n%s\n+\n%.*s\n", n, template, pos, seq, len, qual);
+	}
+}
+
+long unsigned benchReads(char *templatefilename, char *outputfilename, int len, double depth, double error, int insert, long unsigned seed) {
+	
+	const char bases[6] = "ACGTN-";
+	int i, j, n, max, DB_size, file_len, frag_len, pos, read_len, t_len;
+	int *template_lengths;
+	long unsigned frags, *compseq;
+	char *seq, *mate, *read, *qual;
+	FILE *seqfile, *out, *out_r;
+	
+	template_lengths = getLengths(templatefilename);
+	DB_size = *template_lengths;
+	max = insert < len ? len : insert;
+	for(i = 1; i < DB_size; ++i) {
+		if(max < template_lengths[i]) {
+			max = template_lengths[i];
+		}
+	}
+	file_len = strlen(templatefilename);
+	strcat(templatefilename, ".seq.b");
+	seqfile = sfopen(templatefilename, "rb");
+	templatefilename[file_len] = 0;
+	
+	/* open output */
+	file_len = strlen(outputfilename);
+	strcat(outputfilename, insert ? "_1.fq" : ".fq");
+	out = sfopen(outputfilename, "wb");
+	outputfilename[file_len] = 0;
+	if(insert) {
+		strcat(outputfilename, "_2.fq");
+		out_r = sfopen(outputfilename, "wb");
+		outputfilename[file_len] = 0;
+	} else {
+		out_r = 0;
+	}
+	
+	/* allocate stuff */
+	seq = smalloc(max + 1);
+	mate = insert ? smalloc(max + 1) : 0;
+	read = smalloc(len + 1);
+	qual = smalloc(len + 1);
+	memset(qual, 'I', len);
+	compseq = smalloc(((max >> 5) + 1) * sizeof(long unsigned));
+	seed = seed ? seed : 1;
+	
+	/* reads are spread evenly over the template bases */
+	frags = 0;
+	for(i = 1; i < DB_size; ++i) {
+		t_len = template_lengths[i];
+		sfread(compseq, sizeof(long unsigned), (t_len >> 5) + 1, seqfile);
+		for(j = 0; j < t_len; ++j) {
+			seq[j] = bases[getNuc(compseq, j)];
+		}
+		seq[t_len] = 0;
+		
+		n = depth * t_len / (insert ? len << 1 : len) + 0.5;
+		frag_len = insert ? (insert < t_len ? insert : t_len) : (len < t_len ? len : t_len);
+		while(n--) {
+			pos = benchRand(&seed) % (t_len - frag_len + 1);
+			read_len = benchMutate(read, seq + pos, frag_len, len, error, &seed);
+			if(insert) {
+				benchPrint(out, frags, i, pos, 1, read, read_len, qual);
+				memcpy(mate, seq + pos, frag_len);
+				benchRc(mate, frag_len);
+				read_len = benchMutate(read, mate, frag_len, len, error, &seed);
+				benchPrint(out_r, frags, i, pos, 2, read, read_len, qual);
+			} else {
+				if(benchRand(&seed) & 1) {
+					benchRc(read, read_len);
+				}
+				benchPrint(out, frags, i, pos, 0, read, read_len, qual);
+			}
+			++frags;
+		}
+	}
+	
+	/* clean up */
+	fclose(seqfile);
+	fclose(out);
+	if(out_r) {
+		fclose(out_r);
+	}
+	free(template_lengths);
+	free(seq);
+	free(mate);
+	free(read);
+	free(qual);
+	free(compseq);
+	
+	return frags;
+}
+
+#ifdef _WIN32
+int benchMap(BenchRun *dest, int argc, char **argv, char *logname) {
+	return 1;
+}
+
+int bench_main(int argc, char *argv[]) {
+	fprintf(stderr, "kma bench is not available on windows.\n");
+	return 1;
+}
+#else
+int benchMap(BenchRun *dest, int argc, char **argv, char *logname) {
+	
+	int i, fd, status;
+	long unsigned t0;
+	pid_t pid;
+	struct rusage usage;
+	
+	/* the forked run counts its stages into a fresh kmaStats */
+	if(!kmaStat_init()) {
+		ERROR();
+	}
+	fflush(stdout);
+	fflush(stderr);
+	t0 = kmaStat_ns();
+	if((pid = fork()) < 0) {
+		ERROR();
+	} else if(pid == 0) {
+		if((fd = open(logname, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0) {
+			ERROR();
+		}
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		close(fd);
+		exit(kma_main(argc, argv));
+	}
+	while(wait4(pid, &status, 0, &usage) < 0) {
+		if(errno != EINTR) {
+			ERROR();
+		}
+	}
+	errno = 0;
+	
+	dest->wall = (kmaStat_ns() - t0) / 1e9;
+	dest->cpu = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+	dest->maxrss = usage.ru_maxrss;
+	dest->status = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+	dest->frags = kmaStats->count[STAT_READS];
+	for(i = 0; i < STAT_STAGES; ++i) {
+		dest->stages[i] = kmaStats->wall[i] / 1e9;
+	}
+	kmaStat_destroy();
+	
+	return dest->status;
+}
+
+static void helpMessage(int exeStatus) {
+	FILE *helpOut;
+	if(exeStatus == 0) {
+		helpOut = stdout;
+	} else {
+		helpOut = stderr;
+	}
+	fprintf(helpOut, "# kma bench maps synthetic reads drawn from a DB, and reports the throughput over thread counts.\n");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "Options:", "Desc:", "Default:");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-t_db", "DB(s), reads are drawn from the first", "");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-o", "Output prefix", "kma_bench");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-l", "Read length", "150");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-depth", "Depth of reads on every template", "20");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-e", "Error rate", "0.01");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-ins", "Insert size, draw paired reads", "False");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-seed", "Seed of the reads", "1");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-t", "Comma separated thread counts", "1");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-reps", "Runs per thread count, fastest is kept", "1");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-draw", "Only draw the reads", "False");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-v", "Version", "");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-h", "Shows this help message", "");
+	fprintf(helpOut, "#\n");
+	fprintf(helpOut, "# Other options are passed on to kma. Given -i, -ipe or -int no reads are drawn.\n");
+	fprintf(helpOut, "# Reads go to -o.fq, runs to -o.t<threads>.* with the log in -o.t<threads>.log.\n");
+	exit(exeStatus);
+}
+
+int bench_main(int argc, char *argv[]) {
+	
+	static const char *stages[STAT_STAGES] = {"Input", "K-mer Mapping", "ConClave", "Alignment", "Assembly", "Output"};
+	int i, j, args, len, insert, reps, failed, kargc, inputs, draw, base, *threads;
+	long unsigned seed, frags;
+	double depth, error, baseWall;
+	char *outputfilename, *templatefilename, *exeBasic, *threadList, *outName, *logName;
+	char **kargv, threadStr[16];
+	BenchRun run, best;
+	
+	/* init */
+	templatefilename = 0;
+	outputfilename = "kma_bench";
+	threadList = "1";
+	len = 150;
+	depth = 20;
+	error = 0.01;
+	insert = 0;
+	seed = 1;
+	reps = 1;
+	inputs = 0;
+	draw = 0;
+	kargv = smalloc((argc + 16) * sizeof(char *));
+	kargc = 1;
+	*kargv = "kma";
+	
+	/* PARSE COMMAND LINE OPTIONS */
+	args = 1;
+	while(args < argc) {
+		if(strcmp(argv[args], "-t_db") == 0) {
+			kargv[kargc++] = argv[args];
+			while(++args < argc && *argv[args] != '-') {
+				kargv[kargc++] = argv[args];
+				if(!templatefilename) {
+					templatefilename = smalloc(strlen(argv[args]) + 64);
+					strcpy(templatefilename, argv[args]);
+				}
+			}
+			--args;
+		} else if(strcmp(argv[args], "-o") == 0) {
+			if(++args < argc) {
+				outputfilename = argv[args];
+			}
+		} else if(strcmp(argv[args], "-l") == 0) {
+			if(++args < argc) {
+				len = strtol(argv[args], &exeBasic, 10);
+				if(*exeBasic != 0 || len < 1) {
+					fprintf(stderr, "Invalid argument at \"-l\".\n");
+					exit(1);
+				}
+			}
+		} else if(strcmp(argv[args], "-depth") == 0) {
+			if(++args < argc) {
+				depth = strtod(argv[args], &exeBasic);
+				if(*exeBasic != 0 || depth <= 0) {
+					fprintf(stderr, "Invalid argument at \"-depth\".\n");
+					exit(1);
+				}
+			}
+		} else if(strcmp(argv[args], "-e") == 0) {
+			if(++args < argc) {
+				error = strtod(argv[args], &exeBasic);
+				if(*exeBasic != 0 || error < 0 || 1 < error) {
+					fprintf(stderr, "Invalid argument at \"-e\".\n");
+					exit(1);
+				}
+			}
+		} else if(strcmp(argv[args], "-ins") == 0) {
+			if(++args < argc) {
+				insert = strtol(argv[args], &exeBasic, 10);
+				if(*exeBasic != 0 || insert < 1) {
+					fprintf(stderr, "Invalid argument at \"-ins\".\n");
+					exit(1);
+				}
+			}
+		} else if(strcmp(argv[args], "-seed") == 0) {
+			if(++args < argc) {
+				seed = strtoul(argv[args], &exeBasic, 10);
+				if(*exeBasic != 0) {
+					fprintf(stderr, "Invalid argument at \"-seed\".\n");
+					exit(1);
+				}
+			}
+		} else if(strcmp(argv[args], "-t") == 0) {
+			if(++args < argc) {
+				threadList = argv[args];
+			}
+		} else if(strcmp(argv[args], "-reps") == 0) {
+			if(++args < argc) {
+				reps = strtol(argv[args], &exeBasic, 10);
+				if(*exeBasic != 0 || reps < 1) {
+					fprintf(stderr, "Invalid argument at \"-reps\".\n");
+					exit(1);
+				}
+			}
+		} else if(strcmp(argv[args], "-draw") == 0) {
+			draw = 1;
+		} else if(strcmp(argv[args], "-v") == 0) {
+			fprintf(stdout, "KMA_bench-%s\n", KMA_VERSION);
+			exit(0);
+		} else if(strcmp(argv[args], "-h") == 0) {
+			helpMessage(0);
+		} else {
+			/* kma option */
+			if(strcmp(argv[args], "-i") == 0 || strcmp(argv[args], "-ipe") == 0 || strcmp(argv[args], "-int") == 0) {
+				inputs = 1;
+			}
+			kargv[kargc++] = argv[args];
+		}
+		++args;
+	}
+	if(!templatefilename) {
+		fprintf(stderr, "Insufficient number of agruments parsed.\n");
+		helpMessage(1);
+	}
+	threads = intSplit(',', threadList);
+	for(i = 1; i <= *threads; ++i) {
+		if(threads[i] < 1) {
+			fprintf(stderr, "Invalid argument at \"-t\".\n");
+			exit(1);
+		}
+	}
+	outName = smalloc(strlen(outputfilename) + 64);
+	logName = smalloc(strlen(outputfilename) + 64);
+	strcpy(outName, outputfilename);
+	
+	/* draw reads */
+	if(!inputs) {
+		frags = benchReads(templatefilename, outName, len, depth, error, insert, seed);
+		fprintf(stdout, "# Reads:\t%lu %s of %d bp, depth %.1f, error %.3f, seed %lu\n", frags, insert ? "pairs" : "reads", len, depth, error, seed);
+		if(draw) {
+			free(threads);
+			free(outName);
+			free(logName);
+			free(templatefilename);
+			free(kargv);
+			return 0;
+		}
+		kargv[kargc++] = insert ? "-ipe" : "-i";
+		sprintf(outName, insert ? "%s_1.fq" : "%s.fq", outputfilename);
+		kargv[kargc++] = strcpy(smalloc(strlen(outName) + 1), outName);
+		if(insert) {
+			sprintf(outName, "%s_2.fq", outputfilename);
+			kargv[kargc++] = strcpy(smalloc(strlen(outName) + 1), outName);
+		}
+	}
+	kargv[kargc++] = "-stats";
+	kargv[kargc++] = "-t";
+	kargv[kargc++] = threadStr;
+	kargv[kargc++] = "-o";
+	kargv[kargc++] = outName;
+	kargv[kargc] = 0;
+	
+	/* run over the thread counts */
+	fprintf(stdout, "# Threads\tWall (s)\tCPU (s)\tFragments/s\tSpeedup\tEfficiency\tMax RSS (MB)");
+	for(i = 0; i < STAT_STAGES; ++i) {
+		fprintf(stdout, "\t%s (s)", stages[i]);
+	}
+	fprintf(stdout, "\n");
+	failed = 0;
+	base = 0;
+	baseWall = 0;
+	for(i = 1; i <= *threads; ++i) {
+		sprintf(threadStr, "%d", threads[i]);
+		sprintf(outName, "%s.t%d", outputfilename, threads[i]);
+		sprintf(logName, "%s.t%d.log", outputfilename, threads[i]);
+		for(j = 0; j < reps; ++j) {
+			if(benchMap(&run, kargc, kargv, logName)) {
+				best = run;
+				break;
+			} else if(j == 0 || run.wall < best.wall) {
+				best = run;
+			}
+		}
+		if(best.status) {
+			fprintf(stdout, "%d\tfailed, see %s\n", threads[i], logName);
+			++failed;
+			continue;
+		} else if(!base) {
+			/* scaling is relative to the first thread count that ran */
+			base = threads[i];
+			baseWall = best.wall;
+		}
+		fprintf(stdout, "%d\t%.3f\t%.3f\t%.0f\t%.2f\t%.2f\t%.1f", threads[i], best.wall, best.cpu, best.frags / best.wall, baseWall / best.wall, baseWall / best.wall * base / threads[i], best.maxrss / 1024.0);
+		for(j = 0; j < STAT_STAGES; ++j) {
+			fprintf(stdout, "\t%.3f", best.stages[j]);
+		}
+		fprintf(stdout, "\n");
+		fflush(stdout);
+	}
+	
+	free(threads);
+	free(outName);
+	free(logName);
+	free(templatefilename);
+	free(kargv);
+	
+	return failed != 0;
+}
+#endif
@@ -0,0 +1,44 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include "kmastat.h"
+
+#ifndef BENCH
+typedef struct benchRun BenchRun;
+struct benchRun {
+	int status;
+	long maxrss; /* kB */
+	long unsigned frags;
+	double wall;
+	double cpu;
+	double stages[STAT_STAGES];
+};
+#define BENCH 1
+#endif
+
+long unsigned benchRand(long unsigned *state);
+
+/*
+ Reads are drawn uniformly from the templates of the DB, so every template 
+ is covered to depth. Errors are substitutions, with one in ten being an 
+ insertion and one in ten a deletion. The same seed gives the same reads.
+*/
+long unsigned benchReads(char *templatefilename, char *outputfilename, int len, double depth, double error, int insert, long unsigned seed);
+int benchMap(BenchRun *dest, int argc, char **argv, char *logname);
+int bench_main(int argc, char *argv[]);
@@ -0,0 +1,286 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "bgzf.h"
+#include "pherror.h"
+#include "threader.h"
+
+/* like wait_atomic, but backs off to 10 ms while there is nothing to do */
+#if _POSIX_C_SOURCE >= 199309L
+#define wait_idle(src) for(long idle_ = 100000; src; nanosleep(sleepSpec(idle_), NULL), idle_ = idle_ < 10000000 ? idle_ << 1 : idle_)
+#else
+#define wait_idle(src) for(long idle_ = 100000; src; usleep(idle_ / 1000), idle_ = idle_ < 10000000 ? idle_ << 1 : idle_)
+#endif
+
+static z_stream * bgzfStrm_init(z_stream *strm, int level) {
+	
+	int status;
+	
+	if(!strm && !(strm = malloc(sizeof(z_stream)))) {
+		ERROR();
+	}
+	strm->zalloc = Z_NULL;
+	strm->zfree  = Z_NULL;
+	strm->opaque = Z_NULL;
+	status = deflateInit2(strm, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+	if(status < 0) {
+		fprintf(stderr, "Gzip error %d\n", status);
+		exit(status);
+	}
+	
+	return strm;
+}
+
+static void bgzfInt(unsigned char *dest, unsigned src) {
+	
+	dest[0] = src;
+	dest[1] = src >> 8;
+	dest[2] = src >> 16;
+	dest[3] = src >> 24;
+}
+
+static int bgzfDeflate(z_stream *strm, BgzfSlot *slot) {
+	
+	int status, bsize;
+	unsigned char *out;
+	static const unsigned char header[16] = {31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 66, 67, 2, 0};
+	
+	/* raw deflate, wrapped in a gzip member with the BC subfield */
+	out = slot->out;
+	deflateReset(strm);
+	strm->next_in = slot->in;
+	strm->avail_in = slot->len;
+	strm->next_out = out + 18;
+	strm->avail_out = BGZF_BLOCK_OUT - 26;
+	if((status = deflate(strm, Z_FINISH)) != Z_STREAM_END) {
+		fprintf(stderr, "Gzip error %d\n", status);
+		return status == Z_OK ? Z_BUF_ERROR : status;
+	}
+	bsize = BGZF_BLOCK_OUT - strm->avail_out;
+	memcpy(out, header, 16);
+	out[16] = (bsize - 1);
+	out[17] = (bsize - 1) >> 8;
+	bgzfInt(out + bsize - 8, crc32(crc32(0L, Z_NULL, 0), slot->in, slot->len));
+	bgzfInt(out + bsize - 4, slot->len);
+	slot->outLen = bsize;
+	
+	return Z_OK;
+}
+
+void * bgzfPool_deflate(void *arg) {
+	
+	int status;
+	BgzfFile *dest = arg;
+	BgzfSlot *slot;
+	volatile int *excludeIn = &dest->excludeIn;
+	z_stream strm;
+	
+	bgzfStrm_init(&strm, dest->level);
+	while(1) {
+		/* claim filled blocks, in order */
+		lock(excludeIn);
+		slot = dest->slots + (dest->deflated % dest->size);
+		wait_idle(slot->status != 1 && !dest->stop);
+		if(dest->stop) {
+			unlock(excludeIn);
+			break;
+		}
+		slot->status = 2;
+		++dest->deflated;
+		unlock(excludeIn);
+		
+		if((status = bgzfDeflate(&strm, slot)) != Z_OK) {
+			dest->z_err = status;
+		}
+		__sync_synchronize();
+		slot->status = 3;
+	}
+	deflateEnd(&strm);
+	
+	return NULL;
+}
+
+void * bgzfPool_write(void *arg) {
+	
+	BgzfFile *dest = arg;
+	BgzfSlot *slot;
+	
+	/* write finished blocks in order, off the producing threads */
+	while(1) {
+		slot = dest->slots + (dest->written % dest->size);
+		wait_idle(slot->status != 3 && !dest->stop);
+		if(slot->status != 3) {
+			break;
+		}
+		sfwrite(dest->raw ? slot->in : slot->out, 1, slot->outLen, dest->file);
+		slot->len = 0;
+		__sync_synchronize();
+		slot->status = 0;
+		++dest->written;
+	}
+	
+	return NULL;
+}
+
+static void bgzfPush(BgzfFile *dest) {
+	
+	int status;
+	BgzfSlot *slot;
+	
+	slot = dest->slots + (dest->filled % dest->size);
+	if(dest->raw) {
+		slot->outLen = slot->len;
+		status = 3;
+	} else if(!dest->ids) {
+		/* no workers, deflate in the calling thread */
+		if((status = bgzfDeflate(dest->strm, slot)) != Z_OK) {
+			dest->z_err = status;
+		}
+		status = 3;
+	} else {
+		status = 1;
+	}
+	__sync_synchronize();
+	slot->status = status;
+	++dest->filled;
+	
+	/* wait for the next slot to be written */
+	slot = dest->slots + (dest->filled % dest->size);
+	wait_atomic(slot->status);
+}
+
+BgzfFile * bgzfOpen(FILE *file, int thread_num, int level, int raw) {
+	
+	int i;
+	BgzfFile *dest;
+	BgzfSlot *slot;
+	
+	dest = smalloc(sizeof(BgzfFile));
+	dest->thread_num = (raw || thread_num < 2) ? 0 : thread_num;
+	dest->size = dest->thread_num < 2 ? 2 : dest->thread_num << 1;
+	dest->raw = raw;
+	dest->level = level;
+	dest->z_err = Z_OK;
+	dest->stop = 0;
+	dest->excludeIn = 0;
+	dest->filled = 0;
+	dest->deflated = 0;
+	dest->written = 0;
+	dest->file = file;
+	dest->slots = smalloc(dest->size * sizeof(BgzfSlot));
+	for(i = 0, slot = dest->slots; i < dest->size; ++i, ++slot) {
+		slot->status = 0;
+		slot->len = 0;
+		slot->outLen = 0;
+		slot->in = smalloc(BGZF_BLOCK_IN);
+		slot->out = raw ? 0 : smalloc(BGZF_BLOCK_OUT);
+	}
+	
+	/* deflate in the calling thread, when no extra threads are given */
+	dest->strm = 0;
+	dest->ids = 0;
+	if(!raw && !dest->thread_num) {
+		dest->strm = bgzfStrm_init(0, level);
+	} else if(dest->thread_num) {
+		dest->ids = smalloc(dest->thread_num * sizeof(pthread_t));
+		for(i = 0; i < dest->thread_num; ++i) {
+			if((errno = pthread_create(dest->ids + i, NULL, &bgzfPool_deflate, dest))) {
+				ERROR();
+			}
+		}
+	}
+	if((errno = pthread_create(&dest->writer, NULL, &bgzfPool_write, dest))) {
+		ERROR();
+	}
+	
+	return dest;
+}
+
+int bgzfWrite(BgzfFile *dest, const void *src, int len) {
+	
+	int n, size;
+	const unsigned char *next;
+	BgzfSlot *slot;
+	
+	/* fill blocks, and push them when full */
+	size = len;
+	next = src;
+	while(len) {
+		slot = dest->slots + (dest->filled % dest->size);
+		n = BGZF_BLOCK_IN - slot->len;
+		n = len < n ? len : n;
+		memcpy(slot->in + slot->len, next, n);
+		slot->len += n;
+		next += n;
+		len -= n;
+		if(slot->len == BGZF_BLOCK_IN) {
+			bgzfPush(dest);
+		}
+	}
+	
+	return size;
+}
+
+int bgzfClose(BgzfFile *dest) {
+	
+	int i, z_err;
+	BgzfSlot *slot;
+	static const unsigned char eof[28] = {31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 66, 67, 2, 0, 27, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+	
+	/* push last block, and drain */
+	if(dest->slots[dest->filled % dest->size].len) {
+		bgzfPush(dest);
+	}
+	wait_atomic(dest->written != dest->filled);
+	dest->stop = 1;
+	for(i = 0; i < dest->thread_num; ++i) {
+		if((errno = pthread_join(dest->ids[i], NULL))) {
+			ERROR();
+		}
+	}
+	if((errno = pthread_join(dest->writer, NULL))) {
+		ERROR();
+	}
+	free(dest->ids);
+	if(dest->strm) {
+		deflateEnd(dest->strm);
+		free(dest->strm);
+	}
+	
+	/* append the empty EOF block */
+	if(!dest->raw) {
+		sfwrite((void *) eof, 1, 28, dest->file);
+	}
+	fflush(dest->file);
+	
+	for(i = 0, slot = dest->slots; i < dest->size; ++i, ++slot) {
+		free(slot->in);
+		free(slot->out);
+	}
+	free(dest->slots);
+	z_err = dest->z_err;
+	free(dest);
+	
+	return z_err;
+}
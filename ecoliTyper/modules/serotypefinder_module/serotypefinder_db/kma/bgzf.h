@@ -0,0 +1,62 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#include <pthread.h>
+#include <stdio.h>
+#include <zlib.h>
+
+#ifndef BGZF
+typedef struct bgzfSlot BgzfSlot;
+typedef struct bgzfFile BgzfFile;
+struct bgzfSlot {
+	volatile int status; /* 0 free, 1 filled, 2 deflating, 3 deflated */
+	int len;
+	int outLen;
+	unsigned char *in;
+	unsigned char *out;
+};
+
+struct bgzfFile {
+	int thread_num;
+	int size;
+	int raw;
+	int level;
+	int z_err;
+	volatile int stop;
+	volatile int excludeIn;
+	long unsigned filled;
+	long unsigned deflated;
+	volatile long unsigned written;
+	FILE *file;
+	z_stream *strm;
+	BgzfSlot *slots;
+	pthread_t *ids;
+	pthread_t writer;
+};
+#define BGZF 1
+#define BGZF_BLOCK_IN 65280
+#define BGZF_BLOCK_OUT 65536
+#endif
+
+/* BGZF writer, blocks are deflated in parallel and written in order by a
+   dedicated thread, raw passes blocks through uncompressed */
+BgzfFile * bgzfOpen(FILE *file, int thread_num, int level, int raw);
+void * bgzfPool_deflate(void *arg);
+void * bgzfPool_write(void *arg);
+int bgzfWrite(BgzfFile *dest, const void *src, int len);
+int bgzfClose(BgzfFile *dest);
@@ -0,0 +1,312 @@
+/* Philip T.L.C. Clausen Sep 2021 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2021, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "bins.h"
+#include "filebuff.h"
+#include "pherror.h"
+#include "qseqs.h"
+#include "runkma.h"
+#include "tmp.h"
+
+Bins *fragBins = 0;
+
+static char * binName(char *name) {
+	
+	int len;
+	char *dest, *ptr;
+	
+	/* keep file names portable, and within limits */
+	len = strlen(name);
+	len = len < 200 ? len : 200;
+	dest = smalloc(len + 1);
+	for(ptr = dest; len; --len, ++ptr, ++name) {
+		if(('a' <= *name && *name <= 'z') || ('A' <= *name && *name <= 'Z') || ('0' <= *name && *name <= '9') || *name == '.' || *name == '-') {
+			*ptr = *name;
+		} else {
+			*ptr = '_';
+		}
+	}
+	*ptr = 0;
+	
+	return dest;
+}
+
+static void binFlush(Bins *dest, Bin *bin) {
+	
+	int status;
+	char *filename;
+	Bin *old;
+	
+	/* open the bin, closing the longest open one beyond the limit */
+	if(!bin->file) {
+		if(dest->open == BINS_OPEN) {
+			old = dest->bins + dest->opened[dest->next];
+			fclose(old->file);
+			old->file = 0;
+			--dest->open;
+		}
+		filename = smalloc(strlen(dest->dir) + strlen(bin->name) + 16);
+		sprintf(filename, "%s/%s.fa.gz", dest->dir, bin->name);
+		bin->file = sfopen(filename, bin->started ? "ab" : "wb");
+		free(filename);
+		bin->started = 1;
+		dest->opened[dest->next] = bin - dest->bins;
+		dest->next = (dest->next + 1) % BINS_OPEN;
+		++dest->open;
+	}
+	
+	/* a gzip member per flush, concatenated members are one gzip file */
+	if(dest->outSize < deflateBound(dest->strm, bin->len)) {
+		free(dest->out);
+		dest->outSize = deflateBound(dest->strm, bin->len);
+		dest->out = smalloc(dest->outSize);
+	}
+	deflateReset(dest->strm);
+	dest->strm->next_in = bin->buff;
+	dest->strm->avail_in = bin->len;
+	dest->strm->next_out = dest->out;
+	dest->strm->avail_out = dest->outSize;
+	if((status = deflate(dest->strm, Z_FINISH)) != Z_STREAM_END) {
+		fprintf(stderr, "Gzip error %d\n", status);
+		exit(1);
+	}
+	sfwrite(dest->out, 1, dest->outSize - dest->strm->avail_out, bin->file);
+	dest->buffered -= bin->len;
+	bin->len = 0;
+}
+
+Bins * bins_init(char *outputfilename, char *templatefilename, int DB_size, int ns) {
+	
+	int i, n, len, size;
+	unsigned *starts;
+	char *name;
+	FILE *infile;
+	Qseqs *line;
+	Bins *dest;
+	
+	dest = smalloc(sizeof(Bins));
+	dest->dir = smalloc(strlen(outputfilename) + 8);
+	sprintf(dest->dir, "%s.bins", outputfilename);
+	if(mkdir(dest->dir, 0777) && errno != EEXIST) {
+		fprintf(stderr, "Could not create bin directory:\t%s\n", dest->dir);
+		ERROR();
+	}
+	errno = 0;
+	dest->map = smalloc(DB_size * sizeof(int));
+	line = setQseqs(256);
+	len = strlen(templatefilename);
+	
+	if(ns) {
+		/* a bin per namespace, by the first template of each */
+		strcat(templatefilename, ".ns");
+		infile = fopen(templatefilename, "rb");
+		templatefilename[len] = 0;
+		if(!infile) {
+			fprintf(stderr, "DB has no namespaces, index it with -ns.\n");
+			exit(1);
+		}
+		n = 0;
+		size = 8;
+		starts = smalloc(size * sizeof(unsigned));
+		dest->bins = smalloc(size * sizeof(Bin));
+		while(*nameLoad(line, infile)) {
+			if(n == size) {
+				size <<= 1;
+				starts = realloc(starts, size * sizeof(unsigned));
+				dest->bins = realloc(dest->bins, size * sizeof(Bin));
+				if(!starts || !dest->bins) {
+					ERROR();
+				}
+			}
+			starts[n] = strtoul((char *) line->seq, &name, 10);
+			dest->bins[n].name = binName(name + 1);
+			++n;
+		}
+		fclose(infile);
+		dest->map[0] = 0;
+		for(i = 1, size = 0; i < DB_size; ++i) {
+			while(size + 1 < n && starts[size + 1] <= i) {
+				++size;
+			}
+			dest->map[i] = size;
+		}
+		free(starts);
+	} else {
+		/* a bin per template */
+		strcat(templatefilename, ".name");
+		infile = sfopen(templatefilename, "rb");
+		templatefilename[len] = 0;
+		n = DB_size;
+		dest->bins = smalloc(n * sizeof(Bin));
+		dest->bins[0].name = binName("");
+		dest->map[0] = 0;
+		for(i = 1; i < DB_size; ++i) {
+			dest->bins[i].name = binName(nameLoad(line, infile));
+			dest->map[i] = i;
+		}
+		fclose(infile);
+	}
+	destroyQseqs(line);
+	
+	dest->n = n;
+	for(i = 0; i < n; ++i) {
+		dest->bins[i].len = 0;
+		dest->bins[i].size = 0;
+		dest->bins[i].started = 0;
+		dest->bins[i].buff = 0;
+		dest->bins[i].file = 0;
+	}
+	dest->open = 0;
+	dest->next = 0;
+	dest->buffered = 0;
+	dest->opened = smalloc(BINS_OPEN * sizeof(int));
+	dest->strm = smalloc(sizeof(z_stream));
+	dest->strm->zalloc = Z_NULL;
+	dest->strm->zfree = Z_NULL;
+	dest->strm->opaque = Z_NULL;
+	if((i = deflateInit2(dest->strm, 6, Z_DEFLATED, 15 | GZIP_ENCODING, 8, Z_DEFAULT_STRATEGY)) < 0) {
+		fprintf(stderr, "Gzip error %d\n", i);
+		exit(1);
+	}
+	dest->out = 0;
+	dest->outSize = 0;
+	dest->keep = calloc(DB_size, 1);
+	if(!dest->keep || !(dest->held = tmpM(0))) {
+		ERROR();
+	}
+	
+	return dest;
+}
+
+void bins_add(Bins *dest, int template, unsigned char *qseq, int len, unsigned char *header, int header_len) {
+	
+	int info[3];
+	
+	/* hold the read, until it is known whether its template is reported */
+	info[0] = template;
+	info[1] = len;
+	info[2] = header_len;
+	sfwrite(info, sizeof(int), 3, dest->held);
+	sfwrite(qseq, 1, len, dest->held);
+	sfwrite(header, 1, header_len, dest->held);
+}
+
+void bins_keep(Bins *dest, int template) {
+	
+	dest->keep[template] = 1;
+}
+
+static void binAdd(Bins *dest, int template, unsigned char *qseq, int len, unsigned char *header, int header_len) {
+	
+	int i, size;
+	unsigned char *ptr;
+	Bin *bin;
+	
+	/* header lacks the '@' or '>', and ends with its terminator */
+	bin = dest->bins + dest->map[template];
+	--header_len;
+	size = bin->len + header_len + len + 3;
+	if(bin->size < size) {
+		bin->size = size < BINS_BUFF ? BINS_BUFF : size;
+		bin->buff = realloc(bin->buff, bin->size);
+		if(!bin->buff) {
+			ERROR();
+		}
+	}
+	ptr = bin->buff + bin->len;
+	*ptr++ = '>';
+	memcpy(ptr, header, header_len);
+	ptr += header_len;
+	*ptr++ = '\n';
+	for(i = 0; i < len; ++i) {
+		*ptr++ = "ACGTN"[qseq[i]];
+	}
+	*ptr++ = '\n';
+	dest->buffered += ptr - (bin->buff + bin->len);
+	bin->len = ptr - bin->buff;
+	
+	if(BINS_BUFF <= bin->len) {
+		binFlush(dest, bin);
+	} else if(BINS_MEM < dest->buffered) {
+		/* keep the total held in memory bounded */
+		for(i = 0; i < dest->n; ++i) {
+			if(dest->bins[i].len) {
+				binFlush(dest, dest->bins + i);
+			}
+		}
+	}
+}
+
+void bins_close(Bins *src) {
+	
+	int i, n, size, info[3];
+	unsigned char *buff;
+	Bin *bin;
+	
+	/* bin the held reads of reported templates */
+	fflush(src->held);
+	rewind(src->held);
+	size = 0;
+	buff = 0;
+	while(fread(info, sizeof(int), 3, src->held) == 3) {
+		if(size < info[1] + info[2]) {
+			size = info[1] + info[2];
+			free(buff);
+			buff = smalloc(size);
+		}
+		sfread(buff, 1, info[1] + info[2], src->held);
+		if(src->keep[*info]) {
+			binAdd(src, *info, buff, info[1], buff + info[1], info[2]);
+		}
+	}
+	free(buff);
+	fclose(src->held);
+	free(src->keep);
+	
+	/* flush all, before closing what remains open */
+	for(i = 0, bin = src->bins; i < src->n; ++i, ++bin) {
+		if(bin->len) {
+			binFlush(src, bin);
+		}
+	}
+	n = 0;
+	for(i = 0, bin = src->bins; i < src->n; ++i, ++bin) {
+		if(bin->file) {
+			fclose(bin->file);
+		}
+		n += bin->started;
+		free(bin->buff);
+		free(bin->name);
+	}
+	deflateEnd(src->strm);
+	free(src->strm);
+	free(src->out);
+	free(src->opened);
+	free(src->map);
+	free(src->bins);
+	fprintf(stderr, "# Reads binned to %d files in:\t%s\n", n, src->dir);
+	free(src->dir);
+	free(src);
+}
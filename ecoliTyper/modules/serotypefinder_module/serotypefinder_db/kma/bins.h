@@ -0,0 +1,68 @@
+/* Philip T.L.C. Clausen Sep 2021 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2021, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <zlib.h>
+
+#ifndef BINS
+typedef struct bin Bin;
+typedef struct bins Bins;
+struct bin {
+	int len;
+	int size;
+	int started;
+	char *name;
+	unsigned char *buff;
+	FILE *file;
+};
+
+struct bins {
+	int n;
+	int open;
+	int next;
+	long unsigned buffered;
+	char *dir;
+	int *map;
+	int *opened;
+	char *keep;
+	FILE *held;
+	Bin *bins;
+	z_stream *strm;
+	unsigned char *out;
+	long unsigned outSize;
+};
+#define BINS 1
+#define BINS_OPEN 64
+#define BINS_BUFF 65536
+#define BINS_MEM 67108864
+#endif
+
+/*
+ "-bin" writes the reads assigned to each template by ConClave to
+ <o>.bins/<template>.fa.gz, or with "-bin ns" to one file per namespace.
+ Reads are held in a tmp file until the results are known, and only the
+ reads of templates marked with bins_keep, i.e. reported in *.res, are
+ binned. Reads are gathered in memory per bin, and appended as gzip
+ members when a bin fills, keeping at most BINS_OPEN files open at once.
+*/
+extern Bins *fragBins;
+Bins * bins_init(char *outputfilename, char *templatefilename, int DB_size, int ns);
+void bins_add(Bins *dest, int template, unsigned char *qseq, int len, unsigned char *header, int header_len);
+void bins_keep(Bins *dest, int template);
+void bins_close(Bins *src);
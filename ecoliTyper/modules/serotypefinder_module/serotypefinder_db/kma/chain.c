@@ -17,6 +17,7 @@
  * limitations under the License.
 */
 
+#include <limits.h>
 #include <math.h>
 #include <stdlib.h>
 #include "chain.h"
@@ -27,6 +28,24 @@
 int (*chainSeedsPtr)(AlnPoints *, int, int, int, unsigned *) = &chainSeeds;
 void (*trimSeedsPtr)(AlnPoints *points, int start) = &trimSeeds;
 
+static int chainTreeSize(int size) {
+	
+	int P;
+	
+	P = 1;
+	while(P < size) {
+		P <<= 1;
+	}
+	
+	return P;
+}
+
+static long unsigned seedPoint_bytes(int size) {
+	
+	/* seven seed arrays and the range max tree */
+	return (7 * size + 2 * chainTreeSize(size + 1)) * sizeof(int);
+}
+
 AlnPoints * seedPoint_init(int size, Penalties *rewards) {
 	
 	AlnPoints *dest;
@@ -34,6 +53,7 @@ AlnPoints * seedPoint_init(int size, Penalties *rewards) {
 	dest = smalloc(sizeof(AlnPoints));
 	dest->len = 0;
 	dest->size = size;
+	memAcc_add(MEM_ALIGN, seedPoint_bytes(size));
 	size *= sizeof(int);
 	dest->tStart = smalloc(size);
 	dest->tEnd = smalloc(size);
@@ -42,6 +62,7 @@ AlnPoints * seedPoint_init(int size, Penalties *rewards) {
 	dest->weight = smalloc(size);
 	dest->score = smalloc(size);
 	dest->next = smalloc(size);
+	dest->ub = smalloc(2 * chainTreeSize(dest->size + 1) * sizeof(int));
 	dest->rewards = rewards;
 	
 	return dest;
@@ -49,6 +70,8 @@ AlnPoints * seedPoint_init(int size, Penalties *rewards) {
 
 void seedPoint_realloc(AlnPoints *dest, int size) {
 	
+	memAcc_sub(MEM_ALIGN, seedPoint_bytes(dest->size));
+	memAcc_add(MEM_ALIGN, seedPoint_bytes(size));
 	dest->size = size;
 	size *= sizeof(int);
 	dest->tStart = realloc(dest->tStart, size);
@@ -58,13 +81,15 @@ void seedPoint_realloc(AlnPoints *dest, int size) {
 	dest->weight = realloc(dest->weight, size);
 	dest->score = realloc(dest->score, size);
 	dest->next = realloc(dest->next, size);
-	if(!dest->tStart || !dest->tEnd || !dest->qStart || !dest->qEnd || !dest->weight || !dest->score || !dest->next) {
+	dest->ub = realloc(dest->ub, 2 * chainTreeSize(dest->size + 1) * sizeof(int));
+	if(!dest->tStart || !dest->tEnd || !dest->qStart || !dest->qEnd || !dest->weight || !dest->score || !dest->next || !dest->ub) {
 		ERROR();
 	}
 }
 
 void seedPoint_free(AlnPoints *src) {
 	
+	memAcc_sub(MEM_ALIGN, seedPoint_bytes(src->size));
 	free(src->tStart);
 	free(src->tEnd);
 	free(src->qStart);
@@ -72,17 +97,95 @@ void seedPoint_free(AlnPoints *src) {
 	free(src->weight);
 	free(src->score);
 	free(src->next);
+	free(src->ub);
 	src->rewards = 0;
 	free(src);
 }
 
+static int chainTree_init(AlnPoints *points, int kmersize) {
+	
+	int i, P, *tree;
+	Penalties *rewards;
+	
+	/* clear range max tree over the seeds */
+	P = chainTreeSize(points->len + 1);
+	tree = points->ub;
+	i = P << 1;
+	while(--i) {
+		tree[i] = INT_MIN;
+	}
+	
+	/*
+	A link can at most gain the length of the seed in matches, and the
+	best mismatch / match mix over one k-mer. Only valid when gaps and
+	mismatches cannot be rewarded.
+	*/
+	rewards = points->rewards;
+	if(rewards->M < 0 || 0 < rewards->MM || 0 < rewards->W1 || 0 < rewards->U) {
+		tree[0] = INT_MAX;
+	} else {
+		tree[0] = MAX(0, kmersize * (rewards->M + rewards->MM));
+	}
+	
+	return P;
+}
+
+static void chainTree_set(AlnPoints *points, int P, int i) {
+	
+	int *tree;
+	
+	/* upper bound any link to seed i may score */
+	tree = points->ub;
+	if(tree[0] == INT_MAX) {
+		return;
+	}
+	i += P;
+	tree[i] = points->score[i - P] + tree[0] + (points->tEnd[i - P] - points->tStart[i - P]) * points->rewards->M;
+	while((i >>= 1)) {
+		tree[i] = MAX(tree[i << 1], tree[(i << 1) | 1]);
+	}
+}
+
+static int chainTree_next(const int *tree, int P, int j, int end, int min) {
+	
+	int node, h;
+	
+	/* find first seed from j, with a bound of at least min */
+	if(tree[0] == INT_MAX) {
+		return j;
+	}
+	node = j + P;
+	h = 0;
+	while(((node << h) - P) < end) {
+		if(tree[node] < min) {
+			/* skip subtree */
+			while(node & 1) {
+				if(node == 1) {
+					return end;
+				}
+				node >>= 1;
+				++h;
+			}
+			++node;
+		} else if(h == 0) {
+			return node - P;
+		} else {
+			node <<= 1;
+			--h;
+		}
+	}
+	
+	return end;
+}
+
 int chainSeeds(AlnPoints *points, int q_len, int t_len, int kmersize, unsigned *mapQ) {
 	
 	int i, j, nMems, weight, gap, score, bestScore, secondScore, bestPos;
-	int tStart, tEnd, qStart, qEnd, tGap, qGap, nMin, W1, U, M, MM, Ms, MMs;
+	int tStart, tEnd, qStart, qEnd, tGap, qGap, nMin, W1, U, M, MM, Ms, MMs, P;
 	Penalties *rewards;
 	
 	rewards = points->rewards;
+	P = chainTree_init(points, kmersize);
 	W1 = rewards->W1;
 	U = rewards->U;
 	M = rewards->M;
@@ -131,8 +234,8 @@ int chainSeeds(AlnPoints *points, int q_len, int t_len, int kmersize, unsigned *
 		/* 128 is the bandwidth */
 		nMin = MIN(nMems, i + 128);
 		
-		/* find best link */
-		for(j = i + 1; j < nMin; ++j) {
+		/* find best link, skipping seeds that cannot beat score */
+		for(j = chainTree_next(points->ub, P, i + 1, nMin, score - weight); j < nMin; j = chainTree_next(points->ub, P, j + 1, nMin, score - weight)) {
 			/* check compability */
 			if(qEnd < points->qStart[j]) {
 				if(tEnd < points->tStart[j]) { /* full compatability */
@@ -210,6 +313,7 @@ int chainSeeds(AlnPoints *points, int q_len, int t_len, int kmersize, unsigned *
 			points->weight[i] -= (kmersize - 1);
 		}
 		points->score[i] = score;
+		chainTree_set(points, P, i);
 		
 		/* penalize start */
 		tStart = points->tStart[i];
@@ -262,10 +366,11 @@ int chainSeeds(AlnPoints *points, int q_len, int t_len, int kmersize, unsigned *
 int chainSeeds_circular(AlnPoints *points, int q_len, int t_len, int kmersize, unsigned *mapQ) {
 	
 	int i, j, nMems, weight, gap, score, bestScore, secondScore, bestPos;
-	int tStart, tEnd, qStart, qEnd, tGap, qGap, nMin, W1, U, M, MM, Ms, MMs;
+	int tStart, tEnd, qStart, qEnd, tGap, qGap, nMin, W1, U, M, MM, Ms, MMs, P;
 	Penalties *rewards;
 	
 	rewards = points->rewards;
+	P = chainTree_init(points, kmersize);
 	W1 = rewards->W1;
 	U = rewards->U;
 	M = rewards->M;
@@ -314,10 +419,18 @@ int chainSeeds_circular(AlnPoints *points, int q_len, int t_len, int kmersize, u
 		/* 128 is the bandwidth */
 		nMin = MIN(nMems, i + 128);
 		
-		/* find best link */
-		for(j = i + 1; j < nMin; ++j) {
+		/* find best link, skipping seeds that cannot beat score */
+		for(j = chainTree_next(points->ub, P, i + 1, nMin, score - weight); j < nMin; j = chainTree_next(points->ub, P, j + 1, nMin, score - weight)) {
 			/* check compability */
-			if(qEnd < points->qStart[j]) {
+			if(qEnd == points->qStart[j] && tEnd == t_len + 1 && points->tStart[j] == 1) { /* seed continued over the origin */
+				gap = weight + points->score[j];
+				
+				/* check if score is max */
+				if(score <= gap) {
+					score = gap;
+					points->next[i] = j;
+				}
+			} else if(qEnd < points->qStart[j]) {
 				tStart = points->tStart[j];
 				if(tEnd < tStart) { /* full compatability */
 					tGap = tStart - tEnd;
@@ -444,6 +557,7 @@ int chainSeeds_circular(AlnPoints *points, int q_len, int t_len, int kmersize, u
 			points->weight[i] -= (kmersize - 1);
 		}
 		points->score[i] = score;
+		chainTree_set(points, P, i);
 		
 		/* penalize start */
 		tStart = points->tStart[i];
@@ -31,6 +31,7 @@ struct alnPoints {
 	int *weight;
 	int *score;
 	int *next;
+	int *ub;
 	Penalties *rewards;
 };
 #define CHAIN 1
@@ -0,0 +1,352 @@
+/* Philip T.L.C. Clausen Sep 2021 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2021, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ckpt.h"
+#include "pack.h"
+#include "pherror.h"
+#include "tmp.h"
+
+#define CKPT_HEAD (8 + sizeof(long unsigned) + 2 * sizeof(int))
+#define CKPT_CHUNK 1048576
+
+static long unsigned ckptSum(FILE *in, long unsigned size) {
+	
+	long unsigned sum, len;
+	unsigned char *buffer;
+	
+	/* whole chunks are multiples of 8, as packSum needs when chained */
+	buffer = smalloc(CKPT_CHUNK);
+	sum = 0xCBF29CE484222325UL;
+	rewind(in);
+	while(size) {
+		len = size < CKPT_CHUNK ? size : CKPT_CHUNK;
+		if(fread(buffer, 1, len, in) != len) {
+			free(buffer);
+			return ~sum;
+		}
+		sum = packSum(sum, buffer, len);
+		size -= len;
+	}
+	free(buffer);
+	
+	return sum;
+}
+
+static void ckptCopy(FILE *in, FILE *out, long unsigned size) {
+	
+	long unsigned len;
+	char *buffer;
+	
+	buffer = smalloc(CKPT_CHUNK);
+	while(size) {
+		len = size < CKPT_CHUNK ? size : CKPT_CHUNK;
+		sfread(buffer, 1, len, in);
+		sfwrite(buffer, 1, len, out);
+		size -= len;
+	}
+	free(buffer);
+}
+
+static int ckptValid(FILE *in, long unsigned key, int stage, int DB_size) {
+	
+	int head[2];
+	long unsigned size, sum, file_key;
+	char magic[8];
+	
+	/* checksum first, then the header it covers */
+	if(fseek(in, 0, SEEK_END) || (size = ftell(in)) < CKPT_HEAD + 2 * sizeof(long unsigned)) {
+		return 0;
+	}
+	size -= sizeof(long unsigned);
+	if(fseek(in, size, SEEK_SET) || fread(&sum, sizeof(long unsigned), 1, in) != 1 || ckptSum(in, size) != sum) {
+		return 0;
+	}
+	rewind(in);
+	if(fread(magic, 1, 8, in) != 8 || memcmp(magic, CKPT_MAGIC, 8) != 0) {
+		return 0;
+	} else if(fread(&file_key, sizeof(long unsigned), 1, in) != 1 || file_key != key) {
+		return 0;
+	} else if(fread(head, sizeof(int), 2, in) != 2 || head[0] != stage || head[1] != DB_size) {
+		return 0;
+	}
+	
+	return 1;
+}
+
+FILE * ckptOpen(char *outputfilename, long unsigned key, int DB_size, int *stage) {
+	
+	int len;
+	FILE *in;
+	
+	/* latest valid checkpoint of this run */
+	len = strlen(outputfilename);
+	for(*stage = 2; *stage; --*stage) {
+		sprintf(outputfilename + len, ".ckpt%d", *stage);
+		if((in = fopen(outputfilename, "rb"))) {
+			if(ckptValid(in, key, *stage, DB_size)) {
+				fprintf(stderr, "# Resuming from checkpoint:\t%s\n", outputfilename);
+				outputfilename[len] = 0;
+				return in;
+			}
+			fprintf(stderr, "# Ignoring invalid checkpoint:\t%s\n", outputfilename);
+			fclose(in);
+		}
+	}
+	outputfilename[len] = 0;
+	errno = 0;
+	
+	return 0;
+}
+
+void ckptLoadScores(FILE *in, int *matched, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, int DB_size) {
+	
+	sfread(matched, sizeof(int), 1, in);
+	sfread(alignment_scores, sizeof(long unsigned), DB_size, in);
+	sfread(uniq_alignment_scores, sizeof(long unsigned), DB_size, in);
+}
+
+void ckptLoadFrags(FILE *in, FILE *frag_out_raw) {
+	
+	long unsigned size;
+	
+	sfread(&size, sizeof(long unsigned), 1, in);
+	ckptCopy(in, frag_out_raw, size);
+	fflush(frag_out_raw);
+	fclose(in);
+}
+
+int ckptLoadConClave(FILE *in, int DB_size, long unsigned *w_scores, unsigned *fragmentCounts, unsigned *readCounts, FILE ***template_fragments) {
+	
+	int i, fileCount, counts;
+	long unsigned size;
+	FILE **files;
+	
+	sfread(w_scores, sizeof(long unsigned), DB_size, in);
+	sfread(&counts, sizeof(int), 1, in);
+	if(counts) {
+		sfread(fragmentCounts, sizeof(unsigned), DB_size, in);
+		sfread(readCounts, sizeof(unsigned), DB_size, in);
+	}
+	
+	/* restore the sorted fragment files */
+	sfread(&fileCount, sizeof(int), 1, in);
+	files = *template_fragments;
+	if(DB_size < fileCount) {
+		files = realloc(files, fileCount * sizeof(FILE*));
+		if(!files) {
+			ERROR();
+		}
+		*template_fragments = files;
+	}
+	for(i = 0; i < fileCount; ++i) {
+		if(!(files[i] = tmpM(0))) {
+			fprintf(stderr, "Could not create tmp files.\n");
+			ERROR();
+		}
+		sfread(&size, sizeof(long unsigned), 1, in);
+		ckptCopy(in, files[i], size);
+		fflush(files[i]);
+		rewind(files[i]);
+	}
+	fclose(in);
+	
+	return fileCount;
+}
+
+static FILE * ckptNew(char *filename, int stage, long unsigned key, int DB_size) {
+	
+	FILE *out;
+	
+	out = sfopen(filename, "wb+");
+	sfwrite(CKPT_MAGIC, 1, 8, out);
+	sfwrite(&key, sizeof(long unsigned), 1, out);
+	sfwrite(&stage, sizeof(int), 1, out);
+	sfwrite(&DB_size, sizeof(int), 1, out);
+	
+	return out;
+}
+
+FILE * ckptCreate(char *outputfilename, int stage, long unsigned key, int DB_size) {
+	
+	int len;
+	FILE *out;
+	
+	len = strlen(outputfilename);
+	sprintf(outputfilename + len, ".ckpt%d.tmp", stage);
+	out = ckptNew(outputfilename, stage, key, DB_size);
+	outputfilename[len] = 0;
+	
+	return out;
+}
+
+void ckptSaveScores(FILE *out, int matched, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, int DB_size) {
+	
+	sfwrite(&matched, sizeof(int), 1, out);
+	sfwrite(alignment_scores, sizeof(long unsigned), DB_size, out);
+	sfwrite(uniq_alignment_scores, sizeof(long unsigned), DB_size, out);
+}
+
+void ckptSaveFrags(FILE *out, FILE *src) {
+	
+	long unsigned size;
+	
+	fflush(src);
+	sfseek(src, 0, SEEK_END);
+	size = ftell(src);
+	sfwrite(&size, sizeof(long unsigned), 1, out);
+	rewind(src);
+	ckptCopy(src, out, size);
+	rewind(src);
+}
+
+void ckptSaveConClave(FILE *out, int DB_size, long unsigned *w_scores, unsigned *fragmentCounts, unsigned *readCounts, FILE **template_fragments, int fileCount) {
+	
+	int i, counts;
+	
+	sfwrite(w_scores, sizeof(long unsigned), DB_size, out);
+	counts = fragmentCounts != 0;
+	sfwrite(&counts, sizeof(int), 1, out);
+	if(counts) {
+		sfwrite(fragmentCounts, sizeof(unsigned), DB_size, out);
+		sfwrite(readCounts, sizeof(unsigned), DB_size, out);
+	}
+	sfwrite(&fileCount, sizeof(int), 1, out);
+	for(i = 0; i < fileCount; ++i) {
+		ckptSaveFrags(out, template_fragments[i]);
+	}
+}
+
+static void ckptSeal(FILE *out, char *tmpname, char *filename) {
+	
+	long unsigned size, sum;
+	
+	/* seal, sync and move in place */
+	fflush(out);
+	sfseek(out, 0, SEEK_END);
+	size = ftell(out);
+	sum = ckptSum(out, size);
+	sfseek(out, 0, SEEK_END);
+	sfwrite(&sum, sizeof(long unsigned), 1, out);
+	fflush(out);
+	if(fsync(fileno(out))) {
+		ERROR();
+	}
+	fclose(out);
+	if(rename(tmpname, filename)) {
+		ERROR();
+	}
+}
+
+void ckptCommit(FILE *out, char *outputfilename, int stage) {
+	
+	int len;
+	char *filename;
+	
+	len = strlen(outputfilename);
+	filename = smalloc(len + 16);
+	sprintf(filename, "%s.ckpt%d", outputfilename, stage);
+	sprintf(outputfilename + len, ".ckpt%d.tmp", stage);
+	ckptSeal(out, outputfilename, filename);
+	outputfilename[len] = 0;
+	free(filename);
+}
+
+void ckptRemove(char *outputfilename) {
+	
+	int len;
+	
+	len = strlen(outputfilename);
+	strcpy(outputfilename + len, ".ckpt1");
+	remove(outputfilename);
+	strcpy(outputfilename + len, ".ckpt2");
+	remove(outputfilename);
+	outputfilename[len] = 0;
+	errno = 0;
+}
+
+FILE * ckptStateOpen(char *filename, long unsigned key, int DB_size) {
+	
+	FILE *in;
+	
+	/* a new sample starts without state */
+	if(!(in = fopen(filename, "rb"))) {
+		errno = 0;
+		return 0;
+	} else if(!ckptValid(in, key, CKPT_STATE, DB_size)) {
+		fprintf(stderr, "State of another database or options, or damaged:\t%s\n", filename);
+		exit(1);
+	}
+	fprintf(stderr, "# Adding to state:\t%s\n", filename);
+	
+	return in;
+}
+
+void ckptLoadState(FILE *in, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, int DB_size, FILE *frag_out_raw) {
+	
+	int i;
+	long unsigned size, *scores;
+	
+	/* add the scores, and append the fragments but their terminator */
+	scores = smalloc(DB_size * sizeof(long unsigned));
+	sfread(&i, sizeof(int), 1, in);
+	sfread(scores, sizeof(long unsigned), DB_size, in);
+	for(i = 0; i < DB_size; ++i) {
+		alignment_scores[i] += scores[i];
+	}
+	sfread(scores, sizeof(long unsigned), DB_size, in);
+	for(i = 0; i < DB_size; ++i) {
+		uniq_alignment_scores[i] += scores[i];
+	}
+	free(scores);
+	sfread(&size, sizeof(long unsigned), 1, in);
+	if(size < sizeof(int)) {
+		fprintf(stderr, "Damaged state.\n");
+		exit(1);
+	}
+	ckptCopy(in, frag_out_raw, size - sizeof(int));
+	fclose(in);
+}
+
+FILE * ckptStateCreate(char *filename, long unsigned key, int DB_size) {
+	
+	char *tmpname;
+	FILE *out;
+	
+	tmpname = smalloc(strlen(filename) + 5);
+	sprintf(tmpname, "%s.tmp", filename);
+	out = ckptNew(tmpname, CKPT_STATE, key, DB_size);
+	free(tmpname);
+	
+	return out;
+}
+
+void ckptStateCommit(FILE *out, char *filename) {
+	
+	char *tmpname;
+	
+	tmpname = smalloc(strlen(filename) + 5);
+	sprintf(tmpname, "%s.tmp", filename);
+	ckptSeal(out, tmpname, filename);
+	free(tmpname);
+}
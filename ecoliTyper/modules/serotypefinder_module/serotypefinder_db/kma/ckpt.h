@@ -0,0 +1,55 @@
+/* Philip T.L.C. Clausen Sep 2021 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2021, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#ifndef CKPT
+#define CKPT 1
+#include <stdio.h>
+
+/*
+ * Checkpoints of runKMA, written with -resume:
+ * <o>.ckpt1 after the alignment, holding the raw fragment stream, and
+ * <o>.ckpt2 after ConClave, holding the fragment assignments.
+ * Both start with magic "KMAckpt\1", u64 run key, int stage, int DB_size,
+ * int matched templates and the alignment scores, and end with a u64
+ * checksum of all that precedes it. They are written to a tmp name,
+ * synced and renamed, so a checkpoint is either whole or absent.
+ *
+ * -incr keeps the state of a sample in the same form as <o>.ckpt1, with
+ * stage CKPT_STATE and the key left without the inputs, so reads of later
+ * runs are added to it.
+ */
+#define CKPT_MAGIC "KMAckpt\1"
+#define CKPT_STATE 0
+
+FILE * ckptOpen(char *outputfilename, long unsigned key, int DB_size, int *stage);
+void ckptLoadScores(FILE *in, int *matched, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, int DB_size);
+void ckptLoadFrags(FILE *in, FILE *frag_out_raw);
+int ckptLoadConClave(FILE *in, int DB_size, long unsigned *w_scores, unsigned *fragmentCounts, unsigned *readCounts, FILE ***template_fragments);
+FILE * ckptCreate(char *outputfilename, int stage, long unsigned key, int DB_size);
+void ckptSaveScores(FILE *out, int matched, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, int DB_size);
+void ckptSaveFrags(FILE *out, FILE *src);
+void ckptSaveConClave(FILE *out, int DB_size, long unsigned *w_scores, unsigned *fragmentCounts, unsigned *readCounts, FILE **template_fragments, int fileCount);
+void ckptCommit(FILE *out, char *outputfilename, int stage);
+void ckptRemove(char *outputfilename);
+FILE * ckptStateOpen(char *filename, long unsigned key, int DB_size);
+void ckptLoadState(FILE *in, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, int DB_size, FILE *frag_out_raw);
+FILE * ckptStateCreate(char *filename, long unsigned key, int DB_size);
+void ckptStateCommit(FILE *out, char *filename);
+
+#endif
@@ -18,9 +18,12 @@
 */
 
 #define _XOPEN_SOURCE 600
+#include <errno.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "cmp.h"
 #include "hashmapkma.h"
 #include "kmmap.h"
@@ -99,85 +102,151 @@ void printmismatch(long unsigned kmer, unsigned kmersize, unsigned *v1, unsigned
 	printsignature(v2, type);
 }
 
-int hashMapKMA_cmp(HashMapKMA *t1, HashMapKMA *t2) {
+void * cmp_thread(void *arg) {
 	
+	CmpThread *thread = arg;
 	short unsigned *values_s;
-	unsigned type, kmersize, *exist, *values, *v_index, *v1, *v2;
-	long unsigned kmer, size, null_index, index, *exist_l, *v_index_l;
+	unsigned type, *exist, *values, *v_index, *v1, *v2;
+	long unsigned kmer, size, null_index, index, start, *exist_l, *v_index_l;
+	HashMapKMA *t1, *t2;
 	
-	/* cmp base structure, and set pointers */
-	if(t1->n != t2->n || t1->v_index != t2->v_index || t1->mlen != t2->mlen || t1->kmersize != t2->kmersize || t1->flag != t2->flag || t1->prefix_len != t2->prefix_len || t1->prefix || t2->prefix || t1->DB_size != t2->DB_size) {
-		fprintf(stderr, "n:\t%lu, %lu\n", t1->n, t2->n);
-		fprintf(stderr, "v_index:\t%lu, %lu\n", t1->v_index, t2->v_index);
-		fprintf(stderr, "mlen:\t%d, %d\n", t1->mlen, t2->mlen);
-		fprintf(stderr, "kmersize:\t%d, %d\n", t1->kmersize, t2->kmersize);
-		fprintf(stderr, "flag:\t%d, %d\n", t1->flag, t2->flag);
-		fprintf(stderr, "prefix_len:\t%d, %d\n", t1->prefix_len, t2->prefix_len);
-		fprintf(stderr, "prefix:\t%lu, %lu\n", t1->prefix, t2->prefix);
-		fprintf(stderr, "DB_size:\t%d, %d\n", t1->DB_size, t2->DB_size);
-		return 1;
-	} else if(t1->DB_size < USHRT_MAX) {
-		type = sizeof(short unsigned);
-		values = 0;
-		values_s = t1->values_s;
-	} else {
-		type = sizeof(unsigned);
+	/* set pointers */
+	t1 = thread->t1;
+	t2 = thread->t2;
+	type = thread->type;
+	if(type == sizeof(unsigned)) {
 		values = t1->values;
 		values_s = 0;
+	} else {
+		values = 0;
+		values_s = t1->values_s;
 	}
-	kmersize = t1->mlen;
+	thread->mismatch = 0;
 	
 	if(t1->size == (t1->mask + 1)) { /* direct on t1 */
+		/* range of k-mers */
+		start = t1->size * thread->num / thread->thread_num;
+		size = t1->size * (thread->num + 1) / thread->thread_num - start + 1;
 		if(t1->v_index <= UINT_MAX) {
-			exist = t1->exist - 1;
+			exist = t1->exist + start - 1;
 			exist_l = 0;
 		} else {
 			exist = 0;
-			exist_l = t1->exist_l - 1;
+			exist_l = t1->exist_l + start - 1;
 		}
 		null_index = t1->null_index;
-		size = t1->size + 1;
-		kmer = 0;
+		kmer = start;
 		while(--size) {
 			index = exist ? *++exist : *++exist_l;
 			if(index != null_index) {
 				v1 = values ? (values + index) : ((unsigned *)(values_s + index));
 				v2 = hashMap_get(t2, kmer);
 				if(signaturecmp(v1, v2, type)) {
-					printmismatch(kmer, kmersize, v1, v2, type);
-					return 1;
+					thread->mismatch = 1;
+					thread->kmer = kmer;
+					thread->v1 = v1;
+					thread->v2 = v2;
+					return NULL;
 				}
 			}
 			++kmer;
 		}
 	} else { /* hashmap on t1 */
+		/* range of stored k-mers */
+		start = t1->n * thread->num / thread->thread_num;
+		size = t1->n * (thread->num + 1) / thread->thread_num - start + 1;
 		if(t1->mlen <= 16) {
-			exist = t1->key_index - 1;
+			exist = t1->key_index + start - 1;
 			exist_l = 0;
 		} else {
 			exist = 0;
-			exist_l = t1->key_index_l - 1;
+			exist_l = t1->key_index_l + start - 1;
 		}
 		if(t1->v_index < UINT_MAX) {
-			v_index = t1->value_index - 1;
+			v_index = t1->value_index + start - 1;
 			v_index_l = 0;
 		} else {
 			v_index = 0;
-			v_index_l = t1->value_index_l - 1;
+			v_index_l = t1->value_index_l + start - 1;
 		}
-		size = t1->n + 1;
 		while(--size) {
 			kmer = exist ? *++exist : *++exist_l;
 			index = v_index ? *++v_index : *++v_index_l;
 			v1 = values ? (values + index) : ((unsigned *)(values_s + index));
 			v2 = hashMap_get(t2, kmer);
 			if(signaturecmp(v1, v2, type)) {
-				printmismatch(kmer, kmersize, v1, v2, type);
-				return 1;
+				thread->mismatch = 1;
+				thread->kmer = kmer;
+				thread->v1 = v1;
+				thread->v2 = v2;
+				return NULL;
 			}
 		}
 	}
 	
+	return NULL;
+}
+
+int hashMapKMA_cmp(HashMapKMA *t1, HashMapKMA *t2, int thread_num) {
+	
+	int i;
+	size_t type;
+	CmpThread *threads, *thread;
+	
+	/* cmp base structure */
+	if(t1->n != t2->n || t1->v_index != t2->v_index || t1->mlen != t2->mlen || t1->kmersize != t2->kmersize || t1->flag != t2->flag || t1->prefix_len != t2->prefix_len || t1->prefix || t2->prefix || t1->DB_size != t2->DB_size) {
+		fprintf(stderr, "n:\t%lu, %lu\n", t1->n, t2->n);
+		fprintf(stderr, "v_index:\t%lu, %lu\n", t1->v_index, t2->v_index);
+		fprintf(stderr, "mlen:\t%d, %d\n", t1->mlen, t2->mlen);
+		fprintf(stderr, "kmersize:\t%d, %d\n", t1->kmersize, t2->kmersize);
+		fprintf(stderr, "flag:\t%d, %d\n", t1->flag, t2->flag);
+		fprintf(stderr, "prefix_len:\t%d, %d\n", t1->prefix_len, t2->prefix_len);
+		fprintf(stderr, "prefix:\t%lu, %lu\n", t1->prefix, t2->prefix);
+		fprintf(stderr, "DB_size:\t%d, %d\n", t1->DB_size, t2->DB_size);
+		return 1;
+	} else if(t1->DB_size < USHRT_MAX) {
+		type = sizeof(short unsigned);
+	} else {
+		type = sizeof(unsigned);
+	}
+	
+	/* thread out over ranges of t1 */
+	threads = smalloc(thread_num * sizeof(CmpThread));
+	for(i = thread_num - 1; 0 <= i; --i) {
+		thread = threads + i;
+		thread->num = i;
+		thread->thread_num = thread_num;
+		thread->type = type;
+		thread->t1 = t1;
+		thread->t2 = t2;
+		thread->id = 0;
+		if(i && (errno = pthread_create(&thread->id, NULL, &cmp_thread, thread))) {
+			fprintf(stderr, "Error: %d (%s)\n", errno, strerror(errno));
+			ERROR();
+		}
+	}
+	
+	/* start main thread */
+	cmp_thread(threads);
+	
+	/* join threads */
+	for(i = 1; i < thread_num; ++i) {
+		if((errno = pthread_join(threads[i].id, NULL))) {
+			ERROR();
+		}
+	}
+	
+	/* report the first mismatch */
+	for(i = 0; i < thread_num; ++i) {
+		thread = threads + i;
+		if(thread->mismatch) {
+			printmismatch(thread->kmer, t1->mlen, thread->v1, thread->v2, type);
+			free(threads);
+			return 1;
+		}
+	}
+	free(threads);
+	
 	return 0;
 }
 
@@ -193,6 +262,7 @@ static void helpMessage(int exeStatus) {
 	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-t_db", "DB to compare to", "");
 	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-s_db", "DB to compare with", "");
 	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-tmp", "Set directory for temporary files", "");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-t", "Number of threads", "1");
 	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-v", "Version", "");
 	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-h", "Shows this help message", "");
 	fprintf(helpOut, "#\n");
@@ -201,14 +271,15 @@ static void helpMessage(int exeStatus) {
 
 int cmp_main(int argc, char *argv[]) {
 	
-	int args, t_len, s_len;
-	char *templatefilename, *secondfilename;
+	int args, t_len, s_len, thread_num;
+	char *templatefilename, *exeBasic, *secondfilename;
 	FILE *templatefile1, *templatefile2;
 	HashMapKMA *t1, *t2;
 	
 	/* init */
 	t_len = 0;
 	s_len = 0;
+	thread_num = 1;
 	templatefilename = 0;
 	secondfilename = 0;
 	
@@ -241,6 +312,17 @@ int cmp_main(int argc, char *argv[]) {
 					--args;
 				}
 			}
+		} else if(strcmp(argv[args], "-t") == 0) {
+			++args;
+			if(args < argc && argv[args][0] != '-') {
+				thread_num = strtoul(argv[args], &exeBasic, 10);
+				if(*exeBasic != 0 || thread_num < 1) {
+					fprintf(stderr, "Invalid number of threads specified.\n");
+					exit(1);
+				}
+			} else {
+				--args;
+			}
 		} else if(strcmp(argv[args], "-v") == 0) {
 			fprintf(stdout, "KMA_index-%s\n", KMA_VERSION);
 			exit(0);
@@ -276,7 +358,7 @@ int cmp_main(int argc, char *argv[]) {
 	//hashMapKMA_load(t2, templatefile2, secondfilename);
 	hashMapKMAmmap(t1, templatefile1);
 	hashMapKMAmmap(t2, templatefile2);
-	if(hashMapKMA_cmp(t1, t2)) {
+	if(hashMapKMA_cmp(t1, t2, thread_num)) {
 		fprintf(stderr, "# Hashmaps does not match.\n");
 	} else {
 		fprintf(stderr, "# Hashmaps match.\n");
@@ -17,7 +17,26 @@
  * limitations under the License.
 */
 
+#include <pthread.h>
 #include "hashmapkma.h"
 
-int hashMapKMA_cmp(HashMapKMA *t1, HashMapKMA *t2);
+#ifndef CMP
+typedef struct cmpThread CmpThread;
+struct cmpThread {
+	pthread_t id;
+	int num;
+	int thread_num;
+	int mismatch;
+	size_t type;
+	long unsigned kmer;
+	unsigned *v1;
+	unsigned *v2;
+	HashMapKMA *t1;
+	HashMapKMA *t2;
+};
+#define CMP 1
+#endif
+
+void * cmp_thread(void *arg);
+int hashMapKMA_cmp(HashMapKMA *t1, HashMapKMA *t2, int thread_num);
 int cmp_main(int argc, char *argv[]);
@@ -22,6 +22,7 @@
 #include "compdna.h"
 #include "pherror.h"
 #include "qseqs.h"
+#include "seqscan.h"
 #include "stdnuc.h"
 
 void allocComp(CompDNA *compressor, unsigned size) {
@@ -117,8 +118,7 @@ void resetComp(CompDNA *compressor) {
 
 void compDNA(CompDNA *compressor, unsigned char *seq, int seqlen) {
 	
-	int i, j, pos, end;
-	
+
 	/* get compressed length */
 	compressor->seqlen = seqlen;
 	if(seqlen & 31) {
@@ -138,28 +138,12 @@ void compDNA(CompDNA *compressor, unsigned char *seq, int seqlen) {
 	}
 	
 	/* load seq */
-	compressor->N[0] = 0;
-	for(i = 0, pos = 0; i < seqlen; i += 32) {
-		end = (i + 32 < seqlen) ? i + 32 : seqlen;
-		pos = i >> 5;
-		for(j = i; j < end; ++j) {
-			if(seq[j] == 4) {
-				compressor->seq[pos] <<= 2;
-				compressor->N[0]++;
-				compressor->N[compressor->N[0]] = j;
-			} else {
-				compressor->seq[pos] = (compressor->seq[pos] << 2) | seq[j];
-			}
-		}
-	}
-	if(seqlen & 31) {
-		compressor->seq[pos] <<= (64 - ((seqlen & 31) << 1));
-	}
+	packNuc(compressor->seq, compressor->N, seq, seqlen);
 }
 
 int compDNAref(CompDNA *compressor, unsigned char *qseq, int seqlen) {
 	
-	int i, j, pos, end, bias;
+	int bias;
 	unsigned char *seq;
 	
 	/* trim leadin N's */
@@ -184,24 +168,7 @@ int compDNAref(CompDNA *compressor, unsigned char *qseq, int seqlen) {
 		compressor->complen = seqlen >> 5;
 	}
 	
-	pos = 0;
-	compressor->N[0] = 0;
-	for(i = 0; i < seqlen; i += 32) {
-		end = (i + 32 < seqlen) ? i + 32 : seqlen;
-		pos = i >> 5;
-		for(j = i; j < end; ++j) {
-			if(seq[j] == 4) {
-				compressor->seq[pos] <<= 2;
-				compressor->N[0]++;
-				compressor->N[compressor->N[0]] = j;
-			} else {
-				compressor->seq[pos] = (compressor->seq[pos] << 2) | seq[j];
-			}
-		}
-	}
-	if(seqlen & 31) {
-		compressor->seq[pos] <<= (64 - ((seqlen & 31) << 1));
-	}
+	packNuc(compressor->seq, compressor->N, seq, seqlen);
 	
 	return bias;
 }
@@ -249,16 +216,12 @@ long unsigned binRev(long unsigned mer) {
 	/* swap nibbles */
 	mer = ((mer >> 4) & 0x0F0F0F0F0F0F0F0F) | ((mer & 0x0F0F0F0F0F0F0F0F) << 4);
 	/* swap bytes */
-	mer = ((mer >> 8) & 0x00FF00FF00FF00FF) | ((mer & 0x00FF00FF00FF00FF) << 8);
-	/* swap 2-bytes */
-	mer = ((mer >> 16) & 0x0000FFFF0000FFFF) | ((mer & 0x0000FFFF0000FFFF) << 16);
-	/* swap 4-bytes */
-	return ((mer >> 32) | (mer << 32));
+	return __builtin_bswap64(mer);
 }
 
 void rc_comp(CompDNA *compressor, CompDNA *compressor_rc) {
 	
-	int i, j, shift, r_shift;
+	int i, j, shift;
 	
 	compressor_rc->seqlen = compressor->seqlen;
 	compressor_rc->complen = compressor->complen;
@@ -274,18 +237,11 @@ void rc_comp(CompDNA *compressor, CompDNA *compressor_rc) {
 	}
 	
 	/* reverse and complement*/
-	for(i = 0, j = compressor->complen - 1; i < compressor->complen; ++i, --j) {
-		compressor_rc->seq[j] = binRev(~compressor->seq[i]);
-	}
+	rcWords(compressor_rc->seq, compressor->seq, compressor->complen);
 	
 	/* shift */
 	if((compressor->seqlen & 31)) {
-		shift = (((compressor->complen << 5) - compressor->seqlen) << 1);
-		r_shift = 64 - shift;
-		for(i = 0, j = 1; j < compressor->complen; i = j++) {
-			compressor_rc->seq[i] = (compressor_rc->seq[i] << shift) | (compressor_rc->seq[j] >> r_shift);
-		}
-		compressor_rc->seq[i] <<= shift;
+		shiftWords(compressor_rc->seq, compressor->complen, ((compressor->complen << 5) - compressor->seqlen) << 1);
 	}
 	
 	/* add N's */
@@ -299,26 +255,13 @@ void rc_comp(CompDNA *compressor, CompDNA *compressor_rc) {
 void comp_rc(CompDNA *compressor) {
 	
 	int i, j, shift, r_shift;
-	long unsigned carry;
 	
 	/* reverse and complement*/
-	for(i = 0, j = compressor->complen - 1; i < j; ++i, --j) {
-		carry = binRev(~compressor->seq[i]);
-		compressor->seq[i] = binRev(~compressor->seq[j]);
-		compressor->seq[j] = carry;
-	}
-	if(i == j) {
-		compressor->seq[i] = binRev(~compressor->seq[i]);
-	}
+	rcWords(compressor->seq, compressor->seq, compressor->complen);
 	
 	/* shift */
 	if((compressor->seqlen & 31)) {
-		shift = (((compressor->complen << 5) - compressor->seqlen) << 1);
-		r_shift = 64 - shift;
-		for(i = 0, j = 1; j < compressor->complen; i = j++) {
-			compressor->seq[i] = (compressor->seq[i] << shift) | (compressor->seq[j] >> r_shift);
-		}
-		compressor->seq[i] <<= shift;
+		shiftWords(compressor->seq, compressor->complen, ((compressor->complen << 5) - compressor->seqlen) << 1);
 	}
 	
 	/* add N's */
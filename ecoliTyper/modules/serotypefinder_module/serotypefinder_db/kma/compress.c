@@ -25,6 +25,7 @@
 #include "hashmap.h"
 #include "hashmapkma.h"
 #include "pherror.h"
+#include "radix.h"
 #include "valueshash.h"
 #include "stdstat.h"
 #ifdef _WIN32
@@ -90,19 +91,11 @@ HashMapKMA * compressKMA_DB(HashMap *templates, FILE *out) {
 	HashMapKMA *finalDB;
 	ValuesHash *shmValues;
 	ValuesTable *node, *next, *table;
-	HashTable *node_t, *next_t, *table_t;
+	HashTable *node_t, *next_t, *table_t, *slots;
 	
 	/* convert templates to linked list */
-	table_t = 0;
-	i = templates->size + 1;
-	while(i--) {
-		for(node_t = templates->table[i]; node_t != 0; node_t = next_t) {
-			next_t = node_t->next;
-			node_t->next = table_t;
-			table_t = node_t;
-		}
-	}
-	free(templates->table);
+	table_t = hashMap_list(templates);
+	slots = templates->table;
 	templates->table = 0;
 	
 	/* prepare final DB */
@@ -322,8 +315,6 @@ HashMapKMA * compressKMA_DB(HashMap *templates, FILE *out) {
 			hashMapKMA_addValue_ptr(finalDB, t_index, new_index);
 			++t_index;
 			
-			/* clean */
-			free(node_t);
 			if((node_t = next_t)) {
 				if(flag) {
 					murmur(new_index, node_t->key);
@@ -337,17 +328,10 @@ HashMapKMA * compressKMA_DB(HashMap *templates, FILE *out) {
 			}
 		} while(new_index == index);
 	}
+	free(slots);
+	
 	/* convert valuesHash to a linked list */
-	table = 0;
-	i = shmValues->size;
-	while(i--) {
-		for(node = shmValues->table[i]; node != 0; node = next) {
-			next = node->next;
-			node->next = table;
-			table = node;
-		}
-	}
-	free(shmValues->table);
+	table = valuesHash_list(shmValues);
 	
 	/* make compressed values */
 	fprintf(stderr, "# Finalizing indexes.\n");
@@ -787,16 +771,7 @@ HashMapKMA * compressKMA_megaDB(HashMap *templates, FILE *out) {
 	free(templates->values);
 	
 	/* convert valuesHash to a linked list */
-	table = 0;
-	i = shmValues->size;
-	while(i--) {
-		for(node = shmValues->table[i]; node != 0; node = next) {
-			next = node->next;
-			node->next = table;
-			table = node;
-		}
-	}
-	free(shmValues->table);
+	table = valuesHash_list(shmValues);
 	
 	/* make compressed values */
 	fprintf(stderr, "# Finalizing indexes.\n");
@@ -979,6 +954,264 @@ HashMapKMA * compressKMA_megaDB(HashMap *templates, FILE *out) {
 	return finalDB;
 }
 
+static unsigned * pairValues(unsigned *src, long unsigned len, int shortValues) {
+	
+	long unsigned i, n;
+	unsigned *values;
+	short unsigned *values_s;
+	
+	/* templates are sorted, skip repeats */
+	n = 1;
+	for(i = 1; i < len; ++i) {
+		n += (src[i] != src[i - 1]);
+	}
+	
+	if(shortValues) {
+		values_s = smalloc((n + 1) * sizeof(short unsigned));
+		*values_s = n;
+		n = 0;
+		for(i = 0; i < len; ++i) {
+			if(i == 0 || src[i] != src[i - 1]) {
+				values_s[++n] = src[i];
+			}
+		}
+		return (unsigned *)(values_s);
+	}
+	
+	values = smalloc((n + 1) * sizeof(unsigned));
+	*values = n;
+	n = 0;
+	for(i = 0; i < len; ++i) {
+		if(i == 0 || src[i] != src[i - 1]) {
+			values[++n] = src[i];
+		}
+	}
+	
+	return values;
+}
+
+HashMapKMA * compressKMA_radix(HashMap *templates, KmerPairs *pairs, FILE *out) {
+	
+	int part, shortValues;
+	unsigned flag, *values, *finalV;
+	short unsigned *values_s, *finalV_s;
+	long unsigned i, j, n, size, check, index, bucket, t_index, v_index, new_index;
+	long unsigned *keys;
+	HashMapKMA *finalDB;
+	ValuesHash *shmValues;
+	ValuesTable *node, *next, *table;
+	
+	/* count k-mers, pairs are grouped by k-mer within the partitions */
+	n = 0;
+	for(part = 0; kmerPairs_load(pairs, part); ++part) {
+		keys = pairs->keys;
+		for(i = 0; i < pairs->n; ++i) {
+			n += (i == 0 || keys[i] != keys[i - 1]);
+		}
+	}
+	shortValues = templates->DB_size < USHRT_MAX;
+	
+	/* get the table size the serial inserts would have reached */
+	free(templates->table);
+	templates->table = 0;
+	size = templates->size + 1;
+	while(size <= n) {
+		size <<= 1;
+		if((templates->mask + 1) <= (size << 1)) {
+			/* fill megaMap */
+			hashMap2megaMap(templates);
+			for(part = 0; kmerPairs_load(pairs, part); ++part) {
+				keys = pairs->keys;
+				for(i = 0; i < pairs->n; i = j) {
+					for(j = i + 1; j < pairs->n && keys[j] == keys[i]; ++j);
+					templates->values[keys[i] & templates->mask] = pairValues(pairs->values + i, j - i, shortValues);
+				}
+			}
+			templates->n = n;
+			kmerPairs_destroy(pairs);
+			return compressKMA_megaDB(templates, out);
+		}
+	}
+	templates->n = n;
+	
+	/* prepare final DB */
+	fprintf(stderr, "# Preparing compressed DB.\n");
+	check = 0;
+	check = ~check;
+	check >>= 32;
+	finalDB = smalloc(sizeof(HashMapKMA));
+	finalDB->size = size;
+	finalDB->n = n;
+	finalDB->mask = templates->mask;
+	finalDB->prefix_len = templates->prefix_len;
+	finalDB->prefix = templates->prefix;
+	finalDB->kmersize = templates->kmersize;
+	finalDB->DB_size = templates->DB_size;
+	finalDB->mlen = templates->mlen;
+	flag = (finalDB->flag = templates->flag);
+	if(n <= check) {
+		finalDB->exist = smalloc(size * sizeof(unsigned));
+		finalDB->exist_l = 0;
+		hashMapKMA_addExist_ptr = &hashMapKMA_addExist;
+	} else {
+		finalDB->exist = 0;
+		finalDB->exist_l = smalloc(size * sizeof(long unsigned));
+		hashMapKMA_addExist_ptr = &hashMapKMA_addExistL;
+	}
+	if(finalDB->mlen <= 16) {
+		finalDB->key_index = smalloc((n + 1) * sizeof(unsigned));
+		finalDB->key_index_l = 0;
+		hashMapKMA_addKey_ptr = &hashMapKMA_addKey;
+	} else {
+		finalDB->key_index = 0;
+		finalDB->key_index_l = smalloc((n + 1) * sizeof(long unsigned));
+		hashMapKMA_addKey_ptr = &hashMapKMA_addKeyL;
+	}
+	finalDB->value_index = smalloc(n * sizeof(unsigned));
+	finalDB->value_index_l = 0;
+	hashMapKMA_addValue_ptr = &hashMapKMA_addValue;
+	finalDB->null_index = n;
+	i = size;
+	while(i--) {
+		hashMapKMA_addExist_ptr(finalDB, i, n);
+	}
+	
+	/* get relative indexes, the buckets are contiguous in the pairs */
+	fprintf(stderr, "# Calculating relative indexes.\n");
+	--finalDB->size;
+	shmValues = initialize_hashValues(n, finalDB->DB_size);
+	bucket = ~0;
+	t_index = 0;
+	v_index = 0;
+	for(part = 0; kmerPairs_load(pairs, part); ++part) {
+		keys = pairs->keys;
+		for(i = 0; i < pairs->n; i = j) {
+			for(j = i + 1; j < pairs->n && keys[j] == keys[i]; ++j);
+			
+			/* get index */
+			if(flag) {
+				murmur(index, keys[i]);
+				index &= finalDB->size;
+			} else {
+				index = keys[i] & finalDB->size;
+			}
+			if(index != bucket) {
+				hashMapKMA_addExist_ptr(finalDB, index, t_index);
+				bucket = index;
+			}
+			
+			/* add kmer */
+			hashMapKMA_addKey_ptr(finalDB, t_index, keys[i]);
+			
+			/* the actual value index */
+			values = pairValues(pairs->values + i, j - i, shortValues);
+			new_index = valuesHash_add(shmValues, values, v_index);
+			if(new_index == v_index) {
+				v_index += valuesSize(values);
+				if(check <= v_index && !finalDB->value_index_l) {
+					fprintf(stderr, "# Compression overflow.\n");
+					finalDB->value_index_l = smalloc(n * sizeof(long unsigned));
+					index = t_index;
+					while(index--) {
+						finalDB->value_index_l[index] = finalDB->value_index[index];
+					}
+					free(finalDB->value_index);
+					finalDB->value_index = 0;
+					hashMapKMA_addValue_ptr = &hashMapKMA_addValueL;
+					getValueIndexPtr = &getValueIndexL;
+				}
+			} else {
+				/* values were duplicated, clean up */
+				free(values);
+			}
+			hashMapKMA_addValue_ptr(finalDB, t_index, new_index);
+			++t_index;
+		}
+	}
+	kmerPairs_destroy(pairs);
+	
+	/* convert valuesHash to a linked list */
+	table = valuesHash_list(shmValues);
+	
+	/* make compressed values */
+	fprintf(stderr, "# Finalizing indexes.\n");
+	finalDB->v_index = v_index;
+	if(shortValues) {
+		finalDB->values = 0;
+		finalDB->values_s = smalloc(v_index * sizeof(short unsigned));
+		for(node = table; node != 0; node = next) {
+			next = node->next;
+			values_s = (short unsigned *)(node->values);
+			finalV_s = finalDB->values_s + node->v_index - 1;
+			i = 2 + *values_s--;
+			while(--i) {
+				*++finalV_s = *++values_s;
+			}
+			free(node->values);
+			free(node);
+		}
+	} else {
+		finalDB->values = smalloc(v_index * sizeof(unsigned));
+		finalDB->values_s = 0;
+		for(node = table; node != 0; node = next) {
+			next = node->next;
+			values = node->values;
+			finalV = finalDB->values + node->v_index - 1;
+			i = 2 + *values--;
+			while(--i) {
+				*++finalV = *++values;
+			}
+			free(node->values);
+			free(node);
+		}
+	}
+	
+	/* add terminating key */
+	i = 0;
+	if(flag) {
+		if(finalDB->mlen <= 16) { 
+			murmur(j, finalDB->key_index[n - 1]);
+			j &= finalDB->size;
+			do {
+				murmur(index, finalDB->key_index[i]);
+				index &= finalDB->size;
+				++i;
+			} while(j == index);
+			finalDB->key_index[n] = finalDB->key_index[i];
+		} else {
+			murmur(j, finalDB->key_index_l[n - 1]);
+			j &= finalDB->size;
+			do {
+				murmur(index, finalDB->key_index_l[i]);
+				index &= finalDB->size;
+				++i;
+			} while(j == index);
+			finalDB->key_index_l[n] = finalDB->key_index_l[i];
+		}
+	} else {
+		if(finalDB->mlen <= 16) { 
+			j = finalDB->key_index[n - 1] & finalDB->size;
+			while(j == (finalDB->key_index[i] & finalDB->size)) {
+				++i;
+			}
+			finalDB->key_index[n] = finalDB->key_index[i];
+		} else {
+			j = finalDB->key_index_l[n - 1] & finalDB->size;
+			while(j == (finalDB->key_index_l[i] & finalDB->size)) {
+				++i;
+			}
+			finalDB->key_index_l[n] = finalDB->key_index_l[i];
+		}
+	}
+	
+	/* dump final DB */
+	fprintf(stderr, "# Dumping compressed DB\n");	
+	++finalDB->size;
+	hashMapKMA_dump(finalDB, out);
+	
+	return finalDB;
+}
+
 void compressKMA_deconDB(HashMapKMA *finalDB, unsigned **Values) {
 	
 	long unsigned i, j, v_index, new_index, check;
@@ -1033,16 +1266,7 @@ void compressKMA_deconDB(HashMapKMA *finalDB, unsigned **Values) {
 	}
 	free(Values);
 	/* convert valuesHash to a linked list */
-	table = 0;
-	i = shmValues->size;
-	while(i--) {
-		for(node = shmValues->table[i]; node != 0; node = next) {
-			next = node->next;
-			node->next = table;
-			table = node;
-		}
-	}
-	free(shmValues->table);
+	table = valuesHash_list(shmValues);
 	
 	/* make compressed values */
 	fprintf(stderr, "# Finalizing indexes.\n");
@@ -1138,16 +1362,7 @@ void compressKMA_deconMegaDB(HashMapKMA *finalDB, unsigned **Values) {
 	}
 	free(Values);
 	/* convert valuesHash to a linked list */
-	table = 0;
-	i = shmValues->size;
-	while(i--) {
-		for(node = shmValues->table[i]; node != 0; node = next) {
-			next = node->next;
-			node->next = table;
-			table = node;
-		}
-	}
-	free(shmValues->table);
+	table = valuesHash_list(shmValues);
 	
 	/* make compressed values */
 	fprintf(stderr, "# Finalizing indexes.\n");
@@ -20,9 +20,11 @@
 #include <stdio.h>
 #include "hashmap.h"
 #include "hashmapkma.h"
+#include "radix.h"
 
 extern unsigned (*valuesSize)(unsigned *);
 HashMapKMA * compressKMA_DB(HashMap *templates, FILE *out);
 HashMapKMA * compressKMA_megaDB(HashMap *templates, FILE *out);
+HashMapKMA * compressKMA_radix(HashMap *templates, KmerPairs *pairs, FILE *out);
 void compressKMA_deconDB(HashMapKMA *finalDB, unsigned **Values);
 void compressKMA_deconMegaDB(HashMapKMA *finalDB, unsigned **Values);
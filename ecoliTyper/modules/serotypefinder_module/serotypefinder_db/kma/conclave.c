@@ -30,16 +30,6 @@
 int (*ConClavePtr)(FILE *, FILE ***, int, int, long unsigned *, unsigned *, unsigned *, long unsigned *, long unsigned *, int *, Qseqs *, Qseqs *, int *, int *, int *, Frag **) = &runConClave;
 int (*ConClave2Ptr)(FILE *, FILE ***, int, int, long unsigned *, unsigned *, unsigned *, long unsigned *, long unsigned *, int *, Qseqs *, Qseqs *, int *, int *, int *, Frag **, long unsigned, double, double) = &runConClave2;
 
-unsigned char * ustrdup(unsigned char *src, size_t n) {
-	
-	unsigned char *dest;
-	
-	dest = smalloc(n);
-	memcpy(dest, src, n);
-	
-	return dest;
-}
-
 int runConClave(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, int maxFrag, long unsigned *w_scores, unsigned *fragmentCounts, unsigned *readCounts, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, int *template_lengths, Qseqs *header, Qseqs *qseq, int *bestTemplates, int *best_start_pos, int *best_end_pos, Frag **alignFrags) {
 	
 	int i, fileCount, sparse, bestHits, read_score, flag, start, end, bestNum;
@@ -151,7 +141,7 @@ int runConClave(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, int
 		}
 		
 		/* dump frag info */
-		alignFrag = smalloc(sizeof(Frag));
+		alignFrag = frag_init(qseq, header);
 		alignFrag->buffer[0] = qseq->len;
 		alignFrag->buffer[1] = bestHits;
 		alignFrag->buffer[2] = (sparse < 0) ? 0 : read_score;
@@ -159,8 +149,6 @@ int runConClave(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, int
 		alignFrag->buffer[4] = end;
 		alignFrag->buffer[5] = header->len;
 		alignFrag->buffer[6] = flag;
-		alignFrag->qseq = ustrdup(qseq->seq, qseq->len);
-		alignFrag->header = ustrdup(header->seq, header->len);
 		alignFrag->next = alignFrags[bestTemplate];
 		alignFrags[bestTemplate] = alignFrag;
 		
@@ -177,7 +165,7 @@ int runConClave(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, int
 			sfread(qseq->seq, 1, qseq->len, frag_in_raw);
 			sfread(header->seq, 1, header->len, frag_in_raw);
 			/* dump frag info */
-			alignFrag = smalloc(sizeof(Frag));
+			alignFrag = frag_init(qseq, header);
 			alignFrag->buffer[0] = qseq->len;
 			alignFrag->buffer[1] = bestHits;
 			alignFrag->buffer[2] = (sparse < 0) ? 0 : read_score;
@@ -185,8 +173,6 @@ int runConClave(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, int
 			alignFrag->buffer[4] = end;
 			alignFrag->buffer[5] = header->len;
 			alignFrag->buffer[6] = flag;
-			alignFrag->qseq = ustrdup(qseq->seq, qseq->len);
-			alignFrag->header = ustrdup(header->seq, header->len);
 			alignFrag->next = alignFrags[bestTemplate];
 			alignFrags[bestTemplate] = alignFrag;
 			
@@ -194,7 +180,7 @@ int runConClave(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, int
 		}
 		
 		if(fragCount >= maxFrag) {
-			template_fragments[fileCount] = printFrags(alignFrags, DB_size);
+			template_fragments[fileCount] = printFragsAsync(alignFrags, DB_size);
 			++fileCount;
 			fragCount = 0;
 			/* control fileamount */
@@ -206,6 +192,7 @@ int runConClave(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, int
 			}
 		}
 	}
+	printFragsAsync(0, 0);
 	template_fragments[fileCount] = printFrags(alignFrags, DB_size);
 	*Template_fragments = template_fragments;
 	
@@ -322,7 +309,7 @@ int runConClave_lc(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, i
 		}
 		
 		/* dump frag info */
-		alignFrag = smalloc(sizeof(Frag));
+		alignFrag = frag_init(qseq, header);
 		alignFrag->buffer[0] = qseq->len;
 		alignFrag->buffer[1] = bestHits;
 		alignFrag->buffer[2] = (sparse < 0) ? 0 : read_score;
@@ -330,8 +317,6 @@ int runConClave_lc(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, i
 		alignFrag->buffer[4] = end;
 		alignFrag->buffer[5] = header->len;
 		alignFrag->buffer[6] = flag;
-		alignFrag->qseq = ustrdup(qseq->seq, qseq->len);
-		alignFrag->header = ustrdup(header->seq, header->len);
 		alignFrag->next = alignFrags[bestTemplate];
 		alignFrags[bestTemplate] = alignFrag;
 		
@@ -348,7 +333,7 @@ int runConClave_lc(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, i
 			sfread(qseq->seq, 1, qseq->len, frag_in_raw);
 			sfread(header->seq, 1, header->len, frag_in_raw);
 			/* dump frag info */
-			alignFrag = smalloc(sizeof(Frag));
+			alignFrag = frag_init(qseq, header);
 			alignFrag->buffer[0] = qseq->len;
 			alignFrag->buffer[1] = bestHits;
 			alignFrag->buffer[2] = (sparse < 0) ? 0 : read_score;
@@ -356,8 +341,6 @@ int runConClave_lc(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, i
 			alignFrag->buffer[4] = end;
 			alignFrag->buffer[5] = header->len;
 			alignFrag->buffer[6] = flag;
-			alignFrag->qseq = ustrdup(qseq->seq, qseq->len);
-			alignFrag->header = ustrdup(header->seq, header->len);
 			alignFrag->next = alignFrags[bestTemplate];
 			alignFrags[bestTemplate] = alignFrag;
 			
@@ -365,7 +348,7 @@ int runConClave_lc(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, i
 		}
 		
 		if(fragCount >= maxFrag) {
-			template_fragments[fileCount] = printFrags(alignFrags, DB_size);
+			template_fragments[fileCount] = printFragsAsync(alignFrags, DB_size);
 			++fileCount;
 			fragCount = 0;
 			/* control fileamount */
@@ -377,6 +360,7 @@ int runConClave_lc(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, i
 			}
 		}
 	}
+	printFragsAsync(0, 0);
 	template_fragments[fileCount] = printFrags(alignFrags, DB_size);
 	*Template_fragments = template_fragments;
 	
@@ -386,13 +370,12 @@ int runConClave_lc(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, i
 int runConClave2(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, int maxFrag, long unsigned *w_scores, unsigned *fragmentCounts, unsigned *readCounts, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, int *template_lengths, Qseqs *header, Qseqs *qseq, int *bestTemplates, int *best_start_pos, int *best_end_pos, Frag **alignFrags, long unsigned template_tot_ulen, double scoreT, double evalue) {
 	
 	int i, j, fileCount, sparse, bestHits, read_score, flag, start, end, rand;
-	int template, bestTemplate, best_read_score, fragCount, t_len, tot;
+	int template, bestTemplate, best_read_score, fragCount, tot;
 	int tmp_start, tmp_end, tmp_template, tmp_tmp_template;
 	int stats[5], *qBoundPtr;
 	unsigned randScore;
-	long unsigned Nhits, bestNum, score;
-	double bestScore, tmp_score, p_value;
-	long double expected, q_value;
+	long unsigned bestNum, score;
+	double bestScore, tmp_score;
 	FILE **template_fragments;
 	Frag *alignFrag;
 	
@@ -467,28 +450,7 @@ int runConClave2(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, int
 	rewind(frag_in_raw);
 	
 	/* discard insignifiacant templates */
-	Nhits = 0;
-	template = DB_size;
-	while(--template) {
-		Nhits += w_scores[template];
-	}
-	
-	template = DB_size;
-	while(--template) {
-		if((read_score = w_scores[template])) {
-			t_len = template_lengths[template];
-			expected = t_len;
-			expected /= MAX(1, (template_tot_ulen - t_len));
-			expected *= (Nhits - read_score);
-			q_value = read_score - expected;
-			q_value /= (expected + read_score);
-			q_value *= read_score - expected;
-			p_value  = p_chisqr(q_value);
-			if(cmp((p_value <= evalue && read_score > expected), (read_score >= scoreT * t_len)) == 0) {
-				w_scores[template] = 0;
-			}
-		}
-	}
+	chisqrFilter(w_scores, template_lengths, DB_size, template_tot_ulen, evalue, scoreT);
 	
 	/* identify sorting keys */
 	while(fread(stats, sizeof(int), 4, frag_in_raw) && stats[0] != 0) {
@@ -682,7 +644,7 @@ int runConClave2(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, int
 			}
 			
 			/* dump frag info */
-			alignFrag = smalloc(sizeof(Frag));
+			alignFrag = frag_init(qseq, header);
 			alignFrag->buffer[0] = qseq->len;
 			alignFrag->buffer[1] = bestHits;
 			alignFrag->buffer[2] = (sparse < 0) ? 0 : read_score;
@@ -690,8 +652,6 @@ int runConClave2(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, int
 			alignFrag->buffer[4] = end;
 			alignFrag->buffer[5] = header->len;
 			alignFrag->buffer[6] = flag;
-			alignFrag->qseq = ustrdup(qseq->seq, qseq->len);
-			alignFrag->header = ustrdup(header->seq, header->len);
 			alignFrag->next = alignFrags[bestTemplate];
 			alignFrags[bestTemplate] = alignFrag;
 			
@@ -708,7 +668,7 @@ int runConClave2(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, int
 				sfread(qseq->seq, 1, qseq->len, frag_in_raw);
 				sfread(header->seq, 1, header->len, frag_in_raw);
 				/* dump frag info */
-				alignFrag = smalloc(sizeof(Frag));
+				alignFrag = frag_init(qseq, header);
 				alignFrag->buffer[0] = qseq->len;
 				alignFrag->buffer[1] = bestHits;
 				alignFrag->buffer[2] = (sparse < 0) ? 0 : read_score;
@@ -716,8 +676,6 @@ int runConClave2(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, int
 				alignFrag->buffer[4] = end;
 				alignFrag->buffer[5] = header->len;
 				alignFrag->buffer[6] = flag;
-				alignFrag->qseq = ustrdup(qseq->seq, qseq->len);
-				alignFrag->header = ustrdup(header->seq, header->len);
 				alignFrag->next = alignFrags[bestTemplate];
 				alignFrags[bestTemplate] = alignFrag;
 				
@@ -729,7 +687,7 @@ int runConClave2(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, int
 		}
 		
 		if(fragCount >= maxFrag) {
-			template_fragments[fileCount] = printFrags(alignFrags, DB_size);
+			template_fragments[fileCount] = printFragsAsync(alignFrags, DB_size);
 			++fileCount;
 			fragCount = 0;
 			/* control fileamount */
@@ -741,6 +699,7 @@ int runConClave2(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, int
 			}
 		}
 	}
+	printFragsAsync(0, 0);
 	template_fragments[fileCount] = printFrags(alignFrags, DB_size);
 	
 	return ++fileCount;
@@ -749,13 +708,12 @@ int runConClave2(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, int
 int runConClave2_lc(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, int maxFrag, long unsigned *w_scores, unsigned *fragmentCounts, unsigned *readCounts, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, int *template_lengths, Qseqs *header, Qseqs *qseq, int *bestTemplates, int *best_start_pos, int *best_end_pos, Frag **alignFrags, long unsigned template_tot_ulen, double scoreT, double evalue) {
 	
 	int i, j, fileCount, sparse, bestHits, read_score, flag, start, end, rand;
-	int template, bestTemplate, best_read_score, fragCount, t_len, tot;
+	int template, bestTemplate, best_read_score, fragCount, tot;
 	int tmp_start, tmp_end, tmp_template, tmp_tmp_template;
 	int stats[5], *qBoundPtr;
 	unsigned randScore;
-	long unsigned Nhits, bestNum, score;
-	double bestScore, tmp_score, p_value;
-	long double expected, q_value;
+	long unsigned bestNum, score;
+	double bestScore, tmp_score;
 	FILE **template_fragments;
 	Frag *alignFrag;
 	
@@ -830,28 +788,7 @@ int runConClave2_lc(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size,
 	rewind(frag_in_raw);
 	
 	/* discard insignifiacant templates */
-	Nhits = 0;
-	template = DB_size;
-	while(--template) {
-		Nhits += w_scores[template];
-	}
-	
-	template = DB_size;
-	while(--template) {
-		if((read_score = w_scores[template])) {
-			t_len = template_lengths[template];
-			expected = t_len;
-			expected /= MAX(1, (template_tot_ulen - t_len));
-			expected *= (Nhits - read_score);
-			q_value = read_score - expected;
-			q_value /= (expected + read_score);
-			q_value *= read_score - expected;
-			p_value  = p_chisqr(q_value);
-			if(cmp((p_value <= evalue && read_score > expected), (read_score >= scoreT * t_len)) == 0) {
-				w_scores[template] = 0;
-			}
-		}
-	}
+	chisqrFilter(w_scores, template_lengths, DB_size, template_tot_ulen, evalue, scoreT);
 	
 	/* identify sorting keys */
 	while(fread(stats, sizeof(int), 4, frag_in_raw) && stats[0] != 0) {
@@ -1045,7 +982,7 @@ int runConClave2_lc(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size,
 			}
 			
 			/* dump frag info */
-			alignFrag = smalloc(sizeof(Frag));
+			alignFrag = frag_init(qseq, header);
 			alignFrag->buffer[0] = qseq->len;
 			alignFrag->buffer[1] = bestHits;
 			alignFrag->buffer[2] = (sparse < 0) ? 0 : read_score;
@@ -1053,8 +990,6 @@ int runConClave2_lc(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size,
 			alignFrag->buffer[4] = end;
 			alignFrag->buffer[5] = header->len;
 			alignFrag->buffer[6] = flag;
-			alignFrag->qseq = ustrdup(qseq->seq, qseq->len);
-			alignFrag->header = ustrdup(header->seq, header->len);
 			alignFrag->next = alignFrags[bestTemplate];
 			alignFrags[bestTemplate] = alignFrag;
 			
@@ -1071,7 +1006,7 @@ int runConClave2_lc(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size,
 				sfread(qseq->seq, 1, qseq->len, frag_in_raw);
 				sfread(header->seq, 1, header->len, frag_in_raw);
 				/* dump frag info */
-				alignFrag = smalloc(sizeof(Frag));
+				alignFrag = frag_init(qseq, header);
 				alignFrag->buffer[0] = qseq->len;
 				alignFrag->buffer[1] = bestHits;
 				alignFrag->buffer[2] = (sparse < 0) ? 0 : read_score;
@@ -1079,8 +1014,6 @@ int runConClave2_lc(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size,
 				alignFrag->buffer[4] = end;
 				alignFrag->buffer[5] = header->len;
 				alignFrag->buffer[6] = flag;
-				alignFrag->qseq = ustrdup(qseq->seq, qseq->len);
-				alignFrag->header = ustrdup(header->seq, header->len);
 				alignFrag->next = alignFrags[bestTemplate];
 				alignFrags[bestTemplate] = alignFrag;
 				
@@ -1092,7 +1025,7 @@ int runConClave2_lc(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size,
 		}
 		
 		if(fragCount >= maxFrag) {
-			template_fragments[fileCount] = printFrags(alignFrags, DB_size);
+			template_fragments[fileCount] = printFragsAsync(alignFrags, DB_size);
 			++fileCount;
 			fragCount = 0;
 			/* control fileamount */
@@ -1104,6 +1037,7 @@ int runConClave2_lc(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size,
 			}
 		}
 	}
+	printFragsAsync(0, 0);
 	template_fragments[fileCount] = printFrags(alignFrags, DB_size);
 	
 	return ++fileCount;
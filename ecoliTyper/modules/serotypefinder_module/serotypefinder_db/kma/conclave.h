@@ -24,7 +24,6 @@
 extern int (*ConClavePtr)(FILE *, FILE ***, int, int, long unsigned *, unsigned *, unsigned *, long unsigned *, long unsigned *, int *, Qseqs *, Qseqs *, int *, int *, int *, Frag **);
 extern int (*ConClave2Ptr)(FILE *, FILE ***, int, int, long unsigned *, unsigned *, unsigned *, long unsigned *, long unsigned *, int *, Qseqs *, Qseqs *, int *, int *, int *, Frag **, long unsigned, double, double);
 
-unsigned char * ustrdup(unsigned char *src, size_t n);
 int runConClave(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, int maxFrag, long unsigned *w_scores, unsigned *fragmentCounts, unsigned *readCounts, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, int *template_lengths, Qseqs *header, Qseqs *qseq, int *bestTemplates, int *best_start_pos, int *best_end_pos, Frag **alignFrags);
 int runConClave_lc(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, int maxFrag, long unsigned *w_scores, unsigned *fragmentCounts, unsigned *readCounts, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, int *template_lengths, Qseqs *header, Qseqs *qseq, int *bestTemplates, int *best_start_pos, int *best_end_pos, Frag **alignFrags);
 int runConClave2(FILE *frag_in_raw, FILE ***Template_fragments, int DB_size, int maxFrag, long unsigned *w_scores, unsigned *fragmentCounts, unsigned *readCounts, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, int *template_lengths, Qseqs *header, Qseqs *qseq, int *bestTemplates, int *best_start_pos, int *best_end_pos, Frag **alignFrags, long unsigned template_tot_ulen, double scoreT, double evalue);
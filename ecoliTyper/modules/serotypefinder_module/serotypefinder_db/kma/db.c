@@ -23,10 +23,11 @@
 #include <string.h>
 #include "db.h"
 #include "hashmapkma.h"
+#include "pack.h"
 #include "pherror.h"
 #include "stdstat.h"
 
-void dbInfo(char *filename) {
+void dbInfo(char *filename, int head) {
 	
 	const char bases[6] = "ACGTN-";
 	int i, filename_len, min, max;
@@ -56,7 +57,7 @@ void dbInfo(char *filename) {
 	strcpy(filename + filename_len, ".comp.b");
 	dbfile = sfopen(filename, "rb" );
 	templates = smalloc(sizeof(HashMapKMA));
-	if(hashMapKMA_load(templates, dbfile, filename) == 1) {
+	if((head ? hashMapKMA_loadHead(templates, dbfile) : hashMapKMAload(templates, dbfile)) == 1) {
 		fprintf(stderr, "Wrong format of DB.\n");
 		exit(1);
 	}
@@ -86,6 +87,11 @@ void dbInfo(char *filename) {
 	fprintf(stdout, "k-mer fraction covered:\t%f\n", templates->n / power(4, templates->kmersize));
 	fprintf(stdout, "inferred tax size:\t%lu\n", templates->v_index);
 	fflush(stdout);
+	if(head) {
+		/* the arrays were skipped */
+		free(templates);
+		return;
+	}
 	
 	/* get number of unique inferred tax */
 	ntax = 0;
@@ -182,6 +188,9 @@ static void helpMessage(int exeStatus) {
 	fprintf(helpOut, "# Options are:\t\tDesc:\t\t\t\t\tRequirements:\n");
 	fprintf(helpOut, "#\n");
 	fprintf(helpOut, "#\t-t_db\t\tTemplate DB\t\t\t\tREQUIRED\n");
+	fprintf(helpOut, "#\t-head\t\tOnly statistics from the header\t\tFalse\n");
+	fprintf(helpOut, "#\t-pack\t\tPack DB into a single container\tFalse\n");
+	fprintf(helpOut, "#\t-embed\t\tWrite DB(s) as C, for make kma_embed\tFalse\n");
 	fprintf(helpOut, "#\t-h\t\tShows this help message\n");
 	fprintf(helpOut, "#\n");
 	exit(exeStatus);
@@ -190,17 +199,34 @@ static void helpMessage(int exeStatus) {
 int db_main(int argc, char *argv[]) {
 	
 	unsigned args;
-	char *filename;
+	int head, pack, n;
+	char *filename, *embed, **filenames;
 	
 	/* set defaults */
 	filename = 0;
+	filenames = smalloc(argc * sizeof(char *));
+	n = 0;
+	embed = 0;
+	head = 0;
+	pack = 0;
 	args = 1;
 	while(args < argc) {
 		if(strcmp(argv[args], "-t_db") == 0) {
-			if(++args < argc) {
+			while(++args < argc && *argv[args] != '-') {
 				filename = smalloc(strlen(argv[args]) + 64);
 				strcpy(filename, argv[args]);
+				filenames[n++] = filename;
 			}
+			--args;
+			filename = n ? *filenames : 0;
+		} else if(strcmp(argv[args], "-embed") == 0) {
+			if(++args < argc) {
+				embed = argv[args];
+			}
+		} else if(strcmp(argv[args], "-head") == 0) {
+			head = 1;
+		} else if(strcmp(argv[args], "-pack") == 0) {
+			pack = 1;
 		} else if(strcmp(argv[args], "-h") == 0) {
 			helpMessage(0);
 		} else {
@@ -216,7 +242,13 @@ int db_main(int argc, char *argv[]) {
 		helpMessage(1);
 	}
 	
-	dbInfo(filename);
+	if(embed) {
+		return packEmbedSrc(filenames, n, embed);
+	} else if(pack) {
+		return packDB(filename);
+	}
+	packLoad(filename);
+	dbInfo(filename, head);
 	
 	return 0;
 }
@@ -17,5 +17,5 @@
  * limitations under the License.
 */
 
-void dbInfo(char *filename);
+void dbInfo(char *filename, int head);
 int db_main(int argc, char *argv[]);
@@ -0,0 +1,229 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+#include "dbmap.h"
+#include "hashmapcci.h"
+#include "pack.h"
+#include "pherror.h"
+#include "qseqs.h"
+#include "runkma.h"
+
+char * (*nameLoadPtr)(Qseqs *, FILE *, int) = &nameLoadSeq;
+void (*nameSkipPtr)(FILE *) = &nameSkipSeq;
+static unsigned char *nameData = 0;
+static long unsigned nameSize = 0, *nameIndex = 0;
+static int nameNum = 0, nameBuilt = 0;
+
+char * nameLoadSeq(Qseqs *name, FILE *infile, int template) {
+	return nameLoad(name, infile);
+}
+
+void nameSkipSeq(FILE *infile) {
+	
+	int c;
+	
+	nameSkip(infile, c);
+}
+
+static long unsigned * nameIndexMake(const unsigned char *data, long unsigned size, int num) {
+	
+	int template;
+	long unsigned pos, *index;
+	unsigned char *ptr;
+	
+	/* offset of every name, read through the names once */
+	index = smalloc((num + 2) * sizeof(long unsigned));
+	*index = num;
+	index[1] = size;
+	index += 2;
+	*index = 0;
+	pos = 0;
+	for(template = 1; template < num; ++template) {
+		if(size <= pos) {
+			free(index - 2);
+			return 0;
+		}
+		index[template] = pos;
+		ptr = memchr(data + pos, '\n', size - pos);
+		pos = ptr ? ptr - data + 1 : size;
+	}
+	
+	return index;
+}
+
+static void nameIndexSave(char *filename, const long unsigned *index) {
+	
+	char *tmpname;
+	FILE *out;
+	
+	/* replace the index in one go */
+	tmpname = smalloc(strlen(filename) + 32);
+	sprintf(tmpname, "%s.%d", filename, (int) getpid());
+	if((out = fopen(tmpname, "wb"))) {
+		if(fwrite(index - 2, sizeof(long unsigned), index[-2] + 2, out) != index[-2] + 2 || fclose(out) || rename(tmpname, filename)) {
+			unlink(tmpname);
+		}
+	}
+	free(tmpname);
+	errno = 0;
+}
+
+static int nameIndexBuild(void) {
+	
+	if(nameBuilt) {
+		return 1;
+	}
+	nameBuilt = 1;
+	
+	return !(nameIndex = nameIndexMake(nameData, nameSize, nameNum));
+}
+
+char * nameLoadMap(Qseqs *name, FILE *infile, int template) {
+	
+	long unsigned start, len;
+	unsigned char *ptr;
+	
+	/* offsets from an outdated index are caught at the line boundary */
+	start = nameIndex[template];
+	if(nameSize <= start || (start && nameData[start - 1] != '\n')) {
+		if(nameIndexBuild()) {
+			fprintf(stderr, "Malformatted *.name\n");
+			exit(1);
+		}
+		start = nameIndex[template];
+	}
+	ptr = memchr(nameData + start, '\n', nameSize - start);
+	len = ptr ? ptr - (nameData + start) : nameSize - start;
+	
+	if(name->size <= len) {
+		free(name->seq);
+		name->size = len + 1;
+		name->seq = smalloc(name->size);
+	}
+	memcpy(name->seq, nameData + start, len);
+	name->seq[len] = 0;
+	
+	return (char *) name->seq;
+}
+
+void nameSkipMap(FILE *infile) {
+	return;
+}
+
+int dbMapNames(char *templatefilename, int DB_size) {
+	
+	int file_len;
+	long unsigned size, *index;
+	
+	/* map names */
+	file_len = strlen(templatefilename);
+	strcat(templatefilename, ".name");
+	nameData = packMmap(templatefilename, &nameSize);
+	templatefilename[file_len] = 0;
+	if(!nameData) {
+		return 1;
+	}
+	posix_madvise(nameData, nameSize, POSIX_MADV_RANDOM);
+	nameNum = DB_size;
+	
+	/* use index if it fits the names, else rebuild it in memory only,
+	   as the DB files are left to kma_index */
+	strcat(templatefilename, ".name.b");
+	index = (long unsigned *) packMmap(templatefilename, &size);
+	errno = 0;
+	if(index && size == (DB_size + 2) * sizeof(long unsigned) && *index == DB_size && index[1] == nameSize) {
+		nameIndex = index + 2;
+	} else if(nameIndexBuild()) {
+		templatefilename[file_len] = 0;
+		nameData = 0;
+		return 1;
+	}
+	templatefilename[file_len] = 0;
+	
+	nameLoadPtr = &nameLoadMap;
+	nameSkipPtr = &nameSkipMap;
+	
+	return 0;
+}
+
+int dbIndexNames(char *templatefilename) {
+	
+	int file_len, DB_size;
+	long unsigned size, *index;
+	unsigned char *data;
+	FILE *infile;
+	
+	/* offsets of the names, written with the DB so read-only DBs have them too */
+	file_len = strlen(templatefilename);
+	strcat(templatefilename, ".length.b");
+	infile = sfopen(templatefilename, "rb");
+	sfread(&DB_size, sizeof(int), 1, infile);
+	fclose(infile);
+	templatefilename[file_len] = 0;
+	strcat(templatefilename, ".name");
+	infile = sfopen(templatefilename, "rb");
+	sfseek(infile, 0, SEEK_END);
+	size = ftell(infile);
+	rewind(infile);
+	data = smalloc(size + 1);
+	sfread(data, 1, size, infile);
+	fclose(infile);
+	
+	strcat(templatefilename, ".b");
+	index = nameIndexMake(data, size, DB_size);
+	if(index) {
+		nameIndexSave(templatefilename, index);
+		free(index - 2);
+	} else {
+		remove(templatefilename);
+		errno = 0;
+	}
+	templatefilename[file_len] = 0;
+	free(data);
+	
+	return !index;
+}
+
+int dbMapSeq(char *templatefilename, int seq_in) {
+	
+	int file_len;
+	long unsigned size;
+	unsigned char *data;
+	
+	/* map sequences */
+	file_len = strlen(templatefilename);
+	strcat(templatefilename, ".seq.b");
+	data = packMmap(templatefilename, &size);
+	templatefilename[file_len] = 0;
+	if(!data) {
+		return 1;
+	}
+	posix_madvise(data, size, POSIX_MADV_RANDOM);
+	alignMap(data, packStart(seq_in), size);
+	
+	return 0;
+}
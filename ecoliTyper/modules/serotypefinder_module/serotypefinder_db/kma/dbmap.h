@@ -0,0 +1,36 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include "qseqs.h"
+
+/*
+ Template names and sequences are used through mmap, so only the pages of
+ templates with hits are touched. Name offsets are kept in "<db>.name.b",
+ made by kma_index, or on first use.
+*/
+extern char * (*nameLoadPtr)(Qseqs *, FILE *, int);
+extern void (*nameSkipPtr)(FILE *);
+char * nameLoadSeq(Qseqs *name, FILE *infile, int template);
+void nameSkipSeq(FILE *infile);
+char * nameLoadMap(Qseqs *name, FILE *infile, int template);
+void nameSkipMap(FILE *infile);
+int dbMapNames(char *templatefilename, int DB_size);
+int dbIndexNames(char *templatefilename);
+int dbMapSeq(char *templatefilename, int seq_in);
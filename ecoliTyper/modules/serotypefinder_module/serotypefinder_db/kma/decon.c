@@ -17,7 +17,10 @@
  * limitations under the License.
 */
 #define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 #include "compdna.h"
 #include "decon.h"
 #include "filebuff.h"
@@ -30,6 +33,7 @@
 
 int (*deConNode_ptr)(CompDNA *, HashMapKMA *, unsigned **);
 int (*addCont)(HashMapKMA *, long unsigned, int, unsigned **);
+static unsigned char *deConMarks;
 
 int hashMap_addCont(HashMapKMA *dest, long unsigned key, int value, unsigned **Values) {
 	
@@ -74,6 +78,41 @@ int megaMap_addCont(HashMapKMA *dest, long unsigned index, int value, unsigned *
 	return 0;
 }
 
+int hashMap_markCont(HashMapKMA *dest, long unsigned key, int value, unsigned **Values) {
+	
+	unsigned pos, kpos;
+	long unsigned kmer;
+	
+	kpos = key & dest->size;
+	pos = getExistPtr(dest->exist, kpos);
+	
+	if(pos != dest->null_index) {
+		kmer = getKeyPtr(dest->key_index, pos);
+		while(key != kmer) {
+			++pos;
+			if(kpos != (kmer & dest->size)) {
+				return 0;
+			}
+			kmer = getKeyPtr(dest->key_index, pos);
+		}
+		/* the values are added by the owner of pos after the scan */
+		deConMarks[getValueIndexPtr(dest->value_index, pos)] = 1;
+	}
+	
+	return 0;
+}
+
+int megaMap_markCont(HashMapKMA *dest, long unsigned index, int value, unsigned **Values) {
+	
+	long unsigned pos;
+	
+	if((pos = getExistPtr(dest->exist, index)) != dest->n) {
+		deConMarks[pos] = 1;
+	}
+	
+	return 0;
+}
+
 int deConNode(CompDNA *qseq, HashMapKMA *finalDB, unsigned **Values) {
 	
 	int i, j, end, mapped_cont, shifter, DB_size, mPos, hLen;
@@ -158,26 +197,115 @@ int deConNode_sparse(CompDNA *qseq, HashMapKMA *finalDB, unsigned **Values) {
 	return mapped_cont;
 }
 
-unsigned deConDB(HashMapKMA *finalDB, char **inputfiles, int fileCount, char *trans, unsigned **Values) {
+void * deConMark_thread(void *arg) {
+	
+	int i;
+	DeConThread *thread = arg;
+	CompDNA *qseq;
+	
+	/* mark the k-mers of every thread_num'th sequence, on both strands */
+	for(i = thread->num; i < thread->size; i += thread->thread_num) {
+		qseq = thread->batch + i;
+		deConNode_ptr(qseq, thread->finalDB, thread->Values);
+		comp_rc(qseq);
+		deConNode_ptr(qseq, thread->finalDB, thread->Values);
+	}
+	
+	return NULL;
+}
+
+void * deConApply_thread(void *arg) {
+	
+	DeConThread *thread = arg;
+	unsigned *values, **Values;
+	long unsigned i, end;
+	
+	/* add contamination to the values of this threads range */
+	Values = thread->Values;
+	i = thread->finalDB->n * thread->num / thread->thread_num;
+	end = thread->finalDB->n * (thread->num + 1) / thread->thread_num;
+	thread->mapped_cont = 0;
+	for(; i < end; ++i) {
+		if(deConMarks[i] && (values = updateValuePtr(Values[i], thread->finalDB->DB_size))) {
+			Values[i] = values;
+			++thread->mapped_cont;
+		}
+	}
+	
+	return NULL;
+}
+
+static void deConRun(DeConThread *threads, int thread_num, void * (*func)(void *)) {
+	
+	int i;
+	
+	/* thread out */
+	for(i = thread_num - 1; 0 <= i; --i) {
+		threads[i].id = 0;
+		if(i && (errno = pthread_create(&threads[i].id, NULL, func, threads + i))) {
+			fprintf(stderr, "Error: %d (%s)\n", errno, strerror(errno));
+			ERROR();
+		}
+	}
+	
+	/* start main thread */
+	func(threads);
+	
+	/* join threads */
+	for(i = 1; i < thread_num; ++i) {
+		if((errno = pthread_join(threads[i].id, NULL))) {
+			ERROR();
+		}
+	}
+}
+
+unsigned deConDB(HashMapKMA *finalDB, char **inputfiles, int fileCount, char *trans, unsigned **Values, int thread_num) {
 	
-	int FASTQ;
+	int i, FASTQ, batchSize;
 	unsigned fileCounter, mapped_cont;
 	char *filename;
 	Qseqs *header, *qseq;
 	FileBuff *inputfile;
-	CompDNA *compressor;
+	CompDNA *compressor, *batch;
+	DeConThread *threads;
 	
 	/* allocate */
-	compressor = smalloc(sizeof(CompDNA));
-	allocComp(compressor, 1024);
+	if(thread_num != 1) {
+		/* k-mers are marked by batches of sequences, and added after */
+		batch = smalloc(DECONBATCH * sizeof(CompDNA));
+		for(i = 0; i < DECONBATCH; ++i) {
+			allocComp(batch + i, 1024);
+		}
+		threads = smalloc(thread_num * sizeof(DeConThread));
+		for(i = 0; i < thread_num; ++i) {
+			threads[i].num = i;
+			threads[i].thread_num = thread_num;
+			threads[i].batch = batch;
+			threads[i].finalDB = finalDB;
+			threads[i].Values = Values;
+		}
+		deConMarks = calloc(finalDB->n, 1);
+		if(!deConMarks) {
+			ERROR();
+		}
+		compressor = batch;
+	} else {
+		batch = 0;
+		threads = 0;
+		compressor = smalloc(sizeof(CompDNA));
+		allocComp(compressor, 1024);
+	}
 	header = setQseqs(1024);
 	qseq = setQseqs(1024);
 	inputfile = setFileBuff(1024 * 1024);
 	
 	/* set variables */
 	mapped_cont = 0;
+	batchSize = 0;
 	if(--finalDB->size == finalDB->mask) {
-		addCont = &megaMap_addCont;
+		addCont = batch ? &megaMap_markCont : &megaMap_addCont;
+	} else if(batch) {
+		addCont = &hashMap_markCont;
 	}
 	
 	/* iterate inputfiles */
@@ -198,11 +326,24 @@ unsigned deConDB(HashMapKMA *finalDB, char **inputfiles, int fileCount, char *tr
 					}
 					compDNAref(compressor, qseq->seq, qseq->len);
 					
-					/* Add contamination */
-					mapped_cont += deConNode_ptr(compressor, finalDB, Values);
-					/* rc */
-					comp_rc(compressor);
-					mapped_cont += deConNode_ptr(compressor, finalDB, Values);
+					if(batch) {
+						/* queue sequence */
+						compressor = batch + ++batchSize;
+						if(batchSize == DECONBATCH) {
+							for(i = 0; i < thread_num; ++i) {
+								threads[i].size = batchSize;
+							}
+							deConRun(threads, thread_num, &deConMark_thread);
+							compressor = batch;
+							batchSize = 0;
+						}
+					} else {
+						/* Add contamination */
+						mapped_cont += deConNode_ptr(compressor, finalDB, Values);
+						/* rc */
+						comp_rc(compressor);
+						mapped_cont += deConNode_ptr(compressor, finalDB, Values);
+					}
 				}
 			}
 			
@@ -214,11 +355,35 @@ unsigned deConDB(HashMapKMA *finalDB, char **inputfiles, int fileCount, char *tr
 			}
 		}
 	}
+	
+	/* add the marked contamination */
+	if(batch) {
+		for(i = 0; i < thread_num; ++i) {
+			threads[i].size = batchSize;
+		}
+		if(batchSize) {
+			deConRun(threads, thread_num, &deConMark_thread);
+		}
+		deConRun(threads, thread_num, &deConApply_thread);
+		for(i = 0; i < thread_num; ++i) {
+			mapped_cont += threads[i].mapped_cont;
+		}
+	}
 	++finalDB->size;
 	
 	/* clean */
-	freeComp(compressor);
-	free(compressor);
+	if(batch) {
+		for(i = 0; i < DECONBATCH; ++i) {
+			freeComp(batch + i);
+		}
+		free(batch);
+		free(threads);
+		free(deConMarks);
+		deConMarks = 0;
+	} else {
+		freeComp(compressor);
+		free(compressor);
+	}
 	destroyQseqs(header);
 	destroyQseqs(qseq);
 	destroyFileBuff(inputfile);
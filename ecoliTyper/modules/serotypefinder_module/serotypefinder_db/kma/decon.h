@@ -17,13 +17,34 @@
  * limitations under the License.
 */
 #define _XOPEN_SOURCE 600
+#include <pthread.h>
 #include "compdna.h"
 #include "hashmapkma.h"
 
+#ifndef DECON
+#define DECONBATCH 1024
+typedef struct deConThread DeConThread;
+struct deConThread {
+	pthread_t id;
+	int num;
+	int thread_num;
+	int size;
+	unsigned mapped_cont;
+	CompDNA *batch;
+	HashMapKMA *finalDB;
+	unsigned **Values;
+};
+#define DECON 1
+#endif
+
 extern int (*deConNode_ptr)(CompDNA *, HashMapKMA *, unsigned **);
 extern int (*addCont)(HashMapKMA *, long unsigned, int, unsigned **);
 int hashMap_addCont(HashMapKMA *dest, long unsigned key, int value, unsigned **Values);
 int megaMap_addCont(HashMapKMA *dest, long unsigned index, int value, unsigned **Values);
+int hashMap_markCont(HashMapKMA *dest, long unsigned key, int value, unsigned **Values);
+int megaMap_markCont(HashMapKMA *dest, long unsigned index, int value, unsigned **Values);
 int deConNode(CompDNA *qseq, HashMapKMA *finalDB, unsigned **Values);
 int deConNode_sparse(CompDNA *qseq, HashMapKMA *finalDB, unsigned **Values);
-unsigned deConDB(HashMapKMA *finalDB, char **inputfiles, int fileCount, char *trans, unsigned **Values);
+void * deConMark_thread(void *arg);
+void * deConApply_thread(void *arg);
+unsigned deConDB(HashMapKMA *finalDB, char **inputfiles, int fileCount, char *trans, unsigned **Values, int thread_num);
@@ -0,0 +1,199 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "delta.h"
+#include "hashmapkma.h"
+#include "pherror.h"
+#include "stdstat.h"
+
+unsigned * (*hashMap_getUndelta)(const HashMapKMA *, const long unsigned) = &hashMap_getGlobal;
+void (*hashMap_getBatchUndelta)(const HashMapKMA *, const long unsigned *, int, unsigned **) = &hashMap_getBatchGlobal;
+
+static int deltaRead(void *dest, size_t unit, long unsigned n, FILE *file) {
+	
+	long unsigned i, *dest_l;
+	unsigned *dest_u;
+	
+	/* read n entries of unit size, and widen them in place */
+	if(fread(dest, unit, n, file) != n) {
+		return 1;
+	}
+	if(unit == sizeof(unsigned)) {
+		dest_l = dest;
+		dest_u = dest;
+		i = n;
+		while(i--) {
+			dest_l[i] = dest_u[i];
+		}
+	}
+	
+	return 0;
+}
+
+HashMapKMA * hashMapKMA_loadDelta(FILE *file) {
+	
+	size_t unit;
+	HashMapKMA *dest;
+	
+	dest = smalloc(sizeof(HashMapKMA));
+	memset(dest, 0, sizeof(HashMapKMA));
+	
+	/* load sizes */
+	sfread(&dest->DB_size, sizeof(unsigned), 1, file);
+	sfread(&dest->mlen, sizeof(unsigned), 1, file);
+	sfread(&dest->prefix_len, sizeof(unsigned), 1, file);
+	sfread(&dest->prefix, sizeof(long unsigned), 1, file);
+	sfread(&dest->size, sizeof(long unsigned), 1, file);
+	sfread(&dest->n, sizeof(long unsigned), 1, file);
+	sfread(&dest->v_index, sizeof(long unsigned), 1, file);
+	sfread(&dest->null_index, sizeof(long unsigned), 1, file);
+	dest->mask = 0xFFFFFFFFFFFFFFFF >> (64 - (dest->mlen << 1));
+	
+	/* deltas are always hashed */
+	if((dest->size - 1) == dest->mask || dest->prefix_len || dest->prefix) {
+		free(dest);
+		return 0;
+	}
+	
+	/* load arrays, with all indexes as long */
+	dest->exist_l = smalloc(dest->size * sizeof(long unsigned));
+	unit = dest->DB_size < USHRT_MAX ? sizeof(short unsigned) : sizeof(unsigned);
+	dest->values = smalloc(dest->v_index * unit + 1);
+	dest->values_s = (short unsigned *)(dest->values);
+	dest->key_index_l = smalloc((dest->n + 1) * sizeof(long unsigned));
+	dest->value_index_l = smalloc((dest->n + 1) * sizeof(long unsigned));
+	if(deltaRead(dest->exist_l, dest->n <= UINT_MAX ? sizeof(unsigned) : sizeof(long unsigned), dest->size, file) 
+		|| fread(dest->values, unit, dest->v_index, file) != dest->v_index 
+		|| deltaRead(dest->key_index_l, dest->mlen <= 16 ? sizeof(unsigned) : sizeof(long unsigned), dest->n + 1, file) 
+		|| deltaRead(dest->value_index_l, dest->v_index < UINT_MAX ? sizeof(unsigned) : sizeof(long unsigned), dest->n, file) 
+		|| !fread(&dest->kmersize, sizeof(unsigned), 1, file) 
+		|| !fread(&dest->flag, sizeof(unsigned), 1, file)) {
+		hashMapKMA_freeDelta(dest);
+		return 0;
+	}
+	--dest->size;
+	
+	return dest;
+}
+
+void hashMapKMA_freeDelta(HashMapKMA *src) {
+	
+	if(src) {
+		free(src->exist_l);
+		free(src->values);
+		free(src->key_index_l);
+		free(src->value_index_l);
+		free(src);
+	}
+}
+
+unsigned * deltaMap_get(const HashMapKMA *delta, const long unsigned key) {
+	
+	long unsigned pos, kpos, kmer;
+	
+	if(delta->flag) {
+		murmur(kpos, key);
+		kpos &= delta->size;
+	} else {
+		kpos = key & delta->size;
+	}
+	
+	if((pos = delta->exist_l[kpos]) != delta->null_index) {
+		while(key != (kmer = delta->key_index_l[pos])) {
+			if(delta->flag) {
+				murmur(kmer, kmer);
+			}
+			if(kpos != (kmer & delta->size)) {
+				return 0;
+			}
+			++pos;
+		}
+		if(delta->DB_size < USHRT_MAX) {
+			return (unsigned *)(delta->values_s + delta->value_index_l[pos]);
+		}
+		return delta->values + delta->value_index_l[pos];
+	}
+	
+	return 0;
+}
+
+unsigned * hashMap_getDelta(const HashMapKMA *templates, const long unsigned key) {
+	
+	unsigned *values;
+	
+	if((values = deltaMap_get(templates->delta, key))) {
+		return values;
+	}
+	
+	return hashMap_getUndelta(templates, key);
+}
+
+void hashMap_getBatchDelta(const HashMapKMA *templates, const long unsigned *keys, int n, unsigned **values) {
+	
+	int i, m, misses, index[HASHMAPBATCH];
+	long unsigned pass[HASHMAPBATCH];
+	unsigned *found[HASHMAPBATCH];
+	
+	for(; 0 < n; n -= HASHMAPBATCH, keys += HASHMAPBATCH, values += HASHMAPBATCH) {
+		m = n < HASHMAPBATCH ? n : HASHMAPBATCH;
+		
+		/* pass k-mers missing in the delta on to the base */
+		misses = 0;
+		for(i = 0; i < m; ++i) {
+			if(!(values[i] = deltaMap_get(templates->delta, keys[i]))) {
+				index[misses] = i;
+				pass[misses++] = keys[i];
+			}
+		}
+		if(misses) {
+			hashMap_getBatchUndelta(templates, pass, misses, found);
+			for(i = 0; i < misses; ++i) {
+				values[index[i]] = found[i];
+			}
+		}
+	}
+}
+
+int hashMapKMA_attachDelta(HashMapKMA *dest, FILE *file) {
+	
+	HashMapKMA *delta;
+	
+	/* check that the delta belongs to dest */
+	if(!(delta = hashMapKMA_loadDelta(file))) {
+		return 1;
+	} else if(delta->kmersize != dest->kmersize || delta->mlen != dest->mlen || delta->flag != dest->flag || delta->prefix != dest->prefix || delta->prefix_len != dest->prefix_len || (delta->DB_size < USHRT_MAX) != (dest->DB_size < USHRT_MAX) || delta->DB_size < dest->DB_size) {
+		hashMapKMA_freeDelta(delta);
+		return 1;
+	}
+	dest->delta = delta;
+	dest->DB_size = delta->DB_size;
+	dest->shmFlag |= 512;
+	
+	/* put the delta in front of the chosen lookups, filter included */
+	hashMap_getUndelta = hashMap_get;
+	hashMap_getBatchUndelta = hashMap_getBatch;
+	hashMap_get = &hashMap_getDelta;
+	hashMap_getBatch = &hashMap_getBatchDelta;
+	
+	return 0;
+}
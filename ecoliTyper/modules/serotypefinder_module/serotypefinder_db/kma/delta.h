@@ -0,0 +1,37 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#include <stdio.h>
+#include "hashmapkma.h"
+
+/*
+ A delta holds the k-mers of templates added after the *.comp.b was
+ written, in the same format. Its value lists are complete, i.e. they
+ include the templates of the base index, so a hit in the delta replaces
+ the lookup in the base.
+*/
+
+extern unsigned * (*hashMap_getUndelta)(const HashMapKMA *, const long unsigned);
+extern void (*hashMap_getBatchUndelta)(const HashMapKMA *, const long unsigned *, int, unsigned **);
+
+HashMapKMA * hashMapKMA_loadDelta(FILE *file);
+void hashMapKMA_freeDelta(HashMapKMA *src);
+unsigned * deltaMap_get(const HashMapKMA *delta, const long unsigned key);
+unsigned * hashMap_getDelta(const HashMapKMA *templates, const long unsigned key);
+void hashMap_getBatchDelta(const HashMapKMA *templates, const long unsigned *keys, int n, unsigned **values);
+int hashMapKMA_attachDelta(HashMapKMA *dest, FILE *file);
@@ -168,7 +168,7 @@ void destroyValues(HashMapKMA *src) {
 	free(src);
 }
 
-void kmerSimilarity(HashMapKMA *DB, Matrix *Dist, int *N) {
+void kmerSimilarity(HashMapKMA *DB, Matrix *Dist, int *N, int first) {
 	
 	int i, j, el, vs, v_i, **D, *Di;
 	unsigned *exist, *values_i, *values_j;
@@ -194,7 +194,9 @@ void kmerSimilarity(HashMapKMA *DB, Matrix *Dist, int *N) {
 				while(--i) {
 					j = i;
 					values_sj = --values_si;
-					v_i = *values_si - 1;
+					if((v_i = *values_si - 1) < first) {
+						break;
+					}
 					Di = D[v_i];
 					while(--j) {
 						++Di[*--values_sj - 1];
@@ -208,7 +210,9 @@ void kmerSimilarity(HashMapKMA *DB, Matrix *Dist, int *N) {
 				while(--i) {
 					j = i;
 					values_j = --values_i;
-					v_i = *values_i - 1;
+					if((v_i = *values_i - 1) < first) {
+						break;
+					}
 					Di = D[v_i];
 					while(--j) {
 						++Di[*--values_j - 1];
@@ -224,89 +228,108 @@ void kmerSimilarity(HashMapKMA *DB, Matrix *Dist, int *N) {
 	destroyValues(DB);
 }
 
-void kmerSimilarity_thread(HashMapKMA *DB, Matrix *Dist, int *N, int thread_num, volatile int *lock) {
+static int lowerBound_s(const short unsigned *values, int n, unsigned value) {
 	
-	static volatile int thread_wait = 0;
-	static volatile long unsigned next;
-	static long unsigned n;
-	int i, j, el, vs, v_i, chunk, chunkster, **D, *Di, *Dptr;
-	unsigned *exist, *values_i, *values_j;
-	long unsigned pos, size, *exist_l;
-	short unsigned *values_si, *values_sj;
+	int i, half;
+	
+	/* first of the n sorted values not below value */
+	i = 0;
+	while(n) {
+		half = n >> 1;
+		if(values[i + half] < value) {
+			i += half + 1;
+			n -= half + 1;
+		} else {
+			n = half;
+		}
+	}
+	
+	return i;
+}
+
+static int lowerBound(const unsigned *values, int n, unsigned value) {
+	
+	int i, half;
+	
+	/* first of the n sorted values not below value */
+	i = 0;
+	while(n) {
+		half = n >> 1;
+		if(values[i + half] < value) {
+			i += half + 1;
+			n -= half + 1;
+		} else {
+			n = half;
+		}
+	}
+	
+	return i;
+}
+
+void kmerSimilarity_thread(HashMapKMA *DB, Matrix *Dist, int *N, int first, int thread_num, volatile int *lock) {
+	
+	static volatile int thread_wait = 0, next = 0;
+	int i, j, el, vs, v_i, m, start, end, block, blocks, **D, *Di;
+	unsigned *values_i;
+	long unsigned k, pos, size;
+	short unsigned *values_si;
+	double lo, area;
 	
 	/* init */
 	el = DB->v_index < UINT_MAX;
 	vs = DB->DB_size < USHRT_MAX;
 	D = Dist->mat;
-	chunk = 131072;
 	size = ((DB->size - 1) == DB->mask) ? DB->size : DB->n;
+	blocks = thread_num * DISTBLOCKS;
+	lo = first;
+	area = (double)(DB->DB_size - 1) * (DB->DB_size - 1) - lo * lo;
 	
 	/* static init */
 	lockTime(lock, 10);
 	if(!thread_wait) {
 		thread_wait = thread_num;
 		next = 0;
-		n = DB->n;
 		Dist->n = DB->DB_size - 1;
 	}
 	unlock(lock);
 	
-	/* get values */
-	while(n && chunk) {
-		/* get next chunk */
-		lockTime(lock, 10);
-		pos = next;
-		if(size < (next += chunk)) {
-			next = size;
-		}
-		unlock(lock);
-		
-		/* update chunk */
-		exist = DB->exist + pos - 1;
-		exist_l = DB->exist_l + pos - 1;
-		if(size < pos + chunk) {
-			chunkster = size - pos + 1;
-			chunk = 0;
-		} else {
-			chunkster = (chunk + 1);
-		}
-		while(n && --chunkster) {
-			pos = el ? *++exist : *++exist_l;
-			if(pos != 1) {
-				if(vs) {
-					values_si = DB->values_s + pos;
-					i = *values_si + 1;
-					values_si += i;
-					while(--i) {
-						j = i;
-						values_sj = --values_si;
-						v_i = *values_si - 1;
-						Di = D[v_i];
-						while(--j) {
-							Dptr = Di + (*--values_sj - 1);
-							__sync_add_and_fetch(Dptr, 1);
-						}
-						Dptr = N + v_i;
-						__sync_add_and_fetch(Dptr, 1);
+	/*
+	The rows of the lower triangle from first on are split in blocks of 
+	equal area. A block scans all k-mers but only counts pairs on its own 
+	rows, so the counts need no atomics and stay within the rows of the 
+	block.
+	*/
+	while((block = __sync_fetch_and_add(&next, 1)) < blocks) {
+		start = 1 + sqrt(lo * lo + area * block / blocks);
+		end = block + 1 == blocks ? DB->DB_size : 1 + sqrt(lo * lo + area * (block + 1) / blocks);
+		for(k = 0; start < end && k < size; ++k) {
+			pos = el ? DB->exist[k] : DB->exist_l[k];
+			if(pos == 1) {
+				continue;
+			} else if(vs) {
+				values_si = DB->values_s + pos;
+				m = *values_si++;
+				i = lowerBound_s(values_si, m, start);
+				for(; i < m && values_si[i] < end; ++i) {
+					v_i = values_si[i] - 1;
+					Di = D[v_i];
+					for(j = 0; j < i; ++j) {
+						++Di[values_si[j] - 1];
 					}
-				} else {
-					values_i = DB->values + pos;
-					i = *values_i + 1;
-					values_i += i;
-					while(--i) {
-						j = i;
-						values_j = --values_i;
-						v_i = *values_i - 1;
-						Di = D[v_i];
-						while(--j) {
-							Dptr = Di + (*--values_j - 1);
-							__sync_add_and_fetch(Dptr, 1);
-						}
-						Dptr = N + v_i;
-						__sync_add_and_fetch(Dptr, 1);
+					++N[v_i];
+				}
+			} else {
+				values_i = DB->values + pos;
+				m = *values_i++;
+				i = lowerBound(values_i, m, start);
+				for(; i < m && values_i[i] < end; ++i) {
+					v_i = values_i[i] - 1;
+					Di = D[v_i];
+					for(j = 0; j < i; ++j) {
+						++Di[values_i[j] - 1];
 					}
+					++N[v_i];
 				}
-				__sync_sub_and_fetch(&n, 1);
 			}
 		}
 	}
@@ -661,7 +684,7 @@ void * threadDist(void *arg) {
 	static volatile int Lock = 0;
 	volatile int *lock = &Lock;
 	DistThread *thread = arg;
-	int flag, format, thread_num, *N;
+	int flag, format, first, thread_num, *N;
 	long unsigned ltdMat, covMat;
 	char *outfileM;
 	FILE *name_file;
@@ -672,6 +695,7 @@ void * threadDist(void *arg) {
 	/* init */
 	flag = thread->flag;
 	format = thread->format;
+	first = thread->first;
 	thread_num = thread->thread_num;
 	N = thread->N;
 	ltdMat = thread->ltdMat;
@@ -683,10 +707,12 @@ void * threadDist(void *arg) {
 	template_name = thread->template_name;
 	
 	/* get kmer similarities and lengths */
-	if(thread_num != 1) {
-		kmerSimilarity_thread(DB, Dist, N, thread_num, lock);
+	if(!DB) {
+		/* loaded from *.ltd.b */
+	} else if(thread_num != 1) {
+		kmerSimilarity_thread(DB, Dist, N, first, thread_num, lock);
 	} else {
-		kmerSimilarity(DB, Dist, N);
+		kmerSimilarity(DB, Dist, N, first);
 	}
 	
 	/* k-mer dist, lt */
@@ -770,29 +796,101 @@ void * threadDist(void *arg) {
 	return NULL;
 }
 
-void runDist(char *templatefilename, char *outputfilename, int flag, int format, int disk, int thread_num) {
+char * distBin(FILE *file, long unsigned *DB_size, long unsigned *first, long unsigned *size) {
+	
+	int *N;
+	char *base;
+	long unsigned old, ltd, oldLtd;
+	
+	/*
+	map *.ltd.b, an existing one when DB_size is zero, and otherwise a new 
+	one of DB_size templates, keeping the first rows if it already holds 
+	counts of a smaller DB.
+	*/
+	old = 0;
+	N = 0;
+	sfseek(file, 0, SEEK_END);
+	*size = ftell(file);
+	rewind(file);
+	if(*size) {
+		base = mmap(0, *size, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(file), 0);
+		if(base == MAP_FAILED) {
+			ERROR();
+		} else if(*size < DISTHEAD || memcmp(base, DIST_MAGIC, 8)) {
+			fprintf(stderr, "Not a binary kma dist matrix.\n");
+			exit(1);
+		}
+		memcpy(&old, base + 8, sizeof(long unsigned));
+		if(*size != DISTHEAD + (old + ((old * (old - 1)) >> 1)) * sizeof(int)) {
+			fprintf(stderr, "Truncated binary kma dist matrix.\n");
+			exit(1);
+		} else if(!*DB_size) {
+			*DB_size = old;
+			*first = old;
+			return base;
+		} else if(*DB_size < old) {
+			fprintf(stderr, "DB holds fewer templates than the binary kma dist matrix.\n");
+			exit(1);
+		}
+		
+		/* save lengths, as they move to the new end */
+		oldLtd = (old * (old - 1)) >> 1;
+		N = smalloc(old * sizeof(int));
+		memcpy(N, base + DISTHEAD + oldLtd * sizeof(int), old * sizeof(int));
+		memset(base + DISTHEAD + oldLtd * sizeof(int), 0, old * sizeof(int));
+		munmap(base, *size);
+	} else if(!*DB_size) {
+		fprintf(stderr, "Not a binary kma dist matrix.\n");
+		exit(1);
+	}
+	
+	/* extend */
+	ltd = (*DB_size * (*DB_size - 1)) >> 1;
+	*size = DISTHEAD + (ltd + *DB_size) * sizeof(int);
+	if(fseek(file, *size - 1, SEEK_SET) || putc(0, file) == EOF) {
+		ERROR();
+	}
+	fflush(file);
+	base = mmap(0, *size, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(file), 0);
+	if(base == MAP_FAILED) {
+		ERROR();
+	}
+	memcpy(base, DIST_MAGIC, 8);
+	memcpy(base + 8, DB_size, sizeof(long unsigned));
+	if(N) {
+		memcpy(base + DISTHEAD + ltd * sizeof(int), N, old * sizeof(int));
+		free(N);
+	}
+	*first = old ? old - 1 : 0;
+	
+	return base;
+}
+
+void runDist(char *templatefilename, char *outputfilename, char *binfilename, int append, int flag, int format, int disk, int thread_num) {
 	
 	int i, file_len, *N;
-	unsigned DB_size;
-	long unsigned out_size, ltdMat, covMat;
-	char *outfileM;
-	FILE *outfile, *name_file;
+	long unsigned DB_size, first, out_size, bin_size, ltdMat, covMat;
+	char *outfileM, *bin;
+	FILE *outfile, *binfile, *name_file;
 	DistThread *thread, *threads;
 	HashMapKMA *DB;
 	Matrix *Dist;
 	Qseqs *template_name;
 	
 	/* init */
-	outfile = sfopen(outputfilename, "wb+");
 	file_len = strlen(templatefilename);
 	
-	/* load k-mer links from KMA DB */
-	strcpy(templatefilename + file_len, ".comp.b");
-	if(!(DB = loadValues(templatefilename))) {
-		fprintf(stderr, "Wrong format of DB.\n");
-		exit(1);
+	/* load k-mer links from KMA DB, unless counted already */
+	if(binfilename && flag) {
+		DB = 0;
+	} else {
+		strcpy(templatefilename + file_len, ".comp.b");
+		if(!(DB = loadValues(templatefilename))) {
+			fprintf(stderr, "Wrong format of DB.\n");
+			exit(1);
+		}
+		templatefilename[file_len] = 0;
 	}
-	templatefilename[file_len] = 0;
 	
 	/* load names */
 	strcpy(templatefilename + file_len, ".name");
@@ -800,19 +898,36 @@ void runDist(char *templatefilename, char *outputfilename, int flag, int format,
 	templatefilename[file_len] = 0;
 	template_name = setQseqs(1024);
 	
-	/* allocate output file */
-	DB_size = DB->DB_size;
-	out_size = getPhySize(flag, format, DB_size, &ltdMat, &covMat, name_file);
-	outfileM = mfile(outfile, out_size);
-	
-	/* allocate matrices */
-	if(!(N = calloc(DB_size, sizeof(int)))) {
-		ERROR();
-	}
-	if(disk) {
-		Dist = ltdMatrix_minit(DB_size);
+	/* allocate matrices, on *.ltd.b when it is given */
+	bin = 0;
+	binfile = 0;
+	first = 0;
+	DB_size = DB ? DB->DB_size : 0;
+	if(binfilename) {
+		binfile = sfopen(binfilename, DB && !append ? "wb+" : "rb+");
+		bin = distBin(binfile, &DB_size, &first, &bin_size);
+		Dist = ltdMatrix_wrap((int *)(bin + DISTHEAD), DB_size);
+		Dist->n = DB_size - 1;
+		N = (int *)(bin + DISTHEAD) + ((DB_size * (DB_size - 1)) >> 1);
 	} else {
-		Dist = ltdMatrix_init(DB_size);
+		if(!(N = calloc(DB_size, sizeof(int)))) {
+			ERROR();
+		}
+		if(disk) {
+			Dist = ltdMatrix_minit(DB_size);
+		} else {
+			Dist = ltdMatrix_init(DB_size);
+		}
+	}
+	
+	/* allocate output file */
+	outfile = 0;
+	outfileM = 0;
+	out_size = 0;
+	if(flag) {
+		outfile = sfopen(outputfilename, "wb+");
+		out_size = getPhySize(flag, format, DB_size, &ltdMat, &covMat, name_file);
+		outfileM = mfile(outfile, out_size);
 	}
 	
 	/* thread out */
@@ -824,6 +939,7 @@ void runDist(char *templatefilename, char *outputfilename, int flag, int format,
 		thread = smalloc(sizeof(DistThread));
 		thread->flag = flag;
 		thread->format = format;
+		thread->first = first;
 		thread->thread_num = thread_num;
 		thread->N = N;
 		thread->ltdMat = ltdMat;
@@ -860,16 +976,26 @@ void runDist(char *templatefilename, char *outputfilename, int flag, int format,
 		free(threads);
 		threads = thread;
 	}
-	outfileM -= out_size;
-	msync(outfileM, out_size, MS_SYNC);
-	munmap(outfileM, out_size);
-	fclose(outfile);
+	if(outfile) {
+		outfileM -= out_size;
+		msync(outfileM, out_size, MS_SYNC);
+		munmap(outfileM, out_size);
+		fclose(outfile);
+	}
 	fclose(name_file);
-	free(N);
-	if(disk) {
-		Matrix_mdestroy(Dist);
+	if(bin) {
+		msync(bin, bin_size, MS_SYNC);
+		munmap(bin, bin_size);
+		fclose(binfile);
+		free(Dist->mat);
+		free(Dist);
 	} else {
-		Matrix_destroy(Dist);
+		free(N);
+		if(disk) {
+			Matrix_mdestroy(Dist);
+		} else {
+			Matrix_destroy(Dist);
+		}
 	}
 	destroyQseqs(template_name);
 }
@@ -885,6 +1011,9 @@ static int helpMessage(FILE *out) {
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-d", "Distance method", "1");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-dh", "Help on option \"-d\"", "");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-m", "Allocate matrix on the disk", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-b", "Write k-mer counts to *.ltd.b", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-i", "Output -d from *.ltd.b", "");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-a", "Add new templates to *.ltd.b", "");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-tmp", "Set directory for temporary files", "");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-t", "Number of threads", "1");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-h", "Shows this helpmessage", "");
@@ -894,13 +1023,16 @@ static int helpMessage(FILE *out) {
 /* main */
 int dist_main(int argc, char *argv[]) {
 	
-	int args, flag, format, mmap, thread_num, file_len;
-	char *arg, *errorMsg, *templatefilename, *outputfilename;
+	int args, flag, format, mmap, bin, append, thread_num, file_len;
+	char *arg, *errorMsg, *templatefilename, *outputfilename, *binfilename;
 	
 	/* init */
 	flag = 1;
 	format = 1;
 	mmap = 0;
+	bin = 0;
+	append = 0;
+	binfilename = 0;
 	thread_num = 1;
 	file_len = 0;
 	templatefilename = 0;
@@ -969,6 +1101,21 @@ int dist_main(int argc, char *argv[]) {
 				return 0;
 			} else if(strcmp(arg, "m") == 0) {
 				mmap = 1;
+			} else if(strcmp(arg, "b") == 0) {
+				bin = 1;
+			} else if(strcmp(arg, "i") == 0) {
+				if(++args < argc) {
+					binfilename = argv[args];
+				} else {
+					missArg("\"-i\"");
+				}
+			} else if(strcmp(arg, "a") == 0) {
+				if(++args < argc) {
+					binfilename = argv[args];
+					append = 1;
+				} else {
+					missArg("\"-a\"");
+				}
 			} else if(strcmp(argv[args], "-tmp") == 0) {
 				if(++args < argc) {
 					if(argv[args][0] != '-') {
@@ -1003,12 +1150,23 @@ int dist_main(int argc, char *argv[]) {
 		fprintf(stderr, "Too few arguments handed.\n");
 		exit(1);
 	}
-	if(!outputfilename) {
+	if(append) {
+		/* counts of new templates only */
+		flag = 0;
+	} else if(bin) {
+		/* counts only */
+		if(!outputfilename) {
+			outputfilename = smalloc(file_len + 64);
+			sprintf(outputfilename, "%s.ltd.b", templatefilename);
+		}
+		binfilename = outputfilename;
+		flag = 0;
+	} else if(!outputfilename) {
 		outputfilename = smalloc(file_len + 64);
 		file_len = sprintf(outputfilename, "%s.phy", templatefilename);
 	}
 	
-	runDist(templatefilename, outputfilename, flag, format, mmap, thread_num);
+	runDist(templatefilename, outputfilename, binfilename, append, flag, format, mmap, thread_num);
 	
 	return 0;
 }
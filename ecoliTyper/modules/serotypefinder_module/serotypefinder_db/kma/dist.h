@@ -34,6 +34,7 @@ struct distThread {
 	pthread_t id;
 	int flag;
 	int format;
+	int first;
 	int thread_num;
 	int *N;
 	long unsigned ltdMat;
@@ -45,13 +46,22 @@ struct distThread {
 	Qseqs *template_name;
 	struct distThread *next;
 };
+#define DISTBLOCKS 4 /* row blocks per thread */
+/*
+ * Binary k-mer counts, *.ltd.b: magic, long unsigned DB_size, the 
+ * lower triangle of shared k-mers as int rows 0 to DB_size - 1, row i 
+ * holding i cells, and int N[DB_size] k-mers per template. New 
+ * templates append rows, only moving N.
+ */
+#define DIST_MAGIC "KMAltd\1"
+#define DISTHEAD 16
 #define DIST 1
 #endif
 
 HashMapKMA * loadValues(const char *filename);
 void destroyValues(HashMapKMA *src);
-void kmerSimilarity(HashMapKMA *DB, Matrix *Dist, int *N);
-void kmerSimilarity_thread(HashMapKMA *DB, Matrix *Dist, int *N, int thread_num, volatile int *lock);
+void kmerSimilarity(HashMapKMA *DB, Matrix *Dist, int *N, int first);
+void kmerSimilarity_thread(HashMapKMA *DB, Matrix *Dist, int *N, int first, int thread_num, volatile int *lock);
 int kmerDist(int Ni, int Nj, int D);
 int kmerShared(int Ni, int Nj, int D);
 int chi2dist(int Ni, int Nj, int D);
@@ -70,5 +80,6 @@ void printDoublePhy(char *outfile, Matrix *Dist, int *N, FILE *name_file, Qseqs
 long unsigned getPhySize(int flag, int format, long unsigned n, long unsigned *ltdMat, long unsigned *covMat, FILE *name_file);
 char * mfile(FILE *outfile, long unsigned size);
 void * threadDist(void *arg);
-void runDist(char *templatefilename, char *outputfilename, int flag, int format, int disk, int thread_num);
+char * distBin(FILE *file, long unsigned *DB_size, long unsigned *first, long unsigned *size);
+void runDist(char *templatefilename, char *outputfilename, char *binfilename, int append, int flag, int format, int disk, int thread_num);
 int dist_main(int argc, char *argv[]);
@@ -16,15 +16,30 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
 */
-
+#define _XOPEN_SOURCE 600
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <zlib.h>
+#include "aout.h"
+#include "aread.h"
 #include "filebuff.h"
+#include "kmatrace.h"
 #include "pherror.h"
 #include "qseqs.h"
+#include "threader.h"
+#ifdef _WIN32
+#define mmap(addr, len, prot, flags, fd, offset) (MAP_FAILED)
+#define munmap(addr, len) (-1)
+#define posix_madvise(addr, len, advice) (0)
+#define MAP_FAILED ((void *) -1)
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
-int (*buffFileBuff)(FileBuff *) = &BuffgzFileBuff;
+__thread int (*buffFileBuff)(FileBuff *) = &BuffgzFileBuff;
 
 int BuffgzFileBuff(FileBuff *dest) {
 	
@@ -113,6 +128,358 @@ void init_gzFile(FileBuff *inputfile) {
 	inputfile->bytes = BuffgzFileBuff(inputfile);
 }
 
+int FileBuffThreads(int thread_num) {
+	
+	static int threads = 1;
+	
+	if(0 < thread_num) {
+		threads = thread_num;
+	}
+	
+	return threads;
+}
+
+static int bgzfBsize(const unsigned char *extra, int xlen) {
+	
+	int slen;
+	const unsigned char *end;
+	
+	/* find the BC subfield, holding the total block size - 1 */
+	end = extra + xlen;
+	while(extra + 4 <= end) {
+		slen = extra[2] | (extra[3] << 8);
+		if(extra[0] == 66 && extra[1] == 67 && slen == 2 && extra + 6 <= end) {
+			return (extra[4] | (extra[5] << 8)) + 1;
+		}
+		extra += 4 + slen;
+	}
+	
+	return 0;
+}
+
+int isBGZF(const unsigned char *buff, int len) {
+	
+	int xlen;
+	
+	/* gzip magic, deflate and FEXTRA */
+	if(len < 18 || buff[0] != 31 || buff[1] != 139 || buff[2] != 8 || !(buff[3] & 4)) {
+		return 0;
+	}
+	xlen = buff[10] | (buff[11] << 8);
+	if(len < 12 + xlen) {
+		return 0;
+	}
+	
+	return bgzfBsize(buff + 12, xlen) != 0;
+}
+
+static int gzPool_read(GzPool *pool, unsigned char *dest, int len) {
+	
+	int n;
+	
+	/* drain what was read when determining the format */
+	n = 0;
+	if(pool->avail) {
+		n = len < pool->avail ? len : pool->avail;
+		memcpy(dest, pool->next, n);
+		pool->next += n;
+		pool->avail -= n;
+	}
+	if(n < len) {
+		n += fread(dest + n, 1, len - n, pool->src->file);
+	}
+	
+	return n;
+}
+
+void * gzPool_thread(void *arg) {
+	
+	int len;
+	GzPool *pool = arg;
+	GzSlot *slot;
+	FileBuff *src;
+	
+	/* inflate stream ahead of the parser */
+	src = pool->src;
+	do {
+		slot = pool->slots + (pool->filled % pool->size);
+		wait_atomic(slot->status && !pool->stop);
+		if(pool->stop) {
+			break;
+		}
+		slot->status = 1;
+		++pool->filled;
+		
+		src->buffer = slot->out;
+		len = BuffgzFileBuff(src);
+		slot->len = len;
+		if((slot->eof = (len == 0))) {
+			pool->z_err = src->z_err;
+			pool->err = errno;
+		}
+		__sync_synchronize();
+		slot->status = 2;
+	} while(len);
+	
+	return NULL;
+}
+
+void * bgzfPool_thread(void *arg) {
+	
+	int bsize, xlen, isize, size, len, status;
+	unsigned char *blk, *end;
+	GzPool *pool = arg;
+	GzSlot *slot;
+	volatile int *excludeIn = &pool->excludeIn;
+	z_stream strm;
+	
+	strm.zalloc = Z_NULL;
+	strm.zfree  = Z_NULL;
+	strm.opaque = Z_NULL;
+	strm.next_in = Z_NULL;
+	strm.avail_in = 0;
+	status = inflateInit2(&strm, 15 | GZIP_ENCODING);
+	if(status < 0) {
+		fprintf(stderr, "Gzip error %d\n", status);
+		exit(status);
+	}
+	size = pool->src->buffSize;
+	
+	while(1) {
+		/* load whole blocks, in order */
+		lock(excludeIn);
+		if(pool->eof || pool->stop) {
+			unlock(excludeIn);
+			break;
+		}
+		slot = pool->slots + (pool->filled % pool->size);
+		wait_atomic(slot->status && !pool->stop);
+		if(pool->stop) {
+			unlock(excludeIn);
+			break;
+		}
+		slot->status = 1;
+		++pool->filled;
+		slot->inLen = 0;
+		slot->eof = 0;
+		len = 0;
+		while(len <= size - BGZF_BLOCK && slot->inLen <= slot->inSize - BGZF_BLOCK) {
+			blk = slot->in + slot->inLen;
+			if((xlen = gzPool_read(pool, blk, 12)) != 12) {
+				if(xlen) {
+					fprintf(stderr, "Truncated BGZF block.\n");
+					pool->z_err = Z_DATA_ERROR;
+				} else {
+					pool->z_err = Z_STREAM_END;
+				}
+				pool->eof = 1;
+				slot->eof = 1;
+				break;
+			}
+			xlen = blk[10] | (blk[11] << 8);
+			bsize = 0;
+			if(gzPool_read(pool, blk + 12, xlen) == xlen) {
+				bsize = bgzfBsize(blk + 12, xlen);
+			}
+			if(bsize < 20 + xlen || BGZF_BLOCK < bsize || gzPool_read(pool, blk + 12 + xlen, bsize - 12 - xlen) != bsize - 12 - xlen) {
+				fprintf(stderr, "Malformed BGZF block.\n");
+				pool->z_err = Z_DATA_ERROR;
+				pool->eof = 1;
+				slot->eof = 1;
+				break;
+			}
+			end = blk + bsize;
+			isize = end[-4] | (end[-3] << 8) | (end[-2] << 16) | ((unsigned) end[-1] << 24);
+			if(BGZF_BLOCK < isize) {
+				fprintf(stderr, "Malformed BGZF block.\n");
+				pool->z_err = Z_DATA_ERROR;
+				pool->eof = 1;
+				slot->eof = 1;
+				break;
+			}
+			len += isize;
+			slot->inLen += bsize;
+		}
+		unlock(excludeIn);
+		
+		/* inflate blocks */
+		len = 0;
+		blk = slot->in;
+		end = blk + slot->inLen;
+		while(blk < end) {
+			xlen = blk[10] | (blk[11] << 8);
+			bsize = bgzfBsize(blk + 12, xlen);
+			inflateReset(&strm);
+			strm.next_in = blk;
+			strm.avail_in = bsize;
+			strm.next_out = slot->out + len;
+			strm.avail_out = size - len;
+			if((status = inflate(&strm, Z_FINISH)) != Z_STREAM_END) {
+				/* end the stream here, and stop loading beyond it */
+				fprintf(stderr, "Gzip error %d\n", status);
+				pool->z_err = status;
+				pool->err |= status;
+				slot->eof = 1;
+				pool->eof = 1;
+				pool->stop = 1;
+				break;
+			}
+			len = size - strm.avail_out;
+			blk += bsize;
+		}
+		slot->len = len;
+		__sync_synchronize();
+		slot->status = 2;
+	}
+	inflateEnd(&strm);
+	
+	return NULL;
+}
+
+int BuffgzFileBuff_MT(FileBuff *dest) {
+	
+	unsigned char *tmp;
+	GzPool *pool;
+	GzSlot *slot;
+	
+	/* swap in the next inflated buffer */
+	pool = dest->pool;
+	dest->bytes = 0;
+	while(dest->bytes == 0 && !pool->eof_seen) {
+		slot = pool->slots + (pool->consumed % pool->size);
+		wait_atomic(slot->status != 2);
+		tmp = dest->buffer;
+		dest->buffer = slot->out;
+		slot->out = tmp;
+		dest->bytes = slot->len;
+		pool->eof_seen = slot->eof;
+		++pool->consumed;
+		unlock(&slot->status);
+	}
+	dest->next = dest->buffer;
+	if(pool->eof_seen) {
+		dest->z_err = pool->z_err;
+		errno |= pool->err;
+	}
+	
+	return dest->bytes;
+}
+
+void init_gzFile_MT(FileBuff *inputfile, int thread_num) {
+	
+	int i, status;
+	unsigned char *tmp;
+	z_stream *strm;
+	GzPool *pool;
+	GzSlot *slot;
+	
+	/* set inBuffer, for compressed format */
+	if(inputfile->inBuffer) {
+		tmp = inputfile->buffer;
+		inputfile->buffer = inputfile->inBuffer;
+		inputfile->inBuffer = tmp;
+	} else {
+		inputfile->inBuffer = inputfile->buffer;
+		inputfile->buffer = smalloc(inputfile->buffSize + 1);
+		inputfile->buffer[inputfile->buffSize] = 0;
+	}
+	inputfile->next = inputfile->buffer;
+	
+	/* set the compressed stream */
+	strm = inputfile->strm;
+	if(!strm && !(strm = malloc(sizeof(z_stream)))) {
+		ERROR();
+	}
+	strm->zalloc = Z_NULL;
+	strm->zfree  = Z_NULL;
+	strm->opaque = Z_NULL;
+	status = inflateInit2(strm, 15 | ENABLE_ZLIB_GZIP);
+	if(status < 0) {
+		fprintf(stderr, "Gzip error %d\n", status);
+		exit(status);
+	}
+	strm->next_in = inputfile->inBuffer;
+	strm->avail_in = inputfile->bytes;
+	strm->avail_out = 0;
+	inputfile->strm = strm;
+	inputfile->z_err = Z_OK;
+	
+	/* set up pool, only BGZF can be split between threads */
+	pool = smalloc(sizeof(GzPool));
+	pool->bgzf = isBGZF(inputfile->inBuffer, inputfile->bytes);
+	pool->thread_num = pool->bgzf ? thread_num : 1;
+	pool->size = pool->thread_num << 1;
+	pool->avail = inputfile->bytes;
+	pool->next = inputfile->inBuffer;
+	pool->z_err = Z_OK;
+	pool->err = 0;
+	pool->eof = 0;
+	pool->eof_seen = 0;
+	pool->stop = 0;
+	pool->excludeIn = 0;
+	pool->filled = 0;
+	pool->consumed = 0;
+	pool->src = smalloc(sizeof(FileBuff));
+	*(pool->src) = *inputfile;
+	pool->src->pool = 0;
+	pool->slots = smalloc(pool->size * sizeof(GzSlot));
+	for(i = 0, slot = pool->slots; i < pool->size; ++i, ++slot) {
+		slot->status = 0;
+		slot->len = 0;
+		slot->eof = 0;
+		slot->inLen = 0;
+		slot->out = smalloc(inputfile->buffSize + 1);
+		slot->out[inputfile->buffSize] = 0;
+		if(pool->bgzf) {
+			slot->inSize = inputfile->buffSize;
+			slot->in = smalloc(slot->inSize);
+		} else {
+			slot->inSize = 0;
+			slot->in = 0;
+		}
+	}
+	pool->ids = smalloc(pool->thread_num * sizeof(pthread_t));
+	inputfile->pool = pool;
+	for(i = 0; i < pool->thread_num; ++i) {
+		if((errno = pthread_create(pool->ids + i, NULL, pool->bgzf ? &bgzfPool_thread : &gzPool_thread, pool))) {
+			ERROR();
+		}
+	}
+	
+	inputfile->bytes = BuffgzFileBuff_MT(inputfile);
+}
+
+void gzPool_destroy(FileBuff *dest) {
+	
+	int i, err;
+	GzPool *pool;
+	GzSlot *slot;
+	
+	/* keep the stream errors passed on by BuffgzFileBuff_MT */
+	pool = dest->pool;
+	pool->stop = 1;
+	err = errno;
+	for(i = 0; i < pool->thread_num; ++i) {
+		if((errno = pthread_join(pool->ids[i], NULL))) {
+			ERROR();
+		}
+	}
+	errno = err;
+	if(!pool->eof_seen) {
+		/* closed before end of stream */
+		dest->z_err = Z_OK;
+	}
+	for(i = 0, slot = pool->slots; i < pool->size; ++i, ++slot) {
+		free(slot->out);
+		free(slot->in);
+	}
+	free(pool->slots);
+	free(pool->ids);
+	free(pool->src);
+	free(pool);
+	dest->pool = 0;
+}
+
 FileBuff * setFileBuff(int buffSize) {
 	
 	FileBuff *dest;
@@ -121,6 +488,12 @@ FileBuff * setFileBuff(int buffSize) {
 	dest->file = 0;
 	dest->inBuffer = 0;
 	dest->strm = 0;
+	dest->pool = 0;
+	dest->bgzf = 0;
+	dest->map = 0;
+	dest->heap = 0;
+	dest->mapSize = 0;
+	dest->mapPos = 0;
 	dest->buffSize = buffSize;
 	dest->buffer = smalloc(buffSize);
 	dest->next = dest->buffer;
@@ -129,10 +502,16 @@ FileBuff * setFileBuff(int buffSize) {
 }
 
 void openFileBuff(FileBuff *dest, char *filename, char *mode) {
-	dest->file = sfopen(filename, mode);
+	dest->file = *mode == 'w' ? outFopenPtr(filename, mode) : inFopenPtr(filename, mode);
 }
 
 void closeFileBuff(FileBuff *dest) {
+	if(dest->map) {
+		munmap(dest->map, dest->mapSize);
+		dest->buffer = dest->heap;
+		dest->map = 0;
+		dest->heap = 0;
+	}
 	fclose(dest->file);
 	dest->file = 0;
 }
@@ -141,6 +520,9 @@ void closeFileBuff(FileBuff *dest) {
 void gzcloseFileBuff(FileBuff *dest) {
 	
 	int status;
+	if(dest->pool) {
+		gzPool_destroy(dest);
+	}
 	if((status = inflateEnd(dest->strm)) != Z_OK) {
 		fprintf(stderr, "Gzip error %d\n", status);
 		errno |= status;
@@ -167,6 +549,51 @@ int buff_FileBuff(FileBuff *dest) {
 	return dest->bytes;
 }
 
+int mmapFileBuff(FileBuff *dest) {
+	
+	#ifndef _WIN32
+	struct stat st;
+	unsigned char *map;
+	
+	/* only regular files can be mapped */
+	if(fstat(fileno(dest->file), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= dest->bytes) {
+		return 0;
+	}
+	map = mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(dest->file), 0);
+	if(map == MAP_FAILED) {
+		return 0;
+	}
+	posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+	
+	/* point the buffer into the map */
+	dest->map = map;
+	dest->heap = dest->buffer;
+	dest->mapSize = st.st_size;
+	dest->mapPos = 0;
+	
+	return buff_FileBuffMmap(dest);
+	#else
+	return 0;
+	#endif
+}
+
+int buff_FileBuffMmap(FileBuff *dest) {
+	
+	long unsigned len;
+	
+	/* next window of the map */
+	len = dest->mapSize - dest->mapPos;
+	if(MMAPWINDOW < len) {
+		len = MMAPWINDOW;
+	}
+	dest->buffer = dest->map + dest->mapPos;
+	dest->next = dest->buffer;
+	dest->bytes = len;
+	dest->mapPos += len;
+	
+	return dest->bytes;
+}
+
 z_stream * strm_init() {
 	
 	z_stream *strm;
@@ -194,7 +621,11 @@ FileBuff * gzInitFileBuff(int size) {
 	dest->file = 0;
 	dest->bytes = size;
 	dest->buffSize = size;
+	dest->pool = 0;
+	dest->map = 0;
+	dest->heap = 0;
 	dest->strm = strm_init();
+	dest->bgzf = 0;
 	dest->buffer = smalloc(size);
 	dest->inBuffer = smalloc(size);
 	dest->next = dest->buffer;
@@ -213,10 +644,38 @@ void resetGzFileBuff(FileBuff *dest, int size) {
 	dest->next = dest->buffer;
 }
 
+static BgzfFile * gzFileBuffBgzf(FileBuff *dest) {
+	
+	/* with threads, write BGZF members deflated in parallel */
+	if(!dest->bgzf && 1 < FileBuffThreads(0)) {
+		dest->bgzf = bgzfOpen(dest->file, FileBuffThreads(0), 1, 0);
+	}
+	
+	return dest->bgzf;
+}
+
+void bgzfFileBuff(FileBuff *dest) {
+	
+	/* write BGZF members, deflated inline without threads */
+	if(!dest->bgzf) {
+		dest->bgzf = bgzfOpen(dest->file, FileBuffThreads(0), 1, 0);
+	}
+}
+
 void writeGzFileBuff(FileBuff *dest) {
 	
 	int check = Z_OK;
+	long unsigned t;
 	z_stream *strm = dest->strm;
+	
+	t = kmaTrace_begin();
+	if(gzFileBuffBgzf(dest)) {
+		bgzfWrite(dest->bgzf, dest->buffer, dest->buffSize - dest->bytes);
+		kmaTrace_end("gz write", "io", t, dest->buffSize - dest->bytes);
+		dest->bytes = dest->buffSize;
+		dest->next = dest->buffer;
+		return;
+	}
 	strm->avail_in = dest->buffSize - dest->bytes;
 	strm->next_in = dest->buffer;
 	strm->avail_out = 0;
@@ -227,6 +686,7 @@ void writeGzFileBuff(FileBuff *dest) {
 		check = deflate(strm, Z_NO_FLUSH);
 		sfwrite(dest->inBuffer, 1, dest->buffSize - strm->avail_out, dest->file);
 	}
+	kmaTrace_end("gz write", "io", t, dest->buffSize - dest->bytes);
 	dest->bytes = dest->buffSize;
 	dest->next = dest->buffer;
 }
@@ -235,6 +695,18 @@ void closeGzFileBuff(FileBuff *dest) {
 	
 	int check = Z_OK;
 	z_stream *strm = dest->strm;
+	
+	if(gzFileBuffBgzf(dest)) {
+		bgzfWrite(dest->bgzf, dest->buffer, dest->buffSize - dest->bytes);
+		if((check = bgzfClose(dest->bgzf)) != Z_OK) {
+			fprintf(stderr, "Gzip error %d\n", check);
+			exit(1);
+		}
+		dest->bgzf = 0;
+		deflateEnd(strm);
+		fclose(dest->file);
+		return;
+	}
 	strm->avail_in = dest->buffSize - dest->bytes;
 	strm->next_in = dest->buffer;
 	strm->avail_out = 0;
@@ -17,11 +17,15 @@
  * limitations under the License.
 */
 
+#include <pthread.h>
 #include <stdio.h>
 #include <zlib.h>
+#include "bgzf.h"
 
 #ifndef FILEBUFF
 typedef struct fileBuff FileBuff;
+typedef struct gzSlot GzSlot;
+typedef struct gzPool GzPool;
 struct fileBuff {
 	int bytes;
 	int buffSize;
@@ -31,26 +35,75 @@ struct fileBuff {
 	FILE *file;
 	z_stream *strm;
 	int z_err;
+	GzPool *pool;
+	BgzfFile *bgzf;
+	unsigned char *map;
+	unsigned char *heap;
+	long unsigned mapSize;
+	long unsigned mapPos;
+};
+
+struct gzSlot {
+	volatile int status; /* 0 free, 1 filling, 2 ready */
+	int len;
+	int inLen;
+	int inSize;
+	int eof;
+	unsigned char *in;
+	unsigned char *out;
+};
+
+struct gzPool {
+	int thread_num;
+	int size;
+	int bgzf;
+	int avail;
+	int z_err;
+	int err;
+	volatile int eof;
+	int eof_seen;
+	volatile int stop;
+	volatile int excludeIn;
+	long unsigned filled;
+	long unsigned consumed;
+	unsigned char *next;
+	FileBuff *src;
+	GzSlot *slots;
+	pthread_t *ids;
 };
 #define FILEBUFF 1
 #define CHUNK 1048576
 #define GZIP_ENCODING 16
 #define ENABLE_ZLIB_GZIP 32
+#define BGZF_BLOCK 65536
+#define MMAPWINDOW 1073741824
 #endif
 
-/* pointer to load buffer from a regular or gz file stream */
-extern int (*buffFileBuff)(FileBuff *);
+/* pointer to load buffer from a regular or gz file stream, per reader thread */
+extern __thread int (*buffFileBuff)(FileBuff *);
 int BuffgzFileBuff(FileBuff *dest);
 void init_gzFile(FileBuff *inputfile);
+/* threaded inflate, BGZF blocks are inflated in parallel */
+int FileBuffThreads(int thread_num);
+int isBGZF(const unsigned char *buff, int len);
+void * gzPool_thread(void *arg);
+void * bgzfPool_thread(void *arg);
+int BuffgzFileBuff_MT(FileBuff *dest);
+void init_gzFile_MT(FileBuff *inputfile, int thread_num);
+void gzPool_destroy(FileBuff *dest);
 FileBuff * setFileBuff(int buffSize);
 void openFileBuff(FileBuff *dest, char *filename, char *mode);
 void closeFileBuff(FileBuff *dest);
 void gzcloseFileBuff(FileBuff *dest);
 void destroyFileBuff(FileBuff *dest);
 int buff_FileBuff(FileBuff *dest);
+/* map uncompressed regular files, and step through them in windows */
+int mmapFileBuff(FileBuff *dest);
+int buff_FileBuffMmap(FileBuff *dest);
 z_stream * strm_init();
 FileBuff * gzInitFileBuff(int size);
 void resetGzFileBuff(FileBuff *dest, int size);
+void bgzfFileBuff(FileBuff *dest);
 void writeGzFileBuff(FileBuff *dest);
 void closeGzFileBuff(FileBuff *dest);
 void destroyGzFileBuff(FileBuff *dest);
@@ -17,9 +17,11 @@
  * limitations under the License.
 */
 #define _XOPEN_SOURCE 600
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "bins.h"
 #include "filebuff.h"
 #include "frags.h"
 #include "pherror.h"
@@ -27,29 +29,93 @@
 #include "threader.h"
 #include "tmp.h"
 
-FILE * printFrags(Frag **alignFrags, int DB_size) {
+static FragArena fragArena = {0, 0, 0};
+
+void * fragArena_alloc(FragArena *src, long unsigned size) {
 	
-	int i;
-	FILE *OUT;
-	Frag *alignFrag, *next;
+	long unsigned n;
+	unsigned char *dest;
+	FragChunk *chunk;
 	
-	if(!(OUT = tmpF(0))) {
-		fprintf(stderr, "Could not create tmp files.\n");
-		ERROR();
+	/* bump allocate, and move on to the next chunk when full */
+	size = (size + 7) & ~7UL;
+	if(!src->cur || src->cur->size < src->pos + size) {
+		n = sizeof(FragChunk) + size;
+		if(src->cur && src->cur->next && n <= src->cur->next->size) {
+			chunk = src->cur->next;
+		} else if(!src->cur && src->first && n <= src->first->size) {
+			chunk = src->first;
+		} else {
+			n = n < FRAGCHUNK ? FRAGCHUNK : n;
+			chunk = smalloc_tag(MEM_FRAGS, n);
+			chunk->size = n;
+			if(src->cur) {
+				chunk->next = src->cur->next;
+				src->cur->next = chunk;
+			} else {
+				chunk->next = src->first;
+				src->first = chunk;
+			}
+		}
+		src->cur = chunk;
+		src->pos = sizeof(FragChunk);
+	}
+	dest = (unsigned char *)(src->cur) + src->pos;
+	src->pos += size;
+	
+	return dest;
+}
+
+void fragArena_reset(FragArena *src) {
+	
+	/* keep the chunks for the next run of frags */
+	src->cur = 0;
+	src->pos = 0;
+}
+
+void fragArena_free(FragArena *src) {
+	
+	FragChunk *chunk, *next;
+	
+	for(chunk = src->first; chunk; chunk = next) {
+		next = chunk->next;
+		memAcc_sub(MEM_FRAGS, chunk->size);
+		free(chunk);
 	}
+	src->first = 0;
+	src->cur = 0;
+	src->pos = 0;
+}
+
+Frag * frag_init(const Qseqs *qseq, const Qseqs *header) {
+	
+	Frag *dest;
+	
+	/* frags are released in bulk, when dumped */
+	dest = fragArena_alloc(&fragArena, sizeof(Frag) + qseq->len + header->len);
+	dest->qseq = (unsigned char *)(dest + 1);
+	dest->header = dest->qseq + qseq->len;
+	memcpy(dest->qseq, qseq->seq, qseq->len);
+	memcpy(dest->header, header->seq, header->len);
+	
+	return dest;
+}
+
+void dumpFrags(Frag **alignFrags, int DB_size, FILE *OUT) {
+	
+	int i;
+	Frag *alignFrag;
+	
 	for(i = 0; i < DB_size; ++i) {
 		if(alignFrags[i]) {
-			for(alignFrag = alignFrags[i]; alignFrag != 0; alignFrag = next) {
-				next = alignFrag->next;
-				
+			for(alignFrag = alignFrags[i]; alignFrag != 0; alignFrag = alignFrag->next) {
 				sfwrite(&i, sizeof(int), 1, OUT);
 				sfwrite(alignFrag->buffer, sizeof(int), 7, OUT);
 				sfwrite(alignFrag->qseq, 1, alignFrag->buffer[0], OUT);
 				sfwrite(alignFrag->header, 1, alignFrag->buffer[5], OUT);
-				
-				free(alignFrag->qseq);
-				free(alignFrag->header);
-				free(alignFrag);
+				if(fragBins) {
+					bins_add(fragBins, i, alignFrag->qseq, alignFrag->buffer[0], alignFrag->header, alignFrag->buffer[5]);
+				}
 			}
 			alignFrags[i] = 0;
 		}
@@ -57,6 +123,78 @@ FILE * printFrags(Frag **alignFrags, int DB_size) {
 	sfwrite(&(int){-1}, sizeof(int), 1, OUT);
 	fflush(OUT);
 	rewind(OUT);
+}
+
+FILE * printFrags(Frag **alignFrags, int DB_size) {
+	
+	FILE *OUT;
+	
+	if(!(OUT = tmpM(0))) {
+		fprintf(stderr, "Could not create tmp files.\n");
+		ERROR();
+	}
+	dumpFrags(alignFrags, DB_size, OUT);
+	fragArena_free(&fragArena);
+	
+	return OUT;
+}
+
+void * dumpFrags_thread(void *arg) {
+	
+	FragDump *dump = arg;
+	
+	dumpFrags(dump->alignFrags, dump->DB_size, dump->OUT);
+	fragArena_reset(&dump->arena);
+	
+	return NULL;
+}
+
+FILE * printFragsAsync(Frag **alignFrags, int DB_size) {
+	
+	static int pending = 0;
+	static FragDump dump;
+	FragArena arena;
+	FILE *OUT;
+	
+	/* wait for previous dump */
+	if(pending) {
+		if((errno = pthread_join(dump.id, NULL))) {
+			ERROR();
+		}
+		pending = 0;
+	}
+	if(!alignFrags) {
+		free(dump.alignFrags);
+		dump.alignFrags = 0;
+		dump.size = 0;
+		fragArena_free(&dump.arena);
+		return 0;
+	}
+	
+	if(!(OUT = tmpM(0))) {
+		fprintf(stderr, "Could not create tmp files.\n");
+		ERROR();
+	}
+	if(dump.size < DB_size) {
+		free(dump.alignFrags);
+		dump.alignFrags = smalloc(DB_size * sizeof(Frag *));
+		dump.size = DB_size;
+	}
+	
+	/* hand the run and its arena to a dump thread, and continue on a clean table */
+	memcpy(dump.alignFrags, alignFrags, DB_size * sizeof(Frag *));
+	memset(alignFrags, 0, DB_size * sizeof(Frag *));
+	arena = dump.arena;
+	dump.arena = fragArena;
+	fragArena = arena;
+	dump.DB_size = DB_size;
+	dump.OUT = OUT;
+	if((errno = pthread_create(&dump.id, NULL, &dumpFrags_thread, &dump))) {
+		errno = 0;
+		dumpFrags_thread(&dump);
+	} else {
+		pending = 1;
+	}
 	
 	return OUT;
 }
@@ -16,6 +16,7 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
 */
+#include <pthread.h>
 #include <stdio.h>
 #include "filebuff.h"
 #include "qseqs.h"
@@ -28,8 +29,39 @@ struct frag {
 	unsigned char *header;
 	struct frag *next;
 };
+
+typedef struct fragChunk FragChunk;
+struct fragChunk {
+	long unsigned size;
+	struct fragChunk *next;
+};
+
+typedef struct fragArena FragArena;
+struct fragArena {
+	FragChunk *first;
+	FragChunk *cur;
+	long unsigned pos;
+};
+
+typedef struct fragDump FragDump;
+struct fragDump {
+	pthread_t id;
+	int DB_size;
+	int size;
+	Frag **alignFrags;
+	FragArena arena;
+	FILE *OUT;
+};
 #define FRAG 1
+#define FRAGCHUNK 1048576
 #endif
 
+void * fragArena_alloc(FragArena *src, long unsigned size);
+void fragArena_reset(FragArena *src);
+void fragArena_free(FragArena *src);
+Frag * frag_init(const Qseqs *qseq, const Qseqs *header);
+void dumpFrags(Frag **alignFrags, int DB_size, FILE *OUT);
 FILE * printFrags(Frag **alignFrags, int DB_size);
+void * dumpFrags_thread(void *arg);
+FILE * printFragsAsync(Frag **alignFrags, int DB_size);
 void updateAllFrag(unsigned char *qseq, int q_len, int bestHits, int best_read_score, int *best_start_pos, int *best_end_pos, int *bestTemplates, Qseqs *header, FileBuff *dest);
@@ -1,3 +1,32 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <stdint.h>
+#include "fuzzymatch.h"
+#include "kmacpu.h"
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define FUZZY_X86 1
+#endif
+
+int (*fuzzyScan)(const long unsigned *, int, long unsigned, int, int *, int) = &fuzzyScan_init;
+
 /* fuzzy k-mer */
 /*
 
@@ -75,7 +104,6 @@ Adaptor trim if insert is less than merged size.
 
 */
 
-#include <stdint.h>
 
 int fuzzykmercmp(uint64_t k1, uint64_t k2) {
 	
@@ -246,3 +274,151 @@ int fuzzierkmercmp(uint64_t k1, uint64_t k2) {
 	/* last two nucleotides */
 	return (((k1 >> 2) == (k2 >> 2)) || ((k1 & 3) == (k2 & 3)) || ((k1 >> 2) == (k2 & 3)) || ((k1 & 3) == (k2 >> 2))) ? 1 : 2;
 }
+
+static inline long unsigned fuzzyFold(long unsigned x) {
+	
+	/* one bit per mismatching base */
+	return (x | (x >> 1)) & 0x5555555555555555;
+}
+
+static inline long unsigned fuzzySmear(long unsigned x) {
+	
+	/* set all bits below the first mismatch */
+	x |= x >> 1;
+	x |= x >> 2;
+	x |= x >> 4;
+	x |= x >> 8;
+	x |= x >> 16;
+	x |= x >> 32;
+	
+	return x;
+}
+
+static inline int fuzzyKind(const long unsigned *words, int n, int t, long unsigned key, int maxMM) {
+	
+	long unsigned f, s;
+	
+	/* mismatches on the diagonal */
+	f = fuzzyFold(key ^ words[t]);
+	if(__builtin_popcountl(f) <= maxMM) {
+		return FUZZY_MM;
+	}
+	
+	/* the head matches words[t] and the tail matches the next or previous 
+	   k-mer, when the mismatches of the tail are all behind those of the head */
+	s = fuzzySmear(f);
+	if(t + 1 < n && !(fuzzyFold(key ^ words[t + 1]) & s)) {
+		return FUZZY_DEL;
+	} else if(t && !(fuzzyFold(key ^ words[t - 1]) & (s >> 2))) {
+		return FUZZY_INS;
+	}
+	
+	return -1;
+}
+
+static int fuzzyScan_range(const long unsigned *words, int n, int t, int end, long unsigned key, int maxMM, int *hits, int hit, int size) {
+	
+	int kind;
+	
+	while(t < end && hit < size) {
+		if(0 <= (kind = fuzzyKind(words, n, t, key, maxMM))) {
+			hits[hit++] = (t << 2) | kind;
+		}
+		++t;
+	}
+	
+	return hit;
+}
+
+int fuzzyScan_scalar(const long unsigned *words, int n, long unsigned key, int maxMM, int *hits, int size) {
+	
+	return fuzzyScan_range(words, n, 0, n, key, maxMM, hits, 0, size);
+}
+
+#ifdef FUZZY_X86
+__attribute__((target("avx2")))
+static inline __m256i fuzzyFold_avx2(__m256i x) {
+	
+	return _mm256_and_si256(_mm256_or_si256(x, _mm256_srli_epi64(x, 1)), _mm256_set1_epi64x(0x5555555555555555));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i fuzzyPopcnt_avx2(__m256i x) {
+	
+	__m256i lut, low;
+	
+	/* nibble popcounts summed per 64-bit lane */
+	lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	low = _mm256_set1_epi8(15);
+	x = _mm256_add_epi8(_mm256_shuffle_epi8(lut, _mm256_and_si256(x, low)), _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), low)));
+	
+	return _mm256_sad_epu8(x, _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2")))
+static int fuzzyScan_avx2(const long unsigned *words, int n, long unsigned key, int maxMM, int *hits, int size) {
+	
+	int t, lane, mask, hit;
+	__m256i k, f, s, zero, limit, cand;
+	
+	/* four template positions at a time, their neighbours loaded shifted */
+	k = _mm256_set1_epi64x(key);
+	zero = _mm256_setzero_si256();
+	limit = _mm256_set1_epi64x(maxMM + 1);
+	hit = fuzzyScan_range(words, n, 0, 1, key, maxMM, hits, 0, size);
+	for(t = 1; t + 5 <= n && hit < size; t += 4) {
+		f = fuzzyFold_avx2(_mm256_xor_si256(k, _mm256_loadu_si256((const __m256i *)(words + t))));
+		cand = _mm256_cmpgt_epi64(limit, fuzzyPopcnt_avx2(f));
+		s = _mm256_or_si256(f, _mm256_srli_epi64(f, 1));
+		s = _mm256_or_si256(s, _mm256_srli_epi64(s, 2));
+		s = _mm256_or_si256(s, _mm256_srli_epi64(s, 4));
+		s = _mm256_or_si256(s, _mm256_srli_epi64(s, 8));
+		s = _mm256_or_si256(s, _mm256_srli_epi64(s, 16));
+		s = _mm256_or_si256(s, _mm256_srli_epi64(s, 32));
+		f = fuzzyFold_avx2(_mm256_xor_si256(k, _mm256_loadu_si256((const __m256i *)(words + t + 1))));
+		cand = _mm256_or_si256(cand, _mm256_cmpeq_epi64(_mm256_and_si256(f, s), zero));
+		f = fuzzyFold_avx2(_mm256_xor_si256(k, _mm256_loadu_si256((const __m256i *)(words + t - 1))));
+		cand = _mm256_or_si256(cand, _mm256_cmpeq_epi64(_mm256_and_si256(f, _mm256_srli_epi64(s, 2)), zero));
+		
+		/* hits are rare, classify them in order */
+		mask = _mm256_movemask_pd(_mm256_castsi256_pd(cand));
+		while(mask) {
+			lane = __builtin_ctz(mask);
+			hit = fuzzyScan_range(words, n, t + lane, t + lane + 1, key, maxMM, hits, hit, size);
+			mask &= mask - 1;
+		}
+	}
+	
+	return fuzzyScan_range(words, n, t, n, key, maxMM, hits, hit, size);
+}
+#endif
+
+void fuzzyInit(void) {
+	
+	static const KmaKernel kernels[] = {
+#ifdef FUZZY_X86
+		{CPU_AVX2, "avx2"},
+#endif
+		{0, "scalar"},
+		{0, 0}
+	};
+	
+	/* pick the widest kernel supported by the running cpu */
+#ifdef FUZZY_X86
+	if(kmaCpu_pick(CPU_FUZZY, kernels) & CPU_AVX2) {
+		fuzzyScan = &fuzzyScan_avx2;
+	} else {
+		fuzzyScan = &fuzzyScan_scalar;
+	}
+#else
+	kmaCpu_pick(CPU_FUZZY, kernels);
+	fuzzyScan = &fuzzyScan_scalar;
+#endif
+}
+
+int fuzzyScan_init(const long unsigned *words, int n, long unsigned key, int maxMM, int *hits, int size) {
+	
+	fuzzyInit();
+	
+	return fuzzyScan(words, n, key, maxMM, hits, size);
+}
@@ -0,0 +1,39 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#include <stdint.h>
+
+/* kinds of fuzzy seed hits */
+#define FUZZY_MM 0
+#define FUZZY_DEL 1
+#define FUZZY_INS 2
+/* templates longer than this are not scanned for fuzzy seeds */
+#define FUZZY_MAXLEN 1048576
+
+/*
+ compare key against the template k-mers words[0 .. n - 1], and list the
+ positions with at most maxMM mismatches or one indel as (t << 2) | kind,
+ returns the number of hits, at most size.
+*/
+extern int (*fuzzyScan)(const long unsigned *, int, long unsigned, int, int *, int);
+int fuzzykmercmp(uint64_t k1, uint64_t k2);
+int fuzzyindelcmp(uint64_t k1, uint64_t k2, uint32_t shift, uint64_t mask);
+int fuzzierkmercmp(uint64_t k1, uint64_t k2);
+int fuzzyScan_scalar(const long unsigned *words, int n, long unsigned key, int maxMM, int *hits, int size);
+int fuzzyScan_init(const long unsigned *words, int n, long unsigned key, int maxMM, int *hits, int size);
+void fuzzyInit(void);
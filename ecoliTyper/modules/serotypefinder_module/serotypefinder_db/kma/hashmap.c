@@ -28,6 +28,59 @@ unsigned * (*hashMapGet)(HashMap *, long unsigned);
 void (*addUniqueValues)(HashMap *, long unsigned, unsigned *);
 unsigned * (*updateValuePtr)(unsigned *, unsigned);
 
+static inline HashTable * hashMap_probe(HashTable *table, long unsigned slots, long unsigned key) {
+	
+	long unsigned index;
+	
+	/* mix all bits, as the slots are probed linearly */
+	index = key ^ (key >> 31);
+	index *= 0x9E3779B97F4A7C15;
+	index ^= index >> 29;
+	index &= slots;
+	while(table[index].value && table[index].key != key) {
+		index = (index + 1) & slots;
+	}
+	
+	return table + index;
+}
+
+static void hashMap_rehash(HashMap *templates, long unsigned slots) {
+	
+	HashTable *table, *node, *end;
+	
+	table = calloc(slots + 1, sizeof(HashTable));
+	if(!table) {
+		ERROR();
+	}
+	if((node = templates->table)) {
+		for(end = node + templates->slots + 1; node != end; ++node) {
+			if(node->value) {
+				*hashMap_probe(table, slots, node->key) = *node;
+			}
+		}
+		free(templates->table);
+	}
+	templates->table = table;
+	templates->slots = slots;
+}
+
+static int hashMap_fit(HashMap *templates, long unsigned n) {
+	
+	long unsigned slots;
+	
+	/* keep the load of the slots under 3/4 */
+	slots = templates->slots + 1;
+	if((n << 2) <= slots * 3) {
+		return 0;
+	}
+	while(slots * 3 < (n << 2)) {
+		slots <<= 1;
+	}
+	hashMap_rehash(templates, slots - 1);
+	
+	return 1;
+}
+
 HashMap * hashMap_initialize(const long unsigned size, const unsigned kmersize, const unsigned mlen, const unsigned flag) {
 	
 	HashMap *src;
@@ -41,6 +94,7 @@ HashMap * hashMap_initialize(const long unsigned size, const unsigned kmersize,
 	src->prefix = 0;
 	src->mlen = mlen;
 	src->flag = flag;
+	src->slots = 0;
 	
 	src->DB_size = 1;
 	
@@ -52,10 +106,8 @@ HashMap * hashMap_initialize(const long unsigned size, const unsigned kmersize,
 		}
 	} else {
 		src->values = 0;
-		src->table = calloc(src->size, sizeof(HashTable *));
-		if(!src->table) {
-			ERROR();
-		}
+		src->table = 0;
+		hashMap_rehash(src, size - 1);
 	}
 	
 	/* masking */
@@ -86,11 +138,10 @@ unsigned * megaMap_getValue(HashMap *templates, long unsigned key) {
 	return templates->values[key & templates->mask];
 }
 
-void hashMap2megaMap(HashMap *templates, HashTable *table) {
+void hashMap2megaMap(HashMap *templates) {
 	
-	HashTable *node, *next;
+	HashTable *node, *end;
 	
-	templates->table = 0;
 	templates->size = templates->mask + 1;
 	templates->values = calloc(templates->size, sizeof(unsigned *));
 	if(!templates->values) {
@@ -98,25 +149,128 @@ void hashMap2megaMap(HashMap *templates, HashTable *table) {
 	}
 	--templates->size;
 	
-	/* convert table */
-	for(node = table; node != 0; node = next) {
-		next = node->next;
-		
-		/* move values */
-		templates->values[node->key & templates->mask] = node->value;
-		
-		/* clean */
-		free(node);
+	/* move values */
+	if((node = templates->table)) {
+		for(end = node + templates->slots + 1; node != end; ++node) {
+			if(node->value) {
+				templates->values[node->key & templates->mask] = node->value;
+			}
+		}
+		free(templates->table);
 	}
-	
-	/* clean */
 	templates->table = 0;
+	templates->slots = 0;
 	
 	/* set pointers */
 	hashMap_add = &megaMap_addKMA;
 	hashMapGet = &megaMap_getValue;
 }
 
+void hashMap_mergeShards(HashMap *templates, HashMap **shards, int shard_num) {
+	
+	int i;
+	long unsigned n, size;
+	HashTable *node, *end;
+	HashMap *shard;
+	
+	/* grow as the serial inserts would have, the key sets are disjoint */
+	n = templates->n;
+	for(i = 0; i < shard_num; ++i) {
+		n += shards[i]->n;
+	}
+	size = templates->size + 1;
+	while(size <= n) {
+		size <<= 1;
+		if((templates->mask + 1) <= (size << 1)) {
+			hashMap2megaMap(templates);
+			break;
+		}
+	}
+	if(templates->table) {
+		templates->size = size - 1;
+		hashMap_fit(templates, n);
+	}
+	
+	/* move the shards */
+	for(i = 0; i < shard_num; ++i) {
+		shard = shards[i];
+		for(node = shard->table, end = node + shard->slots + 1; node != end; ++node) {
+			if(!node->value) {
+				continue;
+			} else if(templates->table) {
+				*hashMap_probe(templates->table, templates->slots, node->key) = *node;
+			} else {
+				templates->values[node->key & templates->mask] = node->value;
+			}
+		}
+		free(shard->table);
+		free(shard);
+	}
+	templates->n = n;
+}
+
+void hashMap_reserve(HashMap *templates, long unsigned n) {
+	
+	long unsigned size;
+	
+	/* grow as hashMap_addKMA would */
+	if(!templates->table || n <= templates->size + 1) {
+		return;
+	}
+	size = templates->size + 1;
+	while(size < n) {
+		size <<= 1;
+	}
+	
+	/* check for megamap */
+	if((templates->mask + 1) <= (size << 1)) {
+		hashMap2megaMap(templates);
+	} else {
+		templates->size = size - 1;
+		hashMap_fit(templates, n);
+	}
+}
+
+HashTable * hashMap_list(HashMap *templates) {
+	
+	long unsigned index, size;
+	HashTable *node, *next, *end, *list, **chains;
+	
+	/*
+	Link the k-mers, grouped on their index in a table of size buckets
+	and in order of it. The k-mers stay in the slots of templates.
+	*/
+	size = templates->size;
+	chains = calloc(size + 1, sizeof(HashTable *));
+	if(!chains) {
+		ERROR();
+	}
+	for(node = templates->table, end = node + templates->slots + 1; node != end; ++node) {
+		if(node->value) {
+			if(templates->flag) {
+				murmur(index, node->key);
+				index &= size;
+			} else {
+				index = node->key & size;
+			}
+			node->next = chains[index];
+			chains[index] = node;
+		}
+	}
+	list = 0;
+	index = size + 1;
+	while(index--) {
+		for(node = chains[index]; node != 0; node = next) {
+			next = node->next;
+			node->next = list;
+			list = node;
+		}
+	}
+	free(chains);
+	
+	return list;
+}
+
 unsigned * updateValue(unsigned *values, unsigned value) {
 	
 	if(!values) {
@@ -163,135 +317,56 @@ unsigned * updateShortValue(unsigned *valuesOrg, unsigned value) {
 
 int hashMap_addKMA(HashMap *templates, long unsigned key, unsigned value) {
 	
-	unsigned *values, flag;
-	long unsigned index, mask;
-	HashTable *node, *next, *table;
-	
-	if(templates->flag) {
-		murmur(index, key);
-		index &= templates->size;
-	} else {
-		index = key & templates->size;
-	}
+	unsigned *values;
+	HashTable *node;
 	
 	/* check if key exists */
-	for(node = templates->table[index]; node != 0; node = node->next) {
-		if(key == node->key) {
-			if((values = updateValuePtr(node->value, value))) {
-				node->value = values;
-				return 1;
-			} else {
-				return 0;
-			}
+	node = hashMap_probe(templates->table, templates->slots, key);
+	if(node->value) {
+		if((values = updateValuePtr(node->value, value))) {
+			node->value = values;
+			return 1;
+		} else {
+			return 0;
 		}
 	}
 	
-	/* new value check if there is space */
+	/* new value, grow as a chained table of size buckets */
 	if(templates->n == templates->size) {
 		++templates->size;
-		/* link table */
-		table = 0;
-		index = templates->size;
-		while(index--) {
-			for(node = templates->table[index]; node != 0; node = next) {
-				next = node->next;
-				node->next = table;
-				table = node;
-			}
-		}
-		free(templates->table);
+		templates->size <<= 1;
 		
 		/* check for megamap */
-		templates->size <<= 1;
 		if((templates->mask + 1) <= (templates->size << 1)) {
-			hashMap2megaMap(templates, table);
+			hashMap2megaMap(templates);
 			return megaMap_addKMA(templates, key, value);
 		}
-		
-		/* reallocate */
-		templates->table = calloc(templates->size, sizeof(HashTable));
-		if(!templates->table) {
-			ERROR();
-		}
-		mask = --templates->size;
-		
-		flag = templates->flag;
-		for(node = table; node != 0; node = next) {
-			next = node->next;
-			if(flag) {
-				murmur(index, node->key);
-				index &= mask;
-			} else {
-				index = node->key & mask;
-			}
-			node->next = templates->table[index];
-			templates->table[index] = node;
-		}
-		
-		
-		if(flag) {
-			murmur(index, key);
-			index &= mask;
-		} else {
-			index = key & mask;
-		}
+		--templates->size;
+	}
+	if(hashMap_fit(templates, templates->n + 1)) {
+		node = hashMap_probe(templates->table, templates->slots, key);
 	}
 	
 	/* add new value */
-	node = smalloc(sizeof(HashTable));
-	
-	/* key */
 	node->key = key;
-	
-	/* value */
 	node->value = updateValuePtr(0, value);
-	
-	/* push it */
-	node->next = templates->table[index];
-	templates->table[index] = node;
-	
 	++templates->n;
 	
 	return 1;
 }
 
 unsigned * hashMapGetValue(HashMap *templates, long unsigned key) {
-	
-	long unsigned index;
-	HashTable *node;
-	
-	if(templates->flag) {
-		murmur(index, key);
-		index &= templates->size;
-	} else {
-		index = key & templates->size;
-	}
-	
-	for(node = templates->table[index]; node != 0; node = node->next) {
-		if(key == node->key) {
-			return node->value;
-		}
-	}
-	
-	return 0;
+	return hashMap_probe(templates->table, templates->slots, key)->value;
 }
 
 void hashMap_addUniqueValues(HashMap *dest, long unsigned key, unsigned *values) {
 	
-	long unsigned index;
 	HashTable *node;
 	
-	node = smalloc(sizeof(HashTable));
+	hashMap_fit(dest, dest->n + 1);
+	node = hashMap_probe(dest->table, dest->slots, key);
 	node->key = key;
 	node->value = values;
-	if(dest->flag) {
-		murmur(index, key);
-		index &= dest->size;
-	} else {
-		index = key & dest->size;
-	}
-	node->next = dest->table[index];
-	dest->table[index] = node;
 	dest->n++;
 }
 
@@ -325,13 +400,13 @@ unsigned * HU2U(unsigned *values) {
 void convertToU(HashMap *templates) {
 	
 	long unsigned index;
-	HashTable *node;
+	HashTable *node, *end;
 	
 	/* convert values */
 	index = templates->size + 1;
-	if(templates->table) {
-		while(index--) {
-			for(node = templates->table[index]; node != 0; node = node->next) {
+	if((node = templates->table)) {
+		for(end = node + templates->slots + 1; node != end; ++node) {
+			if(node->value) {
 				node->value = HU2U(node->value);
 			}
 		}
@@ -31,7 +31,8 @@ struct hashMap {
 	long unsigned prefix;	// prefix
 	unsigned mlen;			// Minimizer length
 	unsigned flag;			// flag to describe k-mer format: std, hom, min, minhom
-	HashTable **table;		// org
+	long unsigned slots;	// open addressed slots - 1
+	HashTable *table;		// org, empty slots have no value
 	unsigned **values;		// ME
 	int DB_size;
 };
@@ -45,7 +46,10 @@ extern unsigned * (*updateValuePtr)(unsigned *, unsigned);
 HashMap * hashMap_initialize(const long unsigned size, const unsigned kmersize, const unsigned mlen, const unsigned flag);
 int megaMap_addKMA(HashMap *templates, long unsigned key, unsigned value);
 unsigned * megaMap_getValue(HashMap *templates, long unsigned key);
-void hashMap2megaMap(HashMap *templates, HashTable *table);
+void hashMap2megaMap(HashMap *templates);
+void hashMap_mergeShards(HashMap *templates, HashMap **shards, int shard_num);
+void hashMap_reserve(HashMap *templates, long unsigned n);
+HashTable * hashMap_list(HashMap *templates);
 unsigned * updateValue(unsigned *values, unsigned value);
 unsigned * updateShortValue(unsigned *valuesOrg, unsigned value);
 int hashMap_addKMA(HashMap *templates, long unsigned key, unsigned value);
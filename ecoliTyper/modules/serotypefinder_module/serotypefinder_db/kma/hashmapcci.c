@@ -21,6 +21,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "hashmapcci.h"
+#include "kmastat.h"
 #include "pherror.h"
 #include "stdnuc.h"
 #include "stdstat.h"
@@ -37,6 +38,8 @@ typedef int key_t;
 #endif
 
 HashMapCCI * (*alignLoadPtr)(HashMapCCI *, int, int, int, long unsigned) = &alignLoad_fly;
+static unsigned char *alignMapData = 0;
+static long unsigned alignMapStart = 0, alignMapSize = 0;
 
 long unsigned hashMapCCI_initialize(HashMapCCI *dest, int len, int kmerindex) {
 	
@@ -125,15 +128,10 @@ int hashMapCCI_get(const HashMapCCI *dest, long unsigned key, unsigned shifter)
 	return 0;
 }
 
-int hashMapCCI_get_bound(const HashMapCCI *dest, long unsigned key, int min, int max, unsigned shifter) {
+static inline int hashMapCCI_get_slot(const HashMapCCI *dest, long unsigned index, long unsigned key, int min, int max, unsigned shifter) {
 	
-	long unsigned index;
 	int pos, apos, *chain;
 	
-	/* get hash */
-	murmur(index, key);
-	index &= dest->mask;
-	
 	/* check index */
 	if((pos = dest->index[index]) == 0) {
 		return 0;
@@ -153,6 +151,42 @@ int hashMapCCI_get_bound(const HashMapCCI *dest, long unsigned key, int min, int
 	return 0;
 }
 
+int hashMapCCI_get_bound(const HashMapCCI *dest, long unsigned key, int min, int max, unsigned shifter) {
+	
+	long unsigned index;
+	
+	/* get hash */
+	murmur(index, key);
+	
+	return hashMapCCI_get_slot(dest, index & dest->mask, key, min, max, shifter);
+}
+
+int hashMapCCI_get_bound_batch(const HashMapCCI *dest, const long unsigned *keys, int n, int min, int max, unsigned shifter) {
+	
+	/* return first key found within bounds, or n if none are */
+	int i, j, end;
+	long unsigned index, slots[CCIBATCH];
+	
+	for(i = 0; i < n; i = end) {
+		/* hash block and prefetch its slots */
+		end = (i + CCIBATCH < n) ? (i + CCIBATCH) : n;
+		for(j = i; j < end; ++j) {
+			murmur(index, keys[j]);
+			slots[j - i] = index & dest->mask;
+			__builtin_prefetch(dest->index + slots[j - i]);
+		}
+		
+		/* probe */
+		for(j = i; j < end; ++j) {
+			if(hashMapCCI_get_slot(dest, slots[j - i], keys[j], min, max, shifter)) {
+				return j;
+			}
+		}
+	}
+	
+	return n;
+}
+
 int * hashMapCCI_getDubPos(const HashMapCCI *dest, long unsigned key, int value, unsigned shifter) {
 	
 	long unsigned index;
@@ -431,20 +465,15 @@ int extendChain(HashMapCCI *dest, int chainpos, int newpos, long unsigned kmer,
 	return -chainpos;
 }
 
-void hashMapCCI_add(HashMapCCI *dest, long unsigned key, int newpos, unsigned shifter) {
+static void hashMapCCI_addSlot(HashMapCCI *dest, int *index_ptr, long unsigned key, int newpos, unsigned shifter) {
 	
-	int pos, *index_ptr;
-	long unsigned index;
+	int pos;
 	
 	if(key == 0) {
 		/* likely undefined region */
 		return;
 	}
 	
-	/* get hash */
-	murmur(index, key);
-	index_ptr = dest->index + (index & dest->mask);
-	
 	/* check index */
 	if((pos = *index_ptr) == 0) {
 		*index_ptr = newpos;
@@ -457,6 +486,15 @@ void hashMapCCI_add(HashMapCCI *dest, long unsigned key, int newpos, unsigned sh
 	}
 }
 
+void hashMapCCI_add(HashMapCCI *dest, long unsigned key, int newpos, unsigned shifter) {
+	
+	long unsigned index;
+	
+	/* get hash */
+	murmur(index, key);
+	hashMapCCI_addSlot(dest, dest->index + (index & dest->mask), key, newpos, shifter);
+}
+
 void hashMapCCI_add_thread(HashMapCCI *dest, long unsigned key, int newpos, unsigned shifter) {
 	
 	static volatile int Lock[2] = {0, 0};
@@ -492,13 +530,10 @@ void hashMapCCI_add_thread(HashMapCCI *dest, long unsigned key, int newpos, unsi
 	}
 }
 
-HashMapCCI * hashMapCCI_load(HashMapCCI *src, int seq, int len, int kmersize) {
+static HashMapCCI * hashMapCCI_init(HashMapCCI *src, int len, int kmersize) {
 	
-	int i, end, shifter, cPos, iPos;
 	long size;
-	long unsigned kmer;
 	
-	/* init */
 	if(src == 0) {
 		src = smalloc(sizeof(HashMapCCI));
 		src->size = 0;
@@ -507,6 +542,43 @@ HashMapCCI * hashMapCCI_load(HashMapCCI *src, int seq, int len, int kmersize) {
 		memset(src->index, 0, size * sizeof(int));
 	}
 	
+	return src;
+}
+
+static HashMapCCI * hashMapCCI_addSeq(HashMapCCI *src, int len, int kmersize) {
+	
+	int i, j, end, stop, shifter, cPos, iPos;
+	long unsigned index, kmers[CCIBATCH], slots[CCIBATCH];
+	
+	kmaStat_add(STAT_CCI, 1);
+	shifter = sizeof(long unsigned) * sizeof(long unsigned) - (src->kmerindex << 1);
+	end = len - kmersize + 1;
+	for(i = 0; i < end; i = stop) {
+		/* hash block and prefetch its slots */
+		stop = (i + CCIBATCH < end) ? (i + CCIBATCH) : end;
+		for(j = i; j < stop; ++j) {
+			getKmer_macro(kmers[j - i], src->seq, j, cPos, iPos, shifter);
+			murmur(index, kmers[j - i]);
+			slots[j - i] = index & src->mask;
+			__builtin_prefetch(src->index + slots[j - i]);
+		}
+		
+		/* add k-mers in order, chains depend on it */
+		for(j = i; j < stop; ++j) {
+			hashMapCCI_addSlot(src, src->index + slots[j - i], kmers[j - i], j + 1, shifter);
+		}
+	}
+	
+	return src;
+}
+
+HashMapCCI * hashMapCCI_load(HashMapCCI *src, int seq, int len, int kmersize) {
+	
+	long size;
+	
+	/* init */
+	src = hashMapCCI_init(src, len, kmersize);
+	
 	/* get seq */
 	size = ((src->len >> 5) + 1) * sizeof(long unsigned);
 	if(size != read(seq, src->seq, size)) {
@@ -519,31 +591,46 @@ HashMapCCI * hashMapCCI_load(HashMapCCI *src, int seq, int len, int kmersize) {
 	}
 	
 	/* add k-mers */
-	shifter = sizeof(long unsigned) * sizeof(long unsigned) - (src->kmerindex << 1);
-	end = len - kmersize + 1;
-	for(i = 0; i < end; ++i) {
-		getKmer_macro(kmer, src->seq, i, cPos, iPos, shifter);
-		hashMapCCI_add(src, kmer, i + 1, shifter);
-	}
+	return hashMapCCI_addSeq(src, len, kmersize);
+}
+
+HashMapCCI * hashMapCCI_load_mem(HashMapCCI *src, const unsigned char *seq, int len, int kmersize) {
 	
-	return src;
+	/* init */
+	src = hashMapCCI_init(src, len, kmersize);
+	
+	/* get seq, only the pages of it are touched */
+	memcpy(src->seq, seq, ((src->len >> 5) + 1) * sizeof(long unsigned));
+	
+	/* add k-mers */
+	return hashMapCCI_addSeq(src, len, kmersize);
 }
 
 HashMapCCI * hashMapCCI_load_thread(HashMapCCI *src, int seq, int len, int kmersize, int thread_num) {
 	
-	static volatile int Lock = 0, next = 1, thread_wait = 0;
+	static volatile int Lock = 0, next = 1, kmer_next = 1, thread_wait = 0, seq_wait = 0;
+	static int slot_size = 0;
+	static unsigned *slots = 0;
 	static long unsigned size;
 	volatile int *lock = &Lock;
-	int i, end, shifter, chunk, cPos, iPos;
+	int i, end, stop, shifter, chunk, cPos, iPos;
 	long check;
-	long unsigned kmer;
+	long unsigned kmer, index;
 	
 	/* init */
 	lock(lock);
 	if(src->len == 0) {
 		size = hashMapCCI_initialize(src, len, kmersize);
+		kmaStat_add(STAT_CCI, 1);
+		if(slot_size < len) {
+			free(slots);
+			slot_size = len;
+			slots = smalloc(slot_size * sizeof(unsigned));
+		}
 		thread_wait = thread_num;
+		seq_wait = 1;
 		next = 0;
+		kmer_next = 0;
 		unlock(lock);
 		
 		/* get seq */
@@ -556,6 +643,7 @@ HashMapCCI * hashMapCCI_load_thread(HashMapCCI *src, int seq, int len, int kmers
 				exit(1);
 			}
 		}
+		seq_wait = 0;
 	} else {
 		unlock(lock);
 	}
@@ -616,15 +704,41 @@ HashMapCCI * hashMapCCI_load_thread(HashMapCCI *src, int seq, int len, int kmers
 	}
 	*/
 	
+	/* hash k-mers in chunks of 16224, once seq is loaded */
+	wait_atomic(seq_wait);
+	shifter = sizeof(long unsigned) * sizeof(long unsigned) - (src->kmerindex << 1);
+	end = len - kmersize + 1;
+	chunk = 16224;
+	while(chunk) {
+		lock(lock);
+		i = kmer_next;
+		if((kmer_next += chunk) < 0) {
+			kmer_next = end;
+		}
+		unlock(lock);
+		
+		if(i < end) {
+			stop = (end <= i + chunk) ? end : (i + chunk);
+			while(i < stop) {
+				getKmer_macro(kmer, src->seq, i, cPos, iPos, shifter);
+				murmur(index, kmer);
+				slots[i++] = index & src->mask;
+			}
+		} else {
+			chunk = 0;
+		}
+	}
+	
 	lock(lock);
 	if(--thread_wait == 0) {
-		/* add k-mers */
-		shifter = sizeof(long unsigned) * sizeof(long unsigned) - (src->kmerindex << 1);
-		end = len - kmersize + 1;
+		/* add k-mers in order, chains depend on it */
 		i = -1;
 		while(++i < end) {
+			if(i + 16 < end) {
+				__builtin_prefetch(src->index + slots[i + 16]);
+			}
 			getKmer_macro(kmer, src->seq, i, cPos, iPos, shifter);
-			hashMapCCI_add(src, kmer, i + 1, shifter);
+			hashMapCCI_addSlot(src, src->index + slots[i], kmer, i + 1, shifter);
 		}
 	}
 	unlock(lock);
@@ -651,6 +765,25 @@ HashMapCCI * alignLoad_fly_mem(HashMapCCI *dest, int seq_in, int len, int kmersi
 	return hashMapCCI_load(dest, seq_in, len, kmersize);
 }
 
+void alignMap(unsigned char *data, long unsigned start, long unsigned size) {
+	
+	/* sequences are used from data, holding the seq.b from offset start */
+	alignMapData = data;
+	alignMapStart = start;
+	alignMapSize = size;
+}
+
+HashMapCCI * alignLoad_map(HashMapCCI *dest, int seq_in, int len, int kmersize, long unsigned seq_index) {
+	
+	seq_index -= alignMapStart;
+	if(alignMapSize < seq_index + ((len >> 5) + 1) * sizeof(long unsigned)) {
+		fprintf(stderr, "Corrupted *.seq.b\n");
+		exit(1);
+	}
+	
+	return hashMapCCI_load_mem(dest, alignMapData + seq_index, len, kmersize);
+}
+
 HashMapCCI * alignLoad_skip(HashMapCCI *dest, int seq_in, int len, int kmersize, long unsigned seq_index) {
 	
 	dest->len = len;
@@ -36,6 +36,7 @@ struct hashMapCCI {
 	unsigned cci_avail; // avail chains
 };
 #define HASHMAPCCI 1
+#define CCIBATCH 32 /* k-mers hashed and prefetched ahead of their slots */
 #endif
 
 /* pointers determining how indexes a stored */
@@ -45,6 +46,7 @@ long unsigned hashMapCCI_initialize(HashMapCCI *dest, int len, int kmerindex);
 void hashMapCCI_destroy(HashMapCCI *dest);
 int hashMapCCI_get(const HashMapCCI *dest, long unsigned key, unsigned shifter);
 int hashMapCCI_get_bound(const HashMapCCI *dest, long unsigned key, int min, int max, unsigned shifter);
+int hashMapCCI_get_bound_batch(const HashMapCCI *dest, const long unsigned *keys, int n, int min, int max, unsigned shifter);
 int * hashMapCCI_getDubPos(const HashMapCCI *dest, long unsigned key, int value, unsigned shifter);
 int * hashMapCCI_getNextDubPos(const HashMapCCI *dest, int *chain, long unsigned key, int min, int max, unsigned shifter);
 int defragChain(HashMapCCI *dest, int size, int shifter);
@@ -53,8 +55,11 @@ int extendChain(HashMapCCI *dest, int chainpos, int newpos, long unsigned kmer,
 void hashMapCCI_add(HashMapCCI *dest, long unsigned key, int newpos, unsigned shifter);
 void hashMapCCI_add_thread(HashMapCCI *dest, long unsigned key, int newpos, unsigned shifter);
 HashMapCCI * hashMapCCI_load(HashMapCCI *src, int seq, int len, int kmersize);
+HashMapCCI * hashMapCCI_load_mem(HashMapCCI *src, const unsigned char *seq, int len, int kmersize);
 HashMapCCI * hashMapCCI_load_thread(HashMapCCI *src, int seq, int len, int kmersize, int thread_num);
 void hashMapCCI_dump(HashMapCCI *src, FILE *seq);
 HashMapCCI * alignLoad_fly(HashMapCCI *dest, int seq_in, int len, int kmersize, long unsigned seq_index);
 HashMapCCI * alignLoad_fly_mem(HashMapCCI *dest, int seq_in, int len, int kmersize, long unsigned seq_index);
+void alignMap(unsigned char *data, long unsigned start, long unsigned size);
+HashMapCCI * alignLoad_map(HashMapCCI *dest, int seq_in, int len, int kmersize, long unsigned seq_index);
 HashMapCCI * alignLoad_skip(HashMapCCI *dest, int seq_in, int len, int kmersize, long unsigned seq_index);
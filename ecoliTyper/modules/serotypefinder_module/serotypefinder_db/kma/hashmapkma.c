@@ -20,8 +20,12 @@
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "delta.h"
 #include "hashmapkma.h"
+#include "kmmap.h"
 #include "pherror.h"
+#include "seqscan.h"
 #include "stdnuc.h"
 #include "stdstat.h"
 #ifdef _WIN32
@@ -41,6 +45,9 @@ long unsigned (*getKeyPtr)(const unsigned *, const long unsigned);
 long unsigned (*getValueIndexPtr)(const unsigned *, const long unsigned);
 unsigned * (*getValuePtr)(const HashMapKMA *, const long unsigned);
 unsigned * (*hashMap_get)(const HashMapKMA *, const long unsigned) = &hashMap_getGlobal;
+void (*hashMap_getBatch)(const HashMapKMA *, const long unsigned *, int, unsigned **) = &hashMap_getBatchGlobal;
+unsigned * (*hashMap_getUnfiltered)(const HashMapKMA *, const long unsigned) = &hashMap_getGlobal;
+void (*hashMap_getBatchUnfiltered)(const HashMapKMA *, const long unsigned *, int, unsigned **) = &hashMap_getBatchGlobal;
 int (*intpos_bin_contaminationPtr)(const unsigned *, const int);
 int (*getSizePtr)(const unsigned *);
 void (*hashMapKMA_addKey_ptr)(HashMapKMA *, long unsigned, long unsigned);
@@ -89,61 +96,53 @@ int getSizeS(const unsigned *values) {
 
 int intpos_bin_contamination(const unsigned *str1, const int str2) {
 	
-	int pos, upLim, downLim, template;
+	int n, half, pos;
+	const unsigned *base, *end;
 	
-	upLim = *str1;
-	if(upLim == 0) {
+	if((n = *str1) == 0) {
 		return -1;
 	}
 	
-	downLim = 1;
-	pos = (upLim + downLim) >> 1;
-	while(0 < (upLim - downLim)) {
-		template = str1[pos];
-		if(template == str2) {
-			return pos;
-		} else if(template < str2) {
-			downLim = pos + 1;
-		} else {
-			upLim = pos - 1;
-		}
-		pos = (upLim + downLim) >> 1;
+	/* branchless narrowing of long lists, then scan the window */
+	base = str1 + 1;
+	end = base + n;
+	while(INTPOSSCAN < n) {
+		half = n >> 1;
+		base = (base[half] < (unsigned) str2) ? base + half : base;
+		n -= half;
 	}
-	if(str1[pos] == str2) {
-		return pos;
+	n += (base + n < end);
+	if((pos = findU32(base, n, str2)) < 0) {
+		return -1;
 	}
 	
-	return -1;
+	return pos + (base - str1);
 }
 
 int intpos_bin_contamination_s(const unsigned *Str1, const int str2) {
 	
-	int pos, upLim, downLim, template;
-	short unsigned *str1 = (short unsigned *) Str1;
+	int n, half, pos;
+	const short unsigned *str1, *base, *end;
 	
-	upLim = *str1;
-	if(upLim == 0) {
+	str1 = (const short unsigned *) Str1;
+	if((n = *str1) == 0) {
 		return -1;
 	}
 	
-	downLim = 1;
-	pos = (upLim + downLim) >> 1;
-	while(0 < (upLim - downLim)) {
-		template = str1[pos];
-		if(template == str2) {
-			return pos;
-		} else if(template < str2) {
-			downLim = pos + 1;
-		} else {
-			upLim = pos - 1;
-		}
-		pos = (upLim + downLim) >> 1;
+	/* branchless narrowing of long lists, then scan the window */
+	base = str1 + 1;
+	end = base + n;
+	while(INTPOSSCAN < n) {
+		half = n >> 1;
+		base = (base[half] < (unsigned) str2) ? base + half : base;
+		n -= half;
 	}
-	if(str1[pos] == str2) {
-		return pos;
+	n += (base + n < end);
+	if((pos = findU16(base, n, str2)) < 0) {
+		return -1;
 	}
 	
-	return -1;
+	return pos + (base - str1);
 }
 
 unsigned * hashMap_getGlobal(const HashMapKMA *templates, const long unsigned key) {
@@ -177,6 +176,13 @@ unsigned * hashMap_getGlobal(const HashMapKMA *templates, const long unsigned ke
 	return 0;
 }
 
+void hashMap_getBatchGlobal(const HashMapKMA *templates, const long unsigned *keys, int n, unsigned **values) {
+	
+	while(n--) {
+		*values++ = hashMap_get(templates, *keys++);
+	}
+}
+
 void loadPrefix(HashMapKMA *dest, FILE *file) {
 	
 	long unsigned Size, size;
@@ -272,6 +278,493 @@ unsigned * megaMap_getGlobal(const HashMapKMA *templates, const long unsigned ke
 	return 0;
 }
 
+/*
+ Layout specialized lookups, the widths of exist, key_index, value_index and
+ values are fixed at compile time, so the probe can be inlined as a whole.
+*/
+#define HASHMAP_GET(name, exist_t, key_t, vindex_t, value_t) \
+static unsigned * name(const HashMapKMA *templates, const long unsigned key) { \
+	\
+	long unsigned pos, kpos, kmer; \
+	const key_t *key_index; \
+	\
+	if(templates->flag) { \
+		murmur(kpos, key); \
+		kpos &= templates->size; \
+	} else { \
+		kpos = key & templates->size; \
+	} \
+	\
+	if((pos = ((const exist_t *)(templates->exist))[kpos]) != templates->null_index) { \
+		key_index = (const key_t *)(templates->key_index); \
+		while(key != (kmer = key_index[pos])) { \
+			if(templates->flag) { \
+				murmur(kmer, kmer); \
+			} \
+			if(kpos != (kmer & templates->size)) { \
+				return 0; \
+			} \
+			++pos; \
+		} \
+		return (unsigned *)((value_t *)(templates->values) + ((const vindex_t *)(templates->value_index))[pos]); \
+	} \
+	\
+	return 0; \
+}
+
+#define MEGAMAP_GET(name, exist_t, value_t) \
+static unsigned * name(const HashMapKMA *templates, const long unsigned key) { \
+	\
+	long unsigned pos; \
+	\
+	if((pos = ((const exist_t *)(templates->exist))[key & templates->mask]) != 1) { \
+		return (unsigned *)((value_t *)(templates->values) + pos); \
+	} \
+	\
+	return 0; \
+}
+
+HASHMAP_GET(hashMap_get_eeee, unsigned, unsigned, unsigned, unsigned)
+HASHMAP_GET(hashMap_get_eees, unsigned, unsigned, unsigned, short unsigned)
+HASHMAP_GET(hashMap_get_eele, unsigned, unsigned, long unsigned, unsigned)
+HASHMAP_GET(hashMap_get_eels, unsigned, unsigned, long unsigned, short unsigned)
+HASHMAP_GET(hashMap_get_elee, unsigned, long unsigned, unsigned, unsigned)
+HASHMAP_GET(hashMap_get_eles, unsigned, long unsigned, unsigned, short unsigned)
+HASHMAP_GET(hashMap_get_elle, unsigned, long unsigned, long unsigned, unsigned)
+HASHMAP_GET(hashMap_get_ells, unsigned, long unsigned, long unsigned, short unsigned)
+HASHMAP_GET(hashMap_get_leee, long unsigned, unsigned, unsigned, unsigned)
+HASHMAP_GET(hashMap_get_lees, long unsigned, unsigned, unsigned, short unsigned)
+HASHMAP_GET(hashMap_get_lele, long unsigned, unsigned, long unsigned, unsigned)
+HASHMAP_GET(hashMap_get_lels, long unsigned, unsigned, long unsigned, short unsigned)
+HASHMAP_GET(hashMap_get_llee, long unsigned, long unsigned, unsigned, unsigned)
+HASHMAP_GET(hashMap_get_lles, long unsigned, long unsigned, unsigned, short unsigned)
+HASHMAP_GET(hashMap_get_llle, long unsigned, long unsigned, long unsigned, unsigned)
+HASHMAP_GET(hashMap_get_llls, long unsigned, long unsigned, long unsigned, short unsigned)
+/*
+ Batched lookups, every level of the probe is issued for the whole batch
+ before it is resolved, so that the cache misses of the k-mers overlap.
+*/
+#define HASHMAP_GETBATCH(name, exist_t, key_t, vindex_t, value_t) \
+static void name(const HashMapKMA *templates, const long unsigned *keys, int n, unsigned **values) { \
+	\
+	int i, m; \
+	long unsigned pos, kpos, kmer, kposs[HASHMAPBATCH], poss[HASHMAPBATCH]; \
+	const exist_t *exist; \
+	const key_t *key_index; \
+	const vindex_t *value_index; \
+	\
+	exist = (const exist_t *)(templates->exist); \
+	key_index = (const key_t *)(templates->key_index); \
+	value_index = (const vindex_t *)(templates->value_index); \
+	for(; 0 < n; n -= HASHMAPBATCH, keys += HASHMAPBATCH, values += HASHMAPBATCH) { \
+		m = n < HASHMAPBATCH ? n : HASHMAPBATCH; \
+		/* hash and fetch buckets */ \
+		for(i = 0; i < m; ++i) { \
+			if(templates->flag) { \
+				murmur(kpos, keys[i]); \
+				kposs[i] = kpos & templates->size; \
+			} else { \
+				kposs[i] = keys[i] & templates->size; \
+			} \
+			__builtin_prefetch(exist + kposs[i]); \
+		} \
+		/* fetch keys and value indexes */ \
+		for(i = 0; i < m; ++i) { \
+			if((poss[i] = exist[kposs[i]]) != templates->null_index) { \
+				__builtin_prefetch(key_index + poss[i]); \
+				__builtin_prefetch(value_index + poss[i]); \
+			} \
+		} \
+		/* resolve, and fetch values */ \
+		for(i = 0; i < m; ++i) { \
+			values[i] = 0; \
+			if((pos = poss[i]) != templates->null_index) { \
+				kpos = kposs[i]; \
+				while(keys[i] != (kmer = key_index[pos])) { \
+					if(templates->flag) { \
+						murmur(kmer, kmer); \
+					} \
+					if(kpos != (kmer & templates->size)) { \
+						pos = templates->null_index; \
+						break; \
+					} \
+					++pos; \
+				} \
+				if(pos != templates->null_index) { \
+					values[i] = (unsigned *)((value_t *)(templates->values) + value_index[pos]); \
+					__builtin_prefetch(values[i]); \
+				} \
+			} \
+		} \
+	} \
+}
+
+#define MEGAMAP_GETBATCH(name, exist_t, value_t) \
+static void name(const HashMapKMA *templates, const long unsigned *keys, int n, unsigned **values) { \
+	\
+	int i; \
+	const exist_t *exist; \
+	\
+	exist = (const exist_t *)(templates->exist); \
+	for(i = 0; i < n; ++i) { \
+		__builtin_prefetch(exist + (keys[i] & templates->mask)); \
+	} \
+	for(i = 0; i < n; ++i) { \
+		if(exist[keys[i] & templates->mask] != 1) { \
+			values[i] = (unsigned *)((value_t *)(templates->values) + exist[keys[i] & templates->mask]); \
+			__builtin_prefetch(values[i]); \
+		} else { \
+			values[i] = 0; \
+		} \
+	} \
+}
+
+MEGAMAP_GET(megaMap_get_ee, unsigned, unsigned)
+MEGAMAP_GET(megaMap_get_es, unsigned, short unsigned)
+MEGAMAP_GET(megaMap_get_le, long unsigned, unsigned)
+MEGAMAP_GET(megaMap_get_ls, long unsigned, short unsigned)
+HASHMAP_GETBATCH(hashMap_getBatch_eeee, unsigned, unsigned, unsigned, unsigned)
+HASHMAP_GETBATCH(hashMap_getBatch_eees, unsigned, unsigned, unsigned, short unsigned)
+HASHMAP_GETBATCH(hashMap_getBatch_eele, unsigned, unsigned, long unsigned, unsigned)
+HASHMAP_GETBATCH(hashMap_getBatch_eels, unsigned, unsigned, long unsigned, short unsigned)
+HASHMAP_GETBATCH(hashMap_getBatch_elee, unsigned, long unsigned, unsigned, unsigned)
+HASHMAP_GETBATCH(hashMap_getBatch_eles, unsigned, long unsigned, unsigned, short unsigned)
+HASHMAP_GETBATCH(hashMap_getBatch_elle, unsigned, long unsigned, long unsigned, unsigned)
+HASHMAP_GETBATCH(hashMap_getBatch_ells, unsigned, long unsigned, long unsigned, short unsigned)
+HASHMAP_GETBATCH(hashMap_getBatch_leee, long unsigned, unsigned, unsigned, unsigned)
+HASHMAP_GETBATCH(hashMap_getBatch_lees, long unsigned, unsigned, unsigned, short unsigned)
+HASHMAP_GETBATCH(hashMap_getBatch_lele, long unsigned, unsigned, long unsigned, unsigned)
+HASHMAP_GETBATCH(hashMap_getBatch_lels, long unsigned, unsigned, long unsigned, short unsigned)
+HASHMAP_GETBATCH(hashMap_getBatch_llee, long unsigned, long unsigned, unsigned, unsigned)
+HASHMAP_GETBATCH(hashMap_getBatch_lles, long unsigned, long unsigned, unsigned, short unsigned)
+HASHMAP_GETBATCH(hashMap_getBatch_llle, long unsigned, long unsigned, long unsigned, unsigned)
+HASHMAP_GETBATCH(hashMap_getBatch_llls, long unsigned, long unsigned, long unsigned, short unsigned)
+MEGAMAP_GETBATCH(megaMap_getBatch_ee, unsigned, unsigned)
+MEGAMAP_GETBATCH(megaMap_getBatch_es, unsigned, short unsigned)
+MEGAMAP_GETBATCH(megaMap_getBatch_le, long unsigned, unsigned)
+MEGAMAP_GETBATCH(megaMap_getBatch_ls, long unsigned, short unsigned)
+
+/*
+ Cache blocked lookups, the bucket of a k-mer holds its key and value index
+ in one cache line. Buckets are filled from the front, so an empty slot 
+ ends the probe.
+*/
+#define BLOCKMAP_GET(name, block_t, slots, value_t) \
+static unsigned * name(const HashMapKMA *templates, const long unsigned key) { \
+	\
+	int i; \
+	long unsigned pos; \
+	const block_t *block; \
+	\
+	murmur(pos, key); \
+	pos &= templates->block_mask; \
+	while(1) { \
+		block = (const block_t *)(templates->blocks) + pos; \
+		for(i = 0; i < slots; ++i) { \
+			if(block->value[i] == HASHBLOCKNULL) { \
+				return 0; \
+			} else if(block->key[i] == key) { \
+				return (unsigned *)((value_t *)(templates->values) + block->value[i]); \
+			} \
+		} \
+		pos = (pos + 1) & templates->block_mask; \
+	} \
+}
+
+#define BLOCKMAP_GETBATCH(name, get, block_t) \
+static void name(const HashMapKMA *templates, const long unsigned *keys, int n, unsigned **values) { \
+	\
+	int i, m; \
+	long unsigned pos; \
+	\
+	for(; 0 < n; n -= HASHMAPBATCH, keys += HASHMAPBATCH, values += HASHMAPBATCH) { \
+		m = n < HASHMAPBATCH ? n : HASHMAPBATCH; \
+		for(i = 0; i < m; ++i) { \
+			murmur(pos, keys[i]); \
+			__builtin_prefetch((const block_t *)(templates->blocks) + (pos & templates->block_mask)); \
+		} \
+		for(i = 0; i < m; ++i) { \
+			if((values[i] = get(templates, keys[i]))) { \
+				__builtin_prefetch(values[i]); \
+			} \
+		} \
+	} \
+}
+
+BLOCKMAP_GET(blockMap_get_e, HashBlock, HASHBLOCK, unsigned)
+BLOCKMAP_GET(blockMap_get_s, HashBlock, HASHBLOCK, short unsigned)
+BLOCKMAP_GET(blockMap_get_le, HashBlockL, HASHBLOCKL, unsigned)
+BLOCKMAP_GET(blockMap_get_ls, HashBlockL, HASHBLOCKL, short unsigned)
+BLOCKMAP_GETBATCH(blockMap_getBatch_e, blockMap_get_e, HashBlock)
+BLOCKMAP_GETBATCH(blockMap_getBatch_s, blockMap_get_s, HashBlock)
+BLOCKMAP_GETBATCH(blockMap_getBatch_le, blockMap_get_le, HashBlockL)
+BLOCKMAP_GETBATCH(blockMap_getBatch_ls, blockMap_get_ls, HashBlockL)
+
+void setHashMapGet(int megaMap) {
+	
+	int layout;
+	static unsigned * (*hashMap_gets[16])(const HashMapKMA *, const long unsigned) = {
+		&hashMap_get_eeee, &hashMap_get_eees, &hashMap_get_eele, &hashMap_get_eels,
+		&hashMap_get_elee, &hashMap_get_eles, &hashMap_get_elle, &hashMap_get_ells,
+		&hashMap_get_leee, &hashMap_get_lees, &hashMap_get_lele, &hashMap_get_lels,
+		&hashMap_get_llee, &hashMap_get_lles, &hashMap_get_llle, &hashMap_get_llls};
+	static unsigned * (*megaMap_gets[4])(const HashMapKMA *, const long unsigned) = {
+		&megaMap_get_ee, &megaMap_get_es, &megaMap_get_le, &megaMap_get_ls};
+	static void (*hashMap_getBatchs[16])(const HashMapKMA *, const long unsigned *, int, unsigned **) = {
+		&hashMap_getBatch_eeee, &hashMap_getBatch_eees, &hashMap_getBatch_eele, &hashMap_getBatch_eels,
+		&hashMap_getBatch_elee, &hashMap_getBatch_eles, &hashMap_getBatch_elle, &hashMap_getBatch_ells,
+		&hashMap_getBatch_leee, &hashMap_getBatch_lees, &hashMap_getBatch_lele, &hashMap_getBatch_lels,
+		&hashMap_getBatch_llee, &hashMap_getBatch_lles, &hashMap_getBatch_llle, &hashMap_getBatch_llls};
+	static void (*megaMap_getBatchs[4])(const HashMapKMA *, const long unsigned *, int, unsigned **) = {
+		&megaMap_getBatch_ee, &megaMap_getBatch_es, &megaMap_getBatch_le, &megaMap_getBatch_ls};
+	
+	/* select lookup from the layout chosen by the loader */
+	layout = (getExistPtr == &getExistL) << 1 | (getValuePtr == &getValueS);
+	if(megaMap) {
+		hashMap_get = megaMap_gets[layout];
+		hashMap_getBatch = megaMap_getBatchs[layout];
+	} else {
+		layout = (layout & 2) << 2 | (getKeyPtr == &getKeyL) << 2 | (getValueIndexPtr == &getValueIndexL) << 1 | (layout & 1);
+		hashMap_get = hashMap_gets[layout];
+		hashMap_getBatch = hashMap_getBatchs[layout];
+	}
+}
+
+static long unsigned hashMapKMA_bytes = 0; /* accounted by the loaders */
+
+static void * hashMapKMA_malloc(HashMapKMA *dest, long unsigned size) {
+	
+	void *ptr;
+	
+	memAcc_add(MEM_INDEX, size);
+	hashMapKMA_bytes += size;
+	
+	/* place DB arrays on hugepages if requested */
+	if(getHugePages()) {
+		dest->shmFlag |= 256;
+		return hugeMalloc(size);
+	} else if((errno = posix_memalign(&ptr, 64, size))) {
+		ERROR();
+	}
+	
+	return ptr;
+}
+
+static void hashMapKMA_dealloc(HashMapKMA *dest, void *ptr) {
+	
+	if(dest->shmFlag & 256) {
+		hugeFree(ptr);
+	} else {
+		free(ptr);
+	}
+}
+
+static inline long unsigned filterHash(long unsigned key) {
+	
+	/* low bits choose the block, high bits the bits within it */
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdUL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53UL;
+	key ^= key >> 33;
+	
+	return key;
+}
+
+static inline int filterTest(const long unsigned *block, long unsigned h) {
+	
+	int i;
+	unsigned bit;
+	
+	for(i = 28; i < 64; i += 9) {
+		bit = (h >> i) & 511;
+		if(!((block[bit >> 6] >> (bit & 63)) & 1)) {
+			return 0;
+		}
+	}
+	
+	return 1;
+}
+
+unsigned * hashMap_getFilter(const HashMapKMA *templates, const long unsigned key) {
+	
+	long unsigned h;
+	
+	/* absent k-mers are rejected from a single cache line */
+	h = filterHash(key);
+	if(!filterTest(templates->filter + ((h & templates->filter_mask) * HASHFILTERWORDS), h)) {
+		return 0;
+	}
+	
+	return hashMap_getUnfiltered(templates, key);
+}
+
+void hashMap_getBatchFilter(const HashMapKMA *templates, const long unsigned *keys, int n, unsigned **values) {
+	
+	int i, m, hits, index[HASHMAPBATCH];
+	long unsigned h[HASHMAPBATCH], pass[HASHMAPBATCH];
+	unsigned *found[HASHMAPBATCH];
+	
+	for(; 0 < n; n -= HASHMAPBATCH, keys += HASHMAPBATCH, values += HASHMAPBATCH) {
+		m = n < HASHMAPBATCH ? n : HASHMAPBATCH;
+		for(i = 0; i < m; ++i) {
+			h[i] = filterHash(keys[i]);
+			__builtin_prefetch(templates->filter + ((h[i] & templates->filter_mask) * HASHFILTERWORDS));
+		}
+		
+		/* only look up k-mers passing the filter */
+		hits = 0;
+		for(i = 0; i < m; ++i) {
+			values[i] = 0;
+			if(filterTest(templates->filter + ((h[i] & templates->filter_mask) * HASHFILTERWORDS), h[i])) {
+				index[hits] = i;
+				pass[hits++] = keys[i];
+			}
+		}
+		if(hits) {
+			hashMap_getBatchUnfiltered(templates, pass, hits, found);
+			for(i = 0; i < hits; ++i) {
+				values[index[i]] = found[i];
+			}
+		}
+	}
+}
+
+void hashMapKMA_loadFilter(HashMapKMA *dest, FILE *file) {
+	
+	long unsigned n_blocks, size;
+	
+	sfread(&n_blocks, sizeof(long unsigned), 1, file);
+	size = n_blocks * HASHFILTERWORDS * sizeof(long unsigned);
+	memAcc_add(MEM_INDEX, size);
+	hashMapKMA_bytes += size;
+	if((errno = posix_memalign((void **) &dest->filter, 64, size))) {
+		ERROR();
+	}
+	sfread(dest->filter, 1, size, file);
+	dest->filter_mask = n_blocks - 1;
+	dest->shmFlag |= 128;
+	
+	/* put the filter in front of the chosen lookups */
+	hashMap_getUnfiltered = hashMap_get;
+	hashMap_getBatchUnfiltered = hashMap_getBatch;
+	hashMap_get = &hashMap_getFilter;
+	hashMap_getBatch = &hashMap_getBatchFilter;
+}
+
+void hashMapKMA_loadValues(HashMapKMA *dest, FILE *file) {
+	
+	unsigned i, n, len, rem, prev, *tmp;
+	long unsigned j;
+	unsigned char *buff;
+	
+	/* chunks of: data length, control bytes and stream-vbyte data */
+	buff = smalloc((SVBCHUNK >> 2) + (SVBCHUNK << 2) + 16);
+	tmp = smalloc(SVBCHUNK * sizeof(unsigned));
+	rem = 0;
+	prev = 0;
+	for(j = 0; j < dest->v_index; j += n) {
+		n = (dest->v_index - j < SVBCHUNK) ? dest->v_index - j : SVBCHUNK;
+		sfread(&len, sizeof(unsigned), 1, file);
+		if((SVBCHUNK << 2) < len) {
+			fprintf(stderr, "Corrupted value lists in DB.\n");
+			exit(1);
+		}
+		sfread(buff, 1, ((n + 3) >> 2) + len, file);
+		if(svbDecode(tmp, buff, buff + ((n + 3) >> 2), n) != len) {
+			fprintf(stderr, "Corrupted value lists in DB.\n");
+			exit(1);
+		}
+		
+		/* lists are stored as their length followed by deltas */
+		for(i = 0; i < n; ++i) {
+			if(rem) {
+				prev += tmp[i];
+				tmp[i] = prev;
+				--rem;
+			} else {
+				rem = tmp[i];
+				prev = 0;
+			}
+		}
+		if(dest->DB_size < USHRT_MAX) {
+			for(i = 0; i < n; ++i) {
+				dest->values_s[j + i] = tmp[i];
+			}
+		} else {
+			memcpy(dest->values + j, tmp, n * sizeof(unsigned));
+		}
+	}
+	free(buff);
+	free(tmp);
+}
+
+int hashMapKMA_loadBlocks(HashMapKMA *dest, FILE *file) {
+	
+	unsigned magic, slots;
+	long start, size, valueSize, blockSize;
+	
+	/* blocked layout is appended after the trailing kmersize and flag */
+	if((dest->size - 1) == dest->mask || (start = ftell(file)) < 0) {
+		return 0;
+	}
+	size = dest->size * ((dest->n <= UINT_MAX) ? sizeof(unsigned) : sizeof(long unsigned));
+	valueSize = dest->v_index * ((dest->DB_size < USHRT_MAX) ? sizeof(short unsigned) : sizeof(unsigned));
+	size += valueSize;
+	size += (dest->n + 1) * ((dest->mlen <= 16) ? sizeof(unsigned) : sizeof(long unsigned));
+	size += dest->n * ((dest->v_index < UINT_MAX) ? sizeof(unsigned) : sizeof(long unsigned));
+	if(fseek(file, start + size, SEEK_SET) || fread(&dest->kmersize, sizeof(unsigned), 1, file) != 1 || 
+		fread(&dest->flag, sizeof(unsigned), 1, file) != 1 || 
+		fread(&magic, sizeof(unsigned), 1, file) != 1 || magic != HASHBLOCKMAGIC) {
+		errno = 0;
+		sfseek(file, start, SEEK_SET);
+		return 0;
+	}
+	sfread(&slots, sizeof(unsigned), 1, file);
+	sfread(&dest->block_mask, sizeof(long unsigned), 1, file);
+	blockSize = dest->block_mask * ((slots == HASHBLOCK) ? sizeof(HashBlock) : sizeof(HashBlockL));
+	dest->blocks = hashMapKMA_malloc(dest, blockSize);
+	sfread(dest->blocks, 1, blockSize, file);
+	dest->blocks_l = (HashBlockL *)(dest->blocks);
+	--dest->block_mask;
+	
+	/* values, delta encoded after the blocks if present */
+	dest->values = hashMapKMA_malloc(dest, valueSize);
+	dest->values_s = (short unsigned *)(dest->values);
+	if(fread(&magic, sizeof(unsigned), 1, file) == 1 && magic == HASHSVBMAGIC) {
+		hashMapKMA_loadValues(dest, file);
+	} else {
+		errno = 0;
+		sfseek(file, start + dest->size * ((dest->n <= UINT_MAX) ? sizeof(unsigned) : sizeof(long unsigned)), SEEK_SET);
+		sfread(dest->values, 1, valueSize, file);
+	}
+	dest->exist = 0;
+	dest->exist_l = 0;
+	dest->key_index = 0;
+	dest->key_index_l = 0;
+	dest->value_index = 0;
+	dest->value_index_l = 0;
+	dest->shmFlag |= 2 | 64;
+	setCmerPointers(dest->flag);
+	
+	if(dest->DB_size < USHRT_MAX) {
+		getValuePtr = &getValueS;
+		intpos_bin_contaminationPtr = &intpos_bin_contamination_s;
+		hashMap_get = (slots == HASHBLOCK) ? &blockMap_get_s : &blockMap_get_ls;
+		hashMap_getBatch = (slots == HASHBLOCK) ? &blockMap_getBatch_s : &blockMap_getBatch_ls;
+	} else {
+		getValuePtr = &getValue;
+		intpos_bin_contaminationPtr = &intpos_bin_contamination;
+		hashMap_get = (slots == HASHBLOCK) ? &blockMap_get_e : &blockMap_get_le;
+		hashMap_getBatch = (slots == HASHBLOCK) ? &blockMap_getBatch_e : &blockMap_getBatch_le;
+	}
+	
+	/* make indexing a masking problem */
+	--dest->size;
+	
+	return 1;
+}
+
 int hashMapKMA_load(HashMapKMA *dest, FILE *file, const char *filename) {
 	
 	key_t key;
@@ -295,6 +788,8 @@ int hashMapKMA_load(HashMapKMA *dest, FILE *file, const char *filename) {
 	/* simple check for old indexing */
 	if(dest->size < dest->n) {
 		return 1;
+	} else if(hashMapKMA_loadBlocks(dest, file)) {
+		return 0;
 	}
 	
 	/* check shared memory, else load */
@@ -321,7 +816,7 @@ int hashMapKMA_load(HashMapKMA *dest, FILE *file, const char *filename) {
 	if(shmid < 0) {
 		/* not shared, load */
 		errno = 0;
-		dest->exist = smalloc(size);
+		dest->exist = hashMapKMA_malloc(dest, size);
 		check = fread(dest->exist, 1, size, file);
 		if(check != size) {
 			return 1;
@@ -351,7 +846,7 @@ int hashMapKMA_load(HashMapKMA *dest, FILE *file, const char *filename) {
 	if(shmid < 0) {
 		/* not shared, load */
 		errno = 0;
-		dest->values = smalloc(size);
+		dest->values = hashMapKMA_malloc(dest, size);
 		if(seekSize) {
 			sfseek(file, seekSize, SEEK_CUR);
 		}
@@ -370,9 +865,8 @@ int hashMapKMA_load(HashMapKMA *dest, FILE *file, const char *filename) {
 	
 	/* check for megaMap */
 	if((dest->size - 1) == dest->mask) {
-		hashMap_get = &megaMap_getGlobal;
+		setHashMapGet(1);
 	} else {
-		hashMap_get = &hashMap_getGlobal;
 		/* kmers */
 		size = dest->n + 1;
 		if(dest->mlen <= 16) {
@@ -387,7 +881,7 @@ int hashMapKMA_load(HashMapKMA *dest, FILE *file, const char *filename) {
 		if(shmid < 0) {
 			/* not shared, load */
 			errno = 0;
-			dest->key_index = smalloc(size);
+			dest->key_index = hashMapKMA_malloc(dest, size);
 			if(seekSize) {
 				sfseek(file, seekSize, SEEK_CUR);
 			}
@@ -418,7 +912,7 @@ int hashMapKMA_load(HashMapKMA *dest, FILE *file, const char *filename) {
 		if(shmid < 0) {
 			/* not shared, load */
 			errno = 0;
-			dest->value_index = smalloc(size);
+			dest->value_index = hashMapKMA_malloc(dest, size);
 			if(seekSize) {
 				sfseek(file, seekSize, SEEK_CUR);
 			}
@@ -435,6 +929,8 @@ int hashMapKMA_load(HashMapKMA *dest, FILE *file, const char *filename) {
 		}
 		dest->value_index_l = (long unsigned *)(dest->value_index);
 		
+		setHashMapGet(0);
+		
 		/* make indexing a masking problem */
 		--dest->size;
 	}
@@ -532,9 +1028,8 @@ void hashMapKMA_load_shm(HashMapKMA *dest, FILE *file, const char *filename) {
 	
 	/* check for megaMap */
 	if((dest->size - 1) == dest->mask) {
-		hashMap_get = &megaMap_getGlobal;
+		setHashMapGet(1);
 	} else {
-		hashMap_get = &hashMap_getGlobal;
 		/* kmers */
 		size = dest->n + 1;
 		if(dest->mlen <= 16) {
@@ -579,6 +1074,8 @@ void hashMapKMA_load_shm(HashMapKMA *dest, FILE *file, const char *filename) {
 		}
 		dest->value_index_l = (long unsigned *)(dest->value_index);
 		
+		setHashMapGet(0);
+		
 		/* make indexing a masking problem */
 		--dest->size;
 	}
@@ -719,6 +1216,55 @@ int hashMapKMAload(HashMapKMA *dest, FILE *file) {
 	return 0;
 }
 
+int hashMapKMA_loadHead(HashMapKMA *dest, FILE *file) {
+	
+	long unsigned size;
+	
+	/* load sizes */
+	sfread(&dest->DB_size, sizeof(unsigned), 1, file);
+	sfread(&dest->mlen, sizeof(unsigned), 1, file);
+	sfread(&dest->prefix_len, sizeof(unsigned), 1, file);
+	sfread(&dest->prefix, sizeof(long unsigned), 1, file);
+	sfread(&dest->size, sizeof(long unsigned), 1, file);
+	sfread(&dest->n, sizeof(long unsigned), 1, file);
+	sfread(&dest->v_index, sizeof(long unsigned), 1, file);
+	sfread(&dest->null_index, sizeof(long unsigned), 1, file);
+	
+	dest->mask = 0;
+	dest->mask = (~dest->mask) >> (sizeof(long unsigned) * sizeof(long unsigned) - (dest->mlen << 1));
+	dest->shmFlag = 0;
+	dest->exist = 0;
+	dest->exist_l = 0;
+	dest->values = 0;
+	dest->values_s = 0;
+	dest->key_index = 0;
+	dest->key_index_l = 0;
+	dest->value_index = 0;
+	dest->value_index_l = 0;
+	
+	/* skip the arrays, as sized by hashMapKMAload */
+	if((dest->size - 1) == dest->mask) {
+		size = dest->size * (dest->v_index <= UINT_MAX ? sizeof(unsigned) : sizeof(long unsigned));
+	} else {
+		size = dest->size * (dest->n <= UINT_MAX ? sizeof(unsigned) : sizeof(long unsigned));
+		size += (dest->n + 1) * (dest->mlen <= 16 ? sizeof(unsigned) : sizeof(long unsigned));
+		size += dest->n * (dest->v_index < UINT_MAX ? sizeof(unsigned) : sizeof(long unsigned));
+	}
+	size += dest->v_index * (dest->DB_size < USHRT_MAX ? sizeof(short unsigned) : sizeof(unsigned));
+	if(fseeko(file, size, SEEK_CUR)) {
+		return 1;
+	}
+	
+	if(fread(&dest->kmersize, sizeof(unsigned), 1, file)) {
+		sfread(&dest->flag, sizeof(unsigned), 1, file);
+	} else {
+		dest->kmersize = dest->mlen;
+		dest->flag = 0;
+	}
+	
+	return 0;
+}
+
 void hashMapKMA_dump(HashMapKMA *dest, FILE *out) {
 	
 	/* dump sizes */
@@ -811,6 +1357,146 @@ void megaMapKMA_dump(HashMapKMA *dest, FILE *out) {
 	cfwrite(&dest->flag, sizeof(unsigned), 1, out);
 }
 
+void hashMapKMA_dumpValues(HashMapKMA *dest, FILE *out) {
+	
+	unsigned i, n, len, rem, prev, *tmp;
+	long unsigned j;
+	unsigned char *buff;
+	
+	buff = smalloc((SVBCHUNK >> 2) + (SVBCHUNK << 2));
+	tmp = smalloc(SVBCHUNK * sizeof(unsigned));
+	rem = 0;
+	prev = 0;
+	for(j = 0; j < dest->v_index; j += n) {
+		n = (dest->v_index - j < SVBCHUNK) ? dest->v_index - j : SVBCHUNK;
+		for(i = 0; i < n; ++i) {
+			tmp[i] = (dest->DB_size < USHRT_MAX) ? dest->values_s[j + i] : dest->values[j + i];
+		}
+		
+		/* replace template numbers by the distance to the previous one */
+		for(i = 0; i < n; ++i) {
+			if(rem) {
+				tmp[i] -= prev;
+				prev += tmp[i];
+				--rem;
+			} else {
+				rem = tmp[i];
+				prev = 0;
+			}
+		}
+		len = svbEncode(buff, buff + ((n + 3) >> 2), tmp, n);
+		cfwrite(&len, sizeof(unsigned), 1, out);
+		cfwrite(buff, 1, ((n + 3) >> 2) + len, out);
+	}
+	free(buff);
+	free(tmp);
+}
+
+int hashMapKMA_dumpBlocks(HashMapKMA *dest, FILE *out) {
+	
+	unsigned i, slots, magic;
+	long unsigned j, pos, key, value, n_blocks, blockSize;
+	HashBlock *block;
+	HashBlockL *block_l;
+	
+	/* needs a hashed DB, with relative value indexes */
+	if((dest->size - 1) == dest->mask || UINT_MAX <= dest->v_index) {
+		return 1;
+	}
+	
+	/* keep buckets at most 3/4 full */
+	slots = (dest->mlen <= 16) ? HASHBLOCK : HASHBLOCKL;
+	n_blocks = 1;
+	while(((n_blocks * slots * 3) >> 2) <= dest->n) {
+		n_blocks <<= 1;
+	}
+	blockSize = n_blocks * ((slots == HASHBLOCK) ? sizeof(HashBlock) : sizeof(HashBlockL));
+	dest->blocks = smalloc(blockSize);
+	dest->blocks_l = (HashBlockL *)(dest->blocks);
+	memset(dest->blocks, 255, blockSize);
+	
+	/* fill buckets */
+	block = 0;
+	block_l = 0;
+	for(j = 0; j < dest->n; ++j) {
+		key = (dest->mlen <= 16) ? dest->key_index[j] : dest->key_index_l[j];
+		value = dest->value_index[j];
+		murmur(pos, key);
+		pos &= (n_blocks - 1);
+		while(1) {
+			if(slots == HASHBLOCK) {
+				block = dest->blocks + pos;
+				for(i = 0; i < slots && block->value[i] != HASHBLOCKNULL; ++i);
+			} else {
+				block_l = dest->blocks_l + pos;
+				for(i = 0; i < slots && block_l->value[i] != HASHBLOCKNULL; ++i);
+			}
+			if(i < slots) {
+				break;
+			}
+			pos = (pos + 1) & (n_blocks - 1);
+		}
+		if(slots == HASHBLOCK) {
+			block->key[i] = key;
+			block->value[i] = value;
+		} else {
+			block_l->key[i] = key;
+			block_l->value[i] = value;
+		}
+	}
+	
+	/* append */
+	magic = HASHBLOCKMAGIC;
+	sfseek(out, 0, SEEK_END);
+	cfwrite(&magic, sizeof(unsigned), 1, out);
+	cfwrite(&slots, sizeof(unsigned), 1, out);
+	cfwrite(&n_blocks, sizeof(long unsigned), 1, out);
+	cfwrite(dest->blocks, 1, blockSize, out);
+	magic = HASHSVBMAGIC;
+	cfwrite(&magic, sizeof(unsigned), 1, out);
+	hashMapKMA_dumpValues(dest, out);
+	free(dest->blocks);
+	dest->blocks = 0;
+	dest->blocks_l = 0;
+	
+	return 0;
+}
+
+int hashMapKMA_dumpFilter(HashMapKMA *dest, FILE *out) {
+	
+	unsigned i, bit;
+	long unsigned j, h, n_blocks, *block;
+	
+	/* lookups in megaMaps are already a single access */
+	if((dest->size - 1) == dest->mask) {
+		return 1;
+	}
+	
+	n_blocks = 1;
+	while(n_blocks * HASHFILTERWORDS * 64 < dest->n * HASHFILTERBITS) {
+		n_blocks <<= 1;
+	}
+	dest->filter = calloc(n_blocks * HASHFILTERWORDS, sizeof(long unsigned));
+	if(!dest->filter) {
+		ERROR();
+	}
+	for(j = 0; j < dest->n; ++j) {
+		h = filterHash((dest->mlen <= 16) ? dest->key_index[j] : dest->key_index_l[j]);
+		block = dest->filter + ((h & (n_blocks - 1)) * HASHFILTERWORDS);
+		for(i = 28; i < 64; i += 9) {
+			bit = (h >> i) & 511;
+			block[bit >> 6] |= 1UL << (bit & 63);
+		}
+	}
+	
+	cfwrite(&n_blocks, sizeof(long unsigned), 1, out);
+	cfwrite(dest->filter, sizeof(long unsigned), n_blocks * HASHFILTERWORDS, out);
+	free(dest->filter);
+	dest->filter = 0;
+	
+	return 0;
+}
+
 void hashMapKMA_addKey(HashMapKMA *dest, long unsigned index, long unsigned key) {
 	dest->key_index[index] = key;
 }
@@ -839,17 +1525,28 @@ void hashMapKMA_free(HashMapKMA *dest) {
 	
 	if(dest) {
 		if(dest->exist && dest->shmFlag & 1) {
-			free(dest->exist);
+			hashMapKMA_dealloc(dest, dest->exist);
 		}
 		if(dest->values && dest->shmFlag & 2) {
-			free(dest->values);
+			hashMapKMA_dealloc(dest, dest->values);
 		}
 		if(dest->key_index && dest->shmFlag & 4) {
-			free(dest->key_index);
+			hashMapKMA_dealloc(dest, dest->key_index);
 		}
 		if(dest->value_index && dest->shmFlag & 8) {
-			free(dest->value_index);
+			hashMapKMA_dealloc(dest, dest->value_index);
+		}
+		if(dest->blocks && dest->shmFlag & 64) {
+			hashMapKMA_dealloc(dest, dest->blocks);
+		}
+		if(dest->filter && dest->shmFlag & 128) {
+			free(dest->filter);
+		}
+		if(dest->shmFlag & 512) {
+			hashMapKMA_freeDelta(dest->delta);
 		}
 		free(dest);
+		memAcc_sub(MEM_INDEX, hashMapKMA_bytes);
+		hashMapKMA_bytes = 0;
 	}
 }
@@ -23,6 +23,22 @@
 typedef int key_t;
 #endif
 
+#define HASHBLOCK 8
+#define HASHBLOCKL 5
+
+typedef struct hashBlock HashBlock;
+struct hashBlock {
+	unsigned key[HASHBLOCK];
+	unsigned value[HASHBLOCK];
+};
+
+typedef struct hashBlockL HashBlockL;
+struct hashBlockL {
+	long unsigned key[HASHBLOCKL];
+	unsigned value[HASHBLOCKL];
+	unsigned fill;
+};
+
 typedef struct hashMapKMA HashMapKMA;
 struct hashMapKMA {
 	long unsigned size;				// size of DB
@@ -45,8 +61,22 @@ struct hashMapKMA {
 	long unsigned *key_index_l;		// Relative, 16 < k
 	unsigned *value_index;			// Relative
 	long unsigned *value_index_l;	// Relative, big DBs
+	long unsigned block_mask;		// blocks - 1
+	HashBlock *blocks;				// cache blocked keys and values
+	HashBlockL *blocks_l;			// cache blocked keys and values, 16 < k
+	long unsigned filter_mask;		// filter blocks - 1
+	long unsigned *filter;			// cache line blocked k-mer filter
+	struct hashMapKMA *delta;		// k-mers of templates added since
 };
 #define HASHMAPKMA 1
+#define HASHMAPBATCH 16
+#define INTPOSSCAN 32
+#define HASHBLOCKNULL 4294967295U
+#define HASHBLOCKMAGIC 1296387138U
+#define HASHSVBMAGIC 826430035U
+#define SVBCHUNK 4096
+#define HASHFILTERWORDS 8
+#define HASHFILTERBITS 16
 #endif
 
 /* DB size dependent pointers */
@@ -56,6 +86,9 @@ extern long unsigned (*getKeyPtr)(const unsigned *, const long unsigned);
 extern long unsigned (*getValueIndexPtr)(const unsigned *, const long unsigned);
 extern unsigned * (*getValuePtr)(const HashMapKMA *, const long unsigned);
 extern unsigned * (*hashMap_get)(const HashMapKMA *, const long unsigned);
+extern void (*hashMap_getBatch)(const HashMapKMA *, const long unsigned *, int, unsigned **);
+extern unsigned * (*hashMap_getUnfiltered)(const HashMapKMA *, const long unsigned);
+extern void (*hashMap_getBatchUnfiltered)(const HashMapKMA *, const long unsigned *, int, unsigned **);
 extern int (*intpos_bin_contaminationPtr)(const unsigned *, const int);
 extern int (*getSizePtr)(const unsigned *);
 extern void (*hashMapKMA_addKey_ptr)(HashMapKMA *, long unsigned, long unsigned);
@@ -76,13 +109,24 @@ int getSizeS(const unsigned *values);
 int intpos_bin_contamination(const unsigned *str1, const int str2);
 int intpos_bin_contamination_s(const unsigned *Str1, const int str2);
 unsigned * hashMap_getGlobal(const HashMapKMA *templates, const long unsigned key);
+void hashMap_getBatchGlobal(const HashMapKMA *templates, const long unsigned *keys, int n, unsigned **values);
 void loadPrefix(HashMapKMA *dest, FILE *file);
 unsigned * megaMap_getGlobal(const HashMapKMA *templates, const long unsigned key);
+void setHashMapGet(int megaMap);
+unsigned * hashMap_getFilter(const HashMapKMA *templates, const long unsigned key);
+void hashMap_getBatchFilter(const HashMapKMA *templates, const long unsigned *keys, int n, unsigned **values);
+void hashMapKMA_loadFilter(HashMapKMA *dest, FILE *file);
+void hashMapKMA_loadValues(HashMapKMA *dest, FILE *file);
+int hashMapKMA_loadBlocks(HashMapKMA *dest, FILE *file);
 int hashMapKMA_load(HashMapKMA *dest, FILE *file, const char *filename);
 void hashMapKMA_load_shm(HashMapKMA *dest, FILE *file, const char *filename);
 int hashMapKMAload(HashMapKMA *dest, FILE *file);
+int hashMapKMA_loadHead(HashMapKMA *dest, FILE *file);
 void hashMapKMA_dump(HashMapKMA *dest, FILE *out);
 void megaMapKMA_dump(HashMapKMA *dest, FILE *out);
+void hashMapKMA_dumpValues(HashMapKMA *dest, FILE *out);
+int hashMapKMA_dumpBlocks(HashMapKMA *dest, FILE *out);
+int hashMapKMA_dumpFilter(HashMapKMA *dest, FILE *out);
 void hashMapKMA_addKey(HashMapKMA *dest, long unsigned index, long unsigned key);
 void hashMapKMA_addKeyL(HashMapKMA *dest, long unsigned index, long unsigned key);
 void hashMapKMA_addValue(HashMapKMA *dest, long unsigned index, long unsigned v_index);
@@ -119,6 +119,45 @@ void hashMap_kmers_CountIndex(HashMap_kmers *dest, long unsigned key) {
 	dest->table[index] = node;
 }
 
+void hashMap_kmers_merge(HashMap_kmers *dest, HashMap_kmers *src) {
+	
+	long unsigned i, index;
+	HashTable_kmers *node, *node_next, *hit;
+	
+	/* move the counts of src into dest, and empty src */
+	for(i = 0; i <= src->size; ++i) {
+		for(node = src->table[i]; node; node = node_next) {
+			node_next = node->next;
+			if(dest->flag) {
+				murmur(index, node->key);
+				index &= dest->size;
+			} else {
+				index = node->key & dest->size;
+			}
+			for(hit = dest->table[index]; hit && hit->key != node->key; hit = hit->next);
+			if(hit) {
+				hit->value += node->value;
+				free(node);
+			} else {
+				if(dest->n == dest->size) {
+					reallocHashMap_kmers(dest);
+					if(dest->flag) {
+						murmur(index, node->key);
+						index &= dest->size;
+					} else {
+						index = node->key & dest->size;
+					}
+				}
+				++dest->n;
+				node->next = dest->table[index];
+				dest->table[index] = node;
+			}
+		}
+		src->table[i] = 0;
+	}
+	src->n = 0;
+}
+
 int hashMap_CountKmer(HashMap_kmers *dest, long unsigned key) {
 	
 	long unsigned index;
@@ -40,5 +40,6 @@ struct hashMap_kmers {
 void hashMap_kmers_initialize(HashMap_kmers *dest, long unsigned newSize);
 void reallocHashMap_kmers(HashMap_kmers *dest);
 void hashMap_kmers_CountIndex(HashMap_kmers *dest, long unsigned key);
+void hashMap_kmers_merge(HashMap_kmers *dest, HashMap_kmers *src);
 int hashMap_CountKmer(HashMap_kmers *dest, long unsigned key);
 void emptyHash(HashMap_kmers *dest);
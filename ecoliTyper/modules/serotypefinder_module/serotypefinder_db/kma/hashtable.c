@@ -45,108 +45,152 @@ int intpos_bin(const unsigned *str1, const int str2) {
 		}
 		pos = (upLim + downLim) >> 1;
 	}
-	if(str1[pos] == str2) {
+	if(pos && str1[pos] == str2) {
 		return pos;
 	}
 	return -1;
 }
 
-HashTable * collect_Kmers(const HashMapKMA *templates, unsigned *Scores, long unsigned *Scores_tot, HashMap_kmers *foundKmers, Hit *hits) {
+static KmerList * kmerList_init(long unsigned size) {
 	
-	int template, SU;
-	long unsigned i;
-	unsigned j, *value;
-	short unsigned *values_s;
-	HashTable_kmers *node, *node_next;
-	HashTable *kmerNode, *kmerList;
+	KmerList *dest;
+	
+	dest = smalloc(sizeof(KmerList));
+	dest->n = 0;
+	dest->size = size;
+	dest->v_size = size << 1;
+	dest->counts = smalloc(size * sizeof(long unsigned));
+	dest->offsets = smalloc((size + 1) * sizeof(long unsigned));
+	*dest->offsets = 0;
+	dest->values = smalloc(dest->v_size * sizeof(unsigned));
+	dest->t_offsets = 0;
+	dest->kmers = 0;
 	
-	if(templates->DB_size < USHRT_MAX) {
-		SU = 1;
+	return dest;
+}
+
+static unsigned * kmerList_push(KmerList *dest, long unsigned count, const unsigned *value, int SU) {
+	
+	unsigned i, n, *values;
+	long unsigned end;
+	const short unsigned *value_s;
+	
+	n = SU ? *((const short unsigned *) value) : *value;
+	end = dest->offsets[dest->n];
+	if(dest->size == dest->n) {
+		dest->size <<= 1;
+		dest->counts = realloc(dest->counts, dest->size * sizeof(long unsigned));
+		dest->offsets = realloc(dest->offsets, (dest->size + 1) * sizeof(long unsigned));
+		if(!dest->counts || !dest->offsets) {
+			ERROR();
+		}
+	}
+	if(dest->v_size < end + n) {
+		dest->v_size = (end + n) << 1;
+		dest->values = realloc(dest->values, dest->v_size * sizeof(unsigned));
+		if(!dest->values) {
+			ERROR();
+		}
+	}
+	
+	values = dest->values + end;
+	if(SU) {
+		value_s = (const short unsigned *) value;
+		for(i = 1; i <= n; ++i) {
+			values[i - 1] = value_s[i];
+		}
 	} else {
-		SU = 0;
+		for(i = 1; i <= n; ++i) {
+			values[i - 1] = value[i];
+		}
+	}
+	dest->counts[dest->n] = count;
+	dest->offsets[++dest->n] = end + n;
+	
+	return values;
+}
+
+static void kmerList_index(KmerList *dest, unsigned DB_size) {
+	
+	unsigned *values, *end;
+	long unsigned i, *t_offsets;
+	
+	/* invert the value lists by counting sort on the templates,
+	   contamination included */
+	++DB_size;
+	t_offsets = calloc(DB_size + 1, sizeof(long unsigned));
+	if(!t_offsets) {
+		ERROR();
+	}
+	dest->t_offsets = t_offsets;
+	dest->kmers = smalloc((dest->offsets[dest->n] + 1) * sizeof(unsigned));
+	for(values = dest->values, end = values + dest->offsets[dest->n]; values < end; ++values) {
+		++t_offsets[*values + 1];
+	}
+	for(i = 1; i <= DB_size; ++i) {
+		t_offsets[i] += t_offsets[i - 1];
 	}
+	for(i = 0; i < dest->n; ++i) {
+		end = dest->values + dest->offsets[i + 1];
+		for(values = dest->values + dest->offsets[i]; values < end; ++values) {
+			dest->kmers[t_offsets[*values]++] = i;
+		}
+	}
+	for(i = DB_size; i; --i) {
+		t_offsets[i] = t_offsets[i - 1];
+	}
+	*t_offsets = 0;
+}
+
+KmerList * collect_Kmers(const HashMapKMA *templates, unsigned *Scores, long unsigned *Scores_tot, HashMap_kmers *foundKmers, Hit *hits) {
+	
+	int SU;
+	long unsigned i;
+	unsigned *value, *values, *end;
+	HashTable_kmers *node, *node_next;
+	KmerList *kmerList;
 	
+	SU = templates->DB_size < USHRT_MAX;
 	hits->n = 0;
 	hits->tot = 0;
-	
-	kmerList = 0;
-	kmerNode = 0;
+	kmerList = kmerList_init(foundKmers->n + 1);
 	
 	for(i = 0; i <= foundKmers->size; ++i) {
 		for(node = foundKmers->table[i]; node != 0; node = node_next) {
 			node_next = node->next;
-			value = hashMap_get(templates, node->key);
-			if(value) {
+			if((value = hashMap_get(templates, node->key))) {
 				++hits->n;
 				hits->tot += node->value;
 				
-				kmerNode = malloc(sizeof(HashTable));
-				if(!kmerNode) {
-					ERROR();
-				}
-				if(SU) {
-					values_s = (short unsigned *) value;
-					kmerNode->value = smalloc(((*values_s) + 1) * sizeof(unsigned));
-					*(kmerNode->value) = *values_s;
-					j = *values_s + 1;
-					while(--j) {
-						template = values_s[j];
-						kmerNode->value[j] = template;
-						Scores[template]++;
-						Scores_tot[template] += node->value;
-					}
-				} else {
-					kmerNode->value = smalloc(((*value) + 1) * sizeof(unsigned));
-					*(kmerNode->value) = *value;
-					j = *value + 1;
-					while(--j) {
-						template = value[j];
-						kmerNode->value[j] = template;
-						Scores[template]++;
-						Scores_tot[template] += node->value;
-					}
+				values = kmerList_push(kmerList, node->value, value, SU);
+				end = kmerList->values + kmerList->offsets[kmerList->n];
+				while(values < end) {
+					Scores[*values]++;
+					Scores_tot[*values++] += node->value;
 				}
-				kmerNode->key = node->value;
-				
-				kmerNode->next = kmerList;
-				kmerList = kmerNode;
 			}
 			free(node);
 		}
 	}
 	free(foundKmers->table);
+	kmerList_index(kmerList, templates->DB_size);
 	
 	return kmerList;
 }
 
-HashTable ** collect_Kmers_deCon(const HashMapKMA *templates, unsigned *Scores, long unsigned *Scores_tot, HashMap_kmers *foundKmers, Hit *hits, int contamination) {
+KmerList * collect_Kmers_deCon(const HashMapKMA *templates, unsigned *Scores, long unsigned *Scores_tot, HashMap_kmers *foundKmers, Hit *hits, int contamination, KmerList **deConList) {
 	
-	int template, SU;
+	int SU;
 	long unsigned i;
-	unsigned j, n, *value;
-	short unsigned *value_s;
+	unsigned j, *value, *values, *end;
 	HashTable_kmers *node, *node_next;
-	HashTable *kmerNode, *kmerList;
-	HashTable *decon_node, *deconList;
-	HashTable **Returner;
-	
-	if(templates->DB_size < USHRT_MAX) {
-		SU = 1;
-	} else {
-		SU = 0;
-	}
-	value_s = 0;
+	KmerList *kmerList, *deconList;
 	
+	SU = templates->DB_size < USHRT_MAX;
 	hits->n = 0;
 	hits->tot = 0;
-	
-	kmerList = 0;
-	kmerNode = 0;
-	
-	deconList = 0;
-	decon_node = 0;
-	
-	Returner = smalloc(sizeof(HashTable *) << 1);
+	kmerList = kmerList_init(foundKmers->n + 1);
+	deconList = kmerList_init(1024);
 	
 	for(i = 0; i <= foundKmers->size; ++i) {
 		for(node = foundKmers->table[i]; node != 0; node = node_next) {
@@ -157,174 +201,71 @@ HashTable ** collect_Kmers_deCon(const HashMapKMA *templates, unsigned *Scores,
 				hits->tot += node->value;
 				
 				if(SU) {
-					value_s = (short unsigned *) value;
-					n = *value_s;
-					j = value_s[*value_s];
+					j = ((short unsigned *) value)[*((short unsigned *) value)];
 				} else {
-					n = *value;
 					j = value[*value];
 				}
 				
 				if(j == contamination) {
-					decon_node = smalloc(sizeof(HashTable));
-					decon_node->value = smalloc((n + 1) * sizeof(unsigned));
-					decon_node->value[0] = n;
-					j = n + 1;
-					if(SU) {
-						while(--j) {
-							decon_node->value[j] = value_s[j];
-						}
-					} else {
-						while(--j) {
-							decon_node->value[j] = value[j];
-						}
-					}
-					decon_node->key = node->value;
-					
-					decon_node->next = deconList;
-					deconList = decon_node;
+					kmerList_push(deconList, node->value, value, SU);
 				} else {
-					kmerNode = smalloc(sizeof(HashTable));
-					kmerNode->value = smalloc((n + 1) * sizeof(unsigned));
-					kmerNode->value[0] = n;
-					j = n + 1;
-					if(SU) {
-						while(--j) {
-							template = value_s[j];
-							kmerNode->value[j] = template;
-							Scores[template]++;
-							Scores_tot[template] += node->value;
-						}
-					} else {
-						while(--j) {
-							template = value[j];
-							kmerNode->value[j] = template;
-							Scores[template]++;
-							Scores_tot[template] += node->value;
-						}
+					values = kmerList_push(kmerList, node->value, value, SU);
+					end = kmerList->values + kmerList->offsets[kmerList->n];
+					while(values < end) {
+						Scores[*values]++;
+						Scores_tot[*values++] += node->value;
 					}
-					
-					kmerNode->key = node->value;
-					
-					kmerNode->next = kmerList;
-					kmerList = kmerNode;
 				}
 			}
 			free(node);
 		}
 	}
 	free(foundKmers->table);
+	kmerList_index(kmerList, templates->DB_size);
+	kmerList_index(deconList, templates->DB_size);
+	*deConList = deconList;
 	
-	Returner[0] = kmerList;
-	Returner[1] = deconList;
-	
-	return Returner;
+	return kmerList;
 }
 
-HashTable * withDraw_Kmers(unsigned *Scores, long unsigned *Scores_tot, HashTable *kmerList, int template, Hit *hits) {
+Hit withDraw_Kmers(unsigned *Scores, long unsigned *Scores_tot, KmerList *kmerList, int template) {
 	
-	unsigned i;
-	HashTable *node, *prev;
-	prev = 0;
+	long unsigned count;
+	unsigned *kmer, *kmer_end, *values, *end;
+	Hit withdrawn;
 	
-	if(kmerList == 0) {
-		return 0;
-	}
-	
-	node = kmerList;
-	while(node != 0) {
-		if(intpos_bin(node->value, template) != -1) {
-			--hits->n;
-			hits->tot -= node->key;
-			for(i = 1; i <= node->value[0]; ++i) {
-				Scores[node->value[i]]--;
-				Scores_tot[node->value[i]] -= node->key;
-			}
-			if(prev == 0) {
-				kmerList = node->next;
-				free(node->value);
-				free(node);
-				node = kmerList;
-			} else {
-				prev->next = node->next;
-				free(node->value);
-				free(node);
-				node = prev->next;
-			}
-			/* early stopping */
-			if(Scores[template] == 0 && Scores_tot[template] == 0) {
-				return kmerList;
+	/* withdraw the k-mers of template, with their scores when given */
+	withdrawn.n = 0;
+	withdrawn.tot = 0;
+	kmer = kmerList->kmers + kmerList->t_offsets[template];
+	kmer_end = kmerList->kmers + kmerList->t_offsets[template + 1];
+	while(kmer < kmer_end) {
+		if((count = kmerList->counts[*kmer])) {
+			++withdrawn.n;
+			withdrawn.tot += count;
+			if(Scores) {
+				values = kmerList->values + kmerList->offsets[*kmer];
+				end = kmerList->values + kmerList->offsets[*kmer + 1];
+				while(values < end) {
+					Scores[*values]--;
+					Scores_tot[*values++] -= count;
+				}
 			}
-			
-		} else {
-			prev = node;
-			node = node->next;
+			kmerList->counts[*kmer] = 0;
+			--kmerList->n;
 		}
+		++kmer;
 	}
 	
-	if(prev != 0) {
-		prev->next = 0;
-	}
-	
-	return kmerList;
+	return withdrawn;
 }
 
-Hit withDraw_Contamination(unsigned *Scores, long unsigned *Scores_tot, HashTable *kmerList, HashTable *deConTable, int template, Hit hits) {
+void kmerList_destroy(KmerList *src) {
 	
-	unsigned i, belong;
-	HashTable *node, *prev;
-	HashTable *cont_node, *cont_prev;
-	if(kmerList != 0) {
-		prev = 0;
-		node = kmerList;
-		cont_prev = 0;
-		cont_node = deConTable;
-		while(node != 0) {
-			/* check if k-mer belongs to template */
-			belong = 0;
-			for(i = node->value[0]; i != 0 && !belong; --i) {
-				if(node->value[i] == template) {
-					belong = 1;
-				}
-			}
-			if(belong) { //withdraw score
-				--hits.n;
-				hits.tot -= node->key;
-				for(i = node->value[0]; i != 0; --i) {
-					Scores[node->value[i]]--;
-					Scores_tot[node->value[i]] -= node->key;
-				}
-				cont_node->value = node->value;
-				cont_node->key = node->key;
-				cont_node->next = smalloc(sizeof(HashTable));
-				cont_prev = cont_node;
-				cont_node = cont_node->next;
-				
-				/* delete node */
-				if(prev == 0) {
-					kmerList = node->next;
-					free(node);
-					node = kmerList;
-				} else {
-					prev->next = node->next;
-					free(node);
-					node = prev->next;
-				}
-			} else {
-				prev = node;
-				node = node->next;
-			}
-		}
-		if(cont_prev != 0) {
-			free(cont_prev->next);
-			cont_prev->next = 0;
-		} else {
-			free(deConTable);
-			deConTable = 0;
-		}
-	} else {
-		free(deConTable);
-		deConTable = 0;
-	}
-	return hits;
+	free(src->counts);
+	free(src->offsets);
+	free(src->values);
+	free(src->t_offsets);
+	free(src->kmers);
+	free(src);
 }
@@ -34,11 +34,30 @@ struct hit {
 	long unsigned n;
 	long unsigned tot;
 };
+
+/*
+ The k-mers found in the query, in flat arrays: the templates of k-mer i
+ are values[offsets[i]] to values[offsets[i + 1]], and the k-mers of
+ template t are kmers[t_offsets[t]] to kmers[t_offsets[t + 1]], so a
+ template is withdrawn by walking its own k-mers. Withdrawn k-mers get a
+ count of zero.
+*/
+typedef struct kmerList KmerList;
+struct kmerList {
+	long unsigned n;
+	long unsigned size;
+	long unsigned v_size;
+	long unsigned *counts;
+	long unsigned *offsets;
+	unsigned *values;
+	long unsigned *t_offsets;
+	unsigned *kmers;
+};
 #define HASHTABLE 1
 #endif
 
 int intpos_bin(const unsigned *str1, const int str2);
-HashTable * collect_Kmers(const HashMapKMA *templates, unsigned *Scores, long unsigned *Scores_tot, HashMap_kmers *foundKmers, Hit *hits);
-HashTable ** collect_Kmers_deCon(const HashMapKMA *templates, unsigned *Scores, long unsigned *Scores_tot, HashMap_kmers *foundKmers, Hit *hits, int contamination);
-HashTable * withDraw_Kmers(unsigned *Scores, long unsigned *Scores_tot, HashTable *kmerList, int template, Hit *hits);
-Hit withDraw_Contamination(unsigned *Scores, long unsigned *Scores_tot, HashTable *kmerList, HashTable *deConTable, int template, Hit hits);
+KmerList * collect_Kmers(const HashMapKMA *templates, unsigned *Scores, long unsigned *Scores_tot, HashMap_kmers *foundKmers, Hit *hits);
+KmerList * collect_Kmers_deCon(const HashMapKMA *templates, unsigned *Scores, long unsigned *Scores_tot, HashMap_kmers *foundKmers, Hit *hits, int contamination, KmerList **deConList);
+Hit withDraw_Kmers(unsigned *Scores, long unsigned *Scores_tot, KmerList *kmerList, int template);
+void kmerList_destroy(KmerList *src);
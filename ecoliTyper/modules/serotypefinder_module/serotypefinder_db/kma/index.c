@@ -18,6 +18,7 @@
 */
 #define _XOPEN_SOURCE 600
 #include <ctype.h>
+#include <errno.h>
 #include <limits.h>
 #include <math.h>
 #include <stdio.h>
@@ -25,16 +26,23 @@
 #include <string.h>
 #include <time.h>
 #include "compress.h"
+#include "dbmap.h"
 #include "decon.h"
+#include "delta.h"
 #include "hashmap.h"
 #include "hashmapkma.h"
 #include "index.h"
 #include "loadupdate.h"
 #include "makeindex.h"
+#include "nspace.h"
+#include "order.h"
 #include "pherror.h"
 #include "qualcheck.h"
+#include "radix.h"
+#include "sketch.h"
 #include "stdnuc.h"
 #include "stdstat.h"
+#include "tmp.h"
 #include "updateindex.h"
 #include "valueshash.h"
 #include "version.h"
@@ -64,6 +72,17 @@ static void helpMessage(int exeStatus) {
 	fprintf(helpOut, "#\t-CS\t\tStart Chain size\t\t\t1 M\n");
 	fprintf(helpOut, "#\t-ME\t\tMega DB\t\t\t\t\tFalse\n");
 	fprintf(helpOut, "#\t-NI\t\tDo not dump *.index.b\t\t\tFalse\n");
+	fprintf(helpOut, "#\t-t\t\tNumber of threads\t\t\t1\n");
+	fprintf(helpOut, "#\t-radix\t\tBuild from sorted k-mer pairs\t\tFalse\n");
+	fprintf(helpOut, "#\t-mem\t\tMemory for k-mer pairs (MB), -radix\tFalse\n");
+	fprintf(helpOut, "#\t-tmp\t\tSet directory for temporary files\n");
+	fprintf(helpOut, "#\t-blocked\tAdd cache blocked k-mer layout\t\tFalse\n");
+	fprintf(helpOut, "#\t-filter\t\tAdd k-mer filter in front of lookups\tFalse\n");
+	fprintf(helpOut, "#\t-sketch\t\tAdd bottom-k sketches, for kma screen\tFalse/%d\n", SKETCHSIZE);
+	fprintf(helpOut, "#\t-delta\t\tAdd templates to a delta of -t_db\tFalse\n");
+	fprintf(helpOut, "#\t-compact\tFold the delta of -t_db into it\tFalse\n");
+	fprintf(helpOut, "#\t-ns\t\tTag templates by input file\t\tFalse\n");
+	fprintf(helpOut, "#\t-order\t\tNumber similar templates together\tFalse/%.1f\n", ORDERSHARED);
 	fprintf(helpOut, "#\t-Sparse\t\tMake Sparse DB ('-' for no prefix)\tNone/False\n");
 	fprintf(helpOut, "#\t-ht\t\tHomology template\t\t\t1.0\n");
 	fprintf(helpOut, "#\t-hq\t\tHomology query\t\t\t\t1.0\n");
@@ -78,18 +97,20 @@ static void helpMessage(int exeStatus) {
 int index_main(int argc, char *argv[]) {
 	
 	int i, args, stop, filecount, deconcount, sparse_run, size, mapped_cont;
-	int file_len, appender, prefix_len, MinLen, MinKlen;
-	unsigned kmersize, mlen, flag, kmerindex, megaDB, **Values;
+	int file_len, appender, prefix_len, MinLen, MinKlen, thread_num, part_bits;
+	unsigned kmersize, mlen, flag, kmerindex, megaDB, blocked, filter, radix, **Values;
+	unsigned delta_run, compact, sketch;
 	unsigned *template_lengths, *template_slengths, *template_ulengths;
-	long unsigned initialSize, prefix, mask;
-	double homQ, homT;
+	long unsigned initialSize, deltaSize, prefix, mask, mem;
+	double homQ, homT, order;
 	char **inputfiles, *outputfilename, *templatefilename, **deconfiles;
-	char *to2Bit, *line, *exeBasic;
+	char *to2Bit, *line, *exeBasic, *orderfilename;
 	unsigned char *update;
 	FILE *inputfile, *out;
 	time_t t0, t1;
 	HashMap *templates;
-	HashMapKMA *finalDB;
+	HashMapKMA *finalDB, *delta;
+	KmerPairs *pairs;
 	
 	if(argc == 1) {
 		fprintf(stderr, "# Too few arguments handed.\n");
@@ -122,6 +143,17 @@ int index_main(int argc, char *argv[]) {
 	outputfilename = 0;
 	templatefilename = 0;
 	megaDB = 0;
+	thread_num = 1;
+	radix = 0;
+	mem = 0;
+	blocked = 0;
+	filter = 0;
+	sketch = 0;
+	delta_run = 0;
+	compact = 0;
+	delta = 0;
+	order = 0;
+	orderfilename = 0;
 	inputfiles = smalloc(sizeof(char*));
 	deconfiles = smalloc(sizeof(char*));
 	to2Bit = smalloc(384);
@@ -474,8 +506,76 @@ int index_main(int argc, char *argv[]) {
 			}
 		} else if(strcmp(argv[args], "-ME") == 0) {
 			megaDB = 1;
+		} else if(strcmp(argv[args], "-radix") == 0) {
+			radix = 1;
+		} else if(strcmp(argv[args], "-mem") == 0) {
+			++args;
+			if(args < argc) {
+				mem = strtoul(argv[args], &exeBasic, 10);
+				if(*exeBasic != 0 || mem == 0) {
+					fprintf(stderr, "Invalid argument at \"-mem\".\n");
+					exit(1);
+				}
+				mem <<= 20;
+				radix = 1;
+			}
+		} else if(strcmp(argv[args], "-tmp") == 0) {
+			if(++args < argc) {
+				if(argv[args][0] != '-') {
+					if(argv[args][strlen(argv[args]) - 1] != '/') {
+						fprintf(stderr, "Invalid output directory specified.\n");
+						exit(1);
+					}
+					tmpF(argv[args]);
+				} else {
+					--args;
+				}
+			}
+		} else if(strcmp(argv[args], "-t") == 0) {
+			++args;
+			if(args < argc && argv[args][0] != '-') {
+				thread_num = strtoul(argv[args], &exeBasic, 10);
+				if(*exeBasic != 0 || thread_num < 1) {
+					fprintf(stderr, "Invalid number of threads specified.\n");
+					exit(1);
+				}
+			} else {
+				--args;
+			}
 		} else if(strcmp(argv[args], "-NI") == 0) {
 			
+		} else if(strcmp(argv[args], "-blocked") == 0) {
+			blocked = 1;
+		} else if(strcmp(argv[args], "-filter") == 0) {
+			filter = 1;
+		} else if(strcmp(argv[args], "-sketch") == 0) {
+			if(++args < argc && argv[args][0] != '-') {
+				sketch = strtoul(argv[args], &exeBasic, 10);
+				if(*exeBasic != 0 || sketch == 0) {
+					fprintf(stderr, "Invalid argument at \"-sketch\".\n");
+					exit(1);
+				}
+			} else {
+				sketch = SKETCHSIZE;
+				--args;
+			}
+		} else if(strcmp(argv[args], "-delta") == 0) {
+			delta_run = 1;
+		} else if(strcmp(argv[args], "-compact") == 0) {
+			compact = 1;
+		} else if(strcmp(argv[args], "-ns") == 0) {
+			nsPrintPtr = &nsPrint;
+		} else if(strcmp(argv[args], "-order") == 0) {
+			if(++args < argc && argv[args][0] != '-') {
+				order = strtod(argv[args], &exeBasic);
+				if(*exeBasic != 0 || order <= 0 || 1 < order) {
+					fprintf(stderr, "Invalid argument at \"-order\".\n");
+					exit(1);
+				}
+			} else {
+				order = ORDERSHARED;
+				--args;
+			}
 		} else if(strcmp(argv[args], "-nbp") == 0) {
 			biasPrintPtr = &biasNoPrint;
 		} else if(strcmp(argv[args], "-v") == 0) {
@@ -492,9 +592,18 @@ int index_main(int argc, char *argv[]) {
 	}
 	
 	/* check for sufficient input */
-	if(filecount == 0 && deconcount == 0) {
+	if(filecount == 0 && deconcount == 0 && !(compact && templatefilename)) {
 		fprintf(stderr, "No inputfiles defined.\n");
 		helpMessage(-1);
+	} else if((delta_run || compact) && templatefilename == 0) {
+		fprintf(stderr, "Deltas are kept on an existing DB, use -t_db.\n");
+		exit(1);
+	} else if(delta_run && (compact || deconcount)) {
+		fprintf(stderr, "-delta cannot be combined with -compact or -deCon.\n");
+		exit(1);
+	} else if(order && (templatefilename || nsPrintPtr == &nsPrint)) {
+		fprintf(stderr, "-order needs a new DB, and cannot be combined with -ns.\n");
+		exit(1);
 	} else if(filecount == 0 && deconcount != 0 && templatefilename == 0) {
 		fprintf(stderr, "Nothing to update.\n");
 		exit(0);
@@ -527,6 +636,7 @@ int index_main(int argc, char *argv[]) {
 	setCmerPointers(flag);
 	
 	/* load DB */
+	deltaSize = initialSize < (mask >> 1) ? initialSize : 1048576;
 	if(templatefilename != 0) {
 		/* load */
 		fprintf(stderr, "# Loading database: %s\n", outputfilename);
@@ -544,16 +654,50 @@ int index_main(int argc, char *argv[]) {
 		} else {
 			sparse_run = 1;
 		}
+		
+		/* load delta of templates added since */
+		i = strlen(templatefilename);
+		strcat(templatefilename, ".delta.b");
+		if((out = fopen(templatefilename, "rb"))) {
+			if(!(delta = hashMapKMA_loadDelta(out))) {
+				fprintf(stderr, "Wrong format of delta\n");
+				exit(1);
+			}
+			fclose(out);
+		} else {
+			errno = 0;
+		}
+		templatefilename[i] = 0;
+		if(delta_run && sparse_run) {
+			fprintf(stderr, "Deltas need a DB without prefix.\n");
+			exit(1);
+		}
 		if(finalDB->mask == finalDB->size) {
 			megaDB = 1;
 			initialSize = finalDB->mask + 1;
 		} else if(megaDB == 0) {
 			initialSize = finalDB->size + 1;
 		}
+		if(delta_run) {
+			megaDB = 0;
+			initialSize = deltaSize;
+		}
 		appender = 1;
 	} else {
 		finalDB = 0;
 		appender = 0;
+		
+		/* a new DB starts without namespaces */
+		strcat(outputfilename, ".ns");
+		if(remove(outputfilename)) {
+			errno = 0;
+		}
+		outputfilename[file_len] = 0;
+		strcat(outputfilename, ".order");
+		if(remove(outputfilename)) {
+			errno = 0;
+		}
+		outputfilename[file_len] = 0;
 	}
 	
 	/* function pointers */
@@ -613,8 +757,12 @@ int index_main(int argc, char *argv[]) {
 	}
 	
 	/* update DBs */
-	if(filecount != 0) {
-		if(finalDB) {
+	if(filecount != 0 || (compact && finalDB)) {
+		if(finalDB && (delta_run || delta)) {
+			/* index new templates alone, and join them with the DB after */
+			templates = hashMap_initialize(initialSize, finalDB->kmersize, finalDB->mlen, finalDB->flag);
+			templates->DB_size = delta ? delta->DB_size : finalDB->DB_size;
+		} else if(finalDB) {
 			/* convert */
 			templates = hashMapKMA_openChains(finalDB);
 		} else {
@@ -635,15 +783,57 @@ int index_main(int argc, char *argv[]) {
 				*template_lengths = 1024;
 			}
 		}
+		if(radix && !finalDB && !sparse_run && !megaDB) {
+			pairs = kmerPairs_init(1048576, mlen, flag);
+			if(mem) {
+				/* partitions follow the low bucket bits */
+				for(part_bits = 0; part_bits < 8 && (2UL << part_bits) <= initialSize; ++part_bits);
+				kmerPairs_budget(pairs, mem, part_bits);
+			}
+		} else {
+			if(radix) {
+				fprintf(stderr, "# Radix build needs a new hashed DB, using the hash map.\n");
+			}
+			pairs = 0;
+		}
+		if(order && filecount) {
+			/* index the templates from a copy in cluster order */
+			fprintf(stderr, "# Ordering templates.\n");
+			orderTemplates(inputfiles, filecount, outputfilename, to2Bit, kmersize, order);
+			orderfilename = smalloc(file_len + 16);
+			sprintf(orderfilename, "%s.order.fsa", outputfilename);
+			inputfiles = &orderfilename;
+			filecount = 1;
+		}
 		fprintf(stderr, "# Indexing databases.\n");
 		t0 = clock();
-		makeDB(templates, kmerindex, inputfiles, filecount, outputfilename, appender, to2Bit, MinLen, MinKlen, homQ, homT, &template_lengths, &template_ulengths, &template_slengths);
+		if(filecount) {
+			makeDB(templates, kmerindex, inputfiles, filecount, outputfilename, appender, to2Bit, MinLen, MinKlen, homQ, homT, &template_lengths, &template_ulengths, &template_slengths, thread_num, pairs);
+		}
 		t1 = clock();
 		fprintf(stderr, "#\n# Total time used for DB indexing: %.2f s.\n#\n", difftime(t1, t0) / 1000000);
+		if(orderfilename) {
+			remove(orderfilename);
+			free(orderfilename);
+			orderfilename = 0;
+		}
 		free(template_lengths);
 		free(template_slengths);
 		free(template_ulengths);
 		
+		/* join with the existing DB and delta */
+		if(finalDB && (delta_run || delta)) {
+			if(delta_run && !hashMap_deltaFits(templates, finalDB, delta)) {
+				fprintf(stderr, "# Delta does not fit beside the DB, folding it in.\n");
+				delta_run = 0;
+			}
+			fprintf(stderr, delta_run ? "# Joining templates with the DB.\n" : "# Folding delta into the DB.\n");
+			hashMap_addBase(templates, finalDB, delta, !delta_run);
+			hashMapKMA_freeDelta(delta);
+			hashMapKMA_free(finalDB);
+			delta = 0;
+		}
+		
 		/* compress db */
 		fprintf(stderr, "# Compressing templates\n");
 		t0 = clock();
@@ -656,9 +846,13 @@ int index_main(int argc, char *argv[]) {
 			cmpValuesPtr = &cmpValues;
 			valuesSize = &uSize;
 		}
-		strcat(outputfilename, ".comp.b");
+		strcat(outputfilename, delta_run ? ".delta.b" : ".comp.b");
 		out = sfopen(outputfilename, "wb+");
-		if(templates->table != 0) {
+		if(pairs) {
+			fprintf(stderr, "# Sorting k-mer pairs.\n");
+			kmerPairs_sort(pairs, thread_num);
+			finalDB = compressKMA_radix(templates, pairs, out);
+		} else if(templates->table != 0) {
 			finalDB = compressKMA_DB(templates, out);
 		} else {
 			finalDB = compressKMA_megaDB(templates, out);
@@ -666,6 +860,20 @@ int index_main(int argc, char *argv[]) {
 		fclose(out);
 		outputfilename[file_len] = 0;
 		free(templates);
+		if(delta_run) {
+			/* keep the DB beside the delta */
+			strcat(templatefilename, ".comp.b");
+			strcat(outputfilename, ".comp.b");
+			CP(templatefilename, outputfilename);
+			templatefilename[strlen(templatefilename) - 7] = 0;
+		} else {
+			/* a delta beside the new DB would be stale */
+			strcat(outputfilename, ".delta.b");
+			if(remove(outputfilename)) {
+				errno = 0;
+			}
+		}
+		outputfilename[file_len] = 0;
 		fprintf(stderr, "# Template database created.\n");
 		t1 = clock();
 		fprintf(stderr, "#\n# Total time used for DB compression: %.2f s.\n#\n", difftime(t1, t0) / 1000000);
@@ -693,7 +901,7 @@ int index_main(int argc, char *argv[]) {
 		/* get decontamination info */
 		fprintf(stderr, "# Adding decontamination information\n");
 		t0 = clock();
-		mapped_cont = deConDB(finalDB, deconfiles, deconcount, to2Bit, Values);
+		mapped_cont = deConDB(finalDB, deconfiles, deconcount, to2Bit, Values, thread_num);
 		fprintf(stderr, "# Contamination information added.\n");
 		fprintf(stderr, "# %d kmers mapped to the DB.\n", mapped_cont);
 		fprintf(stderr, "# Contamination mapped to %f %% of the DB.\n", 100.0 * mapped_cont / finalDB->n);
@@ -731,5 +939,58 @@ int index_main(int argc, char *argv[]) {
 		outputfilename[file_len] = 0;
 	}
 	
+	/* add cache blocked layout */
+	if(blocked) {
+		for(i = 0; i <= (deconcount != 0); ++i) {
+			strcat(outputfilename, i ? ".decon.comp.b" : ".comp.b");
+			out = sfopen(outputfilename, "rb+");
+			finalDB = smalloc(sizeof(HashMapKMA));
+			if(hashMapKMAload(finalDB, out)) {
+				fprintf(stderr, "Wrong format of DB\n");
+				exit(1);
+			} else if(hashMapKMA_dumpBlocks(finalDB, out)) {
+				fprintf(stderr, "# Cache blocked layout needs a hashed DB, skipping %s\n", outputfilename);
+			}
+			fclose(out);
+			hashMapKMA_free(finalDB);
+			outputfilename[file_len] = 0;
+		}
+	}
+	
+	/* add k-mer filter */
+	if(filter) {
+		for(i = 0; i <= (deconcount != 0); ++i) {
+			strcat(outputfilename, i ? ".decon.comp.b" : ".comp.b");
+			out = sfopen(outputfilename, "rb");
+			finalDB = smalloc(sizeof(HashMapKMA));
+			if(hashMapKMAload(finalDB, out)) {
+				fprintf(stderr, "Wrong format of DB\n");
+				exit(1);
+			}
+			fclose(out);
+			outputfilename[file_len] = 0;
+			strcat(outputfilename, i ? ".decon.filter.b" : ".filter.b");
+			out = sfopen(outputfilename, "wb");
+			if(hashMapKMA_dumpFilter(finalDB, out)) {
+				fprintf(stderr, "# K-mer filter needs a hashed DB, skipping %s\n", outputfilename);
+				fclose(out);
+				remove(outputfilename);
+			} else {
+				fclose(out);
+			}
+			hashMapKMA_free(finalDB);
+			outputfilename[file_len] = 0;
+		}
+	}
+	
+	/* add sketches */
+	if(sketch) {
+		fprintf(stderr, "# Sketching templates.\n");
+		sketch_dump(outputfilename, kmersize, sketch);
+	}
+	
+	/* add name offsets */
+	dbIndexNames(outputfilename);
+	
 	return 0;
 }
@@ -17,6 +17,7 @@
  * limitations under the License.
 */
 #define _XOPEN_SOURCE 600
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -24,23 +25,43 @@
 #include "ankers.h"
 #include "align.h"
 #include "alnfrags.h"
+#include "aout.h"
+#include "aread.h"
 #include "assembly.h"
 #include "chain.h"
 #include "conclave.h"
+#include "filebuff.h"
+#include "fuzzymatch.h"
 #include "hashmapkma.h"
 #include "kma.h"
+#include "kmacache.h"
+#include "kmacpu.h"
+#include "kmactx.h"
 #include "kmapipe.h"
+#include "kmaprof.h"
+#include "kmastat.h"
+#include "kmatrace.h"
+#include "kmatune.h"
 #include "kmeranker.h"
 #include "kmers.h"
 #include "kmmap.h"
 #include "mt1.h"
+#include "nspace.h"
+#include "numa.h"
+#include "nw.h"
+#include "pack.h"
 #include "penalties.h"
 #include "pherror.h"
 #include "qc.h"
+#include "qpack.h"
 #include "qseqs.h"
 #include "runinput.h"
 #include "runkma.h"
+#include "sam.h"
 #include "savekmers.h"
+#include "seqparse.h"
+#include "seqscan.h"
+#include "smat.h"
 #include "sparse.h"
 #include "spltdb.h"
 #include "stdstat.h"
@@ -62,7 +83,7 @@ char * strjoin(char **strings, int len) {
 			new_len += 2;
 		}
 		new_len += strlen(strings[i]);
-		if(strncmp(strings[i], "-i", 2) == 0) {
+		if(*strings[i] == '-' && (strings[i][1] == 'i' || strings[i][1] == 'o')) {
 			escape = 1;
 		}
 	}
@@ -95,6 +116,9 @@ char * strjoin(char **strings, int len) {
 			escape = 1;
 		}
 	}
+	if(stringPtr != newStr) {
+		*--stringPtr = 0;
+	}
 	
 	return newStr;
 }
@@ -111,17 +135,26 @@ static void helpMessage(int exitStatus) {
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-i", "Single end input(s)", "stdin");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-ipe", "Paired end input(s)", "");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-int", "Interleaved input(s)", "");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-ipk", "Packed input(s), kma trim -pack", "");
 	
 	fprintf(out, "#\n# Output:\n");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-o", "Output prefix", "");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-ef", "Output additional features", "False");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-vcf", "Output vcf file, 2 to apply FT", "False");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-sam", "Output sam, 4/2096 for mapped/aligned", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-bam", "Output bam to stdout, as -sam", "False");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-nc", "No consensus file", "False");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-na", "No aln file", "False");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-nf", "No frag file", "False");
-	fprintf(out, "# %16s\t%-32s\t%s\n", "-matrix", "Output assembly matrix", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-ns", "Best hit per namespace of -ns DB", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-allele", "Exact/near allele per locus, -ns", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-st", "ST from profile table, -allele", "");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-abricate", "Hits as abricate table, -ns", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-stream", "Flush results after each template", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-sum", "Summary only, -nc -na -nf -tsv 31", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-matrix", "Output assembly matrix, sparse: binary", "False");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-a", "Output all template mappings", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-bin", "Bin reads of *.res templates (ns)", "False");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-and", "Use both mrs and p-value on consensus", "or");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-oa", "Use neither mrs or p-value on consensus", "False");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-tsv", "Tsv flag", "0");
@@ -140,13 +173,34 @@ static void helpMessage(int exitStatus) {
 	
 	fprintf(out, "#\n# General:\n");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-t_db", "Template DB", "");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-spltDB_map", "Map all -t_db here, one input parse", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-spltDB_net", "Map -t_db on host:port,... workers", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-listen", "Map -t_db for -spltDB_net on [host:]port", "False/127.0.0.1");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-p", "P-value", "0.05");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-shm", "Use DB in shared memory", "0");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-mmap", "Memory map *.comp.b", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-mmap_load", "-mmap paging: lazy/populate/prefetch", "default");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-hugepages", "Place *.comp.b on hugepages", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-numa", "Pin threads: pin/interleave/replicate", "False");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-tmp", "Set directory for temporary files", "");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-tmp_mem", "Keep temporary files in memory (MB)", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-ahead", "Keep n 4 MB input reads in flight", "False/4");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-ahead_direct", "-ahead, with O_DIRECT reads", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-aio", "Write outputs in blocks of MB, async", "False/1");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-aio_sync", "fsync outputs at close, or every MB", "False");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-mf", "Max number of fragments to store in memory", "1000000");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-t", "Number of threads", "1");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-t_auto", "Fit threads to the input, up to -t", "False");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-status", "Extra status", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-cache", "Reuse results of identical runs", "");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-resume", "Checkpoint, and resume from *.ckpt", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-incr", "Add the reads to a sample state", "");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-stats", "Write stage times to *.stats.json", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-stats_hw", "Add CPU counters to -stats", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-trace", "Write chrome trace to *.trace.json", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-profile", "Sample 1/n lookups to *.profile.tsv", "False/64");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-mem_cap", "Fail beyond this many GB in use", "0");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-mem_budget", "Fit threads and buffers to GB", "0/False");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-verbose", "Extra verbose", "False");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-c", "Citation", "");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-v", "Version", "");
@@ -157,6 +211,10 @@ static void helpMessage(int exitStatus) {
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-mem_mode", "Base ConClave on template mappings", "False");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-proxi", "Proximity scoring (negative for soft)", "False/1.0");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-ex_mode", "Searh kmers exhaustively", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-probes", "Drop reads missing first k-mers", "0/all");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-stride", "Probe every n'th k-mer off hits", "0/False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-dedup", "Reuse mapping of duplicate reads", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-sat", "Stop mapping at this depth", "0/False");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-deCon", "Remove contamination", "False");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-Sparse", "Only count kmers", "False");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-ss", "Sparse sorting (q,c,d,n)", "q");
@@ -187,11 +245,16 @@ static void helpMessage(int exitStatus) {
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-penalty", "Penalty for mismatch", "2");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-gapopen", "Penalty for gap opening", "3");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-gapextend", "Penalty for gap extension", "1");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-xdrop", "X-drop tails, narrow seed gaps", "0/False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-fuzzy", "Fuzzy seeds, max mismatches", "False/1");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-astride", "Seed long reads every n'th k-mer", "0/False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-nw_window", "Max MB of NW traceback per gap", "0/False/64");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-per", "Reward for pairing reads", "7");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-Npenalty", "Penalty matching N", "0");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-transition", "Penalty for transition", "2");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-transversion", "Penalty for transversion", "2");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-sasm", "Skip alignment", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-tsort", "Align batches of reads by template", "0/False");
 	
 	fprintf(out, "#\n# Trimming:\n");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-mp", "Minimum phred score", "20");
@@ -217,7 +280,7 @@ static void helpMessage(int exitStatus) {
 	exit(exitStatus);
 }
 
-int kma_main(int argc, char *argv[]) {
+static int kma_run(int argc, char *argv[]) {
 	
 	static const double prob[256] = {1.00000000000000000000000000000000, 0.79432823472428149003121689020190, 0.63095734448019324958067954867147, 0.50118723362727224390766878059367, 0.39810717055349720272516833574628, 0.31622776601683794117647607890831, 0.25118864315095795758381314044527, 0.19952623149688791803768594945723,
 		0.15848931924611134314240246112604, 0.12589254117941672816982645599637, 0.10000000000000000555111512312578, 0.07943282347242813790089144276862, 0.06309573444801930275360746236402, 0.05011872336272722022743053571503, 0.03981071705534971333362292966740, 0.03162277660168379134209004632794,
@@ -252,28 +315,30 @@ int kma_main(int argc, char *argv[]) {
 		0.00000000000000000000000100000000, 0.00000000000000000000000079432823, 0.00000000000000000000000063095734, 0.00000000000000000000000050118723, 0.00000000000000000000000039810717, 0.00000000000000000000000031622777, 0.00000000000000000000000025118864, 0.00000000000000000000000019952623,
 		0.00000000000000000000000015848932, 0.00000000000000000000000012589254, 0.00000000000000000000000010000000, 0.00000000000000000000000007943282, 0.00000000000000000000000006309573, 0.00000000000000000000000005011872, 0.00000000000000000000000003981072, 0.00000000000000000000000003162278};
 	static int minPhred, minmaskQ, minQ, fiveClip, threeClip, minlen, maxlen;
-	static int fileCounter, fileCounter_PE, fileCounter_INT, Ts, Tv, mem_mode;
+	static int fileCounter, fileCounter_PE, fileCounter_INT, fileCounter_PK, Ts, Tv, mem_mode;
 	static int extendedFeatures, spltDB, thread_num, kmersize, targetNum, mq;
-	static int ref_fsa, print_matrix, print_all, sam, vcf, Mt1, bcd, one2one;
-	static int ConClave, sparse_run, ts, maxFrag, preset, **d, status = 0;
-	static unsigned xml, nc, nf, shm, exhaustive, verbose;
-	static long unsigned tsv;
-	static char *outputfilename, *templatefilename, **templatefilenames;
-	static char **inputfiles, **inputfiles_PE, **inputfiles_INT, ss;
-	static double ID_t, Depth_t, scoreT, coverT, mrc, evalue, minFrac, support;
+	static int ref_fsa, print_matrix, print_all, sam, bam, vcf, Mt1, bcd, one2one;
+	static int ahead, bins, ConClave, sparse_run, ts, maxFrag, preset, stats, stats_hw, trace, profile, t_auto, map_threads, **d, status = 0;
+	static unsigned xml, nc, nf, ns, shm, exhaustive, verbose;
+	static long unsigned tsv, tmp_mem, aio, aio_sync, resume, incrKey;
+	static char *outputfilename, *templatefilename, **templatefilenames, *stfilename, *incrfilename, *netHosts, *listenAddr;
+	static char **inputfiles, **inputfiles_PE, **inputfiles_INT, **inputfiles_PK, ss;
+	static double ID_t, Depth_t, scoreT, coverT, mrc, evalue, minFrac, support, mem_cap, mem_budget;
 	static FILE *out_json;
 	static Penalties *rewards;
 	static QCstat *qcreport;
 	int i, j, args, exe_len, fileCount, size, escape, tmp, step1, step2;
-	long unsigned totFrags;
-	char *to2Bit, *exeBasic, *myTemplatefilename;
+	long unsigned totFrags, timer[STAT_TIMER];
+	char *to2Bit, *exeBasic, *myTemplatefilename, *sample;
 	FILE *templatefile, *ioStream;
 	time_t t0, t1;
 	Qseqs qseq;
 	HashMapKMA *templates;
+	KmaContext ctx;
 	
 	step1 = 0;
 	step2 = 0;
+	sample = 0;
 	
 	if(argc) {
 		if(sizeof(long unsigned) != 8) {
@@ -282,16 +347,25 @@ int kma_main(int argc, char *argv[]) {
 		}
 		
 		/* SET DEFAULTS */
+		status = 0;
 		ConClave = 1;
 		verbose = 0;
 		tsv = 0;
 		vcf = 0;
 		xml = 0;
 		sam = 0;
+		bam = 0;
 		nc = 0;
 		nf = 0;
+		ns = 0;
+		stfilename = 0;
+		resume = 0;
+		bins = 0;
+		incrfilename = 0;
 		targetNum = 0;
 		spltDB = 0;
+		netHosts = 0;
+		listenAddr = 0;
 		extendedFeatures = 0;
 		minPhred = 20;
 		minmaskQ = 0;
@@ -302,6 +376,7 @@ int kma_main(int argc, char *argv[]) {
 		fileCounter = 0;
 		fileCounter_PE = 0;
 		fileCounter_INT = 0;
+		fileCounter_PK = 0;
 		outputfilename = 0;
 		templatefilename = 0;
 		print_matrix = 0;
@@ -338,8 +413,10 @@ int kma_main(int argc, char *argv[]) {
 		Tv = -2;
 		Ts = -2;
 		thread_num = 1;
+		t_auto = 0;
 		inputfiles_PE = 0;
 		inputfiles_INT = 0;
+		inputfiles_PK = 0;
 		inputfiles = 0;
 		templatefilenames = 0;
 		tmp = 0;
@@ -348,6 +425,16 @@ int kma_main(int argc, char *argv[]) {
 		deConPrintPtr = printPtr;
 		out_json = 0;
 		qcreport = 0;
+		stats = 0;
+		stats_hw = 0;
+		trace = 0;
+		profile = 0;
+		mem_cap = 0;
+		mem_budget = 0;
+		tmp_mem = 0;
+		aio = 0;
+		aio_sync = 0;
+		ahead = 0;
 		preset = 0;
 		
 		/* PARSE COMMAND LINE OPTIONS */
@@ -436,6 +523,24 @@ int kma_main(int argc, char *argv[]) {
 					inputfiles_INT[i] = argv[args];
 				}
 				--args;
+			} else if(strcmp(argv[args], "-ipk") == 0) {
+				++args;
+				fileCount = fileCounter_PK;
+				for(i = args; i < argc && strncmp(argv[i], "-", 1) != 0; ++i) {
+					++fileCounter_PK;
+				}
+				if(fileCounter_PK == 0) {
+					fprintf(stderr, "No packed query files were specified.\n");
+					exit(1);
+				}
+				inputfiles_PK = realloc(inputfiles_PK, fileCounter_PK * sizeof(char *));
+				if(!inputfiles_PK) {
+					ERROR();
+				}
+				for(i = fileCount; i < fileCounter_PK; ++i, ++args) {
+					inputfiles_PK[i] = argv[args];
+				}
+				--args;
 			} else if(strcmp(argv[args], "-pm") == 0) {
 				++args;
 				if(args < argc) {
@@ -529,6 +634,34 @@ int kma_main(int argc, char *argv[]) {
 			} else if(strcmp(argv[args], "-mmap") == 0 || strcmp(argv[args], "-swap") == 0) {
 				shm |= 32;
 				hashMapKMA_destroy = &hashMapKMA_munmap;
+			} else if(strcmp(argv[args], "-hugepages") == 0) {
+				setHugePages(1);
+			} else if(strcmp(argv[args], "-numa") == 0) {
+				if(++args < argc && strcmp(argv[args], "pin") == 0) {
+					setNuma(NUMAPIN);
+				} else if(args < argc && strcmp(argv[args], "interleave") == 0) {
+					setNuma(NUMAINTERLEAVE);
+				} else if(args < argc && strcmp(argv[args], "replicate") == 0) {
+					setNuma(NUMAREPLICATE);
+				} else {
+					fprintf(stderr, "Invalid argument at \"-numa\".\n");
+					exit(1);
+				}
+			} else if(strcmp(argv[args], "-mmap_load") == 0) {
+				if(++args < argc && strcmp(argv[args], "lazy") == 0) {
+					setMmapLoad(MMAPLAZY);
+				} else if(args < argc && strcmp(argv[args], "populate") == 0) {
+					setMmapLoad(MMAPPOPULATE);
+				} else if(args < argc && strcmp(argv[args], "prefetch") == 0) {
+					setMmapLoad(MMAPPREFETCH);
+				} else if(args < argc && strcmp(argv[args], "default") == 0) {
+					setMmapLoad(MMAPDEFAULT);
+				} else {
+					fprintf(stderr, "Invalid argument at \"-mmap_load\".\n");
+					exit(1);
+				}
+				shm |= 32;
+				hashMapKMA_destroy = &hashMapKMA_munmap;
 			} else if(strcmp(argv[args], "-t") == 0) {
 				++args;
 				if(args < argc && argv[args][0] != '-') {
@@ -553,6 +686,35 @@ int kma_main(int argc, char *argv[]) {
 				ankerPtr = &ankerAndClean_MEM;
 			} else if(strcmp(argv[args], "-ex_mode") == 0) {
 				exhaustive = 1;
+			} else if(strcmp(argv[args], "-probes") == 0) {
+				++args;
+				if(args < argc) {
+					setQuickProbes(strtoul(argv[args], &exeBasic, 10));
+					if(*exeBasic != 0) {
+						fprintf(stderr, "# Invalid number of probes parsed\n");
+						exit(1);
+					}
+				}
+			} else if(strcmp(argv[args], "-sat") == 0) {
+				++args;
+				if(args < argc) {
+					setSaturation(strtod(argv[args], &exeBasic));
+					if(*exeBasic != 0) {
+						fprintf(stderr, "Invalid argument at \"-sat\".\n");
+						exit(1);
+					}
+				}
+			} else if(strcmp(argv[args], "-dedup") == 0) {
+				setDupReads(DUPREADS);
+			} else if(strcmp(argv[args], "-stride") == 0) {
+				++args;
+				if(args < argc) {
+					setSeedStride(strtol(argv[args], &exeBasic, 10));
+					if(*exeBasic != 0) {
+						fprintf(stderr, "Invalid argument at \"-stride\".\n");
+						exit(1);
+					}
+				}
 			} else if(strcmp(argv[args], "-k") == 0) {
 				++args;
 				if(args < argc) {
@@ -669,6 +831,12 @@ int kma_main(int argc, char *argv[]) {
 				ID_t = 0.0;
 			} else if(strcmp(argv[args], "-matrix") == 0) {
 				print_matrix = 1;
+				if(++args < argc && strcmp(argv[args], "sparse") == 0) {
+					print_matrix = 2;
+					updateMatrixPtr = &updateSparseMatrix;
+				} else {
+					--args;
+				}
 			} else if(strcmp(argv[args], "-a") == 0) {
 				print_all = 1;
 			} else if(strcmp(argv[args], "-ref_fsa") == 0) {
@@ -863,6 +1031,55 @@ int kma_main(int argc, char *argv[]) {
 						exit(1);
 					}
 				}
+			} else if(strcmp(argv[args], "-xdrop") == 0) {
+				++args;
+				if(args < argc) {
+					setXdrop(strtoul(argv[args], &exeBasic, 10));
+					if(*exeBasic != 0) {
+						fprintf(stderr, "Invalid argument at \"-xdrop\".\n");
+						exit(1);
+					}
+				}
+			} else if(strcmp(argv[args], "-astride") == 0) {
+				++args;
+				if(args < argc) {
+					setAlnStride(strtol(argv[args], &exeBasic, 10));
+					if(*exeBasic != 0) {
+						fprintf(stderr, "Invalid argument at \"-astride\".\n");
+						exit(1);
+					}
+				}
+			} else if(strcmp(argv[args], "-fuzzy") == 0) {
+				if(++args < argc && argv[args][0] != '-') {
+					setFuzzy(strtoul(argv[args], &exeBasic, 10));
+					if(*exeBasic != 0) {
+						fprintf(stderr, "Invalid argument at \"-fuzzy\".\n");
+						exit(1);
+					}
+				} else {
+					setFuzzy(1);
+					--args;
+				}
+			} else if(strcmp(argv[args], "-nw_window") == 0) {
+				if(++args < argc && argv[args][0] != '-') {
+					setNWwindow(strtoul(argv[args], &exeBasic, 10) << 20);
+					if(*exeBasic != 0 || *argv[args] == '0') {
+						fprintf(stderr, "Invalid argument at \"-nw_window\".\n");
+						exit(1);
+					}
+				} else {
+					setNWwindow(64 << 20);
+					--args;
+				}
+			} else if(strcmp(argv[args], "-tsort") == 0) {
+				++args;
+				if(args < argc) {
+					setAlnBatch(strtol(argv[args], &exeBasic, 10));
+					if(*exeBasic != 0 || *argv[args] == '-') {
+						fprintf(stderr, "Invalid argument at \"-tsort\".\n");
+						exit(1);
+					}
+				}
 			} else if(strcmp(argv[args], "-localopen") == 0) {
 				/* add to help */
 				++args;
@@ -1021,12 +1238,50 @@ int kma_main(int argc, char *argv[]) {
 						--args;
 					}
 				}
+			} else if(strcmp(argv[args], "-bam") == 0) {
+				sam = 1;
+				bam = 1;
+				if(++args < argc) {
+					if(argv[args][0] != '-') {
+						sam = strtol(argv[args], &exeBasic, 10);
+						if(*exeBasic != 0) {
+							fprintf(stderr, "Invalid argument at \"-bam\".\n");
+							exit(1);
+						}
+					} else {
+						--args;
+					}
+				}
 			} else if(strcmp(argv[args], "-nc") == 0) {
 				nc = 3;
 			} else if(strcmp(argv[args], "-na") == 0) {
 				nc |= 2;
 			} else if(strcmp(argv[args], "-nf") == 0) {
 				nf = 1;
+			} else if(strcmp(argv[args], "-ns") == 0) {
+				ns |= 1;
+			} else if(strcmp(argv[args], "-allele") == 0) {
+				/* typing of small allele panels, one locus per namespace */
+				ns |= 3;
+			} else if(strcmp(argv[args], "-abricate") == 0) {
+				/* gene panels screened in one pass, one panel per namespace */
+				ns |= 5;
+			} else if(strcmp(argv[args], "-st") == 0) {
+				++args;
+				if(args < argc) {
+					stfilename = argv[args];
+					ns |= 3;
+				} else {
+					fprintf(stderr, "Need a profile table after \"-st\".\n");
+					exit(1);
+				}
+			} else if(strcmp(argv[args], "-sum") == 0) {
+				/* name, length, identity, coverage and depth per hit */
+				nc = 3;
+				nf = 1;
+				if(!tsv) {
+					tsv = 31;
+				}
 			} else if(strcmp(argv[args], "-cge") == 0) {
 				scoreT = 0.5;
 				rewards->M = 1;
@@ -1034,6 +1289,28 @@ int kma_main(int argc, char *argv[]) {
 				rewards->W1 = -5;
 				rewards->U = -1;
 				rewards->PE = 17;
+			} else if(strcmp(argv[args], "-bin") == 0) {
+				bins = 1;
+				if(++args < argc && strcmp(argv[args], "ns") == 0) {
+					bins = 2;
+				} else {
+					--args;
+				}
+			} else if(strcmp(argv[args], "-resume") == 0) {
+				resume = 1;
+			} else if(strcmp(argv[args], "-incr") == 0) {
+				if(++args < argc) {
+					incrfilename = argv[args];
+				} else {
+					fprintf(stderr, "Need a file after \"-incr\".\n");
+					exit(1);
+				}
+			} else if(strcmp(argv[args], "-cache") == 0) {
+				/* handled by kma_main */
+				if(++args == argc) {
+					fprintf(stderr, "Need a directory after \"-cache\".\n");
+					exit(1);
+				}
 			} else if(strcmp(argv[args], "-tmp") == 0) {
 				tmp = 1;
 				if(++args < argc) {
@@ -1048,6 +1325,49 @@ int kma_main(int argc, char *argv[]) {
 						--args;
 					}
 				}
+			} else if(strcmp(argv[args], "-tmp_mem") == 0) {
+				++args;
+				if(args < argc) {
+					size = strtol(argv[args], &exeBasic, 10);
+					if(*exeBasic != 0 || size < 0) {
+						fprintf(stderr, "Invalid argument at \"-tmp_mem\".\n");
+						exit(1);
+					} else if(size) {
+						tmp_mem = (long unsigned)(size) << 20;
+						tmpM(tmp_mem);
+					}
+				}
+			} else if(strcmp(argv[args], "-aio") == 0 || strcmp(argv[args], "-aio_sync") == 0) {
+				i = argv[args][4] == '_';
+				if(++args < argc && argv[args][0] != '-') {
+					size = strtol(argv[args], &exeBasic, 10);
+					if(*exeBasic != 0 || size < 1) {
+						fprintf(stderr, "Invalid argument at \"%s\".\n", argv[--args]);
+						exit(1);
+					}
+				} else {
+					size = i ? 0 : 1;
+					--args;
+				}
+				if(i) {
+					aio_sync = size ? (long unsigned)(size) << 20 : 1;
+					aio = aio ? aio : 1048576;
+				} else {
+					aio = (long unsigned)(size) << 20;
+				}
+			} else if(strcmp(argv[args], "-ahead") == 0 || strcmp(argv[args], "-ahead_direct") == 0) {
+				i = argv[args][6] == '_';
+				if(++args < argc && argv[args][0] != '-') {
+					size = strtol(argv[args], &exeBasic, 10);
+					if(*exeBasic != 0 || size < 1) {
+						fprintf(stderr, "Invalid argument at \"%s\".\n", argv[--args]);
+						exit(1);
+					}
+				} else {
+					size = 4;
+					--args;
+				}
+				ahead = (size << 1) | i;
 			} else if(strcmp(argv[args], "-mf") == 0) {
 				++args;
 				if(args < argc) {
@@ -1059,8 +1379,57 @@ int kma_main(int argc, char *argv[]) {
 				}
 			} else if(strcmp(argv[args], "-spltDB") == 0) {
 				spltDB = 1;
+			} else if(strcmp(argv[args], "-spltDB_map") == 0) {
+				spltDB = 2;
+			} else if(strcmp(argv[args], "-spltDB_net") == 0) {
+				if(++args < argc) {
+					spltDB = 3;
+					netHosts = argv[args];
+				}
+			} else if(strcmp(argv[args], "-listen") == 0) {
+				if(++args < argc) {
+					listenAddr = argv[args];
+					spltDB = 1;
+					step2 = 1;
+				}
+			} else if(strcmp(argv[args], "-t_auto") == 0) {
+				t_auto = 1;
 			} else if(strcmp(argv[args], "-status") == 0) {
 				kmaPipe = &kmaPipeFork;
+			} else if(strcmp(argv[args], "-stats") == 0) {
+				stats = 1;
+			} else if(strcmp(argv[args], "-stats_hw") == 0) {
+				stats = 1;
+				stats_hw = 1;
+			} else if(strcmp(argv[args], "-trace") == 0) {
+				trace = 1;
+			} else if(strcmp(argv[args], "-profile") == 0) {
+				if(++args < argc && argv[args][0] != '-') {
+					profile = strtol(argv[args], &exeBasic, 10);
+					if(*exeBasic != 0 || profile < 1) {
+						fprintf(stderr, "Invalid argument at \"-profile\".\n");
+						exit(1);
+					}
+				} else {
+					profile = 64;
+					--args;
+				}
+			} else if(strcmp(argv[args], "-mem_budget") == 0) {
+				if(++args < argc) {
+					mem_budget = strtod(argv[args], &exeBasic);
+					if(*exeBasic != 0 || mem_budget < 0) {
+						fprintf(stderr, "Invalid argument at \"%s\".\n", argv[--args]);
+						exit(1);
+					}
+				}
+			} else if(strcmp(argv[args], "-mem_cap") == 0) {
+				if(++args < argc) {
+					mem_cap = strtod(argv[args], &exeBasic);
+					if(*exeBasic != 0 || mem_cap < 0) {
+						fprintf(stderr, "Invalid argument at \"%s\".\n", argv[--args]);
+						exit(1);
+					}
+				}
 			} else if(strcmp(argv[args], "-verbose") == 0) {
 				if(++args < argc && argv[args][0] != '-') {
 					verbose = strtol(argv[args], &exeBasic, 10);
@@ -1239,6 +1608,8 @@ int kma_main(int argc, char *argv[]) {
 				ts = 2;
 			} else if(strcmp(argv[args], "-reassign") == 0) {
 				preset |= 32;
+			} else if(strcmp(argv[args], "-stream") == 0) {
+				preset |= 64;
 			} else if(strcmp(argv[args], "-v") == 0) {
 				fprintf(stdout, "KMA-%s\n", KMA_VERSION);
 				exit(0);
@@ -1255,16 +1626,25 @@ int kma_main(int argc, char *argv[]) {
 			++args;
 		}
 		preseed(0, 0, exhaustive);
+		FileBuffThreads(thread_num);
 		trimSeedsPtr(0, ts);
 		mrchain((int *)(&mrc), 0, 0, 0);
 		chooseChain(0, 0, 0, 0, (int *)(&coverT), (int *)(&minFrac));
 		
-		if(sam && kmaPipe != &kmaPipeThread) {
+		if(sam && kmaPipe == &kmaPipeFork) {
 			fprintf(stderr, "\"-sam\" and \"-status\" cannot coincide.\n");
-			kmaPipe = &kmaPipeThread;
+			kmaPipe = &kmaPipeRing;
+		}
+		
+		if(bam) {
+			if(Mt1 || targetNum != 1) {
+				fprintf(stderr, "\"-bam\" cannot be combined with \"-Mt1\" or multiple databases, use \"-sam\".\n");
+				exit(1);
+			}
+			setBam(thread_num < 1 ? 1 : thread_num);
 		}
 		
-		if(spltDB || targetNum != 1) {
+		if(spltDB == 1 || targetNum != 1) {
 			printPtr = &print_ankers_spltDB;
 			if(deConPrintPtr != &deConPrint) {
 				deConPrintPtr = printPtr;
@@ -1305,12 +1685,84 @@ int kma_main(int argc, char *argv[]) {
 			out_json = fopen(outputfilename, "wb");
 			outputfilename[i] = 0;
 		}
+		if(stats && !kmaStats && !kmaStat_init()) {
+			ERROR();
+		}
+		if(stats_hw) {
+			kmaStat_hw();
+		}
+		if(aio) {
+			aoutInit(aio, aio_sync);
+		}
+		if(ahead) {
+			areadInit(ahead >> 1, ahead & 1);
+		}
 		
-		if(fileCounter == 0 && fileCounter_PE == 0 && fileCounter_INT == 0) {
+		/* install the kernels of this cpu, before stages are forked */
+		nwInit();
+		seqscanInit();
+		fuzzyInit();
+		kmaCpu_pick(CPU_HASHMAP, kmaCpuScalar);
+		kmaCpu_pick(CPU_KMERSCAN, kmaCpuScalar);
+		kmaCpu_pick(CPU_CONSENSUS, kmaCpuScalar);
+		if(verbose) {
+			kmaCpu_print(stderr, 0);
+		}
+		if(trace && kmaTraceFd < 0 && kmaTrace_init(outputfilename)) {
+			ERROR();
+		}
+		if(profile && !kmaProfs && !kmaProf_init(profile)) {
+			ERROR();
+		}
+		if((stats || mem_cap) && !memAcc && !memAcc_init(mem_cap * 1073741824)) {
+			ERROR();
+		}
+		
+		if(fileCounter_PK && (sparse_run || printFsa_ptr != &printFsa)) {
+			/* packed queries hold the records of a plain mapping */
+			fprintf(stderr, "\"-ipk\" cannot be combined with \"-Sparse\", \"-Mt1\" or \"-boot\".\n");
+			exit(1);
+		}
+		if(resume || incrfilename) {
+			/* checkpoints belong to the options, inputs and database of a run */
+			if(sparse_run || printFsa_ptr == &printFsaMt1 || print_all || targetNum != 1) {
+				fprintf(stderr, "\"-resume\" and \"-incr\" cannot be combined with \"-Sparse\", \"-Mt1\", \"-a\" or several databases.\n");
+				exit(1);
+			} else if(resume && incrfilename) {
+				fprintf(stderr, "\"-resume\" cannot be combined with \"-incr\".\n");
+				exit(1);
+			} else if(resume && !(resume = kmaCache_sum(argc, argv, 1))) {
+				fprintf(stderr, "\"-resume\" needs named inputs, and no sam output.\n");
+				exit(1);
+			} else if(incrfilename && !(incrKey = kmaCache_sum(argc, argv, 0))) {
+				/* the state holds the reads of earlier runs, not their sam */
+				fprintf(stderr, "\"-incr\" cannot be combined with sam output.\n");
+				exit(1);
+			}
+		}
+		if(fileCounter == 0 && fileCounter_PE == 0 && fileCounter_INT == 0 && fileCounter_PK == 0) {
 			inputfiles = smalloc(sizeof(char*));
 			inputfiles[0] = "--";
 			fileCounter = 1;
 		}
+		sample = fileCounter ? *inputfiles : fileCounter_PE ? *inputfiles_PE : fileCounter_INT ? *inputfiles_INT : *inputfiles_PK;
+		
+		/* threads */
+		map_threads = thread_num;
+		if(t_auto) {
+			kmaTune_threads(templatefilename, (char **[]){inputfiles, inputfiles_PE, inputfiles_INT}, (int []){fileCounter, fileCounter_PE, fileCounter_INT}, 3, thread_num, &map_threads, &thread_num);
+			fprintf(stderr, "# Threads: mapping %d, alignment %d.\n", map_threads, thread_num);
+		}
+		if(mem_budget) {
+			size = tmp_mem;
+			kmaTune_memory(templatefilename, mem_budget * 1073741824, &map_threads, &thread_num, &maxFrag, &mem_mode, &tmp_mem);
+			if(!size) {
+				tmpM(tmp_mem);
+			}
+		}
+		kmaStat_threads(STAT_MAPPING, map_threads);
+		kmaStat_threads(STAT_ALIGNMENT, thread_num);
+		kmaStat_threads(STAT_ASSEMBLY, thread_num);
 		
 		/* set scoring matrix */
 		rewards->MM = (Ts + Tv - 1) / 2; /* avg. of transition and transversion, rounded down */
@@ -1335,7 +1787,7 @@ int kma_main(int argc, char *argv[]) {
 		d[4][4] = 0;
 		rewards->d = (int **) d;
 		
-		if(spltDB && targetNum != 1) {
+		if(spltDB == 1 && targetNum != 1) {
 			/* allocate space for commands */
 			escape = 0;
 			size = argc + strlen(outputfilename) + 32;
@@ -1432,6 +1884,9 @@ int kma_main(int argc, char *argv[]) {
 		}
 		
 		templatefilename = *templatefilenames;
+		for(i = 0; i < targetNum; ++i) {
+			packLoad(templatefilenames[i]);
+		}
 		ioStream = stdout;
 		anker_rc(0, 0, one2one, 0, 0, 0);
 		anker_rc_comp(0, 0, (unsigned char *)(&one2one), 0, 0, 0, 0, 0);
@@ -1446,6 +1901,7 @@ int kma_main(int argc, char *argv[]) {
 	
 	if(step1) {
 		t0 = clock();
+		kmaStat_start(timer);
 		/* set to2Bit conversion */
 		to2Bit = smalloc(384); /* 128 * 3 = 384 -> OS independent */
 		for(i = 0; i < 384; ++i) {
@@ -1565,17 +2021,22 @@ int kma_main(int argc, char *argv[]) {
 			
 			/* SE */
 			if(fileCounter > 0) {
-				totFrags += run_input(inputfiles, fileCounter, minPhred, minmaskQ, minQ, fiveClip, threeClip, minlen, maxlen, to2Bit, prob, qcreport, ioStream);
+				totFrags += run_input_pool(&run_input, inputfiles, fileCounter, 1, minPhred, minmaskQ, minQ, fiveClip, threeClip, minlen, maxlen, to2Bit, prob, qcreport, thread_num, ioStream);
 			}
 			
 			/* PE */
 			if(fileCounter_PE > 0) {
-				totFrags += run_input_PE(inputfiles_PE, fileCounter_PE, minPhred, minmaskQ, minQ, fiveClip, threeClip, minlen, maxlen, to2Bit, prob, qcreport, ioStream);
+				totFrags += run_input_pool(&run_input_PE, inputfiles_PE, fileCounter_PE, 2, minPhred, minmaskQ, minQ, fiveClip, threeClip, minlen, maxlen, to2Bit, prob, qcreport, thread_num, ioStream);
 			}
 			
 			/* INT */
 			if(fileCounter_INT > 0) {
-				totFrags += run_input_INT(inputfiles_INT, fileCounter_INT, minPhred, minmaskQ, minQ, fiveClip, threeClip, minlen, maxlen, to2Bit, prob, qcreport, ioStream);
+				totFrags += run_input_pool(&run_input_INT, inputfiles_INT, fileCounter_INT, 1, minPhred, minmaskQ, minQ, fiveClip, threeClip, minlen, maxlen, to2Bit, prob, qcreport, thread_num, ioStream);
+			}
+			
+			/* packed, converted by "kma trim -pack" */
+			for(i = 0; i < fileCounter_PK; ++i) {
+				totFrags += qpackLoad(inputfiles_PK[i], ioStream);
 			}
 			
 			if(qcreport) {
@@ -1585,6 +2046,7 @@ int kma_main(int argc, char *argv[]) {
 			}
 			
 			fprintf(stderr, "#\n# Total number of query fragment after trimming:\t%lu\n", totFrags);
+			kmaStat_add(STAT_READS, totFrags);
 			
 			status |= errno;
 			
@@ -1595,6 +2057,7 @@ int kma_main(int argc, char *argv[]) {
 			}
 		}
 		free((to2Bit - 128));
+		kmaStat_stop(STAT_INPUT, timer);
 		if(kmaPipe == &kmaPipeFork) {
 			t1 = clock();
 			fprintf(stderr, "#\n# Total time used for converting query: %.2f s.\n#\n", difftime(t1, t0) / 1000000);
@@ -1604,35 +2067,108 @@ int kma_main(int argc, char *argv[]) {
 	} else if(Mt1) {
 		myTemplatefilename = smalloc(strlen(templatefilename) + 64);
 		strcpy(myTemplatefilename, templatefilename);
-		runKMA_Mt1(myTemplatefilename, outputfilename, strjoin(argv, argc), kmersize, minlen, rewards, ID_t, Depth_t, mq, scoreT, mrc, evalue, support, bcd, Mt1, ref_fsa, print_matrix, tsv, vcf, xml, sam, nc, nf, thread_num);
+		runKMA_Mt1(myTemplatefilename, outputfilename, strjoin(argv, argc), kmersize, minlen, rewards, ID_t, Depth_t, mq, scoreT, mrc, evalue, support, bcd, Mt1, ref_fsa, print_matrix, tsv, vcf, xml, sam, nc, nf, thread_num, verbose);
+		if(ns) {
+			printNamespaces(myTemplatefilename, outputfilename, ns & 2, stfilename, ns & 4 ? sample : 0);
+		}
 		free(myTemplatefilename);
 		fprintf(stderr, "# Closing files\n");
 	} else if(step2) {
 		myTemplatefilename = smalloc(strlen(templatefilename) + 64);
 		strcpy(myTemplatefilename, templatefilename);
-		status |= save_kmers_batch(myTemplatefilename, "-s1", shm, thread_num, exhaustive, rewards, ioStream, sam, minlen, scoreT, coverT, (!mem_mode && minFrac < 0) ? -minFrac : minFrac);
+		if(listenAddr) {
+			status |= spltDB_serve(listenAddr, myTemplatefilename, map_threads, exhaustive, rewards, minlen, scoreT, coverT, minFrac, shm);
+		} else {
+			status |= save_kmers_batch(myTemplatefilename, "-s1", shm, map_threads, exhaustive, rewards, ioStream, sam, minlen, scoreT, coverT, (!mem_mode && minFrac < 0) ? -minFrac : minFrac);
+		}
 		free(myTemplatefilename);
 	} else if(sparse_run) {
 		myTemplatefilename = smalloc(strlen(templatefilename) + 64);
 		strcpy(myTemplatefilename, templatefilename);
-		status |= save_kmers_sparse_batch(myTemplatefilename, outputfilename, "-s1", ID_t, Depth_t, evalue, ss, shm);
+		status |= save_kmers_sparse_batch(myTemplatefilename, outputfilename, "-s1", ID_t, Depth_t, evalue, ss, shm, map_threads);
 		free(myTemplatefilename);
 		fprintf(stderr, "# Closing files\n");
 	} else {
 		exeBasic = strjoin(argv, argc);
 		myTemplatefilename = smalloc(strlen(templatefilename) + 64);
 		strcpy(myTemplatefilename, templatefilename);
-		if(spltDB == 0 && targetNum != 1) {
+		kmaContext_save(&ctx);
+		ctx.ConClave = ConClave;
+		ctx.kmersize = kmersize;
+		ctx.minlen = minlen;
+		ctx.rewards = rewards;
+		ctx.extendedFeatures = extendedFeatures;
+		ctx.ID_t = ID_t;
+		ctx.Depth_t = Depth_t;
+		ctx.mq = mq;
+		ctx.scoreT = scoreT;
+		ctx.mrc = mrc;
+		ctx.minFrac = minFrac;
+		ctx.evalue = evalue;
+		ctx.support = support;
+		ctx.bcd = bcd;
+		ctx.ref_fsa = ref_fsa;
+		ctx.print_matrix = print_matrix;
+		ctx.print_all = print_all;
+		ctx.tsv = tsv;
+		ctx.vcf = vcf;
+		ctx.xml = xml;
+		ctx.sam = sam;
+		ctx.nc = nc;
+		ctx.nf = nf;
+		ctx.shm = shm;
+		ctx.thread_num = thread_num;
+		ctx.maxFrag = maxFrag;
+		ctx.verbose = verbose;
+		ctx.preset = preset;
+		ctx.resume = resume;
+		ctx.incr = incrfilename;
+		ctx.incrKey = incrKey;
+		ctx.bins = bins;
+		if(spltDB != 1 && targetNum != 1) {
+			if(spltDB == 2) {
+				status |= spltDB_map(templatefilenames, targetNum, outputfilename, map_threads, exhaustive, rewards, minlen, scoreT, coverT, minFrac, shm);
+			} else if(spltDB == 3) {
+				status |= spltDB_net(targetNum, outputfilename, netHosts);
+			}
 			status |= runKMA_spltDB(templatefilenames, targetNum, outputfilename, argc, argv, ConClave, kmersize, minlen, rewards, extendedFeatures, ID_t, Depth_t, mq, scoreT, mrc, evalue, support, bcd, ref_fsa, print_matrix, print_all, tsv, vcf, xml, sam, nc, nf, shm, thread_num, maxFrag, verbose);
+			if(1 < spltDB) {
+				/* the mappings were intermediates */
+				i = strlen(outputfilename);
+				for(j = 0; j < targetNum; ++j) {
+					sprintf(outputfilename + i, ".%d", j);
+					remove(outputfilename);
+				}
+				outputfilename[i] = 0;
+			}
 		} else if(mem_mode) {
-			status |= runKMA_MEM(myTemplatefilename, outputfilename, exeBasic, ConClave, kmersize, minlen, rewards, extendedFeatures, ID_t, Depth_t, mq, scoreT, mrc, minFrac, evalue, support, bcd, ref_fsa, print_matrix, print_all, tsv, vcf, xml, sam, nc, nf, shm, thread_num, maxFrag, verbose, preset);
+			status |= runKMA_MEM(myTemplatefilename, outputfilename, exeBasic, &ctx);
 		} else {
-			status |= runKMA(myTemplatefilename, outputfilename, exeBasic, ConClave, kmersize, minlen, rewards, extendedFeatures, ID_t, Depth_t, mq, scoreT, mrc, minFrac, evalue, support, bcd, ref_fsa, print_matrix, print_all, tsv, vcf, xml, sam, nc, nf, shm, thread_num, maxFrag, verbose, preset);
+			status |= runKMA(myTemplatefilename, outputfilename, exeBasic, &ctx);
+		}
+		if(ns && !ctx.hitPtr) {
+			/* best hits per namespace */
+			status |= printNamespaces(myTemplatefilename, outputfilename, ns & 2, stfilename, ns & 4 ? sample : 0);
 		}
 		free(myTemplatefilename);
 		fprintf(stderr, "# Closing files\n");
 	}
 	
+	if(argc && kmaStats) {
+		/* per stage report */
+		status |= kmaStat_print(outputfilename);
+		kmaStat_destroy();
+	}
+	if(argc && kmaProfs) {
+		/* lookup histograms */
+		status |= kmaProf_print(outputfilename, templatefilename);
+		kmaProf_destroy();
+	}
+	if(argc && 0 <= kmaTraceFd) {
+		/* terminate event array */
+		status |= kmaTrace_close();
+	}
+	
 	fflush(stderr);
 	fflush(stdout);
 	status |= errno;
@@ -1642,3 +2178,51 @@ int kma_main(int argc, char *argv[]) {
 	
 	return status;
 }
+
+int kma_main(int argc, char *argv[]) {
+	
+	int status;
+	long unsigned key;
+	char *cachedir, *outputfilename;
+	time_t start;
+	
+	/* stages of the pipeline share the context of the run that started them */
+	if(!argc) {
+		return kma_run(argc, argv);
+	}
+	
+	/* replay an identical earlier run */
+	key = kmaCache_key(argc, argv, &cachedir, &outputfilename);
+	if(key && kmaCache_load(cachedir, outputfilename, key)) {
+		fprintf(stderr, "# Results restored from cache:\t%s/%016lx\n", cachedir, key);
+		return 0;
+	}
+	start = time(0);
+	
+	kmaContext_enter();
+	status = kma_run(argc, argv);
+	kmaContext_leave();
+	
+	if(key && !status) {
+		kmaCache_store(cachedir, outputfilename, key, start);
+	}
+	
+	return status;
+}
+
+int kma_mapFsa(int argc, char *argv[], const char *name, const char *fsa, long size, void (*hitPtr)(void *, const KmaHit *), void *hitArg) {
+	
+	int status;
+	
+	/* map the inputs named name from fsa, and hand the results to hitPtr */
+	kmaContext_enter();
+	errno = 0;
+	setMemInput(name, fsa, size);
+	kmaContext_setHits(hitPtr, hitArg);
+	status = kma_run(argc, argv);
+	kmaContext_setHits(0, 0);
+	setMemInput(0, 0, 0);
+	kmaContext_leave();
+	
+	return status;
+}
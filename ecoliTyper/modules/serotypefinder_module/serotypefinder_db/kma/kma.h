@@ -19,3 +19,5 @@
 
 char * strjoin(char **strings, int len);
 int kma_main(int argc, char *argv[]);
+struct kmaHit;
+int kma_mapFsa(int argc, char *argv[], const char *name, const char *fsa, long size, void (*hitPtr)(void *, const struct kmaHit *), void *hitArg);
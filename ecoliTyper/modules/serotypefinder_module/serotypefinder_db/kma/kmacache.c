@@ -0,0 +1,275 @@
+/* Philip T.L.C. Clausen Sep 2021 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2021, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "kmacache.h"
+#include "pack.h"
+#include "pherror.h"
+#include "version.h"
+
+/* result files a run may leave behind, run reports are not cached */
+static const char *cacheSuffixes[] = {".res", ".fsa", ".aln", ".frag.gz", ".mat.gz", ".smat.gz", ".vcf.gz", ".xml", ".tsv", ".spa", ".mapstat", ".json", ".ns.res", ".allele", ".st", ".tab", 0};
+
+/* files making up a database, as read when mapping */
+static const char *cacheDBsuffixes[] = {".comp.b", ".decon.comp.b", ".length.b", ".seq.b", ".name", ".filter.b", ".decon.filter.b", ".delta.b", ".ns", 0};
+
+static long unsigned cacheSumFile(long unsigned sum, char *filename) {
+	
+	long unsigned len;
+	unsigned char *buff;
+	FILE *file;
+	
+	if(!(file = fopen(filename, "rb"))) {
+		errno = 0;
+		return sum;
+	}
+	buff = smalloc(1048576);
+	while((len = fread(buff, 1, 1048576, file))) {
+		sum = packSum(sum, buff, len);
+	}
+	free(buff);
+	fclose(file);
+	
+	return sum;
+}
+
+static long unsigned cacheSumDB(long unsigned sum, char *templatefilename) {
+	
+	int i, len;
+	char *filename;
+	FILE *file;
+	PackHead head;
+	
+	len = strlen(templatefilename);
+	filename = smalloc(len + 32);
+	strcpy(filename, templatefilename);
+	
+	/* containers carry the checksum of their files */
+	strcpy(filename + len, ".kma");
+	if((file = fopen(filename, "rb"))) {
+		if(fread(&head, sizeof(PackHead), 1, file) == 1 && strncmp(head.magic, PACKMAGIC, 8) == 0) {
+			fclose(file);
+			free(filename);
+			return packSum(sum, (unsigned char *) &head.sum, sizeof(long unsigned));
+		}
+		fclose(file);
+	}
+	errno = 0;
+	
+	for(i = 0; cacheDBsuffixes[i]; ++i) {
+		strcpy(filename + len, cacheDBsuffixes[i]);
+		sum = packSum(sum, (unsigned char *) cacheDBsuffixes[i], strlen(cacheDBsuffixes[i]));
+		sum = cacheSumFile(sum, filename);
+	}
+	free(filename);
+	
+	return sum;
+}
+
+long unsigned kmaCache_sum(int argc, char *argv[], int inputs) {
+	
+	int args, files, db, pipe;
+	long unsigned sum;
+	
+	sum = packSum(0xCBF29CE484222325UL, (unsigned char *) KMA_VERSION, strlen(KMA_VERSION));
+	files = 0;
+	db = 0;
+	pipe = 0;
+	for(args = 1; args < argc; ++args) {
+		if((strcmp(argv[args], "-cache") == 0 || strcmp(argv[args], "-o") == 0 || strcmp(argv[args], "-t") == 0 || strcmp(argv[args], "-incr") == 0) && args + 1 < argc) {
+			++args;
+			files = 0;
+		} else if(files && strcmp(argv[args], "--") == 0) {
+			pipe |= inputs;
+		} else if(files && *argv[args] != '-') {
+			/* inputs and databases by content, not name */
+			if(db) {
+				sum = cacheSumDB(sum, argv[args]);
+			} else if(inputs) {
+				sum = cacheSumFile(sum, argv[args]);
+			}
+		} else {
+			files = strcmp(argv[args], "-i") == 0 || strcmp(argv[args], "-ipe") == 0 || strcmp(argv[args], "-int") == 0 || strcmp(argv[args], "-ipk") == 0 || strcmp(argv[args], "-t_db") == 0;
+			db = strcmp(argv[args], "-t_db") == 0;
+			pipe |= strcmp(argv[args], "-sam") == 0 || strcmp(argv[args], "-bam") == 0;
+			if(inputs || db || !files) {
+				sum = packSum(sum, (unsigned char *) argv[args], strlen(argv[args]) + 1);
+			}
+		}
+	}
+	
+	/* stdin and stdout cannot be replayed */
+	if(pipe) {
+		return 0;
+	}
+	
+	return sum ? sum : 1;
+}
+
+long unsigned kmaCache_key(int argc, char *argv[], char **cachedir, char **outputfilename) {
+	
+	int args, input;
+	
+	*cachedir = 0;
+	*outputfilename = 0;
+	input = 0;
+	for(args = 1; args < argc; ++args) {
+		if(strcmp(argv[args], "-cache") == 0 && args + 1 < argc) {
+			*cachedir = argv[++args];
+		} else if(strcmp(argv[args], "-o") == 0 && args + 1 < argc) {
+			*outputfilename = argv[++args];
+		} else if(strcmp(argv[args], "-i") == 0 || strcmp(argv[args], "-ipe") == 0 || strcmp(argv[args], "-int") == 0 || strcmp(argv[args], "-ipk") == 0) {
+			input = 1;
+		}
+	}
+	
+	if(!*cachedir || !*outputfilename || !input) {
+		return 0;
+	}
+	
+	return kmaCache_sum(argc, argv, 1);
+}
+
+static int cacheCopy(char *src, char *dest) {
+	
+	long unsigned len;
+	unsigned char *buff;
+	FILE *in, *out;
+	
+	if(!(in = fopen(src, "rb"))) {
+		errno = 0;
+		return 0;
+	} else if(!(out = fopen(dest, "wb"))) {
+		fclose(in);
+		errno = 0;
+		return 0;
+	}
+	buff = smalloc(1048576);
+	while((len = fread(buff, 1, 1048576, in))) {
+		if(fwrite(buff, 1, len, out) != len) {
+			break;
+		}
+	}
+	free(buff);
+	fclose(in);
+	len = ferror(out);
+	len |= fclose(out);
+	errno = 0;
+	
+	return !len;
+}
+
+int kmaCache_load(char *cachedir, char *outputfilename, long unsigned key) {
+	
+	int i, n, len, out_len;
+	char *entry, *filename;
+	struct stat st;
+	
+	len = strlen(cachedir);
+	entry = smalloc(len + 64);
+	sprintf(entry, "%s/%016lx/", cachedir, key);
+	if(stat(entry, &st) != 0 || !S_ISDIR(st.st_mode)) {
+		free(entry);
+		errno = 0;
+		return 0;
+	}
+	
+	/* entry holds the result files by suffix */
+	len = strlen(entry);
+	out_len = strlen(outputfilename);
+	filename = smalloc(out_len + 32);
+	strcpy(filename, outputfilename);
+	for(i = 0, n = 0; cacheSuffixes[i]; ++i) {
+		strcpy(entry + len, cacheSuffixes[i] + 1);
+		strcpy(filename + out_len, cacheSuffixes[i]);
+		if(stat(entry, &st) == 0) {
+			if(!cacheCopy(entry, filename)) {
+				fprintf(stderr, "Could not restore cached results:\t%s\n", filename);
+				exit(1);
+			}
+			++n;
+		}
+	}
+	free(entry);
+	free(filename);
+	errno = 0;
+	
+	return n;
+}
+
+int kmaCache_store(char *cachedir, char *outputfilename, long unsigned key, time_t start) {
+	
+	int i, len, out_len;
+	char *entry, *tmpentry, *filename;
+	struct stat st;
+	
+	if(mkdir(cachedir, 0777) && errno != EEXIST) {
+		fprintf(stderr, "Could not use cache directory:\t%s\n", cachedir);
+		errno = 0;
+		return 1;
+	}
+	len = strlen(cachedir);
+	entry = smalloc(len + 64);
+	tmpentry = smalloc(len + 96);
+	sprintf(entry, "%s/%016lx", cachedir, key);
+	sprintf(tmpentry, "%s/%016lx.%d", cachedir, key, (int) getpid());
+	if(mkdir(tmpentry, 0777)) {
+		free(entry);
+		free(tmpentry);
+		errno = 0;
+		return 1;
+	}
+	
+	/* files written by this run, older ones are left from other runs */
+	len = strlen(tmpentry);
+	tmpentry[len++] = '/';
+	out_len = strlen(outputfilename);
+	filename = smalloc(out_len + 32);
+	strcpy(filename, outputfilename);
+	for(i = 0; cacheSuffixes[i]; ++i) {
+		strcpy(filename + out_len, cacheSuffixes[i]);
+		strcpy(tmpentry + len, cacheSuffixes[i] + 1);
+		if(stat(filename, &st) == 0 && start <= st.st_mtime) {
+			cacheCopy(filename, tmpentry);
+		}
+	}
+	
+	/* publish the entry in one step, a concurrent run may have beaten us */
+	tmpentry[--len] = 0;
+	if(rename(tmpentry, entry)) {
+		for(i = 0; cacheSuffixes[i]; ++i) {
+			tmpentry[len] = '/';
+			strcpy(tmpentry + len + 1, cacheSuffixes[i] + 1);
+			unlink(tmpentry);
+		}
+		tmpentry[len] = 0;
+		rmdir(tmpentry);
+	}
+	free(entry);
+	free(tmpentry);
+	free(filename);
+	errno = 0;
+	
+	return 0;
+}
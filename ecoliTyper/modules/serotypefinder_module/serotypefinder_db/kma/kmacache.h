@@ -0,0 +1,34 @@
+/* Philip T.L.C. Clausen Sep 2021 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2021, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <time.h>
+
+/*
+ "-cache <dir>" keeps the results of finished runs in <dir>/<key>, where
+ the key sums the version of kma, the options, the content of the input
+ files and the content of the databases. Output names and -t are left
+ out of the key. An updated database gives new keys, so old entries are
+ simply never hit again. Runs reading stdin or writing to stdout are not
+ cached. kmaCache_sum is the key without the cache conditions, and with
+ the inputs left out unless asked for, as used by -resume and -incr.
+*/
+long unsigned kmaCache_sum(int argc, char *argv[], int inputs);
+long unsigned kmaCache_key(int argc, char *argv[], char **cachedir, char **outputfilename);
+int kmaCache_load(char *cachedir, char *outputfilename, long unsigned key);
+int kmaCache_store(char *cachedir, char *outputfilename, long unsigned key, time_t start);
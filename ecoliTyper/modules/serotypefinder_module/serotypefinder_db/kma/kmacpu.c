@@ -0,0 +1,103 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _GNU_SOURCE /* getauxval */
+#include <stdio.h>
+#if defined(__linux__) && defined(__aarch64__)
+#include <sys/auxv.h>
+#endif
+#undef _XOPEN_SOURCE
+#include "kmacpu.h"
+
+unsigned kmaCpu = 0;
+const KmaKernel kmaCpuScalar[] = {{0, "scalar"}, {0, 0}};
+static int kmaCpuSet = 0;
+static const char *kmaCpuFeatures[CPU_FEATURES] = {"sse4.2", "avx2", "avx512", "neon", "sve"};
+static const char *kmaCpuSlots[CPU_SLOTS] = {"NW", "Seqscan", "HashMap", "KmerScan", "Consensus", "Fuzzy"};
+static const char *kmaCpuPicks[CPU_SLOTS] = {0, 0, 0, 0, 0, 0};
+
+unsigned kmaCpu_init(void) {
+	
+	if(kmaCpuSet) {
+		return kmaCpu;
+	}
+	kmaCpu = 0;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("sse4.2")) {
+		kmaCpu |= CPU_SSE42;
+	}
+	if(__builtin_cpu_supports("avx2")) {
+		kmaCpu |= CPU_AVX2;
+	}
+	if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+		kmaCpu |= CPU_AVX512;
+	}
+#elif defined(__aarch64__)
+	kmaCpu |= CPU_NEON;
+#if defined(__linux__) && defined(HWCAP_SVE)
+	if(getauxval(AT_HWCAP) & HWCAP_SVE) {
+		kmaCpu |= CPU_SVE;
+	}
+#endif
+#endif
+	kmaCpuSet = 1;
+	
+	return kmaCpu;
+}
+
+unsigned kmaCpu_pick(int slot, const KmaKernel *kernels) {
+	
+	kmaCpu_init();
+	while(kernels[1].name && (kernels->need & kmaCpu) != kernels->need) {
+		++kernels;
+	}
+	kmaCpuPicks[slot] = kernels->name;
+	
+	return kernels->need;
+}
+
+void kmaCpu_print(FILE *out, int json) {
+	
+	int i, n;
+	
+	if(json) {
+		fprintf(out, "\t\"CPU\": {\"Features\": \"");
+	} else {
+		fprintf(out, "# CPU features:");
+	}
+	for(i = 0, n = 0; i < CPU_FEATURES; ++i) {
+		if(kmaCpu & (1 << i)) {
+			fprintf(out, "%s%s", (n++ || !json) ? " " : "", kmaCpuFeatures[i]);
+		}
+	}
+	if(!n && !json) {
+		fprintf(out, " none");
+	}
+	fprintf(out, json ? "\"" : ".\n# Kernels:");
+	for(i = 0, n = 0; i < CPU_SLOTS; ++i) {
+		if(kmaCpuPicks[i]) {
+			if(json) {
+				fprintf(out, ", \"%s\": \"%s\"", kmaCpuSlots[i], kmaCpuPicks[i]);
+			} else {
+				fprintf(out, "%s %s %s", n++ ? "," : "", kmaCpuSlots[i], kmaCpuPicks[i]);
+			}
+		}
+	}
+	fprintf(out, json ? "},\n" : ".\n");
+}
@@ -0,0 +1,56 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+
+#ifndef KMACPU
+typedef struct kmaKernel KmaKernel;
+struct kmaKernel {
+	unsigned need; /* cpu features used */
+	const char *name;
+};
+
+/* cpu features */
+#define CPU_SSE42 1
+#define CPU_AVX2 2
+#define CPU_AVX512 4
+#define CPU_NEON 8
+#define CPU_SVE 16
+#define CPU_FEATURES 5
+
+/* dispatched slots */
+#define CPU_NW 0
+#define CPU_SEQSCAN 1
+#define CPU_HASHMAP 2
+#define CPU_KMERSCAN 3
+#define CPU_CONSENSUS 4
+#define CPU_FUZZY 5
+#define CPU_SLOTS 6
+
+#define KMACPU 1
+#endif
+
+/* features of the running cpu, detected once */
+extern unsigned kmaCpu;
+/* for slots without vector kernels */
+extern const KmaKernel kmaCpuScalar[];
+unsigned kmaCpu_init(void);
+/* first kernel the cpu can run, kernels are listed widest first and end with name 0 */
+unsigned kmaCpu_pick(int slot, const KmaKernel *kernels);
+void kmaCpu_print(FILE *out, int json);
@@ -0,0 +1,167 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "align.h"
+#include "alnfrags.h"
+#include "kmactx.h"
+#include "kmmap.h"
+#include "numa.h"
+#include "pherror.h"
+#include "sam.h"
+#include "savekmers.h"
+#include "stdstat.h"
+
+static pthread_mutex_t kmaLock = PTHREAD_MUTEX_INITIALIZER;
+static KmaContext kmaDefaults;
+static int kmaDefaultsSet = 0;
+static void (*hitPtr)(void *, const KmaHit *) = 0;
+static void *hitArg = 0;
+
+void kmaContext_save(KmaContext *dest) {
+	
+	dest->kmaPipe = kmaPipe;
+	dest->hashMapKMA_destroy = hashMapKMA_destroy;
+	dest->printPtr = printPtr;
+	dest->printPairPtr = printPairPtr;
+	dest->deConPrintPtr = deConPrintPtr;
+	dest->printFsa_ptr = printFsa_ptr;
+	dest->printFsa_pair_ptr = printFsa_pair_ptr;
+	dest->ankerPtr = ankerPtr;
+	dest->kmerScan = kmerScan;
+	dest->save_kmers_pair = save_kmers_pair;
+	dest->get_kmers_for_pair_ptr = get_kmers_for_pair_ptr;
+	dest->getMatch = getMatch;
+	dest->getMatchSparse = getMatchSparse;
+	dest->getSecondForce = getSecondForce;
+	dest->getSecondPen = getSecondPen;
+	dest->getF = getF;
+	dest->getR = getR;
+	dest->getChainTemplates = getChainTemplates;
+	dest->kmerAnkerScore = kmerAnkerScore;
+	dest->testExtension = testExtension;
+	dest->proxiTestBest = proxiTestBest;
+	dest->getBestAnker = getBestAnker;
+	dest->getTieAnker = getTieAnker;
+	dest->alignLoadPtr = alignLoadPtr;
+	dest->nameLoadPtr = nameLoadPtr;
+	dest->nameSkipPtr = nameSkipPtr;
+	dest->alnFragsPE = alnFragsPE;
+	dest->leadTailAlnPtr = leadTailAlnPtr;
+	dest->trailTailAlnPtr = trailTailAlnPtr;
+	dest->chainSeedsPtr = chainSeedsPtr;
+	dest->trimSeedsPtr = trimSeedsPtr;
+	dest->assembly_KMA_Ptr = assembly_KMA_Ptr;
+	dest->significantBase = significantBase;
+	dest->baseCall = baseCall;
+	dest->alnToMatPtr = alnToMatPtr;
+	dest->updateMatrixPtr = updateMatrixPtr;
+	dest->ConClavePtr = ConClavePtr;
+	dest->ConClave2Ptr = ConClave2Ptr;
+	dest->cmp = cmp;
+	dest->hitPtr = hitPtr;
+	dest->hitArg = hitArg;
+}
+
+void kmaContext_load(const KmaContext *src) {
+	
+	kmaPipe = src->kmaPipe;
+	hashMapKMA_destroy = src->hashMapKMA_destroy;
+	printPtr = src->printPtr;
+	printPairPtr = src->printPairPtr;
+	deConPrintPtr = src->deConPrintPtr;
+	printFsa_ptr = src->printFsa_ptr;
+	printFsa_pair_ptr = src->printFsa_pair_ptr;
+	ankerPtr = src->ankerPtr;
+	kmerScan = src->kmerScan;
+	save_kmers_pair = src->save_kmers_pair;
+	get_kmers_for_pair_ptr = src->get_kmers_for_pair_ptr;
+	getMatch = src->getMatch;
+	getMatchSparse = src->getMatchSparse;
+	getSecondForce = src->getSecondForce;
+	getSecondPen = src->getSecondPen;
+	getF = src->getF;
+	getR = src->getR;
+	getChainTemplates = src->getChainTemplates;
+	kmerAnkerScore = src->kmerAnkerScore;
+	testExtension = src->testExtension;
+	proxiTestBest = src->proxiTestBest;
+	getBestAnker = src->getBestAnker;
+	getTieAnker = src->getTieAnker;
+	kmaContext_loadAln(src);
+}
+
+void kmaContext_loadAln(const KmaContext *src) {
+	
+	/* only what the k-mer search, running next to the alignment, leaves alone */
+	alignLoadPtr = src->alignLoadPtr;
+	nameLoadPtr = src->nameLoadPtr;
+	nameSkipPtr = src->nameSkipPtr;
+	alnFragsPE = src->alnFragsPE;
+	leadTailAlnPtr = src->leadTailAlnPtr;
+	trailTailAlnPtr = src->trailTailAlnPtr;
+	chainSeedsPtr = src->chainSeedsPtr;
+	trimSeedsPtr = src->trimSeedsPtr;
+	assembly_KMA_Ptr = src->assembly_KMA_Ptr;
+	significantBase = src->significantBase;
+	baseCall = src->baseCall;
+	alnToMatPtr = src->alnToMatPtr;
+	updateMatrixPtr = src->updateMatrixPtr;
+	ConClavePtr = src->ConClavePtr;
+	ConClave2Ptr = src->ConClave2Ptr;
+	cmp = src->cmp;
+}
+
+void kmaContext_enter(void) {
+	
+	/* one top level run at a time, starting from the defaults */
+	if((errno = pthread_mutex_lock(&kmaLock))) {
+		ERROR();
+	} else if(!kmaDefaultsSet) {
+		kmaContext_save(&kmaDefaults);
+		kmaDefaultsSet = 1;
+	} else {
+		kmaContext_load(&kmaDefaults);
+		setHugePages(0);
+		setMmapLoad(MMAPDEFAULT);
+		setNuma(0);
+		setAlnBatch(0);
+		setQuickProbes(0);
+		setXdrop(0);
+		setAlnStride(0);
+		setBam(0);
+		kmaContext_setHits(0, 0);
+	}
+}
+
+void kmaContext_leave(void) {
+	
+	if((errno = pthread_mutex_unlock(&kmaLock))) {
+		ERROR();
+	}
+}
+
+void kmaContext_setHits(void (*hit)(void *, const KmaHit *), void *arg) {
+	hitPtr = hit;
+	hitArg = arg;
+}
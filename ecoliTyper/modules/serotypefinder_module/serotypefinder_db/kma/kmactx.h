@@ -0,0 +1,152 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include "align.h"
+#include "alnfrags.h"
+#include "ankers.h"
+#include "assembly.h"
+#include "chain.h"
+#include "compdna.h"
+#include "conclave.h"
+#include "dbmap.h"
+#include "filebuff.h"
+#include "hashmapcci.h"
+#include "hashmapkma.h"
+#include "kmapipe.h"
+#include "kmeranker.h"
+#include "penalties.h"
+#include "qseqs.h"
+#include "runinput.h"
+#include "savekmers.h"
+
+#ifndef KMACTX
+typedef struct kmaHit KmaHit;
+typedef struct kmaContext KmaContext;
+struct kmaHit {
+	char *name;
+	long score;
+	unsigned expected;
+	int t_len;
+	double id;
+	double cover;
+	double q_id;
+	double q_cover;
+	double depth;
+	double q_value;
+	double p_value;
+};
+
+struct kmaContext {
+	/* k-mer search */
+	FILE * (*kmaPipe)(const char*, const char*, FILE*, int*);
+	void (*hashMapKMA_destroy)(HashMapKMA *);
+	int (*printPtr)(int*, CompDNA*, int, const Qseqs*, const int, FILE *out);
+	int (*printPairPtr)(int*, CompDNA*, int, const Qseqs*, CompDNA*, int, const Qseqs*, const int flag, const int flag_r, FILE *out);
+	int (*deConPrintPtr)(int*, CompDNA*, int, const Qseqs*, const int flag, FILE *out);
+	void (*printFsa_ptr)(Qseqs*, Qseqs*, Qseqs*, CompDNA*, FILE*);
+	void (*printFsa_pair_ptr)(Qseqs*, Qseqs*, Qseqs*, Qseqs*, Qseqs*, Qseqs*, CompDNA*, FILE*);
+	void (*ankerPtr)(int*, int*, int*, char*, int*, unsigned**, unsigned**, int*, CompDNA*, int, int, int, int, Qseqs*, volatile int*, FILE*);
+	int (*kmerScan)(const HashMapKMA *, const Penalties *, int*, int*, int*, int*, CompDNA*, CompDNA*, Qseqs*, int*, const int, volatile int*, FILE*);
+	int (*save_kmers_pair)(const HashMapKMA *, const Penalties *, int*, int*, int*, int*, int*, int*, CompDNA*, CompDNA*, const Qseqs*, const Qseqs*, int*, const int, volatile int*, FILE*);
+	int (*get_kmers_for_pair_ptr)(const HashMapKMA *, const Penalties *, int *, int *, int *, int *, CompDNA *, int *, int);
+	int (*getMatch)(int*, int*);
+	int (*getMatchSparse)(int*, int*, int, int, int, int);
+	int (*getSecondForce)(int*, int*, int*, int*, int*, int*);
+	int (*getSecondPen)(int*, int*, int*, int*, int*, int*, int, int);
+	int (*getF)(int*, int*, int*, int*, int*);
+	int (*getR)(int*, int*, int*, int*, int*);
+	KmerAnker * (*getChainTemplates)(KmerAnker*, const Penalties*, const int*, const int, const int, const int, int*, int*, int*, char*);
+	int (*kmerAnkerScore)(KmerAnker*);
+	const int (*testExtension)(const int, const int, const int);
+	const int (*proxiTestBest)(const double, const int, const int, const int, const int);
+	KmerAnker * (*getBestAnker)(KmerAnker**, unsigned*, const int*);
+	KmerAnker * (*getTieAnker)(int, KmerAnker*, const KmerAnker*);
+	
+	/* alignment and assembly */
+	HashMapCCI * (*alignLoadPtr)(HashMapCCI *, int, int, int, long unsigned);
+	char * (*nameLoadPtr)(Qseqs *, FILE *, int);
+	void (*nameSkipPtr)(FILE *);
+	int (*alnFragsPE)(HashMapCCI**, int*, int*, int, double, double, double, int, CompDNA*, CompDNA*, CompDNA*, CompDNA*, unsigned char*, unsigned char*, unsigned char*, unsigned char*, Qseqs*, Qseqs*, int, int*, int*, long unsigned*, long unsigned*, int*, int*, int*, int*, int*, int*, int, long*, FILE*, AlnPoints*, NWmat*, volatile int*, volatile int*);
+	AlnScore (*leadTailAlnPtr)(Aln *, Aln *, const long unsigned*, const unsigned char*, int, int, int, const int, NWmat *);
+	void (*trailTailAlnPtr)(Aln *, Aln *, AlnScore *, const long unsigned *, const unsigned char *, int, int, int, int, const int, NWmat *);
+	int (*chainSeedsPtr)(AlnPoints *, int, int, int, unsigned *);
+	void (*trimSeedsPtr)(AlnPoints *points, int start);
+	void * (*assembly_KMA_Ptr)(void *);
+	int (*significantBase)(int, int, double);
+	unsigned char (*baseCall)(unsigned char, unsigned char, int, int, double, Assembly*);
+	void (*alnToMatPtr)(AssemInfo *, Assem *, Aln *, AlnScore, int, int);
+	void (*updateMatrixPtr)(FileBuff *, char *, long unsigned *, AssemInfo *, int);
+	int (*ConClavePtr)(FILE *, FILE ***, int, int, long unsigned *, unsigned *, unsigned *, long unsigned *, long unsigned *, int *, Qseqs *, Qseqs *, int *, int *, int *, Frag **);
+	int (*ConClave2Ptr)(FILE *, FILE ***, int, int, long unsigned *, unsigned *, unsigned *, long unsigned *, long unsigned *, int *, Qseqs *, Qseqs *, int *, int *, int *, Frag **, long unsigned, double, double);
+	int (*cmp)(int, int);
+	
+	/* receives the lines of *.res instead of the file, when set */
+	void (*hitPtr)(void *, const KmaHit *);
+	void *hitArg;
+	
+	/* parameters of runKMA and runKMA_MEM */
+	int ConClave;
+	int kmersize;
+	int minlen;
+	Penalties *rewards;
+	int extendedFeatures;
+	double ID_t;
+	double Depth_t;
+	int mq;
+	double scoreT;
+	double mrc;
+	double minFrac;
+	double evalue;
+	double support;
+	int bcd;
+	int ref_fsa;
+	int print_matrix;
+	int print_all;
+	long unsigned tsv;
+	int vcf;
+	int xml;
+	int sam;
+	int nc;
+	int nf;
+	unsigned shm;
+	int thread_num;
+	int maxFrag;
+	int verbose;
+	unsigned preset;
+	long unsigned resume;
+	char *incr;
+	long unsigned incrKey;
+	int bins;
+};
+#define KMACTX 1
+#endif
+
+/*
+ A KmaContext holds the dispatch table chosen by the options, and the
+ parameters of the mapping. kma_main runs top level calls under
+ kmaContext_enter, which starts them from the defaults, so several
+ configurations can be run after each other in one process.
+*/
+void kmaContext_save(KmaContext *dest);
+void kmaContext_load(const KmaContext *src);
+void kmaContext_loadAln(const KmaContext *src);
+void kmaContext_enter(void);
+void kmaContext_leave(void);
+void kmaContext_setHits(void (*hit)(void *, const KmaHit *), void *arg);
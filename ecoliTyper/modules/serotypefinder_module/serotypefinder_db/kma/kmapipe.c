@@ -16,15 +16,13 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
 */
-#define _XOPEN_SOURCE 600
+#define _GNU_SOURCE /* fopencookie */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <pthread.h>
+#include <time.h>
 #include <unistd.h>
-#include "kma.h"
-#include "kmapipe.h"
-#include "pherror.h"
-#include "threader.h"
 #ifdef _WIN32
 #include <windows.h>
 #else
@@ -32,8 +30,14 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #endif
+#undef _XOPEN_SOURCE
+#include "kma.h"
+#include "kmapipe.h"
+#include "kmatrace.h"
+#include "pherror.h"
+#include "threader.h"
 
-FILE * (*kmaPipe)(const char*, const char*, FILE*, int*) = &kmaPipeThread;
+FILE * (*kmaPipe)(const char*, const char*, FILE*, int*) = &kmaPipeRing;
 
 void * pipeThreader(void *arg) {
 	
@@ -201,6 +205,7 @@ FILE * kmaPipeFork(const char *cmd, const char *type, FILE *ioStream, int *statu
 			
 			/* close stream */
 			fclose(dest->ioStream);
+			kmaTrace_flush();
 			
 			/* kill child */
 			_exit(exit_status);
@@ -273,3 +278,224 @@ FILE * kmaPipeFork(const char *cmd, const char *type, FILE *ioStream, int *statu
 		return 0;
 	}
 }
+
+FILE * kmaPipeFile(const char *cmd, const char *type, FILE *ioStream, int *status) {
+	
+	/* stand in for a pipe, with cmd naming a file holding its output */
+	if(cmd && type) {
+		return sfopen(cmd, type);
+	}
+	*status = fclose(ioStream) ? 1 : 0;
+	
+	return 0;
+}
+
+#ifdef __GLIBC__
+static ssize_t pipeRingRead(void *cookie, char *buf, size_t size) {
+	
+	long unsigned avail, start, len;
+	PipeRing *ring = cookie;
+	
+	/* wait for data or end of stream */
+	while((avail = ring->head - ring->tail) == 0) {
+		if(ring->wclosed) {
+			if((avail = ring->head - ring->tail) == 0) {
+				return 0;
+			}
+			break;
+		}
+		/* park until the writer moves head or closes */
+		lock(&ring->readable);
+	}
+	__sync_synchronize();
+	if(size < avail) {
+		avail = size;
+	}
+	
+	/* copy around the end of the ring */
+	start = ring->tail % ring->size;
+	len = ring->size - start;
+	if(avail <= len) {
+		memcpy(buf, ring->buff + start, avail);
+	} else {
+		memcpy(buf, ring->buff + start, len);
+		memcpy(buf + len, ring->buff, avail - len);
+	}
+	__sync_synchronize();
+	ring->tail += avail;
+	unlock(&ring->writable);
+	
+	return avail;
+}
+
+static ssize_t pipeRingWrite(void *cookie, const char *buf, size_t size) {
+	
+	long unsigned avail, start, len, written;
+	PipeRing *ring = cookie;
+	
+	written = 0;
+	while(written < size) {
+		/* wait for space */
+		while((avail = ring->size - (ring->head - ring->tail)) == 0) {
+			if(ring->rclosed) {
+				errno = EPIPE;
+				return written ? written : -1;
+			}
+			/* park until the reader moves tail or closes */
+			lock(&ring->writable);
+		}
+		__sync_synchronize();
+		if(size - written < avail) {
+			avail = size - written;
+		}
+		
+		start = ring->head % ring->size;
+		len = ring->size - start;
+		if(avail <= len) {
+			memcpy(ring->buff + start, buf, avail);
+		} else {
+			memcpy(ring->buff + start, buf, len);
+			memcpy(ring->buff, buf + len, avail - len);
+		}
+		__sync_synchronize();
+		ring->head += avail;
+		unlock(&ring->readable);
+		buf += avail;
+		written += avail;
+	}
+	
+	return written;
+}
+
+static void pipeRingRelease(PipeRing *ring) {
+	
+	if(__sync_sub_and_fetch(&ring->ref, 1) == 0) {
+		free(ring->buff);
+		free(ring);
+	}
+}
+
+static int pipeRingCloseRead(void *cookie) {
+	
+	PipeRing *ring = cookie;
+	
+	ring->rclosed = 1;
+	unlock(&ring->writable);
+	pipeRingRelease(ring);
+	
+	return 0;
+}
+
+static int pipeRingCloseWrite(void *cookie) {
+	
+	PipeRing *ring = cookie;
+	
+	__sync_synchronize();
+	ring->wclosed = 1;
+	unlock(&ring->readable);
+	pipeRingRelease(ring);
+	
+	return 0;
+}
+
+static void pipeRingOpen(FILE **rd, FILE **wr) {
+	
+	PipeRing *ring;
+	cookie_io_functions_t rfuncs = {&pipeRingRead, NULL, NULL, &pipeRingCloseRead};
+	cookie_io_functions_t wfuncs = {NULL, &pipeRingWrite, NULL, &pipeRingCloseWrite};
+	
+	ring = smalloc(sizeof(PipeRing));
+	ring->head = 0;
+	ring->tail = 0;
+	ring->wclosed = 0;
+	ring->rclosed = 0;
+	ring->readable = 1;
+	ring->writable = 1;
+	ring->ref = 2;
+	ring->size = PIPERING;
+	ring->buff = smalloc(ring->size);
+	
+	if(!(*rd = fopencookie(ring, "rb", rfuncs)) || !(*wr = fopencookie(ring, "wb", wfuncs))) {
+		ERROR();
+	}
+}
+
+FILE * kmaPipeRing(const char *cmd, const char *type, FILE *ioStream, int *status) {
+	
+	/* same as kmaPipeThread, but the stream is kept in an in-process ring */
+	static volatile int Lock = 0;
+	static Pid *pidlist = 0;
+	volatile int *lock = &Lock;
+	pthread_t id;
+	Pid *src, *last, *dest;
+	
+	if(cmd && type) {
+		/* check mode */
+		if((*type != 'r' && *type != 'w') || (type[1] != 0 && type[2] != 0)) {
+			errno = EINVAL;
+			ERROR();
+		}
+		
+		/* create ring */
+		dest = smalloc(sizeof(Pid));
+		dest->cmd = (char *) cmd;
+		if (*type == 'r') {
+			pipeRingOpen(&dest->fp, &dest->ioStream);
+		} else {
+			pipeRingOpen(&dest->ioStream, &dest->fp);
+		}
+		
+		/* spawn thread */
+		if((errno = pthread_create(&dest->id, NULL, &pipeThreader, dest))) {
+			ERROR();
+		}
+		
+		/* Link into list of file descriptors. */
+		lock(lock);
+		dest->next = pidlist;
+		pidlist = dest;
+		unlock(lock);
+		
+		return dest->fp;
+	} else {
+		*status = 0;
+		/* Get stream. */
+		lock(lock);
+		for(src = pidlist; src && src->fp != ioStream; src = src->next);
+		unlock(lock);
+		if(!src) {
+			*status = 1;
+			return 0;
+		}
+		
+		/* join and close */
+		id = src->id;
+		if((errno = pthread_join(id, NULL))) {
+			ERROR();
+		}
+		fclose(ioStream);
+		
+		/* Remove the entry from the linked list. */
+		lock(lock);
+		for(last = 0, src = pidlist; src && src->id != id; last = src, src = src->next);
+		if(!src) {
+			unlock(lock);
+			*status = 1;
+			return 0;
+		} else if(!last) {
+			pidlist = src->next;
+		} else {
+			last->next = src->next;
+		}
+		unlock(lock);
+		free(src);
+		
+		return 0;
+	}
+}
+#else
+FILE * kmaPipeRing(const char *cmd, const char *type, FILE *ioStream, int *status) {
+	/* no cookie streams, fall back to kernel pipe */
+	return kmaPipeThread(cmd, type, ioStream, status);
+}
+#endif
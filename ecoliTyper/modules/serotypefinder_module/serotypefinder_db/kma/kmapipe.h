@@ -26,6 +26,7 @@
 
 #ifndef KMAPIPE
 typedef struct pid Pid;
+typedef struct pipeRing PipeRing;
 
 struct pid {
 	pthread_t id;
@@ -36,7 +37,20 @@ struct pid {
 	struct pid *next;
 };
 
+struct pipeRing {
+	volatile long unsigned head; /* bytes written */
+	volatile long unsigned tail; /* bytes read */
+	volatile int wclosed;
+	volatile int rclosed;
+	volatile int readable; /* held until the writer signals data */
+	volatile int writable; /* held until the reader signals space */
+	volatile int ref;
+	long unsigned size;
+	unsigned char *buff;
+};
+
 #define KMAPIPE 1
+#define PIPERING 8388608
 #endif
 
 /* open or close pipe */
@@ -44,3 +58,7 @@ extern FILE * (*kmaPipe)(const char*, const char*, FILE*, int*);
 void * pipeThreader(void *arg);
 FILE * kmaPipeThread(const char *cmd, const char *type, FILE *ioStream, int *status);
 FILE * kmaPipeFork(const char *cmd, const char *type, FILE *ioStream, int *status);
+/* cmd names a file with the output of that step */
+FILE * kmaPipeFile(const char *cmd, const char *type, FILE *ioStream, int *status);
+/* in-process ring, no kernel pipe */
+FILE * kmaPipeRing(const char *cmd, const char *type, FILE *ioStream, int *status);
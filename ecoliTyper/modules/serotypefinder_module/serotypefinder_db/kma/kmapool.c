@@ -0,0 +1,136 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "kmapool.h"
+#include "kmastat.h"
+#include "kmatrace.h"
+#include "numa.h"
+#include "pherror.h"
+#include "threader.h"
+
+static volatile int poolExclude = 0;
+static KmaWorker *poolWorkers = 0;
+static long unsigned poolStarted = 0, poolTasks = 0;
+
+static void kmaPool_child(void) {
+	
+	/* the workers are not copied into a forked child */
+	poolExclude = 0;
+	poolWorkers = 0;
+	poolStarted = 0;
+	poolTasks = 0;
+}
+
+static void * kmaPool_worker(void *arg) {
+	
+	KmaWorker *worker = arg;
+	
+	pthread_mutex_lock(&worker->mutex);
+	while(1) {
+		/* sleep until handed a task */
+		while(worker->state != 1) {
+			pthread_cond_wait(&worker->cond, &worker->mutex);
+		}
+		pthread_mutex_unlock(&worker->mutex);
+		worker->ret = worker->func(worker->arg);
+		
+		/* as on thread exit */
+		kmaStat_flush();
+		kmaTrace_flush();
+		pthread_mutex_lock(&worker->mutex);
+		worker->state = 2;
+		pthread_cond_broadcast(&worker->cond);
+	}
+	
+	return NULL;
+}
+
+int kmaPool_create(KmaWorker **dest, int num, void * (*func)(void *), void *arg) {
+	
+	static int init = 0;
+	pthread_attr_t *attr;
+	KmaWorker *worker;
+	
+	/* find an idle worker with the same placement */
+	lock(&poolExclude);
+	attr = num < 0 ? NULL : numaThread(num);
+	num = attr ? num : -1;
+	if(!init) {
+		if((errno = pthread_atfork(0, 0, &kmaPool_child))) {
+			unlock(&poolExclude);
+			return errno;
+		}
+		init = 1;
+	}
+	for(worker = poolWorkers; worker && (worker->busy || worker->num != num); worker = worker->next);
+	if(!worker) {
+		worker = smalloc(sizeof(KmaWorker));
+		worker->num = num;
+		worker->state = 0;
+		if((errno = pthread_mutex_init(&worker->mutex, NULL)) || (errno = pthread_cond_init(&worker->cond, NULL)) || (errno = pthread_create(&worker->id, attr, &kmaPool_worker, worker))) {
+			unlock(&poolExclude);
+			free(worker);
+			return errno;
+		}
+		pthread_detach(worker->id);
+		worker->next = poolWorkers;
+		poolWorkers = worker;
+		++poolStarted;
+	}
+	worker->busy = 1;
+	++poolTasks;
+	unlock(&poolExclude);
+	
+	/* hand over the task */
+	pthread_mutex_lock(&worker->mutex);
+	worker->func = func;
+	worker->arg = arg;
+	worker->state = 1;
+	pthread_cond_signal(&worker->cond);
+	pthread_mutex_unlock(&worker->mutex);
+	*dest = worker;
+	
+	return 0;
+}
+
+int kmaPool_join(KmaWorker *src, void **ret) {
+	
+	/* wait for the task, and return the worker to the pool */
+	pthread_mutex_lock(&src->mutex);
+	while(src->state != 2) {
+		pthread_cond_wait(&src->cond, &src->mutex);
+	}
+	src->state = 0;
+	pthread_mutex_unlock(&src->mutex);
+	if(ret) {
+		*ret = src->ret;
+	}
+	lock(&poolExclude);
+	src->busy = 0;
+	unlock(&poolExclude);
+	
+	return 0;
+}
+
+void kmaPool_report(FILE *out) {
+	fprintf(out, "# Worker pool:\t%lu threads started for %lu stage tasks.\n", poolStarted, poolTasks);
+}
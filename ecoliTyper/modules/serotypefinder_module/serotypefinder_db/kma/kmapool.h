@@ -0,0 +1,47 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#include <pthread.h>
+#include <stdio.h>
+
+#ifndef KMAPOOL
+typedef struct kmaWorker KmaWorker;
+struct kmaWorker {
+	int num; /* pinned as numaThread(num), -1 when not pinned */
+	int busy;
+	int state; /* 0 idle, 1 running, 2 done */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	void * (*func)(void *);
+	void *arg;
+	void *ret;
+	pthread_t id;
+	KmaWorker *next;
+};
+#define KMAPOOL 1
+#endif
+
+/*
+ Stage threads are handed to persistent workers instead of created and
+ joined per stage. A task goes to an idle worker with the same placement,
+ and the pool only grows when every such worker is busy, so tasks that
+ wait on each other always run at the same time.
+*/
+int kmaPool_create(KmaWorker **dest, int num, void * (*func)(void *), void *arg);
+int kmaPool_join(KmaWorker *src, void **ret);
+void kmaPool_report(FILE *out);
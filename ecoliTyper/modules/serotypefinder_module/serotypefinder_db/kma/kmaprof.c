@@ -0,0 +1,230 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _GNU_SOURCE /* MAP_ANONYMOUS, MAP_NORESERVE */
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+#undef _XOPEN_SOURCE
+#include "hashmapkma.h"
+#include "kmaprof.h"
+#include "pherror.h"
+#include "qseqs.h"
+#include "runkma.h"
+
+KmaProf *kmaProfs = 0;
+static unsigned * (*profGet)(const HashMapKMA *, const long unsigned) = 0;
+static void (*profGetBatch)(const HashMapKMA *, const long unsigned *, int, unsigned **) = 0;
+static __thread unsigned profTick = 0;
+
+KmaProf * kmaProf_init(unsigned period) {
+	
+	/* anonymous shared mapping, so stages forked by -status count here too, 
+	template counters are only backed once touched */
+#ifdef _WIN32
+	kmaProfs = calloc(1, sizeof(KmaProf));
+#else
+	kmaProfs = mmap(0, sizeof(KmaProf), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(kmaProfs == MAP_FAILED) {
+		kmaProfs = 0;
+	}
+#endif
+	if(kmaProfs) {
+		kmaProfs->period = period < 1 ? 1 : period;
+	}
+	
+	return kmaProfs;
+}
+
+void kmaProf_destroy(void) {
+	
+	if(kmaProfs) {
+#ifdef _WIN32
+		free(kmaProfs);
+#else
+		munmap(kmaProfs, sizeof(KmaProf));
+#endif
+		kmaProfs = 0;
+	}
+}
+
+static void kmaProf_sample(const HashMapKMA *templates, const long unsigned key, const unsigned *values) {
+	
+	int i, n, prefix;
+	short unsigned *values_s;
+	
+	prefix = PROF_BASES < templates->kmersize ? key >> ((templates->kmersize - PROF_BASES) << 1) : key;
+	__sync_add_and_fetch(kmaProfs->probes + (prefix & (PROF_PREFIXES - 1)), 1);
+	__sync_add_and_fetch(&kmaProfs->sampled, 1);
+	if(!values) {
+		return;
+	}
+	__sync_add_and_fetch(kmaProfs->hits + (prefix & (PROF_PREFIXES - 1)), 1);
+	
+	/* value list length, and the templates in it */
+	if(templates->DB_size < USHRT_MAX) {
+		values_s = (short unsigned *) values;
+		n = *values_s;
+		for(i = 1; i <= n; ++i) {
+			__sync_add_and_fetch(kmaProfs->templates + (values_s[i] & (PROF_TEMPLATES - 1)), 1);
+		}
+	} else {
+		n = *values;
+		for(i = 1; i <= n; ++i) {
+			__sync_add_and_fetch(kmaProfs->templates + (values[i] & (PROF_TEMPLATES - 1)), 1);
+		}
+	}
+	for(i = 0; (2 << i) <= n && i < PROF_LENS - 1; ++i);
+	__sync_add_and_fetch(kmaProfs->lens + i, 1);
+	kmaProfs->DB_size = templates->DB_size;
+}
+
+static unsigned * hashMap_getProf(const HashMapKMA *templates, const long unsigned key) {
+	
+	unsigned *value;
+	
+	value = profGet(templates, key);
+	if(++profTick == kmaProfs->period) {
+		profTick = 0;
+		kmaProf_sample(templates, key, value);
+	}
+	
+	return value;
+}
+
+static void hashMap_getBatchProf(const HashMapKMA *templates, const long unsigned *keys, int n, unsigned **values) {
+	
+	int i;
+	
+	profGetBatch(templates, keys, n, values);
+	for(i = 0; i < n; ++i) {
+		if(++profTick == kmaProfs->period) {
+			profTick = 0;
+			kmaProf_sample(templates, keys[i], values[i]);
+		}
+	}
+}
+
+void kmaProf_hash(int on) {
+	
+	/* sample the chosen lookups */
+	if(on && kmaProfs && hashMap_get != &hashMap_getProf) {
+		profGet = hashMap_get;
+		profGetBatch = hashMap_getBatch;
+		hashMap_get = &hashMap_getProf;
+		hashMap_getBatch = &hashMap_getBatchProf;
+	} else if(!on && hashMap_get == &hashMap_getProf) {
+		hashMap_get = profGet;
+		hashMap_getBatch = profGetBatch;
+	}
+}
+
+static int cmpTemplates(const void *a, const void *b) {
+	
+	long unsigned A, B;
+	
+	A = kmaProfs->templates[*((const int *) a)];
+	B = kmaProfs->templates[*((const int *) b)];
+	
+	return A < B ? 1 : B < A ? -1 : *((const int *) a) - *((const int *) b);
+}
+
+int kmaProf_print(char *outputfilename, char *templatefilename) {
+	
+	int i, j, n, len, *order;
+	long unsigned probes;
+	char **names;
+	FILE *out, *name_file;
+	Qseqs *name;
+	
+	if(!kmaProfs) {
+		return 0;
+	}
+	
+	len = strlen(outputfilename);
+	strcpy(outputfilename + len, ".profile.tsv");
+	out = fopen(outputfilename, "w");
+	outputfilename[len] = 0;
+	if(!out) {
+		return 1;
+	}
+	fprintf(out, "## Sampled probes\t%lu\n", kmaProfs->sampled);
+	fprintf(out, "## Sampling period\t%u\n", kmaProfs->period);
+	
+	/* probes and hits per k-mer prefix */
+	fprintf(out, "## Prefix\tProbes\tHits\tHit rate\n");
+	for(i = 0; i < PROF_PREFIXES; ++i) {
+		if((probes = kmaProfs->probes[i])) {
+			for(j = PROF_BASES - 1; 0 <= j; --j) {
+				fputc("ACGT"[(i >> (j << 1)) & 3], out);
+			}
+			fprintf(out, "\t%lu\t%lu\t%f\n", probes, kmaProfs->hits[i], (double) kmaProfs->hits[i] / probes);
+		}
+	}
+	
+	/* length of the value lists hit */
+	fprintf(out, "## Value list length\tHits\n");
+	for(i = 0; i < PROF_LENS; ++i) {
+		if(kmaProfs->lens[i]) {
+			fprintf(out, "%u-%u\t%lu\n", 1U << i, (2U << i) - 1, kmaProfs->lens[i]);
+		}
+	}
+	
+	/* templates by hits */
+	n = kmaProfs->DB_size < PROF_TEMPLATES ? kmaProfs->DB_size : PROF_TEMPLATES;
+	order = smalloc((n + 1) * sizeof(int));
+	for(i = 0, j = 0; i < n; ++i) {
+		if(kmaProfs->templates[i]) {
+			order[j++] = i;
+		}
+	}
+	qsort(order, j, sizeof(int), cmpTemplates);
+	names = calloc(n + 1, sizeof(char *));
+	len = strlen(templatefilename);
+	strcpy(templatefilename + len, ".name");
+	name_file = (names && kmaProfs->DB_size <= PROF_TEMPLATES) ? fopen(templatefilename, "rb") : 0;
+	templatefilename[len] = 0;
+	if(name_file) {
+		name = setQseqs(256);
+		for(i = 1; i < n && nameLoad(name, name_file) && *name->seq; ++i) {
+			if(kmaProfs->templates[i]) {
+				names[i] = strdup((char *) name->seq);
+			}
+		}
+		destroyQseqs(name);
+		fclose(name_file);
+	}
+	fprintf(out, "## Template\tHits\tName\n");
+	for(i = 0; i < j; ++i) {
+		fprintf(out, "%d\t%lu\t%s\n", order[i], kmaProfs->templates[order[i]], (names && names[order[i]]) ? names[order[i]] : "");
+	}
+	if(names) {
+		for(i = 0; i <= n; ++i) {
+			free(names[i]);
+		}
+		free(names);
+	}
+	free(order);
+	fclose(out);
+	
+	return 0;
+}
@@ -0,0 +1,45 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+
+#ifndef KMAPROF
+#define PROF_BASES 6 /* k-mer prefix length of the prefix histogram */
+#define PROF_PREFIXES 4096
+#define PROF_LENS 33 /* value list lengths, in powers of two */
+#define PROF_TEMPLATES 1048576 /* templates beyond this share counters */
+
+typedef struct kmaProf KmaProf;
+struct kmaProf {
+	volatile long unsigned probes[PROF_PREFIXES];
+	volatile long unsigned hits[PROF_PREFIXES];
+	volatile long unsigned lens[PROF_LENS];
+	volatile long unsigned sampled;
+	unsigned period; /* one probe of each period is sampled */
+	int DB_size;
+	volatile long unsigned templates[PROF_TEMPLATES];
+};
+#define KMAPROF 1
+#endif
+
+/* shared with forked stages, 0 when not profiling */
+extern KmaProf *kmaProfs;
+KmaProf * kmaProf_init(unsigned period);
+void kmaProf_destroy(void);
+void kmaProf_hash(int on);
+int kmaProf_print(char *outputfilename, char *templatefilename);
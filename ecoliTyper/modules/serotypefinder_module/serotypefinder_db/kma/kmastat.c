@@ -0,0 +1,412 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _GNU_SOURCE /* MAP_ANONYMOUS */
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+#undef _XOPEN_SOURCE
+#include "hashmapkma.h"
+#include "kmacpu.h"
+#include "kmastat.h"
+#include "kmatrace.h"
+#include "pherror.h"
+
+KmaStat *kmaStats = 0;
+static const char *kmaStatStages[STAT_STAGES] = {"Input", "K-mer Mapping", "ConClave", "Alignment", "Assembly", "Output"};
+static unsigned * (*statGet)(const HashMapKMA *, const long unsigned) = 0;
+static void (*statGetBatch)(const HashMapKMA *, const long unsigned *, int, unsigned **) = 0;
+static __thread long unsigned statProbes = 0, statMisses = 0;
+static const char *kmaStatHwNames[STAT_HW] = {"Cycles", "Instructions", "LLC Misses", "dTLB Misses", "Branch Misses"};
+static int statHwKeyed = 0;
+static pthread_key_t statHwKey;
+static __thread int statHwOpen = 0, statHwFd[STAT_HW];
+
+KmaStat * kmaStat_init(void) {
+	
+	/* anonymous shared mapping, so stages forked by -status count here too */
+#ifdef _WIN32
+	kmaStats = calloc(1, sizeof(KmaStat));
+#else
+	kmaStats = mmap(0, sizeof(KmaStat), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(kmaStats == MAP_FAILED) {
+		kmaStats = 0;
+	}
+#endif
+	if(kmaStats) {
+		memset((void *) kmaStats, 0, sizeof(KmaStat));
+		kmaStats->start = kmaStat_ns();
+		kmaStats->born = time(0);
+	}
+	
+	return kmaStats;
+}
+
+void kmaStat_destroy(void) {
+	
+	if(kmaStats) {
+#ifdef _WIN32
+		free(kmaStats);
+#else
+		munmap(kmaStats, sizeof(KmaStat));
+#endif
+		kmaStats = 0;
+	}
+}
+
+long unsigned kmaStat_ns(void) {
+	
+	struct timespec now;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+static long unsigned kmaStat_thread_ns(void) {
+	
+	struct timespec now;
+	
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+static void kmaStat_hwClose(void *arg) {
+	
+	int i;
+	
+	/* thread exits */
+	for(i = 0; i < STAT_HW; ++i) {
+		if(0 <= statHwFd[i]) {
+			close(statHwFd[i]);
+		}
+	}
+	statHwOpen = 0;
+}
+
+static void kmaStat_hwChild(void) {
+	
+	int i;
+	
+	/* inherited counters follow the parent thread */
+	if(statHwOpen) {
+		for(i = 0; i < STAT_HW; ++i) {
+			if(0 <= statHwFd[i]) {
+				close(statHwFd[i]);
+			}
+		}
+		statHwOpen = 0;
+	}
+}
+
+static void kmaStat_hwOpen(void) {
+	
+	int i;
+#ifdef __linux__
+	static const unsigned types[STAT_HW] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE};
+	static const long unsigned configs[STAT_HW] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_CACHE_DTLB | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16, PERF_COUNT_HW_BRANCH_MISSES};
+	struct perf_event_attr attr;
+	
+	/* counters of this thread, in user space */
+	for(i = 0; i < STAT_HW; ++i) {
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = types[i];
+		attr.config = configs[i];
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		if(0 <= (statHwFd[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0))) {
+			__sync_fetch_and_or(&kmaStats->hwFlag, 1 << i);
+		}
+	}
+	errno = 0;
+#else
+	for(i = 0; i < STAT_HW; ++i) {
+		statHwFd[i] = -1;
+	}
+#endif
+	statHwOpen = 1;
+	pthread_setspecific(statHwKey, (void *) 1);
+}
+
+static void kmaStat_hwRead(long unsigned *v) {
+	
+	int i;
+	long unsigned buff[3];
+	
+	if(!statHwOpen) {
+		kmaStat_hwOpen();
+	}
+	
+	/* scale by the time counted, when multiplexed */
+	for(i = 0; i < STAT_HW; ++i) {
+		if(0 <= statHwFd[i] && read(statHwFd[i], buff, sizeof(buff)) == sizeof(buff) && buff[2]) {
+			v[i] = buff[2] < buff[1] ? (double) buff[0] * buff[1] / buff[2] : buff[0];
+		} else {
+			v[i] = 0;
+		}
+	}
+}
+
+static void kmaStat_hwAdd(int stage, const long unsigned *t) {
+	
+	int i;
+	long unsigned now[STAT_HW];
+	
+	kmaStat_hwRead(now);
+	for(i = 0; i < STAT_HW; ++i) {
+		if(t[i] < now[i]) {
+			__sync_add_and_fetch(kmaStats->hw[stage] + i, now[i] - t[i]);
+		}
+	}
+}
+
+void kmaStat_hw(void) {
+	
+	if(!kmaStats) {
+		return;
+	} else if(!statHwKeyed) {
+		/* once per process, kma_main may be run repeatedly */
+		if(pthread_key_create(&statHwKey, &kmaStat_hwClose) || pthread_atfork(0, 0, &kmaStat_hwChild)) {
+			return;
+		}
+		statHwKeyed = 1;
+	}
+	kmaStats->hwOn = 1;
+}
+
+void kmaStat_start(long unsigned *t) {
+	
+	if(kmaStats || 0 <= kmaTraceFd) {
+		t[0] = kmaStat_ns();
+		t[1] = kmaStat_thread_ns();
+	}
+	if(kmaStats && kmaStats->hwOn) {
+		kmaStat_hwRead(t + 2);
+	}
+}
+
+void kmaStat_wall(int stage, const long unsigned *t) {
+	
+	if(kmaStats) {
+		__sync_add_and_fetch(kmaStats->wall + stage, kmaStat_ns() - t[0]);
+	}
+	kmaTrace_end(kmaStatStages[stage], "stage", t[0], -1);
+}
+
+void kmaStat_cpu(int stage, const long unsigned *t) {
+	
+	/* workers, traced over their lifetime */
+	if(kmaStats) {
+		__sync_add_and_fetch(kmaStats->cpu + stage, kmaStat_thread_ns() - t[1]);
+		if(kmaStats->hwOn) {
+			kmaStat_hwAdd(stage, t + 2);
+		}
+	}
+	kmaTrace_end(kmaStatStages[stage], "thread", t[0], -1);
+}
+
+void kmaStat_stop(int stage, const long unsigned *t) {
+	
+	kmaStat_wall(stage, t);
+	if(kmaStats) {
+		__sync_add_and_fetch(kmaStats->cpu + stage, kmaStat_thread_ns() - t[1]);
+		if(kmaStats->hwOn) {
+			kmaStat_hwAdd(stage, t + 2);
+		}
+	}
+}
+
+void kmaStat_add(int counter, long unsigned n) {
+	
+	if(kmaStats) {
+		__sync_add_and_fetch(kmaStats->count + counter, n);
+	}
+}
+
+void kmaStat_threads(int stage, int n) {
+	
+	if(kmaStats) {
+		kmaStats->threads[stage] = n;
+	}
+}
+
+void kmaStat_flush(void) {
+	
+	if(kmaStats && statProbes) {
+		__sync_add_and_fetch(kmaStats->count + STAT_PROBES, statProbes);
+		__sync_add_and_fetch(kmaStats->count + STAT_MISSES, statMisses);
+	}
+	statProbes = 0;
+	statMisses = 0;
+}
+
+static unsigned * hashMap_getStat(const HashMapKMA *templates, const long unsigned key) {
+	
+	unsigned *value;
+	
+	value = statGet(templates, key);
+	statMisses += !value;
+	if(!(++statProbes & 65535)) {
+		kmaStat_flush();
+	}
+	
+	return value;
+}
+
+static void hashMap_getBatchStat(const HashMapKMA *templates, const long unsigned *keys, int n, unsigned **values) {
+	
+	int i;
+	
+	statGetBatch(templates, keys, n, values);
+	statProbes += n;
+	for(i = 0; i < n; ++i) {
+		statMisses += !values[i];
+	}
+	if(65536 <= statProbes) {
+		kmaStat_flush();
+	}
+}
+
+void kmaStat_hash(int on) {
+	
+	/* count probes and misses in front of the chosen lookups */
+	if(on && kmaStats && hashMap_get != &hashMap_getStat) {
+		statGet = hashMap_get;
+		statGetBatch = hashMap_getBatch;
+		hashMap_get = &hashMap_getStat;
+		hashMap_getBatch = &hashMap_getBatchStat;
+	} else if(!on && hashMap_get == &hashMap_getStat) {
+		hashMap_get = statGet;
+		hashMap_getBatch = statGetBatch;
+	}
+}
+
+static long unsigned kmaStat_bytes(char *outputfilename) {
+	
+	static const char *suffixes[] = {".res", ".tsv", ".frag.gz", ".aln", ".fsa", ".mat.gz", ".smat.gz", ".frag_raw.gz", ".vcf.gz", ".mapstat", ".xml", ".ns.res", ".json", 0};
+	int i, len;
+	long unsigned bytes;
+	struct stat st;
+	
+	/* outputs of this run, earlier files of the same name are left out */
+	bytes = 0;
+	len = strlen(outputfilename);
+	for(i = 0; suffixes[i]; ++i) {
+		strcpy(outputfilename + len, suffixes[i]);
+		if(stat(outputfilename, &st) == 0 && kmaStats->born <= st.st_mtime) {
+			bytes += st.st_size;
+		}
+	}
+	outputfilename[len] = 0;
+	errno = 0;
+	
+	return bytes;
+}
+
+int kmaStat_print(char *outputfilename) {
+	
+	int i, j, len, threads;
+	long maxrss;
+	double cpu, eff;
+	struct rusage self, children;
+	FILE *out;
+	
+	if(!kmaStats) {
+		return 0;
+	}
+	kmaStat_flush();
+	kmaStats->count[STAT_BYTES] += kmaStat_bytes(outputfilename);
+	getrusage(RUSAGE_SELF, &self);
+	getrusage(RUSAGE_CHILDREN, &children);
+	cpu = self.ru_utime.tv_sec + self.ru_stime.tv_sec + children.ru_utime.tv_sec + children.ru_stime.tv_sec;
+	cpu += (self.ru_utime.tv_usec + self.ru_stime.tv_usec + children.ru_utime.tv_usec + children.ru_stime.tv_usec) / 1000000.0;
+	maxrss = self.ru_maxrss < children.ru_maxrss ? children.ru_maxrss : self.ru_maxrss;
+	
+	if(kmaStats->hwOn && !kmaStats->hwFlag) {
+		fprintf(stderr, "# No CPU counters, perf_event_open failed (no PMU, or see /proc/sys/kernel/perf_event_paranoid).\n");
+	}
+	
+	len = strlen(outputfilename);
+	strcpy(outputfilename + len, ".stats.json");
+	out = fopen(outputfilename, "w");
+	outputfilename[len] = 0;
+	if(!out) {
+		return 1;
+	}
+	
+	fprintf(out, "{\n");
+	fprintf(out, "\t\"Wall Time\": %f,\n", (kmaStat_ns() - kmaStats->start) / 1e9);
+	fprintf(out, "\t\"CPU Time\": %f,\n", cpu);
+	fprintf(out, "\t\"Max RSS (kB)\": %ld,\n", maxrss);
+	kmaCpu_print(out, 1);
+	fprintf(out, "\t\"Stages\": {\n");
+	for(i = 0; i < STAT_STAGES; ++i) {
+		/* share of the given threads kept busy */
+		threads = kmaStats->threads[i] < 1 ? 1 : kmaStats->threads[i];
+		eff = kmaStats->wall[i] ? (double) kmaStats->cpu[i] / kmaStats->wall[i] / threads : 0;
+		fprintf(out, "\t\t\"%s\": {\"Wall Time\": %f, \"CPU Time\": %f, \"Threads\": %d, \"Parallel Efficiency\": %f", kmaStatStages[i], kmaStats->wall[i] / 1e9, kmaStats->cpu[i] / 1e9, threads, eff);
+		if(kmaStats->hwOn) {
+			for(j = 0; j < STAT_HW; ++j) {
+				if(kmaStats->hwFlag & (1 << j)) {
+					fprintf(out, ", \"%s\": %lu", kmaStatHwNames[j], kmaStats->hw[i][j]);
+				}
+			}
+			if((kmaStats->hwFlag & 3) == 3) {
+				fprintf(out, ", \"IPC\": %f", kmaStats->hw[i][STAT_CYCLES] ? (double) kmaStats->hw[i][STAT_INSTRUCTIONS] / kmaStats->hw[i][STAT_CYCLES] : 0);
+			}
+		}
+		fprintf(out, "}%s\n", i + 1 < STAT_STAGES ? "," : "");
+	}
+	fprintf(out, "\t},\n");
+	fprintf(out, "\t\"Fragments In\": %lu,\n", kmaStats->count[STAT_READS]);
+	fprintf(out, "\t\"Fragments Mapped\": %lu,\n", kmaStats->count[STAT_MAPPED]);
+	fprintf(out, "\t\"K-mer Probes\": %lu,\n", kmaStats->count[STAT_PROBES]);
+	fprintf(out, "\t\"Hash Misses\": %lu,\n", kmaStats->count[STAT_MISSES]);
+	fprintf(out, "\t\"CCI Builds\": %lu,\n", kmaStats->count[STAT_CCI]);
+	fprintf(out, "\t\"NW Cells\": %lu,\n", kmaStats->count[STAT_CELLS]);
+	fprintf(out, "\t\"NW Ungapped\": %lu,\n", kmaStats->count[STAT_UNGAPPED]);
+	fprintf(out, "\t\"Lock Wait Time\": %f,\n", kmaStats->count[STAT_LOCKWAIT] / 1e9);
+	fprintf(out, "\t\"Bytes Written\": %lu%s\n", kmaStats->count[STAT_BYTES], memAcc ? "," : "");
+	if(memAcc) {
+		/* tagged allocations, bytes */
+		fprintf(out, "\t\"Memory\": {\n");
+		for(i = 0; i < MEM_TAGS; ++i) {
+			fprintf(out, "\t\t\"%s\": {\"Current\": %lu, \"Peak\": %lu},\n", memAccNames[i], memAcc->cur[i], memAcc->peak[i]);
+		}
+		fprintf(out, "\t\t\"Total\": {\"Current\": %lu, \"Peak\": %lu},\n", memAcc->cur[MEM_TAGS], memAcc->peak[MEM_TAGS]);
+		fprintf(out, "\t\t\"Cap\": %lu\n", memAcc->cap);
+		fprintf(out, "\t}\n");
+	}
+	fprintf(out, "}\n");
+	
+	return fclose(out) != 0;
+}
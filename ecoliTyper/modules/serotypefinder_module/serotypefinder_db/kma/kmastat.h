@@ -0,0 +1,85 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+
+#ifndef KMASTAT
+typedef struct kmaStat KmaStat;
+struct kmaStat {
+	volatile long unsigned wall[6]; /* ns */
+	volatile long unsigned cpu[6]; /* ns, summed over threads */
+	volatile long unsigned count[9];
+	volatile long unsigned hw[6][5]; /* hardware counters, summed over threads */
+	volatile unsigned hwFlag; /* counters that could be opened */
+	int threads[6]; /* threads given to each stage */
+	int hwOn;
+	long unsigned start;
+	long born;
+};
+
+/* stages */
+#define STAT_INPUT 0
+#define STAT_MAPPING 1
+#define STAT_CONCLAVE 2
+#define STAT_ALIGNMENT 3
+#define STAT_ASSEMBLY 4
+#define STAT_OUTPUT 5
+#define STAT_STAGES 6
+
+/* counters */
+#define STAT_READS 0
+#define STAT_MAPPED 1
+#define STAT_PROBES 2
+#define STAT_MISSES 3
+#define STAT_CCI 4
+#define STAT_CELLS 5
+#define STAT_LOCKWAIT 6
+#define STAT_BYTES 7
+#define STAT_UNGAPPED 8
+#define STAT_COUNTERS 9
+
+/* hardware counters */
+#define STAT_CYCLES 0
+#define STAT_INSTRUCTIONS 1
+#define STAT_LLC_MISSES 2
+#define STAT_DTLB_MISSES 3
+#define STAT_BRANCH_MISSES 4
+#define STAT_HW 5
+
+/* stage timer: wall and thread cpu ns, followed by the hardware counters */
+#define STAT_TIMER 7
+
+#define KMASTAT 1
+#endif
+
+/* shared with forked stages, 0 when no report is made */
+extern KmaStat *kmaStats;
+KmaStat * kmaStat_init(void);
+void kmaStat_destroy(void);
+long unsigned kmaStat_ns(void);
+void kmaStat_start(long unsigned *t);
+void kmaStat_wall(int stage, const long unsigned *t);
+void kmaStat_cpu(int stage, const long unsigned *t);
+void kmaStat_stop(int stage, const long unsigned *t);
+void kmaStat_add(int counter, long unsigned n);
+void kmaStat_hash(int on);
+void kmaStat_hw(void);
+void kmaStat_threads(int stage, int n);
+void kmaStat_flush(void);
+int kmaStat_print(char *outputfilename);
@@ -0,0 +1,171 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "kmastat.h"
+#include "kmatrace.h"
+#include "pherror.h"
+
+int kmaTraceFd = -1;
+static pid_t kmaTracePid = 0;
+static int kmaTraceKeyed = 0;
+static volatile int kmaTraceTids = 0;
+static pthread_key_t kmaTraceKey;
+static __thread KmaTraceBuff *kmaTraceLocal = 0;
+
+static void kmaTrace_write(KmaTraceBuff *src) {
+	
+	int i, len;
+	char buff[65536];
+	pid_t pid;
+	KmaTraceEvent *event;
+	
+	/* one write per chunk, appends of other processes fall in between */
+	pid = getpid();
+	len = 0;
+	for(i = 0, event = src->events; i < src->n; ++i, ++event) {
+		len += sprintf(buff + len, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lu.%03lu,\"dur\":%lu.%03lu,\"pid\":%d,\"tid\":%d", event->name, event->cat, event->ts / 1000, event->ts % 1000, event->dur / 1000, event->dur % 1000, (int) pid, src->tid);
+		if(0 <= event->n) {
+			len += sprintf(buff + len, ",\"args\":{\"n\":%ld}},\n", event->n);
+		} else {
+			len += sprintf(buff + len, "},\n");
+		}
+		if(sizeof(buff) - 512 < len || i == src->n - 1) {
+			if(write(kmaTraceFd, buff, len) != len) {
+				ERROR();
+			}
+			len = 0;
+		}
+	}
+	src->n = 0;
+}
+
+static void kmaTrace_exit(void *arg) {
+	
+	KmaTraceBuff *src = arg;
+	
+	/* thread exits */
+	if(0 <= kmaTraceFd) {
+		kmaTrace_write(src);
+	}
+	free(src->events);
+	free(src);
+	kmaTraceLocal = 0;
+}
+
+static void kmaTrace_child(void) {
+	
+	/* events of the parent are written by the parent */
+	if(kmaTraceLocal) {
+		kmaTraceLocal->n = 0;
+	}
+}
+
+int kmaTrace_init(char *outputfilename) {
+	
+	int len;
+	
+	len = strlen(outputfilename);
+	strcpy(outputfilename + len, ".trace.json");
+	kmaTraceFd = open(outputfilename, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0666);
+	outputfilename[len] = 0;
+	if(kmaTraceFd < 0) {
+		return 1;
+	} else if(write(kmaTraceFd, "[\n", 2) != 2) {
+		return 1;
+	}
+	kmaTracePid = getpid();
+	if(!kmaTraceKeyed) {
+		/* once per process, kma_main may be run repeatedly */
+		if((errno = pthread_key_create(&kmaTraceKey, &kmaTrace_exit))) {
+			return 1;
+		} else if((errno = pthread_atfork(0, 0, &kmaTrace_child))) {
+			return 1;
+		}
+		kmaTraceKeyed = 1;
+	}
+	
+	return 0;
+}
+
+long unsigned kmaTrace_begin(void) {
+	return kmaTraceFd < 0 ? 0 : kmaStat_ns();
+}
+
+void kmaTrace_end(const char *name, const char *cat, long unsigned t0, long n) {
+	
+	KmaTraceBuff *src;
+	KmaTraceEvent *event;
+	
+	if(kmaTraceFd < 0 || !t0) {
+		return;
+	} else if(!(src = kmaTraceLocal)) {
+		src = smalloc(sizeof(KmaTraceBuff));
+		src->events = smalloc(TRACEBUFF * sizeof(KmaTraceEvent));
+		src->n = 0;
+		src->tid = __sync_add_and_fetch(&kmaTraceTids, 1);
+		kmaTraceLocal = src;
+		pthread_setspecific(kmaTraceKey, src);
+	}
+	event = src->events + src->n;
+	event->name = name;
+	event->cat = cat;
+	event->ts = t0;
+	event->dur = kmaStat_ns() - t0;
+	event->n = n;
+	if(++src->n == TRACEBUFF) {
+		kmaTrace_write(src);
+	}
+}
+
+void kmaTrace_flush(void) {
+	
+	/* events of the calling thread */
+	if(0 <= kmaTraceFd && kmaTraceLocal && kmaTraceLocal->n) {
+		kmaTrace_write(kmaTraceLocal);
+	}
+}
+
+int kmaTrace_close(void) {
+	
+	int len;
+	char buff[128];
+	
+	if(kmaTraceFd < 0) {
+		return 0;
+	}
+	kmaTrace_flush();
+	
+	/* the closing element has no trailing comma */
+	if(getpid() == kmaTracePid) {
+		len = sprintf(buff, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"kma\"}}\n]\n", (int) kmaTracePid);
+		if(write(kmaTraceFd, buff, len) != len) {
+			return 1;
+		}
+	}
+	close(kmaTraceFd);
+	kmaTraceFd = -1;
+	
+	return 0;
+}
@@ -0,0 +1,50 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+
+#ifndef KMATRACE
+typedef struct kmaTraceEvent KmaTraceEvent;
+typedef struct kmaTraceBuff KmaTraceBuff;
+struct kmaTraceEvent {
+	const char *name;
+	const char *cat;
+	long unsigned ts; /* ns */
+	long unsigned dur; /* ns */
+	long n; /* argument, -1 for none */
+};
+struct kmaTraceBuff {
+	int tid;
+	int n;
+	KmaTraceEvent *events;
+};
+#define TRACEBUFF 4096
+#define KMATRACE 1
+#endif
+
+/*
+ Events are kept per thread without locking, and appended to a chrome trace 
+ when a buffer fills, its thread exits or its process exits. Forked stages 
+ share the file, so the trace covers the whole pipeline.
+*/
+extern int kmaTraceFd; /* -1 when off */
+int kmaTrace_init(char *outputfilename);
+long unsigned kmaTrace_begin(void);
+void kmaTrace_end(const char *name, const char *cat, long unsigned t0, long n);
+void kmaTrace_flush(void);
+int kmaTrace_close(void);
@@ -0,0 +1,139 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "kmatune.h"
+#include "pherror.h"
+
+long unsigned kmaTune_bytes(const char *filename) {
+	
+	int len;
+	struct stat st;
+	
+	/* 0 when unknown */
+	if(strcmp(filename, "--") == 0 || stat(filename, &st) || !S_ISREG(st.st_mode)) {
+		return 0;
+	}
+	len = strlen(filename);
+	if(3 < len && strcmp(filename + len - 3, ".gz") == 0) {
+		return st.st_size * TUNEGZ;
+	}
+	
+	return st.st_size;
+}
+
+static int kmaTune_fit(long unsigned work, long unsigned perThread, int max) {
+	
+	long unsigned n;
+	
+	n = (work + perThread - 1) / perThread;
+	
+	return n < 1 ? 1 : max < n ? max : n;
+}
+
+void kmaTune_threads(const char *templatefilename, char ***inputs, const int *counts, int n, int max, int *mapThreads, int *alnThreads) {
+	
+	int i, j;
+	long unsigned bytes, size, index;
+	char *filename;
+	
+	/* input */
+	*mapThreads = max;
+	*alnThreads = max;
+	bytes = 0;
+	for(i = 0; i < n; ++i) {
+		for(j = 0; j < counts[i]; ++j) {
+			if(!(size = kmaTune_bytes(inputs[i][j]))) {
+				return;
+			}
+			bytes += size;
+		}
+	}
+	
+	/* lookups in an index beyond the cache are bound by memory */
+	filename = smalloc(strlen(templatefilename) + 16);
+	sprintf(filename, "%s.comp.b", templatefilename);
+	index = kmaTune_bytes(filename);
+	free(filename);
+	
+	*mapThreads = kmaTune_fit(TUNECACHE < index ? bytes << 1 : bytes, TUNEMAP, max);
+	*alnThreads = kmaTune_fit(bytes, TUNEALN, max);
+}
+
+void kmaTune_memory(const char *templatefilename, long unsigned budget, int *mapThreads, int *alnThreads, int *maxFrag, int *mem_mode, long unsigned *tmpMem) {
+	
+	int i, DB_size, len, max;
+	long unsigned index, rest, bases, perThread;
+	char *filename;
+	FILE *file;
+	
+	/* index and template lengths */
+	filename = smalloc(strlen(templatefilename) + 16);
+	sprintf(filename, "%s.comp.b", templatefilename);
+	index = kmaTune_bytes(filename);
+	sprintf(filename, "%s.length.b", templatefilename);
+	file = sfopen(filename, "rb");
+	free(filename);
+	bases = 0;
+	max = 0;
+	if(fread(&DB_size, sizeof(int), 1, file)) {
+		for(i = 0; i < DB_size && fread(&len, sizeof(int), 1, file); ++i) {
+			bases += len;
+			if(max < len) {
+				max = len;
+			}
+		}
+	}
+	fclose(file);
+	
+	/* share what the index leaves */
+	if(budget <= index) {
+		fprintf(stderr, "# The index alone fills -mem_budget, consider -shm or -mmap.\n");
+		rest = 0;
+	} else {
+		rest = (budget - index) >> 2;
+	}
+	
+	/* fragments */
+	if(rest / TUNEFRAG < *maxFrag) {
+		*maxFrag = rest / TUNEFRAG < 1024 ? 1024 : rest / TUNEFRAG;
+	}
+	
+	/* temporary streams */
+	*tmpMem = rest < 1048576 ? 1048576 : rest;
+	
+	/* template indexes, built once per template unless -mem_mode */
+	if(!*mem_mode && rest < bases * TUNECCI) {
+		*mem_mode = 1;
+	}
+	
+	/* threads */
+	perThread = TUNETHREAD + (long unsigned)(max) * TUNEBASE;
+	if(rest / perThread < *alnThreads) {
+		*alnThreads = rest < perThread ? 1 : rest / perThread;
+	}
+	if(rest / TUNETHREAD < *mapThreads) {
+		*mapThreads = rest < TUNETHREAD ? 1 : rest / TUNETHREAD;
+	}
+	
+	fprintf(stderr, "# Memory budget: threads %d/%d, -mf %d, -tmp_mem %lu%s.\n", *mapThreads, *alnThreads, *maxFrag, *tmpMem >> 20, *mem_mode ? ", -mem_mode" : "");
+}
@@ -0,0 +1,47 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+
+#ifndef KMATUNE
+#define TUNEMAP 33554432 /* input bytes mapped per thread */
+#define TUNEALN 8388608 /* input bytes aligned per thread */
+#define TUNECACHE 67108864 /* index size where lookups leave the cache */
+#define TUNEGZ 4 /* expected compression ratio of gzipped input */
+#define TUNETHREAD 16777216 /* fixed buffers of a thread */
+#define TUNEBASE 64 /* alignment bytes per base of the longest template */
+#define TUNECCI 16 /* bytes per base of a template index */
+#define TUNEFRAG 512 /* bytes per fragment kept in memory */
+#define KMATUNE 1
+#endif
+
+/*
+ Threads are fitted to the work, estimated from the size of the input and 
+ the index, with -t as the upper bound. Input read from stdin is taken as 
+ big, and keeps -t.
+*/
+long unsigned kmaTune_bytes(const char *filename);
+void kmaTune_threads(const char *templatefilename, char ***inputs, const int *counts, int n, int max, int *mapThreads, int *alnThreads);
+
+/*
+ A memory budget is split between the index, which is taken as is, and a 
+ quarter each to the fragments held by ConClave, the temporary streams, the 
+ template indexes and the threads. What does not fit is scaled down, and 
+ the template indexes are left to -mem_mode.
+*/
+void kmaTune_memory(const char *templatefilename, long unsigned budget, int *mapThreads, int *alnThreads, int *maxFrag, int *mem_mode, long unsigned *tmpMem);
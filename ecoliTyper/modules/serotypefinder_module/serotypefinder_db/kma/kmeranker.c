@@ -21,6 +21,7 @@
 #include <math.h>
 #include "kmeranker.h"
 #include "penalties.h"
+#include "pherror.h"
 
 KmerAnker * (*getChainTemplates)(KmerAnker*, const Penalties*, const int*, const int, const int, const int, int*, int*, int*, char*) = &getBestChainTemplates;
 int (*kmerAnkerScore)(KmerAnker*) = &ankerScore;
@@ -29,6 +30,24 @@ const int (*proxiTestBest)(const double, const int, const int, const int, const
 KmerAnker * (*getBestAnker)(KmerAnker**, unsigned*, const int*) = &getBestAnkerScore;
 KmerAnker * (*getTieAnker)(int, KmerAnker*, const KmerAnker*) = &getTieAnkerScore;
 
+KmerAnker * ankerPool(KmerAnker *pool, int *size, int n) {
+	
+	/* ankers only live for one read, so a full pool is replaced, not copied, 
+	and grows by doubling to settle after a few long reads */
+	if(*size < n) {
+		while(*size < n) {
+			*size <<= 1;
+		}
+		free(pool);
+		pool = calloc(*size, sizeof(KmerAnker));
+		if(!pool) {
+			ERROR();
+		}
+	}
+	
+	return pool;
+}
+
 /* helper functions */
 int ankerScore(KmerAnker *src) {
 	return src->score;
@@ -59,22 +78,20 @@ const int mrchain(int *bestTemaples, const int *template_lengths, const int q_le
 	static double mrc = 0;
 	int i, n, *bests;
 	
-	if(mrc) {
-		if(q_len < mrc * maplen) {
-			bests = bestTemaples;
-			i = *bests + 1;
-			n = 0;
-			while(--i) {
-				if(mrc * maplen <= template_lengths[*++bests]) {
-					++n;
-					*++bestTemaples = *bests;
-				}
+	if(!template_lengths) {
+		mrc = *((double *)(bestTemaples));
+	} else if(mrc && q_len < mrc * maplen) {
+		bests = bestTemaples;
+		i = *bests + 1;
+		n = 0;
+		while(--i) {
+			if(mrc * maplen <= template_lengths[*++bests]) {
+				++n;
+				*++bestTemaples = *bests;
 			}
-			bestTemaples -= n;
-			return (*bestTemaples = n);
 		}
-	} else if(!maplen) {
-		mrc = *((double *)(bestTemaples));
+		bestTemaples -= n;
+		return (*bestTemaples = n);
 	}
 	
 	return 1;
@@ -477,6 +494,135 @@ KmerAnker * getBestAnkerScoreLen(KmerAnker **src, unsigned *ties, const int *tem
 	return best;
 }
 
+AnkerHeap * ankerHeap_init(int size) {
+	
+	AnkerHeap *dest;
+	
+	dest = smalloc(sizeof(AnkerHeap));
+	dest->n = -1;
+	dest->scans = 0;
+	dest->size = size;
+	dest->scores = smalloc(size * sizeof(int));
+	dest->ankers = smalloc(size * sizeof(KmerAnker *));
+	
+	return dest;
+}
+
+void ankerHeap_destroy(AnkerHeap *dest) {
+	
+	free(dest->scores);
+	free(dest->ankers);
+	free(dest);
+}
+
+void ankerHeap_reset(AnkerHeap *dest) {
+	
+	dest->n = -1;
+	dest->scans = 0;
+}
+
+static int ankerHeap_above(const AnkerHeap *heap, int i, int j) {
+	/* equal scores go to the last anker, as in getBestAnkerScore */
+	return heap->scores[j] < heap->scores[i] || (heap->scores[i] == heap->scores[j] && heap->ankers[j] < heap->ankers[i]);
+}
+
+static void ankerHeap_down(AnkerHeap *heap, int i) {
+	
+	int child, score;
+	KmerAnker *anker;
+	
+	score = heap->scores[i];
+	anker = heap->ankers[i];
+	while((child = (i << 1) + 1) < heap->n) {
+		if(child + 1 < heap->n && ankerHeap_above(heap, child + 1, child)) {
+			++child;
+		}
+		if(heap->scores[child] < score || (heap->scores[child] == score && heap->ankers[child] < anker)) {
+			break;
+		}
+		heap->scores[i] = heap->scores[child];
+		heap->ankers[i] = heap->ankers[child];
+		i = child;
+	}
+	heap->scores[i] = score;
+	heap->ankers[i] = anker;
+}
+
+static int ankerHeap_build(AnkerHeap *heap, KmerAnker *src) {
+	
+	int i, n;
+	KmerAnker *node;
+	
+	/* live ankers of the pruned list */
+	for(n = 0, node = src; node; node = node->descend) {
+		n += node->score != 0;
+	}
+	if(n < ANKERHEAPMIN) {
+		return (heap->n = -2);
+	} else if(heap->size < n) {
+		free(heap->scores);
+		free(heap->ankers);
+		while(heap->size < n) {
+			heap->size <<= 1;
+		}
+		heap->scores = smalloc(heap->size * sizeof(int));
+		heap->ankers = smalloc(heap->size * sizeof(KmerAnker *));
+	}
+	for(n = 0, node = src; node; node = node->descend) {
+		if(node->score) {
+			heap->scores[n] = node->score;
+			heap->ankers[n++] = node;
+		}
+	}
+	heap->n = n;
+	i = n >> 1;
+	while(i--) {
+		ankerHeap_down(heap, i);
+	}
+	
+	return n;
+}
+
+static unsigned ankerHeap_ties(const AnkerHeap *heap, int i, int score) {
+	
+	unsigned ties;
+	
+	/* ankers of the best score sit in a subtree of the root */
+	if(heap->n <= i || heap->scores[i] != score) {
+		return 0;
+	}
+	ties = heap->ankers[i]->score == score;
+	ties += ankerHeap_ties(heap, (i << 1) + 1, score);
+	ties += ankerHeap_ties(heap, (i << 1) + 2, score);
+	
+	return ties;
+}
+
+KmerAnker * getBestAnkerHeap(AnkerHeap *heap, KmerAnker **src, unsigned *ties, const int *template_lengths) {
+	
+	/* same pick as getBestAnker, without rescanning all ankers on every call. 
+	Most reads are done after a few picks, so the heap is only built for 
+	reads that keep picking. Scores only drop to zero once an anker is 
+	used, so stale entries are dropped as they reach the top. */
+	if(getBestAnker != &getBestAnkerScore || heap->n == -2 || (heap->n == -1 && (++heap->scans <= ANKERHEAPSCANS || ankerHeap_build(heap, *src) < 0))) {
+		return getBestAnker(src, ties, template_lengths);
+	}
+	while(heap->n && heap->ankers[0]->score != heap->scores[0]) {
+		if(--heap->n) {
+			heap->scores[0] = heap->scores[heap->n];
+			heap->ankers[0] = heap->ankers[heap->n];
+			ankerHeap_down(heap, 0);
+		}
+	}
+	if(!heap->n) {
+		*ties = 0;
+		return 0;
+	}
+	*ties = ankerHeap_ties(heap, 0, heap->scores[0]) - 1;
+	
+	return heap->ankers[0];
+}
+
 KmerAnker * getTieAnkerScore(int stop, KmerAnker *src, const KmerAnker *bestScore) {
 	
 	if(!src || src->start <= stop) {
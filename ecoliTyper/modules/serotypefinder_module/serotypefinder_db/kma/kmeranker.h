@@ -32,6 +32,18 @@ struct kmerAnker {
 	unsigned *values;
 	struct kmerAnker *descend; /* descending anker */
 };
+
+/* max-heap of the pruned ankers of a read, on score and then position */
+typedef struct ankerHeap AnkerHeap;
+struct ankerHeap {
+	int n; /* -1 if not built for this read, -2 if scanned instead */
+	int scans; /* calls served by scanning this read */
+	int size;
+	int *scores; /* score when pushed, the anker is stale once it differs */
+	KmerAnker **ankers;
+};
+#define ANKERHEAPMIN 64 /* fewer ankers are scanned */
+#define ANKERHEAPSCANS 4 /* scans of a read before the heap is built */
 #endif
 
 extern KmerAnker * (*getChainTemplates)(KmerAnker*, const Penalties*, const int*, const int, const int, const int, int*, int*, int*, char*);
@@ -40,6 +52,7 @@ extern const int (*testExtension)(const int, const int, const int);
 extern const int (*proxiTestBest)(const double, const int, const int, const int, const int);
 extern KmerAnker * (*getBestAnker)(KmerAnker**, unsigned*, const int*);
 extern KmerAnker * (*getTieAnker)(int, KmerAnker*, const KmerAnker*);
+KmerAnker * ankerPool(KmerAnker *pool, int *size, int n);
 int ankerScore(KmerAnker *src);
 int ankerScoreLen(KmerAnker *src);
 const int testExtensionScore(const int q_len, const int t_len, const int best_len);
@@ -52,6 +65,10 @@ KmerAnker * getProxiChainTemplates(KmerAnker *src, const Penalties *rewards, con
 KmerAnker * pruneAnkers(KmerAnker *V_score, int kmersize);
 KmerAnker * getBestAnkerScore(KmerAnker **src, unsigned *ties, const int *template_lengths);
 KmerAnker * getBestAnkerScoreLen(KmerAnker **src, unsigned *ties, const int *template_lengths);
+AnkerHeap * ankerHeap_init(int size);
+void ankerHeap_destroy(AnkerHeap *dest);
+void ankerHeap_reset(AnkerHeap *dest);
+KmerAnker * getBestAnkerHeap(AnkerHeap *heap, KmerAnker **src, unsigned *ties, const int *template_lengths);
 KmerAnker * getTieAnkerScore(int stop, KmerAnker *src, const KmerAnker *bestScore);
 KmerAnker * getTieAnkerScoreLen(int stop, KmerAnker *src, const KmerAnker *bestScore);
 int chooseChain(const KmerAnker *bestScore, const KmerAnker *bestScore_r, int cStart, int cStart_r, int *Start, int *Len);
@@ -17,6 +17,7 @@
  * limitations under the License.
 */
 #define _XOPEN_SOURCE 600
+#include <errno.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -25,15 +26,20 @@
 #include <time.h>
 #include "ankers.h"
 #include "compdna.h"
+#include "delta.h"
 #include "hashmapkma.h"
 #include "kmapipe.h"
+#include "kmaprof.h"
+#include "kmastat.h"
 #include "kmeranker.h"
 #include "kmers.h"
 #include "kmmap.h"
+#include "numa.h"
 #include "penalties.h"
 #include "pherror.h"
 #include "qseqs.h"
 #include "savekmers.h"
+#include "shmposix.h"
 #include "spltdb.h"
 #ifndef _WIN32
 #include <sys/ipc.h>
@@ -51,7 +57,7 @@ typedef int key_t;
 int save_kmers_batch(char *templatefilename, char *exePrev, unsigned shm, int thread_num, const int exhaustive, Penalties *rewards, FILE *out, int sam, int minlen, double mrs, double coverT, double minFrac) {
 	
 	int i, file_len, shmid, deCon, *bestTemplates, *template_lengths;
-	long unsigned *softProxi;
+	long unsigned *softProxi, timer[STAT_TIMER];
 	FILE *inputfile, *templatefile;
 	time_t t0, t1;
 	key_t key;
@@ -82,7 +88,9 @@ int save_kmers_batch(char *templatefilename, char *exePrev, unsigned shm, int th
 	templates = smalloc(sizeof(HashMapKMA));
 	hashMap_get = &hashMap_getGlobal;
 	if((shm & 1) || (deCon && (shm & 2))) {
-		hashMapKMA_load_shm(templates, templatefile, templatefilename);
+		if(shmPosix_attach(templates, templatefilename)) {
+			hashMapKMA_load_shm(templates, templatefile, templatefilename);
+		}
 	} else if(shm & 32) {
 		hashMapKMAmmap(templates, templatefile);
 	} else {
@@ -93,6 +101,32 @@ int save_kmers_batch(char *templatefilename, char *exePrev, unsigned shm, int th
 	}
 	templatefilename[file_len] = 0;
 	fclose(templatefile);
+	hugePagesReport(stderr);
+	
+	/* put k-mer filter in front of lookups if present */
+	strcat(templatefilename, deCon ? ".decon.filter.b" : ".filter.b");
+	if((templatefile = packFopenPtr(templatefilename)) || (templatefile = fopen(templatefilename, "rb"))) {
+		hashMapKMA_loadFilter(templates, templatefile);
+		fclose(templatefile);
+	} else {
+		errno = 0;
+	}
+	templatefilename[file_len] = 0;
+	
+	/* put the delta of recently added templates in front of lookups */
+	if(!deCon) {
+		strcat(templatefilename, ".delta.b");
+		if((templatefile = packFopenPtr(templatefilename)) || (templatefile = fopen(templatefilename, "rb"))) {
+			if(hashMapKMA_attachDelta(templates, templatefile)) {
+				fprintf(stderr, "# Delta does not match the DB, ignoring %s\n", templatefilename);
+			}
+			fclose(templatefile);
+		} else {
+			errno = 0;
+		}
+		templatefilename[file_len] = 0;
+	}
+	numaPlace(templates);
 	
 	/* check if DB is sparse */
 	if(templates->prefix_len != 0 || templates->prefix != 0) {
@@ -171,6 +205,7 @@ int save_kmers_batch(char *templatefilename, char *exePrev, unsigned shm, int th
 		templatefilename[file_len] = 0;
 		fclose(templatefile);
 		
+		saturation_init(template_lengths, templates->DB_size);
 		if(kmerScan == &save_kmers_HMM) {
 			save_kmers_HMM(templates, 0, &(int){thread_num}, template_lengths, 0, 0, 0, 0, 0, 0, minlen, 0, 0);
 		} else {
@@ -182,8 +217,15 @@ int save_kmers_batch(char *templatefilename, char *exePrev, unsigned shm, int th
 	fprintf(stderr, "#\n# Total time used for DB loading: %.2f s.\n#\n", difftime(t1, t0) / 1000000);
 	t0 = clock();
 	fprintf(stderr, "# Finding k-mer ankers\n");
+	kmaStat_start(timer);
+	kmaStat_hash(1);
+	kmaProf_hash(1);
 	
 	/* initialize threads */
+	if(printPtr != &print_ankers_spltDB && printPtr != &print_ankers_Sparse_spltDB) {
+		print_ankers_head(out);
+	}
+	save_kmers_threaded(0);
 	i = 1;
 	threads = 0;
 	while(i < thread_num) {
@@ -199,7 +241,7 @@ int save_kmers_batch(char *templatefilename, char *exePrev, unsigned shm, int th
 		if(!thread->bestTemplates || !thread->bestTemplates_r) {
 			ERROR();
 		}
-		thread->templates = templates;
+		thread->templates = numaTemplates(templates, i);
 		thread->inputfile = inputfile;
 		thread->rewards = rewards;
 		thread->out = out;
@@ -207,7 +249,7 @@ int save_kmers_batch(char *templatefilename, char *exePrev, unsigned shm, int th
 		threads = thread;
 		
 		/* start thread */
-		if((errno = pthread_create(&thread->id, NULL, &save_kmers_threaded, thread))) {
+		if((errno = kmaPool_create(&thread->id, i, &save_kmers_threaded, thread))) {
 			fprintf(stderr, "Error: %d (%s)\n", errno, strerror(errno));
 			fprintf(stderr, "Will continue with %d threads.\n", i);
 			threads = thread->next;
@@ -242,7 +284,7 @@ int save_kmers_batch(char *templatefilename, char *exePrev, unsigned shm, int th
 	/* join threads */
 	for(thread = threads; thread; thread = thread->next) {
 		/* join thread */
-		if((errno = pthread_join(thread->id, NULL))) {
+		if((errno = kmaPool_join(thread->id, NULL))) {
 			ERROR();
 		} else if(bestTemplates[2] < thread->bestTemplates[2]) {
 			bestTemplates[2] = thread->bestTemplates[2];
@@ -254,14 +296,17 @@ int save_kmers_batch(char *templatefilename, char *exePrev, unsigned shm, int th
 		printPtr(bestTemplates, 0, 0, 0, 0, out);
 	} else {
 		/* print number of fragments and send terminating signal*/
-		sfwrite(&(int){-bestTemplates[2]}, sizeof(int), 1, out);
+		print_ankers_tail(bestTemplates[2], out);
 	}
 	if(softProxi) {
 		sfwrite(softProxi, sizeof(int), 6, out);
 		sfwrite(softProxi, sizeof(long unsigned), templates->DB_size, out);
 	}
+	kmaProf_hash(0);
+	kmaStat_hash(0);
 	
 	kmaPipe(0, 0, inputfile, &i);
+	kmaStat_wall(STAT_MAPPING, timer);
 	if(kmaPipe == &kmaPipeFork) {
 		t1 = clock();
 		fprintf(stderr, "#\n# Total time used ankering query: %.2f s.\n#\n", difftime(t1, t0) / 1000000);
@@ -270,9 +315,14 @@ int save_kmers_batch(char *templatefilename, char *exePrev, unsigned shm, int th
 	}
 	
 	/* clean up */
+	mmapLoadReport(stderr);
+	numaFree();
 	if(!((shm & 1) || (deCon && (shm & 2)))) {
 		hashMapKMA_destroy(templates);
+	} else {
+		shmPosix_detach(templates);
 	}
+	saturation_init(0, 0);
 	if(template_lengths && !(shm & 4)) {
 		free(template_lengths);
 	}
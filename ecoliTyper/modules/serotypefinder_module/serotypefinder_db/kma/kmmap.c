@@ -16,11 +16,18 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
 */
-#define _XOPEN_SOURCE 600
+#define _GNU_SOURCE /* MAP_HUGETLB, madvise */
+#include <errno.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#undef _XOPEN_SOURCE
+#include "delta.h"
 #include "hashmapkma.h"
+#include "kmmap.h"
+#include "pack.h"
 #include "pherror.h"
 #include "stdnuc.h"
 #ifdef _WIN32
@@ -28,22 +35,247 @@
 #define munmap(addr, len) (-1);
 #else
 #include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/time.h>
 #endif
+#ifndef MAP_POPULATE
+#define MAP_POPULATE 0
+#endif
+
+static int hugePages = 0;
+static int hugeMode = 4;
+static int mmapLoad = 0;
+static int mmapLoads = 0;
+static double mmapTime = 0;
+static long mmapFaults[4] = {0, 0, 0, 0};
+static MmapPrefetch mmapPrefetcher;
+
+void setHugePages(int use) {
+	hugePages = use;
+}
+
+int getHugePages(void) {
+	return hugePages;
+}
+
+static void hugeNote(int mode) {
+	
+	/* keep the weakest mode used */
+	if(mode < hugeMode) {
+		hugeMode = mode;
+	}
+}
+
+static void hugeMadvise(void *ptr, long unsigned size) {
+	
+#ifdef MADV_HUGEPAGE
+	if(madvise(ptr, size, MADV_HUGEPAGE) == 0) {
+		hugeNote(1);
+		return;
+	}
+	errno = 0;
+#endif
+	hugeNote(0);
+}
+
+void * hugeMalloc(long unsigned size) {
+	
+	long unsigned total;
+	unsigned char *base;
+	
+	/* header keeps the mapped size and mode, before the data */
+	total = (size + HUGEHEADER + HUGEPAGE - 1) & ~(HUGEPAGE - 1);
+	base = 0;
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_1GB)
+	if(HUGEPAGE_1G <= total) {
+		base = mmap(0, (total + HUGEPAGE_1G - 1) & ~(HUGEPAGE_1G - 1), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_1GB, -1, 0);
+		if(base == MAP_FAILED) {
+			base = 0;
+		} else {
+			total = (total + HUGEPAGE_1G - 1) & ~(HUGEPAGE_1G - 1);
+			*((int *)(base + sizeof(long unsigned))) = 3;
+		}
+	}
+#endif
+#ifdef MAP_HUGETLB
+	if(!base) {
+		base = mmap(0, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if(base == MAP_FAILED) {
+			base = 0;
+		} else {
+			*((int *)(base + sizeof(long unsigned))) = 2;
+		}
+	}
+#endif
+	
+	/* no reserved hugepages, fall back to transparent or normal pages */
+	if(!base) {
+		if((errno = posix_memalign((void **) &base, HUGEPAGE, total))) {
+			ERROR();
+		}
+		hugeMadvise(base, total);
+		*((int *)(base + sizeof(long unsigned))) = 0;
+	} else {
+		hugeNote(*((int *)(base + sizeof(long unsigned))));
+	}
+	errno = 0;
+	*((long unsigned *) base) = total;
+	
+	return base + HUGEHEADER;
+}
+
+void hugeFree(void *ptr) {
+	
+	unsigned char *base;
+	
+	if(ptr) {
+		base = (unsigned char *) ptr - HUGEHEADER;
+		if(*((int *)(base + sizeof(long unsigned))) < 2) {
+			free(base);
+		} else if(munmap(base, *((long unsigned *) base)) < 0) {
+			ERROR();
+		}
+	}
+}
+
+void hugePagesReport(FILE *out) {
+	
+	if(!hugePages) {
+		return;
+	} else if(hugeMode == 3) {
+		fprintf(out, "# DB placed on 1GB hugepages.\n");
+	} else if(hugeMode == 2) {
+		fprintf(out, "# DB placed on 2MB hugepages.\n");
+	} else if(hugeMode == 1) {
+		fprintf(out, "# DB placed on transparent hugepages (madvise).\n");
+	} else if(hugeMode == 0) {
+		fprintf(out, "# Hugepages not available, DB placed on normal pages.\n");
+	}
+}
+
+void setMmapLoad(int policy) {
+	mmapLoad = policy;
+}
+
+static double mmapClock(void) {
+	
+	struct timeval tv;
+	
+	gettimeofday(&tv, 0);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void mmapUsage(long *minflt, long *majflt) {
+	
+	struct rusage usage;
+	
+	if(getrusage(RUSAGE_SELF, &usage)) {
+		*minflt = 0;
+		*majflt = 0;
+		errno = 0;
+	} else {
+		*minflt = usage.ru_minflt;
+		*majflt = usage.ru_majflt;
+	}
+}
+
+static void mmapWarm(unsigned char *ptr, long unsigned size, volatile int *stop) {
+	
+	long unsigned page, pos;
+	volatile unsigned char c;
+	
+	/* madvise wants page aligned addresses */
+	page = sysconf(_SC_PAGESIZE);
+	pos = (long unsigned) ptr & (page - 1);
+	ptr -= pos;
+	size += pos;
+	if(madvise(ptr, size, MADV_WILLNEED)) {
+		errno = 0;
+	}
+	
+	/* fault the pages in, in case the read ahead is ignored */
+	for(pos = 0, c = 0; pos < size && !*stop; pos += page) {
+		c ^= ptr[pos];
+	}
+}
+
+static void * mmapPrefetch(void *arg) {
+	
+	MmapPrefetch *prefetch = arg;
+	double t0;
+	
+	t0 = mmapClock();
+	mmapWarm(prefetch->ptr[0], prefetch->size[0], &prefetch->stop);
+	if(prefetch->ptr[1]) {
+		mmapWarm(prefetch->ptr[1], prefetch->size[1], &prefetch->stop);
+	}
+	prefetch->done = !prefetch->stop;
+	prefetch->time = mmapClock() - t0;
+	
+	return NULL;
+}
+
+static void mmapPrefetch_stop(int stop) {
+	
+	/* stop, or wait for, the prefetch of the previous index */
+	if(mmapPrefetcher.running) {
+		mmapPrefetcher.stop = stop;
+		if((errno = pthread_join(mmapPrefetcher.id, NULL))) {
+			ERROR();
+		}
+		mmapPrefetcher.running = 0;
+	}
+}
+
+void mmapLoadReport(FILE *out) {
+	
+	static const char *policies[4] = {"default", "lazy", "populate", "prefetch"};
+	long minflt, majflt;
+	
+	if(!mmapLoads) {
+		return;
+	}
+	mmapPrefetch_stop(1);
+	mmapUsage(&minflt, &majflt);
+	fprintf(out, "# mmap load (%s):\t%.2f s, %ld minor and %ld major page faults.\n", policies[mmapLoad], mmapTime, mmapFaults[0], mmapFaults[1]);
+	if(mmapLoad == MMAPPREFETCH) {
+		fprintf(out, "# mmap prefetch %s:\t%.2f s.\n", mmapPrefetcher.done ? "finished" : "stopped", mmapPrefetcher.time);
+	}
+	fprintf(out, "# Page faults after load:\t%ld minor and %ld major.\n", minflt - mmapFaults[2], majflt - mmapFaults[3]);
+}
 
 int hashMapKMAmmap(HashMapKMA *dest, FILE *file) {
 	
 	int fd;
 	unsigned *uptr;
+	long minflt, majflt;
 	long unsigned Size, size, *luptr;
 	unsigned char *data;
+	double t0;
 	
-	/* mmap data */
-	fd = fileno(file);
-	sfseek(file, 0, SEEK_END);
-	Size = ftell(file);
-	data = mmap(0, Size, PROT_READ, MAP_SHARED, fd, 0);
-	if(data == MAP_FAILED) {
-		ERROR();
+	t0 = mmapClock();
+	mmapUsage(&minflt, &majflt);
+	mmapPrefetch_stop(0);
+	
+	/* mmap data, or use it in place from a DB container */
+	if((fd = fileno(file)) < 0 && (data = packMap(file, &Size))) {
+		errno = 0;
+		if(mmapLoad == MMAPPOPULATE) {
+			mmapWarm(data, Size, &(int){0});
+		}
+	} else {
+		sfseek(file, 0, SEEK_END);
+		Size = ftell(file);
+		data = mmap(0, Size, PROT_READ, mmapLoad == MMAPPOPULATE ? MAP_SHARED | MAP_POPULATE : MAP_SHARED, fd, 0);
+		if(data == MAP_FAILED) {
+			ERROR();
+		}
+	}
+	if(hugePages) {
+		hugeMadvise(data, Size);
+	}
+	if(mmapLoad == MMAPLAZY && madvise(data, Size, MADV_RANDOM)) {
+		errno = 0;
 	}
 	
 	/* get data */
@@ -111,9 +343,8 @@ int hashMapKMAmmap(HashMapKMA *dest, FILE *file) {
 		dest->key_index_l = 0;
 		dest->value_index = 0;
 		dest->value_index_l = 0;
-		hashMap_get = &megaMap_getGlobal;
+		setHashMapGet(1);
 	} else {
-		hashMap_get = &hashMap_getGlobal;
 		/* kmers */
 		size = dest->n + 1;
 		if(dest->mlen <= 16) {
@@ -145,6 +376,8 @@ int hashMapKMAmmap(HashMapKMA *dest, FILE *file) {
 		data += size;
 		Size -= size;
 		
+		setHashMapGet(0);
+		
 		/* make indexing a masking problem */
 		--dest->size;
 	}
@@ -160,6 +393,27 @@ int hashMapKMAmmap(HashMapKMA *dest, FILE *file) {
 		dest->flag = 0;
 	}
 	
+	/* warm exist and key_index in the background, while input is parsed */
+	if(mmapLoad == MMAPPREFETCH) {
+		mmapPrefetcher.ptr[0] = (unsigned char *) dest->exist;
+		mmapPrefetcher.size[0] = (unsigned char *) dest->values - (unsigned char *) dest->exist;
+		mmapPrefetcher.ptr[1] = (unsigned char *) dest->key_index;
+		mmapPrefetcher.size[1] = dest->key_index ? (unsigned char *) dest->value_index - (unsigned char *) dest->key_index : 0;
+		mmapPrefetcher.stop = 0;
+		mmapPrefetcher.done = 0;
+		if((errno = pthread_create(&mmapPrefetcher.id, NULL, &mmapPrefetch, &mmapPrefetcher))) {
+			ERROR();
+		}
+		mmapPrefetcher.running = 1;
+	}
+	
+	/* statistics */
+	++mmapLoads;
+	mmapTime += mmapClock() - t0;
+	mmapUsage(mmapFaults + 2, mmapFaults + 3);
+	mmapFaults[0] += mmapFaults[2] - minflt;
+	mmapFaults[1] += mmapFaults[3] - majflt;
+	
 	return 0;
 }
 
@@ -170,6 +424,7 @@ void hashMapKMA_munmap(HashMapKMA *dest) {
 	unsigned char *data;
 	
 	if(dest && dest->shmFlag & 16) {
+		mmapPrefetch_stop(1);
 		data = (unsigned char *) dest->exist;
 		size = 3 * sizeof(unsigned) + 5 * sizeof(long unsigned);
 		data -= size;
@@ -202,6 +457,12 @@ void hashMapKMA_munmap(HashMapKMA *dest) {
 		if(data && dest->shmFlag & 1 && munmap(data, size) < 0) {
 			ERROR();
 		}
+		if(dest->shmFlag & 128) {
+			free(dest->filter);
+		}
+		if(dest->shmFlag & 512) {
+			hashMapKMA_freeDelta(dest->delta);
+		}
 		free(dest);
 	}
 }
@@ -17,8 +17,37 @@
  * limitations under the License.
 */
 #define _XOPEN_SOURCE 600
+#include <pthread.h>
 #include <stdio.h>
 #include "hashmapkma.h"
 
+#ifndef KMMAP
+#define HUGEPAGE 2097152UL
+#define HUGEPAGE_1G 1073741824UL
+#define HUGEHEADER 64
+#define MMAPDEFAULT 0
+#define MMAPLAZY 1
+#define MMAPPOPULATE 2
+#define MMAPPREFETCH 3
+typedef struct mmapPrefetch MmapPrefetch;
+struct mmapPrefetch {
+	pthread_t id;
+	int running;
+	volatile int stop;
+	int done;
+	double time;
+	unsigned char *ptr[2];
+	long unsigned size[2];
+};
+#define KMMAP 1
+#endif
+
+void setHugePages(int use);
+int getHugePages(void);
+void * hugeMalloc(long unsigned size);
+void hugeFree(void *ptr);
+void hugePagesReport(FILE *out);
+void setMmapLoad(int policy);
+void mmapLoadReport(FILE *out);
 int hashMapKMAmmap(HashMapKMA *dest, FILE *file);
 void hashMapKMA_munmap(HashMapKMA *dest);
@@ -17,13 +17,18 @@
  * limitations under the License.
 */
 #define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "delta.h"
 #include "loadupdate.h"
 #include "pherror.h"
 #include "hashmap.h"
 #include "hashmapkma.h"
+#include "hashtable.h"
+#include "stdstat.h"
 #include "updateindex.h"
 
 void * memdup(const void * src, size_t size) {
@@ -206,5 +211,142 @@ unsigned load_DBs(char *templatefilename, char *outputfilename, unsigned **templ
 	templatefilename[file_len] = 0;
 	outputfilename[out_len] = 0;
 	
+	/* cp namespaces, if any */
+	strcat(templatefilename, ".ns");
+	strcat(outputfilename, ".ns");
+	if((infile = fopen(templatefilename, "rb"))) {
+		fclose(infile);
+		CP(templatefilename, outputfilename);
+	} else {
+		errno = 0;
+	}
+	templatefilename[file_len] = 0;
+	outputfilename[out_len] = 0;
+	
 	return kmerindex;
 }
+
+static unsigned * baseGet(HashMapKMA *base, long unsigned key) {
+	
+	if(base->mask == base->size) {
+		return megaMap_getGlobal(base, key);
+	}
+	return hashMap_getGlobal(base, key);
+}
+
+static unsigned * valuesJoin(const unsigned *prev, int prev_short, unsigned *add, int wide) {
+	
+	unsigned i, n, m, *dest;
+	short unsigned *dest_s;
+	
+	/* copy prev in the width of the new DB, and append add */
+	n = prev_short ? *((const short unsigned *)(prev)) : *prev;
+	m = add ? (wide ? *add : *((short unsigned *)(add))) : 0;
+	if(wide) {
+		dest = smalloc((n + m + 1) * sizeof(unsigned));
+		*dest = n + m;
+		for(i = 1; i <= n; ++i) {
+			dest[i] = prev_short ? ((const short unsigned *)(prev))[i] : prev[i];
+		}
+		for(i = 1; i <= m; ++i) {
+			dest[n + i] = add[i];
+		}
+	} else {
+		dest_s = smalloc((n + m + 1) * sizeof(short unsigned));
+		*dest_s = n + m;
+		for(i = 1; i <= n; ++i) {
+			dest_s[i] = ((const short unsigned *)(prev))[i];
+		}
+		for(i = 1; i <= m; ++i) {
+			dest_s[n + i] = ((short unsigned *)(add))[i];
+		}
+		dest = (unsigned *)(dest_s);
+	}
+	free(add);
+	
+	return dest;
+}
+
+static void hashMap_addMissing(HashMap *templates, long unsigned key, const unsigned *values, int prev_short, int wide) {
+	
+	/* add a copy of values, unless the k-mer was added */
+	if(templates->table) {
+		if(!hashMapGetValue(templates, key)) {
+			hashMap_addUniqueValues(templates, key, valuesJoin(values, prev_short, 0, wide));
+		}
+	} else if(!megaMap_getValue(templates, key)) {
+		megaMap_addUniqueValues(templates, key, valuesJoin(values, prev_short, 0, wide));
+	}
+}
+
+int hashMap_deltaFits(HashMap *templates, HashMapKMA *base, HashMapKMA *delta) {
+	
+	long unsigned n, size;
+	
+	/* the delta has to be hashed, and keep the value width of base */
+	if(!templates->table || (base->DB_size < USHRT_MAX) != (templates->DB_size < USHRT_MAX)) {
+		return 0;
+	}
+	n = templates->n + (delta ? delta->n : 0);
+	size = templates->size + 1;
+	while(size < n) {
+		size <<= 1;
+	}
+	
+	return (size << 1) < (templates->mask + 1);
+}
+
+void hashMap_addBase(HashMap *templates, HashMapKMA *base, HashMapKMA *delta, int full) {
+	
+	int wide, prev_short;
+	long unsigned i, pos;
+	unsigned *prev;
+	HashTable *node, *end;
+	
+	/* values of delta and base share their width */
+	wide = USHRT_MAX <= templates->DB_size;
+	prev_short = base->DB_size < USHRT_MAX;
+	
+	/* put the lists of the existing templates in front of the new ones */
+	if((node = templates->table)) {
+		for(end = node + templates->slots + 1; node != end; ++node) {
+			if(node->value && ((delta && (prev = deltaMap_get(delta, node->key))) || (prev = baseGet(base, node->key)))) {
+				node->value = valuesJoin(prev, prev_short, node->value, wide);
+			}
+		}
+	} else {
+		i = templates->size + 1;
+		while(i--) {
+			if(templates->values[i]) {
+				if((delta && (prev = deltaMap_get(delta, i))) || (prev = baseGet(base, i))) {
+					templates->values[i] = valuesJoin(prev, prev_short, templates->values[i], wide);
+				}
+			}
+		}
+	}
+	
+	/* carry the remaining k-mers of the delta */
+	if(delta) {
+		hashMap_reserve(templates, templates->n + delta->n);
+		for(i = 0; i < delta->n; ++i) {
+			hashMap_addMissing(templates, delta->key_index_l[i], prev_short ? (unsigned *)(delta->values_s + delta->value_index_l[i]) : delta->values + delta->value_index_l[i], prev_short, wide);
+		}
+	}
+	
+	/* carry the remaining k-mers of the base */
+	if(full) {
+		if(base->mask != base->size) {
+			hashMap_reserve(templates, templates->n + base->n);
+			for(i = 0; i < base->n; ++i) {
+				prev = getValuePtr(base, getValueIndexPtr(base->value_index, i));
+				hashMap_addMissing(templates, getKeyPtr(base->key_index, i), prev, prev_short, wide);
+			}
+		} else {
+			for(i = 0; i <= base->mask; ++i) {
+				if((pos = getExistPtr(base->exist, i)) != 1) {
+					hashMap_addMissing(templates, i, getValuePtr(base, pos), prev_short, wide);
+				}
+			}
+		}
+	}
+}
@@ -25,3 +25,5 @@ int CP(char *templatefilename, char *outputfilename);
 HashMap * hashMapKMA_openChains(HashMapKMA *src);
 unsigned ** hashMapKMA_openValues(HashMapKMA *src);
 unsigned load_DBs(char *templatefilename, char *outputfilename, unsigned **template_lengths, unsigned **template_ulengths, unsigned **template_slengths, HashMapKMA *finalDB);
+int hashMap_deltaFits(HashMap *templates, HashMapKMA *base, HashMapKMA *delta);
+void hashMap_addBase(HashMap *templates, HashMapKMA *base, HashMapKMA *delta, int full);
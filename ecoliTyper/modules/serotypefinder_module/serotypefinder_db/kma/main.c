@@ -18,17 +18,32 @@
 */
 #define _XOPEN_SOURCE 600
 #include <string.h>
+#include "batch.h"
+#include "bench.h"
 #include "cmp.h"
 #include "db.h"
 #include "dist.h"
 #include "kma.h"
 #include "index.h"
+#include "mbench.h"
 #include "merge.h"
+#include "pack.h"
+#include "serve.h"
 #include "shm.h"
 #include "seq2fasta.h"
+#include "sketch.h"
+#include "smat.h"
 #include "trim.h"
 #include "update.h"
 
+#ifdef KMAEMBED
+/* made by kma db -embed, see make kma_embed */
+extern const int kmaEmbeddedNum;
+extern const char *kmaEmbeddedNames[];
+extern const unsigned char *kmaEmbeddedData[];
+extern const long unsigned *kmaEmbeddedSizes[];
+#endif
+
 static int helpmessage(FILE *out) {
 	
 	fprintf(out, "# KMA enables alignment towards databases, using two k-mer mapping steps and one alignment step.\n");
@@ -36,6 +51,10 @@ static int helpmessage(FILE *out) {
 	fprintf(out, "# %16s\t%-32s\n", "", "Alignment and mapping");
 	fprintf(out, "# %16s\t%-32s\n", "index", "Indexing of databases");
 	fprintf(out, "# %16s\t%-32s\n", "shm", "Shared memory");
+	fprintf(out, "# %16s\t%-32s\n", "serve", "Serve jobs against resident databases");
+	fprintf(out, "# %16s\t%-32s\n", "batch", "Map a manifest of samples");
+	fprintf(out, "# %16s\t%-32s\n", "bench", "Benchmark on synthetic reads");
+	fprintf(out, "# %16s\t%-32s\n", "mbench", "Benchmark core kernels");
 	fprintf(out, "# %16s\t%-32s\n", "seq2fasta", "Conversion of database to fasta");
 	fprintf(out, "# %16s\t%-32s\n", "dist", "Calculate distance measures between templates");
 	fprintf(out, "# %16s\t%-32s\n", "db", "Make statistics on KMA db");
@@ -43,6 +62,8 @@ static int helpmessage(FILE *out) {
 	fprintf(out, "# %16s\t%-32s\n", "cmp", "Compare two indexed kma databases");
 	fprintf(out, "# %16s\t%-32s\n", "update", "Update database to current version");
 	fprintf(out, "# %16s\t%-32s\n", "trim", "trim sequences");
+	fprintf(out, "# %16s\t%-32s\n", "smat", "Print sparse matrix as text");
+	fprintf(out, "# %16s\t%-32s\n", "screen", "Screen input against sketches");
 	fprintf(out, "# %16s\t%-32s\n", "-c", "Citation");
 	fprintf(out, "# %16s\t%-32s\n", "-v", "Version");
 	fprintf(out, "# %16s\t%-32s\n", "-h", "Help on alignment and mapping");
@@ -53,6 +74,11 @@ int main(int argc, char *argv[]) {
 	
 	int status;
 	
+#ifdef KMAEMBED
+	for(status = 0; status < kmaEmbeddedNum; ++status) {
+		packEmbed(kmaEmbeddedNames[status], kmaEmbeddedData[status], *kmaEmbeddedSizes[status]);
+	}
+#endif
 	if(argc != 1) {
 		if(**++argv == '-') {
 			status = kma_main(argc, --argv);
@@ -60,6 +86,14 @@ int main(int argc, char *argv[]) {
 			status = index_main(argc, argv);
 		} else if(strcmp(*argv, "shm") == 0) {
 			status = shm_main(argc, argv);
+		} else if(strcmp(*argv, "serve") == 0) {
+			status = serve_main(argc, argv);
+		} else if(strcmp(*argv, "batch") == 0) {
+			status = batch_main(argc, argv);
+		} else if(strcmp(*argv, "bench") == 0) {
+			status = bench_main(argc, argv);
+		} else if(strcmp(*argv, "mbench") == 0) {
+			status = mbench_main(argc, argv);
 		} else if(strcmp(*argv, "seq2fasta") == 0) {
 			status = seq2fasta_main(argc, argv);
 		} else if(strcmp(*argv, "dist") == 0) {
@@ -74,6 +108,10 @@ int main(int argc, char *argv[]) {
 			status = db_main(argc, argv);
 		} else if(strcmp(*argv, "trim") == 0) {
 			status = trim_main(argc, argv);
+		} else if(strcmp(*argv, "smat") == 0) {
+			status = smat_main(argc, argv);
+		} else if(strcmp(*argv, "screen") == 0) {
+			status = screen_main(argc, argv);
 		} else {
 			fprintf(stderr, "Invalid option:\t%s\n", *argv);
 			status = helpmessage(stderr);
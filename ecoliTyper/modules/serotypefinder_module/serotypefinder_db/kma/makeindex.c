@@ -20,6 +20,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -27,8 +28,10 @@
 #include "filebuff.h"
 #include "hashmap.h"
 #include "makeindex.h"
+#include "nspace.h"
 #include "pherror.h"
 #include "qseqs.h"
+#include "radix.h"
 #include "seqparse.h"
 #include "updateindex.h"
 
@@ -164,19 +167,129 @@ int qualCheck(CompDNA *qseq, const int minlen) {
 	return 0;
 }
 
-void makeDB(HashMap *templates, int kmerindex, char **inputfiles, int fileCount, char *outputfilename, int appender, char *trans, int MinLen, int MinKlen, double homQ, double homT, unsigned **template_lengths, unsigned **template_ulengths, unsigned **template_slengths) {
+void * shardDB_thread(void *arg) {
 	
-	int fileCounter, file_len, bias, FASTQ;
+	int i;
+	unsigned template;
+	ShardThread *thread = arg;
+	CompDNA *qseq;
+	
+	if(thread->pairs) {
+		/* write the pairs of every shard_num'th template */
+		for(i = thread->num; i < thread->size; i += thread->shard_num) {
+			updateDBs_pairs(thread->templates, thread->pairs, thread->batch + i, thread->template + i, thread->pairs->n + thread->offsets[i]);
+		}
+		return NULL;
+	}
+	
+	/* add this shards part of the batch, in template order */
+	qseq = thread->batch;
+	template = thread->template;
+	for(i = thread->size; i; --i) {
+		updateDBs_shard(thread->shard, qseq++, template++, thread->num, thread->shard_num);
+	}
+	
+	return NULL;
+}
+
+static void shardBatch(ShardThread *threads, int thread_num, unsigned template, int size, long unsigned kmers) {
+	
+	int i;
+	ShardThread *thread;
+	
+	if(threads->pairs) {
+		if(threads->pairs->max && threads->pairs->max < threads->pairs->n + kmers) {
+			kmerPairs_spill(threads->pairs);
+		}
+		kmerPairs_grow(threads->pairs, threads->pairs->n + kmers);
+	}
+	
+	/* thread out */
+	for(i = thread_num - 1; 0 <= i; --i) {
+		thread = threads + i;
+		thread->template = template;
+		thread->size = size;
+		thread->id = 0;
+		if(i && (errno = pthread_create(&thread->id, NULL, &shardDB_thread, thread))) {
+			fprintf(stderr, "Error: %d (%s)\n", errno, strerror(errno));
+			ERROR();
+		}
+	}
+	
+	/* start main thread */
+	shardDB_thread(threads);
+	
+	/* join threads */
+	for(i = 1; i < thread_num; ++i) {
+		if((errno = pthread_join(threads[i].id, NULL))) {
+			ERROR();
+		}
+	}
+	
+	if(threads->pairs) {
+		threads->pairs->n += kmers;
+	}
+}
+
+void makeDB(HashMap *templates, int kmerindex, char **inputfiles, int fileCount, char *outputfilename, int appender, char *trans, int MinLen, int MinKlen, double homQ, double homT, unsigned **template_lengths, unsigned **template_ulengths, unsigned **template_slengths, int thread_num, KmerPairs *pairs) {
+	
+	int i, fileCounter, file_len, bias, FASTQ, batchSize;
+	long unsigned size, n, batchKmers, *offsets;
 	char *filename;
 	unsigned char *seq;
 	FILE *seq_out, *length_out, *name_out;
 	Qseqs *header, *qseq;
 	FileBuff *inputfile;
-	CompDNA *compressor;
+	CompDNA *compressor, *batch;
+	HashMap **shards;
+	ShardThread *threads;
+	
+	/* k-mers are sharded on their hash over the threads, when the insertion
+	   order only depends on the template order */
+	if(!pairs && (thread_num < 2 || appender || update_DB != &updateDBs || !templates->table)) {
+		thread_num = 1;
+	}
 	
 	/* allocate */
-	compressor = smalloc(sizeof(CompDNA));
-	allocComp(compressor, 1024);
+	if(pairs || thread_num != 1) {
+		batch = smalloc(SHARDBATCH * sizeof(CompDNA));
+		for(i = 0; i < SHARDBATCH; ++i) {
+			allocComp(batch + i, 1024);
+		}
+		offsets = smalloc(SHARDBATCH * sizeof(long unsigned));
+		shards = pairs ? 0 : smalloc(thread_num * sizeof(HashMap *));
+		threads = smalloc(thread_num * sizeof(ShardThread));
+		size = templates->size + 1;
+		for(i = 1; i < thread_num && 1024 < size; i <<= 1) {
+			size >>= 1;
+		}
+		for(i = 0; i < thread_num; ++i) {
+			threads[i].num = i;
+			threads[i].shard_num = thread_num;
+			threads[i].batch = batch;
+			threads[i].offsets = offsets;
+			threads[i].templates = templates;
+			threads[i].pairs = pairs;
+			threads[i].shard = 0;
+			if(shards) {
+				shards[i] = hashMap_initialize(size, templates->kmersize, templates->mlen, templates->flag);
+				/* leave the megaMap switch to the merge */
+				shards[i]->mask = 0xFFFFFFFFFFFFFFFF >> 1;
+				threads[i].shard = shards[i];
+			}
+		}
+		compressor = batch;
+	} else {
+		batch = 0;
+		offsets = 0;
+		shards = 0;
+		threads = 0;
+		compressor = smalloc(sizeof(CompDNA));
+		allocComp(compressor, 1024);
+	}
+	n = 0;
+	batchSize = 0;
+	batchKmers = 0;
 	header = setQseqs(1024);
 	qseq = setQseqs(1024);
 	inputfile = setFileBuff(1024 * 1024);
@@ -213,6 +326,7 @@ void makeDB(HashMap *templates, int kmerindex, char **inputfiles, int fileCount,
 		/* determine filetype and open it */
 		if((FASTQ = openAndDetermine(inputfile, filename)) & 2) {
 			fprintf(stderr, "%s\t%s\n", "# Reading inputfile: ", filename);
+			nsPrintPtr(outputfilename, filename, templates->DB_size);
 			
 			/* parse the file */
 			while(FileBuffgetFsa(inputfile, header, qseq, trans)) {
@@ -222,7 +336,7 @@ void makeDB(HashMap *templates, int kmerindex, char **inputfiles, int fileCount,
 				}
 				bias = compDNAref(compressor, qseq->seq, qseq->len);
 				
-				if(qualcheck(compressor, MinLen) && update_DB(templates, compressor, templates->DB_size, MinKlen, homQ, homT, *template_ulengths, *template_slengths, header)) {
+				if(qualcheck(compressor, MinLen) && (batch ? (n = countDBs(templates, compressor)) : update_DB(templates, compressor, templates->DB_size, MinKlen, homQ, homT, *template_ulengths, *template_slengths, header))) {
 					/* Update annots */
 					seq = header->seq + header->len;
 					while(isspace(*--seq)) {
@@ -237,9 +351,25 @@ void makeDB(HashMap *templates, int kmerindex, char **inputfiles, int fileCount,
 					
 					fprintf(stderr, "# Added:\t%s\n", header->seq + 1);
 					
+					if(batch) {
+						/* queue template */
+						offsets[batchSize] = batchKmers;
+						compressor = batch + ++batchSize;
+						batchKmers += n;
+						if(batchSize == SHARDBATCH || SHARDKMERS <= batchKmers || (pairs && pairs->max && pairs->max <= batchKmers) || templates->DB_size + 1 == USHRT_MAX) {
+							shardBatch(threads, thread_num, templates->DB_size + 1 - batchSize, batchSize, batchKmers);
+							compressor = batch;
+							batchSize = 0;
+							batchKmers = 0;
+						}
+					}
+					
 					if(++(templates->DB_size) == USHRT_MAX) {
 						/* convert values to unsigned */
 						convertToU(templates);
+						for(i = 0; shards && i < thread_num; ++i) {
+							convertToU(shards[i]);
+						}
 					}
 				} else {
 					fprintf(stderr, "# Skipped:\t%s\n", header->seq + 1);
@@ -259,6 +389,24 @@ void makeDB(HashMap *templates, int kmerindex, char **inputfiles, int fileCount,
 		}
 	}
 	
+	/* merge shards */
+	if(batch) {
+		if(batchSize) {
+			shardBatch(threads, thread_num, templates->DB_size - batchSize, batchSize, batchKmers);
+		}
+		if(shards) {
+			hashMap_mergeShards(templates, shards, thread_num);
+		}
+		for(i = 0; i < SHARDBATCH; ++i) {
+			freeComp(batch + i);
+		}
+		free(batch);
+		free(offsets);
+		free(shards);
+		free(threads);
+		compressor = 0;
+	}
+	
 	/* Dump annots */
 	cfwrite(&templates->DB_size, sizeof(int), 1, length_out);
 	if(*template_ulengths != 0) {
@@ -275,7 +423,9 @@ void makeDB(HashMap *templates, int kmerindex, char **inputfiles, int fileCount,
 	fclose(length_out);
 	fclose(name_out);
 	
-	if(templates->n) {
+	if(pairs && (pairs->n || pairs->total)) {
+		fprintf(stderr, "# Templates k-mer pairs:\t%lu.\n", pairs->n + pairs->total);
+	} else if(templates->n) {
 		fprintf(stderr, "# Templates key-value pairs:\t%lu.\n", templates->n);// / 1048576);
 	} else {
 		fprintf(stderr, "DB is empty!!!\n");
@@ -283,8 +433,10 @@ void makeDB(HashMap *templates, int kmerindex, char **inputfiles, int fileCount,
 	}
 	
 	/* clean */
-	freeComp(compressor);
-	free(compressor);
+	if(compressor) {
+		freeComp(compressor);
+		free(compressor);
+	}
 	destroyQseqs(header);
 	destroyQseqs(qseq);
 	destroyFileBuff(inputfile);
@@ -16,7 +16,30 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
 */
+#define _XOPEN_SOURCE 600
+#include <pthread.h>
+#include "compdna.h"
 #include "hashmap.h"
+#include "radix.h"
+
+#ifndef MAKEINDEX
+#define SHARDBATCH 1024
+#define SHARDKMERS 16777216
+typedef struct shardThread ShardThread;
+struct shardThread {
+	pthread_t id;
+	unsigned num;
+	unsigned shard_num;
+	unsigned template;
+	int size;
+	long unsigned *offsets;
+	CompDNA *batch;
+	HashMap *shard;
+	HashMap *templates;
+	KmerPairs *pairs;
+};
+#define MAKEINDEX 1
+#endif
 
 extern int (*biasPrintPtr)(FILE*, char*, unsigned char*, int);
 extern int (*qualcheck)(CompDNA *, const int);
@@ -26,4 +49,5 @@ int lenCheck(CompDNA *qseq, const int minlen);
 int internalStopCheck1(CompDNA *qseq);
 int internalStopCheck(CompDNA *qseq, const int minlen);
 int qualCheck(CompDNA *qseq, const int minlen);
-void makeDB(HashMap *templates, int kmerindex, char **inputfiles, int fileCount, char *outputfilename, int appender, char *trans, int MinLen, int MinKlen, double homQ, double homT, unsigned **template_lengths, unsigned **template_ulengths, unsigned **template_slengths);
+void makeDB(HashMap *templates, int kmerindex, char **inputfiles, int fileCount, char *outputfilename, int appender, char *trans, int MinLen, int MinKlen, double homQ, double homT, unsigned **template_lengths, unsigned **template_ulengths, unsigned **template_slengths, int thread_num, KmerPairs *pairs);
+void * shardDB_thread(void *arg);
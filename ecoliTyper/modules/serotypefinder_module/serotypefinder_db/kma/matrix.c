@@ -36,6 +36,7 @@ Matrix * matrix_init(unsigned size) {
 	dest = smalloc(sizeof(Matrix));
 	dest->n = 0;
 	dest->size = size;
+	dest->base = size;
 	dest->mat = smalloc(size * sizeof(int *));
 	Size = size;
 	Size *= size;
@@ -64,6 +65,7 @@ Matrix * ltdMatrix_init(unsigned size) {
 	dest = smalloc(sizeof(Matrix));
 	dest->n = 0;
 	dest->size = size;
+	dest->base = size;
 	dest->mat = smalloc(size * sizeof(int *));
 	Size = size;
 	Size *= (size - 1);
@@ -95,6 +97,7 @@ Matrix * ltdMatrix_minit(long unsigned size) {
 	dest = smalloc(sizeof(Matrix));
 	dest->n = 0;
 	dest->size = size;
+	dest->base = size;
 	dest->mat = smalloc(size * sizeof(int *));
 	n = size;
 	size = size * (size - 1) * sizeof(int) / 2;
@@ -125,34 +128,66 @@ Matrix * ltdMatrix_minit(long unsigned size) {
 	return dest;
 }
 
+Matrix * ltdMatrix_wrap(int *src, unsigned size) {
+	
+	int i, **ptr;
+	Matrix *dest;
+	
+	/* lower triangular matrix on memory owned by the caller */
+	dest = smalloc(sizeof(Matrix));
+	dest->n = 0;
+	dest->size = size;
+	dest->base = size;
+	dest->mat = smalloc(size * sizeof(int *));
+	ptr = dest->mat;
+	i = 0;
+	*ptr++ = src;
+	while(--size) {
+		*ptr++ = src + i;
+		src += i++;
+	}
+	
+	return dest;
+}
+
 void ltdMatrix_realloc(Matrix *src, unsigned size) {
 	
 	int i, **ptr, *mat;
 	long unsigned Size;
 	
+	/* new rows go in a block of their own, the former rows stay in place */
+	if(size <= src->size) {
+		return;
+	}
 	Size = size;
 	Size *= (size - 1);
+	Size -= (long unsigned)(src->size) * (src->size - 1);
 	Size *= (sizeof(int) / 2);
-	*(src->mat) = realloc(*(src->mat), Size);
 	src->mat = realloc(src->mat, size * sizeof(int *));
-	if(!src->mat || !*(src->mat)) {
+	if(!src->mat || !(mat = malloc(Size))) {
 		ERROR();
 	}
-	src->size = size;
 	
-	/* set matrix rows */
-	ptr = src->mat;
-	mat = *ptr;
-	i = 0;
-	*ptr++ = mat;
-	while(--size) {
-		*ptr++ = mat + i;
+	/* set new rows */
+	ptr = src->mat + src->size;
+	i = src->size;
+	while(i < size) {
+		*ptr++ = mat;
 		mat += i++;
 	}
+	src->size = size;
 }
 
 void Matrix_destroy(Matrix *src) {
 	
+	int i;
+	
+	/* free grown blocks, found where rows stop being contiguous */
+	for(i = src->size - 1; src->base <= i; --i) {
+		if(src->mat[i] != src->mat[i - 1] + (i - 1)) {
+			free(src->mat[i]);
+		}
+	}
 	free(*(src->mat));
 	free(src->mat);
 	free(src);
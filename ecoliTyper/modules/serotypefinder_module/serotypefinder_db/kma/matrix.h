@@ -22,6 +22,7 @@ typedef struct matrix Matrix;
 struct matrix {
 	int n;
 	int size;
+	int base; /* rows in the first block, later rows are grown in blocks of their own */
 	int **mat;
 };
 #define MATRIX 1
@@ -30,6 +31,7 @@ struct matrix {
 Matrix * matrix_init(unsigned size);
 Matrix * ltdMatrix_init(unsigned size);
 Matrix * ltdMatrix_minit(long unsigned size);
+Matrix * ltdMatrix_wrap(int *src, unsigned size);
 void ltdMatrix_realloc(Matrix *src, unsigned size);
 void Matrix_destroy(Matrix *src);
 void Matrix_mdestroy(Matrix *src);
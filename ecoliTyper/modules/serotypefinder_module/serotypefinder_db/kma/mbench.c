@@ -0,0 +1,844 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "assembly.h"
+#include "bench.h"
+#include "chain.h"
+#include "compdna.h"
+#include "filebuff.h"
+#include "hashmapcci.h"
+#include "hashmapkma.h"
+#include "kmastat.h"
+#include "mbench.h"
+#include "nw.h"
+#include "penalties.h"
+#include "pherror.h"
+#include "qseqs.h"
+#include "seq2fasta.h"
+#include "seqparse.h"
+#include "stdnuc.h"
+#include "version.h"
+
+static long unsigned mbench_cycles(void) {
+	
+	/* time stamp counter, zero where there is none */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	return __builtin_ia32_rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static long unsigned mbench_getFq(MBench *src, long unsigned *bytes) {
+	
+	long unsigned n, check;
+	
+	if(!(openAndDetermine(src->inputfile, src->fqname) & 1)) {
+		fprintf(stderr, "Malformed input:\t%s\n", src->fqname);
+		exit(1);
+	}
+	n = 0;
+	check = 0;
+	while(FileBuffgetFq(src->inputfile, src->header, src->qseq, src->qual, src->trans)) {
+		check += src->qseq->len;
+		++n;
+	}
+	closeFileBuff(src->inputfile);
+	src->check = check;
+	*bytes = src->fqSize;
+	
+	return n;
+}
+
+static long unsigned mbench_compDNA(MBench *src, long unsigned *bytes) {
+	
+	int i;
+	long unsigned check;
+	
+	check = 0;
+	for(i = 0; i < src->n; ++i) {
+		compDNA(src->comps + i, src->seqs + src->offsets[i], src->offsets[i + 1] - src->offsets[i]);
+		check += *(src->comps[i].seq);
+	}
+	src->check = check;
+	*bytes = src->bases;
+	
+	return src->n;
+}
+
+static long unsigned mbench_rc_comp(MBench *src, long unsigned *bytes) {
+	
+	int i;
+	long unsigned check;
+	
+	check = 0;
+	for(i = 0; i < src->n; ++i) {
+		rc_comp(src->comps + i, src->comps_rc + i);
+		check += *(src->comps_rc[i].seq);
+	}
+	src->check = check;
+	*bytes = src->bases;
+	
+	return src->n;
+}
+
+static long unsigned mbench_hashMap_get(MBench *src, long unsigned *bytes) {
+	
+	long unsigned i, check;
+	
+	check = 0;
+	for(i = 0; i < src->n_kmers; ++i) {
+		if((src->values[i] = hashMap_get(src->templates_kma, src->kmers[i]))) {
+			check += *(src->values[i]) + i;
+		}
+	}
+	src->check = check;
+	*bytes = src->n_kmers * sizeof(long unsigned);
+	
+	return src->n_kmers;
+}
+
+static long unsigned mbench_hashMap_getBatch(MBench *src, long unsigned *bytes) {
+	
+	long unsigned i, check;
+	
+	for(i = 0; i + HASHMAPBATCH <= src->n_kmers; i += HASHMAPBATCH) {
+		hashMap_getBatch(src->templates_kma, src->kmers + i, HASHMAPBATCH, src->values + i);
+	}
+	if(i < src->n_kmers) {
+		hashMap_getBatch(src->templates_kma, src->kmers + i, src->n_kmers - i, src->values + i);
+	}
+	check = 0;
+	for(i = 0; i < src->n_kmers; ++i) {
+		if(src->values[i]) {
+			check += *(src->values[i]) + i;
+		}
+	}
+	src->check = check;
+	*bytes = src->n_kmers * sizeof(long unsigned);
+	
+	return src->n_kmers;
+}
+
+static long unsigned mbench_intpos(MBench *src, long unsigned *bytes) {
+	
+	long unsigned i, check;
+	
+	check = 0;
+	for(i = 0; i < src->n_hits; ++i) {
+		check += intpos_bin_contaminationPtr(src->hits[i], src->hitTemplates[i]) + 1;
+	}
+	src->check = check;
+	*bytes = src->n_hits * sizeof(unsigned);
+	
+	return src->n_hits;
+}
+
+static long unsigned mbench_NW_band(MBench *src, long unsigned *bytes) {
+	
+	int i, t_s, t_e, q_len, band;
+	long unsigned n, check;
+	AlnScore Stat;
+	
+	n = 0;
+	check = 0;
+	*bytes = 0;
+	for(i = 0; i < src->n; ++i) {
+		q_len = src->offsets[i + 1] - src->offsets[i];
+		t_s = src->positions[i];
+		t_e = t_s + q_len;
+		if(src->template_lengths[src->templates[i]] < t_e) {
+			t_e = src->template_lengths[src->templates[i]];
+		}
+		
+		/* as in KMA, narrow gaps go to NW */
+		band = abs(t_e - t_s - q_len) + 64;
+		if(band < q_len && band < t_e - t_s) {
+			src->aligned->pos = 0;
+			Stat = NW_band(src->seqs_t[src->templates[i]], src->queries + src->offsets[i], 0, t_s, t_e, 0, q_len, src->aligned, band, src->matrices, src->template_lengths[src->templates[i]]);
+			check += Stat.score + ((long unsigned) Stat.len << 32);
+			*bytes += q_len;
+			++n;
+		}
+	}
+	src->check = check;
+	
+	return n;
+}
+
+static long unsigned mbench_NW_band_scalar(MBench *src, long unsigned *bytes) {
+	
+	long unsigned n;
+	int (*row)(int *, int *, int *, unsigned char *, const int *, const int *, const unsigned char *, const int *, int, int, int, int, int, int);
+	
+	row = nwBandRow;
+	nwBandRow = &nwBandRow_scalar;
+	n = mbench_NW_band(src, bytes);
+	nwBandRow = row;
+	
+	return n;
+}
+
+static long unsigned mbench_chainSeeds(MBench *src, long unsigned *bytes) {
+	
+	int i, start, len, size;
+	unsigned mapQ;
+	long unsigned check;
+	AlnPoints *points, *seeds;
+	
+	/* seeds are copied in, as chaining alters their weights */
+	points = src->points;
+	seeds = src->seeds;
+	check = 0;
+	*bytes = 0;
+	for(i = 0; i < src->n; ++i) {
+		start = src->seedOffsets[i];
+		len = src->seedOffsets[i + 1] - start;
+		if(len) {
+			size = len * sizeof(int);
+			memcpy(points->tStart, seeds->tStart + start, size);
+			memcpy(points->tEnd, seeds->tEnd + start, size);
+			memcpy(points->qStart, seeds->qStart + start, size);
+			memcpy(points->qEnd, seeds->qEnd + start, size);
+			memcpy(points->weight, seeds->weight + start, size);
+			points->len = len;
+			start = chainSeeds(points, src->offsets[i + 1] - src->offsets[i], src->template_lengths[src->templates[i]], src->kmersize, &mapQ);
+			check += points->score[start] + mapQ;
+			*bytes += 5 * size;
+		}
+	}
+	src->check = check;
+	
+	return src->n;
+}
+
+static long unsigned mbench_hashMapCCI_load(MBench *src, long unsigned *bytes) {
+	
+	int i;
+	long unsigned check;
+	
+	if(lseek(src->seq_fd, 0, SEEK_SET) != 0) {
+		ERROR();
+	}
+	check = 0;
+	*bytes = 0;
+	for(i = 1; i < src->DB_size; ++i) {
+		src->template_index = hashMapCCI_load(src->template_index, src->seq_fd, src->template_lengths[i], src->kmersize);
+		check += src->template_index->ndup + src->template_index->size;
+		*bytes += src->template_lengths[i];
+	}
+	src->check = check;
+	
+	return *bytes;
+}
+
+static long unsigned mbench_callConsensus(MBench *src, long unsigned *bytes) {
+	
+	int i;
+	long unsigned check;
+	Assem *aligned_assem;
+	
+	aligned_assem = src->aligned_assem;
+	check = 0;
+	*bytes = 0;
+	for(i = 1; i < src->DB_size; ++i) {
+		aligned_assem->depth = 0;
+		aligned_assem->depthVar = 0;
+		aligned_assem->aln_len = 0;
+		aligned_assem->cover = 0;
+		callConsensus(src->matrix + i, aligned_assem, src->seqs_t[i], src->template_lengths[i], 1, 0.05, 1);
+		check += aligned_assem->depth + aligned_assem->cover + aligned_assem->q[aligned_assem->len >> 1];
+		*bytes += src->template_lengths[i] * sizeof(Assembly);
+	}
+	src->check = check;
+	
+	return *bytes / sizeof(Assembly);
+}
+
+static int mbench_strand(const long unsigned *seq_t, int t_len, int pos, const unsigned char *read, int len) {
+	
+	int i, end, fw, rc;
+	unsigned char nuc;
+	
+	/* count agreeing bases in the head of the read, on both strands */
+	end = pos + (len < 32 ? len : 32);
+	end = t_len < end ? t_len : end;
+	fw = 0;
+	rc = 0;
+	for(i = pos; i < end; ++i) {
+		nuc = getNuc(seq_t, i);
+		fw += (read[i - pos] == nuc);
+		rc += ((3 - read[len - 1 - i + pos]) == nuc);
+	}
+	
+	return fw < rc;
+}
+
+static void mbench_seeds(MBench *src, int i, long unsigned *state) {
+	
+	int n, q, q_e, w, t, q_len, t_len, pos, drift;
+	AlnPoints *seeds;
+	
+	/* collinear seeds along the origin of the read, with decoys between */
+	seeds = src->seeds;
+	n = src->seedOffsets[i];
+	q_len = src->offsets[i + 1] - src->offsets[i];
+	t_len = src->template_lengths[src->templates[i]];
+	pos = src->positions[i];
+	drift = 0;
+	q = 0;
+	while(q + src->kmersize <= q_len) {
+		if(seeds->size <= n + 2) {
+			seedPoint_realloc(seeds, seeds->size << 1);
+		}
+		w = src->kmersize + benchRand(state) % 24;
+		w = q_len < q + w ? q_len - q : w;
+		t = pos + q + drift;
+		if(t < 0 || t_len < t + w) {
+			break;
+		}
+		seeds->qStart[n] = q;
+		seeds->qEnd[n] = q + w;
+		seeds->tStart[n] = t + 1;
+		seeds->tEnd[n] = t + w + 1;
+		seeds->weight[n] = w;
+		++n;
+		q_e = q + w;
+		
+		/* decoy */
+		if((benchRand(state) & 1) && src->kmersize + 8 < t_len) {
+			w = src->kmersize + benchRand(state) % 8;
+			t = benchRand(state) % (t_len - w);
+			seeds->qStart[n] = q + benchRand(state) % 8;
+			if(seeds->qStart[n] + w <= q_len) {
+				seeds->qEnd[n] = seeds->qStart[n] + w;
+				seeds->tStart[n] = t + 1;
+				seeds->tEnd[n] = t + w + 1;
+				seeds->weight[n] = w;
+				++n;
+			}
+		}
+		q = q_e + 1 + benchRand(state) % 8;
+		if((benchRand(state) & 3) == 0) {
+			drift += (benchRand(state) & 1) ? 1 : -1;
+		}
+	}
+	src->seedOffsets[i + 1] = n;
+}
+
+static Penalties * mbench_rewards(void) {
+	
+	int i, j, **d;
+	Penalties *rewards;
+	
+	/* default kma scoring */
+	rewards = smalloc(sizeof(Penalties));
+	rewards->M = 1;
+	rewards->MM = -2;
+	rewards->U = -1;
+	rewards->W1 = -3;
+	rewards->Wl = -6;
+	rewards->Mn = 0;
+	rewards->PE = 7;
+	d = smalloc(5 * sizeof(int *) + 25 * sizeof(int));
+	*d = (int *) (d + 5);
+	for(i = 0; i < 5; ++i) {
+		d[i] = *d + 5 * i;
+		for(j = 0; j < 5; ++j) {
+			d[i][j] = (i == 4 || j == 4) ? rewards->Mn : i == j ? rewards->M : -2;
+		}
+	}
+	d[4][4] = 0;
+	rewards->d = d;
+	
+	return rewards;
+}
+
+MBench * mbench_init(char *templatefilename, char *outputfilename, int len, double depth, double error, long unsigned seed) {
+	
+	int i, j, n, file_len, q_len, t_len, max_t, shifter, cPos, iPos, size;
+	long unsigned kmer, state;
+	unsigned *values;
+	unsigned char *read, *query;
+	FILE *file;
+	struct stat st;
+	Assembly *assembly;
+	MBench *src;
+	
+	src = smalloc(sizeof(MBench));
+	
+	/* draw reads */
+	benchReads(templatefilename, outputfilename, len, depth, error, 0, seed);
+	src->fqname = smalloc(strlen(outputfilename) + 4);
+	sprintf(src->fqname, "%s.fq", outputfilename);
+	if(stat(src->fqname, &st)) {
+		ERROR();
+	}
+	src->fqSize = st.st_size;
+	
+	/* templates */
+	src->template_lengths = getLengths(templatefilename);
+	src->DB_size = *src->template_lengths;
+	src->seqs_t = smalloc(src->DB_size * sizeof(long unsigned *));
+	*src->seqs_t = 0;
+	file_len = strlen(templatefilename);
+	strcat(templatefilename, ".seq.b");
+	file = sfopen(templatefilename, "rb");
+	max_t = 0;
+	for(i = 1; i < src->DB_size; ++i) {
+		t_len = src->template_lengths[i];
+		max_t = max_t < t_len ? t_len : max_t;
+		src->seqs_t[i] = smalloc(((t_len >> 5) + 1) * sizeof(long unsigned));
+		sfread(src->seqs_t[i], sizeof(long unsigned), (t_len >> 5) + 1, file);
+	}
+	fclose(file);
+	if((src->seq_fd = open(templatefilename, O_RDONLY)) < 0) {
+		ERROR();
+	}
+	templatefilename[file_len] = 0;
+	
+	/* k-mer DB */
+	strcat(templatefilename, ".comp.b");
+	file = sfopen(templatefilename, "rb");
+	src->templates_kma = smalloc(sizeof(HashMapKMA));
+	hashMap_get = &hashMap_getGlobal;
+	if(hashMapKMA_load(src->templates_kma, file, templatefilename) == 1) {
+		fprintf(stderr, "Wrong format of DB.\n");
+		exit(1);
+	}
+	fclose(file);
+	templatefilename[file_len] = 0;
+	strcat(templatefilename, ".filter.b");
+	if((file = fopen(templatefilename, "rb"))) {
+		hashMapKMA_loadFilter(src->templates_kma, file);
+		fclose(file);
+	}
+	templatefilename[file_len] = 0;
+	src->kmersize = src->templates_kma->kmersize;
+	if(src->kmersize < 4 || 31 < src->kmersize) {
+		src->kmersize = 16;
+	}
+	
+	/* fastq parsing */
+	src->trans = smalloc(384);
+	memset(src->trans, 8, 384);
+	src->trans += 128;
+	src->trans['\n'] = 16;
+	src->trans['A'] = 0;
+	src->trans['C'] = 1;
+	src->trans['G'] = 2;
+	src->trans['T'] = 3;
+	src->trans['N'] = 4;
+	src->inputfile = setFileBuff(CHUNK);
+	src->header = setQseqs(256);
+	src->qseq = setQseqs(1024);
+	src->qual = setQseqs(1024);
+	
+	/* load reads */
+	size = 1024;
+	src->offsets = smalloc((size + 1) * sizeof(int));
+	src->templates = smalloc(size * sizeof(int));
+	src->positions = smalloc(size * sizeof(int));
+	src->bases = 0;
+	src->seqs = smalloc(size * (len + 1));
+	*src->offsets = 0;
+	n = 0;
+	if(!(openAndDetermine(src->inputfile, src->fqname) & 1)) {
+		fprintf(stderr, "Malformed input:\t%s\n", src->fqname);
+		exit(1);
+	}
+	while(FileBuffgetFq(src->inputfile, src->header, src->qseq, src->qual, src->trans)) {
+		if(n == size) {
+			size <<= 1;
+			src->offsets = realloc(src->offsets, (size + 1) * sizeof(int));
+			src->templates = realloc(src->templates, size * sizeof(int));
+			src->positions = realloc(src->positions, size * sizeof(int));
+			src->seqs = realloc(src->seqs, size * (len + 1));
+			if(!src->offsets || !src->templates || !src->positions || !src->seqs) {
+				ERROR();
+			}
+		}
+		if(sscanf((char *) src->header->seq, "@bench_%*u_%d_%d", src->templates + n, src->positions + n) != 2) {
+			fprintf(stderr, "Malformed header:\t%s\n", src->header->seq);
+			exit(1);
+		}
+		memcpy(src->seqs + src->offsets[n], src->qseq->seq, src->qseq->len);
+		src->offsets[n + 1] = src->offsets[n] + src->qseq->len;
+		src->bases += src->qseq->len;
+		++n;
+	}
+	closeFileBuff(src->inputfile);
+	src->n = n;
+	
+	/* reads on the strand of their template */
+	src->queries = smalloc(src->bases + 1);
+	for(i = 0; i < n; ++i) {
+		read = src->seqs + src->offsets[i];
+		query = src->queries + src->offsets[i];
+		q_len = src->offsets[i + 1] - src->offsets[i];
+		if(mbench_strand(src->seqs_t[src->templates[i]], src->template_lengths[src->templates[i]], src->positions[i], read, q_len)) {
+			for(j = 0; j < q_len; ++j) {
+				query[j] = 3 - read[q_len - 1 - j];
+			}
+		} else {
+			memcpy(query, read, q_len);
+		}
+	}
+	
+	/* compressed reads */
+	src->comps = smalloc(n * sizeof(CompDNA));
+	src->comps_rc = smalloc(n * sizeof(CompDNA));
+	for(i = 0; i < n; ++i) {
+		allocComp(src->comps + i, len);
+		allocComp(src->comps_rc + i, len);
+		compDNA(src->comps + i, src->seqs + src->offsets[i], src->offsets[i + 1] - src->offsets[i]);
+		rc_comp(src->comps + i, src->comps_rc + i);
+	}
+	
+	/* k-mers on both strands, as kma looks them up */
+	i = src->templates_kma->mlen;
+	src->n_kmers = 0;
+	for(j = 0; j < n; ++j) {
+		q_len = src->offsets[j + 1] - src->offsets[j];
+		src->n_kmers += q_len < i ? 0 : (q_len - i + 1) << 1;
+	}
+	src->kmers = smalloc((src->n_kmers + 1) * sizeof(long unsigned));
+	src->values = smalloc((src->n_kmers + 1) * sizeof(unsigned *));
+	src->hits = smalloc((src->n_kmers + 1) * sizeof(unsigned *));
+	src->hitTemplates = smalloc((src->n_kmers + 1) * sizeof(int));
+	shifter = sizeof(long unsigned) * sizeof(long unsigned) - (i << 1);
+	src->n_kmers = 0;
+	src->n_hits = 0;
+	for(j = 0; j < n; ++j) {
+		q_len = src->offsets[j + 1] - src->offsets[j] - i + 1;
+		for(size = 0; size < q_len; ++size) {
+			getKmer_macro(kmer, src->comps[j].seq, size, cPos, iPos, shifter);
+			src->kmers[src->n_kmers++] = kmer;
+			getKmer_macro(kmer, src->comps_rc[j].seq, size, cPos, iPos, shifter);
+			src->kmers[src->n_kmers++] = kmer;
+		}
+		
+		/* hits, for the template searches */
+		for(size = src->n_kmers - (q_len < 0 ? 0 : q_len << 1); size < src->n_kmers; ++size) {
+			if((values = hashMap_get(src->templates_kma, src->kmers[size]))) {
+				src->hits[src->n_hits] = values;
+				src->hitTemplates[src->n_hits++] = src->templates[j];
+			}
+		}
+	}
+	
+	/* alignment */
+	src->rewards = mbench_rewards();
+	src->matrices = NWmat_init(1024, 1024, src->rewards);
+	src->aligned = smalloc(sizeof(Aln));
+	src->aligned->t = smalloc((len + 1) << 2);
+	src->aligned->s = smalloc((len + 1) << 2);
+	src->aligned->q = smalloc((len + 1) << 2);
+	
+	/* seeds */
+	state = seed ? seed : 1;
+	src->seeds = seedPoint_init(1024, src->rewards);
+	src->seedOffsets = smalloc((n + 1) * sizeof(int));
+	*src->seedOffsets = 0;
+	size = 0;
+	for(i = 0; i < n; ++i) {
+		mbench_seeds(src, i, &state);
+		j = src->seedOffsets[i + 1] - src->seedOffsets[i];
+		size = size < j ? j : size;
+	}
+	src->points = seedPoint_init(size + 1, src->rewards);
+	
+	/* CCI, sized for the longest template as in kma */
+	src->template_index = smalloc(sizeof(HashMapCCI));
+	src->template_index->size = 0;
+	hashMapCCI_initialize(src->template_index, max_t, src->kmersize);
+	
+	/* pile-ups at depth, with the odd minor base and deletion */
+	src->matrix = smalloc(src->DB_size * sizeof(AssemInfo));
+	for(i = 1; i < src->DB_size; ++i) {
+		t_len = src->template_lengths[i];
+		src->matrix[i].len = t_len;
+		src->matrix[i].size = t_len;
+		src->matrix[i].assmb = smalloc(t_len * sizeof(Assembly));
+		assembly = src->matrix[i].assmb;
+		for(j = 0; j < t_len; ++j) {
+			memset(assembly[j].counts, 0, sizeof(assembly[j].counts));
+			assembly[j].counts[getNuc(src->seqs_t[i], j)] = depth * (0.8 + (benchRand(&state) % 41) / 100.0) + 0.5;
+			if(benchRand(&state) % 100 == 0) {
+				assembly[j].counts[benchRand(&state) & 3] += depth / 2;
+			}
+			if(benchRand(&state) % 500 == 0) {
+				assembly[j].counts[5] += depth;
+			}
+			assembly[j].next = j + 1;
+		}
+	}
+	src->aligned_assem = smalloc(sizeof(Assem));
+	src->aligned_assem->size = max_t + 1;
+	src->aligned_assem->t = smalloc(max_t + 1);
+	src->aligned_assem->s = smalloc(max_t + 1);
+	src->aligned_assem->q = smalloc(max_t + 1);
+	src->check = 0;
+	
+	return src;
+}
+
+void mbench_destroy(MBench *src) {
+	
+	int i;
+	
+	for(i = 1; i < src->DB_size; ++i) {
+		free(src->seqs_t[i]);
+		free(src->matrix[i].assmb);
+	}
+	for(i = 0; i < src->n; ++i) {
+		freeComp(src->comps + i);
+		freeComp(src->comps_rc + i);
+	}
+	close(src->seq_fd);
+	free(src->seqs_t);
+	free(src->matrix);
+	free(src->comps);
+	free(src->comps_rc);
+	free(src->template_lengths);
+	free(src->templates);
+	free(src->positions);
+	free(src->offsets);
+	free(src->seedOffsets);
+	free(src->kmers);
+	free(src->values);
+	free(src->hits);
+	free(src->hitTemplates);
+	free(src->seqs);
+	free(src->queries);
+	free(src->fqname);
+	free(src->trans - 128);
+	destroyFileBuff(src->inputfile);
+	destroyQseqs(src->header);
+	destroyQseqs(src->qseq);
+	destroyQseqs(src->qual);
+	hashMapKMA_destroy(src->templates_kma);
+	hashMapCCI_destroy(src->template_index);
+	NWmat_free(src->matrices);
+	free(src->aligned->t);
+	free(src->aligned->s);
+	free(src->aligned->q);
+	free(src->aligned);
+	seedPoint_free(src->seeds);
+	seedPoint_free(src->points);
+	free(src->aligned_assem->t);
+	free(src->aligned_assem->s);
+	free(src->aligned_assem->q);
+	free(src->aligned_assem);
+	free(src->rewards->d);
+	free(src->rewards);
+	free(src);
+}
+
+static void helpMessage(int exeStatus) {
+	FILE *helpOut;
+	if(exeStatus == 0) {
+		helpOut = stdout;
+	} else {
+		helpOut = stderr;
+	}
+	fprintf(helpOut, "# kma mbench times the core kernels of kma in isolation, on reads drawn from a DB.\n");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "Options:", "Desc:", "Default:");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-t_db", "DB to draw reads from", "");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-o", "Output prefix", "kma_mbench");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-l", "Read length", "150");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-depth", "Depth of reads on every template", "10");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-e", "Error rate", "0.01");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-seed", "Seed of the input", "1");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-reps", "Runs per kernel, fastest is kept", "5");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-v", "Version", "");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-h", "Shows this help message", "");
+	fprintf(helpOut, "#\n");
+	fprintf(helpOut, "# Cycles are those of the time stamp counter, and NA where there is none.\n");
+	fprintf(helpOut, "# Kernels sharing a checksum must agree, e.g. NW_band and its scalar rows.\n");
+	exit(exeStatus);
+}
+
+int mbench_main(int argc, char *argv[]) {
+	
+	static MBenchKernel kernels[] = {
+		{"FileBuffgetFq", "read", &mbench_getFq},
+		{"compDNA", "read", &mbench_compDNA},
+		{"rc_comp", "read", &mbench_rc_comp},
+		{"hashMap_get", "lookup", &mbench_hashMap_get},
+		{"hashMap_getBatch", "lookup", &mbench_hashMap_getBatch},
+		{"intpos_bin_contamination", "lookup", &mbench_intpos},
+		{"NW_band", "alignment", &mbench_NW_band},
+		{"NW_band_scalar", "alignment", &mbench_NW_band_scalar},
+		{"chainSeeds", "read", &mbench_chainSeeds},
+		{"hashMapCCI_load", "base", &mbench_hashMapCCI_load},
+		{"callConsensus", "base", &mbench_callConsensus},
+		{0, 0, 0}
+	};
+	int i, j, args, len, reps, status;
+	long unsigned seed, items, bytes, ns, cycles, best_ns, best_cycles, check;
+	long unsigned checks[sizeof(kernels) / sizeof(MBenchKernel)];
+	double depth, error;
+	char *outputfilename, *templatefilename, *outName, *exeBasic;
+	MBench *src;
+	
+	/* init */
+	templatefilename = 0;
+	outputfilename = "kma_mbench";
+	len = 150;
+	depth = 10;
+	error = 0.01;
+	seed = 1;
+	reps = 5;
+	
+	/* PARSE COMMAND LINE OPTIONS */
+	args = 1;
+	while(args < argc) {
+		if(strcmp(argv[args], "-t_db") == 0) {
+			if(++args < argc) {
+				templatefilename = smalloc(strlen(argv[args]) + 64);
+				strcpy(templatefilename, argv[args]);
+			}
+		} else if(strcmp(argv[args], "-o") == 0) {
+			if(++args < argc) {
+				outputfilename = argv[args];
+			}
+		} else if(strcmp(argv[args], "-l") == 0) {
+			if(++args < argc) {
+				len = strtol(argv[args], &exeBasic, 10);
+				if(*exeBasic != 0 || len < 1) {
+					fprintf(stderr, "Invalid argument at \"-l\".\n");
+					exit(1);
+				}
+			}
+		} else if(strcmp(argv[args], "-depth") == 0) {
+			if(++args < argc) {
+				depth = strtod(argv[args], &exeBasic);
+				if(*exeBasic != 0 || depth <= 0) {
+					fprintf(stderr, "Invalid argument at \"-depth\".\n");
+					exit(1);
+				}
+			}
+		} else if(strcmp(argv[args], "-e") == 0) {
+			if(++args < argc) {
+				error = strtod(argv[args], &exeBasic);
+				if(*exeBasic != 0 || error < 0 || 1 < error) {
+					fprintf(stderr, "Invalid argument at \"-e\".\n");
+					exit(1);
+				}
+			}
+		} else if(strcmp(argv[args], "-seed") == 0) {
+			if(++args < argc) {
+				seed = strtoul(argv[args], &exeBasic, 10);
+				if(*exeBasic != 0) {
+					fprintf(stderr, "Invalid argument at \"-seed\".\n");
+					exit(1);
+				}
+			}
+		} else if(strcmp(argv[args], "-reps") == 0) {
+			if(++args < argc) {
+				reps = strtol(argv[args], &exeBasic, 10);
+				if(*exeBasic != 0 || reps < 1) {
+					fprintf(stderr, "Invalid argument at \"-reps\".\n");
+					exit(1);
+				}
+			}
+		} else if(strcmp(argv[args], "-v") == 0) {
+			fprintf(stdout, "KMA_mbench-%s\n", KMA_VERSION);
+			exit(0);
+		} else if(strcmp(argv[args], "-h") == 0) {
+			helpMessage(0);
+		} else {
+			fprintf(stderr, " Invalid option:\t%s\n", argv[args]);
+			fprintf(stderr, " Printing help message:\n");
+			helpMessage(1);
+		}
+		++args;
+	}
+	if(!templatefilename) {
+		fprintf(stderr, "Insufficient number of agruments parsed.\n");
+		helpMessage(1);
+	}
+	outName = smalloc(strlen(outputfilename) + 64);
+	strcpy(outName, outputfilename);
+	
+	/* fixed input */
+	src = mbench_init(templatefilename, outName, len, depth, error, seed);
+	fprintf(stdout, "# Input:\t%d reads of %d bp, depth %.1f, error %.3f, seed %lu, %lu k-mers\n", src->n, len, depth, error, seed, src->n_kmers);
+	
+	/* time kernels */
+	status = 0;
+	fprintf(stdout, "# Kernel\tItem\tItems\tns/item\tCycles/item\tItems/s\tMB/s\tChecksum\n");
+	for(i = 0; kernels[i].name; ++i) {
+		best_ns = 0;
+		best_cycles = 0;
+		items = 0;
+		bytes = 0;
+		check = 0;
+		for(j = 0; j < reps; ++j) {
+			ns = kmaStat_ns();
+			cycles = mbench_cycles();
+			items = kernels[i].run(src, &bytes);
+			cycles = mbench_cycles() - cycles;
+			ns = kmaStat_ns() - ns;
+			if(j == 0 || ns < best_ns) {
+				best_ns = ns;
+				best_cycles = cycles;
+			}
+			if(j && check != src->check) {
+				fprintf(stderr, "# %s is not deterministic.\n", kernels[i].name);
+				status = 1;
+			}
+			check = src->check;
+		}
+		checks[i] = check;
+		best_ns = best_ns ? best_ns : 1;
+		items = items ? items : 1;
+		fprintf(stdout, "%s\t%s\t%lu\t%.2f\t", kernels[i].name, kernels[i].item, items, (double) best_ns / items);
+		if(best_cycles) {
+			fprintf(stdout, "%.1f\t", (double) best_cycles / items);
+		} else {
+			fprintf(stdout, "NA\t");
+		}
+		fprintf(stdout, "%.0f\t%.1f\t%016lx\n", items * 1e9 / best_ns, bytes * 1e3 / best_ns, check);
+		fflush(stdout);
+	}
+	
+	/* versions of the same kernel must agree */
+	for(i = 0; kernels[i].name; ++i) {
+		for(j = 0; j < i; ++j) {
+			if(strncmp(kernels[i].name, kernels[j].name, strlen(kernels[j].name)) == 0 && checks[i] != checks[j]) {
+				fprintf(stderr, "# %s does not agree with %s.\n", kernels[i].name, kernels[j].name);
+				status = 1;
+			}
+		}
+	}
+	
+	mbench_destroy(src);
+	free(outName);
+	free(templatefilename);
+	
+	return status;
+}
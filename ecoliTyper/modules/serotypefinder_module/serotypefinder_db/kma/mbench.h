@@ -0,0 +1,84 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include "assembly.h"
+#include "chain.h"
+#include "compdna.h"
+#include "filebuff.h"
+#include "hashmapcci.h"
+#include "hashmapkma.h"
+#include "nw.h"
+#include "penalties.h"
+#include "qseqs.h"
+
+#ifndef MBENCH
+typedef struct mbench MBench;
+typedef struct mbenchKernel MBenchKernel;
+struct mbench {
+	int n; /* reads */
+	int DB_size;
+	int kmersize;
+	int seq_fd;
+	int *template_lengths;
+	int *templates; /* template of each read */
+	int *positions; /* start of each read on its template */
+	int *offsets; /* start of each read in seqs and queries */
+	int *seedOffsets; /* start of the seeds of each read */
+	long unsigned bases;
+	long unsigned fqSize;
+	long unsigned n_kmers;
+	long unsigned n_hits;
+	long unsigned check; /* checksum of the last run */
+	long unsigned *kmers;
+	long unsigned **seqs_t; /* 2-bit templates */
+	unsigned **values;
+	unsigned **hits;
+	int *hitTemplates;
+	unsigned char *seqs; /* reads as read */
+	unsigned char *queries; /* reads on the template strand */
+	char *fqname;
+	char *trans;
+	FileBuff *inputfile;
+	Qseqs *header, *qseq, *qual;
+	CompDNA *comps, *comps_rc;
+	HashMapKMA *templates_kma;
+	HashMapCCI *template_index;
+	NWmat *matrices;
+	Aln *aligned;
+	AlnPoints *points, *seeds;
+	AssemInfo *matrix;
+	Assem *aligned_assem;
+	Penalties *rewards;
+};
+struct mbenchKernel {
+	char *name;
+	char *item;
+	long unsigned (*run)(MBench *, long unsigned *);
+};
+#define MBENCH 1
+#endif
+
+/*
+ Every kernel runs over the same fixed input, drawn with kma bench, and 
+ returns the number of items it handled along with the bytes it consumed. 
+ The checksum of each run allows two versions of a kernel to be compared.
+*/
+MBench * mbench_init(char *templatefilename, char *outputfilename, int len, double depth, double error, long unsigned seed);
+void mbench_destroy(MBench *src);
+int mbench_main(int argc, char *argv[]);
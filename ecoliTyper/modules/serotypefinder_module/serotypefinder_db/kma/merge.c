@@ -18,9 +18,12 @@
 */
 
 #define _XOPEN_SOURCE 600
+#include <errno.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "merge.h"
 #include "hashmapkma.h"
 #include "kmmap.h"
@@ -36,6 +39,53 @@
 #include <sys/mman.h>
 #endif
 
+static int bucketPairCmp(const void *a, const void *b) {
+	
+	const BucketPair *x, *y;
+	
+	x = (const BucketPair *) a;
+	y = (const BucketPair *) b;
+	
+	if(x->bucket != y->bucket) {
+		return (x->bucket > y->bucket) - (x->bucket < y->bucket);
+	}
+	return (x->kmer > y->kmer) - (x->kmer < y->kmer);
+}
+
+static void bucket_qsort(unsigned *key_index, long unsigned *key_index_l, unsigned *value_index, long unsigned *value_index_l, long unsigned n, long unsigned mask_new, unsigned flag) {
+	
+	long unsigned i, kmer;
+	BucketPair *pairs;
+	
+	/* hash each k-mer once, and sort on (new bucket, k-mer) */
+	pairs = smalloc(n * sizeof(BucketPair));
+	for(i = 0; i < n; ++i) {
+		kmer = key_index ? key_index[i] : key_index_l[i];
+		pairs[i].kmer = kmer;
+		if(flag) {
+			murmur(kmer, kmer);
+		}
+		pairs[i].bucket = kmer & mask_new;
+		pairs[i].value = value_index ? value_index[i] : value_index_l[i];
+	}
+	qsort(pairs, n, sizeof(BucketPair), &bucketPairCmp);
+	
+	/* write back */
+	for(i = 0; i < n; ++i) {
+		if(key_index) {
+			key_index[i] = pairs[i].kmer;
+		} else {
+			key_index_l[i] = pairs[i].kmer;
+		}
+		if(value_index) {
+			value_index[i] = pairs[i].value;
+		} else {
+			value_index_l[i] = pairs[i].value;
+		}
+	}
+	free(pairs);
+}
+
 long unsigned bucket_insertionsort(unsigned *key_index, unsigned *value_index, long unsigned *value_index_l, long unsigned mask_new, long unsigned mask_org, unsigned flag) {
 	
 	unsigned *start, *end;
@@ -77,6 +127,12 @@ long unsigned bucket_insertionsort(unsigned *key_index, unsigned *value_index, l
 		return n;
 	}
 	
+	/* larger buckets are not worth a quadratic sort */
+	if(BUCKETSMALL < n) {
+		bucket_qsort(key_index, 0, value_index, value_index_l, n, mask_new, flag);
+		return n;
+	}
+	
 	/* run insertion sort */
 	while(start < end) {
 		/* find min */
@@ -165,6 +221,12 @@ long unsigned bucket_insertionsort_l(long unsigned *key_index, unsigned *value_i
 		return n;
 	}
 	
+	/* larger buckets are not worth a quadratic sort */
+	if(BUCKETSMALL < n) {
+		bucket_qsort(0, key_index, value_index, value_index_l, n, mask_new, flag);
+		return n;
+	}
+	
 	/* run insertion sort */
 	while(start < end) {
 		/* find min */
@@ -213,35 +275,47 @@ long unsigned bucket_insertionsort_l(long unsigned *key_index, unsigned *value_i
 	return n;
 }
 
-void hashMapKMA_sortbuckets(HashMapKMA *dest, HashMapKMA *src) {
+static long unsigned bucketOf(HashMapKMA *src, long unsigned index, long unsigned mask, unsigned flag) {
 	
-	unsigned flag, *exist, *key_index, *value_index;
-	long unsigned n, null_index, size, mask, mask_src, index, kmer;
-	long unsigned *exist_l, *key_index_l, *value_index_l;
+	long unsigned kmer;
 	
-	/* load value_indexes */
-	if(src->v_index < UINT_MAX) {
-		memcpy(dest->value_index, src->value_index, src->n * sizeof(unsigned));
-		value_index = dest->value_index;
-		value_index_l = 0;
-	} else {
-		memcpy(dest->value_index_l, src->value_index_l, src->n * sizeof(long unsigned));
-		value_index_l = dest->value_index_l;
-		value_index = 0;
+	kmer = src->mlen <= 16 ? src->key_index[index] : src->key_index_l[index];
+	if(flag) {
+		murmur(kmer, kmer);
 	}
+	
+	return kmer & mask;
+}
+
+void * sortbuckets_thread(void *arg) {
+	
+	MergeThread *thread = arg;
+	unsigned flag, *key_index, *value_index;
+	long unsigned n, size, mask, mask_src;
+	long unsigned *key_index_l, *value_index_l;
+	HashMapKMA *dest;
+	
+	dest = thread->dest;
+	flag = dest->flag;
+	mask = dest->size;
+	mask_src = thread->src->size;
 	if(dest->mlen <= 16) {
-		key_index = dest->key_index;
+		key_index = dest->key_index + thread->start;
 		key_index_l = 0;
 	} else {
 		key_index = 0;
-		key_index_l = dest->key_index_l;
+		key_index_l = dest->key_index_l + thread->start;
+	}
+	if(thread->src->v_index < UINT_MAX) {
+		value_index = dest->value_index + thread->start;
+		value_index_l = 0;
+	} else {
+		value_index = 0;
+		value_index_l = dest->value_index_l + thread->start;
 	}
 	
 	/* sort buckets */
-	flag = dest->flag;
-	mask = dest->size;
-	mask_src = src->size;
-	size = src->n;
+	size = thread->end - thread->start;
 	while(size) {
 		if(key_index) {
 			n = bucket_insertionsort(key_index, value_index, value_index_l, mask, mask_src, flag);
@@ -258,6 +332,75 @@ void hashMapKMA_sortbuckets(HashMapKMA *dest, HashMapKMA *src) {
 		size -= n;
 	}
 	
+	return NULL;
+}
+
+void hashMapKMA_sortbuckets(HashMapKMA *dest, HashMapKMA *src, int thread_num) {
+	
+	int i;
+	unsigned flag, *exist, *key_index;
+	long unsigned null_index, size, mask, mask_src, index, kmer, start;
+	long unsigned *exist_l, *key_index_l;
+	MergeThread *threads, *thread;
+	
+	/* load value_indexes */
+	if(src->v_index < UINT_MAX) {
+		memcpy(dest->value_index, src->value_index, src->n * sizeof(unsigned));
+	} else {
+		memcpy(dest->value_index_l, src->value_index_l, src->n * sizeof(long unsigned));
+	}
+	flag = dest->flag;
+	mask = dest->size;
+	mask_src = src->size;
+	
+	/* split pairs on buckets of src, so no bucket is shared */
+	if(src->n < ((long unsigned)(thread_num) << 10)) {
+		thread_num = 1;
+	}
+	threads = smalloc(thread_num * sizeof(MergeThread));
+	start = 0;
+	for(i = 0; i < thread_num; ++i) {
+		thread = threads + i;
+		thread->src = src;
+		thread->dest = dest;
+		thread->middle = 0;
+		thread->start = start;
+		if(i == thread_num - 1) {
+			start = src->n;
+		} else {
+			start = (src->n * (i + 1)) / thread_num;
+			if(start <= thread->start) {
+				start = thread->start;
+			} else {
+				kmer = bucketOf(dest, start - 1, mask_src, flag);
+				while(start < src->n && bucketOf(dest, start, mask_src, flag) == kmer) {
+					++start;
+				}
+			}
+		}
+		thread->end = start;
+	}
+	
+	/* thread out */
+	for(i = thread_num - 1; 0 <= i; --i) {
+		threads[i].id = 0;
+		if(i && (errno = pthread_create(&threads[i].id, NULL, &sortbuckets_thread, threads + i))) {
+			fprintf(stderr, "Error: %d (%s)\n", errno, strerror(errno));
+			ERROR();
+		}
+	}
+	
+	/* start main thread */
+	sortbuckets_thread(threads);
+	
+	/* join threads */
+	for(i = 1; i < thread_num; ++i) {
+		if((errno = pthread_join(threads[i].id, NULL))) {
+			ERROR();
+		}
+	}
+	free(threads);
+	
 	/* reset exist */
 	if(dest->exist) {
 		exist = dest->exist - 1;
@@ -468,7 +611,7 @@ long unsigned add_pairs(long unsigned *exist, long unsigned size, long unsigned
 	
 	unsigned *exist_t, *value_index;
 	long unsigned n, index, v_index;
-	long unsigned *layer, *exist_lt, *value_index_l;
+	long unsigned *exist_lt, *value_index_l;
 	
 	if(t2->kmersize <= 16) {
 		exist_t = t2->key_index - 1;
@@ -494,9 +637,7 @@ long unsigned add_pairs(long unsigned *exist, long unsigned size, long unsigned
 			++n;
 		} else { /* get combo of signatures */ 
 			/* search (new) combo */
-			layer = middle->layer + (exist[index] << 1);
-			layer[1] = layer[1] ? layer[1] : (middle->n + alternative->n);
-			exist[index] = middle->n + AlternativeLayer_add(alternative, layer[1] - middle->n, exist[index], MiddleLayer_search(middle, v_indexes + v_index));
+			exist[index] = middle->n + AlternativeLayer_add(alternative, exist[index], MiddleLayer_search(middle, v_indexes + v_index));
 		}
 	}
 	
@@ -508,7 +649,7 @@ void hashMapKMA_merge(HashMapKMA *dest, MiddleLayer *middle, MiddleLayer *altern
 	unsigned flag, *exist, *key_index;
 	long unsigned n, size, v_index, null_index, index, value;
 	long unsigned kmer, kmer1, kmer2, buff1[2], buff2[2];
-	long unsigned *layer, *exist_l, *key_index_l, *value_index_l;
+	long unsigned *exist_l, *key_index_l, *value_index_l;
 	
 	/* init */
 	n = 0;
@@ -575,11 +716,9 @@ void hashMapKMA_merge(HashMapKMA *dest, MiddleLayer *middle, MiddleLayer *altern
 				if(buff1[0] == buff2[0]) { /* new combo */
 					/* get position in middle layer */
 					value = MiddleLayer_search(middle, buff1[1]);
-					layer = middle->layer + (value << 1);
 					/* get combo */
 					kmer = buff1[0];
-					layer[1] = layer[1] ? layer[1] : (middle->n + alternative->n);
-					value = middle->n + AlternativeLayer_add(alternative, layer[1] - middle->n, value, MiddleLayer_search(middle, v_index + buff2[1]));
+					value = middle->n + AlternativeLayer_add(alternative, value, MiddleLayer_search(middle, v_index + buff2[1]));
 					
 					/* load next pairs */
 					if(fread(buff1, sizeof(long unsigned), 2, tmp_1)) {
@@ -1080,16 +1219,46 @@ void hashMapKMA_dumpmerge(HashMapKMA *src, HashMapKMA *t1, HashMapKMA *t2, Middl
 	free(src);
 }
 
-HashMapKMA * merge_kmersignatures(HashMapKMA *t1, HashMapKMA *t2, MiddleLayer *middle, MiddleLayer *alternative) {
+void * middlelayer_thread(void *arg) {
+	
+	MergeThread *thread = arg;
+	unsigned *exist_t;
+	long unsigned i, index, null_index, null_index_t, *exist_l, *exist_lt;
+	MiddleLayer *middle;
+	
+	middle = thread->middle;
+	null_index = thread->dest->null_index;
+	null_index_t = thread->src->null_index;
+	exist_l = thread->dest->exist_l;
+	if(thread->src->v_index < UINT_MAX) {
+		exist_t = thread->src->exist;
+		exist_lt = 0;
+	} else {
+		exist_t = 0;
+		exist_lt = thread->src->exist_l;
+	}
+	
+	/* map the range of exist on the middle layer */
+	for(i = thread->start; i < thread->end; ++i) {
+		index = exist_t ? exist_t[i] : exist_lt[i];
+		exist_l[i] = index == null_index_t ? null_index : MiddleLayer_search(middle, index);
+	}
+	
+	return NULL;
+}
+
+HashMapKMA * merge_kmersignatures(HashMapKMA *t1, HashMapKMA *t2, MiddleLayer *middle, MiddleLayer *alternative, int thread_num) {
 	
 	/* output hash with exist, key_index, value_index */
+	int i;
 	unsigned flag, *exist, *exist_t, *value_index, *key_index, *key_index_t;
 	long unsigned index, null_index, null_index_t, size, n, v_index, mask;
 	long unsigned key, kmer, kpos;
-	long unsigned *layer, *exist_l, *exist_lt, *value_index_l;
+	long unsigned *exist_l, *exist_lt, *value_index_l;
 	long unsigned *key_index_l, *key_index_tl;
 	FILE *tmp_1, *tmp_2;
 	HashMapKMA *dest;
+	MergeThread *threads;
 	
 	/* init */
 	dest = smalloc(sizeof(HashMapKMA));
@@ -1121,27 +1290,32 @@ HashMapKMA * merge_kmersignatures(HashMapKMA *t1, HashMapKMA *t2, MiddleLayer *m
 		exist_l = smalloc(t1->size * sizeof(long unsigned));
 		dest->exist_l = exist_l--;
 		
-		/* populate new exist with t1 */
+		/* populate new exist with t1, in ranges of the prefix space */
 		fprintf(stderr, "# Getting middlelayer signatures from first index.\n");
-		if(t1->v_index < UINT_MAX) {
-			exist_t = t1->exist - 1;
-			exist_lt = 0;
-		} else {
-			exist_t = 0;
-			exist_lt = t1->exist_l - 1;
+		MiddleLayer_index(middle);
+		if(dest->size < ((long unsigned)(thread_num) << 16)) {
+			thread_num = 1;
 		}
-		size = dest->size + 1;
-		null_index_t = t1->null_index;
-		while(--size) {
-			index = exist_t ? *++exist_t : *++exist_lt;
-			if(index == null_index_t) {
-				/* empty */
-				*++exist_l = null_index;
-			} else {
-				/* get index to middlelayer */
-				*++exist_l = MiddleLayer_search(middle, index);
+		threads = smalloc(thread_num * sizeof(MergeThread));
+		for(i = thread_num - 1; 0 <= i; --i) {
+			threads[i].id = 0;
+			threads[i].src = t1;
+			threads[i].dest = dest;
+			threads[i].middle = middle;
+			threads[i].start = (dest->size * i) / thread_num;
+			threads[i].end = (dest->size * (i + 1)) / thread_num;
+			if(i && (errno = pthread_create(&threads[i].id, NULL, &middlelayer_thread, threads + i))) {
+				fprintf(stderr, "Error: %d (%s)\n", errno, strerror(errno));
+				ERROR();
 			}
 		}
+		middlelayer_thread(threads);
+		for(i = 1; i < thread_num; ++i) {
+			if((errno = pthread_join(threads[i].id, NULL))) {
+				ERROR();
+			}
+		}
+		free(threads);
 		
 		/* merge with t2 */
 		fprintf(stderr, "# Merging middlelayer signatures with second index.\n");
@@ -1164,9 +1338,7 @@ HashMapKMA * merge_kmersignatures(HashMapKMA *t1, HashMapKMA *t2, MiddleLayer *m
 						dest->n++;
 					} else { /* get combo of signatures */
 						/* search (new) combo */
-						layer = middle->layer + (*exist_l << 1);
-						layer[1] = layer[1] ? layer[1] : (middle->n + alternative->n);
-						*exist_l = middle->n + AlternativeLayer_add(alternative, layer[1] - middle->n, *exist_l, MiddleLayer_search(middle, t1->v_index + index));
+						*exist_l = middle->n + AlternativeLayer_add(alternative, *exist_l, MiddleLayer_search(middle, t1->v_index + index));
 					}
 				}
 				++exist_l;
@@ -1358,7 +1530,7 @@ HashMapKMA * merge_kmersignatures(HashMapKMA *t1, HashMapKMA *t2, MiddleLayer *m
 			fprintf(stderr, "# Sorting buckets of first index w.r.t. new index.\n");
 			dest->null_index = t1->null_index;
 			dest->size--;
-			hashMapKMA_sortbuckets(dest, t1);
+			hashMapKMA_sortbuckets(dest, t1, thread_num);
 			tmp_1 = hashMapKMA_dumpbuckets(dest);
 			
 			/* load k-mer from t2 */
@@ -1370,7 +1542,7 @@ HashMapKMA * merge_kmersignatures(HashMapKMA *t1, HashMapKMA *t2, MiddleLayer *m
 			}
 			/* sort k-mer buckets from t2 based on dest, and dump on tmp */
 			dest->null_index = t2->null_index;
-			hashMapKMA_sortbuckets(dest, t2);
+			hashMapKMA_sortbuckets(dest, t2, thread_num);
 			tmp_2 = hashMapKMA_dumpbuckets(dest);
 			
 			/* merge in key- and value_indexes */
@@ -1388,7 +1560,7 @@ HashMapKMA * merge_kmersignatures(HashMapKMA *t1, HashMapKMA *t2, MiddleLayer *m
 	return dest;
 }
 
-int merge(char *templatefilename, char *templatefilename1, char *templatefilename2) {
+int merge(char *templatefilename, char *templatefilename1, char *templatefilename2, int thread_num) {
 	
 	int order;
 	long unsigned org_split, alt_split;
@@ -1448,7 +1620,7 @@ int merge(char *templatefilename, char *templatefilename1, char *templatefilenam
 	
 	/* merge hashmaps */
 	fprintf(stderr, "# Merging signatures.\n");
-	t = merge_kmersignatures(t1, t2, middle, alternative);
+	t = merge_kmersignatures(t1, t2, middle, alternative, thread_num);
 	
 	/* dump and free new hashmap */
 	fprintf(stderr, "# Dumping new index.\n");
@@ -1556,6 +1728,7 @@ static void helpMessage(int exeStatus) {
 	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-t_db", "Add to DB", "");
 	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-s_db", "DB to merge", "");
 	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-tmp", "Set directory for temporary files", "");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-t", "Number of threads", "1");
 	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-v", "Version", "");
 	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-h", "Shows this help message", "");
 	fprintf(helpOut, "#\n");
@@ -1564,10 +1737,12 @@ static void helpMessage(int exeStatus) {
 
 int merge_main(int argc, char *argv[]) {
 	
-	int args, order, o_len, t_len, s_len;
+	int args, order, o_len, t_len, s_len, thread_num;
 	char *outfilename, *templatefilename, *secondfilename, *tmpfilename;
+	char *exeBasic;
 	
 	/* init */
+	thread_num = 1;
 	o_len = 0;
 	t_len = 0;
 	s_len = 0;
@@ -1611,6 +1786,17 @@ int merge_main(int argc, char *argv[]) {
 					--args;
 				}
 			}
+		} else if(strcmp(argv[args], "-t") == 0) {
+			++args;
+			if(args < argc && argv[args][0] != '-') {
+				thread_num = strtoul(argv[args], &exeBasic, 10);
+				if(*exeBasic != 0 || thread_num < 1) {
+					fprintf(stderr, "Invalid number of threads specified.\n");
+					exit(1);
+				}
+			} else {
+				--args;
+			}
 		} else if(strcmp(argv[args], "-v") == 0) {
 			fprintf(stdout, "KMA_index-%s\n", KMA_VERSION);
 			exit(0);
@@ -1639,7 +1825,7 @@ int merge_main(int argc, char *argv[]) {
 	strcpy(outfilename + o_len, ".comp.b");
 	strcpy(templatefilename + t_len, ".comp.b");
 	strcpy(secondfilename + s_len, ".comp.b");
-	order = merge(outfilename, templatefilename, secondfilename);
+	order = merge(outfilename, templatefilename, secondfilename, thread_num);
 	if(order == 2) { /* switch order of merged DBs */
 		tmpfilename = templatefilename;
 		templatefilename = secondfilename;
@@ -18,14 +18,37 @@
 */
 
 #define _XOPEN_SOURCE 600
+#include <pthread.h>
 #include "hashmapkma.h"
 #include "middlelayer.h"
 
+#ifndef MERGE
+typedef struct mergeThread MergeThread;
+typedef struct bucketPair BucketPair;
+struct mergeThread {
+	pthread_t id;
+	HashMapKMA *src;
+	HashMapKMA *dest;
+	MiddleLayer *middle;
+	long unsigned start;
+	long unsigned end;
+};
+struct bucketPair {
+	long unsigned bucket;
+	long unsigned kmer;
+	long unsigned value;
+};
+#define BUCKETSMALL 16
+#define MERGE 1
+#endif
+
 #define hashMapKMA_compatible(t1, t2)(t1->kmersize == t2->kmersize && t1->prefix_len == t2->prefix_len && t1->prefix == t2->prefix && t1->mlen == t2->mlen)
 
 long unsigned bucket_insertionsort(unsigned *key_index, unsigned *value_index, long unsigned *value_index_l, long unsigned mask_new, long unsigned mask_org, unsigned flag);
 long unsigned bucket_insertionsort_l(long unsigned *key_index, unsigned *value_index, long unsigned *value_index_l, long unsigned mask_new, long unsigned mask_org, unsigned flag);
-void hashMapKMA_sortbuckets(HashMapKMA *dest, HashMapKMA *src);
+void * sortbuckets_thread(void *arg);
+void * middlelayer_thread(void *arg);
+void hashMapKMA_sortbuckets(HashMapKMA *dest, HashMapKMA *src, int thread_num);
 FILE * hashMapKMA_dumpbuckets(HashMapKMA *src);
 long unsigned getV_index(long unsigned *exist, long unsigned size, long unsigned null_index, long unsigned v_indexes, MiddleLayer *middle, MiddleLayer *alternative);
 unsigned * adjustV_index(long unsigned *exist_l, long unsigned size, long unsigned v_index);
@@ -35,8 +58,8 @@ unsigned loadValues1(unsigned *values, short unsigned *values_s, unsigned *value
 unsigned loadValues2(unsigned *values, short unsigned *values_s, unsigned *values2, short unsigned *values2_s, long unsigned index, unsigned offset);
 unsigned loadValues12(unsigned *values, short unsigned *values_s, unsigned *values1, short unsigned *values1_s, unsigned *values2, short unsigned *values2_s, long unsigned index1, long unsigned index2, unsigned offset);
 void hashMapKMA_dumpmerge(HashMapKMA *src, HashMapKMA *t1, HashMapKMA *t2, MiddleLayer *middle, MiddleLayer *alternative, FILE *out);
-HashMapKMA * merge_kmersignatures(HashMapKMA *t1, HashMapKMA *t2, MiddleLayer *middle, MiddleLayer *alternative);
-int merge(char *templatefilename, char *templatefilename1, char *templatefilename2);
+HashMapKMA * merge_kmersignatures(HashMapKMA *t1, HashMapKMA *t2, MiddleLayer *middle, MiddleLayer *alternative, int thread_num);
+int merge(char *templatefilename, char *templatefilename1, char *templatefilename2, int thread_num);
 int merge_lengths(char *outname, char *inname1, char *inname2);
 int cat(char *outname, char *inname1, char *inname2);
 int merge_main(int argc, char *argv[]);
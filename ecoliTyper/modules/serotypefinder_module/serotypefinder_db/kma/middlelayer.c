@@ -31,6 +31,10 @@ MiddleLayer * MiddleLayer_init(long unsigned size) {
 	if(dest) {
 		dest->n = 0;
 		dest->size = size;
+		dest->rank = 0;
+		dest->rank_size = 0;
+		dest->table = 0;
+		dest->mask = 0;
 		dest->layer = calloc(size << 1, sizeof(long unsigned));
 		if(!dest->layer) {
 			free(dest);
@@ -49,6 +53,10 @@ MiddleLayer * AlternativeLayer_init(long unsigned size) {
 	if(dest) {
 		dest->n = 0;
 		dest->size = size;
+		dest->rank = 0;
+		dest->rank_size = 0;
+		dest->table = 0;
+		dest->mask = 0;
 		dest->layer = calloc(size + (size << 1), sizeof(long unsigned));
 		if(!dest->layer) {
 			free(dest);
@@ -65,6 +73,8 @@ void MiddleLayer_free(MiddleLayer *src) {
 		if(src->layer) {
 			free(src->layer);
 		}
+		free(src->rank);
+		free(src->table);
 		free(src);
 	}
 }
@@ -145,6 +155,11 @@ MiddleLayer * AlternativeLayer_readjust(MiddleLayer *dest) {
 		dest->layer = layer;
 	}
 	
+	/* combinations are settled, release the hash */
+	free(dest->table);
+	dest->table = 0;
+	dest->mask = 0;
+	
 	return dest;
 }
 
@@ -154,6 +169,11 @@ long unsigned MiddleLayer_populate(MiddleLayer *dest, HashMapKMA *src, const lon
 	short unsigned *values_s;
 	long unsigned n, size, index, vindex, *layer;
 	
+	/* invalidate rank */
+	free(dest->rank);
+	dest->rank = 0;
+	dest->rank_size = 0;
+	
 	n = dest->n;
 	size = dest->size;
 	layer = dest->layer + (n << 1);
@@ -195,46 +215,110 @@ long unsigned MiddleLayer_populate(MiddleLayer *dest, HashMapKMA *src, const lon
 	return index;
 }
 
+void MiddleLayer_index(MiddleLayer *src) {
+	
+	long unsigned i, n, rank, v_index, *layer, *ranks;
+	
+	/* mark the start of each signature in a bitmap, and store the
+	   number of preceding starts for every 64 vindexes */
+	n = src->n;
+	layer = src->layer;
+	src->rank_size = n ? (layer[(n - 1) << 1] >> 6) + 1 : 0;
+	free(src->rank);
+	src->rank = calloc((src->rank_size << 1) + 2, sizeof(long unsigned));
+	if(!src->rank) {
+		ERROR();
+	}
+	ranks = src->rank;
+	for(i = 0; i < n; ++i) {
+		v_index = layer[i << 1];
+		ranks[((v_index >> 6) << 1) + 1] |= 1UL << (v_index & 63);
+	}
+	rank = 0;
+	for(i = 0; i < src->rank_size; ++i) {
+		ranks[i << 1] = rank;
+		rank += __builtin_popcountl(ranks[(i << 1) + 1]);
+	}
+}
+
 long unsigned MiddleLayer_search(MiddleLayer *src, long unsigned v_index) {
 	
-	long unsigned mid, l1, l2, l_index, *layer;
+	long unsigned bit, *rank;
+	
+	if(!src->rank) {
+		MiddleLayer_index(src);
+	}
+	
+	/* rank of v_index among the signature starts */
+	if(src->rank_size <= (v_index >> 6)) {
+		/* should not be possible */
+		return src->n;
+	}
+	rank = src->rank + ((v_index >> 6) << 1);
+	bit = 1UL << (v_index & 63);
+	if(!(rank[1] & bit)) {
+		/* should not be possible */
+		return src->n;
+	}
+	
+	return *rank + __builtin_popcountl(rank[1] & (bit - 1));
+}
+
+static inline long unsigned alternativeKey(long unsigned v_index1, long unsigned v_index2) {
+	
+	long unsigned key;
 	
+	key = (v_index1 * 0x9E3779B97F4A7C15) ^ v_index2;
+	key ^= key >> 31;
+	key *= 0xBF58476D1CE4E5B9;
+	
+	return key ^ (key >> 29);
+}
+
+static void AlternativeLayer_rehash(MiddleLayer *src, long unsigned slots) {
+	
+	long unsigned i, pos, *layer, *table;
+	
+	free(src->table);
+	src->mask = slots - 1;
+	src->table = calloc(slots, sizeof(long unsigned));
+	if(!src->table) {
+		ERROR();
+	}
+	table = src->table;
 	layer = src->layer;
-	l1 = 0;
-	l2 = src->n - 1;
-	while(l1 <= l2) {
-		mid = (l1 + l2) >> 1;
-		l_index = layer[mid << 1]; /* remember layer contains two elements per index */
-		if(l_index < v_index) {
-			l1 = mid + 1;
-		} else if(v_index < l_index) {
-			l2 = mid - 1;
-		} else {
-			return mid;
+	for(i = 0; i < src->n; ++i) {
+		pos = alternativeKey(layer[0], layer[1]) & src->mask;
+		while(table[pos]) {
+			pos = (pos + 1) & src->mask;
 		}
+		table[pos] = i + 1;
+		layer += 3;
 	}
-	
-	/* should not be possible */
-	return src->n;
 }
 
-long unsigned AlternativeLayer_add(MiddleLayer *src, long unsigned v_index, long unsigned v_index1, long unsigned v_index2) {
+long unsigned AlternativeLayer_add(MiddleLayer *src, long unsigned v_index1, long unsigned v_index2) {
+	
+	long unsigned index, pos, *layer;
 	
-	long unsigned index, *layer;
+	/* keep load at most 1/2 */
+	if(!src->table || src->mask < (src->n << 1)) {
+		pos = 1024;
+		while(pos <= (src->n << 1)) {
+			pos <<= 1;
+		}
+		AlternativeLayer_rehash(src, pos);
+	}
 	
 	/* check if combination is unique */
-	if((index = v_index) != src->n) {
-		do {
-			layer = src->layer + (index + (index << 1)); /* remember layer contains three elements per index */
-			if(layer[0] == v_index1 && layer[1] == v_index2) {
-				return index;
-			} else {
-				index = layer[2];
-			}
-		} while(index);
-		
-		/* add index to new combination */
-		layer[2] = src->n;
+	pos = alternativeKey(v_index1, v_index2) & src->mask;
+	while((index = src->table[pos])) {
+		--index;
+		layer = src->layer + (index + (index << 1)); /* remember layer contains three elements per index */
+		if(layer[0] == v_index1 && layer[1] == v_index2) {
+			return index;
+		}
+		pos = (pos + 1) & src->mask;
 	}
 	
 	/* resize */
@@ -244,6 +328,7 @@ long unsigned AlternativeLayer_add(MiddleLayer *src, long unsigned v_index, long
 	
 	/* add new combination */
 	index = src->n++;
+	src->table[pos] = index + 1;
 	layer = src->layer + (index + (index << 1));
 	layer[0] = v_index1;
 	layer[1] = v_index2;
@@ -25,6 +25,10 @@ struct middlelayer {
 	long unsigned n;
 	long unsigned size;
 	long unsigned *layer;	/* vindex, alternative */
+	long unsigned *rank;	/* rank, start bits for every 64 vindexes */
+	long unsigned rank_size;
+	long unsigned *table;	/* hashed alternatives, index + 1 */
+	long unsigned mask;
 	//long unsigned *val_indexes;	/* vindex, alternative */
 	//long unsigned *alt_indexes;	/* vindex1, vindex2, alternative */
 };
@@ -45,4 +49,5 @@ MiddleLayer * MiddleLayer_readjust(MiddleLayer *dest);
 MiddleLayer * AlternativeLayer_readjust(MiddleLayer *dest);
 long unsigned MiddleLayer_populate(MiddleLayer *dest, HashMapKMA *src, const long unsigned offset);
 long unsigned MiddleLayer_search(MiddleLayer *src, long unsigned v_index);
-long unsigned AlternativeLayer_add(MiddleLayer *src, long unsigned v_index, long unsigned v_index1, long unsigned v_index2);
+void MiddleLayer_index(MiddleLayer *src);
+long unsigned AlternativeLayer_add(MiddleLayer *src, long unsigned v_index1, long unsigned v_index2);
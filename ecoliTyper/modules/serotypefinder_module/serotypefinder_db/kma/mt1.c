@@ -23,19 +23,24 @@
 #include <string.h>
 #include <pthread.h>
 #include <time.h>
+#include "aout.h"
 #include "assembly.h"
 #include "chain.h"
 #include "compdna.h"
 #include "filebuff.h"
 #include "hashmapcci.h"
 #include "kmapipe.h"
+#include "kmapool.h"
+#include "kmastat.h"
 #include "mt1.h"
 #include "nw.h"
+#include "pack.h"
 #include "penalties.h"
 #include "pherror.h"
 #include "printconsensus.h"
 #include "qseqs.h"
 #include "runkma.h"
+#include "smat.h"
 #include "stdnuc.h"
 #include "stdstat.h"
 #include "tsv.h"
@@ -83,11 +88,11 @@ void printFsa_pairMt1(Qseqs *header, Qseqs *qseq, Qseqs *qual, Qseqs *header_r,
 	
 }
 
-void runKMA_Mt1(char *templatefilename, char *outputfilename, char *exePrev, int kmersize, int minlen, Penalties *rewards, double ID_t, double Depth_t, int mq, double scoreT, double mrc, double evalue, double support, int bcd, int Mt1, int ref_fsa, int print_matrix, long unsigned tsv, int vcf, int xml, int sam, int nc, int nf, int thread_num) {
+void runKMA_Mt1(char *templatefilename, char *outputfilename, char *exePrev, int kmersize, int minlen, Penalties *rewards, double ID_t, double Depth_t, int mq, double scoreT, double mrc, double evalue, double support, int bcd, int Mt1, int ref_fsa, int print_matrix, long unsigned tsv, int vcf, int xml, int sam, int nc, int nf, int thread_num, int verbose) {
 	
 	int i, j, aln_len, t_len, coverScore, file_len, DB_size, delta, seq_in;
 	int *template_lengths;
-	long unsigned read_score, seeker;
+	long unsigned read_score, seeker, timer[STAT_TIMER];
 	double p_value, id, q_id, cover, q_cover;
 	long double depth;
 	FILE *res_out, *tsv_out, *xml_out, *alignment_out, *consensus_out;
@@ -121,11 +126,11 @@ void runKMA_Mt1(char *templatefilename, char *outputfilename, char *exePrev, int
 	/* open outputfiles */
 	if(outputfilename) {
 		strcat(outputfilename, ".res");
-		res_out = sfopen(outputfilename, "w");
+		res_out = outFopenPtr(outputfilename, "w");
 		outputfilename[file_len] = 0;
 		if(tsv) {
 			strcat(outputfilename, ".tsv");
-			tsv_out = sfopen(outputfilename, "w");
+			tsv_out = outFopenPtr(outputfilename, "w");
 			outputfilename[file_len] = 0;
 		} else {
 			tsv_out = 0;
@@ -142,20 +147,23 @@ void runKMA_Mt1(char *templatefilename, char *outputfilename, char *exePrev, int
 		consensus_out = 0;
 		if(nc == 0) {
 			strcat(outputfilename, ".aln");
-			alignment_out = sfopen(outputfilename, "w");
+			alignment_out = outFopenPtr(outputfilename, "w");
 			outputfilename[file_len] = 0;
 			strcat(outputfilename, ".fsa");
-			consensus_out = sfopen(outputfilename, "w");
+			consensus_out = outFopenPtr(outputfilename, "w");
 			outputfilename[file_len] = 0;
 		} else if((nc & 1) == 0) {
 			strcat(outputfilename, ".fsa");
-			consensus_out = sfopen(outputfilename, "w");
+			consensus_out = outFopenPtr(outputfilename, "w");
 			outputfilename[file_len] = 0;
 		}
 		if(print_matrix) {
 			matrix_out = gzInitFileBuff(CHUNK);
-			strcat(outputfilename, ".mat.gz");
+			strcat(outputfilename, print_matrix == 2 ? ".smat.gz" : ".mat.gz");
 			openFileBuff(matrix_out, outputfilename, "wb");
+			if(print_matrix == 2) {
+				initSparseMatrix(matrix_out);
+			}
 			outputfilename[file_len] = 0;
 		} else {
 			matrix_out = 0;
@@ -221,12 +229,12 @@ void runKMA_Mt1(char *templatefilename, char *outputfilename, char *exePrev, int
 	}
 	
 	strcat(templatefilename, ".seq.b");
-	seq_in = open(templatefilename, O_RDONLY);
+	seq_in = packOpen(templatefilename, 0);
 	if(seq_in == -1) {
 		ERROR();
 	}
 	templatefilename[file_len] = 0;
-	template_index = alignLoad_fly(0, seq_in, *template_lengths, kmersize, seeker);
+	template_index = alignLoad_fly(0, seq_in, *template_lengths, kmersize, seeker + packStart(seq_in));
 	close(seq_in);
 	
 	/* get name */
@@ -250,6 +258,7 @@ void runKMA_Mt1(char *templatefilename, char *outputfilename, char *exePrev, int
 	
 	fprintf(stderr, "#\n# Doing local assemblies of found templates, and output results\n");
 	t0 = clock();
+	kmaStat_start(timer);
 	
 	/* print heading of resistance file: */
 	fprintf(res_out, "#Template\tScore\tExpected\tTemplate_length\tTemplate_Identity\tTemplate_Coverage\tQuery_Identity\tQuery_Coverage\tDepth\tq_value\tp_value\n");
@@ -268,7 +277,7 @@ void runKMA_Mt1(char *templatefilename, char *outputfilename, char *exePrev, int
 	} else {
 		matrix->size = (*template_lengths) + 1;
 	}
-	matrix->assmb = smalloc(matrix->size * sizeof(Assembly));
+	matrix->assmb = smalloc_tag(MEM_ASSEMBLY, matrix->size * sizeof(Assembly));
 	aligned_assem->size = matrix->size;
 	aligned_assem->t = smalloc(aligned_assem->size);
 	aligned_assem->s = smalloc(aligned_assem->size);
@@ -279,15 +288,7 @@ void runKMA_Mt1(char *templatefilename, char *outputfilename, char *exePrev, int
 	threads = 0;
 	while(i < thread_num) {
 		/* allocate matrices */
-		NWmatrices = smalloc(sizeof(NWmat));
-		NWmatrices->NW_s = 1024 * 1024;
-		NWmatrices->NW_q = 1024;
-		NWmatrices->E = smalloc(NWmatrices->NW_s);
-		NWmatrices->D[0] = smalloc((NWmatrices->NW_q << 1) * sizeof(int));
-		NWmatrices->P[0] = smalloc((NWmatrices->NW_q << 1) * sizeof(int));
-		NWmatrices->D[1] = NWmatrices->D[0] + NWmatrices->NW_q;
-		NWmatrices->P[1] = NWmatrices->P[0] + NWmatrices->NW_q;
-		NWmatrices->rewards = rewards;
+		NWmatrices = NWmat_init(1024, 1024 * 1024, rewards);
 		
 		aligned = smalloc(sizeof(Aln));
 		gap_align = smalloc(sizeof(Aln));
@@ -332,7 +333,7 @@ void runKMA_Mt1(char *templatefilename, char *outputfilename, char *exePrev, int
 		threads = thread;
 		
 		/* start thread */
-		if((errno = pthread_create(&thread->id, NULL, assembly_KMA_Ptr, thread))) {
+		if((errno = kmaPool_create(&thread->id, -1, assembly_KMA_Ptr, thread))) {
 			fprintf(stderr, "Error: %d (%s)\n", errno, strerror(errno));
 			fprintf(stderr, "Will continue with %d threads.\n", i);
 			threads = thread->next;
@@ -344,15 +345,7 @@ void runKMA_Mt1(char *templatefilename, char *outputfilename, char *exePrev, int
 	}
 	
 	/* start main thread */
-	NWmatrices = smalloc(sizeof(NWmat));
-	NWmatrices->NW_s = 1024 * 1024;
-	NWmatrices->NW_q = 1024;
-	NWmatrices->E = smalloc(NWmatrices->NW_s);
-	NWmatrices->D[0] = smalloc((NWmatrices->NW_q << 1) * sizeof(int));
-	NWmatrices->P[0] = smalloc((NWmatrices->NW_q << 1) * sizeof(int));
-	NWmatrices->D[1] = NWmatrices->D[0] + NWmatrices->NW_q;
-	NWmatrices->P[1] = NWmatrices->P[0] + NWmatrices->NW_q;
-	NWmatrices->rewards = rewards;
+	NWmatrices = NWmat_init(1024, 1024 * 1024, rewards);
 	
 	aligned = smalloc(sizeof(Aln));
 	gap_align = smalloc(sizeof(Aln));
@@ -442,7 +435,7 @@ void runKMA_Mt1(char *templatefilename, char *outputfilename, char *exePrev, int
 			}
 			/* print matrix */
 			if(matrix_out) {
-				updateMatrix(matrix_out, thread->template_name, template_index->seq, matrix, t_len);
+				updateMatrixPtr(matrix_out, thread->template_name, template_index->seq, matrix, t_len);
 			}
 			if(vcf) {
 				updateVcf(thread->template_name, aligned_assem->t, evalue, support, bcd, t_len, matrix, vcf, vcf_out);
@@ -468,10 +461,11 @@ void runKMA_Mt1(char *templatefilename, char *outputfilename, char *exePrev, int
 	assembly_KMA_Ptr(thread);
 	for(thread = threads; thread != 0; thread = thread->next) {
 		/* join thread */
-		if((errno = pthread_join(thread->id, NULL))) {
+		if((errno = kmaPool_join(thread->id, NULL))) {
 			ERROR();
 		}
 	}
+	kmaStat_stop(STAT_ASSEMBLY, timer);
 	
 	/* Close files */
 	fclose(res_out);
@@ -495,5 +489,8 @@ void runKMA_Mt1(char *templatefilename, char *outputfilename, char *exePrev, int
 	}
 	
 	t1 = clock();
+	if(verbose) {
+		kmaPool_report(stderr);
+	}
 	fprintf(stderr, "# Total time used for local assembly: %.2f s.\n#\n", difftime(t1, t0) / 1000000);
 }
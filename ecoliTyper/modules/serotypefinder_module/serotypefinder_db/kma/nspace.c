@@ -0,0 +1,439 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nspace.h"
+#include "pherror.h"
+#include "qseqs.h"
+#include "runkma.h"
+
+int (*nsPrintPtr)(char*, char*, unsigned) = &nsNoPrint;
+
+int nsPrint(char *outputfilename, char *filename, unsigned template) {
+	
+	int file_len, len;
+	char *name, *ptr;
+	FILE *ns_out;
+	
+	/* name the namespace after the file, without path or extensions */
+	name = (ptr = strrchr(filename, '/')) ? ptr + 1 : filename;
+	len = (ptr = strchr(name, '.')) ? ptr - name : strlen(name);
+	
+	file_len = strlen(outputfilename);
+	strcat(outputfilename, ".ns");
+	ns_out = sfopen(outputfilename, "ab");
+	outputfilename[file_len] = 0;
+	fprintf(ns_out, "%u\t%.*s\n", template, len, name);
+	fclose(ns_out);
+	
+	return 1;
+}
+
+int nsNoPrint(char *outputfilename, char *filename, unsigned template) {
+	return 0;
+}
+
+static int alleleCall(char *line, double *id, double *cov, double *depth) {
+	
+	int field;
+	char *ptr;
+	
+	*id = 0;
+	*cov = 0;
+	*depth = 0;
+	if(!line) {
+		return 0;
+	}
+	
+	/* Template, Score, Expected, Template_length, Template_Identity, ... */
+	ptr = strchr(line, '\t');
+	for(field = 1; ptr && field <= 8; ++field) {
+		if(field == 4) {
+			*id = strtod(ptr + 1, 0);
+		} else if(field == 5) {
+			*cov = strtod(ptr + 1, 0);
+		} else if(field == 8) {
+			*depth = strtod(ptr + 1, 0);
+		}
+		ptr = strchr(ptr + 1, '\t');
+	}
+	
+	/* exact when the whole allele is covered without differences */
+	return (100 <= *id && 100 <= *cov) ? 2 : 1;
+}
+
+static void printAllele(FILE *out, char *locus, char *line) {
+	
+	int call;
+	double id, cov, depth;
+	
+	call = alleleCall(line, &id, &cov, &depth);
+	if(!call) {
+		fprintf(out, "%s\t-\tnone\t0.00\t0.00\t0.00\n", locus);
+	} else {
+		fprintf(out, "%s\t%.*s\t%s\t%.2f\t%.2f\t%.2f\n", locus, (int)(strchr(line, '\t') - line), line, call == 2 ? "exact" : "near", id, cov, depth);
+	}
+}
+
+static int alleleNumber(char *locus, char *line, char **number) {
+	
+	int len;
+	
+	/* "dinB_1" and "fumC4" are allele 1 and 4 of dinB and fumC */
+	len = strlen(locus);
+	if(strncmp(line, locus, len) == 0) {
+		line += len;
+	}
+	while(*line == '_' || *line == '-') {
+		++line;
+	}
+	*number = line;
+	len = 0;
+	while(line[len] && line[len] != '\t' && line[len] != ' ') {
+		++len;
+	}
+	
+	return len;
+}
+
+static void printST(char *stfilename, char *outputfilename, char **names, char **lines, int n) {
+	
+	int i, j, out_len, cols, size, typed, *loci, *calls, *lens;
+	double id, cov, depth;
+	char *ST, *col, *next, **numbers;
+	FILE *st_in, *st_out;
+	Qseqs *line;
+	
+	/* header of the profile table, "ST" followed by the loci */
+	st_in = sfopen(stfilename, "rb");
+	line = setQseqs(256);
+	if(!*nameLoad(line, st_in)) {
+		fprintf(stderr, "Empty profile table:\t%s\n", stfilename);
+		exit(1);
+	}
+	size = 32;
+	loci = smalloc(size * sizeof(int));
+	cols = 0;
+	col = (char *) line->seq;
+	do {
+		next = strchr(col, '\t');
+		if(next) {
+			*next++ = 0;
+		}
+		if(cols == size) {
+			size <<= 1;
+			loci = realloc(loci, size * sizeof(int));
+			if(!loci) {
+				ERROR();
+			}
+		}
+		/* columns without a namespace, e.g. clonal_complex, are skipped */
+		loci[cols] = -1;
+		for(i = 0; cols && i < n; ++i) {
+			if(strcmp(names[i], col) == 0) {
+				loci[cols] = i;
+				break;
+			}
+		}
+		++cols;
+	} while((col = next));
+	
+	/* calls of the sample */
+	calls = smalloc(n * sizeof(int));
+	lens = smalloc(n * sizeof(int));
+	numbers = smalloc(n * sizeof(char *));
+	typed = 1;
+	for(i = 0; i < n; ++i) {
+		calls[i] = alleleCall(lines[i], &id, &cov, &depth);
+		lens[i] = calls[i] ? alleleNumber(names[i], lines[i], numbers + i) : 0;
+		typed &= calls[i] == 2;
+	}
+	
+	/* only complete exact profiles get an ST */
+	ST = 0;
+	while(typed && !ST && *nameLoad(line, st_in)) {
+		col = (char *) line->seq;
+		for(j = 0; col; ++j) {
+			next = strchr(col, '\t');
+			if(next) {
+				*next++ = 0;
+			}
+			if(j == 0) {
+				ST = col;
+			} else if(j < cols && 0 <= (i = loci[j]) && (strncmp(col, numbers[i], lens[i]) || col[lens[i]])) {
+				ST = 0;
+				break;
+			}
+			col = next;
+		}
+	}
+	fclose(st_in);
+	
+	/* dump the sequence type and the profile behind it */
+	out_len = strlen(outputfilename);
+	strcat(outputfilename, ".st");
+	st_out = sfopen(outputfilename, "wb");
+	outputfilename[out_len] = 0;
+	fprintf(st_out, "#ST");
+	for(j = 1; j < cols; ++j) {
+		if(0 <= loci[j]) {
+			fprintf(st_out, "\t%s", names[loci[j]]);
+		}
+	}
+	fprintf(st_out, "\n%s", ST ? ST : "-");
+	for(j = 1; j < cols; ++j) {
+		if(0 <= (i = loci[j])) {
+			if(!calls[i]) {
+				fprintf(st_out, "\t-");
+			} else {
+				fprintf(st_out, "\t%s%.*s", calls[i] == 2 ? "" : "~", lens[i], numbers[i]);
+			}
+		}
+	}
+	fprintf(st_out, "\n");
+	fclose(st_out);
+	
+	destroyQseqs(line);
+	free(loci);
+	free(calls);
+	free(lens);
+	free(numbers);
+}
+
+static void printAbricate(FILE *out, char *filename, char *db, char *line, int len) {
+	
+	int field, tlen, gene_len, acc_len, res_len, product_len;
+	double id, cov;
+	char *gene, *acc, *res, *product, *ptr, *end;
+	
+	/* Template, Score, Expected, Template_length, Template_Identity, Template_Coverage */
+	tlen = 0;
+	id = 0;
+	cov = 0;
+	ptr = line + len;
+	for(field = 1; ptr && field <= 5; ++field) {
+		if(field == 3) {
+			tlen = strtol(ptr + 1, 0, 10);
+		} else if(field == 4) {
+			id = strtod(ptr + 1, 0);
+		} else if(field == 5) {
+			cov = strtod(ptr + 1, 0);
+		}
+		ptr = strchr(ptr + 1, '\t');
+	}
+	
+	/* abricate names its templates "db~~~gene~~~accession~~~resistance product" */
+	end = line + len;
+	gene = line;
+	acc = "-";
+	acc_len = 1;
+	res = "-";
+	res_len = 1;
+	if((ptr = strstr(line, "~~~")) && ptr < end) {
+		gene = ptr + 3;
+		if((ptr = strstr(gene, "~~~")) && ptr < end) {
+			gene_len = ptr - gene;
+			acc = ptr + 3;
+			if((ptr = strstr(acc, "~~~")) && ptr < end) {
+				acc_len = ptr - acc;
+				res = ptr + 3;
+				for(res_len = 0; res + res_len < end && res[res_len] != ' '; ++res_len);
+			} else {
+				for(acc_len = 0; acc + acc_len < end && acc[acc_len] != ' '; ++acc_len);
+				res_len = 0;
+			}
+		} else {
+			for(gene_len = 0; gene + gene_len < end && gene[gene_len] != ' '; ++gene_len);
+		}
+	} else {
+		for(gene_len = 0; gene + gene_len < end && gene[gene_len] != ' '; ++gene_len);
+	}
+	if((product = memchr(line, ' ', len))) {
+		product_len = end - ++product;
+	} else {
+		product = "-";
+		product_len = 1;
+	}
+	if(res_len == 0) {
+		res = "-";
+		res_len = 1;
+	}
+	
+	/*
+	 kma has no query coordinates in its results, so SEQUENCE to STRAND,
+	 COVERAGE_MAP and GAPS are left out. %IDENTITY is over the aligned part
+	 of the gene, as in abricate.
+	*/
+	fprintf(out, "%s\t-\t-\t-\t-\t%.*s\t%d/%d\t-\t-\t%.2f\t%.2f\t%s\t%.*s\t%.*s\t%.*s\n", filename, gene_len, gene, (int)(cov * tlen / 100 + 0.5), tlen, cov, cov ? 100 * id / cov : 0, db, acc_len, acc, product_len, product, res_len, res);
+}
+
+int printNamespaces(char *templatefilename, char *outputfilename, int allele, char *stfilename, char *abricate) {
+	
+	int i, n, size, file_len, out_len, len, *best;
+	unsigned template, *starts;
+	long *scores, score;
+	char **names, **lines, *name;
+	FILE *ns_in, *name_in, *res_in, *ns_out, *allele_out, *abricate_out;
+	Qseqs *line, *template_name;
+	
+	/* load namespaces */
+	file_len = strlen(templatefilename);
+	strcat(templatefilename, ".ns");
+	ns_in = fopen(templatefilename, "rb");
+	templatefilename[file_len] = 0;
+	if(!ns_in) {
+		fprintf(stderr, "DB has no namespaces, index it with -ns.\n");
+		errno = 0;
+		return 1;
+	}
+	line = setQseqs(256);
+	n = 0;
+	size = 8;
+	starts = smalloc(size * sizeof(unsigned));
+	names = smalloc(size * sizeof(char *));
+	while(*nameLoad(line, ns_in)) {
+		if(n == size) {
+			size <<= 1;
+			starts = realloc(starts, size * sizeof(unsigned));
+			names = realloc(names, size * sizeof(char *));
+			if(!starts || !names) {
+				ERROR();
+			}
+		}
+		starts[n] = strtoul((char *) line->seq, &name, 10);
+		names[n] = smalloc(strlen(name));
+		strcpy(names[n], name + 1);
+		++n;
+	}
+	fclose(ns_in);
+	best = smalloc(n * sizeof(int));
+	scores = smalloc(n * sizeof(long));
+	lines = smalloc(n * sizeof(char *));
+	for(i = 0; i < n; ++i) {
+		best[i] = 0;
+		lines[i] = 0;
+	}
+	
+	/* open names and results */
+	strcat(templatefilename, ".name");
+	name_in = sfopen(templatefilename, "rb");
+	templatefilename[file_len] = 0;
+	out_len = strlen(outputfilename);
+	strcat(outputfilename, ".res");
+	res_in = sfopen(outputfilename, "rb");
+	outputfilename[out_len] = 0;
+	template_name = setQseqs(256);
+	if(abricate) {
+		/* every hit, in the layout of abricate */
+		strcat(outputfilename, ".tab");
+		abricate_out = sfopen(outputfilename, "wb");
+		outputfilename[out_len] = 0;
+		fprintf(abricate_out, "#FILE\tSEQUENCE\tSTART\tEND\tSTRAND\tGENE\tCOVERAGE\tCOVERAGE_MAP\tGAPS\t%%COVERAGE\t%%IDENTITY\tDATABASE\tACCESSION\tPRODUCT\tRESISTANCE\n");
+	} else {
+		abricate_out = 0;
+	}
+	
+	/* results follow the template order, so names and hits are read along */
+	template = 0;
+	i = -1;
+	len = 0;
+	name = "";
+	while(*nameLoad(line, res_in)) {
+		if(*line->seq == '#') {
+			continue;
+		}
+		while(strncmp((char *) line->seq, name, len) || line->seq[len] != '\t') {
+			name = nameLoad(template_name, name_in);
+			len = strlen(name);
+			if(!*name && feof(name_in)) {
+				fprintf(stderr, "Results do not follow the template order of the DB.\n");
+				exit(1);
+			}
+			++template;
+		}
+		while(i + 1 < n && starts[i + 1] <= template) {
+			++i;
+		}
+		
+		if(abricate_out && 0 <= i) {
+			printAbricate(abricate_out, abricate, names[i], (char *) line->seq, len);
+		}
+		
+		/* keep the highest scoring hit of the namespace */
+		score = strtol((char *) line->seq + len + 1, 0, 10);
+		if(0 <= i && (!best[i] || scores[i] < score)) {
+			best[i] = 1;
+			scores[i] = score;
+			free(lines[i]);
+			lines[i] = smalloc(strlen((char *) line->seq) + 1);
+			strcpy(lines[i], (char *) line->seq);
+		}
+	}
+	fclose(name_in);
+	fclose(res_in);
+	if(abricate_out) {
+		fclose(abricate_out);
+	}
+	
+	/* dump best hits */
+	strcat(outputfilename, ".ns.res");
+	ns_out = sfopen(outputfilename, "wb");
+	outputfilename[out_len] = 0;
+	fprintf(ns_out, "#Namespace\tTemplate\tScore\tExpected\tTemplate_length\tTemplate_Identity\tTemplate_Coverage\tQuery_Identity\tQuery_Coverage\tDepth\tq_value\tp_value\n");
+	if(allele) {
+		/* one call per locus, i.e. per namespace */
+		strcat(outputfilename, ".allele");
+		allele_out = sfopen(outputfilename, "wb");
+		outputfilename[out_len] = 0;
+		fprintf(allele_out, "#Locus\tAllele\tCall\tTemplate_Identity\tTemplate_Coverage\tDepth\n");
+	} else {
+		allele_out = 0;
+	}
+	if(stfilename) {
+		printST(stfilename, outputfilename, names, lines, n);
+	}
+	for(i = 0; i < n; ++i) {
+		if(best[i]) {
+			fprintf(ns_out, "%s\t%s\n", names[i], lines[i]);
+		}
+		if(allele_out) {
+			printAllele(allele_out, names[i], lines[i]);
+		}
+		free(lines[i]);
+		free(names[i]);
+	}
+	fclose(ns_out);
+	if(allele_out) {
+		fclose(allele_out);
+	}
+	
+	/* clean */
+	destroyQseqs(line);
+	destroyQseqs(template_name);
+	free(starts);
+	free(names);
+	free(best);
+	free(scores);
+	free(lines);
+	
+	return 0;
+}
@@ -0,0 +1,28 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+
+/*
+ A namespace is the templates added from one input file, named after the
+ file. "<db>.ns" holds a line of "<first template>\t<name>" per namespace.
+*/
+extern int (*nsPrintPtr)(char*, char*, unsigned);
+int nsPrint(char *outputfilename, char *filename, unsigned template);
+int nsNoPrint(char *outputfilename, char *filename, unsigned template);
+int printNamespaces(char *templatefilename, char *outputfilename, int allele, char *stfilename, char *abricate);
@@ -0,0 +1,337 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _GNU_SOURCE /* sched_getaffinity, pthread_attr_setaffinity_np */
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#undef _XOPEN_SOURCE
+#include "hashmapkma.h"
+#include "numa.h"
+#include "pherror.h"
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+static int numaMode = 0;
+static int numaNodes = 0;
+static int numaCpus = 0;
+static int numaCpu[NUMAMAXCPU];
+static int numaNode[NUMAMAXCPU];
+static HashMapKMA *numaReplicas[NUMAMAXNODE];
+static long unsigned numaSizes[NUMAMAXNODE];
+
+static long unsigned numaArrays(const HashMapKMA *src, long unsigned *sizes) {
+	
+	/* sizes of exist, values, key_index, value_index and blocks */
+	memset(sizes, 0, 5 * sizeof(long unsigned));
+	if(src->exist) {
+		if((src->size - 1) == src->mask) {
+			sizes[0] = (src->size) * ((src->v_index <= UINT_MAX) ? sizeof(unsigned) : sizeof(long unsigned));
+		} else {
+			sizes[0] = (src->size + 1) * ((src->n <= UINT_MAX) ? sizeof(unsigned) : sizeof(long unsigned));
+		}
+	}
+	if(src->values) {
+		sizes[1] = src->v_index * ((src->DB_size < USHRT_MAX) ? sizeof(short unsigned) : sizeof(unsigned));
+	}
+	if(src->key_index) {
+		sizes[2] = (src->n + 1) * ((src->mlen <= 16) ? sizeof(unsigned) : sizeof(long unsigned));
+	}
+	if(src->value_index) {
+		sizes[3] = src->n * ((src->v_index < UINT_MAX) ? sizeof(unsigned) : sizeof(long unsigned));
+	}
+	if(src->blocks) {
+		sizes[4] = (src->block_mask + 1) * ((src->mlen <= 16) ? sizeof(HashBlock) : sizeof(HashBlockL));
+	}
+	
+	return sizes[0] + sizes[1] + sizes[2] + sizes[3] + sizes[4] + 5 * 64;
+}
+
+#ifdef __linux__
+static int numaCpulist(const char *filename, int *cpus, int max) {
+	
+	int n, first, last;
+	FILE *file;
+	
+	/* parse lists as "0-3,8-11" */
+	if(!(file = fopen(filename, "r"))) {
+		errno = 0;
+		return 0;
+	}
+	n = 0;
+	while(fscanf(file, "%d", &first) == 1) {
+		if(fscanf(file, "-%d", &last) != 1) {
+			last = first;
+		}
+		while(first <= last && n < max) {
+			cpus[n++] = first++;
+		}
+		if(fgetc(file) != ',') {
+			break;
+		}
+	}
+	fclose(file);
+	errno = 0;
+	
+	return n;
+}
+
+static int numaMbind(void *ptr, long unsigned size, int mode, long unsigned mask) {
+	
+	long unsigned page, pos;
+	
+	/* mbind wants page aligned addresses */
+	if(!size) {
+		return 0;
+	}
+	page = sysconf(_SC_PAGESIZE);
+	pos = (long unsigned) ptr & (page - 1);
+	ptr = (unsigned char *) ptr - pos;
+	size += pos;
+	if(syscall(SYS_mbind, ptr, size, mode, &mask, sizeof(long unsigned) * CHAR_BIT + 1, NUMAMOVE)) {
+		errno = 0;
+		return 1;
+	}
+	
+	return 0;
+}
+
+void setNuma(int mode) {
+	
+	int i, j, n, round, count[NUMAMAXNODE], start[NUMAMAXNODE];
+	int cpus[NUMAMAXCPU], nodes[NUMAMAXCPU];
+	char filename[64];
+	cpu_set_t allowed;
+	
+	numaMode = mode;
+	if(!mode) {
+		return;
+	}
+	
+	/* get the cpus of each node that this process may run on */
+	if(sched_getaffinity(0, sizeof(allowed), &allowed)) {
+		ERROR();
+	}
+	numaCpus = 0;
+	numaNodes = 0;
+	for(i = 0; i < NUMAMAXNODE; ++i) {
+		sprintf(filename, "/sys/devices/system/node/node%d/cpulist", i);
+		n = numaCpulist(filename, cpus + numaCpus, NUMAMAXCPU - numaCpus);
+		start[i] = numaCpus;
+		count[i] = 0;
+		for(j = 0; j < n; ++j) {
+			if(CPU_ISSET(cpus[numaCpus + j], &allowed)) {
+				cpus[numaCpus + count[i]++] = cpus[numaCpus + j];
+			}
+		}
+		numaCpus += count[i];
+		if(count[i]) {
+			numaNodes = i + 1;
+		}
+	}
+	
+	/* no node information, use the allowed cpus as one node */
+	if(!numaCpus) {
+		for(i = 0; i < CPU_SETSIZE && numaCpus < NUMAMAXCPU; ++i) {
+			if(CPU_ISSET(i, &allowed)) {
+				cpus[numaCpus++] = i;
+			}
+		}
+		numaNodes = 1;
+		start[0] = 0;
+		count[0] = numaCpus;
+	}
+	
+	/* order cpus round robin over the nodes, so threads spread over the sockets */
+	for(round = 0, n = 0; n < numaCpus; ++round) {
+		for(i = 0; i < numaNodes; ++i) {
+			if(round < count[i]) {
+				numaCpu[n] = cpus[start[i] + round];
+				nodes[n++] = i;
+			}
+		}
+	}
+	memcpy(numaNode, nodes, numaCpus * sizeof(int));
+	fprintf(stderr, "# NUMA:\t%d node(s), %d cpu(s).\n", numaNodes, numaCpus);
+}
+
+int numaNodeOf(int num) {
+	
+	return (numaMode && numaCpus) ? numaNode[num % numaCpus] : 0;
+}
+
+pthread_attr_t * numaThread(int num) {
+	
+	static int init = 0;
+	static pthread_attr_t attr;
+	cpu_set_t cpus;
+	
+	/* pin thread num to a cpu, the attributes are copied on creation */
+	if(!numaMode || !numaCpus) {
+		return NULL;
+	} else if(!init) {
+		if((errno = pthread_attr_init(&attr))) {
+			ERROR();
+		}
+		init = 1;
+	}
+	CPU_ZERO(&cpus);
+	CPU_SET(numaCpu[num % numaCpus], &cpus);
+	if((errno = pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus))) {
+		ERROR();
+	}
+	
+	return &attr;
+}
+
+void numaPlace(HashMapKMA *src) {
+	
+	int i;
+	long unsigned mask, sizes[5];
+	void *arrays[5];
+	
+	if(numaMode != NUMAINTERLEAVE || numaNodes < 2) {
+		return;
+	}
+	
+	/* spread the pages of the index over the nodes */
+	mask = numaNodes < sizeof(long unsigned) * CHAR_BIT ? (1UL << numaNodes) - 1 : ~0UL;
+	numaArrays(src, sizes);
+	arrays[0] = src->exist;
+	arrays[1] = src->values;
+	arrays[2] = src->key_index;
+	arrays[3] = src->value_index;
+	arrays[4] = src->blocks;
+	for(i = 0; i < 5; ++i) {
+		if(numaMbind(arrays[i], sizes[i], NUMAPOLICYINTERLEAVE, mask)) {
+			fprintf(stderr, "# NUMA interleaving not possible, keeping placement.\n");
+			return;
+		}
+	}
+	fprintf(stderr, "# NUMA:\tDB interleaved over %d node(s).\n", numaNodes);
+}
+
+HashMapKMA * numaTemplates(HashMapKMA *src, int num) {
+	
+	int i, node;
+	long unsigned size, sizes[5];
+	unsigned char *data;
+	void **dest[5], *arrays[5];
+	HashMapKMA *replica;
+	
+	/* get replica on the node of thread num */
+	if(numaMode != NUMAREPLICATE || numaNodes < 2) {
+		return src;
+	} else if((replica = numaReplicas[(node = numaNodeOf(num))])) {
+		return replica;
+	}
+	
+	/* bind memory to the node, before it is touched */
+	size = numaArrays(src, sizes);
+	data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(data == MAP_FAILED) {
+		ERROR();
+	} else if(numaMbind(data, size, NUMAPOLICYBIND, 1UL << node)) {
+		fprintf(stderr, "# NUMA binding not possible, sharing DB between nodes.\n");
+		munmap(data, size);
+		return src;
+	}
+	numaSizes[node] = size;
+	
+	/* copy the index arrays, keeping them cache line aligned */
+	replica = smalloc(sizeof(HashMapKMA));
+	*replica = *src;
+	arrays[0] = src->exist;
+	arrays[1] = src->values;
+	arrays[2] = src->key_index;
+	arrays[3] = src->value_index;
+	arrays[4] = src->blocks;
+	dest[0] = (void **) &replica->exist;
+	dest[1] = (void **) &replica->values;
+	dest[2] = (void **) &replica->key_index;
+	dest[3] = (void **) &replica->value_index;
+	dest[4] = (void **) &replica->blocks;
+	for(i = 0; i < 5; ++i) {
+		if(arrays[i]) {
+			memcpy(data, arrays[i], sizes[i]);
+			*dest[i] = data;
+			data += (sizes[i] + 63) & ~63UL;
+		}
+	}
+	replica->exist_l = (long unsigned *) replica->exist;
+	replica->values_s = (short unsigned *) replica->values;
+	replica->key_index_l = (long unsigned *) replica->key_index;
+	replica->value_index_l = (long unsigned *) replica->value_index;
+	replica->blocks_l = (HashBlockL *) replica->blocks;
+	numaReplicas[node] = replica;
+	fprintf(stderr, "# NUMA:\tDB replicated on node %d.\n", node);
+	
+	return replica;
+}
+
+void numaFree(void) {
+	
+	int i;
+	
+	for(i = 0; i < NUMAMAXNODE; ++i) {
+		if(numaReplicas[i]) {
+			if(numaReplicas[i]->exist) {
+				munmap(numaReplicas[i]->exist, numaSizes[i]);
+			} else {
+				munmap(numaReplicas[i]->values, numaSizes[i]);
+			}
+			free(numaReplicas[i]);
+			numaReplicas[i] = 0;
+		}
+	}
+}
+#else
+void setNuma(int mode) {
+	numaMode = 0;
+	if(mode) {
+		fprintf(stderr, "NUMA placement is only available on Linux.\n");
+	}
+}
+
+int numaNodeOf(int num) {
+	return 0;
+}
+
+pthread_attr_t * numaThread(int num) {
+	return NULL;
+}
+
+void numaPlace(HashMapKMA *src) {
+	return;
+}
+
+HashMapKMA * numaTemplates(HashMapKMA *src, int num) {
+	return src;
+}
+
+void numaFree(void) {
+	return;
+}
+#endif
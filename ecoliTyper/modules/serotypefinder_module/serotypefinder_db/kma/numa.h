@@ -0,0 +1,45 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <pthread.h>
+#include "hashmapkma.h"
+
+#ifndef NUMA
+#define NUMAPIN 1
+#define NUMAINTERLEAVE 2
+#define NUMAREPLICATE 3
+#define NUMAMAXNODE 64
+#define NUMAMAXCPU 4096
+#define NUMAPOLICYBIND 2
+#define NUMAPOLICYINTERLEAVE 3
+#define NUMAMOVE 2
+#define NUMA 1
+#endif
+
+/*
+ Threads are pinned round robin over the nodes, so thread num runs on
+ numaNodeOf(num). With NUMAREPLICATE each node gets its own copy of the
+ k-mer index, bound to the node.
+*/
+void setNuma(int mode);
+int numaNodeOf(int num);
+pthread_attr_t * numaThread(int num);
+void numaPlace(HashMapKMA *src);
+HashMapKMA * numaTemplates(HashMapKMA *src, int num);
+void numaFree(void);
@@ -18,10 +18,607 @@
 */
 #include <stdlib.h>
 #include <string.h>
+#include "kmacpu.h"
+#include "kmastat.h"
+#include "kmmap.h"
 #include "nw.h"
 #include "penalties.h"
 #include "pherror.h"
 #include "stdnuc.h"
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define NW_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define NW_NEON 1
+#endif
+
+int (*nwBandRow)(int *, int *, int *, unsigned char *, const int *, const int *, const unsigned char *, const int *, int, int, int, int, int, int) = &nwBandRow_init;
+
+int nwBandRow_scalar(int *D_ptr, int *P_ptr, int *Q_row, unsigned char *E_ptr, const int *D_prev, const int *P_prev, const unsigned char *query, const int *d_t, int sn, int en, int sq, int Q_prev, int W1, int U) {
+	
+	int n, q_pos, Q, thisScore;
+	unsigned char e;
+	
+	for(n = sn, q_pos = sq; n > en; --q_pos, --n) {
+		E_ptr[n] = 0;
+		
+		/* update Q and P, gap openings */
+		Q = D_ptr[n + 1] + W1;
+		P_ptr[n] = D_prev[n - 1] + W1;
+		if(Q < P_ptr[n]) {
+			D_ptr[n] = P_ptr[n];
+			e = 4;
+		} else {
+			D_ptr[n] = Q;
+			e = 2;
+		}
+		
+		/* update Q and P, gap extensions */
+		/* mark bit 4 and 5 as possible gap-opennings, if necesarry */
+		thisScore = Q_prev + U;
+		if(Q < thisScore) {
+			Q = thisScore;
+			if(D_ptr[n] <= thisScore) {
+				D_ptr[n] = thisScore;
+				e = 3;
+			}
+		} else {
+			E_ptr[n] |= 16;
+		}
+		thisScore = P_prev[n - 1] + U;
+		if(P_ptr[n] < thisScore) {
+			P_ptr[n] = thisScore;
+			if(D_ptr[n] <= thisScore) {
+				D_ptr[n] = thisScore;
+				e = 5;
+			}
+		} else {
+			E_ptr[n] |= 32;
+		}
+		
+		/* Update D, match */
+		thisScore = D_prev[n] + d_t[query[q_pos]];
+		if(D_ptr[n] <= thisScore) {
+			D_ptr[n] = thisScore;
+			E_ptr[n] |= 1;
+		} else {
+			E_ptr[n] |= e;
+		}
+		
+		Q_prev = Q;
+	}
+	
+	return Q_prev;
+}
+
+/*
+	The vector kernels split each row in three passes:
+	P gaps and matches only depend on the previous row, the Q gaps are
+	carried along the row by a max-plus prefix scan, and the
+	traceback bits are set from the final values of each cell.
+	Inside the row a Q gap is either opened from D or extended from Q,
+	with D >= Q, so Q[n] = max(D[n + 1] + W1, Q[n + 1] + max(W1, U)).
+	This gives the same scores and ties as the scalar kernel.
+*/
+static inline void nwBandCell(int *D_ptr, int *P_ptr, const int *D_prev, const int *P_prev, int match, int n, int W1, int U) {
+	
+	int P;
+	
+	P = D_prev[n - 1] + W1;
+	if(P < P_prev[n - 1] + U) {
+		P = P_prev[n - 1] + U;
+	}
+	P_ptr[n] = P;
+	match += D_prev[n];
+	D_ptr[n] = (P < match) ? match : P;
+}
+
+static inline int nwBandQ(int *D_ptr, int *Q_row, int n, int lo, int Q, int W1, int U) {
+	
+	int Qo;
+	
+	for(; lo <= n; --n) {
+		Qo = D_ptr[n + 1] + W1;
+		Q += U;
+		if(Q < Qo) {
+			Q = Qo;
+		}
+		Q_row[n] = Q;
+		if(D_ptr[n] < Q) {
+			D_ptr[n] = Q;
+		}
+	}
+	
+	return Q;
+}
+
+static inline unsigned char nwBandE(const int *D_ptr, const int *Q_row, const int *D_prev, const int *P_prev, int match, int n, int W1, int U) {
+	
+	int Qo, Qe, Po, Pe, D;
+	unsigned char e, E;
+	
+	Qo = D_ptr[n + 1] + W1;
+	Qe = Q_row[n + 1] + U;
+	Po = D_prev[n - 1] + W1;
+	Pe = P_prev[n - 1] + U;
+	match += D_prev[n];
+	E = 0;
+	if(Qo < Po) {
+		D = Po;
+		e = 4;
+	} else {
+		D = Qo;
+		e = 2;
+	}
+	if(Qo < Qe) {
+		if(D <= Qe) {
+			D = Qe;
+			e = 3;
+		}
+	} else {
+		E |= 16;
+	}
+	if(Po < Pe) {
+		if(D <= Pe) {
+			D = Pe;
+			e = 5;
+		}
+	} else {
+		E |= 32;
+	}
+	
+	return E | ((D <= match) ? 1 : e);
+}
+
+#ifdef NW_X86
+__attribute__((target("avx2")))
+static int nwBandRow_avx2(int *D_ptr, int *P_ptr, int *Q_row, unsigned char *E_ptr, const int *D_prev, const int *P_prev, const unsigned char *query, const int *d_t, int sn, int en, int sq, int Q_prev, int W1, int U) {
+	
+	int n, lo, e, Um;
+	__m256i w1, u, um, cm, dt, Qo, Qe, Po, Pe, M, D, E, c1, c2, mask;
+	
+	lo = en + 1;
+	if(sn < lo) {
+		return Q_prev;
+	}
+	Um = (W1 < U) ? U : W1;
+	query += sq - sn;
+	w1 = _mm256_set1_epi32(W1);
+	u = _mm256_set1_epi32(U);
+	dt = _mm256_setr_epi32(d_t[0], d_t[1], d_t[2], d_t[3], d_t[4], 0, 0, 0);
+	
+	/* P gaps and matches */
+	for(n = lo; n + 8 <= sn + 1; n += 8) {
+		Po = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(D_prev + n - 1)), w1);
+		Pe = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(P_prev + n - 1)), u);
+		M = _mm256_permutevar8x32_epi32(dt, _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(query + n))));
+		M = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(D_prev + n)), M);
+		Po = _mm256_max_epi32(Po, Pe);
+		_mm256_storeu_si256((__m256i *)(P_ptr + n), Po);
+		_mm256_storeu_si256((__m256i *)(D_ptr + n), _mm256_max_epi32(Po, M));
+	}
+	for(; n <= sn; ++n) {
+		nwBandCell(D_ptr, P_ptr, D_prev, P_prev, d_t[query[n]], n, W1, U);
+	}
+	
+	/* Q gaps */
+	Q_row[sn + 1] = Q_prev;
+	Q_prev = nwBandQ(D_ptr, Q_row, sn, sn, Q_prev, W1, U);
+	um = _mm256_set1_epi32(Um);
+	cm = _mm256_mullo_epi32(_mm256_setr_epi32(8, 7, 6, 5, 4, 3, 2, 1), um);
+	for(n = sn - 8; lo <= n; n -= 8) {
+		Qe = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(D_ptr + n + 1)), w1);
+		Qo = _mm256_add_epi32(_mm256_permutevar8x32_epi32(Qe, _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 7)), um);
+		Qe = _mm256_max_epi32(Qe, _mm256_blend_epi32(Qo, Qe, 0x80));
+		Qo = _mm256_add_epi32(_mm256_permutevar8x32_epi32(Qe, _mm256_setr_epi32(2, 3, 4, 5, 6, 7, 7, 7)), _mm256_add_epi32(um, um));
+		Qe = _mm256_max_epi32(Qe, _mm256_blend_epi32(Qo, Qe, 0xC0));
+		Qo = _mm256_permutevar8x32_epi32(Qe, _mm256_setr_epi32(4, 5, 6, 7, 7, 7, 7, 7));
+		Qo = _mm256_add_epi32(Qo, _mm256_slli_epi32(um, 2));
+		Qe = _mm256_max_epi32(Qe, _mm256_blend_epi32(Qo, Qe, 0xF0));
+		Qe = _mm256_max_epi32(Qe, _mm256_add_epi32(_mm256_set1_epi32(Q_prev), cm));
+		_mm256_storeu_si256((__m256i *)(Q_row + n), Qe);
+		D = _mm256_loadu_si256((const __m256i *)(D_ptr + n));
+		_mm256_storeu_si256((__m256i *)(D_ptr + n), _mm256_max_epi32(D, Qe));
+		Q_prev = _mm_cvtsi128_si32(_mm256_castsi256_si128(Qe));
+	}
+	Q_prev = nwBandQ(D_ptr, Q_row, n + 7, lo, Q_prev, W1, U);
+	
+	/* traceback */
+	for(n = lo; n + 8 <= sn + 1; n += 8) {
+		Qo = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(D_ptr + n + 1)), w1);
+		Qe = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(Q_row + n + 1)), u);
+		Po = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(D_prev + n - 1)), w1);
+		Pe = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(P_prev + n - 1)), u);
+		M = _mm256_permutevar8x32_epi32(dt, _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(query + n))));
+		M = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(D_prev + n)), M);
+		
+		E = _mm256_blendv_epi8(_mm256_set1_epi32(2), _mm256_set1_epi32(4), _mm256_cmpgt_epi32(Po, Qo));
+		D = _mm256_max_epi32(Qo, Po);
+		c1 = _mm256_cmpgt_epi32(Qe, Qo);
+		mask = _mm256_andnot_si256(_mm256_cmpgt_epi32(D, Qe), c1);
+		E = _mm256_blendv_epi8(E, _mm256_set1_epi32(3), mask);
+		D = _mm256_max_epi32(D, Qe);
+		c2 = _mm256_cmpgt_epi32(Pe, Po);
+		mask = _mm256_andnot_si256(_mm256_cmpgt_epi32(D, Pe), c2);
+		E = _mm256_blendv_epi8(E, _mm256_set1_epi32(5), mask);
+		D = _mm256_max_epi32(D, Pe);
+		E = _mm256_blendv_epi8(_mm256_set1_epi32(1), E, _mm256_cmpgt_epi32(D, M));
+		E = _mm256_or_si256(E, _mm256_andnot_si256(c1, _mm256_set1_epi32(16)));
+		E = _mm256_or_si256(E, _mm256_andnot_si256(c2, _mm256_set1_epi32(32)));
+		
+		/* pack to bytes */
+		E = _mm256_packus_epi16(_mm256_packs_epi32(E, E), E);
+		e = _mm_cvtsi128_si32(_mm256_castsi256_si128(E));
+		memcpy(E_ptr + n, &e, sizeof(int));
+		e = _mm_cvtsi128_si32(_mm256_extracti128_si256(E, 1));
+		memcpy(E_ptr + n + 4, &e, sizeof(int));
+	}
+	for(; n <= sn; ++n) {
+		E_ptr[n] = nwBandE(D_ptr, Q_row, D_prev, P_prev, d_t[query[n]], n, W1, U);
+	}
+	
+	return Q_prev;
+}
+
+__attribute__((target("sse4.2")))
+static int nwBandRow_sse42(int *D_ptr, int *P_ptr, int *Q_row, unsigned char *E_ptr, const int *D_prev, const int *P_prev, const unsigned char *query, const int *d_t, int sn, int en, int sq, int Q_prev, int W1, int U) {
+	
+	int n, lo, e, Um;
+	__m128i w1, u, um, cm, Qo, Qe, Po, Pe, M, D, E, c1, c2, mask;
+	
+	lo = en + 1;
+	if(sn < lo) {
+		return Q_prev;
+	}
+	Um = (W1 < U) ? U : W1;
+	query += sq - sn;
+	w1 = _mm_set1_epi32(W1);
+	u = _mm_set1_epi32(U);
+	
+	/* P gaps and matches */
+	for(n = lo; n + 4 <= sn + 1; n += 4) {
+		Po = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(D_prev + n - 1)), w1);
+		Pe = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(P_prev + n - 1)), u);
+		M = _mm_setr_epi32(d_t[query[n]], d_t[query[n + 1]], d_t[query[n + 2]], d_t[query[n + 3]]);
+		M = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(D_prev + n)), M);
+		Po = _mm_max_epi32(Po, Pe);
+		_mm_storeu_si128((__m128i *)(P_ptr + n), Po);
+		_mm_storeu_si128((__m128i *)(D_ptr + n), _mm_max_epi32(Po, M));
+	}
+	for(; n <= sn; ++n) {
+		nwBandCell(D_ptr, P_ptr, D_prev, P_prev, d_t[query[n]], n, W1, U);
+	}
+	
+	/* Q gaps */
+	Q_row[sn + 1] = Q_prev;
+	Q_prev = nwBandQ(D_ptr, Q_row, sn, sn, Q_prev, W1, U);
+	um = _mm_set1_epi32(Um);
+	cm = _mm_mullo_epi32(_mm_setr_epi32(4, 3, 2, 1), um);
+	for(n = sn - 4; lo <= n; n -= 4) {
+		Qe = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(D_ptr + n + 1)), w1);
+		Qo = _mm_add_epi32(_mm_srli_si128(Qe, 4), um);
+		Qe = _mm_max_epi32(Qe, _mm_blend_epi16(Qo, Qe, 0xC0));
+		Qo = _mm_add_epi32(_mm_srli_si128(Qe, 8), _mm_add_epi32(um, um));
+		Qe = _mm_max_epi32(Qe, _mm_blend_epi16(Qo, Qe, 0xF0));
+		Qe = _mm_max_epi32(Qe, _mm_add_epi32(_mm_set1_epi32(Q_prev), cm));
+		_mm_storeu_si128((__m128i *)(Q_row + n), Qe);
+		D = _mm_loadu_si128((const __m128i *)(D_ptr + n));
+		_mm_storeu_si128((__m128i *)(D_ptr + n), _mm_max_epi32(D, Qe));
+		Q_prev = _mm_cvtsi128_si32(Qe);
+	}
+	Q_prev = nwBandQ(D_ptr, Q_row, n + 3, lo, Q_prev, W1, U);
+	
+	/* traceback */
+	for(n = lo; n + 4 <= sn + 1; n += 4) {
+		Qo = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(D_ptr + n + 1)), w1);
+		Qe = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(Q_row + n + 1)), u);
+		Po = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(D_prev + n - 1)), w1);
+		Pe = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(P_prev + n - 1)), u);
+		M = _mm_setr_epi32(d_t[query[n]], d_t[query[n + 1]], d_t[query[n + 2]], d_t[query[n + 3]]);
+		M = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(D_prev + n)), M);
+		
+		E = _mm_blendv_epi8(_mm_set1_epi32(2), _mm_set1_epi32(4), _mm_cmpgt_epi32(Po, Qo));
+		D = _mm_max_epi32(Qo, Po);
+		c1 = _mm_cmpgt_epi32(Qe, Qo);
+		mask = _mm_andnot_si128(_mm_cmpgt_epi32(D, Qe), c1);
+		E = _mm_blendv_epi8(E, _mm_set1_epi32(3), mask);
+		D = _mm_max_epi32(D, Qe);
+		c2 = _mm_cmpgt_epi32(Pe, Po);
+		mask = _mm_andnot_si128(_mm_cmpgt_epi32(D, Pe), c2);
+		E = _mm_blendv_epi8(E, _mm_set1_epi32(5), mask);
+		D = _mm_max_epi32(D, Pe);
+		E = _mm_blendv_epi8(_mm_set1_epi32(1), E, _mm_cmpgt_epi32(D, M));
+		E = _mm_or_si128(E, _mm_andnot_si128(c1, _mm_set1_epi32(16)));
+		E = _mm_or_si128(E, _mm_andnot_si128(c2, _mm_set1_epi32(32)));
+		
+		/* pack to bytes */
+		E = _mm_packus_epi16(_mm_packs_epi32(E, E), E);
+		e = _mm_cvtsi128_si32(E);
+		memcpy(E_ptr + n, &e, sizeof(int));
+	}
+	for(; n <= sn; ++n) {
+		E_ptr[n] = nwBandE(D_ptr, Q_row, D_prev, P_prev, d_t[query[n]], n, W1, U);
+	}
+	
+	return Q_prev;
+}
+#endif
+
+#ifdef NW_NEON
+static int nwBandRow_neon(int *D_ptr, int *P_ptr, int *Q_row, unsigned char *E_ptr, const int *D_prev, const int *P_prev, const unsigned char *query, const int *d_t, int sn, int en, int sq, int Q_prev, int W1, int U) {
+	
+	int n, lo, m[4], Um;
+	int32x4_t w1, u, um, cm, Qo, Qe, Po, Pe, M, D, E;
+	uint32x4_t c1, c2, mask, top;
+	uint16x4_t e;
+	
+	lo = en + 1;
+	if(sn < lo) {
+		return Q_prev;
+	}
+	Um = (W1 < U) ? U : W1;
+	query += sq - sn;
+	w1 = vdupq_n_s32(W1);
+	u = vdupq_n_s32(U);
+	
+	/* P gaps and matches */
+	for(n = lo; n + 4 <= sn + 1; n += 4) {
+		Po = vaddq_s32(vld1q_s32(D_prev + n - 1), w1);
+		Pe = vaddq_s32(vld1q_s32(P_prev + n - 1), u);
+		m[0] = d_t[query[n]];
+		m[1] = d_t[query[n + 1]];
+		m[2] = d_t[query[n + 2]];
+		m[3] = d_t[query[n + 3]];
+		M = vaddq_s32(vld1q_s32(D_prev + n), vld1q_s32(m));
+		Po = vmaxq_s32(Po, Pe);
+		vst1q_s32(P_ptr + n, Po);
+		vst1q_s32(D_ptr + n, vmaxq_s32(Po, M));
+	}
+	for(; n <= sn; ++n) {
+		nwBandCell(D_ptr, P_ptr, D_prev, P_prev, d_t[query[n]], n, W1, U);
+	}
+	
+	/* Q gaps */
+	Q_row[sn + 1] = Q_prev;
+	Q_prev = nwBandQ(D_ptr, Q_row, sn, sn, Q_prev, W1, U);
+	um = vdupq_n_s32(Um);
+	m[0] = 4 * Um;
+	m[1] = 3 * Um;
+	m[2] = 2 * Um;
+	m[3] = Um;
+	cm = vld1q_s32(m);
+	top = vreinterpretq_u32_s32(vsetq_lane_s32(-1, vdupq_n_s32(0), 3));
+	for(n = sn - 4; lo <= n; n -= 4) {
+		Qe = vaddq_s32(vld1q_s32(D_ptr + n + 1), w1);
+		Qo = vaddq_s32(vextq_s32(Qe, Qe, 1), um);
+		Qe = vmaxq_s32(Qe, vbslq_s32(top, Qe, Qo));
+		Qo = vaddq_s32(vextq_s32(Qe, Qe, 2), vaddq_s32(um, um));
+		Qe = vmaxq_s32(Qe, vbslq_s32(vorrq_u32(top, vextq_u32(top, top, 1)), Qe, Qo));
+		Qe = vmaxq_s32(Qe, vaddq_s32(vdupq_n_s32(Q_prev), cm));
+		vst1q_s32(Q_row + n, Qe);
+		vst1q_s32(D_ptr + n, vmaxq_s32(vld1q_s32(D_ptr + n), Qe));
+		Q_prev = vgetq_lane_s32(Qe, 0);
+	}
+	Q_prev = nwBandQ(D_ptr, Q_row, n + 3, lo, Q_prev, W1, U);
+	
+	/* traceback */
+	for(n = lo; n + 4 <= sn + 1; n += 4) {
+		Qo = vaddq_s32(vld1q_s32(D_ptr + n + 1), w1);
+		Qe = vaddq_s32(vld1q_s32(Q_row + n + 1), u);
+		Po = vaddq_s32(vld1q_s32(D_prev + n - 1), w1);
+		Pe = vaddq_s32(vld1q_s32(P_prev + n - 1), u);
+		m[0] = d_t[query[n]];
+		m[1] = d_t[query[n + 1]];
+		m[2] = d_t[query[n + 2]];
+		m[3] = d_t[query[n + 3]];
+		M = vaddq_s32(vld1q_s32(D_prev + n), vld1q_s32(m));
+		
+		E = vbslq_s32(vcgtq_s32(Po, Qo), vdupq_n_s32(4), vdupq_n_s32(2));
+		D = vmaxq_s32(Qo, Po);
+		c1 = vcgtq_s32(Qe, Qo);
+		mask = vbicq_u32(c1, vcgtq_s32(D, Qe));
+		E = vbslq_s32(mask, vdupq_n_s32(3), E);
+		D = vmaxq_s32(D, Qe);
+		c2 = vcgtq_s32(Pe, Po);
+		mask = vbicq_u32(c2, vcgtq_s32(D, Pe));
+		E = vbslq_s32(mask, vdupq_n_s32(5), E);
+		D = vmaxq_s32(D, Pe);
+		E = vbslq_s32(vcgtq_s32(D, M), E, vdupq_n_s32(1));
+		E = vorrq_s32(E, vbicq_s32(vdupq_n_s32(16), vreinterpretq_s32_u32(c1)));
+		E = vorrq_s32(E, vbicq_s32(vdupq_n_s32(32), vreinterpretq_s32_u32(c2)));
+		
+		/* pack to bytes */
+		e = vmovn_u32(vreinterpretq_u32_s32(E));
+		vst1_lane_u32((uint32_t *)(m), vreinterpret_u32_u8(vmovn_u16(vcombine_u16(e, e))), 0);
+		memcpy(E_ptr + n, m, 4);
+	}
+	for(; n <= sn; ++n) {
+		E_ptr[n] = nwBandE(D_ptr, Q_row, D_prev, P_prev, d_t[query[n]], n, W1, U);
+	}
+	
+	return Q_prev;
+}
+#endif
+
+void nwInit(void) {
+	
+	static const KmaKernel kernels[] = {
+#ifdef NW_X86
+		{CPU_AVX2, "avx2"},
+		{CPU_SSE42, "sse4.2"},
+#elif defined(NW_NEON)
+		{CPU_NEON, "neon"},
+#endif
+		{0, "scalar"},
+		{0, 0}
+	};
+	unsigned need;
+	
+	/* pick the widest kernel supported by the running cpu */
+	need = kmaCpu_pick(CPU_NW, kernels);
+#ifdef NW_X86
+	if(need & CPU_AVX2) {
+		nwBandRow = &nwBandRow_avx2;
+	} else if(need & CPU_SSE42) {
+		nwBandRow = &nwBandRow_sse42;
+	} else {
+		nwBandRow = &nwBandRow_scalar;
+	}
+#elif defined(NW_NEON)
+	nwBandRow = (need & CPU_NEON) ? &nwBandRow_neon : &nwBandRow_scalar;
+#else
+	nwBandRow = &nwBandRow_scalar;
+#endif
+}
+
+int nwBandRow_init(int *D_ptr, int *P_ptr, int *Q_row, unsigned char *E_ptr, const int *D_prev, const int *P_prev, const unsigned char *query, const int *d_t, int sn, int en, int sq, int Q_prev, int W1, int U) {
+	
+	nwInit();
+	
+	return nwBandRow(D_ptr, P_ptr, Q_row, E_ptr, D_prev, P_prev, query, d_t, sn, en, sq, Q_prev, W1, U);
+}
+
+NWmat * NWmat_init(long NW_q, long NW_s, Penalties *rewards) {
+	
+	NWmat *dest;
+	
+	dest = smalloc(sizeof(NWmat));
+	dest->NW_s = NW_s;
+	dest->NW_q = NW_q;
+	memAcc_add(MEM_ALIGN, NW_s + 5 * NW_q * sizeof(int));
+	dest->E = getHugePages() ? hugeMalloc(NW_s) : smalloc(NW_s);
+	dest->D[0] = smalloc(5 * NW_q * sizeof(int));
+	dest->D[1] = dest->D[0] + NW_q;
+	dest->Q = dest->D[0] + (NW_q << 1);
+	dest->P[0] = dest->D[0] + 3 * NW_q;
+	dest->P[1] = dest->P[0] + NW_q;
+	dest->P2[0] = 0;
+	dest->P2[1] = 0;
+	dest->rewards = rewards;
+	
+	return dest;
+}
+
+void NWmat_realloc(NWmat *matrices, long q_len, long size) {
+	
+	/*
+	All rows share one block, and the traceback is grown by at least 50%,
+	to keep allocations out of the alignment loop.
+	*/
+	if(matrices->NW_q <= q_len) {
+		sfree_tag(MEM_ALIGN, matrices->D[0], 5 * matrices->NW_q * sizeof(int));
+		matrices->NW_q = q_len << 1;
+		matrices->D[0] = smalloc_tag(MEM_ALIGN, 5 * matrices->NW_q * sizeof(int));
+		matrices->D[1] = matrices->D[0] + matrices->NW_q;
+		matrices->Q = matrices->D[0] + (matrices->NW_q << 1);
+		matrices->P[0] = matrices->D[0] + 3 * matrices->NW_q;
+		matrices->P[1] = matrices->P[0] + matrices->NW_q;
+	}
+	if(matrices->NW_s <= size) {
+		memAcc_sub(MEM_ALIGN, matrices->NW_s);
+		matrices->NW_s += matrices->NW_s >> 1;
+		if(matrices->NW_s <= size) {
+			matrices->NW_s = size + 1;
+		}
+		memAcc_add(MEM_ALIGN, matrices->NW_s);
+		if(getHugePages()) {
+			hugeFree(matrices->E);
+			matrices->E = hugeMalloc(matrices->NW_s);
+		} else {
+			free(matrices->E);
+			matrices->E = smalloc(matrices->NW_s);
+		}
+	}
+}
+
+void NWmat_free(NWmat *src) {
+	
+	memAcc_sub(MEM_ALIGN, src->NW_s + 5 * src->NW_q * sizeof(int));
+	if(getHugePages()) {
+		hugeFree(src->E);
+	} else {
+		free(src->E);
+	}
+	free(src->D[0]);
+	free(src);
+}
+
+long NWmat_size(const int *template_lengths, int DB_size, int band) {
+	
+	int i;
+	long unsigned size;
+	
+	/* fit a band over the average template */
+	size = 0;
+	for(i = 1; i < DB_size; ++i) {
+		size += template_lengths[i];
+	}
+	size = 1 < DB_size ? (size / (DB_size - 1) + 2) * ((band << 1) + 3) : 0;
+	if(size < 1024 * 1024) {
+		size = 1024 * 1024;
+	} else if(64 * 1024 * 1024 < size) {
+		size = 64 * 1024 * 1024;
+	}
+	
+	return size;
+}
+
+static int NW_ungapped(const long unsigned *template, const unsigned char *query, int t_s, int len, Aln *aligned, AlnScore *Stat, Penalties *rewards, int template_length) {
+	
+	int i, j, nuc_pos, score, best, bound, **d;
+	
+	/*
+	Pieces of equal length joined at both ends. A gapped alignment of these
+	holds an insertion and a deletion, and at most len - 1 aligned pairs, so
+	the ungapped alignment is the only optimum when it scores above that.
+	*/
+	if(0 < rewards->W1 || 0 < rewards->U) {
+		return 0;
+	}
+	d = rewards->d;
+	best = **d;
+	for(i = 0; i < 5; ++i) {
+		for(j = 0; j < 5; ++j) {
+			best = best < d[i][j] ? d[i][j] : best;
+		}
+	}
+	bound = (len - 1) * best + 2 * rewards->W1;
+	score = 0;
+	nuc_pos = t_s;
+	for(i = 0; i < len; ++i) {
+		if(nuc_pos == template_length) {
+			nuc_pos = 0;
+		}
+		score += d[getNuc(template, nuc_pos)][query[i]];
+		++nuc_pos;
+		if(score + (len - 1 - i) * best <= bound) {
+			return 0;
+		}
+	}
+	kmaStat_add(STAT_UNGAPPED, 1);
+	
+	Stat->score = score;
+	Stat->len = len;
+	Stat->match = len;
+	Stat->tGaps = 0;
+	Stat->qGaps = 0;
+	if(aligned) {
+		nuc_pos = t_s;
+		for(i = 0; i < len; ++i) {
+			if(nuc_pos == template_length) {
+				nuc_pos = 0;
+			}
+			aligned->t[i] = getNuc(template, nuc_pos);
+			aligned->q[i] = query[i];
+			aligned->s[i] = (aligned->t[i] == aligned->q[i]) ? '|' : '_';
+			++nuc_pos;
+		}
+		aligned->s[len] = 0;
+	}
+	
+	return 1;
+}
 
 AlnScore NW(const long unsigned *template, const unsigned char *queryOrg, int k, int t_s, int t_e, int q_s, int q_e, Aln *aligned, NWmat *matrices, int template_length) {
 	
@@ -85,22 +682,15 @@ AlnScore NW(const long unsigned *template, const unsigned char *queryOrg, int k,
 		return Stat;
 	}
 	
-	/* check matrix size */
-	if(matrices->NW_q <= q_len) {
-		matrices->NW_q = q_len << 1;
-		free(matrices->D[0]);
-		free(matrices->P[0]);
-		matrices->D[0] = smalloc((matrices->NW_q << 1) * sizeof(int));
-		matrices->P[0] = smalloc((matrices->NW_q << 1) * sizeof(int));
-		matrices->D[1] = matrices->D[0] + matrices->NW_q;
-		matrices->P[1] = matrices->P[0] + matrices->NW_q;
-	}
-	if(matrices->NW_s <= ((long unsigned)(q_len + 1) * (long unsigned)(t_len + 1))) {
-		matrices->NW_s = ((long unsigned)(q_len + 2) * (long unsigned)(t_len + 2));
-		free(matrices->E);
-		matrices->E = smalloc(matrices->NW_s);
+	/* equal pieces between seeds, that need no gaps */
+	if(k == 0 && t_len == q_len && NW_ungapped(template, query, t_s, q_len, aligned, &Stat, rewards, template_length)) {
+		return Stat;
 	}
 	
+	/* check matrix size */
+	NWmat_realloc(matrices, q_len, (long unsigned)(q_len + 1) * (long unsigned)(t_len + 1));
+	kmaStat_add(STAT_CELLS, (long unsigned)(q_len) * t_len);
+	
 	/* fill in start penalties */
 	D_ptr = matrices->D[0];
 	D_prev = matrices->D[1];
@@ -377,20 +967,8 @@ AlnScore NW_band(const long unsigned *template, const unsigned char *queryOrg, i
 	halfBand = band >> 1;
 	
 	/* check matrix size */
-	if(matrices->NW_q <= band) {
-		matrices->NW_q = band << 1;
-		free(matrices->D[0]);
-		free(matrices->P[0]);
-		matrices->D[0] = smalloc((matrices->NW_q << 1) * sizeof(int));
-		matrices->P[0] = smalloc((matrices->NW_q << 1) * sizeof(int));
-		matrices->D[1] = matrices->D[0] + matrices->NW_q;
-		matrices->P[1] = matrices->P[0] + matrices->NW_q;
-	}
-	if(matrices->NW_s <= ((long unsigned)(band + 2) * (long unsigned)(t_len + 1))) {
-		matrices->NW_s = ((long unsigned)(band + 3) * (long unsigned)(t_len + 2));
-		free(matrices->E);
-		matrices->E = smalloc(matrices->NW_s);
-	}
+	NWmat_realloc(matrices, band, (long unsigned)(band + 2) * (long unsigned)(t_len + 1));
+	kmaStat_add(STAT_CELLS, (long unsigned)(band + 1) * t_len);
 	
 	/* fill in start penalties */
 	bq_len = band + 1; /* (band + 1) ~ q_len */
@@ -461,54 +1039,9 @@ AlnScore NW_band(const long unsigned *template, const unsigned char *queryOrg, i
 		}
 		
 		t_nuc = getNuc(template, nuc_pos);
-		for(n = sn, q_pos = sq; n > en; --q_pos, --n) {
-			E_ptr[n] = 0;
-			
-			/* update Q and P, gap openings */
-			Q = D_ptr[n + 1] + W1;
-			P_ptr[n] = D_prev[n - 1] + W1;
-			if(Q < P_ptr[n]) {
-				D_ptr[n] = P_ptr[n];
-				e = 4;
-			} else {
-				D_ptr[n] = Q;
-				e = 2;
-			}
-			
-			/* update Q and P, gap extensions */
-			/* mark bit 4 and 5 as possible gap-opennings, if necesarry */
-			thisScore = Q_prev + U;
-			if(Q < thisScore) {
-				Q = thisScore;
-				if(D_ptr[n] <= thisScore) {
-					D_ptr[n] = thisScore;
-					e = 3;
-				}
-			} else {
-				E_ptr[n] |= 16;
-			}
-			thisScore = P_prev[n - 1] + U;
-			if(P_ptr[n] < thisScore) {
-				P_ptr[n] = thisScore;
-				if(D_ptr[n] <= thisScore) {
-					D_ptr[n] = thisScore;
-					e = 5;
-				}
-			} else {
-				E_ptr[n] |= 32;
-			}
-			
-			/* Update D, match */
-			thisScore = D_prev[n] + d[t_nuc][query[q_pos]];
-			if(D_ptr[n] <= thisScore) {
-				D_ptr[n] = thisScore;
-				E_ptr[n] |= 1;
-			} else {
-				E_ptr[n] |= e;
-			}
-			
-			Q_prev = Q;
-		}
+		Q_prev = nwBandRow(D_ptr, P_ptr, matrices->Q, E_ptr, D_prev, P_prev, query, d[t_nuc], sn, en, sq, Q_prev, W1, U);
+		n = (en < sn) ? en : sn;
+		q_pos = sq - (sn - n);
 		
 		/* handle banded boundary */
 		E_ptr[n] = 0;
@@ -683,22 +1216,15 @@ AlnScore NW_score(const long unsigned *template, const unsigned char *queryOrg,
 		return Stat;
 	}
 	
-	/* check matrix size */
-	if(matrices->NW_q <= q_len) {
-		matrices->NW_q = q_len << 1;
-		free(matrices->D[0]);
-		free(matrices->P[0]);
-		matrices->D[0] = smalloc((matrices->NW_q << 1) * sizeof(int));
-		matrices->P[0] = smalloc((matrices->NW_q << 1) * sizeof(int));
-		matrices->D[1] = matrices->D[0] + matrices->NW_q;
-		matrices->P[1] = matrices->P[0] + matrices->NW_q;
-	}
-	if(matrices->NW_s <= ((q_len + 1) * (t_len + 1))) {
-		matrices->NW_s = ((q_len + 2) * (t_len + 2));
-		free(matrices->E);
-		matrices->E = smalloc(matrices->NW_s);
+	/* equal pieces between seeds, that need no gaps */
+	if(k == 0 && t_len == q_len && NW_ungapped(template, query, t_s, q_len, 0, &Stat, rewards, template_length)) {
+		return Stat;
 	}
 	
+	/* check matrix size */
+	NWmat_realloc(matrices, q_len, (long unsigned)(q_len + 1) * (long unsigned)(t_len + 1));
+	kmaStat_add(STAT_CELLS, (long unsigned)(q_len) * t_len);
+	
 	/* fill in start penalties */
 	D_ptr = matrices->D[0];
 	D_prev = matrices->D[1];
@@ -941,20 +1467,8 @@ AlnScore NW_band_score(const long unsigned *template, const unsigned char *query
 	halfBand = band >> 1;
 	
 	/* check matrix size */
-	if(matrices->NW_q <= band) {
-		matrices->NW_q = band << 1;
-		free(matrices->D[0]);
-		free(matrices->P[0]);
-		matrices->D[0] = smalloc((matrices->NW_q << 1) * sizeof(int));
-		matrices->P[0] = smalloc((matrices->NW_q << 1) * sizeof(int));
-		matrices->D[1] = matrices->D[0] + matrices->NW_q;
-		matrices->P[1] = matrices->P[0] + matrices->NW_q;
-	}
-	if(matrices->NW_s <= ((band + 2) * (t_len + 1))) {
-		matrices->NW_s = ((band + 3) * (t_len + 2));
-		free(matrices->E);
-		matrices->E = smalloc(matrices->NW_s);
-	}
+	NWmat_realloc(matrices, band, (long unsigned)(band + 2) * (long unsigned)(t_len + 1));
+	kmaStat_add(STAT_CELLS, (long unsigned)(band + 1) * t_len);
 	
 	/* fill in start penalties */
 	bq_len = band + 1; /* (band + 1) ~ q_len */
@@ -1027,54 +1541,9 @@ AlnScore NW_band_score(const long unsigned *template, const unsigned char *query
 		}
 		
 		t_nuc = getNuc(template, nuc_pos);
-		for(n = sn, q_pos = sq; n > en; --q_pos, --n) {
-			E_ptr[n] = 0;
-			
-			/* update Q and P, gap openings */
-			Q = D_ptr[n + 1] + W1;
-			P_ptr[n] = D_prev[n - 1] + W1;
-			if(Q < P_ptr[n]) {
-				D_ptr[n] = P_ptr[n];
-				e = 4;
-			} else {
-				D_ptr[n] = Q;
-				e = 2;
-			}
-			
-			/* update Q and P, gap extensions */
-			/* mark bit 4 and 5 as possible gap-opennings, if necesarry */
-			thisScore = Q_prev + U;
-			if(Q < thisScore) {
-				Q = thisScore;
-				if(D_ptr[n] <= thisScore) {
-					D_ptr[n] = thisScore;
-					e = 3;
-				}
-			} else {
-				E_ptr[n] |= 16;
-			}
-			thisScore = P_prev[n - 1] + U;
-			if(P_ptr[n] < thisScore) {
-				P_ptr[n] = thisScore;
-				if(D_ptr[n] <= thisScore) {
-					D_ptr[n] = thisScore;
-					e = 5;
-				}
-			} else {
-				E_ptr[n] |= 32;
-			}
-			
-			/* Update D, match */
-			thisScore = D_prev[n] + d[t_nuc][query[q_pos]];
-			if(D_ptr[n] <= thisScore) {
-				D_ptr[n] = thisScore;
-				E_ptr[n] |= 1;
-			} else {
-				E_ptr[n] |= e;
-			}
-			
-			Q_prev = Q;
-		}
+		Q_prev = nwBandRow(D_ptr, P_ptr, matrices->Q, E_ptr, D_prev, P_prev, query, d[t_nuc], sn, en, sq, Q_prev, W1, U);
+		n = (en < sn) ? en : sn;
+		q_pos = sq - (sn - n);
 		
 		/* handle banded boundary */
 		E_ptr[n] = 0;
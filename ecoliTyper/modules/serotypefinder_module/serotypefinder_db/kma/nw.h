@@ -31,6 +31,7 @@ struct nWmat {
 	int *D[2];
 	int *P[2];
 	int *P2[2];
+	int *Q;
 	Penalties *rewards;
 };
 
@@ -57,6 +58,14 @@ struct aln {
 #define NWLOAD 1
 #endif
 
+extern int (*nwBandRow)(int *, int *, int *, unsigned char *, const int *, const int *, const unsigned char *, const int *, int, int, int, int, int, int);
+int nwBandRow_scalar(int *D_ptr, int *P_ptr, int *Q_row, unsigned char *E_ptr, const int *D_prev, const int *P_prev, const unsigned char *query, const int *d_t, int sn, int en, int sq, int Q_prev, int W1, int U);
+void nwInit(void);
+int nwBandRow_init(int *D_ptr, int *P_ptr, int *Q_row, unsigned char *E_ptr, const int *D_prev, const int *P_prev, const unsigned char *query, const int *d_t, int sn, int en, int sq, int Q_prev, int W1, int U);
+NWmat * NWmat_init(long NW_q, long NW_s, Penalties *rewards);
+void NWmat_realloc(NWmat *matrices, long q_len, long size);
+void NWmat_free(NWmat *src);
+long NWmat_size(const int *template_lengths, int DB_size, int band);
 AlnScore NW(const long unsigned *template, const unsigned char *queryOrg, int k, int t_s, int t_e, int q_s, int q_e, Aln *aligned, NWmat *matrices, int template_length);
 AlnScore NW_band(const long unsigned *template, const unsigned char *queryOrg, int k, int t_s, int t_e, int q_s, int q_e, Aln *aligned, int band, NWmat *matrices, int template_length);
 AlnScore NW_score(const long unsigned *template, const unsigned char *queryOrg, int k, int t_s, int t_e, int q_s, int q_e, NWmat *matrices, int template_length);
@@ -96,22 +96,11 @@ AlnScore NW2P(const long unsigned *template, const unsigned char *queryOrg, int
 	
 	/* check matrix size */
 	if(matrices->NW_q <= q_len) {
-		matrices->NW_q = q_len << 1;
-		free(matrices->D[0]);
-		free(matrices->P[0]);
 		free(matrices->P2[0]);
-		matrices->D[0] = smalloc((matrices->NW_q << 1) * sizeof(int));
-		matrices->P[0] = smalloc((matrices->NW_q << 1) * sizeof(int));
-		matrices->P2[0] = smalloc((matrices->NW_q << 1) * sizeof(int));
-		matrices->D[1] = matrices->D[0] + matrices->NW_q;
-		matrices->P[1] = matrices->P[0] + matrices->NW_q;
-		matrices->P2[1] = matrices->P[0] + matrices->NW_q;
-	}
-	if(matrices->NW_s <= ((q_len + 1) * (t_len + 1))) {
-		matrices->NW_s = ((q_len + 2) * (t_len + 2));
-		free(matrices->E);
-		matrices->E = smalloc(matrices->NW_s);
+		matrices->P2[0] = smalloc((q_len << 2) * sizeof(int));
+		matrices->P2[1] = matrices->P2[0] + (q_len << 1);
 	}
+	NWmat_realloc(matrices, q_len, (long unsigned)(q_len + 1) * (long unsigned)(t_len + 1));
 	
 	/* fill in start penalties */
 	D_ptr = matrices->D[0];
@@ -499,20 +488,7 @@ AlnScore NW_band(const long unsigned *template, const unsigned char *queryOrg, i
 	halfBand = band >> 1;
 	
 	/* check matrix size */
-	if(matrices->NW_q <= band) {
-		matrices->NW_q = band << 1;
-		free(matrices->D[0]);
-		free(matrices->P[0]);
-		matrices->D[0] = smalloc((matrices->NW_q << 1) * sizeof(int));
-		matrices->P[0] = smalloc((matrices->NW_q << 1) * sizeof(int));
-		matrices->D[1] = matrices->D[0] + matrices->NW_q;
-		matrices->P[1] = matrices->P[0] + matrices->NW_q;
-	}
-	if(matrices->NW_s <= ((band + 2) * (t_len + 1))) {
-		matrices->NW_s = ((band + 3) * (t_len + 2));
-		free(matrices->E);
-		matrices->E = smalloc(matrices->NW_s);
-	}
+	NWmat_realloc(matrices, band, (long unsigned)(band + 2) * (long unsigned)(t_len + 1));
 	
 	/* fill in start penalties */
 	bq_len = band + 1; /* (band + 1) ~ q_len */
@@ -807,20 +783,7 @@ AlnScore NW_score(const long unsigned *template, const unsigned char *queryOrg,
 	}
 	
 	/* check matrix size */
-	if(matrices->NW_q <= q_len) {
-		matrices->NW_q = q_len << 1;
-		free(matrices->D[0]);
-		free(matrices->P[0]);
-		matrices->D[0] = smalloc((matrices->NW_q << 1) * sizeof(int));
-		matrices->P[0] = smalloc((matrices->NW_q << 1) * sizeof(int));
-		matrices->D[1] = matrices->D[0] + matrices->NW_q;
-		matrices->P[1] = matrices->P[0] + matrices->NW_q;
-	}
-	if(matrices->NW_s <= ((q_len + 1) * (t_len + 1))) {
-		matrices->NW_s = ((q_len + 2) * (t_len + 2));
-		free(matrices->E);
-		matrices->E = smalloc(matrices->NW_s);
-	}
+	NWmat_realloc(matrices, q_len, (long unsigned)(q_len + 1) * (long unsigned)(t_len + 1));
 	
 	/* fill in start penalties */
 	D_ptr = matrices->D[0];
@@ -1064,20 +1027,7 @@ AlnScore NW_band_score(const long unsigned *template, const unsigned char *query
 	halfBand = band >> 1;
 	
 	/* check matrix size */
-	if(matrices->NW_q <= band) {
-		matrices->NW_q = band << 1;
-		free(matrices->D[0]);
-		free(matrices->P[0]);
-		matrices->D[0] = smalloc((matrices->NW_q << 1) * sizeof(int));
-		matrices->P[0] = smalloc((matrices->NW_q << 1) * sizeof(int));
-		matrices->D[1] = matrices->D[0] + matrices->NW_q;
-		matrices->P[1] = matrices->P[0] + matrices->NW_q;
-	}
-	if(matrices->NW_s <= ((band + 2) * (t_len + 1))) {
-		matrices->NW_s = ((band + 3) * (t_len + 2));
-		free(matrices->E);
-		matrices->E = smalloc(matrices->NW_s);
-	}
+	NWmat_realloc(matrices, band, (long unsigned)(band + 2) * (long unsigned)(t_len + 1));
 	
 	/* fill in start penalties */
 	bq_len = band + 1; /* (band + 1) ~ q_len */
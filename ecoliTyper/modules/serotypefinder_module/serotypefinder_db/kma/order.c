@@ -0,0 +1,285 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "filebuff.h"
+#include "order.h"
+#include "pherror.h"
+#include "qseqs.h"
+#include "seqparse.h"
+#include "sketch.h"
+#include "tmp.h"
+
+static int cmpHash(const void *a, const void *b) {
+	
+	long unsigned x, y;
+	
+	x = *((long unsigned *) a);
+	y = *((long unsigned *) b);
+	
+	return x < y ? -1 : y < x;
+}
+
+static int cmpOrderHash(const void *a, const void *b) {
+	
+	const OrderHash *x, *y;
+	
+	x = a;
+	y = b;
+	if(x->hash != y->hash) {
+		return x->hash < y->hash ? -1 : 1;
+	}
+	
+	return x->num < y->num ? -1 : y->num < x->num;
+}
+
+static int cmpNum(const void *a, const void *b) {
+	
+	unsigned x, y;
+	
+	x = *((unsigned *) a);
+	y = *((unsigned *) b);
+	
+	return x < y ? -1 : y < x;
+}
+
+static unsigned orderSketch(long unsigned *sketch, long unsigned *hashes, unsigned char *seq, int len, unsigned kmersize) {
+	
+	int i, j, n;
+	unsigned size, shift;
+	long unsigned kmer, rmer, mask, h;
+	
+	/* hash canonical k-mers, without N's */
+	mask = 0xFFFFFFFFFFFFFFFF >> (64 - (kmersize << 1));
+	shift = (kmersize - 1) << 1;
+	n = 0;
+	kmer = 0;
+	rmer = 0;
+	for(i = 0, j = 0; i < len; ++i) {
+		if(seq[i] < 4) {
+			kmer = ((kmer << 2) | seq[i]) & mask;
+			rmer = (rmer >> 2) | ((long unsigned)(3 - seq[i]) << shift);
+			if(kmersize <= ++j) {
+				h = kmer < rmer ? kmer : rmer;
+				sketchHash(h, h);
+				hashes[n++] = h;
+			}
+		} else {
+			j = 0;
+		}
+	}
+	
+	/* keep the smallest unique */
+	qsort(hashes, n, sizeof(long unsigned), cmpHash);
+	for(size = 0, i = 0; i < n && size < ORDERSKETCH; ++i) {
+		if(!size || sketch[size - 1] != hashes[i]) {
+			sketch[size++] = hashes[i];
+		}
+	}
+	
+	return size;
+}
+
+int orderTemplates(char **inputfiles, int filecount, char *outputfilename, char *trans, unsigned kmersize, double shared) {
+	
+	int i, j, n, size, hashSize, FASTQ, file_len, clusters;
+	unsigned t, u, o, first, touched_n, *sizes, *counts, *touched, *order;
+	long unsigned pos, len, buffSize, lo, hi, mid, m, *offsets, *sketches, *hashes, *sketch;
+	unsigned char *seq, *assigned, *buff;
+	FILE *tmp, *out, *order_out;
+	FileBuff *inputfile;
+	Qseqs *header, *qseq;
+	OrderHash *entries, *entry;
+	
+	/* init */
+	size = 1024;
+	offsets = smalloc((size + 1) * sizeof(long unsigned));
+	sizes = smalloc(size * sizeof(unsigned));
+	sketches = smalloc(size * ORDERSKETCH * sizeof(long unsigned));
+	hashSize = 1024;
+	hashes = smalloc(hashSize * sizeof(long unsigned));
+	header = setQseqs(1024);
+	qseq = setQseqs(1024);
+	inputfile = setFileBuff(1024 * 1024);
+	if(!(tmp = tmpF(0))) {
+		ERROR();
+	}
+	n = 0;
+	pos = 0;
+	
+	/* sketch the templates, and keep them in input order */
+	for(i = 0; i < filecount; ++i) {
+		if((FASTQ = openAndDetermine(inputfile, inputfiles[i])) & 2) {
+			while(FileBuffgetFsa(inputfile, header, qseq, trans)) {
+				if(n == size) {
+					size <<= 1;
+					offsets = realloc(offsets, (size + 1) * sizeof(long unsigned));
+					sizes = realloc(sizes, size * sizeof(unsigned));
+					sketches = realloc(sketches, size * ORDERSKETCH * sizeof(long unsigned));
+					if(!offsets || !sizes || !sketches) {
+						ERROR();
+					}
+				}
+				if(hashSize < qseq->len) {
+					free(hashes);
+					hashSize = qseq->len;
+					hashes = smalloc(hashSize * sizeof(long unsigned));
+				}
+				sizes[n] = orderSketch(sketches + (long unsigned) n * ORDERSKETCH, hashes, qseq->seq, qseq->len, kmersize);
+				
+				/* spool as fasta */
+				seq = qseq->seq;
+				for(j = 0; j < qseq->len; ++j) {
+					seq[j] = "ACGTN"[seq[j]];
+				}
+				offsets[n++] = pos;
+				pos += fprintf(tmp, "%s\n", (char *) header->seq);
+				sfwrite(seq, 1, qseq->len, tmp);
+				fputc('\n', tmp);
+				pos += qseq->len + 1;
+			}
+		} else {
+			fprintf(stderr, "Unsupported format for file:\t%s\n", inputfiles[i]);
+			errno |= 1;
+		}
+		if(FASTQ & 4) {
+			gzcloseFileBuff(inputfile);
+		} else {
+			closeFileBuff(inputfile);
+		}
+	}
+	offsets[n] = pos;
+	destroyQseqs(header);
+	destroyQseqs(qseq);
+	destroyFileBuff(inputfile);
+	free(hashes);
+	
+	/* index the sketches on their hashes */
+	for(m = 0, t = 0; t < n; ++t) {
+		m += sizes[t];
+	}
+	entries = smalloc((m + 1) * sizeof(OrderHash));
+	entry = entries;
+	for(t = 0; t < n; ++t) {
+		sketch = sketches + (long unsigned) t * ORDERSKETCH;
+		for(u = 0; u < sizes[t]; ++u) {
+			entry->hash = sketch[u];
+			entry->num = t;
+			++entry;
+		}
+	}
+	qsort(entries, m, sizeof(OrderHash), cmpOrderHash);
+	
+	/* grow clusters from the first unassigned template, taking the
+	   templates sharing enough of the smaller sketch with it */
+	counts = calloc(n + 1, sizeof(unsigned));
+	assigned = calloc(n + 1, 1);
+	if(!counts || !assigned) {
+		ERROR();
+	}
+	touched = smalloc((n + 1) * sizeof(unsigned));
+	order = smalloc((n + 1) * sizeof(unsigned));
+	clusters = 0;
+	o = 0;
+	for(t = 0; t < n; ++t) {
+		if(assigned[t]) {
+			continue;
+		}
+		assigned[t] = 1;
+		order[o++] = t;
+		first = o;
+		touched_n = 0;
+		sketch = sketches + (long unsigned) t * ORDERSKETCH;
+		for(u = 0; u < sizes[t]; ++u) {
+			/* first entry of hash */
+			lo = 0;
+			hi = m;
+			while(lo < hi) {
+				mid = (lo + hi) >> 1;
+				if(entries[mid].hash < sketch[u]) {
+					lo = mid + 1;
+				} else {
+					hi = mid;
+				}
+			}
+			for(entry = entries + lo; entry < entries + m && entry->hash == sketch[u]; ++entry) {
+				if(!assigned[entry->num] && !counts[entry->num]++) {
+					touched[touched_n++] = entry->num;
+				}
+			}
+		}
+		for(u = 0; u < touched_n; ++u) {
+			i = touched[u];
+			if(shared * (sizes[t] < sizes[i] ? sizes[t] : sizes[i]) <= counts[i]) {
+				assigned[i] = 1;
+				order[o++] = i;
+			}
+			counts[i] = 0;
+		}
+		
+		/* keep input order within the cluster */
+		qsort(order + first, o - first, sizeof(unsigned), cmpNum);
+		++clusters;
+	}
+	free(entries);
+	free(counts);
+	free(assigned);
+	free(touched);
+	free(sketches);
+	free(sizes);
+	
+	/* write templates in cluster order, with their input numbers */
+	file_len = strlen(outputfilename);
+	strcat(outputfilename, ".order.fsa");
+	out = sfopen(outputfilename, "wb");
+	outputfilename[file_len] = 0;
+	strcat(outputfilename, ".order");
+	order_out = sfopen(outputfilename, "wb");
+	outputfilename[file_len] = 0;
+	buffSize = 0;
+	buff = 0;
+	for(o = 0; o < n; ++o) {
+		t = order[o];
+		len = offsets[t + 1] - offsets[t];
+		if(buffSize < len) {
+			free(buff);
+			buffSize = len;
+			buff = smalloc(buffSize);
+		}
+		if(fseeko(tmp, offsets[t], SEEK_SET)) {
+			ERROR();
+		}
+		sfread(buff, 1, len, tmp);
+		sfwrite(buff, 1, len, out);
+		seq = memchr(buff, '\n', len);
+		fprintf(order_out, "%u\t%.*s\n", t + 1, (int)(seq - buff - 1), (char *)(buff + 1));
+	}
+	fclose(tmp);
+	fclose(out);
+	fclose(order_out);
+	free(buff);
+	free(offsets);
+	free(order);
+	
+	fprintf(stderr, "# Ordered %d templates in %d clusters.\n", n, clusters);
+	
+	return clusters;
+}
@@ -0,0 +1,488 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 700
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#undef _XOPEN_SOURCE
+#include "pack.h"
+#include "pherror.h"
+
+static const char *packSuffixes[] = {".comp.b", ".decon.comp.b", ".length.b", ".seq.b", ".name", ".filter.b", ".decon.filter.b", ".delta.b", ".ns", ".name.b", 0};
+static Pack *packs = 0;
+static FILE *packFiles[PACKFILES];
+static PackSection *packFileSections[PACKFILES];
+static Pack *packFilePacks[PACKFILES];
+static int packFds[PACKFILES];
+static long unsigned packFdStarts[PACKFILES];
+
+long unsigned packSum(long unsigned sum, unsigned char *data, long unsigned size) {
+	
+	long unsigned word;
+	
+	/* chained calls must hand over multiples of 8 bytes, but the last */
+	while(8 <= size) {
+		memcpy(&word, data, 8);
+		sum = (sum ^ word) * 0x100000001B3UL;
+		sum ^= sum >> 29;
+		data += 8;
+		size -= 8;
+	}
+	if(size) {
+		word = 0;
+		memcpy(&word, data, size);
+		sum = (sum ^ word) * 0x100000001B3UL;
+		sum ^= sum >> 29;
+	}
+	
+	return sum;
+}
+
+static void packAdd(const char *filename, unsigned char *data, long unsigned size, int embedded) {
+	
+	int i, file_len;
+	Pack *pack;
+	PackHead *head;
+	PackSection *section;
+	
+	/* verify sections and use the container */
+	file_len = strlen(filename);
+	pack = smalloc(sizeof(Pack));
+	pack->filename = smalloc(file_len + 5);
+	sprintf(pack->filename, "%s.kma", filename);
+	pack->len = file_len;
+	pack->data = data;
+	pack->head = head = (PackHead *) data;
+	pack->sections = (PackSection *)(data + sizeof(PackHead));
+	pack->embedded = embedded;
+	if(size < sizeof(PackHead) + head->n * sizeof(PackSection) || packSum(0, (unsigned char *) pack->sections, head->n * sizeof(PackSection)) != head->sum) {
+		fprintf(stderr, "Corrupt DB container:\t%s\n", pack->filename);
+		exit(1);
+	}
+	for(i = 0, section = pack->sections; i < head->n; ++i, ++section) {
+		if(size < section->offset || size - section->offset < section->size || packSum(0, data + section->offset, section->size) != section->sum) {
+			fprintf(stderr, "Corrupt DB container:\t%s\t%s\n", pack->filename, section->name);
+			exit(1);
+		}
+	}
+	
+	pack->next = packs;
+	packs = pack;
+	packFopenPtr = &packFopen;
+}
+
+#ifdef _WIN32
+int packDB(char *filename) {
+	fprintf(stderr, "DB containers are not available on windows.\n");
+	return 1;
+}
+
+int packLoad(char *filename) {
+	return 1;
+}
+#else
+int packDB(char *filename) {
+	
+	int i, n, file_len;
+	long unsigned offset, size, chunk;
+	unsigned char *buff;
+	PackHead head;
+	PackSection *sections;
+	FILE *in, *out;
+	struct stat st;
+	
+	/* lay out sections of present files */
+	file_len = strlen(filename);
+	for(n = 0; packSuffixes[n]; ++n);
+	sections = smalloc(n * sizeof(PackSection));
+	memset(sections, 0, n * sizeof(PackSection));
+	offset = sizeof(PackHead) + n * sizeof(PackSection);
+	for(i = 0, n = 0; packSuffixes[i]; ++i) {
+		strcpy(filename + file_len, packSuffixes[i]);
+		if(stat(filename, &st) == 0 && st.st_size) {
+			strcpy(sections[n].name, packSuffixes[i]);
+			sections[n].offset = (offset + PACKALIGN - 1) & ~(PACKALIGN - 1);
+			sections[n].size = st.st_size;
+			offset = sections[n].offset + st.st_size;
+			++n;
+		}
+	}
+	errno = 0;
+	if(!n || strcmp(sections->name, ".comp.b")) {
+		filename[file_len] = 0;
+		fprintf(stderr, "No DB to pack:\t%s\n", filename);
+		free(sections);
+		return 1;
+	}
+	
+	/* copy files */
+	strcpy(filename + file_len, ".kma");
+	out = sfopen(filename, "wb");
+	chunk = 1048576;
+	buff = smalloc(chunk);
+	for(i = 0; i < n; ++i) {
+		strcpy(filename + file_len, sections[i].name);
+		in = sfopen(filename, "rb");
+		sfseek(out, sections[i].offset, SEEK_SET);
+		size = sections[i].size;
+		while(size) {
+			offset = size < chunk ? size : chunk;
+			sfread(buff, 1, offset, in);
+			sections[i].sum = packSum(sections[i].sum, buff, offset);
+			cfwrite(buff, 1, offset, out);
+			size -= offset;
+		}
+		fclose(in);
+	}
+	
+	/* header and section table go first */
+	memset(&head, 0, sizeof(PackHead));
+	strcpy(head.magic, PACKMAGIC);
+	head.version = PACKVERSION;
+	head.n = n;
+	head.size = sections[n - 1].offset + sections[n - 1].size;
+	head.sum = packSum(0, (unsigned char *) sections, n * sizeof(PackSection));
+	sfseek(out, 0, SEEK_SET);
+	cfwrite(&head, sizeof(PackHead), 1, out);
+	cfwrite(sections, sizeof(PackSection), n, out);
+	fclose(out);
+	filename[file_len] = 0;
+	
+	for(i = 0; i < n; ++i) {
+		fprintf(stderr, "# Packed:\t%s%s\t%lu\n", filename, sections[i].name, sections[i].size);
+	}
+	free(buff);
+	free(sections);
+	
+	return 0;
+}
+
+int packLoad(char *filename) {
+	
+	int fd, file_len;
+	long unsigned size;
+	unsigned char *data;
+	Pack *pack;
+	PackHead head;
+	struct stat st;
+	
+	/* embedded, or already loaded */
+	file_len = strlen(filename);
+	for(pack = packs; pack; pack = pack->next) {
+		if(pack->len == file_len && strncmp(pack->filename, filename, file_len) == 0) {
+			return 0;
+		}
+	}
+	
+	/* open container if present */
+	strcpy(filename + file_len, ".kma");
+	fd = open(filename, O_RDONLY);
+	filename[file_len] = 0;
+	if(fd < 0) {
+		errno = 0;
+		return 1;
+	} else if(fstat(fd, &st) || pread(fd, &head, sizeof(PackHead), 0) != sizeof(PackHead)) {
+		close(fd);
+		fprintf(stderr, "Truncated DB container:\t%s.kma\n", filename);
+		exit(1);
+	} else if(strcmp(head.magic, PACKMAGIC) || head.version != PACKVERSION) {
+		close(fd);
+		fprintf(stderr, "Wrong format of DB container:\t%s.kma\n", filename);
+		exit(1);
+	} else if(head.size != st.st_size) {
+		close(fd);
+		fprintf(stderr, "Truncated DB container:\t%s.kma\n", filename);
+		exit(1);
+	}
+	size = st.st_size;
+	data = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED) {
+		ERROR();
+	}
+	
+	/* verify everything up front, in one sequential read */
+	posix_madvise(data, size, POSIX_MADV_SEQUENTIAL);
+	packAdd(filename, data, size, 0);
+	posix_madvise(data, size, POSIX_MADV_NORMAL);
+	
+	return 0;
+}
+#endif
+
+int packEmbed(const char *name, const unsigned char *data, long unsigned size) {
+	
+	PackHead *head;
+	
+	/* container compiled into kma, see packEmbedSrc */
+	head = (PackHead *) data;
+	if(size < sizeof(PackHead) || strcmp(head->magic, PACKMAGIC) || head->version != PACKVERSION || head->size != size) {
+		fprintf(stderr, "Wrong format of embedded DB:\t%s\n", name);
+		exit(1);
+	}
+	packAdd(name, (unsigned char *) data, size, 1);
+	
+	return 0;
+}
+
+int packEmbedSrc(char **filenames, int n, char *outname) {
+	
+	int i, j, file_len, nameStart;
+	long unsigned size, word, *words;
+	FILE *in, *out;
+	
+	out = sfopen(outname, "w");
+	fprintf(out, "/* made by kma db -embed, do not edit */\n");
+	for(i = 0; i < n; ++i) {
+		/* pack the DB, unless it is already */
+		file_len = strlen(filenames[i]);
+		strcpy(filenames[i] + file_len, ".kma");
+		if(!(in = fopen(filenames[i], "rb"))) {
+			filenames[i][file_len] = 0;
+			errno = 0;
+			if(packDB(filenames[i])) {
+				fclose(out);
+				remove(outname);
+				return 1;
+			}
+			strcpy(filenames[i] + file_len, ".kma");
+			in = sfopen(filenames[i], "rb");
+		}
+		filenames[i][file_len] = 0;
+		sfseek(in, 0, SEEK_END);
+		size = ftell(in);
+		sfseek(in, 0, SEEK_SET);
+		
+		/* written as words, to keep the sections aligned in place */
+		words = smalloc(size + 8);
+		words[size >> 3] = 0;
+		sfread(words, 1, size, in);
+		fclose(in);
+		fprintf(out, "static const long unsigned kmaDB%d[%lu] = {", i, (size + 7) >> 3);
+		for(j = 0; j < (size + 7) >> 3; ++j) {
+			word = words[j];
+			fprintf(out, "%s0x%lxUL", j ? (j & 7 ? ", " : ",\n") : "\n", word);
+		}
+		fprintf(out, "\n};\n");
+		free(words);
+		
+		/* DB is known by its name without directories */
+		nameStart = file_len;
+		while(nameStart && filenames[i][nameStart - 1] != '/') {
+			--nameStart;
+		}
+		fprintf(out, "static const long unsigned kmaDBsize%d = %luUL;\n", i, size);
+		fprintf(out, "static const char kmaDBname%d[] = \"%s\";\n", i, filenames[i] + nameStart);
+		fprintf(stderr, "# Embedded:\t%s\t%lu\n", filenames[i] + nameStart, size);
+	}
+	fprintf(out, "const int kmaEmbeddedNum = %d;\n", n);
+	fprintf(out, "const char *kmaEmbeddedNames[] = {");
+	for(i = 0; i < n; ++i) {
+		fprintf(out, "kmaDBname%d, ", i);
+	}
+	fprintf(out, "0};\n");
+	fprintf(out, "const unsigned char *kmaEmbeddedData[] = {");
+	for(i = 0; i < n; ++i) {
+		fprintf(out, "(const unsigned char *)(kmaDB%d), ", i);
+	}
+	fprintf(out, "0};\n");
+	fprintf(out, "const long unsigned *kmaEmbeddedSizes[] = {");
+	for(i = 0; i < n; ++i) {
+		fprintf(out, "&kmaDBsize%d, ", i);
+	}
+	fprintf(out, "0};\n");
+	fclose(out);
+	
+	return 0;
+}
+
+static PackSection * packFind(const char *filename, Pack **dest) {
+	
+	int i;
+	Pack *pack;
+	
+	for(pack = packs; pack; pack = pack->next) {
+		if(strncmp(filename, pack->filename, pack->len) == 0) {
+			for(i = 0; i < pack->head->n; ++i) {
+				if(strcmp(filename + pack->len, pack->sections[i].name) == 0) {
+					*dest = pack;
+					return pack->sections + i;
+				}
+			}
+		}
+	}
+	
+	return 0;
+}
+
+FILE * packFopen(const char *filename) {
+	
+	int i;
+	FILE *file;
+	Pack *pack;
+	PackSection *section;
+	
+	if(!(section = packFind(filename, &pack))) {
+		return 0;
+	} else if(!(file = fmemopen(pack->data + section->offset, section->size, "rb"))) {
+		ERROR();
+	}
+	
+	/* remember section, for in place use */
+	for(i = 0; i < PACKFILES && packFiles[i] && packFiles[i] != file; ++i);
+	if(i == PACKFILES) {
+		i = 0;
+	}
+	packFiles[i] = file;
+	packFileSections[i] = section;
+	packFilePacks[i] = pack;
+	
+	return file;
+}
+
+unsigned char * packMap(FILE *file, long unsigned *size) {
+	
+	int i;
+	
+	for(i = 0; i < PACKFILES && packFiles[i]; ++i) {
+		if(packFiles[i] == file) {
+			*size = packFileSections[i]->size;
+			return packFilePacks[i]->data + packFileSections[i]->offset;
+		}
+	}
+	
+	return 0;
+}
+
+static int packEmbedFd(Pack *pack, PackSection *section) {
+	
+	static int n = 0;
+	int fd;
+	long unsigned pos;
+	ssize_t bytes;
+	char name[64];
+	
+	/* embedded sections are read through an unlinked shared memory file */
+	sprintf(name, "/kma_embed.%d.%d", (int) getpid(), n++);
+	if((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0) {
+		return -1;
+	}
+	shm_unlink(name);
+	for(pos = 0; pos < section->size; pos += bytes) {
+		if((bytes = write(fd, pack->data + section->offset + pos, section->size - pos)) <= 0) {
+			close(fd);
+			return -1;
+		}
+	}
+	lseek(fd, 0, SEEK_SET);
+	
+	return fd;
+}
+
+int packOpen(const char *filename, long unsigned *size) {
+	
+	int i, fd;
+	long unsigned start;
+	Pack *pack;
+	PackSection *section;
+	
+	/* open section in container, or the file itself */
+	if((section = packFind(filename, &pack)) && pack->embedded) {
+		fd = packEmbedFd(pack, section);
+		start = 0;
+		if(size) {
+			*size = section->size;
+		}
+	} else if(section) {
+		fd = open(pack->filename, O_RDONLY);
+		start = section->offset;
+		if(size) {
+			*size = section->size;
+		}
+	} else {
+		fd = open(filename, O_RDONLY);
+		start = 0;
+		if(size && 0 <= fd) {
+			*size = lseek(fd, 0, SEEK_END);
+		}
+	}
+	if(fd < 0 || lseek(fd, start, SEEK_SET) != start) {
+		return -1;
+	}
+	
+	/* remember where the section starts */
+	for(i = 0; i < PACKFILES && packFds[i] && packFds[i] != fd; ++i);
+	if(i == PACKFILES) {
+		i = 0;
+	}
+	packFds[i] = fd;
+	packFdStarts[i] = start;
+	
+	return fd;
+}
+
+unsigned char * packMmap(const char *filename, long unsigned *size) {
+	
+	int fd;
+	unsigned char *data;
+	Pack *pack;
+	PackSection *section;
+	struct stat st;
+	
+	/* use section in container, or map the file itself */
+	if((section = packFind(filename, &pack))) {
+		*size = section->size;
+		return pack->data + section->offset;
+	} else if((fd = open(filename, O_RDONLY)) < 0) {
+		errno = 0;
+		return 0;
+	} else if(fstat(fd, &st) || !(*size = st.st_size)) {
+		close(fd);
+		errno = 0;
+		return 0;
+	}
+	data = mmap(0, *size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED) {
+		errno = 0;
+		return 0;
+	}
+	
+	return data;
+}
+
+long unsigned packStart(int fd) {
+	
+	int i;
+	
+	for(i = 0; i < PACKFILES && packFds[i]; ++i) {
+		if(packFds[i] == fd) {
+			return packFdStarts[i];
+		}
+	}
+	
+	return 0;
+}
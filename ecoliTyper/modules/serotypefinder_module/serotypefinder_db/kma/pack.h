@@ -0,0 +1,75 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+
+#ifndef PACK
+typedef struct packHead PackHead;
+typedef struct packSection PackSection;
+typedef struct pack Pack;
+
+struct packHead {
+	char magic[8];
+	unsigned version;
+	unsigned n;
+	long unsigned size;
+	long unsigned sum;
+};
+
+struct packSection {
+	char name[32];
+	long unsigned offset;
+	long unsigned size;
+	long unsigned sum;
+};
+
+struct pack {
+	char *filename;
+	int len;
+	unsigned char *data;
+	PackHead *head;
+	PackSection *sections;
+	int embedded;
+	struct pack *next;
+};
+
+#define PACK 1
+#define PACKMAGIC "KMAPACK"
+#define PACKVERSION 1
+#define PACKALIGN 4096
+#define PACKFILES 64
+#endif
+
+/*
+ "<db>.kma" holds the files of a DB in one container: a header, a table
+ of sections and the files themselves, each starting on a page. Sizes and
+ checksums are verified when the container is loaded, and the sections
+ are used in place from a single mmap. Containers can also be compiled
+ into kma, with packEmbedSrc writing them as C and packEmbed using them.
+*/
+long unsigned packSum(long unsigned sum, unsigned char *data, long unsigned size);
+int packDB(char *filename);
+int packLoad(char *filename);
+int packEmbed(const char *name, const unsigned char *data, long unsigned size);
+int packEmbedSrc(char **filenames, int n, char *outname);
+FILE * packFopen(const char *filename);
+unsigned char * packMap(FILE *file, long unsigned *size);
+int packOpen(const char *filename, long unsigned *size);
+unsigned char * packMmap(const char *filename, long unsigned *size);
+long unsigned packStart(int fd);
@@ -0,0 +1,103 @@
+#!/bin/sh
+# Performance regression over the bundled serotype data.
+#
+# Maps an assembled genome (test.fsa), paired Illumina reads and ONT reads,
+# the reads drawn from test.fsa by kma bench, against the O and H type DBs.
+# Every run must call wzx O1 and fliC H9 as the best scoring template, and
+# its fragments per second is checked against the baseline, when one is stored.
+#
+# ./perf.sh             run and compare against $PERFBASE
+# ./perf.sh -baseline   run and store the results as $PERFBASE
+#
+# KMA       kma to test (./kma)
+# PERFDIR   work directory (perf.tmp)
+# PERFBASE  stored baseline (perf.baseline)
+# PERFREPS  runs per workload, fastest is kept (3)
+# PERFTOL   allowed slowdown in percent (20)
+# PERFT     threads (1)
+
+KMA=${KMA:-./kma}
+PERFDIR=${PERFDIR:-perf.tmp}
+PERFBASE=${PERFBASE:-perf.baseline}
+PERFREPS=${PERFREPS:-3}
+PERFTOL=${PERFTOL:-20}
+PERFT=${PERFT:-1}
+DATA=../../test.fsa
+DB=..
+
+mkdir -p "$PERFDIR" || exit 1
+W="$PERFDIR"
+
+# sample, reads are drawn from its genes
+$KMA index -i "$DATA" -o "$W/sample" > "$W/index.log" 2>&1 || { echo "Indexing of $DATA failed, see $W/index.log"; exit 1; }
+$KMA bench -draw -t_db "$W/sample" -o "$W/illumina" -l 150 -ins 350 -depth 2000 -e 0.01 -seed 1 > "$W/draw.log" 2>&1 &&
+$KMA bench -draw -t_db "$W/sample" -o "$W/ont" -l 10000 -depth 2000 -e 0.08 -seed 1 >> "$W/draw.log" 2>&1 || { echo "Drawing reads failed, see $W/draw.log"; exit 1; }
+
+# workload	input	options
+workloads="genome|-i $DATA|
+illumina|-ipe $W/illumina_1.fq $W/illumina_2.fq|-1t1
+ont|-i $W/ont.fq|-bcNano -bc 0.7"
+
+# DB	expected call
+calls="O_type wzx_1_GU299791_O1
+H_type fliC_307_AY249994_H9"
+
+printf "# Workload\tDB\tFragments\tWall (s)\tFragments/s\tBaseline\tRatio\tStatus\n" > "$W/last"
+echo "$workloads" | while IFS='|' read name input options; do
+	echo "$calls" | while read db call; do
+		out="$W/$name.$db"
+		best=""
+		rep=0
+		while [ $rep -lt "$PERFREPS" ]; do
+			if ! $KMA $input -o "$out" -t_db "$DB/$db" -t "$PERFT" -stats $options > "$out.log" 2>&1; then
+				best=""
+				break
+			fi
+			wall=`sed -n 's/^[[:space:]]*"Wall Time": \([0-9.]*\),$/\1/p' "$out.stats.json"`
+			if [ -z "$best" ] || awk "BEGIN {exit !($wall < $best)}"; then
+				best=$wall
+			fi
+			rep=$((rep + 1))
+		done
+		if [ -z "$best" ]; then
+			printf "%s\t%s\t-\t-\t-\t-\t-\tfailed, see %s\n" "$name" "$db" "$out.log" >> "$W/last"
+			continue
+		fi
+
+		# typing call, the best scoring template
+		hit=`grep -v '^#' "$out.res" | sort -t "	" -k 2,2nr | head -n 1 | cut -f 1 | tr -d ' '`
+		if [ "$hit" = "$call" ]; then
+			status=ok
+		else
+			status="wrong call: ${hit:-none}"
+		fi
+
+		# throughput against the baseline
+		frags=`sed -n 's/^[[:space:]]*"Fragments In": \([0-9]*\),$/\1/p' "$out.stats.json"`
+		rate=`awk "BEGIN {printf(\"%.0f\", $frags / ($best < 0.001 ? 0.001 : $best))}"`
+		base=`[ -f "$PERFBASE" ] && awk -F '\t' -v n="$name" -v d="$db" '$1 == n && $2 == d {print $5}' "$PERFBASE"`
+		if [ -n "$base" ] && [ "$base" != "-" ]; then
+			ratio=`awk "BEGIN {printf(\"%.2f\", $rate / $base)}"`
+			if [ "$status" = ok ] && awk "BEGIN {exit !($ratio * 100 < 100 - $PERFTOL)}"; then
+				status="slower than baseline"
+			fi
+		else
+			base=-
+			ratio=-
+		fi
+		printf "%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n" "$name" "$db" "$frags" "$best" "$rate" "$base" "$ratio" "$status" >> "$W/last"
+	done
+done
+
+cat "$W/last"
+if [ "$1" = "-baseline" ]; then
+	if grep -q 'failed\|wrong call' "$W/last"; then
+		echo "# Not storing a baseline with failed runs"
+		exit 1
+	fi
+	cp "$W/last" "$PERFBASE"
+	echo "# Baseline stored in $PERFBASE"
+elif grep -v '^#' "$W/last" | cut -f8 | grep -qv '^ok$'; then
+	exit 1
+fi
+exit 0
@@ -16,14 +16,21 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
 */
-#define _XOPEN_SOURCE 600
+#define _GNU_SOURCE /* MAP_ANONYMOUS */
 #include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+#undef _XOPEN_SOURCE
 #include "pherror.h"
 
+MemAcc *memAcc = 0;
+const char *memAccNames[MEM_TAGS] = {"Index", "Alignment", "Assembly", "Fragments"};
+
 void * smalloc(const size_t size) {
 	
 	void *dest = malloc(size);
@@ -34,9 +41,107 @@ void * smalloc(const size_t size) {
 	return dest;
 }
 
+MemAcc * memAcc_init(long unsigned cap) {
+	
+	/* anonymous shared mapping, so stages forked by -status count here too */
+#ifdef _WIN32
+	memAcc = calloc(1, sizeof(MemAcc));
+#else
+	memAcc = mmap(0, sizeof(MemAcc), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(memAcc == MAP_FAILED) {
+		memAcc = 0;
+	}
+#endif
+	if(memAcc) {
+		memset((void *) memAcc, 0, sizeof(MemAcc));
+		memAcc->cap = cap;
+	}
+	
+	return memAcc;
+}
+
+static void memAcc_peak(volatile long unsigned *peak, long unsigned cur) {
+	
+	long unsigned prev;
+	
+	while((prev = *peak) < cur && !__sync_bool_compare_and_swap(peak, prev, cur));
+}
+
+void memAcc_add(int tag, long unsigned size) {
+	
+	int i;
+	long unsigned total;
+	
+	if(!memAcc) {
+		return;
+	}
+	memAcc_peak(memAcc->peak + tag, __sync_add_and_fetch(memAcc->cur + tag, size));
+	total = __sync_add_and_fetch(memAcc->cur + MEM_TAGS, size);
+	memAcc_peak(memAcc->peak + MEM_TAGS, total);
+	
+	/* fail before the allocation is made */
+	if(memAcc->cap && memAcc->cap < total) {
+		fprintf(stderr, "Memory cap of %.1f MB exceeded, when allocating %.1f MB for %s.\n", memAcc->cap / 1048576.0, size / 1048576.0, memAccNames[tag]);
+		fprintf(stderr, "In use:");
+		for(i = 0; i < MEM_TAGS; ++i) {
+			fprintf(stderr, "\t%s: %.1f MB", memAccNames[i], memAcc->cur[i] / 1048576.0);
+		}
+		fprintf(stderr, "\nConsider fewer threads (-t), -mem_mode, sharing the index with -shm or -mmap, or a larger -mem_cap.\n");
+		errno = ENOMEM;
+		ERROR();
+	}
+}
+
+void memAcc_sub(int tag, long unsigned size) {
+	
+	if(memAcc) {
+		__sync_sub_and_fetch(memAcc->cur + tag, size);
+		__sync_sub_and_fetch(memAcc->cur + MEM_TAGS, size);
+	}
+}
+
+void * smalloc_tag(int tag, const size_t size) {
+	
+	memAcc_add(tag, size);
+	
+	return smalloc(size);
+}
+
+void * srealloc_tag(int tag, void *ptr, const size_t old, const size_t size) {
+	
+	if(old < size) {
+		memAcc_add(tag, size - old);
+	} else {
+		memAcc_sub(tag, old - size);
+	}
+	if(!(ptr = realloc(ptr, size))) {
+		ERROR();
+	}
+	
+	return ptr;
+}
+
+void sfree_tag(int tag, void *ptr, const size_t size) {
+	
+	memAcc_sub(tag, size);
+	free(ptr);
+}
+
+FILE * (*packFopenPtr)(const char *) = &noPackFopen;
+
+FILE * noPackFopen(const char *filename) {
+	return 0;
+}
+
 FILE * sfopen(const char *filename, const char *mode) {
 	
-	FILE *file = fopen(filename, mode);
+	FILE *file;
+	
+	/* files of a DB may be in its container */
+	if(*mode == 'r' && (file = packFopenPtr(filename))) {
+		return file;
+	}
+	file = fopen(filename, mode);
 	if(!file) {
 		fprintf(stderr, "Filename:\t%s\n", filename);
 		ERROR();
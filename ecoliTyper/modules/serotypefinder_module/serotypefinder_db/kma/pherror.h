@@ -23,6 +23,24 @@
 #include <string.h>
 #include <unistd.h>
 
+#ifndef PHERROR
+/* subsystems */
+#define MEM_INDEX 0
+#define MEM_ALIGN 1
+#define MEM_ASSEMBLY 2
+#define MEM_FRAGS 3
+#define MEM_TAGS 4
+
+typedef struct memAcc MemAcc;
+struct memAcc {
+	volatile long unsigned cur[MEM_TAGS + 1]; /* bytes, last is the sum */
+	volatile long unsigned peak[MEM_TAGS + 1];
+	long unsigned cap; /* 0 when uncapped */
+};
+
+#define PHERROR 1
+#endif
+
 /* errno error message */
 #define ERROR() fprintf(stderr, "Error: %d (%s)\n", errno, strerror(errno)); exit(errno);
 
@@ -30,7 +48,19 @@
 #define sfwrite(ptr, size, nmemb, stream) if(fwrite(ptr, size, nmemb, stream) != nmemb) {if(errno) {ERROR();} else {fprintf(stderr, "Writing error.\n"); exit(1);}}
 #define sfread(ptr, size, nmemb, stream) if(fread(ptr, size, nmemb, stream) != nmemb) {if(errno) {ERROR();} else {fprintf(stderr, "Reading error.\n"); exit(1);}}
 #define sfseek(stream, offset, whence) if(fseek(stream, offset, whence)) {if(errno) {ERROR();} else {fprintf(stderr, "fseek error.\n"); exit(1);}}
+extern FILE * (*packFopenPtr)(const char *);
 void * smalloc(const size_t size);
+
+/* tagged accounting, shared with forked stages, 0 when off */
+extern MemAcc *memAcc;
+extern const char *memAccNames[MEM_TAGS];
+MemAcc * memAcc_init(long unsigned cap);
+void memAcc_add(int tag, long unsigned size);
+void memAcc_sub(int tag, long unsigned size);
+void * smalloc_tag(int tag, const size_t size);
+void * srealloc_tag(int tag, void *ptr, const size_t old, const size_t size);
+void sfree_tag(int tag, void *ptr, const size_t size);
+FILE * noPackFopen(const char *filename);
 FILE * sfopen(const char *filename, const char *mode);
 
 /* cyclic */
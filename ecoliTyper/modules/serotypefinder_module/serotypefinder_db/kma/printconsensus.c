@@ -17,13 +17,40 @@
  * limitations under the License.
 */
 #define _XOPEN_SOURCE 600
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "assembly.h"
+#include "pherror.h"
 #include "printconsensus.h"
+#include "threader.h"
 
-void printConsensus(Assem *aligned_assem, char *header, FILE *alignment_out, FILE *consensus_out, int ref_fsa) {
+/* like wait_atomic, but backs off to 10 ms while there is nothing to do */
+#if _POSIX_C_SOURCE >= 199309L
+#define wait_idle(src) for(long idle_ = 100000; src; nanosleep(sleepSpec(idle_), NULL), idle_ = idle_ < 10000000 ? idle_ << 1 : idle_)
+#else
+#define wait_idle(src) for(long idle_ = 100000; src; usleep(idle_ / 1000), idle_ = idle_ < 10000000 ? idle_ << 1 : idle_)
+#endif
+
+static char * alnRow(char *dest, const char *label, const unsigned char *src, int len) {
+	
+	int n;
+	
+	/* as "%-10s\t%.60s\n" */
+	memset(dest, ' ', 10);
+	n = strlen(label);
+	memcpy(dest, label, n);
+	dest[10] = '\t';
+	memcpy(dest + 11, src, len);
+	dest[11 + len] = '\n';
+	
+	return dest + 12 + len;
+}
+
+static void trimConsensus(Assem *aligned_assem) {
 	
-	int i, aln_len, bias;
+	int i;
 	char *s, *s_next;
 	unsigned char *t, *q, *t_next, *q_next;
 	
@@ -50,38 +77,260 @@ void printConsensus(Assem *aligned_assem, char *header, FILE *alignment_out, FIL
 	*++t = 0;
 	*++s = 0;
 	*++q = 0;
+}
+
+static int consensusSize(char *header, int aln_len) {
+	/* one output block holds either file */
+	return strlen(header) + 16 + ((aln_len + 59) / 60) * 220;
+}
+
+static char * formatAln(char *dest, char *header, unsigned char *t, char *s, unsigned char *q, int aln_len) {
+	
+	int i, n;
+	
+	dest += sprintf(dest, "# %s\n", header);
+	for(i = 0; i < aln_len; i += 60) {
+		n = aln_len - i < 60 ? aln_len - i : 60;
+		dest = alnRow(dest, "template:", t + i, n);
+		dest = alnRow(dest, "", (unsigned char *) s + i, n);
+		dest = alnRow(dest, "query:", q + i, n);
+		*dest++ = '\n';
+	}
+	
+	return dest;
+}
+
+static char * formatFsa(char *dest, char *header, unsigned char *q, int aln_len, int ref_fsa) {
+	
+	int i, col;
+	unsigned char c;
+	
+	/* gaps are dropped or masked on the way */
+	dest += sprintf(dest, ">%s\n", header);
+	for(i = 0, col = 0; i < aln_len; ++i) {
+		if((c = q[i]) == '-') {
+			if(ref_fsa == 0) {
+				continue;
+			} else if(ref_fsa == 1) {
+				c = 'n';
+			}
+		}
+		*dest++ = c;
+		if(++col == 60) {
+			*dest++ = '\n';
+			col = 0;
+		}
+	}
+	if(col) {
+		*dest++ = '\n';
+	}
+	
+	return dest;
+}
+
+void printConsensus(Assem *aligned_assem, char *header, FILE *alignment_out, FILE *consensus_out, int ref_fsa) {
+	
+	static int size = 0;
+	static char *buff = 0;
+	int n;
+	char *next;
+	
+	trimConsensus(aligned_assem);
+	n = consensusSize(header, aligned_assem->len);
+	if(size < n) {
+		free(buff);
+		size = n << 1;
+		buff = smalloc(size);
+	}
 	
 	/* print alignment */
-	aln_len = aligned_assem->len;
 	if(alignment_out) {
-		fprintf(alignment_out, "# %s\n", header);
-		for(i = 0; i < aln_len; i += 60) {
-			fprintf(alignment_out, "%-10s\t%.60s\n", "template:", aligned_assem->t + i);
-			fprintf(alignment_out, "%-10s\t%.60s\n", "", aligned_assem->s + i);
-			fprintf(alignment_out, "%-10s\t%.60s\n\n", "query:", aligned_assem->q + i);
+		next = formatAln(buff, header, aligned_assem->t, aligned_assem->s, aligned_assem->q, aligned_assem->len);
+		sfwrite(buff, 1, next - buff, alignment_out);
+	}
+	
+	/* Print consensus */
+	next = formatFsa(buff, header, aligned_assem->q, aligned_assem->len, ref_fsa);
+	sfwrite(buff, 1, next - buff, consensus_out);
+}
+
+ConsPool * consPool_init(FILE *alignment_out, FILE *consensus_out, int ref_fsa, int thread_num) {
+	
+	int i;
+	ConsPool *pool;
+	ConsSlot *slot;
+	
+	pool = smalloc(sizeof(ConsPool));
+	pool->thread_num = thread_num;
+	pool->size = thread_num << 1;
+	pool->ref_fsa = ref_fsa;
+	pool->stop = 0;
+	pool->excludeIn = 0;
+	pool->filled = 0;
+	pool->formatted = 0;
+	pool->written = 0;
+	pool->alignment_out = alignment_out;
+	pool->consensus_out = consensus_out;
+	pool->slots = smalloc(pool->size * sizeof(ConsSlot));
+	for(i = 0, slot = pool->slots; i < pool->size; ++i, ++slot) {
+		slot->status = 0;
+		slot->len = 0;
+		slot->size = 1024;
+		slot->nameSize = 256;
+		slot->buffSize = 65536;
+		slot->alnLen = 0;
+		slot->fsaLen = 0;
+		slot->header = smalloc(slot->nameSize);
+		slot->t = smalloc(slot->size);
+		slot->s = smalloc(slot->size);
+		slot->q = smalloc(slot->size);
+		slot->buff = smalloc(slot->buffSize);
+	}
+	
+	pool->ids = smalloc(thread_num * sizeof(pthread_t));
+	for(i = 0; i < thread_num; ++i) {
+		if((errno = pthread_create(pool->ids + i, NULL, &consPool_format, pool))) {
+			ERROR();
 		}
 	}
-	/* Prepare consensus */
-	if(ref_fsa == 0) {
-		for(i = 0, bias = 0; i < aln_len; ++i, ++bias) {
-			aligned_assem->q[bias] = aligned_assem->q[i];
-			if(aligned_assem->q[i] == '-') {
-				--bias;
-			}
+	if((errno = pthread_create(&pool->writer, NULL, &consPool_write, pool))) {
+		ERROR();
+	}
+	
+	return pool;
+}
+
+void * consPool_format(void *arg) {
+	
+	int n;
+	char *next;
+	ConsPool *pool = arg;
+	ConsSlot *slot;
+	volatile int *excludeIn = &pool->excludeIn;
+	
+	while(1) {
+		/* claim filled templates, in order */
+		lock(excludeIn);
+		slot = pool->slots + (pool->formatted % pool->size);
+		wait_idle(slot->status != 1 && !pool->stop);
+		if(slot->status != 1) {
+			unlock(excludeIn);
+			break;
 		}
-		aln_len = bias;
-		aligned_assem->q[aln_len] = 0;
-	} else if(ref_fsa == 1) {
-		for(i = 0; i < aln_len; ++i) {
-			if(aligned_assem->q[i] == '-') {
-				aligned_assem->q[i] = 'n';
-			}
+		slot->status = 2;
+		++pool->formatted;
+		unlock(excludeIn);
+		
+		/* alignment and consensus share the block of the slot */
+		n = consensusSize(slot->header, slot->len) << 1;
+		if(slot->buffSize < n) {
+			free(slot->buff);
+			slot->buffSize = n << 1;
+			slot->buff = smalloc(slot->buffSize);
 		}
+		next = slot->buff;
+		if(pool->alignment_out) {
+			next = formatAln(next, slot->header, slot->t, slot->s, slot->q, slot->len);
+		}
+		slot->alnLen = next - slot->buff;
+		next = formatFsa(next, slot->header, slot->q, slot->len, pool->ref_fsa);
+		slot->fsaLen = next - slot->buff - slot->alnLen;
+		__sync_synchronize();
+		slot->status = 3;
 	}
 	
-	/* Print consensus */
-	fprintf(consensus_out, ">%s\n", header);
-	for(i = 0; i < aln_len; i += 60) {
-		fprintf(consensus_out, "%.60s\n", aligned_assem->q + i);
+	return NULL;
+}
+
+void * consPool_write(void *arg) {
+	
+	ConsPool *pool = arg;
+	ConsSlot *slot;
+	
+	/* write formatted templates in order, off the producing threads */
+	while(1) {
+		slot = pool->slots + (pool->written % pool->size);
+		wait_idle(slot->status != 3 && !pool->stop);
+		if(slot->status != 3) {
+			break;
+		}
+		if(slot->alnLen) {
+			sfwrite(slot->buff, 1, slot->alnLen, pool->alignment_out);
+		}
+		sfwrite(slot->buff + slot->alnLen, 1, slot->fsaLen, pool->consensus_out);
+		__sync_synchronize();
+		slot->status = 0;
+		++pool->written;
+	}
+	
+	return NULL;
+}
+
+void consPush(ConsPool *pool, Assem *aligned_assem, char *header) {
+	
+	int len;
+	ConsSlot *slot;
+	
+	/* trim here, as later output reads the trimmed alignment */
+	trimConsensus(aligned_assem);
+	
+	/* wait for a free slot */
+	slot = pool->slots + (pool->filled % pool->size);
+	wait_atomic(slot->status);
+	
+	/* copy the alignment, as aligned_assem is reused */
+	len = strlen(header) + 1;
+	if(slot->nameSize < len) {
+		free(slot->header);
+		slot->nameSize = len << 1;
+		slot->header = smalloc(slot->nameSize);
+	}
+	memcpy(slot->header, header, len);
+	len = aligned_assem->len + 1;
+	if(slot->size < len) {
+		free(slot->t);
+		free(slot->s);
+		free(slot->q);
+		slot->size = len << 1;
+		slot->t = smalloc(slot->size);
+		slot->s = smalloc(slot->size);
+		slot->q = smalloc(slot->size);
+	}
+	memcpy(slot->t, aligned_assem->t, len);
+	memcpy(slot->s, aligned_assem->s, len);
+	memcpy(slot->q, aligned_assem->q, len);
+	slot->len = aligned_assem->len;
+	
+	__sync_synchronize();
+	slot->status = 1;
+	++pool->filled;
+}
+
+void consPool_close(ConsPool *pool) {
+	
+	int i;
+	ConsSlot *slot;
+	
+	/* drain */
+	wait_atomic(pool->written != pool->filled);
+	pool->stop = 1;
+	for(i = 0; i < pool->thread_num; ++i) {
+		if((errno = pthread_join(pool->ids[i], NULL))) {
+			ERROR();
+		}
+	}
+	if((errno = pthread_join(pool->writer, NULL))) {
+		ERROR();
+	}
+	
+	for(i = 0, slot = pool->slots; i < pool->size; ++i, ++slot) {
+		free(slot->header);
+		free(slot->t);
+		free(slot->s);
+		free(slot->q);
+		free(slot->buff);
 	}
+	free(pool->slots);
+	free(pool->ids);
+	free(pool);
 }
@@ -17,7 +17,51 @@
  * limitations under the License.
 */
 #define _XOPEN_SOURCE 600
+#include <pthread.h>
 #include <stdio.h>
 #include "assembly.h"
 
+#ifndef PRINTCONSENSUS
+typedef struct consSlot ConsSlot;
+typedef struct consPool ConsPool;
+struct consSlot {
+	volatile int status; /* 0 free, 1 filled, 2 formatting, 3 formatted */
+	int len;
+	int size;
+	int nameSize;
+	int buffSize;
+	int alnLen;
+	int fsaLen;
+	char *header;
+	unsigned char *t;
+	char *s;
+	unsigned char *q;
+	char *buff;
+};
+
+struct consPool {
+	int thread_num;
+	int size;
+	int ref_fsa;
+	volatile int stop;
+	volatile int excludeIn;
+	long unsigned filled;
+	long unsigned formatted;
+	volatile long unsigned written;
+	FILE *alignment_out;
+	FILE *consensus_out;
+	ConsSlot *slots;
+	pthread_t *ids;
+	pthread_t writer;
+};
+#define PRINTCONSENSUS 1
+#endif
+
 void printConsensus(Assem *aligned_assem, char *header, FILE *alignment_out, FILE *consensus_out, int ref_fsa);
+/* alignments are copied in by the main thread, rendered in parallel, and
+   written in template order by a dedicated thread */
+ConsPool * consPool_init(FILE *alignment_out, FILE *consensus_out, int ref_fsa, int thread_num);
+void * consPool_format(void *arg);
+void * consPool_write(void *arg);
+void consPush(ConsPool *pool, Assem *aligned_assem, char *header);
+void consPool_close(ConsPool *pool);
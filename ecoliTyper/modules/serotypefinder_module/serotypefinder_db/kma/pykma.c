@@ -0,0 +1,302 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+/* Python.h sets the feature test macros, and has to come first */
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#undef _XOPEN_SOURCE
+#include "kma.h"
+#include "kmactx.h"
+
+typedef struct hitList HitList;
+struct hitList {
+	int n;
+	int size;
+	KmaHit *hits;
+};
+
+static PyStructSequence_Field hitFields[] = {
+	{"template", "Template name"},
+	{"score", "Score"},
+	{"expected", "Expected score"},
+	{"template_length", "Template length"},
+	{"template_identity", "Template identity"},
+	{"template_coverage", "Template coverage"},
+	{"query_identity", "Query identity"},
+	{"query_coverage", "Query coverage"},
+	{"depth", "Depth"},
+	{"q_value", "q-value"},
+	{"p_value", "p-value"},
+	{0, 0}
+};
+
+static PyStructSequence_Desc hitDesc = {
+	"pykma.Hit",
+	"A line of *.res",
+	hitFields,
+	11
+};
+
+static PyTypeObject *HitType = 0;
+
+static void collectHit(void *arg, const KmaHit *hit) {
+	
+	HitList *dest = arg;
+	KmaHit *hits;
+	
+	/* called by runKMA without the GIL, so only C is touched here */
+	if(dest->n == dest->size) {
+		dest->size = dest->size ? dest->size << 1 : 64;
+		hits = realloc(dest->hits, dest->size * sizeof(KmaHit));
+		if(!hits) {
+			dest->size = dest->n;
+			return;
+		}
+		dest->hits = hits;
+	}
+	if((dest->hits[dest->n].name = strdup(hit->name))) {
+		dest->hits[dest->n].score = hit->score;
+		dest->hits[dest->n].expected = hit->expected;
+		dest->hits[dest->n].t_len = hit->t_len;
+		dest->hits[dest->n].id = hit->id;
+		dest->hits[dest->n].cover = hit->cover;
+		dest->hits[dest->n].q_id = hit->q_id;
+		dest->hits[dest->n].q_cover = hit->q_cover;
+		dest->hits[dest->n].depth = hit->depth;
+		dest->hits[dest->n].q_value = hit->q_value;
+		dest->hits[dest->n].p_value = hit->p_value;
+		++dest->n;
+	}
+}
+
+static PyObject * hitTuple(const KmaHit *hit) {
+	
+	PyObject *dest;
+	
+	if(!(dest = PyStructSequence_New(HitType))) {
+		return 0;
+	}
+	PyStructSequence_SET_ITEM(dest, 0, PyUnicode_FromString(hit->name));
+	PyStructSequence_SET_ITEM(dest, 1, PyLong_FromLong(hit->score));
+	PyStructSequence_SET_ITEM(dest, 2, PyLong_FromUnsignedLong(hit->expected));
+	PyStructSequence_SET_ITEM(dest, 3, PyLong_FromLong(hit->t_len));
+	PyStructSequence_SET_ITEM(dest, 4, PyFloat_FromDouble(hit->id));
+	PyStructSequence_SET_ITEM(dest, 5, PyFloat_FromDouble(hit->cover));
+	PyStructSequence_SET_ITEM(dest, 6, PyFloat_FromDouble(hit->q_id));
+	PyStructSequence_SET_ITEM(dest, 7, PyFloat_FromDouble(hit->q_cover));
+	PyStructSequence_SET_ITEM(dest, 8, PyFloat_FromDouble(hit->depth));
+	PyStructSequence_SET_ITEM(dest, 9, PyFloat_FromDouble(hit->q_value));
+	PyStructSequence_SET_ITEM(dest, 10, PyFloat_FromDouble(hit->p_value));
+	if(PyErr_Occurred()) {
+		Py_DECREF(dest);
+		return 0;
+	}
+	
+	return dest;
+}
+
+static int checkDB(const char *t_db) {
+	
+	static const char *suffixes[] = {".comp.b", ".length.b", ".name", ".seq.b", 0};
+	const char **suffix;
+	char *filename;
+	struct stat st;
+	
+	/* kma exits the process on a missing DB, so check it here first */
+	if(!*t_db) {
+		PyErr_SetString(PyExc_ValueError, "empty t_db");
+		return 1;
+	} else if(!(filename = malloc(strlen(t_db) + 16))) {
+		PyErr_NoMemory();
+		return 1;
+	}
+	for(suffix = suffixes; *suffix; ++suffix) {
+		sprintf(filename, "%s%s", t_db, *suffix);
+		if(stat(filename, &st) || access(filename, R_OK)) {
+			PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+			free(filename);
+			return 1;
+		} else if(!S_ISREG(st.st_mode) || st.st_size == 0) {
+			PyErr_Format(PyExc_ValueError, "not a KMA database file: %s", filename);
+			free(filename);
+			return 1;
+		}
+	}
+	free(filename);
+	
+	return 0;
+}
+
+static int muteStderr(void) {
+	
+	int saved, devnull;
+	
+	/* send the log of kma to /dev/null, returning the fd to restore */
+	fflush(stderr);
+	if((saved = dup(2)) < 0) {
+		return -1;
+	} else if((devnull = open("/dev/null", O_WRONLY)) < 0) {
+		close(saved);
+		return -1;
+	}
+	dup2(devnull, 2);
+	close(devnull);
+	
+	return saved;
+}
+
+static void unmuteStderr(int saved) {
+	
+	if(0 <= saved) {
+		fflush(stderr);
+		dup2(saved, 2);
+		close(saved);
+	}
+}
+
+static PyObject * pykma_map(PyObject *self, PyObject *args, PyObject *kwds) {
+	
+	static char *kwlist[] = {"fsa", "t_db", "name", "options", "verbose", 0};
+	int i, argc, optc, status, verbose, saved;
+	char *t_db, *name, **argv;
+	const char *fsa;
+	Py_ssize_t size;
+	HitList hits;
+	PyObject *options, *opts, *dest, *hit;
+	
+	/* get input */
+	name = "sample";
+	options = 0;
+	verbose = 0;
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "s#s|sOp", kwlist, &fsa, &size, &t_db, &name, &options, &verbose)) {
+		return 0;
+	} else if(size == 0) {
+		PyErr_SetString(PyExc_ValueError, "empty input");
+		return 0;
+	} else if(checkDB(t_db)) {
+		return 0;
+	}
+	if(options) {
+		if(!(opts = PySequence_Fast(options, "options must be a sequence of strings"))) {
+			return 0;
+		}
+		optc = PySequence_Fast_GET_SIZE(opts);
+	} else {
+		opts = 0;
+		optc = 0;
+	}
+	
+	/* kma -i name -o name -t_db t_db -nc -nf options... */
+	argc = 0;
+	if(!(argv = malloc((9 + optc) * sizeof(char *)))) {
+		Py_XDECREF(opts);
+		return PyErr_NoMemory();
+	}
+	argv[argc++] = "kma";
+	argv[argc++] = "-i";
+	argv[argc++] = name;
+	argv[argc++] = "-o";
+	argv[argc++] = name;
+	argv[argc++] = "-t_db";
+	argv[argc++] = t_db;
+	argv[argc++] = "-nc";
+	argv[argc++] = "-nf";
+	for(i = 0; i < optc; ++i) {
+		if(!(argv[argc++] = (char *) PyUnicode_AsUTF8(PySequence_Fast_GET_ITEM(opts, i)))) {
+			free(argv);
+			Py_DECREF(opts);
+			return 0;
+		}
+	}
+	
+	/* map, other Python threads may run meanwhile */
+	hits.n = 0;
+	hits.size = 0;
+	hits.hits = 0;
+	Py_BEGIN_ALLOW_THREADS
+	saved = verbose ? -1 : muteStderr();
+	status = kma_mapFsa(argc, argv, name, fsa, size, &collectHit, &hits);
+	unmuteStderr(saved);
+	Py_END_ALLOW_THREADS
+	free(argv);
+	Py_XDECREF(opts);
+	
+	/* convert hits */
+	dest = status ? 0 : PyList_New(0);
+	for(i = 0; i < hits.n; ++i) {
+		if(dest && (!(hit = hitTuple(hits.hits + i)) || PyList_Append(dest, hit))) {
+			Py_XDECREF(hit);
+			Py_CLEAR(dest);
+		} else if(dest) {
+			Py_DECREF(hit);
+		}
+		free(hits.hits[i].name);
+	}
+	free(hits.hits);
+	if(status && !PyErr_Occurred()) {
+		PyErr_Format(PyExc_RuntimeError, "kma exited with status %d", status);
+	}
+	
+	return dest;
+}
+
+static PyMethodDef pykmaMethods[] = {
+	{"map", (PyCFunction)(void (*)(void)) pykma_map, METH_VARARGS | METH_KEYWORDS,
+	"map(fsa, t_db, name='sample', options=(), verbose=False)\n"
+	"Map the FASTA or FASTQ text fsa against the KMA database t_db,\n"
+	"and return the lines of *.res as a list of Hit.\n"
+	"options are added to the kma command line, e.g. ['-ID', '90'].\n"
+	"The log of kma on stderr is only shown with verbose=True.\n"
+	"A missing or empty database file raises FileNotFoundError or ValueError."},
+	{0, 0, 0, 0}
+};
+
+static struct PyModuleDef pykmaModule = {
+	PyModuleDef_HEAD_INIT,
+	"pykma",
+	"KMA mapping in process, against libkma",
+	-1,
+	pykmaMethods
+};
+
+PyMODINIT_FUNC PyInit_pykma(void) {
+	
+	PyObject *dest;
+	
+	if(!(dest = PyModule_Create(&pykmaModule))) {
+		return 0;
+	}
+	if(!HitType && !(HitType = PyStructSequence_NewType(&hitDesc))) {
+		Py_DECREF(dest);
+		return 0;
+	}
+	Py_INCREF(HitType);
+	if(PyModule_AddObject(dest, "Hit", (PyObject *) HitType)) {
+		Py_DECREF(HitType);
+		Py_DECREF(dest);
+		return 0;
+	}
+	
+	return dest;
+}
@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 #include "pherror.h"
 #include "qc.h"
 
@@ -66,17 +67,17 @@ int rescale_ldist(unsigned *ldist, const int maskold, const int maxlen) {
 
 unsigned * rescale_ldist_v1(unsigned *ldist, const int size, const int maxlen) {
 	
-	unsigned i, *ptr;
+	unsigned *ptr;
 	
 	ptr = realloc(ldist, (maxlen + 4) * sizeof(unsigned));
 	if(!ptr) {
 		ERROR();
 	}
 	ldist = ptr;
-	i = maxlen;
-	ptr += size - 1;
-	while(i <= size) {
-		*++ptr = 0;
+	
+	/* clear the new tail, lengths up to size are already counted */
+	if(size < maxlen) {
+		memset(ldist + size + 1, 0, (maxlen - size + 3) * sizeof(unsigned));
 	}
 	
 	return ldist;
@@ -99,10 +100,57 @@ void update_QCstat(QCstat *src, int len, int gc, int ns, double sp) {
 		}
 		src->maxlen = len;
 	}
-	src->qdist[(int)(ceil(-10 * log10(sp / len)))]++;
+	if(sp) {
+		src->qdist[(int)(ceil(-10 * log10(sp / len)))]++;
+	}
 	src->ldist[len >> src->qresolution]++;
 }
 
+void merge_QCstat(QCstat *dest, QCstat *src) {
+	
+	int i, mask;
+	unsigned *ptr;
+	
+	/* add counts */
+	dest->count += src->count;
+	dest->org_count += src->org_count;
+	dest->bpcount += src->bpcount;
+	dest->org_bpcount += src->org_bpcount;
+	dest->totgc += src->totgc;
+	dest->totns += src->totns;
+	dest->Eeq += src->Eeq;
+	for(i = 0; i < 256; ++i) {
+		dest->qdist[i] += src->qdist[i];
+	}
+	
+	/* add length distribution at the coarsest resolution */
+	if(dest->verbose) {
+		if(dest->maxlen < src->maxlen) {
+			dest->ldist = rescale_ldist_v1(dest->ldist, dest->maxlen, src->maxlen);
+		}
+		for(i = 0; i <= src->maxlen; ++i) {
+			dest->ldist[i] += src->ldist[i];
+		}
+	} else {
+		if(dest->qresolution < src->qresolution) {
+			mask = src->qresolution - dest->qresolution;
+			ptr = dest->ldist;
+			for(i = 1; i < 512; ++i) {
+				dest->ldist[i >> mask] += *++ptr;
+				*ptr = 0;
+			}
+			dest->qresolution = src->qresolution;
+		}
+		mask = dest->qresolution - src->qresolution;
+		for(i = 0; i < 512; ++i) {
+			dest->ldist[i >> mask] += src->ldist[i];
+		}
+	}
+	if(dest->maxlen < src->maxlen) {
+		dest->maxlen = src->maxlen;
+	}
+}
+
 /* adapter trim */
 /*
 SE, both ends (unless sr)
@@ -45,4 +45,5 @@ QCstat * init_QCstat(int verbose);
 void destroy_QCstat(QCstat *src);
 int rescale_ldist(unsigned *ldist, const int maskold, const int maxlen);
 void update_QCstat(QCstat *src, int len, int gc, int ns, double sp);
+void merge_QCstat(QCstat *dest, QCstat *src);
 int print_QCstat(QCstat *src, int minQ, int minPhred, int minmaskQ, int minlen, int maxlen, int fiveClip, int threeClip, FILE *dest);
@@ -0,0 +1,91 @@
+/* Philip T.L.C. Clausen Sep 2021 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2021, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pherror.h"
+#include "qpack.h"
+#ifdef _WIN32
+#define mmap(addr, len, prot, flags, fd, offset) (MAP_FAILED)
+#define munmap(addr, len) (-1)
+#define posix_madvise(addr, len, advice) (0)
+#define MAP_FAILED ((void *) -1)
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+void qpackOpen(FILE *out) {
+	
+	long unsigned count;
+	
+	/* the count is filled in on close */
+	count = 0;
+	sfwrite(QPACK_MAGIC, 1, 8, out);
+	sfwrite(&count, sizeof(long unsigned), 1, out);
+}
+
+void qpackClose(FILE *out, long unsigned count) {
+	
+	sfseek(out, 8, SEEK_SET);
+	sfwrite(&count, sizeof(long unsigned), 1, out);
+	fflush(out);
+}
+
+long unsigned qpackLoad(char *filename, FILE *out) {
+	
+	long unsigned count, size, len;
+	char magic[8], *buffer;
+	unsigned char *map;
+	FILE *infile;
+	#ifndef _WIN32
+	struct stat st;
+	#endif
+	
+	infile = sfopen(filename, "rb");
+	if(fread(magic, 1, 8, infile) != 8 || memcmp(magic, QPACK_MAGIC, 8) != 0 || fread(&count, sizeof(long unsigned), 1, infile) != 1) {
+		fprintf(stderr, "Not a packed query file:\t%s\n", filename);
+		exit(1);
+	}
+	
+	/* the records are already in the form the mapping reads */
+	map = MAP_FAILED;
+	size = 0;
+	#ifndef _WIN32
+	if(fstat(fileno(infile), &st) == 0 && S_ISREG(st.st_mode) && 16 < st.st_size) {
+		size = st.st_size;
+		map = mmap(0, size, PROT_READ, MAP_PRIVATE, fileno(infile), 0);
+	}
+	#endif
+	if(map != MAP_FAILED) {
+		posix_madvise(map, size, POSIX_MADV_SEQUENTIAL);
+		sfwrite(map + 16, 1, size - 16, out);
+		munmap(map, size);
+	} else {
+		buffer = smalloc(1048576);
+		while((len = fread(buffer, 1, 1048576, infile))) {
+			sfwrite(buffer, 1, len, out);
+		}
+		free(buffer);
+	}
+	fclose(infile);
+	
+	return count;
+}
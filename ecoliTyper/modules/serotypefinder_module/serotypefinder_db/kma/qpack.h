@@ -0,0 +1,36 @@
+/* Philip T.L.C. Clausen Sep 2021 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2021, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#ifndef QPACK
+#define QPACK 1
+#include <stdio.h>
+
+/*
+ * Packed queries, the converted input stream of kma saved to a file:
+ * magic "KMAqpak\1", u64 number of fragments, then the records as
+ * written by printFsa and printFsa_pair. "kma trim -pack" writes them,
+ * and "kma -ipk" hands them to the mapping without parsing the input.
+ */
+#define QPACK_MAGIC "KMAqpak\1"
+
+void qpackOpen(FILE *out);
+void qpackClose(FILE *out, long unsigned count);
+long unsigned qpackLoad(char *filename, FILE *out);
+
+#endif
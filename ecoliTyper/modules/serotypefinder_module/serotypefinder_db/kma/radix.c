@@ -0,0 +1,340 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pherror.h"
+#include "radix.h"
+#include "stdstat.h"
+#include "tmp.h"
+
+static inline long unsigned radixKey(long unsigned key, unsigned flag, unsigned width) {
+	
+	long unsigned index;
+	
+	if(flag) {
+		murmur(index, key);
+	} else {
+		index = key;
+	}
+	
+	/* reverse bits, so the buckets of any table size are contiguous */
+	index = __builtin_bswap64(index);
+	index = ((index >> 4) & 0x0F0F0F0F0F0F0F0F) | ((index & 0x0F0F0F0F0F0F0F0F) << 4);
+	index = ((index >> 2) & 0x3333333333333333) | ((index & 0x3333333333333333) << 2);
+	index = ((index >> 1) & 0x5555555555555555) | ((index & 0x5555555555555555) << 1);
+	
+	return index >> (64 - width);
+}
+
+KmerPairs * kmerPairs_init(long unsigned size, unsigned mlen, unsigned flag) {
+	
+	KmerPairs *dest;
+	
+	dest = smalloc(sizeof(KmerPairs));
+	dest->n = 0;
+	dest->size = size;
+	dest->keys = smalloc(size * sizeof(long unsigned));
+	dest->values = smalloc(size * sizeof(unsigned));
+	dest->max = 0;
+	dest->total = 0;
+	dest->width = flag ? 64 : (mlen << 1);
+	dest->flag = flag;
+	dest->part_bits = 0;
+	dest->parts = 0;
+	
+	return dest;
+}
+
+void kmerPairs_budget(KmerPairs *src, long unsigned budget, unsigned part_bits) {
+	
+	/* pairs and the scratch space of the sort */
+	src->max = budget / (2 * (sizeof(long unsigned) + sizeof(unsigned)));
+	src->part_bits = part_bits;
+}
+
+void kmerPairs_grow(KmerPairs *src, long unsigned n) {
+	
+	if(src->size < n) {
+		while(src->size < n) {
+			src->size <<= 1;
+		}
+		if(src->max && src->max < src->size) {
+			src->size = src->max < n ? n : src->max;
+		}
+		src->keys = realloc(src->keys, src->size * sizeof(long unsigned));
+		src->values = realloc(src->values, src->size * sizeof(unsigned));
+		if(!src->keys || !src->values) {
+			ERROR();
+		}
+	}
+}
+
+void kmerPairs_spill(KmerPairs *src) {
+	
+	int i;
+	unsigned shift, *values;
+	long unsigned n, *keys;
+	FILE *part;
+	
+	/* open partitions */
+	if(!src->parts) {
+		src->parts = smalloc((1 << src->part_bits) * sizeof(FILE *));
+		for(i = 0; i < (1 << src->part_bits); ++i) {
+			if(!(src->parts[i] = tmpF(0))) {
+				fprintf(stderr, "Could not create tmp files.\n");
+				ERROR();
+			}
+		}
+	}
+	
+	/* move pairs to their partition, keeping the template order */
+	keys = src->keys;
+	values = src->values;
+	shift = src->width - src->part_bits;
+	for(n = src->n; n; --n) {
+		part = src->parts[radixKey(*keys, src->flag, src->width) >> shift];
+		cfwrite(keys++, sizeof(long unsigned), 1, part);
+		cfwrite(values++, sizeof(unsigned), 1, part);
+	}
+	src->total += src->n;
+	src->n = 0;
+}
+
+int kmerPairs_load(KmerPairs *src, int part) {
+	
+	long unsigned n, *keys;
+	unsigned *values;
+	FILE *file;
+	
+	if(!src->parts) {
+		/* everything is in memory */
+		return part == 0;
+	} else if((1 << src->part_bits) <= part) {
+		return 0;
+	}
+	
+	/* read partition */
+	file = src->parts[part];
+	fseeko(file, 0, SEEK_END);
+	n = ftello(file) / (sizeof(long unsigned) + sizeof(unsigned));
+	rewind(file);
+	src->n = 0;
+	kmerPairs_grow(src, n);
+	keys = src->keys;
+	values = src->values;
+	for(src->n = n; n; --n) {
+		if(fread(keys++, sizeof(long unsigned), 1, file) != 1 || fread(values++, sizeof(unsigned), 1, file) != 1) {
+			ERROR();
+		}
+	}
+	rewind(file);
+	
+	return 1;
+}
+
+void kmerPairs_destroy(KmerPairs *src) {
+	
+	int i;
+	
+	if(src->parts) {
+		for(i = 0; i < (1 << src->part_bits); ++i) {
+			fclose(src->parts[i]);
+		}
+		free(src->parts);
+	}
+	free(src->keys);
+	free(src->values);
+	free(src);
+}
+
+void * radixPass_thread(void *arg) {
+	
+	RadixThread *thread = arg;
+	unsigned flag, width, shift, *values, *dvalues;
+	long unsigned i, end, pos, *counts, *keys, *dkeys;
+	KmerPairs *src;
+	
+	src = thread->src;
+	i = src->n * thread->num / thread->thread_num;
+	end = src->n * (thread->num + 1) / thread->thread_num;
+	keys = src->keys;
+	values = src->values;
+	flag = src->flag;
+	width = src->width;
+	shift = thread->shift;
+	counts = thread->counts;
+	
+	if(thread->scatter) {
+		/* move pairs to their offsets, stable within the digit */
+		dkeys = thread->keys;
+		dvalues = thread->values;
+		for(; i < end; ++i) {
+			pos = counts[(radixKey(keys[i], flag, width) >> shift) & 255]++;
+			dkeys[pos] = keys[i];
+			dvalues[pos] = values[i];
+		}
+	} else {
+		/* count digits */
+		memset(counts, 0, 256 * sizeof(long unsigned));
+		for(; i < end; ++i) {
+			++counts[(radixKey(keys[i], flag, width) >> shift) & 255];
+		}
+	}
+	
+	return NULL;
+}
+
+static void radixRun(RadixThread *threads, int thread_num, int scatter) {
+	
+	int i;
+	
+	/* thread out */
+	for(i = thread_num - 1; 0 <= i; --i) {
+		threads[i].scatter = scatter;
+		threads[i].id = 0;
+		if(i && (errno = pthread_create(&threads[i].id, NULL, &radixPass_thread, threads + i))) {
+			fprintf(stderr, "Error: %d (%s)\n", errno, strerror(errno));
+			ERROR();
+		}
+	}
+	
+	/* start main thread */
+	radixPass_thread(threads);
+	
+	/* join threads */
+	for(i = 1; i < thread_num; ++i) {
+		if((errno = pthread_join(threads[i].id, NULL))) {
+			ERROR();
+		}
+	}
+}
+
+static void radixSort(KmerPairs *src, int thread_num) {
+	
+	int i, digit, swaps;
+	unsigned shift, *values, *values_tmp;
+	long unsigned pos, count, *keys, *keys_tmp;
+	RadixThread *threads;
+	
+	if(src->n < 2) {
+		return;
+	}
+	
+	/* allocate */
+	keys = smalloc(src->n * sizeof(long unsigned));
+	values = smalloc(src->n * sizeof(unsigned));
+	threads = smalloc(thread_num * sizeof(RadixThread));
+	for(i = 0; i < thread_num; ++i) {
+		threads[i].num = i;
+		threads[i].thread_num = thread_num;
+		threads[i].src = src;
+	}
+	
+	/* lsd radix sort on the reversed hash, keeping the template order */
+	swaps = 0;
+	for(shift = 0; shift < src->width; shift += 8) {
+		for(i = 0; i < thread_num; ++i) {
+			threads[i].shift = shift;
+		}
+		radixRun(threads, thread_num, 0);
+		
+		/* skip passes with a single digit */
+		for(digit = 0, count = 0; !count; ++digit) {
+			for(i = 0; i < thread_num; ++i) {
+				count += threads[i].counts[digit];
+			}
+		}
+		if(count == src->n) {
+			continue;
+		}
+		
+		/* get offsets */
+		pos = 0;
+		for(digit = 0; digit < 256; ++digit) {
+			for(i = 0; i < thread_num; ++i) {
+				count = threads[i].counts[digit];
+				threads[i].counts[digit] = pos;
+				pos += count;
+			}
+		}
+		
+		/* scatter */
+		for(i = 0; i < thread_num; ++i) {
+			threads[i].keys = keys;
+			threads[i].values = values;
+		}
+		radixRun(threads, thread_num, 1);
+		keys_tmp = src->keys;
+		src->keys = keys;
+		keys = keys_tmp;
+		values_tmp = src->values;
+		src->values = values;
+		values = values_tmp;
+		swaps ^= 1;
+	}
+	
+	/* keep the allocated buffers */
+	if(swaps) {
+		memcpy(keys, src->keys, src->n * sizeof(long unsigned));
+		memcpy(values, src->values, src->n * sizeof(unsigned));
+		keys_tmp = src->keys;
+		src->keys = keys;
+		keys = keys_tmp;
+		values_tmp = src->values;
+		src->values = values;
+		values = values_tmp;
+	}
+	
+	/* clean */
+	free(keys);
+	free(values);
+	free(threads);
+}
+
+void kmerPairs_sort(KmerPairs *src, int thread_num) {
+	
+	int part;
+	long unsigned n, *keys;
+	unsigned *values;
+	FILE *file;
+	
+	if(!src->parts) {
+		radixSort(src, thread_num);
+		return;
+	}
+	
+	/* sort partitions one at a time, and write them back */
+	kmerPairs_spill(src);
+	for(part = 0; kmerPairs_load(src, part); ++part) {
+		radixSort(src, thread_num);
+		file = src->parts[part];
+		keys = src->keys;
+		values = src->values;
+		for(n = src->n; n; --n) {
+			cfwrite(keys++, sizeof(long unsigned), 1, file);
+			cfwrite(values++, sizeof(unsigned), 1, file);
+		}
+		fflush(file);
+	}
+	src->n = 0;
+}
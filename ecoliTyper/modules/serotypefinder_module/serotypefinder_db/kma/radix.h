@@ -0,0 +1,61 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <pthread.h>
+#include <stdio.h>
+
+#ifndef RADIX
+typedef struct kmerPairs KmerPairs;
+typedef struct radixThread RadixThread;
+
+struct kmerPairs {
+	long unsigned n;		// pairs stored
+	long unsigned size;		// pairs allocated
+	long unsigned *keys;	// k-mers
+	unsigned *values;		// templates
+	long unsigned max;		// pairs allowed in memory, 0 for no limit
+	long unsigned total;	// pairs spilled to partitions
+	unsigned width;			// bits in sort key
+	unsigned flag;			// k-mers are hashed
+	unsigned part_bits;		// partitions, by the low bucket bits
+	FILE **parts;			// on-disk partitions
+};
+
+struct radixThread {
+	pthread_t id;
+	int num;
+	int thread_num;
+	int scatter;
+	unsigned shift;
+	long unsigned counts[256];
+	long unsigned *keys;
+	unsigned *values;
+	KmerPairs *src;
+};
+#define RADIX 1
+#endif
+
+KmerPairs * kmerPairs_init(long unsigned size, unsigned mlen, unsigned flag);
+void kmerPairs_budget(KmerPairs *src, long unsigned budget, unsigned part_bits);
+void kmerPairs_grow(KmerPairs *src, long unsigned n);
+void kmerPairs_spill(KmerPairs *src);
+int kmerPairs_load(KmerPairs *src, int part);
+void kmerPairs_destroy(KmerPairs *src);
+void * radixPass_thread(void *arg);
+void kmerPairs_sort(KmerPairs *src, int thread_num);
@@ -25,6 +25,7 @@
 #include "ef.h"
 #include "hashmapkma.h"
 #include "kmmap.h"
+#include "pack.h"
 #include "pherror.h"
 #include "qseqs.h"
 #include "reassign.h"
@@ -104,7 +105,7 @@ int reassign_template(HashMapKMA *templates, FILE *name_file, int seq_in, int *t
 		
 		/* make file indexes */
 		*seq_indexes = seq_in;
-		seq_indexes[1] = 0;
+		seq_indexes[1] = packStart(seq_in);
 		for(i = 2; i < templates->DB_size; ++i) {
 			seq_indexes[i] = seq_indexes[i - 1] + ((template_lengths[i - 1] >> 5) + 1) * sizeof(long unsigned);
 		}
@@ -636,8 +637,9 @@ int reassign_matrix_bias(AssemInfo *matrix, int bias) {
 	
 	/* reallocate */
 	if(matrix->size <= matrix->len + bias) {
+		len = matrix->size;
 		matrix->size = matrix->len + bias + 1;
-		matrix->assmb = realloc(matrix->assmb, matrix->size * sizeof(Assembly));
+		matrix->assmb = srealloc_tag(MEM_ASSEMBLY, matrix->assmb, len * sizeof(Assembly), matrix->size * sizeof(Assembly));
 	} else if(bias <= 0) {
 		return 0;
 	}
@@ -666,6 +668,7 @@ unsigned reassign_matrix_insertions(AssemInfo *matrix) {
 		if(!matrix->assmb) {
 			ERROR();
 		}
+		memAcc_add(MEM_ASSEMBLY, 1024 * sizeof(Assembly));
 	}
 	
 	/* get next available spot */
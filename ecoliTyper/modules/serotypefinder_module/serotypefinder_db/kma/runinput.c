@@ -16,9 +16,13 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
 */
+#include <errno.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
+#include "ankers.h"
 #include "compdna.h"
 #include "filebuff.h"
 #include "pherror.h"
@@ -26,10 +30,13 @@
 #include "qc.h"
 #include "qseqs.h"
 #include "seqparse.h"
+#include "seqscan.h"
 #include "stdstat.h"
+#include "threader.h"
 
 void (*printFsa_ptr)(Qseqs*, Qseqs*, Qseqs*, CompDNA*, FILE*) = &printFsa;
 void (*printFsa_pair_ptr)(Qseqs*, Qseqs*, Qseqs*, Qseqs*, Qseqs*, Qseqs*, CompDNA*, FILE*) = &printFsa_pair;
+static __thread AnkerBuff *inputBuff = 0; /* private sink of a pooled reader */
 
 unsigned hardmask(unsigned char *seq, unsigned char *qual, int len, const int phredScale, int minQ) {
 	
@@ -55,16 +62,10 @@ unsigned hardmask(unsigned char *seq, unsigned char *qual, int len, const int ph
 
 int gcontent(unsigned char *seq, int len) {
 	
-	int gc;
+	unsigned gc;
 	
-	gc = 0;
-	++len;
-	while(--len) {
-		if(*seq == 1 || *seq == 2) {
-			++gc;
-		}
-		++seq;
-	}
+	/* without a quality limit nothing new is masked */
+	maskQual(seq, seq, len, 0, &gc);
 	
 	return gc;
 }
@@ -94,7 +95,7 @@ double qcstat(const unsigned char *seq, const unsigned char *qual, const int len
 	E(Q) = -10 * log_10(sum(10^(-Q/10)) / |Q|) 
 	*/
 	unsigned i, ns, gc;
-	unsigned char *sptr, *qptr;
+	unsigned char *qptr;
 	double eq;
 	
 	/* init */
@@ -103,17 +104,11 @@ double qcstat(const unsigned char *seq, const unsigned char *qual, const int len
 	eq = 0;
 	
 	/* sum quality scores */
+	ns = maskQual((unsigned char *)(seq), qual, len, hardmaskQ, &gc);
 	i = len + 1;
-	sptr = (unsigned char*)(seq) - 1;
 	qptr = (unsigned char*)(qual) - 1;
 	while(--i) {
 		eq += prob[*++qptr];
-		if(*++sptr == 4 || *qptr < hardmaskQ) {
-			*sptr = 4;
-			++ns;
-		} else if(*sptr == 1 || *sptr == 2) {
-			++gc;
-		}
 	}
 	
 	*GC = gc;
@@ -167,24 +162,15 @@ int phredStat(unsigned char *seq, unsigned char *qual, int len, const double *pr
 		return len;
 	}
 	
-	/* minQ trim */
-	ns = 0;
-	gc = 0;
+	/* minQ trim, masking in one vector pass and summing in read order */
+	ns = maskQual(sptr5, qptr5, len, hardmaskQ, &gc);
 	sp = 0;
 	i = len + 1;
 	--qptr5;
-	--sptr5;
 	while(--i) {
 		sp += prob[*++qptr5];
-		if(*++sptr5 == 4 || *qptr5 < hardmaskQ) {
-			*sptr5 = 4;
-			++ns;
-		} else if(*sptr5 == 1 || *sptr5 == 2) {
-			++gc;
-		}
 	}
 	qptr5 = qual + start;
-	sptr5 = seq + start;
 	
 	/* bi-directional phred trim */
 	minP = pow(10, (-0.1) * minQ);
@@ -421,6 +407,9 @@ long unsigned run_input(char **inputfiles, int fileCount, int minPhred, int hard
 					qual->seq -= start;
 					++count;
 				}
+				if(inputBuff) {
+					ankerBuff_drain(inputBuff, 0);
+				}
 			}
 		} else if(FASTQ & 2) {
 			while(FileBuffgetFsa(inputfile, header, qseq, trans)) {
@@ -435,6 +424,9 @@ long unsigned run_input(char **inputfiles, int fileCount, int minPhred, int hard
 					qseq->seq -= start;
 					++count;
 				}
+				if(inputBuff) {
+					ankerBuff_drain(inputBuff, 0);
+				}
 			}
 		}
 		
@@ -542,6 +534,9 @@ long unsigned run_input_PE(char **inputfiles, int fileCount, int minPhred, int h
 				qual->seq -= start;
 				qseq2->seq -= start2;
 				qual2->seq -= start2;
+				if(inputBuff) {
+					ankerBuff_drain(inputBuff, 0);
+				}
 			}
 		} else if(FASTQ & 2) {
 			while((FileBuffgetFsa(inputfile, header, qseq, trans) | FileBuffgetFsa(inputfile2, header2, qseq2, trans))) {
@@ -553,7 +548,7 @@ long unsigned run_input_PE(char **inputfiles, int fileCount, int minPhred, int h
 				qseq->seq += start;
 				qseq->len = end - start;
 				qseq2->seq += start2;
-				qseq2->len = end - start;
+				qseq2->len = end2 - start2;
 				if(minlen <= len && minlen <= len2) {
 					printFsa_pair_ptr(header, qseq, 0, header2, qseq2, 0, compressor, out);
 					++count;
@@ -566,6 +561,9 @@ long unsigned run_input_PE(char **inputfiles, int fileCount, int minPhred, int h
 				}
 				qseq->seq -= start;
 				qseq2->seq -= start2;
+				if(inputBuff) {
+					ankerBuff_drain(inputBuff, 0);
+				}
 			}
 		}
 		
@@ -674,6 +672,9 @@ long unsigned run_input_INT(char **inputfiles, int fileCount, int minPhred, int
 				qual->seq -= start;
 				qseq2->seq -= start2;
 				qual2->seq -= start2;
+				if(inputBuff) {
+					ankerBuff_drain(inputBuff, 0);
+				}
 			}
 		} else if(FASTQ & 2) {
 			while((FileBuffgetFsa(inputfile, header, qseq, trans) | FileBuffgetFsa(inputfile, header2, qseq2, trans))) {
@@ -685,7 +686,7 @@ long unsigned run_input_INT(char **inputfiles, int fileCount, int minPhred, int
 				qseq->seq += start;
 				qseq->len = end - start;
 				qseq2->seq += start2;
-				qseq2->len = end - start;
+				qseq2->len = end2 - start2;
 				if(minlen <= len && minlen <= len2) {
 					printFsa_pair_ptr(header, qseq, 0, header2, qseq2, 0, compressor, out);
 					++count;
@@ -698,6 +699,9 @@ long unsigned run_input_INT(char **inputfiles, int fileCount, int minPhred, int
 				}
 				qseq->seq -= start;
 				qseq2->seq -= start2;
+				if(inputBuff) {
+					ankerBuff_drain(inputBuff, 0);
+				}
 			}
 		}
 		
@@ -729,6 +733,127 @@ long unsigned run_input_INT(char **inputfiles, int fileCount, int minPhred, int
 	return count;
 }
 
+static void * run_input_thread(void *arg) {
+	
+	int i;
+	long unsigned count;
+	FILE *out;
+	QCstat *qcreport;
+	InputPool *pool = arg;
+	
+	/* reads are drained to the shared stream in whole records */
+	qcreport = pool->qcreport ? init_QCstat(pool->qcreport->verbose) : 0;
+	if(pool->qcreport && !qcreport) {
+		ERROR();
+	} else if((inputBuff = ankerBuff_init(pool->out, &pool->excludeOut))) {
+		out = inputBuff->sink;
+	} else {
+		out = pool->out;
+	}
+	
+	/* take units of files, until there are none left */
+	count = 0;
+	while(1) {
+		lock(&pool->excludeIn);
+		i = pool->next;
+		pool->next += pool->step;
+		unlock(&pool->excludeIn);
+		if(pool->fileCount <= i) {
+			break;
+		}
+		if(!inputBuff) {
+			/* no private sink, keep the stream whole */
+			lock(&pool->excludeOut);
+		}
+		count += pool->runner(pool->inputfiles + i, pool->step, pool->minPhred, pool->hardmaskQ, pool->minQ, pool->fiveClip, pool->threeClip, pool->minlen, pool->maxlen, pool->trans, pool->prob, qcreport, out);
+		if(!inputBuff) {
+			unlock(&pool->excludeOut);
+		}
+	}
+	if(inputBuff) {
+		ankerBuff_destroy(inputBuff);
+		inputBuff = 0;
+	}
+	
+	/* merge counts */
+	lock(&pool->excludeIn);
+	pool->count += count;
+	if(qcreport) {
+		merge_QCstat(pool->qcreport, qcreport);
+		pool->qcreport->fragcount += qcreport->fragcount;
+		pool->qcreport->org_fragcount += qcreport->org_fragcount;
+		if(qcreport->phredScale) {
+			pool->qcreport->phredScale = qcreport->phredScale;
+		}
+		destroy_QCstat(qcreport);
+	}
+	unlock(&pool->excludeIn);
+	
+	return NULL;
+}
+
+long unsigned run_input_pool(long unsigned (*runner)(char**, int, int, int, int, int, int, int, int, char*, const double*, QCstat*, FILE*), char **inputfiles, int fileCount, int step, int minPhred, int hardmaskQ, int minQ, int fiveClip, int threeClip, int minlen, int maxlen, char *trans, const double *prob, QCstat *qcreport, int thread_num, FILE *out) {
+	
+	int i, readers, gzThreads;
+	pthread_t *ids;
+	InputPool pool;
+	
+	/*
+	Units of files (pairs for PE) are read in parallel, each reader
+	feeding whole records to the shared stream. The stateful Mt1
+	printers keep to one reader.
+	*/
+	readers = fileCount / step;
+	if(thread_num < readers) {
+		readers = thread_num;
+	}
+	if(readers <= 1 || printFsa_ptr != &printFsa || printFsa_pair_ptr != &printFsa_pair) {
+		return runner(inputfiles, fileCount, minPhred, hardmaskQ, minQ, fiveClip, threeClip, minlen, maxlen, trans, prob, qcreport, out);
+	}
+	
+	pool.runner = runner;
+	pool.inputfiles = inputfiles;
+	pool.fileCount = fileCount;
+	pool.step = step;
+	pool.next = 0;
+	pool.minPhred = minPhred;
+	pool.hardmaskQ = hardmaskQ;
+	pool.minQ = minQ;
+	pool.fiveClip = fiveClip;
+	pool.threeClip = threeClip;
+	pool.minlen = minlen;
+	pool.maxlen = maxlen;
+	pool.trans = trans;
+	pool.prob = prob;
+	pool.qcreport = qcreport;
+	pool.out = out;
+	pool.excludeIn = 0;
+	pool.excludeOut = 0;
+	pool.count = 0;
+	
+	/* share the inflate threads between the readers */
+	gzThreads = FileBuffThreads(0);
+	FileBuffThreads(gzThreads < readers ? 1 : gzThreads / readers);
+	
+	/* start readers, the calling thread being the last */
+	ids = smalloc(readers * sizeof(pthread_t));
+	for(i = 1; i < readers; ++i) {
+		if((errno = pthread_create(ids + i, NULL, &run_input_thread, &pool))) {
+			fprintf(stderr, "Error: %d (%s)\n", errno, strerror(errno));
+			fprintf(stderr, "Will continue with %d readers.\n", i);
+			readers = i;
+		}
+	}
+	run_input_thread(&pool);
+	for(i = 1; i < readers; ++i) {
+		pthread_join(ids[i], NULL);
+	}
+	free(ids);
+	FileBuffThreads(gzThreads);
+	
+	return pool.count;
+}
+
 void bootFsa(Qseqs *header, Qseqs *qseq, Qseqs *qual, CompDNA *compressor, FILE *out) {
 	
 	int i, end, buffer[4];
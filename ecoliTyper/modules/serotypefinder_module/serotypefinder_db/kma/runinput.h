@@ -17,10 +17,37 @@
  * limitations under the License.
 */
 
+#include <stdio.h>
 #include "compdna.h"
 #include "qc.h"
 #include "qseqs.h"
 
+#ifndef RUNINPUT
+typedef struct inputPool InputPool;
+struct inputPool {
+	long unsigned (*runner)(char**, int, int, int, int, int, int, int, int, char*, const double*, QCstat*, FILE*);
+	char **inputfiles;
+	int fileCount;
+	int step;
+	int next;
+	int minPhred;
+	int hardmaskQ;
+	int minQ;
+	int fiveClip;
+	int threeClip;
+	int minlen;
+	int maxlen;
+	char *trans;
+	const double *prob;
+	QCstat *qcreport;
+	FILE *out;
+	volatile int excludeIn;
+	volatile int excludeOut;
+	long unsigned count;
+};
+#define RUNINPUT 1
+#endif
+
 /* pointers determining how to deliver the input */
 extern void (*printFsa_ptr)(Qseqs*, Qseqs*, Qseqs*, CompDNA*, FILE*);
 extern void (*printFsa_pair_ptr)(Qseqs*, Qseqs*, Qseqs*, Qseqs*, Qseqs*, Qseqs*, CompDNA*, FILE*);
@@ -32,6 +59,7 @@ int phredStat(unsigned char *seq, unsigned char *qual, int len, const double *pr
 long unsigned run_input(char **inputfiles, int fileCount, int minPhred, int hardmaskQ, int minQ, int fiveClip, int threeClip, int minlen, int maxlen, char *trans, const double *prob, QCstat *qcreport, FILE *out);
 long unsigned run_input_PE(char **inputfiles, int fileCount, int minPhred, int hardmaskQ, int minQ, int fiveClip, int threeClip, int minlen, int maxlen, char *trans, const double *prob, QCstat *qcreport, FILE *out);
 long unsigned run_input_INT(char **inputfiles, int fileCount, int minPhred, int hardmaskQ, int minQ, int fiveClip, int threeClip, int minlen, int maxlen, char *trans, const double *prob, QCstat *qcreport, FILE *out);
+long unsigned run_input_pool(long unsigned (*runner)(char**, int, int, int, int, int, int, int, int, char*, const double*, QCstat*, FILE*), char **inputfiles, int fileCount, int step, int minPhred, int hardmaskQ, int minQ, int fiveClip, int threeClip, int minlen, int maxlen, char *trans, const double *prob, QCstat *qcreport, int thread_num, FILE *out);
 void bootFsa(Qseqs *header, Qseqs *qseq, Qseqs *qual, CompDNA *compressor, FILE *out);
 void printFsa(Qseqs *header, Qseqs *qseq, Qseqs *qual, CompDNA *compressor, FILE *out);
 void printFsa_pair(Qseqs *header, Qseqs *qseq, Qseqs *qual, Qseqs *header_r, Qseqs *qseq_r, Qseqs *qual_r, CompDNA *compressor, FILE *out);
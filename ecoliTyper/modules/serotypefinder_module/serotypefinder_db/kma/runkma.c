@@ -27,18 +27,28 @@
 #include "align.h"
 #include "alnfrags.h"
 #include "ankers.h"
+#include "aout.h"
 #include "assembly.h"
+#include "bins.h"
 #include "chain.h"
+#include "ckpt.h"
 #include "compdna.h"
 #include "conclave.h"
+#include "dbmap.h"
 #include "ef.h"
 #include "filebuff.h"
 #include "frags.h"
 #include "hashmapcci.h"
 #include "hashmapkma.h"
+#include "kmactx.h"
 #include "kmapipe.h"
+#include "kmapool.h"
+#include "kmastat.h"
+#include "kmatrace.h"
 #include "kmmap.h"
+#include "numa.h"
 #include "nw.h"
+#include "pack.h"
 #include "penalties.h"
 #include "pherror.h"
 #include "printconsensus.h"
@@ -46,6 +56,7 @@
 #include "reassign.h"
 #include "runkma.h"
 #include "sam.h"
+#include "smat.h"
 #include "stdnuc.h"
 #include "stdstat.h"
 #include "tmp.h"
@@ -134,23 +145,72 @@ char * nameLoad(Qseqs *name, FILE *infile) {
 	return (char *) name->seq;
 }
 
-int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConClave, int kmersize, int minlen, Penalties *rewards, int extendedFeatures, double ID_t, double Depth_t, int mq, double scoreT, double mrc, double minFrac, double evalue, double support, int bcd, int ref_fsa, int print_matrix, int print_all, long unsigned tsv, int vcf, int xml, int sam, int nc, int nf, unsigned shm, int thread_num, int maxFrag, int verbose, unsigned preset) {
+static void streamResults(FILE *res_out, FILE *tsv_out, FILE *alignment_out, FILE *consensus_out) {
 	
-	int i, file_len, template, t_len, end, aln_len, status, sparse, fileCount;
-	int coverScore, seq_in_no, DB_size, counter;
+	/* hand the results of a template on, as soon as it is done */
+	if(res_out) {
+		fflush(res_out);
+	}
+	if(tsv_out) {
+		fflush(tsv_out);
+	}
+	if(alignment_out) {
+		fflush(alignment_out);
+	}
+	if(consensus_out) {
+		fflush(consensus_out);
+	}
+}
+
+static void printRes(FILE *res_out, const KmaContext *ctx, char *name, long score, unsigned expected, int t_len, double id, double cover, double q_id, double q_cover, double depth, double q_value, double p_value) {
+	
+	KmaHit hit;
+	
+	if(res_out) {
+		fprintf(res_out, "%s\t%8ld\t%8u\t%8d\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%4.1e\n", name, score, expected, t_len, id, cover, q_id, q_cover, depth, q_value, p_value);
+	} else {
+		/* handed to the embedding caller */
+		hit.name = name;
+		hit.score = score;
+		hit.expected = expected;
+		hit.t_len = t_len;
+		hit.id = id;
+		hit.cover = cover;
+		hit.q_id = q_id;
+		hit.q_cover = q_cover;
+		hit.depth = depth;
+		hit.q_value = q_value;
+		hit.p_value = p_value;
+		ctx->hitPtr(ctx->hitArg, &hit);
+	}
+}
+
+int runKMA(char *templatefilename, char *outputfilename, char *exePrev, const KmaContext *ctx) {
+	
+	int ConClave, kmersize, minlen, extendedFeatures, mq, bcd, ref_fsa, print_matrix;
+	int print_all, vcf, xml, sam, nc, nf, thread_num, maxFrag, verbose;
+	unsigned shm, preset;
+	long unsigned tsv;
+	double ID_t, Depth_t, scoreT, mrc, minFrac, evalue, support;
+	Penalties *rewards;
+	int i, file_len, template, t_len, aln_len, status, sparse, fileCount;
+	int coverScore, seq_in_no, DB_size, counter, resume;
 	int *bestTemplates, *bestTemplates_r, *best_start_pos, *best_end_pos;
 	int *matched_templates, *template_lengths, *Lengths;
 	unsigned *fragmentCounts, *readCounts;
-	long read_score, *seq_indexes;
+	long read_score, NWsize, *seq_indexes;
 	long unsigned Nhits, template_tot_ulen, seqin_size;
 	long unsigned *w_scores, *uniq_alignment_scores, *alignment_scores, *tseq;
 	double id, q_id, cover, q_cover, p_value;
 	long double depth, expected, q_value;
 	FILE *inputfile, *frag_in_raw, *res_out, *tsv_out, *name_file;
 	FILE *alignment_out, *consensus_out, *frag_out_raw, **template_fragments;
-	FILE *extendedFeatures_out, *xml_out;
+	FILE *extendedFeatures_out, *xml_out, *ckpt, *state;
+	long unsigned timer[STAT_TIMER], t_assem;
 	time_t t0, t1;
 	FileBuff *frag_out, *frag_out_all, *matrix_out, *vcf_out;
+	VcfPool *vcf_pool;
+	ConsPool *cons_pool;
 	Aln *aligned, *gap_align;
 	Assem *aligned_assem;
 	Frag **alignFrags;
@@ -164,6 +224,37 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	HashMapCCI **templates_index;
 	HashMapKMA *templates;
 	
+	/* get parameters and install the alignment dispatch */
+	kmaContext_loadAln(ctx);
+	ConClave = ctx->ConClave;
+	kmersize = ctx->kmersize;
+	minlen = ctx->minlen;
+	rewards = ctx->rewards;
+	extendedFeatures = ctx->extendedFeatures;
+	ID_t = ctx->ID_t;
+	Depth_t = ctx->Depth_t;
+	mq = ctx->mq;
+	scoreT = ctx->scoreT;
+	mrc = ctx->mrc;
+	minFrac = ctx->minFrac;
+	evalue = ctx->evalue;
+	support = ctx->support;
+	bcd = ctx->bcd;
+	ref_fsa = ctx->ref_fsa;
+	print_matrix = ctx->print_matrix;
+	print_all = ctx->print_all;
+	tsv = ctx->tsv;
+	vcf = ctx->vcf;
+	xml = ctx->xml;
+	sam = ctx->sam;
+	nc = ctx->nc;
+	nf = ctx->nf;
+	shm = ctx->shm;
+	thread_num = ctx->thread_num;
+	maxFrag = ctx->maxFrag;
+	verbose = ctx->verbose;
+	preset = ctx->preset;
+	
 	/* init */
 	minFrac = (preset & 16) ? 1.0 : minFrac;
 	
@@ -173,36 +264,45 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	if(!kmersize) {
 		kmersize = *template_lengths;
 	}
+	/* 64 is the bandwidth */
+	NWsize = NWmat_size(template_lengths, DB_size, 64);
 	templatefilename[file_len] = 0;
 	template_name = setQseqs(256);
 	strcat(templatefilename, ".name");
 	name_file = sfopen(templatefilename, "rb");
 	templatefilename[file_len] = 0;
+	dbMapNames(templatefilename, DB_size);
 	
 	/* print sam-header */
 	if(sam) {
 		saminit(template_name, name_file, template_lengths, DB_size, exePrev);
 	}
 	
-	/* open pipe */
+	/* open pipe, ankers are streamed from the concurrently running mapping */
 	status = 0;
-	inputfile = kmaPipe("-s2", "rb", 0, 0);
+	resume = 0;
+	ckpt = ctx->resume ? ckptOpen(outputfilename, ctx->resume, DB_size, &resume) : 0;
+	state = ctx->incr ? ckptStateOpen(ctx->incr, ctx->incrKey, DB_size) : 0;
+	if(ckpt) {
+		/* resumed, the stages before the checkpoint see no reads */
+		inputfile = tmpM(0);
+	} else {
+		inputfile = kmaPipe("-s2", "rb", 0, 0);
+	}
 	if(!inputfile) {
 		ERROR();
 	} else {
 		setvbuf(inputfile, NULL, _IOFBF, CHUNK);
+		get_ankers(0, 0, 0, 0, 0);
 	}
 	
 	/* load databases */
 	strcat(templatefilename, ".seq.b");
-	seq_in_no = open(templatefilename, O_RDONLY);
+	seq_in_no = packOpen(templatefilename, &seqin_size);
 	if(seq_in_no == -1) {
 		ERROR();
 	}
-	seqin_size = 4 * lseek(seq_in_no, 0, SEEK_END);
-	if(lseek(seq_in_no, 0, SEEK_SET) != 0) {
-		ERROR();
-	}
+	seqin_size *= 4;
 	/*
 	seq_in = sfopen(templatefilename, "rb");
 	sfseek(seq_in, 0, SEEK_END);
@@ -215,7 +315,7 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	if(!templates_index) {
 		ERROR();
 	}
-	alignLoadPtr = &alignLoad_fly;
+	alignLoadPtr = dbMapSeq(templatefilename, seq_in_no) ? &alignLoad_fly : &alignLoad_map;
 	if(kmersize < 4 || 31 < kmersize) {
 		kmersize = 16;
 	}
@@ -225,19 +325,23 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	seq_indexes = smalloc((DB_size + 1) * sizeof(long));
 	/* make file indexes of template indexing */
 	*seq_indexes = seq_in_no;
-	seq_indexes[1] = 0;
+	seq_indexes[1] = packStart(seq_in_no);
 	for(i = 2; i < DB_size; ++i) {
 		seq_indexes[i] = seq_indexes[i - 1] + ((template_lengths[i - 1] >> 5) + 1) * sizeof(long unsigned);
 	}
 	
 	/* open outputfiles */
 	if(outputfilename) {
-		strcat(outputfilename, ".res");
-		res_out = sfopen(outputfilename, "w");
-		outputfilename[file_len] = 0;
+		if(ctx->hitPtr) {
+			res_out = 0;
+		} else {
+			strcat(outputfilename, ".res");
+			res_out = outFopenPtr(outputfilename, "w");
+			outputfilename[file_len] = 0;
+		}
 		if(tsv) {
 			strcat(outputfilename, ".tsv");
-			tsv_out = sfopen(outputfilename, "w");
+			tsv_out = outFopenPtr(outputfilename, "w");
 			outputfilename[file_len] = 0;
 		} else {
 			tsv_out = 0;
@@ -254,25 +358,28 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 		consensus_out = 0;
 		if(nc == 0) {
 			strcat(outputfilename, ".aln");
-			alignment_out = sfopen(outputfilename, "w");
+			alignment_out = outFopenPtr(outputfilename, "w");
 			outputfilename[file_len] = 0;
 			strcat(outputfilename, ".fsa");
-			consensus_out = sfopen(outputfilename, "w");
+			consensus_out = outFopenPtr(outputfilename, "w");
 			outputfilename[file_len] = 0;
 		} else if((nc & 1) == 0) {
 			strcat(outputfilename, ".fsa");
-			consensus_out = sfopen(outputfilename, "w");
+			consensus_out = outFopenPtr(outputfilename, "w");
 			outputfilename[file_len] = 0;
 		}
 		
-		frag_out_raw = tmpF(0);
+		frag_out_raw = tmpM(0);
 		if(!frag_out_raw) {
 			ERROR();
 		}
 		if(print_matrix) {
 			matrix_out = gzInitFileBuff(CHUNK);
-			strcat(outputfilename, ".mat.gz");
+			strcat(outputfilename, print_matrix == 2 ? ".smat.gz" : ".mat.gz");
 			openFileBuff(matrix_out, outputfilename, "wb");
+			if(print_matrix == 2) {
+				initSparseMatrix(matrix_out);
+			}
 			outputfilename[file_len] = 0;
 		} else {
 			matrix_out = 0;
@@ -300,6 +407,7 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	
 	fprintf(stderr, "# Running KMA.\n");
 	t0 = clock();
+	kmaStat_start(timer);
 	
 	/* allocate stuff */
 	i = 1;
@@ -318,15 +426,7 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 		allocComp(qseq_r_comp, 1024);
 		
 		/* allocate matrcies for NW */
-		NWmatrices = smalloc(sizeof(NWmat));
-		NWmatrices->NW_s = 1024 * 1024;
-		NWmatrices->NW_q = 1024;
-		NWmatrices->E = smalloc(NWmatrices->NW_s);
-		NWmatrices->D[0] = smalloc((NWmatrices->NW_q << 1) * sizeof(int));
-		NWmatrices->P[0] = smalloc((NWmatrices->NW_q << 1) * sizeof(int));
-		NWmatrices->D[1] = NWmatrices->D[0] + NWmatrices->NW_q;
-		NWmatrices->P[1] = NWmatrices->P[0] + NWmatrices->NW_q;
-		NWmatrices->rewards = rewards;
+		NWmatrices = NWmat_init(1024, NWsize, rewards);
 		
 		/* move it to the thread */
 		alnThread = smalloc(sizeof(Aln_thread));
@@ -365,7 +465,7 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 		
 		
 		/* start thread */
-		if((errno = pthread_create(&alnThread->id, NULL, &alnFrags_threaded, alnThread))) {
+		if((errno = kmaPool_create(&alnThread->id, i, &alnFrags_threaded, alnThread))) {
 			fprintf(stderr, "Error: %d (%s)\n", errno, strerror(errno));
 			fprintf(stderr, "Will continue with %d threads.\n", i);
 			alnThreads = alnThread->next;
@@ -394,15 +494,7 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	points = seedPoint_init(1024, rewards);
 	
 	/* allocate matrcies for NW */
-	NWmatrices = smalloc(sizeof(NWmat));
-	NWmatrices->NW_s = 1024 * 1024;
-	NWmatrices->NW_q = 1024;
-	NWmatrices->E = smalloc(NWmatrices->NW_s);
-	NWmatrices->D[0] = smalloc((NWmatrices->NW_q << 1) * sizeof(int));
-	NWmatrices->P[0] = smalloc((NWmatrices->NW_q << 1) * sizeof(int));
-	NWmatrices->D[1] = NWmatrices->D[0] + NWmatrices->NW_q;
-	NWmatrices->P[1] = NWmatrices->P[0] + NWmatrices->NW_q;
-	NWmatrices->rewards = rewards;
+	NWmatrices = NWmat_init(1024, NWsize, rewards);
 	
 	/* strat main thread */
 	alnThread = smalloc(sizeof(Aln_thread));
@@ -445,15 +537,40 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	/* join threads */
 	for(alnThread = alnThreads; alnThread != 0; alnThread = alnThread->next) {
 		/* join thread */
-		if((errno = pthread_join(alnThread->id, NULL))) {
+		if((errno = kmaPool_join(alnThread->id, NULL))) {
 			ERROR();
 		}
 	}
-	kmaPipe(0, 0, inputfile, &i);
-	status |= i;
-	i = 0;
-	sfwrite(&i, sizeof(int), 1, frag_out_raw);
-	fflush(frag_out_raw);
+	if(ckpt) {
+		fclose(inputfile);
+		ckptLoadScores(ckpt, matched_templates, alignment_scores, uniq_alignment_scores, DB_size);
+		if(resume == 1) {
+			ckptLoadFrags(ckpt, frag_out_raw);
+		}
+	} else {
+		kmaPipe(0, 0, inputfile, &i);
+		status |= i;
+		if(state) {
+			/* reads of earlier runs on the sample */
+			ckptLoadState(state, alignment_scores, uniq_alignment_scores, DB_size, frag_out_raw);
+		}
+		i = 0;
+		sfwrite(&i, sizeof(int), 1, frag_out_raw);
+		fflush(frag_out_raw);
+		if(ctx->incr && !status) {
+			state = ckptStateCreate(ctx->incr, ctx->incrKey, DB_size);
+			ckptSaveScores(state, *matched_templates, alignment_scores, uniq_alignment_scores, DB_size);
+			ckptSaveFrags(state, frag_out_raw);
+			ckptStateCommit(state, ctx->incr);
+		}
+		if(ctx->resume && !status) {
+			ckpt = ckptCreate(outputfilename, 1, ctx->resume, DB_size);
+			ckptSaveScores(ckpt, *matched_templates, alignment_scores, uniq_alignment_scores, DB_size);
+			ckptSaveFrags(ckpt, frag_out_raw);
+			ckptCommit(ckpt, outputfilename, 1);
+			ckpt = 0;
+		}
+	}
 	freeComp(qseq_comp);
 	free(qseq_comp);
 	freeComp(qseq_r_comp);
@@ -472,7 +589,7 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	/* Patricks features */
 	if(extendedFeatures) {
 		strcat(outputfilename, ".mapstat");
-		extendedFeatures_out = sfopen(outputfilename, "wb");
+		extendedFeatures_out = outFopenPtr(outputfilename, "wb");
 		outputfilename[file_len] = 0;
 		initExtendedFeatures(extendedFeatures_out, templatefilename, *matched_templates, exePrev);
 	} else {
@@ -562,14 +679,19 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 		free(alnThread);
 	}
 	
+	kmaStat_wall(STAT_ALIGNMENT, timer);
 	if(kmaPipe == &kmaPipeFork) {
 		t1 = clock();
 		fprintf(stderr, "#\n# KMA mapping time\t%.2f s.\n", difftime(t1, t0) / 1000000);
 	} else {
 		fprintf(stderr, "# KMA mapping done\n");
 	}
+	xDropReport(stderr);
+	fuzzyReport(stderr);
+	nwWindowReport(stderr);
 	fprintf(stderr, "#\n# Sort, output and select KMA alignments.\n");
 	t0 = clock();
+	kmaStat_start(timer);
 	
 	/* Get best template for each mapped read
 	Best hit chosen as: highest mapping score then higest # unique maps */
@@ -596,13 +718,23 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	}
 	
 	/* ConClave */
-	if(ConClave == 1) {
+	fragBins = ctx->bins && resume != 2 ? bins_init(outputfilename, templatefilename, DB_size, ctx->bins == 2) : 0;
+	if(resume == 2) {
+		fileCount = ckptLoadConClave(ckpt, DB_size, w_scores, fragmentCounts, readCounts, &template_fragments);
+	} else if(ConClave == 1) {
 		fileCount = ConClavePtr(frag_in_raw, &template_fragments, DB_size, maxFrag, w_scores, fragmentCounts, readCounts, alignment_scores, uniq_alignment_scores, template_lengths, header, qseq, bestTemplates, best_start_pos, best_end_pos, alignFrags);
 	} else if(ConClave == 2) {
 		fileCount = ConClave2Ptr(frag_in_raw, &template_fragments, DB_size, maxFrag, w_scores, fragmentCounts, readCounts, alignment_scores, uniq_alignment_scores, template_lengths, header, qseq, bestTemplates, best_start_pos, best_end_pos, alignFrags, template_tot_ulen, scoreT, evalue);	
 	} else {
 		fileCount = 0;
 	}
+	if(ctx->resume && resume != 2 && !status) {
+		ckpt = ckptCreate(outputfilename, 2, ctx->resume, DB_size);
+		ckptSaveScores(ckpt, *matched_templates, alignment_scores, uniq_alignment_scores, DB_size);
+		ckptSaveConClave(ckpt, DB_size, w_scores, fragmentCounts, readCounts, template_fragments, fileCount);
+		ckptCommit(ckpt, outputfilename, 2);
+	}
+	kmaStat_stop(STAT_CONCLAVE, timer);
 	
 	free(alignFrags);
 	free(best_start_pos);
@@ -629,13 +761,20 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	t0 = clock();
 	
 	/* print heading of resistance file: */
-	fprintf(res_out, "#Template\tScore\tExpected\tTemplate_length\tTemplate_Identity\tTemplate_Coverage\tQuery_Identity\tQuery_Coverage\tDepth\tq_value\tp_value\n");
+	if(res_out) {
+		fprintf(res_out, "#Template\tScore\tExpected\tTemplate_length\tTemplate_Identity\tTemplate_Coverage\tQuery_Identity\tQuery_Coverage\tDepth\tq_value\tp_value\n");
+	}
 	if(tsv) {
 		initsv(tsv_out, tsv);
 	}
 	if(vcf) {
 		initialiseVcf(vcf_out, templatefilename);
+		vcf_pool = 1 < thread_num ? vcfPool_init(vcf_out, thread_num, evalue, support, bcd, vcf) : 0;
+	} else {
+		vcf_pool = 0;
 	}
+	/* streamed results are flushed per template, and cannot wait for the pool */
+	cons_pool = consensus_out && 1 < thread_num && !(preset & 64) ? consPool_init(alignment_out, consensus_out, ref_fsa, thread_num) : 0;
 	
 	/* Get expected values */
 	points->len = 0;
@@ -655,7 +794,7 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	} else {
 		matrix->size++;
 	}
-	matrix->assmb = smalloc(matrix->size * sizeof(Assembly));
+	matrix->assmb = smalloc_tag(MEM_ASSEMBLY, matrix->size * sizeof(Assembly));
 	aligned_assem->size = matrix->size;
 	aligned_assem->t = smalloc(aligned_assem->size);
 	aligned_assem->s = smalloc(aligned_assem->size);
@@ -704,7 +843,7 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 		thread->spin = (sparse < 0) ? 10 : 100;
 		
 		/* start thread */
-		if((errno = pthread_create(&thread->id, NULL, assembly_KMA_Ptr, thread))) {
+		if((errno = kmaPool_create(&thread->id, i, assembly_KMA_Ptr, thread))) {
 			fprintf(stderr, "Error: %d (%s)\n", errno, strerror(errno));
 			fprintf(stderr, "Will continue with %d threads.\n", i);
 			
@@ -722,10 +861,7 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 			while(thread) {
 				next = thread->next;
 				NWmatrices = thread->NWmatrices;
-				free(NWmatrices->E);
-				free(NWmatrices->D[0]);
-				free(NWmatrices->P[0]);
-				free(NWmatrices);
+				NWmat_free(NWmatrices);
 				destroyQseqs(thread->qseq);
 				destroyQseqs(thread->header);
 				seedPoint_free(thread->points);
@@ -777,6 +913,12 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	thread->points->len = 0;
 	thread->next = 0;
 	thread->spin = (sparse < 0) ? 10 : 100;
+	/* the alignment loads the templates it met, resumed and earlier reads were not aligned here */
+	for(i = 1; i < DB_size; ++i) {
+		if(w_scores[i] && !templates_index[i]) {
+			templates_index[i] = alignLoadPtr(templates_index[i], seq_in_no, template_lengths[i], kmersize, seq_indexes[i]);
+		}
+	}
 	if(assembly_KMA_Ptr == &skip_assemble_KMA) {
 		alignLoadPtr = &alignLoad_skip;
 	}
@@ -785,6 +927,7 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	}
 	
 	/* Do local assemblies of fragments mapping to the same template */
+	kmaStat_start(timer);
 	depth = 0;
 	q_id = 0;
 	cover = 0;
@@ -811,7 +954,7 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 			}
 			p_value  = p_chisqr(q_value);
 			if(cmp((p_value <= evalue && read_score > expected), (read_score >= scoreT * t_len))) {
-				thread->template_name = nameLoad(template_name, name_file);
+				thread->template_name = nameLoadPtr(template_name, name_file, template);
 				thread->template_index = templates_index[template];
 				if(xml) {
 					newIterXML(xml_out, template, t_len, thread->template_name);
@@ -821,7 +964,9 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 				//status |= assemblyPtr(aligned_assem, template, template_fragments, fileCount, frag_out, aligned, gap_align, qseq, header, matrix, points, NWmatrices);
 				thread->template = template;
 				thread->t_len = t_len;
+				t_assem = kmaTrace_begin();
 				assembly_KMA_Ptr(thread);
+				kmaTrace_end("assemble template", "batch", t_assem, template);
 				
 				/* Depth, ID and coverage */
 				if(aligned_assem->cover > 0) {
@@ -861,28 +1006,42 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 					}
 					
 					/* Output result */
-					fprintf(res_out, "%s\t%8ld\t%8u\t%8d\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%4.1e\n", thread->template_name, read_score, (unsigned) expected, t_len, id, cover, q_id, q_cover, (double) depth, (double) q_value, p_value);
+					printRes(res_out, ctx, thread->template_name, read_score, (unsigned) expected, t_len, id, cover, q_id, q_cover, (double) depth, (double) q_value, p_value);
+					if(fragBins) {
+						bins_keep(fragBins, template);
+					}
 					if(consensus_out) {
-						printConsensus(aligned_assem, thread->template_name, alignment_out, consensus_out, ref_fsa);
+						if(cons_pool) {
+							consPush(cons_pool, aligned_assem, thread->template_name);
+						} else {
+							printConsensus(aligned_assem, thread->template_name, alignment_out, consensus_out, ref_fsa);
+						}
 					}
 					if(tsv) {
 						printsv(tsv_out, tsv, thread->template_name, aligned_assem, t_len, readCounts[template], read_score, expected, q_value, p_value, alignment_scores[template], template_name->seq);
 					}
 					/* print matrix */
 					if(matrix_out) {
-						updateMatrix(matrix_out, thread->template_name, tseq, matrix, t_len);	
+						updateMatrixPtr(matrix_out, thread->template_name, tseq, matrix, t_len);	
 					}
 					if(extendedFeatures) {
 						printExtendedFeatures(thread->template_name, aligned_assem, fragmentCounts[template], readCounts[template], extendedFeatures_out);
 					}
 					if(vcf) {
-						updateVcf(thread->template_name, aligned_assem->t, evalue, support, bcd, t_len, matrix, vcf, vcf_out);
+						if(vcf_pool) {
+							vcfPush(vcf_pool, thread->template_name, aligned_assem, t_len, matrix);
+						} else {
+							updateVcf(thread->template_name, aligned_assem->t, evalue, support, bcd, t_len, matrix, vcf, vcf_out);
+						}
 					}
 				}
+				if(preset & 64) {
+					streamResults(res_out, tsv_out, alignment_out, consensus_out);
+				}
 			} else {
 				if((sam && !(sam & 2096)) || ID_t == 0.0) {
 					thread->template_index = templates_index[template];
-					thread->template_name = nameLoad(template_name, name_file);
+					thread->template_name = nameLoadPtr(template_name, name_file, template);
 					thread->template = template;
 					skip_assemble_KMA(thread);
 					//skip_assemble_KMA(template, sam, t_len, thread->template_name, fileCount, template_fragments, aligned_assem, qseq, header);
@@ -892,20 +1051,26 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 						aln_len = aligned_assem->aln_len;
 						cover = 100.0 * aln_len / t_len;
 						q_cover = 100.0 * t_len / aln_len;
-						fprintf(res_out, "%s\t%8ld\t%8u\t%8d\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%4.1e\n", thread->template_name, read_score, (unsigned) expected, t_len, 0.0, cover, 0.0, q_cover, (double) depth, (double) q_value, p_value);
+						printRes(res_out, ctx, thread->template_name, read_score, (unsigned) expected, t_len, 0.0, cover, 0.0, q_cover, (double) depth, (double) q_value, p_value);
+						if(fragBins) {
+							bins_keep(fragBins, template);
+						}
 						if(tsv) {
 							printsv(tsv_out, tsv, thread->template_name, aligned_assem, t_len, readCounts[template], read_score, expected, q_value, p_value, alignment_scores[template], template_name->seq);
 						}
 						if(extendedFeatures) {
 							printExtendedFeatures(thread->template_name, aligned_assem, fragmentCounts[template], readCounts[template], extendedFeatures_out);
 						}
+						if(preset & 64) {
+							streamResults(res_out, tsv_out, alignment_out, consensus_out);
+						}
 					}
 				} else {
-					nameSkip(name_file, end);
+					nameSkipPtr(name_file);
 				}
 			}
 		} else {
-			nameSkip(name_file, end);
+			nameSkipPtr(name_file);
 		}
 		hashMapCCI_destroy(templates_index[template]);
 	}
@@ -915,10 +1080,18 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	assembly_KMA_Ptr(thread);
 	for(thread = threads; thread != 0; thread = thread->next) {
 		/* join thread */
-		if((errno = pthread_join(thread->id, NULL))) {
+		if((errno = kmaPool_join(thread->id, NULL))) {
 			ERROR();
 		}
 	}
+	if(cons_pool) {
+		consPool_close(cons_pool);
+	}
+	if(fragBins) {
+		bins_close(fragBins);
+		fragBins = 0;
+	}
+	kmaStat_stop(STAT_ASSEMBLY, timer);
 	
 	/* clean up reassign stuff */
 	if(templates) {
@@ -928,8 +1101,11 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 	}
 	
 	/* Close files */
+	kmaStat_start(timer);
 	close(seq_in_no);
-	fclose(res_out);
+	if(res_out) {
+		fclose(res_out);
+	}
 	if(tsv) {
 		fclose(tsv_out);
 	}
@@ -950,39 +1126,65 @@ int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConC
 		fclose(extendedFeatures_out);
 	}
 	if(vcf) {
+		if(vcf_pool) {
+			vcfPool_close(vcf_pool);
+		}
 		destroyGzFileBuff(vcf_out);
 	}
 	if(xml) {
 		closeCapXML(xml_out);
 	}
+	if(sam && samclose()) {
+		fprintf(stderr, "Compressing bam failed.\n");
+		status = 1;
+	}
+	kmaStat_stop(STAT_OUTPUT, timer);
 	
 	t1 = clock();
+	if(verbose) {
+		kmaPool_report(stderr);
+	}
 	fprintf(stderr, "# Total time used for local assembly: %.2f s.\n#\n", difftime(t1, t0) / 1000000);
 	
+	/* the run is complete, its checkpoints are spent */
+	if(ctx->resume && !status) {
+		outputfilename[file_len] = 0;
+		ckptRemove(outputfilename);
+	}
+	
 	return status;
 }
 
-int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int ConClave, int kmersize, int minlen, Penalties *rewards, int extendedFeatures, double ID_t, double Depth_t, int mq, double scoreT, double mrc, double minFrac, double evalue, double support, int bcd, int ref_fsa, int print_matrix, int print_all, long unsigned tsv, int vcf, int xml, int sam, int nc, int nf, unsigned shm, int thread_num, int maxFrag, int verbose, unsigned preset) {
+int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, const KmaContext *ctx) {
 	
 	/* runKMA_MEM is a memory saving version of runKMA,
 	   at the cost it chooses best templates based on kmers
 	   instead of alignment score. */
 	
-	int i, file_len, rc_flag, template, bestHits, t_len, delta, aln_len, end;
+	int ConClave, kmersize, minlen, extendedFeatures, mq, bcd, ref_fsa, print_matrix;
+	int print_all, vcf, xml, sam, nc, nf, thread_num, maxFrag, verbose;
+	unsigned shm, preset;
+	long unsigned tsv;
+	double ID_t, Depth_t, scoreT, mrc, minFrac, evalue, support;
+	Penalties *rewards;
+	int i, file_len, rc_flag, template, bestHits, t_len, delta, aln_len;
 	int fileCount, coverScore, status, sparse, progress, seq_in_no, DB_size;
-	int flag, flag_r, *template_lengths;
+	int flag, flag_r, resume, *template_lengths;
 	int *matched_templates, *bestTemplates, *best_start_pos, *best_end_pos;
 	unsigned *fragmentCounts, *readCounts;
-	long best_read_score, read_score, seq_seeker;
+	long best_read_score, read_score, seq_seeker, NWsize;
 	long unsigned Nhits, template_tot_ulen, counter, seqin_size;
 	long unsigned *w_scores, *uniq_alignment_scores, *alignment_scores, *tseq;
 	double id, cover, q_id, q_cover, p_value;
 	long double depth, q_value, expected;
 	FILE *inputfile, *frag_in_raw, *res_out, *tsv_out, *name_file;
 	FILE *alignment_out, *consensus_out, *frag_out_raw, **template_fragments;
-	FILE *extendedFeatures_out, *xml_out;
+	FILE *extendedFeatures_out, *xml_out, *ckpt, *state;
+	long unsigned timer[STAT_TIMER], t_assem;
 	time_t t0, t1;
 	FileBuff *frag_out, *frag_out_all, *matrix_out, *vcf_out;
+	VcfPool *vcf_pool;
+	ConsPool *cons_pool;
 	Aln *aligned, *gap_align;
 	Assem *aligned_assem;
 	Frag **alignFrags;
@@ -995,17 +1197,51 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 	HashMapCCI *template_index;
 	HashMapKMA *templates;
 	
+	/* get parameters and install the alignment dispatch */
+	kmaContext_loadAln(ctx);
+	ConClave = ctx->ConClave;
+	kmersize = ctx->kmersize;
+	minlen = ctx->minlen;
+	rewards = ctx->rewards;
+	extendedFeatures = ctx->extendedFeatures;
+	ID_t = ctx->ID_t;
+	Depth_t = ctx->Depth_t;
+	mq = ctx->mq;
+	scoreT = ctx->scoreT;
+	mrc = ctx->mrc;
+	minFrac = ctx->minFrac;
+	evalue = ctx->evalue;
+	support = ctx->support;
+	bcd = ctx->bcd;
+	ref_fsa = ctx->ref_fsa;
+	print_matrix = ctx->print_matrix;
+	print_all = ctx->print_all;
+	tsv = ctx->tsv;
+	vcf = ctx->vcf;
+	xml = ctx->xml;
+	sam = ctx->sam;
+	nc = ctx->nc;
+	nf = ctx->nf;
+	shm = ctx->shm;
+	thread_num = ctx->thread_num;
+	maxFrag = ctx->maxFrag;
+	verbose = ctx->verbose;
+	preset = ctx->preset;
+	
 	/* get lengths and names */
 	file_len = strlen(templatefilename);
 	DB_size = load_DBs_KMA(templatefilename, &alignment_scores, &uniq_alignment_scores, &template_lengths, shm);
 	if(!kmersize) {
 		kmersize = *template_lengths;
 	}
+	/* 64 is the bandwidth */
+	NWsize = NWmat_size(template_lengths, DB_size, 64);
 	templatefilename[file_len] = 0;
 	template_name = setQseqs(256);
 	strcat(templatefilename, ".name");
 	name_file = sfopen(templatefilename, "rb");
 	templatefilename[file_len] = 0;
+	dbMapNames(templatefilename, DB_size);
 	if((verbose & 2)) {
 		progress = 1;
 		verbose = 0;
@@ -1018,13 +1254,22 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 		saminit(template_name, name_file, template_lengths, DB_size, exePrev);
 	}
 	
-	/* open pipe */
+	/* open pipe, ankers are streamed from the concurrently running mapping */
 	status = 0;
-	inputfile = kmaPipe("-s2", "rb", 0, 0);
+	resume = 0;
+	ckpt = ctx->resume ? ckptOpen(outputfilename, ctx->resume, DB_size, &resume) : 0;
+	state = ctx->incr ? ckptStateOpen(ctx->incr, ctx->incrKey, DB_size) : 0;
+	if(ckpt) {
+		/* resumed, the stages before the checkpoint see no reads */
+		inputfile = tmpM(0);
+	} else {
+		inputfile = kmaPipe("-s2", "rb", 0, 0);
+	}
 	if(!inputfile) {
 		ERROR();
 	} else {
 		setvbuf(inputfile, NULL, _IOFBF, CHUNK);
+		get_ankers(0, 0, 0, 0, 0);
 	}
 	
 	/* load databases */
@@ -1033,14 +1278,11 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 		kmersize = 16;
 	}
 	strcat(templatefilename, ".seq.b");
-	seq_in_no = open(templatefilename, O_RDONLY);
+	seq_in_no = packOpen(templatefilename, &seqin_size);
 	if(seq_in_no == -1) {
 		ERROR();
 	}
-	seqin_size = 4 * lseek(seq_in_no, 0, SEEK_END);
-	if(lseek(seq_in_no, 0, SEEK_SET) != 0) {
-		ERROR();
-	}
+	seqin_size *= 4;
 	templatefilename[file_len] = 0;
 	
 	/* allocate stuff */
@@ -1061,12 +1303,16 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 	
 	/* open outputfiles */
 	if(outputfilename) {
-		strcat(outputfilename, ".res");
-		res_out = sfopen(outputfilename, "w");
-		outputfilename[file_len] = 0;
+		if(ctx->hitPtr) {
+			res_out = 0;
+		} else {
+			strcat(outputfilename, ".res");
+			res_out = outFopenPtr(outputfilename, "w");
+			outputfilename[file_len] = 0;
+		}
 		if(tsv) {
 			strcat(outputfilename, ".tsv");
-			tsv_out = sfopen(outputfilename, "w");
+			tsv_out = outFopenPtr(outputfilename, "w");
 			outputfilename[file_len] = 0;
 		} else {
 			tsv_out = 0;
@@ -1083,25 +1329,28 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 		consensus_out = 0;
 		if(nc == 0) {
 			strcat(outputfilename, ".aln");
-			alignment_out = sfopen(outputfilename, "w");
+			alignment_out = outFopenPtr(outputfilename, "w");
 			outputfilename[file_len] = 0;
 			strcat(outputfilename, ".fsa");
-			consensus_out = sfopen(outputfilename, "w");
+			consensus_out = outFopenPtr(outputfilename, "w");
 			outputfilename[file_len] = 0;
 		} else if((nc & 1) == 0) {
 			strcat(outputfilename, ".fsa");
-			consensus_out = sfopen(outputfilename, "w");
+			consensus_out = outFopenPtr(outputfilename, "w");
 			outputfilename[file_len] = 0;
 		}
 		
-		frag_out_raw = tmpF(0);
+		frag_out_raw = tmpM(0);
 		if(!frag_out_raw) {
 			ERROR();
 		}
 		if(print_matrix) {
 			matrix_out = gzInitFileBuff(CHUNK);
-			strcat(outputfilename, ".mat.gz");
+			strcat(outputfilename, print_matrix == 2 ? ".smat.gz" : ".mat.gz");
 			openFileBuff(matrix_out, outputfilename, "wb");
+			if(print_matrix == 2) {
+				initSparseMatrix(matrix_out);
+			}
 			outputfilename[file_len] = 0;
 		} else {
 			matrix_out = 0;
@@ -1129,6 +1378,7 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 	
 	fprintf(stderr, "# Collecting k-mer scores.\n");
 	t0 = clock();
+	kmaStat_start(timer);
 	
 	/* Get alignments */
 	matched_templates = malloc(((DB_size + 1) << 1) * sizeof(int));
@@ -1168,7 +1418,7 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 				}
 			}
 			unCompDNA(qseq_comp, qseq->seq);
-			
+			kmaStat_add(STAT_MAPPED, 1);
 			
 			/* reverse complement seq */
 			best_read_score = abs(rc_flag);
@@ -1206,6 +1456,8 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 		}
 	}
 	
+	fragFlush();
+	
 	/* check soft proxi */
 	if(minFrac < 0) {
 		sfread(alignment_scores, sizeof(long unsigned), DB_size, inputfile);
@@ -1217,11 +1469,36 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 		fprintf(stderr, "# Scored %ld query sequences.\n", Nhits);
 		verbose = 1;
 	}
-	kmaPipe(0, 0, inputfile, &i);
-	status |= i;
-	i = 0;
-	sfwrite(&i, sizeof(int), 1, frag_out_raw);
-	fflush(frag_out_raw);
+	if(ckpt) {
+		fclose(inputfile);
+		ckptLoadScores(ckpt, matched_templates, alignment_scores, uniq_alignment_scores, DB_size);
+		if(resume == 1) {
+			ckptLoadFrags(ckpt, frag_out_raw);
+		}
+	} else {
+		kmaPipe(0, 0, inputfile, &i);
+		status |= i;
+		if(state) {
+			/* reads of earlier runs on the sample */
+			ckptLoadState(state, alignment_scores, uniq_alignment_scores, DB_size, frag_out_raw);
+		}
+		i = 0;
+		sfwrite(&i, sizeof(int), 1, frag_out_raw);
+		fflush(frag_out_raw);
+		if(ctx->incr && !status) {
+			state = ckptStateCreate(ctx->incr, ctx->incrKey, DB_size);
+			ckptSaveScores(state, *matched_templates, alignment_scores, uniq_alignment_scores, DB_size);
+			ckptSaveFrags(state, frag_out_raw);
+			ckptStateCommit(state, ctx->incr);
+		}
+		if(ctx->resume && !status) {
+			ckpt = ckptCreate(outputfilename, 1, ctx->resume, DB_size);
+			ckptSaveScores(ckpt, *matched_templates, alignment_scores, uniq_alignment_scores, DB_size);
+			ckptSaveFrags(ckpt, frag_out_raw);
+			ckptCommit(ckpt, outputfilename, 1);
+			ckpt = 0;
+		}
+	}
 	freeComp(qseq_comp);
 	free(qseq_comp);
 	freeComp(qseq_r_comp);
@@ -1244,14 +1521,19 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 	if(frag_out_all) {
 		destroyGzFileBuff(frag_out_all);
 	}
+	kmaStat_stop(STAT_ALIGNMENT, timer);
 	if(kmaPipe == &kmaPipeFork) {
 		t1 = clock();
 		fprintf(stderr, "#\n# Time for score collecting:\t%.2f s.\n", difftime(t1, t0) / 1000000);
 	} else {
 		fprintf(stderr, "# Score collection done\n");
 	}
+	xDropReport(stderr);
+	fuzzyReport(stderr);
+	nwWindowReport(stderr);
 	fprintf(stderr, "#\n# Sort, output and select k-mer alignments.\n");
 	t0 = clock();
+	kmaStat_start(timer);
 	
 	/* Get best template for each mapped deltamer/read */
 	/* Best hit chosen as: highest mapping score then higest # unique maps */
@@ -1271,7 +1553,7 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 	/* Patricks features */
 	if(extendedFeatures) {
 		strcat(outputfilename, ".mapstat");
-		extendedFeatures_out = sfopen(outputfilename, "wb");
+		extendedFeatures_out = outFopenPtr(outputfilename, "wb");
 		outputfilename[file_len] = 0;
 		initExtendedFeatures(extendedFeatures_out, templatefilename, *matched_templates, exePrev);
 	} else {
@@ -1309,13 +1591,23 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 	}
 	
 	/* ConClave */
-	if(ConClave == 1) {
+	fragBins = ctx->bins && resume != 2 ? bins_init(outputfilename, templatefilename, DB_size, ctx->bins == 2) : 0;
+	if(resume == 2) {
+		fileCount = ckptLoadConClave(ckpt, DB_size, w_scores, fragmentCounts, readCounts, &template_fragments);
+	} else if(ConClave == 1) {
 		fileCount = ConClavePtr(frag_in_raw, &template_fragments, DB_size, maxFrag, w_scores, fragmentCounts, readCounts, alignment_scores, uniq_alignment_scores, template_lengths, header, qseq, bestTemplates, best_start_pos, best_end_pos, alignFrags);
 	} else if(ConClave == 2) {
 		fileCount = ConClave2Ptr(frag_in_raw, &template_fragments, DB_size, maxFrag, w_scores, fragmentCounts, readCounts, alignment_scores, uniq_alignment_scores, template_lengths, header, qseq, bestTemplates, best_start_pos, best_end_pos, alignFrags, template_tot_ulen, scoreT, evalue);	
 	} else {
 		fileCount = 0;
 	}
+	if(ctx->resume && resume != 2 && !status) {
+		ckpt = ckptCreate(outputfilename, 2, ctx->resume, DB_size);
+		ckptSaveScores(ckpt, *matched_templates, alignment_scores, uniq_alignment_scores, DB_size);
+		ckptSaveConClave(ckpt, DB_size, w_scores, fragmentCounts, readCounts, template_fragments, fileCount);
+		ckptCommit(ckpt, outputfilename, 2);
+	}
+	kmaStat_stop(STAT_CONCLAVE, timer);
 	
 	free(alignFrags);
 	free(best_start_pos);
@@ -1336,13 +1628,20 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 	t0 = clock();
 	
 	/* print heading of resistance file: */
-	fprintf(res_out, "#Template\tScore\tExpected\tTemplate_length\tTemplate_Identity\tTemplate_Coverage\tQuery_Identity\tQuery_Coverage\tDepth\tq_value\tp_value\n");
+	if(res_out) {
+		fprintf(res_out, "#Template\tScore\tExpected\tTemplate_length\tTemplate_Identity\tTemplate_Coverage\tQuery_Identity\tQuery_Coverage\tDepth\tq_value\tp_value\n");
+	}
 	if(tsv) {
 		initsv(tsv_out, tsv);
 	}
 	if(vcf) {
 		initialiseVcf(vcf_out, templatefilename);
+		vcf_pool = 1 < thread_num ? vcfPool_init(vcf_out, thread_num, evalue, support, bcd, vcf) : 0;
+	} else {
+		vcf_pool = 0;
 	}
+	/* streamed results are flushed per template, and cannot wait for the pool */
+	cons_pool = consensus_out && 1 < thread_num && !(preset & 64) ? consPool_init(alignment_out, consensus_out, ref_fsa, thread_num) : 0;
 	
 	/* preallocate assembly matrices */
 	matrix = smalloc(sizeof(AssemInfo));
@@ -1371,7 +1670,7 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 	} else {
 		matrix->size++;
 	}
-	matrix->assmb = smalloc(matrix->size * sizeof(Assembly));
+	matrix->assmb = smalloc_tag(MEM_ASSEMBLY, matrix->size * sizeof(Assembly));
 	aligned_assem->size = matrix->size;
 	aligned_assem->t = smalloc(aligned_assem->size);
 	aligned_assem->s = smalloc(aligned_assem->size);
@@ -1400,15 +1699,7 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 	threads = 0;
 	while(i < thread_num) {
 		/* allocate matrices */
-		NWmatrices = smalloc(sizeof(NWmat));
-		NWmatrices->NW_s = 1024 * 1024;
-		NWmatrices->NW_q = 1024;
-		NWmatrices->E = smalloc(NWmatrices->NW_s);
-		NWmatrices->D[0] = smalloc((NWmatrices->NW_q << 1) * sizeof(int));
-		NWmatrices->P[0] = smalloc((NWmatrices->NW_q << 1) * sizeof(int));
-		NWmatrices->D[1] = NWmatrices->D[0] + NWmatrices->NW_q;
-		NWmatrices->P[1] = NWmatrices->P[0] + NWmatrices->NW_q;
-		NWmatrices->rewards = rewards;
+		NWmatrices = NWmat_init(1024, NWsize, rewards);
 		
 		aligned = smalloc(sizeof(Aln));
 		gap_align = smalloc(sizeof(Aln));
@@ -1453,7 +1744,7 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 		threads = thread;
 		
 		/* start thread */
-		if((errno = pthread_create(&thread->id, NULL, assembly_KMA_Ptr, thread))) {
+		if((errno = kmaPool_create(&thread->id, i, assembly_KMA_Ptr, thread))) {
 			fprintf(stderr, "Error: %d (%s)\n", errno, strerror(errno));
 			fprintf(stderr, "Will continue with %d threads.\n", i);
 			threads = thread->next;
@@ -1465,15 +1756,7 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 	}
 	
 	/* start main thread */
-	NWmatrices = smalloc(sizeof(NWmat));
-	NWmatrices->NW_s = 1024 * 1024;
-	NWmatrices->NW_q = 1024;
-	NWmatrices->E = smalloc(NWmatrices->NW_s);
-	NWmatrices->D[0] = smalloc((NWmatrices->NW_q << 1) * sizeof(int));
-	NWmatrices->P[0] = smalloc((NWmatrices->NW_q << 1) * sizeof(int));
-	NWmatrices->D[1] = NWmatrices->D[0] + NWmatrices->NW_q;
-	NWmatrices->P[1] = NWmatrices->P[0] + NWmatrices->NW_q;
-	NWmatrices->rewards = rewards;
+	NWmatrices = NWmat_init(1024, NWsize, rewards);
 	
 	aligned = smalloc(sizeof(Aln));
 	gap_align = smalloc(sizeof(Aln));
@@ -1517,6 +1800,7 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 	thread->spin = (sparse < 0) ? 10 : 100;
 	
 	/* Do local assemblies of fragments mapping to the same template */
+	kmaStat_start(timer);
 	depth = 0;
 	q_id = 0;
 	cover = 0;
@@ -1565,7 +1849,7 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 				lseek(seq_in_no, seq_seeker, SEEK_CUR);
 				seq_seeker = 0;
 				thread->template_index->len = 0;
-				thread->template_name = nameLoad(template_name, name_file);
+				thread->template_name = nameLoadPtr(template_name, name_file, template);
 				
 				if(xml) {
 					newIterXML(xml_out, template, t_len, thread->template_name);
@@ -1575,7 +1859,9 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 				//status |= assemblyPtr(aligned_assem, template, template_fragments, fileCount, frag_out, aligned, gap_align, qseq, header, matrix, points, NWmatrices);
 				thread->template = template;
 				thread->t_len = t_len;
+				t_assem = kmaTrace_begin();
 				assembly_KMA_Ptr(thread);
+				kmaTrace_end("assemble template", "batch", t_assem, template);
 				read_score = aligned_assem->score;
 				
 				/* Depth, ID and coverage */
@@ -1620,16 +1906,23 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 					}
 					
 					/* Output result */
-					fprintf(res_out, "%s\t%8ld\t%8u\t%8d\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%4.1e\n", thread->template_name, read_score, (unsigned) expected, t_len, id, cover, q_id, q_cover, (double) depth, (double) q_value, p_value);
+					printRes(res_out, ctx, thread->template_name, read_score, (unsigned) expected, t_len, id, cover, q_id, q_cover, (double) depth, (double) q_value, p_value);
+					if(fragBins) {
+						bins_keep(fragBins, template);
+					}
 					if(tsv) {
 						printsv(tsv_out, tsv, thread->template_name, aligned_assem, t_len, readCounts[template], read_score, expected, q_value, p_value, alignment_scores[template], template_name->seq);
 					}
 					if(consensus_out) {
-						printConsensus(aligned_assem, thread->template_name, alignment_out, consensus_out, ref_fsa);
+						if(cons_pool) {
+							consPush(cons_pool, aligned_assem, thread->template_name);
+						} else {
+							printConsensus(aligned_assem, thread->template_name, alignment_out, consensus_out, ref_fsa);
+						}
 					}
 					/* print matrix */
 					if(matrix_out) {
-						updateMatrix(matrix_out, thread->template_name, tseq, matrix, t_len);
+						updateMatrixPtr(matrix_out, thread->template_name, tseq, matrix, t_len);
 					}
 					
 					if(extendedFeatures) {
@@ -1637,9 +1930,16 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 					}
 					
 					if(vcf) {
-						updateVcf(thread->template_name, aligned_assem->t, evalue, support, bcd, t_len, matrix, vcf, vcf_out);
+						if(vcf_pool) {
+							vcfPush(vcf_pool, thread->template_name, aligned_assem, t_len, matrix);
+						} else {
+							updateVcf(thread->template_name, aligned_assem->t, evalue, support, bcd, t_len, matrix, vcf, vcf_out);
+						}
 					}
 				}
+				if(preset & 64) {
+					streamResults(res_out, tsv_out, alignment_out, consensus_out);
+				}
 			} else {
 				if((sam && !(sam & 2096)) || ID_t == 0.0) {
 					/* load DB */
@@ -1647,7 +1947,7 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 					lseek(seq_in_no, seq_seeker, SEEK_CUR);
 					seq_seeker = 0;
 					thread->template_index = alignLoad_skip(thread->template_index, seq_in_no, template_lengths[template], kmersize, 0);
-					thread->template_name = nameLoad(template_name, name_file);
+					thread->template_name = nameLoadPtr(template_name, name_file, template);
 					thread->template = template;
 					skip_assemble_KMA(thread);
 					//skip_assemble_KMA(template, sam, t_len, thread->template_name, fileCount, template_fragments, aligned_assem, qseq, header);
@@ -1658,21 +1958,27 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 						aln_len = aligned_assem->aln_len;
 						cover = 100.0 * aln_len / t_len;
 						q_cover = 0;
-						fprintf(res_out, "%s\t%8ld\t%8u\t%8d\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%8.2f\t%4.1e\n", thread->template_name, read_score, (unsigned) expected, t_len, 0.0, cover, 0.0, q_cover, (double) depth, (double) q_value, p_value);
+						printRes(res_out, ctx, thread->template_name, read_score, (unsigned) expected, t_len, 0.0, cover, 0.0, q_cover, (double) depth, (double) q_value, p_value);
+						if(fragBins) {
+							bins_keep(fragBins, template);
+						}
 						if(tsv) {
 							printsv(tsv_out, tsv, thread->template_name, aligned_assem, t_len, readCounts[template], read_score, expected, q_value, p_value, alignment_scores[template], template_name->seq);
 						}
 						if(extendedFeatures) {
 							printExtendedFeatures(thread->template_name, aligned_assem, fragmentCounts[template], readCounts[template], extendedFeatures_out);
 						}
+						if(preset & 64) {
+							streamResults(res_out, tsv_out, alignment_out, consensus_out);
+						}
 					}
 				} else {
-					nameSkip(name_file, end);
+					nameSkipPtr(name_file);
 				}
 				seq_seeker += ((template_lengths[template] >> 5) + 1);
 			}
 		} else {
-			nameSkip(name_file, end);
+			nameSkipPtr(name_file);
 			seq_seeker += ((template_lengths[template] >> 5) + 1);
 		}
 	}
@@ -1688,10 +1994,18 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 	assembly_KMA_Ptr(thread);
 	for(thread = threads; thread != 0; thread = thread->next) {
 		/* join thread */
-		if((errno = pthread_join(thread->id, NULL))) {
+		if((errno = kmaPool_join(thread->id, NULL))) {
 			ERROR();
 		}
 	}
+	if(cons_pool) {
+		consPool_close(cons_pool);
+	}
+	if(fragBins) {
+		bins_close(fragBins);
+		fragBins = 0;
+	}
+	kmaStat_stop(STAT_ASSEMBLY, timer);
 	
 	/* clean up reassign stuff */
 	if(templates) {
@@ -1701,8 +2015,11 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 	}
 	
 	/* Close files */
+	kmaStat_start(timer);
 	close(seq_in_no);
-	fclose(res_out);
+	if(res_out) {
+		fclose(res_out);
+	}
 	if(tsv) {
 		fclose(tsv_out);
 	}
@@ -1723,14 +2040,31 @@ int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int
 		fclose(extendedFeatures_out);
 	}
 	if(vcf) {
+		if(vcf_pool) {
+			vcfPool_close(vcf_pool);
+		}
 		destroyGzFileBuff(vcf_out);
 	}
 	if(xml) {
 		closeCapXML(xml_out);
 	}
+	if(sam && samclose()) {
+		fprintf(stderr, "Compressing bam failed.\n");
+		status = 1;
+	}
+	kmaStat_stop(STAT_OUTPUT, timer);
 	
 	t1 = clock();
+	if(ctx->verbose) {
+		kmaPool_report(stderr);
+	}
 	fprintf(stderr, "# Total time used for local assembly: %.2f s.\n#\n", difftime(t1, t0) / 1000000);
 	
+	/* the run is complete, its checkpoints are spent */
+	if(ctx->resume && !status) {
+		outputfilename[file_len] = 0;
+		ckptRemove(outputfilename);
+	}
+	
 	return status;
 }
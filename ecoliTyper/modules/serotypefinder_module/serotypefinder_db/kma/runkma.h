@@ -18,6 +18,7 @@
 */
 #define _XOPEN_SOURCE 600
 #include <stdio.h>
+#include "kmactx.h"
 #include "penalties.h"
 #include "qseqs.h"
 
@@ -25,5 +26,5 @@
 
 int load_DBs_KMA(char *templatefilename, long unsigned **alignment_scores, long unsigned **uniq_alignment_scores, int **template_lengths, unsigned shm);
 char * nameLoad(Qseqs *name, FILE *infile);
-int runKMA(char *templatefilename, char *outputfilename, char *exePrev, int ConClave, int kmersize, int minlen, Penalties *rewards, int extendedFeatures, double ID_t, double Depth_t, int mq, double scoreT, double mrc, double minFrac, double evalue, double support, int bcd, int ref_fsa, int print_matrix, int print_all, long unsigned tsv, int vcf, int xml, int sam, int nc, int nf, unsigned shm, int thread_num, int maxFrag, int verbose, unsigned preset);
-int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, int ConClave, int kmersize, int minlen, Penalties *rewards, int extendedFeatures, double ID_t, double Depth_t, int mq, double scoreT, double mrc, double minFrac, double evalue, double support, int bcd, int ref_fsa, int print_matrix, int print_all, long unsigned tsv, int vcf, int xml, int sam, int nc, int nf, unsigned shm, int thread_num, int maxFrag, int verbose, unsigned preset);
+int runKMA(char *templatefilename, char *outputfilename, char *exePrev, const KmaContext *ctx);
+int runKMA_MEM(char *templatefilename, char *outputfilename, char *exePrev, const KmaContext *ctx);
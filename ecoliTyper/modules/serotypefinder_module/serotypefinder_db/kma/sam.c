@@ -19,6 +19,8 @@
 #define _XOPEN_SOURCE 600
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "bgzf.h"
 #include "nw.h"
 #include "pherror.h"
 #include "qseqs.h"
@@ -27,6 +29,18 @@
 #include "threader.h"
 #include "version.h"
 
+static BgzfFile *samOut = 0;
+static int bamThreads = 0;
+static int refNum = 0;
+static unsigned refMask = 0;
+static int *refHash = 0;
+static char **refNames = 0;
+static unsigned char bamNt[256];
+
+void setBam(int thread_num) {
+	bamThreads = thread_num < 0 ? 0 : thread_num;
+}
+
 char * makeCigar(Qseqs *Cigar, const Aln *aligned) {
 	
 	int len, cLen, rep;
@@ -97,17 +111,366 @@ char * makeCigar(Qseqs *Cigar, const Aln *aligned) {
 	return cigar;
 }
 
+static unsigned refHashName(const char *name) {
+	
+	unsigned key;
+	
+	/* FNV-1a */
+	key = 2166136261U;
+	while(*name) {
+		key = (key ^ (unsigned char)(*name++)) * 16777619U;
+	}
+	
+	return key;
+}
+
+static int refID(const char *rname) {
+	
+	static int last = -1;
+	int ref;
+	unsigned key;
+	
+	if(!rname || (rname[0] == '*' && rname[1] == 0)) {
+		return -1;
+	}
+	
+	/* reads arrive grouped by template */
+	ref = last;
+	if(0 <= ref && strcmp(refNames[ref], rname) == 0) {
+		return ref;
+	}
+	key = refHashName(rname) & refMask;
+	while((ref = refHash[key] - 1) != -1) {
+		if(strcmp(refNames[ref], rname) == 0) {
+			last = ref;
+			return ref;
+		}
+		key = (key + 1) & refMask;
+	}
+	
+	return -1;
+}
+
+static void bamInt(unsigned char *dest, unsigned src) {
+	
+	dest[0] = src;
+	dest[1] = src >> 8;
+	dest[2] = src >> 16;
+	dest[3] = src >> 24;
+}
+
+static int reg2bin(int beg, int end) {
+	
+	/* UCSC binning scheme of the SAM specification, end is exclusive */
+	--end;
+	if(beg >> 14 == end >> 14) {
+		return ((1 << 15) - 1) / 7 + (beg >> 14);
+	} else if(beg >> 17 == end >> 17) {
+		return ((1 << 12) - 1) / 7 + (beg >> 17);
+	} else if(beg >> 20 == end >> 20) {
+		return ((1 << 9) - 1) / 7 + (beg >> 20);
+	} else if(beg >> 23 == end >> 23) {
+		return ((1 << 6) - 1) / 7 + (beg >> 23);
+	} else if(beg >> 26 == end >> 26) {
+		return ((1 << 3) - 1) / 7 + (beg >> 26);
+	}
+	
+	return 0;
+}
+
+static int bamCigar(Qseqs *Cigar, const Aln *aligned, int *rlen) {
+	
+	int len, rep, n, tlen;
+	unsigned op, pop;
+	unsigned char *t, *q, *cigar;
+	char *s;
+	
+	/* ops, as in makeCigar: S4 =7 X8 I1 D2 */
+	if(Cigar->size < (aligned->len << 2) + 16) {
+		Cigar->size = (aligned->len << 2) + 16;
+		free(Cigar->seq);
+		Cigar->seq = smalloc(Cigar->size);
+	}
+	cigar = Cigar->seq;
+	n = 0;
+	tlen = 0;
+	if(aligned->start) {
+		bamInt(cigar, (aligned->start << 4) | 4);
+		++n;
+	}
+	
+	len = aligned->len;
+	t = aligned->t;
+	s = aligned->s;
+	q = aligned->q;
+	rep = 0;
+	pop = 0;
+	while(len--) {
+		if(*s == '|') {
+			op = 7;
+		} else if(*t == 5) {
+			op = 1;
+		} else if(*q == 5) {
+			op = 2;
+		} else {
+			op = 8;
+		}
+		if(op != 1) {
+			++tlen;
+		}
+		if(op == pop) {
+			++rep;
+		} else {
+			if(rep) {
+				bamInt(cigar + (n++ << 2), (rep << 4) | pop);
+			}
+			rep = 1;
+			pop = op;
+		}
+		++t;
+		++s;
+		++q;
+	}
+	if(rep) {
+		bamInt(cigar + (n++ << 2), (rep << 4) | pop);
+	}
+	
+	if(aligned->end) {
+		bamInt(cigar + (n++ << 2), (aligned->end << 4) | 4);
+	}
+	Cigar->len = n;
+	*rlen = tlen;
+	
+	return n;
+}
+
+static void baminit(Qseqs *template_name, FILE *name_file, int *template_lengths, int DB_size, char *cmd) {
+	
+	int i, len, size;
+	unsigned key;
+	char *name, *text;
+	unsigned char *buff;
+	const char *nt = "=ACMGRSVTWYHKDBN";
+	
+	/* 4-bit encoding, anything else is N */
+	memset(bamNt, 15, 256);
+	for(i = 0; i < 16; ++i) {
+		bamNt[(unsigned char) nt[i]] = i;
+		bamNt[(unsigned char) (nt[i] | 32)] = i;
+	}
+	
+	/* load names, and hash them for the refID lookup */
+	refNum = DB_size - 1;
+	refNames = smalloc((refNum ? refNum : 1) * sizeof(char *));
+	refMask = 1;
+	while(refMask < (refNum << 1)) {
+		refMask <<= 1;
+	}
+	refHash = calloc(refMask, sizeof(int));
+	if(!refHash) {
+		ERROR();
+	}
+	--refMask;
+	size = 256 + (cmd ? strlen(cmd) : 0);
+	for(i = 0; i < refNum; ++i) {
+		name = nameLoad(template_name, name_file);
+		len = strlen(name) + 1;
+		refNames[i] = smalloc(len);
+		memcpy(refNames[i], name, len);
+		size += (len << 1) + 40;
+		key = refHashName(name) & refMask;
+		while(refHash[key]) {
+			key = (key + 1) & refMask;
+		}
+		refHash[key] = i + 1;
+	}
+	sfseek(name_file, 0, SEEK_SET);
+	
+	/* magic, and the same text header as the sam output */
+	buff = smalloc(size);
+	memcpy(buff, "BAM\1", 4);
+	text = (char *) buff + 8;
+	len = sprintf(text, "@HD\tVN:1.6\tGO:reference\n");
+	if(cmd) {
+		len += sprintf(text + len, "@PG\tID:KMA\tPN:kma\tVN:%s\tCL:%s\n", KMA_VERSION, cmd);
+	} else {
+		len += sprintf(text + len, "@PG\tID:KMA\tPN:kma\tVN:%s\n", KMA_VERSION);
+	}
+	for(i = 0; i < refNum; ++i) {
+		len += sprintf(text + len, "@SQ\tSN:%s\tLN:%d\n", refNames[i], template_lengths[i + 1]);
+	}
+	bamInt(buff + 4, len);
+	len += 8;
+	bamInt(buff + len, refNum);
+	len += 4;
+	
+	/* references */
+	for(i = 0; i < refNum; ++i) {
+		size = strlen(refNames[i]) + 1;
+		bamInt(buff + len, size);
+		memcpy(buff + len + 4, refNames[i], size);
+		len += size + 4;
+		bamInt(buff + len, template_lengths[i + 1]);
+		len += 4;
+	}
+	
+	samOut = bgzfOpen(stdout, bamThreads, Z_DEFAULT_COMPRESSION, 0);
+	bgzfWrite(samOut, buff, len);
+	free(buff);
+}
+
+static int bamwrite(const Qseqs *qseq, const Qseqs *header, const Qseqs *Qual, char *rname, const Aln *aligned, const int *stats) {
+	
+	static volatile int Lock = 0;
+	volatile int *lock = &Lock;
+	static Qseqs *Cigar = 0;
+	static Qseqs *Rec = 0;
+	int i, flag, pos, mapQ, tlen, et, score, ref, bin, l_name, l_seq, n_cigar, rlen, size;
+	char *qname;
+	unsigned char *rec, *next, *seq, *qual;
+	
+	qname = header->seq ? (char *) header->seq : "*";
+	for(l_name = 0; l_name < 254 && qname[l_name] && qname[l_name] != '\t'; ++l_name);
+	seq = qseq->seq;
+	l_seq = strlen((char *) seq);
+	if(aligned) {
+		mapQ = 254 < aligned->mapQ ? 254 : aligned->mapQ;
+		et = *stats;
+		score = stats[1];
+		pos = stats[2];
+		tlen = stats[3] - pos - 1;
+		flag = stats[4];
+	} else {
+		mapQ = 0;
+		et = *stats;
+		score = 0;
+		pos = -1;
+		tlen = 0;
+		flag = stats[1];
+	}
+	
+	lock(lock);
+	if(Cigar == 0) {
+		Cigar = setQseqs(256);
+		Rec = setQseqs(256);
+	}
+	ref = refID(rname);
+	n_cigar = 0;
+	rlen = 0;
+	if(aligned) {
+		n_cigar = bamCigar(Cigar, aligned, &rlen);
+	}
+	if(ref < 0 || pos < 0) {
+		bin = reg2bin(-1, 0);
+	} else {
+		bin = reg2bin(pos, pos + (rlen ? rlen : 1));
+	}
+	
+	/* fixed fields, name, cigar, seq, qual and tags */
+	size = 64 + l_name + (n_cigar << 3) + (l_seq << 1);
+	if(Rec->size < size) {
+		Rec->size = size << 1;
+		free(Rec->seq);
+		Rec->seq = smalloc(Rec->size);
+	}
+	rec = Rec->seq;
+	bamInt(rec + 4, ref);
+	bamInt(rec + 8, pos);
+	rec[12] = l_name + 1;
+	rec[13] = mapQ;
+	rec[14] = bin;
+	rec[15] = bin >> 8;
+	i = n_cigar <= 65535 ? n_cigar : 2;
+	rec[16] = i;
+	rec[17] = i >> 8;
+	rec[18] = flag;
+	rec[19] = flag >> 8;
+	bamInt(rec + 20, l_seq);
+	bamInt(rec + 24, -1);
+	bamInt(rec + 28, -1);
+	bamInt(rec + 32, tlen);
+	next = rec + 36;
+	memcpy(next, qname, l_name);
+	next += l_name;
+	*next++ = 0;
+	if(n_cigar <= 65535) {
+		memcpy(next, Cigar->seq, n_cigar << 2);
+		next += n_cigar << 2;
+	} else {
+		/* too many ops, placeholder cigar and the real one in CG */
+		bamInt(next, (l_seq << 4) | 4);
+		bamInt(next + 4, (rlen << 4) | 3);
+		next += 8;
+	}
+	for(i = 0; i < l_seq - 1; i += 2) {
+		*next++ = (bamNt[seq[i]] << 4) | bamNt[seq[i + 1]];
+	}
+	if(i < l_seq) {
+		*next++ = bamNt[seq[i]] << 4;
+	}
+	if(Qual && Qual->seq) {
+		qual = Qual->seq;
+		for(i = 0; i < l_seq; ++i) {
+			*next++ = qual[i] - 33;
+		}
+	} else {
+		memset(next, 255, l_seq);
+		next += l_seq;
+	}
+	memcpy(next, "ETi", 3);
+	bamInt(next + 3, et);
+	memcpy(next + 7, "ASi", 3);
+	bamInt(next + 10, score);
+	next += 14;
+	if(65535 < n_cigar) {
+		memcpy(next, "CGBI", 4);
+		bamInt(next + 4, n_cigar);
+		next += 8;
+		memcpy(next, Cigar->seq, n_cigar << 2);
+		next += n_cigar << 2;
+	}
+	size = next - rec;
+	bamInt(rec, size - 4);
+	bgzfWrite(samOut, rec, size);
+	unlock(lock);
+	
+	return size;
+}
+
 void saminit(Qseqs *template_name, FILE *name_file, int *template_lengths, int DB_size, char *cmd) {
 	
-	fprintf(stdout, "@HD\tVN:1.6\tGO:reference\n");
+	int len;
+	char *name, *text;
+	Qseqs *line;
+	
+	if(bamThreads) {
+		baminit(template_name, name_file, template_lengths, DB_size, cmd);
+		return;
+	}
+	/* header goes through the same writer as the records */
+	if(!samOut) {
+		samOut = bgzfOpen(stdout, 0, 0, 1);
+	}
+	line = setQseqs(256 + (cmd ? strlen(cmd) : 0));
+	text = (char *) line->seq;
+	len = sprintf(text, "@HD\tVN:1.6\tGO:reference\n");
 	if(cmd) {
-		fprintf(stdout, "@PG\tID:KMA\tPN:kma\tVN:%s\tCL:%s\n", KMA_VERSION, cmd);
+		len += sprintf(text + len, "@PG\tID:KMA\tPN:kma\tVN:%s\tCL:%s\n", KMA_VERSION, cmd);
 	} else {
-		fprintf(stdout, "@PG\tID:KMA\tPN:kma\tVN:%s\n", KMA_VERSION);
+		len += sprintf(text + len, "@PG\tID:KMA\tPN:kma\tVN:%s\n", KMA_VERSION);
 	}
+	bgzfWrite(samOut, text, len);
 	while(--DB_size) {
-		fprintf(stdout, "@SQ\tSN:%s\tLN:%d\n", nameLoad(template_name, name_file), *++template_lengths);
+		name = nameLoad(template_name, name_file);
+		if(line->size < (len = strlen(name) + 32)) {
+			destroyQseqs(line);
+			line = setQseqs(len << 1);
+			text = (char *) line->seq;
+		}
+		len = sprintf(text, "@SQ\tSN:%s\tLN:%d\n", name, *++template_lengths);
+		bgzfWrite(samOut, text, len);
 	}
+	destroyQseqs(line);
 	sfseek(name_file, 0, SEEK_SET);
 }
 
@@ -115,7 +478,7 @@ int samwrite(const Qseqs *qseq, const Qseqs *header, const Qseqs *Qual, char *rn
 	
 	static volatile int Lock = 0;
 	volatile int *lock = &Lock;
-	static Qseqs *Cigar = 0;
+	static Qseqs *Cigar = 0, *Line = 0;
 	int flag, pos, mapQ, pnext, tlen, size, et, score, tab;
 	char *qname, *cigar, *rnext, *qual;
 	unsigned char *seq;
@@ -150,6 +513,10 @@ int samwrite(const Qseqs *qseq, const Qseqs *header, const Qseqs *Qual, char *rn
 	*/
 	
 	
+	if(samOut && bamThreads) {
+		return bamwrite(qseq, header, Qual, rname, aligned, stats);
+	}
+	
 	qname = (char *) header->seq;
 	seq = qseq->seq;
 	if(Qual) {
@@ -197,11 +564,21 @@ int samwrite(const Qseqs *qseq, const Qseqs *header, const Qseqs *Qual, char *rn
 	lock(lock);
 	if(Cigar == 0) {
 		Cigar = setQseqs(256);
+		Line = setQseqs(1024);
 	}
 	if(aligned) {
 		cigar = makeCigar(Cigar, aligned);
 	}
-	size = fprintf(stdout, "%s\t%d\t%s\t%d\t%d\t%s\t%s\t%d\t%d\t%s\t%s\tET:i:%d\tAS:i:%d\n", qname, flag, rname, pos, mapQ, cigar, rnext, pnext, tlen, (char *) seq, qual, et, score);
+	if(samOut) {
+		/* format, and let the writer thread do the io */
+		while(Line->size <= (size = snprintf((char *) Line->seq, Line->size, "%s\t%d\t%s\t%d\t%d\t%s\t%s\t%d\t%d\t%s\t%s\tET:i:%d\tAS:i:%d\n", qname, flag, rname, pos, mapQ, cigar, rnext, pnext, tlen, (char *) seq, qual, et, score))) {
+			destroyQseqs(Line);
+			Line = setQseqs(size << 1);
+		}
+		bgzfWrite(samOut, Line->seq, size);
+	} else {
+		size = fprintf(stdout, "%s\t%d\t%s\t%d\t%d\t%s\t%s\t%d\t%d\t%s\t%s\tET:i:%d\tAS:i:%d\n", qname, flag, rname, pos, mapQ, cigar, rnext, pnext, tlen, (char *) seq, qual, et, score);
+	}
 	unlock(lock);
 	if(tab < 0) {
 		qname[-tab] = '\t';
@@ -209,3 +586,21 @@ int samwrite(const Qseqs *qseq, const Qseqs *header, const Qseqs *Qual, char *rn
 	
 	return size;
 }
+
+int samclose() {
+	
+	int i, status;
+	
+	if(!samOut) {
+		return 0;
+	}
+	status = bgzfClose(samOut);
+	samOut = 0;
+	for(i = 0; i < refNum; ++i) {
+		free(refNames[i]);
+	}
+	free(refNames);
+	free(refHash);
+	
+	return status;
+}
@@ -22,9 +22,12 @@
 #include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "ankers.h"
 #include "compdna.h"
 #include "hashmapkma.h"
+#include "kmastat.h"
+#include "kmatrace.h"
 #include "kmeranker.h"
 #include "penalties.h"
 #include "pherror.h"
@@ -46,12 +49,284 @@ int (*getSecondForce)(int*, int*, int*, int*, int*, int*) = &getSecondBestForce;
 int (*getSecondPen)(int*, int*, int*, int*, int*, int*, int, int) = &getSecondBestPen;
 int (*getF)(int*, int*, int*, int*, int*) = &getF_Best;
 int (*getR)(int*, int*, int*, int*, int*) = &getR_Best;
+static unsigned quickProbes = UINT_MAX;
+static int seedStride = 0;
+static unsigned dupMask = 0;
+static DupRead **dupTable = 0;
+static volatile int *dupLocks = 0;
+static double satDepth = 0;
+static const int *satLengths = 0;
+static int satSize = 0, satRankLen = 0, *satRank = 0;
+static long unsigned satReads = 0, *satBases = 0;
+static volatile int satLock = 0, satDone = 0;
+
+void setQuickProbes(unsigned probes) {
+	
+	/* drop reads whose first probes of the quick check all miss */
+	quickProbes = probes ? probes : UINT_MAX;
+}
+
+void setSeedStride(int stride) {
+	
+	/* only probe every stride'th k-mer between ankers in save_kmers_chain */
+	seedStride = 1 < stride ? stride : 0;
+}
+
+void setDupReads(unsigned size) {
+	
+	unsigned i;
+	
+	/* cache of the last reads, duplicates reuse their k-mer mapping */
+	if(dupTable) {
+		i = dupMask + 1;
+		while(i--) {
+			free(dupTable[i]);
+		}
+		free(dupTable);
+		free((void *)(dupLocks));
+		dupTable = 0;
+		dupLocks = 0;
+	}
+	if(size) {
+		dupMask = 1;
+		while(dupMask < size) {
+			dupMask <<= 1;
+		}
+		dupTable = calloc(dupMask, sizeof(DupRead *));
+		dupLocks = calloc(dupMask, sizeof(int));
+		if(!dupTable || !dupLocks) {
+			ERROR();
+		}
+		--dupMask;
+	}
+}
+
+static unsigned dupSlot(const CompDNA *qseq) {
+	
+	int i;
+	long unsigned h;
+	
+	h = qseq->seqlen;
+	for(i = 0; i < qseq->complen; ++i) {
+		h = (h ^ qseq->seq[i]) * 0x9E3779B97F4A7C15;
+	}
+	for(i = 1; i <= *(qseq->N); ++i) {
+		h = (h ^ qseq->N[i]) * 0x9E3779B97F4A7C15;
+	}
+	
+	return (h ^ (h >> 32)) & dupMask;
+}
+
+static DupRead * dupRead_init(const CompDNA *qseq, const Qseqs *header) {
+	
+	DupRead *dest;
+	
+	/* key is copied before the scan, as it may alter qseq */
+	dest = smalloc(sizeof(DupRead) + qseq->complen * sizeof(long unsigned) + *(qseq->N) * sizeof(int) + header->len);
+	dest->seqlen = qseq->seqlen;
+	dest->complen = qseq->complen;
+	dest->N = *(qseq->N);
+	dest->unmapped = 0;
+	dest->h_len = header->len;
+	dest->len = 0;
+	dest->seq = (long unsigned *)(dest + 1);
+	dest->header = (unsigned char *)(dest->seq + dest->complen) + dest->N * sizeof(int);
+	dest->rec = 0;
+	memcpy(dest->seq, qseq->seq, qseq->complen * sizeof(long unsigned));
+	memcpy(dest->seq + qseq->complen, qseq->N + 1, *(qseq->N) * sizeof(int));
+	memcpy(dest->header, header->seq, header->len);
+	
+	return dest;
+}
+
+static int dupRead_get(const CompDNA *qseq, const Qseqs *header, unsigned slot, int *unmapped, FILE *out) {
+	
+	int p, h_len, info[7];
+	long unsigned pos, size;
+	DupRead *src;
+	
+	lock(dupLocks + slot);
+	src = dupTable[slot];
+	if(!src || src->seqlen != qseq->seqlen || src->complen != qseq->complen || src->N != *(qseq->N) || memcmp(src->seq, qseq->seq, src->complen * sizeof(long unsigned)) || memcmp(src->seq + src->complen, qseq->N + 1, src->N * sizeof(int))) {
+		unlock(dupLocks + slot);
+		return 0;
+	}
+	
+	/*
+	reprint records, swapping the part of the stored header kept
+	in front of any bounds the scan added for this header.
+	*/
+	pos = 0;
+	while(pos < src->len) {
+		memcpy(info, src->rec + pos, 7 * sizeof(int));
+		size = 7 * sizeof(int) + info[1] * sizeof(long unsigned) + (info[2] + info[4]) * sizeof(int);
+		h_len = info[5];
+		for(p = 0; p < h_len && p < src->h_len && src->rec[pos + size + p] == src->header[p]; ++p);
+		info[5] += header->len - src->h_len;
+		sfwrite(info, sizeof(int), 7, out);
+		sfwrite(src->rec + pos + 7 * sizeof(int), 1, size - 7 * sizeof(int), out);
+		sfwrite(header->seq, 1, header->len - src->h_len + p, out);
+		sfwrite(src->rec + pos + size + p, 1, h_len - p, out);
+		pos += size + h_len;
+	}
+	*unmapped = src->unmapped;
+	unlock(dupLocks + slot);
+	
+	return 1;
+}
+
+static void dupRead_put(DupRead *src, unsigned slot, int unmapped, const unsigned char *rec, long unsigned len) {
+	
+	DupRead *dest;
+	
+	dest = realloc(src, sizeof(DupRead) + src->complen * sizeof(long unsigned) + src->N * sizeof(int) + src->h_len + len);
+	if(!dest) {
+		ERROR();
+	}
+	dest->unmapped = unmapped;
+	dest->len = len;
+	dest->seq = (long unsigned *)(dest + 1);
+	dest->header = (unsigned char *)(dest->seq + dest->complen) + dest->N * sizeof(int);
+	dest->rec = dest->header + dest->h_len;
+	memcpy(dest->rec, rec, len);
+	
+	lock(dupLocks + slot);
+	src = dupTable[slot];
+	dupTable[slot] = dest;
+	unlock(dupLocks + slot);
+	free(src);
+}
+
+void setSaturation(double depth) {
+	
+	/* stop mapping once the leading templates reach depth */
+	satDepth = depth;
+}
+
+void saturation_init(const int *template_lengths, int DB_size) {
+	
+	free(satBases);
+	free(satRank);
+	satBases = 0;
+	satRank = 0;
+	satLengths = 0;
+	satSize = 0;
+	satRankLen = 0;
+	satReads = 0;
+	satDone = 0;
+	if(0 < satDepth && template_lengths) {
+		satLengths = template_lengths;
+		satSize = DB_size;
+		satBases = calloc(DB_size, sizeof(long unsigned));
+		satRank = smalloc(DB_size * sizeof(int));
+		if(!satBases) {
+			ERROR();
+		}
+	}
+}
+
+static void saturation_check() {
+	
+	int i, n, stable, saturated;
+	double depth, best;
+	
+	/*
+	candidates are templates within a tenth of the best depth, mapping
+	stops when they all reached satDepth and the set of candidates did
+	not change since the last check.
+	*/
+	best = 0;
+	for(i = 1; i < satSize; ++i) {
+		if(satLengths[i] && best < (depth = (double)(satBases[i]) / satLengths[i])) {
+			best = depth;
+		}
+	}
+	n = 0;
+	stable = 1;
+	saturated = satDepth <= best;
+	for(i = 1; i < satSize && saturated; ++i) {
+		if(satLengths[i] && best <= 10 * (depth = (double)(satBases[i]) / satLengths[i])) {
+			saturated = satDepth <= depth;
+			stable &= (n < satRankLen && satRank[n] == i);
+			satRank[n++] = i;
+		}
+	}
+	
+	if(saturated && stable && n == satRankLen) {
+		satDone = 1;
+		fprintf(stderr, "# Depth saturated at %lu fragments, skipping the rest.\n", satReads);
+	} else {
+		satRankLen = saturated ? n : 0;
+	}
+}
+
+static void saturation_add(const unsigned char *rec, long unsigned len) {
+	
+	int i, template, info[7];
+	long unsigned pos, bases;
+	
+	/* add read lengths to the templates of printed ankers */
+	pos = 0;
+	bases = 0;
+	while(pos < len) {
+		memcpy(info, rec + pos, 7 * sizeof(int));
+		pos += 7 * sizeof(int) + info[1] * sizeof(long unsigned) + info[2] * sizeof(int);
+		bases += info[0];
+		for(i = 0; i < info[4]; ++i) {
+			memcpy(&template, rec + pos + i * sizeof(int), sizeof(int));
+			template = abs(template);
+			if(template < satSize) {
+				__sync_add_and_fetch(satBases + template, bases);
+			}
+		}
+		if(info[4]) {
+			bases = 0;
+		}
+		pos += info[4] * sizeof(int) + info[5];
+	}
+	
+	if(__sync_add_and_fetch(&satReads, 1) % SATCHECK == 0 && __sync_bool_compare_and_swap(&satLock, 0, 1)) {
+		saturation_check();
+		__sync_lock_release(&satLock);
+	}
+}
+
+static int seekAnker(const HashMapKMA *templates, const long unsigned *seq, int pos, int dir, int len, int stride) {
+	
+	int i, cPos, iPos, mPos, hLen, shifter, mlen;
+	long unsigned kmer, cmer, mmask;
+	
+	/* return offset of the first probed hit, or len */
+	shifter = 64 - (templates->kmersize << 1);
+	mlen = templates->mlen;
+	mmask = 0xFFFFFFFFFFFFFFFF >> (64 - (mlen << 1));
+	hLen = templates->kmersize;
+	for(i = 0; i < len; i += stride) {
+		getKmer_macro(kmer, seq, (pos + dir * i), cPos, iPos, shifter);
+		cmer = templates->flag ? getCmer(kmer, &mPos, &hLen, shifter, mlen, mmask) : kmer;
+		if(hashMap_get(templates, cmer)) {
+			return i;
+		}
+	}
+	
+	return len;
+}
+
+static void checkFsaInfo(const int *info) {
+	
+	/* the parsed input may come over a connection, trust no length in it */
+	if(info[0] < 0 || (INT_MAX >> 1) <= info[0] || info[1] != (info[0] >> 5) + ((info[0] & 31) ? 1 : 0) || info[2] < 0 || info[0] < info[2] || info[3] == 0 || info[3] == INT_MIN || (INT_MAX >> 1) <= abs(info[3])) {
+		fprintf(stderr, "Malformed parsed input.\n");
+		exit(1);
+	}
+}
 
 int loadFsa(CompDNA *qseq, Qseqs *header, FILE *inputfile) {
 	
 	int buffer[4];
 	
-	if(fread(buffer, sizeof(int), 4, inputfile)) {
+	if(fread(buffer, sizeof(int), 4, inputfile) == 4) {
+		checkFsaInfo(buffer);
 		qseq->seqlen = buffer[0];
 		qseq->complen = buffer[1];
 		/* if pair, header->len < 0 */
@@ -91,21 +366,175 @@ int loadFsa(CompDNA *qseq, Qseqs *header, FILE *inputfile) {
 	return buffer[3];
 }
 
+ReadBatch * readBatch_init(int size) {
+	
+	ReadBatch *dest;
+	
+	dest = smalloc(sizeof(ReadBatch));
+	dest->num = 0;
+	dest->next = 0;
+	dest->size = size;
+	dest->readNum = 0;
+	/* room for the mate of a pair ending the batch */
+	dest->info = smalloc(((size + 1) << 2) * sizeof(int));
+	dest->seqLen = 0;
+	dest->seqSize = size << 3;
+	dest->seqPos = 0;
+	dest->seq = smalloc(dest->seqSize * sizeof(long unsigned));
+	dest->NLen = 0;
+	dest->NSize = size;
+	dest->NPos = 0;
+	dest->N = smalloc(dest->NSize * sizeof(int));
+	dest->headerLen = 0;
+	dest->headerSize = size << 6;
+	dest->headerPos = 0;
+	dest->header = smalloc(dest->headerSize);
+	
+	return dest;
+}
+
+void readBatch_destroy(ReadBatch *batch) {
+	
+	free(batch->info);
+	free(batch->seq);
+	free(batch->N);
+	free(batch->header);
+	free(batch);
+}
+
+int loadFsaBatch(ReadBatch *batch, FILE *inputfile) {
+	
+	int frags, *info;
+	long unsigned len;
+	
+	/* load a batch of reads, without splitting pairs */
+	frags = 0;
+	batch->num = 0;
+	batch->next = 0;
+	batch->seqLen = 0;
+	batch->seqPos = 0;
+	batch->NLen = 0;
+	batch->NPos = 0;
+	batch->headerLen = 0;
+	batch->headerPos = 0;
+	info = batch->info;
+	while(((batch->num < batch->size && batch->seqLen < READBATCHWORDS) || (batch->num && info[-1] < 0)) && fread(info, sizeof(int), 4, inputfile) == 4) {
+		checkFsaInfo(info);
+		/* make room */
+		if(batch->seqSize < (len = batch->seqLen + info[1])) {
+			batch->seqSize = len << 1;
+			batch->seq = realloc(batch->seq, batch->seqSize * sizeof(long unsigned));
+			if(!batch->seq) {
+				ERROR();
+			}
+		}
+		if(batch->NSize < (len = batch->NLen + info[2])) {
+			batch->NSize = len << 1;
+			batch->N = realloc(batch->N, batch->NSize * sizeof(int));
+			if(!batch->N) {
+				ERROR();
+			}
+		}
+		if(batch->headerSize < (len = batch->headerLen + abs(info[3]))) {
+			batch->headerSize = len << 1;
+			batch->header = realloc(batch->header, batch->headerSize);
+			if(!batch->header) {
+				ERROR();
+			}
+		}
+		
+		sfread(batch->seq + batch->seqLen, sizeof(long unsigned), info[1], inputfile);
+		sfread(batch->N + batch->NLen, sizeof(int), info[2], inputfile);
+		sfread(batch->header + batch->headerLen, 1, abs(info[3]), inputfile);
+		batch->seqLen += info[1];
+		batch->NLen += info[2];
+		batch->headerLen += abs(info[3]);
+		
+		/* mates count as one fragment */
+		if(0 <= info[3]) {
+			++frags;
+		}
+		++batch->num;
+		info += 4;
+	}
+	
+	return frags;
+}
+
+int batchFsa(CompDNA *qseq, Qseqs *header, ReadBatch *batch) {
+	
+	int *info;
+	
+	if(batch->next == batch->num) {
+		qseq->seqlen = 0;
+		return 0;
+	}
+	info = batch->info + (batch->next++ << 2);
+	qseq->seqlen = info[0];
+	qseq->complen = info[1];
+	/* if pair, header->len < 0 */
+	header->len = abs(info[3]);
+	
+	if(qseq->size <= qseq->seqlen) {
+		free(qseq->N);
+		free(qseq->seq);
+		if(qseq->seqlen & 31) {
+			qseq->size = (qseq->seqlen >> 5) + 1;
+			qseq->size <<= 6;
+		} else {
+			qseq->size = qseq->seqlen << 1;
+		}
+		
+		qseq->seq = calloc(qseq->size >> 5, sizeof(long unsigned));
+		qseq->N = malloc((qseq->size + 1) * sizeof(int));
+		if(!qseq->seq || !qseq->N) {
+			ERROR();
+		}
+	}
+	qseq->N[0] = info[2];
+	
+	if(header->size <= header->len) {
+		header->size = header->len << 1;
+		free(header->seq);
+		header->seq = smalloc(header->size);
+	}
+	memcpy(qseq->seq, batch->seq + batch->seqPos, qseq->complen * sizeof(long unsigned));
+	memcpy(qseq->N + 1, batch->N + batch->NPos, qseq->N[0] * sizeof(int));
+	memcpy(header->seq, batch->header + batch->headerPos, header->len);
+	batch->seqPos += qseq->complen;
+	batch->NPos += qseq->N[0];
+	batch->headerPos += header->len;
+	
+	return info[3];
+}
+
 void * save_kmers_threaded(void *arg) {
 	
 	static volatile int Lock[2] = {0, 0};
 	static unsigned readNum = 0;
-	volatile int *excludeIn = &Lock[0], *excludeOut = &Lock[1];
+	volatile int *excludeIn = &Lock[0], *excludeOut = &Lock[1], outLock = 0;
 	KmerScan_thread *thread = arg;
 	int *Score, *Score_r, *bestTemplates, *bestTemplates_r, *regionTemplates;
 	int *regionScores, *extendScore, *p_readNum, *pr_readNum, *preg_readNum;
-	int go, exhaustive, unmapped, sam, flag, cflag, stats[2];;
+	int go, frags, exhaustive, unmapped, sam, flag, cflag, stats[2];;
+	unsigned slot;
+	long unsigned cpu[STAT_TIMER], t_batch, t_read, len;
 	FILE *inputfile, *out;
 	HashMapKMA *templates;
 	CompDNA *qseq, *qseq_r;
 	Qseqs *header, *header_r, *samseq;
 	Penalties *rewards;
+	ReadBatch *batch;
+	AnkerBuff *outBuff;
+	DupRead *dup;
+	
+	/* new input */
+	if(!thread) {
+		readNum = 0;
+		return NULL;
+	}
 	
+	kmaStat_start(cpu);
 	stats[0] = 0;
 	templates = thread->templates;
 	exhaustive = thread->exhaustive;
@@ -142,6 +571,7 @@ void * save_kmers_threaded(void *arg) {
 	header_r = setQseqs(256);
 	allocComp(qseq, 1024);
 	allocComp(qseq_r, 1024);
+	batch = readBatch_init(READBATCH);
 	regionTemplates = smalloc(((templates->DB_size << 1) + 4) * sizeof(int));
 	Score = calloc(templates->DB_size, sizeof(int));
 	Score_r = calloc(templates->DB_size, sizeof(int));
@@ -160,6 +590,13 @@ void * save_kmers_threaded(void *arg) {
 	*bestTemplates_r++ = 0;
 	*regionTemplates++ = 0;
 	out = thread->out;
+	/* buffer stateless output privately */
+	if((printPtr == &print_ankers || printPtr == &print_ankers_Sparse) && (outBuff = ankerBuff_init(out, excludeOut))) {
+		out = outBuff->sink;
+		excludeOut = &outLock;
+	} else {
+		outBuff = 0;
+	}
 	if((sam = thread->sam)) {
 		samseq = setQseqs(256);
 	} else {
@@ -171,21 +608,33 @@ void * save_kmers_threaded(void *arg) {
 	preg_readNum = (regionTemplates - 1);
 	
 	go = 1;
+	t_batch = 0;
 	while(go != 0) {
+		/* load batch of qseqs, and reserve their read numbers */
+		if(batch->next == batch->num) {
+			kmaTrace_end("map batch", "batch", t_batch, -1);
+			t_read = kmaTrace_begin();
+			lock(excludeIn);
+			frags = loadFsaBatch(batch, inputfile);
+			batch->readNum = readNum;
+			readNum += frags;
+			unlock(excludeIn);
+			kmaTrace_end("read batch", "io", t_read, frags);
+			t_batch = frags ? kmaTrace_begin() : 0;
+		}
+		
 		/* load qseqs */
-		lock(excludeIn);
-		if((go = loadFsa(qseq, header, inputfile)) < 0) {
+		if((go = batchFsa(qseq, header, batch)) < 0) {
 			/* PE */
-			loadFsa(qseq_r, header_r, inputfile);
+			batchFsa(qseq_r, header_r, batch);
 		}
 		if(go != 0) {
-			*p_readNum = ++readNum;
+			*p_readNum = ++batch->readNum;
 		} else {
-			*p_readNum = readNum;
+			*p_readNum = batch->readNum;
 		}
-		unlock(excludeIn);
-		*pr_readNum = readNum;
-		*preg_readNum = readNum;
+		*pr_readNum = *p_readNum;
+		*preg_readNum = *p_readNum;
 		
 		/* allocate memory */
 		if(qseq_r->size < qseq->size && 0 < go) {
@@ -194,13 +643,26 @@ void * save_kmers_threaded(void *arg) {
 		}
 		
 		/* find ankers */
-		if(0 < go) {
+		len = outBuff ? outBuff->len : 0;
+		if(satDone) {
+			unmapped = 0;
+		} else if(0 < go && dupTable && outBuff) {
+			slot = dupSlot(qseq);
+			if(!dupRead_get(qseq, header, slot, &unmapped, out)) {
+				dup = dupRead_init(qseq, header);
+				unmapped = kmerScan(templates, rewards, bestTemplates, bestTemplates_r, Score, Score_r, qseq, qseq_r, header, extendScore, exhaustive, excludeOut, out);
+				dupRead_put(dup, slot, unmapped, outBuff->buff + len, outBuff->len - len);
+			}
+		} else if(0 < go) {
 			unmapped = kmerScan(templates, rewards, bestTemplates, bestTemplates_r, Score, Score_r, qseq, qseq_r, header, extendScore, exhaustive, excludeOut, out);
 		} else if(go < 0) {
 			unmapped = save_kmers_pair(templates, rewards, bestTemplates, bestTemplates_r, Score, Score_r, regionTemplates, regionScores, qseq, qseq_r, header, header_r, extendScore, exhaustive, excludeOut, out);
 		} else {
 			unmapped = 0;
 		}
+		if(0 < go && satBases && outBuff && !satDone) {
+			saturation_add(outBuff->buff + len, outBuff->len - len);
+		}
 		
 		if(sam && unmapped) {
 			if(unmapped & 1) {
@@ -246,6 +708,9 @@ void * save_kmers_threaded(void *arg) {
 				samwrite(samseq, header_r, 0, 0, 0, stats);
 			}
 		}
+		if(outBuff) {
+			ankerBuff_drain(outBuff, 0);
+		}
 	}
 	
 	/* clean up */
@@ -263,9 +728,15 @@ void * save_kmers_threaded(void *arg) {
 	free(qseq_r);
 	destroyQseqs(header);
 	destroyQseqs(header_r);
+	readBatch_destroy(batch);
+	if(outBuff) {
+		ankerBuff_destroy(outBuff);
+	}
 	free(regionTemplates - 3);
 	free(Score);
 	free(Score_r);
+	kmaStat_flush();
+	kmaStat_cpu(STAT_MAPPING, cpu);
 	
 	return NULL;
 }
@@ -416,6 +887,14 @@ static int clearScore(int *bestTemplates, int *Score) {
 	
 	int i;
 	
+	/* touched templates are cleared one by one, unless they make up a 
+	   large part of the DB where a dense reset is cheaper. 
+	   bestTemplates is prefixed by DB_size, and Score[0] holds the 
+	   thread number, see save_kmers_threaded */
+	if(bestTemplates[-3] >> SCOREDENSE < *bestTemplates) {
+		memset(Score + 1, 0, (bestTemplates[-3] - 1) * sizeof(int));
+		return 0;
+	}
 	i = *bestTemplates + 1;
 	while(--i) {
 		Score[*++bestTemplates] = 0;
@@ -424,14 +903,54 @@ static int clearScore(int *bestTemplates, int *Score) {
 	return 0;
 }
 
+int getKmerBatch(const HashMapKMA *templates, unsigned **values, const long unsigned *seq, int pos, int end, long unsigned *kmer, long unsigned *cmer, const long unsigned mask, const int flag, int *mPos, long unsigned *hmer, int *hLen, const int kmersize, const int mlen, const long unsigned mmask) {
+	
+	int i, n, m, keyPos[HASHMAPBATCH];
+	unsigned *found[HASHMAPBATCH];
+	long unsigned Kmer, Cmer, keys[HASHMAPBATCH];
+	
+	/* get the next k-mers, and look them up in one go */
+	Kmer = *kmer;
+	Cmer = *cmer;
+	if(flag) {
+		/* neighbouring k-mers mostly share their minimizer or 
+		   homopolymer compression, only look up the changes */
+		m = 0;
+		*keys = ~Cmer;
+		for(n = 0; n < HASHMAPBATCH && pos < end; ++n, ++pos) {
+			Kmer = updateKmer_macro(Kmer, seq, pos, mask);
+			Cmer = updateCmer(Cmer, mPos, hmer, hLen, Kmer, kmersize, mlen, mmask);
+			if(m == 0 || keys[m - 1] != Cmer) {
+				keys[m++] = Cmer;
+			}
+			keyPos[n] = m - 1;
+		}
+		hashMap_getBatch(templates, keys, m, found);
+		for(i = 0; i < n; ++i) {
+			values[i] = found[keyPos[i]];
+		}
+	} else {
+		for(n = 0; n < HASHMAPBATCH && pos < end; ++n, ++pos) {
+			Kmer = updateKmer_macro(Kmer, seq, pos, mask);
+			keys[n] = Kmer;
+		}
+		hashMap_getBatch(templates, keys, n, values);
+		Cmer = Kmer;
+	}
+	*kmer = Kmer;
+	*cmer = Cmer;
+	
+	return n;
+}
+
 int get_kmers_for_pair(const HashMapKMA *templates, const Penalties *rewards, int *bestTemplates, int *bestTemplates_r, int *Score, int *Score_r, CompDNA *qseq, int *extendScore, const int exhaustive) {
 	
 	/* save_kmers find ankering k-mers the in query sequence,
 	   and is the time determining step */
-	int i, j, l, rc, end, HIT, gaps, score, Ms, MMs, Us, W1s, template, flag;
-	int hitCounter, bestSeqCount, kmersize, mlen, SU, shifter, W1, U, M, MM;
+	int i, j, b, bn, l, rc, end, HIT, gaps, score, Ms, MMs, Us, W1s, template, flag;
+	int hitCounter, bestSeqCount, kmersize, mlen, SU, shifter, W1, U, M, MM, skip;
 	int n, cPos, iPos, mPos, hLen, seqend, j_u, m, mm, *bests, *Scores;
-	unsigned *values, *last;
+	unsigned *values, *last, *Values[HASHMAPBATCH], probes;
 	short unsigned *values_s;
 	long unsigned mask, mmask, kmer, cmer, hmer, *seq;
 	char *include;
@@ -453,6 +972,8 @@ int get_kmers_for_pair(const HashMapKMA *templates, const Penalties *rewards, in
 	M = rewards->M;
 	MM = rewards->MM;
 	*extendScore = 0;
+	/* a negative count on entry skips that strand */
+	skip = (*bestTemplates < 0) | ((*bestTemplates_r < 0) << 1);
 	*bestTemplates = 0;
 	*bestTemplates_r = 0;
 	bests = bestTemplates;
@@ -470,15 +991,19 @@ int get_kmers_for_pair(const HashMapKMA *templates, const Penalties *rewards, in
 			Scores = Score_r;
 			comp_rc(qseq);
 		}
+		if(skip & (1 << rc)) {
+			continue;
+		}
 		/* Make quick check of the qseq */
 		HIT = exhaustive;
 		hitCounter = 0;
 		j = 0;
 		qseq->N[0]++;
 		qseq->N[qseq->N[0]] = qseq->seqlen;
+		probes = quickProbes;
 		for(i = 1; i <= qseq->N[0] && !HIT; ++i) {
 			end = qseq->N[i] - kmersize + 1;
-			for(; j < end && !HIT; j += kmersize) {
+			for(; j < end && !HIT && probes; j += kmersize, --probes) {
 				getKmer_macro(kmer, seq, j, cPos, iPos, shifter);
 				cmer = flag ? getCmer(kmer, &mPos, &hLen, shifter, mlen, mmask) : kmer;
 				if(hashMap_get(templates, cmer)) {
@@ -504,12 +1029,15 @@ int get_kmers_for_pair(const HashMapKMA *templates, const Penalties *rewards, in
 				getKmer_macro(kmer, seq, j, cPos, iPos, (shifter + 2));
 				cmer = flag ? initCmer(kmer, &mPos, &hmer, &hLen, shifter + 2, kmersize, mlen, mmask) : kmer;
 				end = qseq->N[i];
+				b = 0;
+				bn = 0;
 				for(j_u = j + kmersize - 1; j_u < end; ++j_u) {
-					/* update k-mer */
-					kmer = updateKmer_macro(kmer, seq, j_u, mask);
-					cmer = flag ? updateCmer(cmer, &mPos, &hmer, &hLen, kmer, kmersize, mlen, mmask) : kmer;
-					/* lookup */
-					if((values = hashMap_get(templates, cmer))) {
+					/* update k-mers and lookup in batches */
+					if(b == bn) {
+						bn = getKmerBatch(templates, Values, seq, j_u, end, &kmer, &cmer, mask, flag, &mPos, &hmer, &hLen, kmersize, mlen, mmask);
+						b = 0;
+					}
+					if((values = Values[b++])) {
 						if(values == last) {
 							/*
 							gaps == 0 -> Match
@@ -691,10 +1219,10 @@ int get_kmers_for_pair_count(const HashMapKMA *templates, const Penalties *rewar
 	
 	/* save_kmers find ankering k-mers the in query sequence,
 	   and is the time determining step */
-	int i, j, rc, end, HIT, hitCounter, bestSeqCount, reps, SU, kmersize;
-	int shifter, mlen, flag, n, cPos, iPos, mPos, hLen, seqend;
+	int i, j, b, bn, rc, end, HIT, hitCounter, bestSeqCount, reps, SU, kmersize;
+	int shifter, mlen, flag, n, cPos, iPos, mPos, hLen, seqend, skip;
 	int *bests, *Scores;
-	unsigned *values, *last;
+	unsigned *values, *last, *Values[HASHMAPBATCH], probes;
 	short unsigned *values_s;
 	long unsigned mask, mmask, kmer, cmer, hmer, *seq;
 	
@@ -707,6 +1235,7 @@ int get_kmers_for_pair_count(const HashMapKMA *templates, const Penalties *rewar
 	}
 	
 	*extendScore = 0;
+	skip = (*bestTemplates < 0) | ((*bestTemplates_r < 0) << 1);
 	*bestTemplates = 0;
 	*bestTemplates_r = 0;
 	bests = bestTemplates;
@@ -727,15 +1256,19 @@ int get_kmers_for_pair_count(const HashMapKMA *templates, const Penalties *rewar
 			Scores = Score_r;
 			comp_rc(qseq);
 		}
+		if(skip & (1 << rc)) {
+			continue;
+		}
 		/* Make quick check of the qseq */
 		HIT = exhaustive;
 		hitCounter = 0;
 		j = 0;
 		qseq->N[0]++;
 		qseq->N[qseq->N[0]] = qseq->seqlen;
+		probes = quickProbes;
 		for(i = 1; i <= qseq->N[0] && !HIT; ++i) {
 			end = qseq->N[i] - kmersize + 1;
-			for(; j < end && !HIT; j += kmersize) {
+			for(; j < end && !HIT && probes; j += kmersize, --probes) {
 				getKmer_macro(kmer, seq, j, cPos, iPos, shifter);
 				cmer = flag ? getCmer(kmer, &mPos, &hLen, shifter, mlen, mmask) : kmer;
 				if(hashMap_get(templates, cmer)) {
@@ -756,12 +1289,15 @@ int get_kmers_for_pair_count(const HashMapKMA *templates, const Penalties *rewar
 				getKmer_macro(kmer, seq, j, cPos, iPos, (shifter + 2));
 				cmer = flag ? initCmer(kmer, &mPos, &hmer, &hLen, shifter + 2, kmersize, mlen, mmask) : kmer;
 				end = qseq->N[i];
+				b = 0;
+				bn = 0;
 				for(j += kmersize - 1; j < end; ++j) {
-					/* update k-mer */
-					kmer = updateKmer_macro(kmer, seq, j, mask);
-					cmer = flag ? updateCmer(cmer, &mPos, &hmer, &hLen, kmer, kmersize, mlen, mmask) : kmer;
-					/* lookup */
-					if((values = hashMap_get(templates, cmer))) {
+					/* update k-mers and lookup in batches */
+					if(b == bn) {
+						bn = getKmerBatch(templates, Values, seq, j, end, &kmer, &cmer, mask, flag, &mPos, &hmer, &hLen, kmersize, mlen, mmask);
+						b = 0;
+					}
+					if((values = Values[b++])) {
 						if(values == last) {
 							++reps;
 						} else {
@@ -827,7 +1363,7 @@ int get_kmers_for_pair_Sparse(const HashMapKMA *templates, const Penalties *rewa
 	
 	int i, j, n, end, rc, prefix_len, hitCounter, reps, n_kmers, kmersize;
 	int HIT, SU, mlen, flag, cPos, iPos, mPos, hLen, seqend, *bests, *Scores;
-	unsigned shifter, prefix_shifter, *values, *last;
+	unsigned shifter, prefix_shifter, *values, *last, probes;
 	short unsigned *values_s;
 	long unsigned pmask, mask, mmask, prefix, pmer, kmer, cmer, hmer, *seq;
 	
@@ -917,9 +1453,10 @@ int get_kmers_for_pair_Sparse(const HashMapKMA *templates, const Penalties *rewa
 		j = 0;
 		qseq->N[0]++;
 		qseq->N[qseq->N[0]] = qseq->seqlen;
+		probes = quickProbes;
 		for(i = 1; i <= qseq->N[0] && !HIT; ++i) {
 			end = qseq->N[i] - kmersize + 1;
-			for(; j < end && !HIT; j += kmersize) {
+			for(; j < end && !HIT && probes; j += kmersize, --probes) {
 				getKmer_macro(kmer, seq, j, cPos, iPos, shifter);
 				cmer = flag ? getCmer(kmer, &mPos, &hLen, shifter, mlen, mmask) : kmer;
 				if(hashMap_get(templates, cmer)) {
@@ -999,10 +1536,10 @@ int get_kmers_for_pair_Sparse(const HashMapKMA *templates, const Penalties *rewa
 
 int get_kmers_for_pair_pseoudoSparse(const HashMapKMA *templates, const Penalties *rewards, int *bestTemplates, int *bestTemplates_r, int *Score, int *Score_r, CompDNA *qseq, int *extendScore, const int exhaustive) {
 	
-	int i, j, l, n, end, template, hitCounter, gaps, Ms, MMs, Us, W1s, flag;
+	int i, j, b, bn, l, n, end, template, hitCounter, gaps, Ms, MMs, Us, W1s, flag;
 	int W1, U, M, MM, HIT, SU, kmersize, score, mlen, mPos, hLen, cPos, iPos;
 	int seqend, j_u, m, mm, *bests, *Scores;
-	unsigned shifter, *values, *last;
+	unsigned shifter, *values, *last, *Values[HASHMAPBATCH], probes;
 	short unsigned *values_s;
 	char *include;
 	long unsigned mask, mmask, kmer, cmer, hmer, *seq;
@@ -1047,9 +1584,10 @@ int get_kmers_for_pair_pseoudoSparse(const HashMapKMA *templates, const Penaltie
 	j = 0;
 	qseq->N[0]++;
 	qseq->N[qseq->N[0]] = qseq->seqlen;
+	probes = quickProbes;
 	for(i = 1; i <= qseq->N[0] && !HIT; ++i) {
 		end = qseq->N[i] - kmersize + 1;
-		for(; j < end && !HIT; j += kmersize) {
+		for(; j < end && !HIT && probes; j += kmersize, --probes) {
 			getKmer_macro(kmer, seq, j, cPos, iPos, shifter);
 			cmer = flag ? getCmer(kmer, &mPos, &hLen, shifter, mlen, mmask) : kmer;
 			if(hashMap_get(templates, cmer)) {
@@ -1073,12 +1611,15 @@ int get_kmers_for_pair_pseoudoSparse(const HashMapKMA *templates, const Penaltie
 			getKmer_macro(kmer, seq, j, cPos, iPos, (shifter + 2));
 			cmer = flag ? initCmer(kmer, &mPos, &hmer, &hLen, shifter + 2, kmersize, mlen, mmask) : kmer;
 			end = qseq->N[i];
+			b = 0;
+			bn = 0;
 			for(j_u = j + kmersize - 1; j_u < end; ++j_u) {
-				/* update k-mer */
-				kmer = updateKmer_macro(kmer, seq, j_u, mask);
-				cmer = flag ? updateCmer(cmer, &mPos, &hmer, &hLen, kmer, kmersize, mlen, mmask) : kmer;
-				/* lookup */
-				if((values = hashMap_get(templates, cmer))) {
+				/* update k-mers and lookup in batches */
+				if(b == bn) {
+					bn = getKmerBatch(templates, Values, seq, j_u, end, &kmer, &cmer, mask, flag, &mPos, &hmer, &hLen, kmersize, mlen, mmask);
+					b = 0;
+				}
+				if((values = Values[b++])) {
 					if(values == last) {
 						/*
 						gaps == 0 -> Match
@@ -1926,7 +2467,7 @@ int save_kmers_Sparse(const HashMapKMA *templates, const Penalties *rewards, int
 	int i, j, k, l, n, end, rc, prefix_len, template, hitCounter, HIT, SU;
 	int M, MM, n_kmers, bestScore, reps, kmersize, mlen, tflag, flag, seqend;
 	int cPos, iPos, mPos, hLen;
-	unsigned shifter, prefix_shifter, *values, *last;
+	unsigned shifter, prefix_shifter, *values, *last, probes;
 	short unsigned *values_s;
 	long unsigned pmask, mask, mmask, prefix, pmer, kmer, cmer, hmer, *seq;
 	
@@ -2044,9 +2585,10 @@ int save_kmers_Sparse(const HashMapKMA *templates, const Penalties *rewards, int
 		j = 0;
 		qseq->N[0]++;
 		qseq->N[qseq->N[0]] = qseq->seqlen;
+		probes = quickProbes;
 		for(i = 1; i <= qseq->N[0] && !HIT; ++i) {
 			end = qseq->N[i] - kmersize + 1;
-			for(; j < end && !HIT; j += kmersize) {
+			for(; j < end && !HIT && probes; j += kmersize, --probes) {
 				getKmer_macro(kmer, seq, j, cPos, iPos, shifter);
 				cmer = tflag ? getCmer(kmer, &mPos, &hLen, shifter, mlen, mmask) : kmer;
 				if(hashMap_get(templates, cmer)) {
@@ -2158,10 +2700,10 @@ int save_kmers_Sparse(const HashMapKMA *templates, const Penalties *rewards, int
 
 int save_kmers_pseuodeSparse(const HashMapKMA *templates, const Penalties *rewards, int *bestTemplates, int *bestTemplates_r, int *Score, int *Score_r, CompDNA *qseq, CompDNA *qseq_r, Qseqs *header, int *extendScore, const int exhaustive, volatile int *excludeOut, FILE *out) {
 	
-	int i, j, l, n, end, template, hitCounter, gaps, Ms, MMs, Us, W1s, flag;
+	int i, j, b, bn, l, n, end, template, hitCounter, gaps, Ms, MMs, Us, W1s, flag;
 	int HIT, SU, score, bestScore, kmersize, mlen, mPos, hLen, cPos, iPos;
 	int W1, U, M, MM, seqend, j_u, m, mm;
-	unsigned shifter, *values, *last;
+	unsigned shifter, *values, *last, *Values[HASHMAPBATCH], probes;
 	short unsigned *values_s;
 	char *include;
 	long unsigned mask, mmask, kmer, cmer, hmer, *seq;
@@ -2196,9 +2738,10 @@ int save_kmers_pseuodeSparse(const HashMapKMA *templates, const Penalties *rewar
 	j = 0;
 	qseq->N[0]++;
 	qseq->N[qseq->N[0]] = qseq->seqlen;
+	probes = quickProbes;
 	for(i = 1; i <= qseq->N[0] && !HIT; ++i) {
 		end = qseq->N[i] - kmersize + 1;
-		for(; j < end && !HIT; j += kmersize) {
+		for(; j < end && !HIT && probes; j += kmersize, --probes) {
 			getKmer_macro(kmer, seq, j, cPos, iPos, shifter);
 			cmer = flag ? getCmer(kmer, &mPos, &hLen, shifter, mlen, mmask) : kmer;
 			if(hashMap_get(templates, cmer)) {
@@ -2222,12 +2765,15 @@ int save_kmers_pseuodeSparse(const HashMapKMA *templates, const Penalties *rewar
 			getKmer_macro(kmer, seq, j, cPos, iPos, (shifter + 2));
 			cmer = flag ? initCmer(kmer, &mPos, &hmer, &hLen, shifter + 2, kmersize, mlen, mmask) : kmer;
 			end = qseq->N[i];
+			b = 0;
+			bn = 0;
 			for(j_u = j + kmersize - 1; j_u < end; ++j_u) {
-				/* update k-mer */
-				kmer = updateKmer_macro(kmer, seq, j_u, mask);
-				cmer = flag ? updateCmer(cmer, &mPos, &hmer, &hLen, kmer, kmersize, mlen, mmask) : kmer;
-				/* lookup */
-				if((values = hashMap_get(templates, cmer))) {
+				/* update k-mers and lookup in batches */
+				if(b == bn) {
+					bn = getKmerBatch(templates, Values, seq, j_u, end, &kmer, &cmer, mask, flag, &mPos, &hmer, &hLen, kmersize, mlen, mmask);
+					b = 0;
+				}
+				if((values = Values[b++])) {
 					if(values == last) {
 						/*
 						gaps == 0 -> Match
@@ -2441,10 +2987,10 @@ int save_kmers_pseuodeSparse(const HashMapKMA *templates, const Penalties *rewar
 
 int save_kmers(const HashMapKMA *templates, const Penalties *rewards, int *bestTemplates, int *bestTemplates_r, int *Score, int *Score_r, CompDNA *qseq, CompDNA *qseq_r, Qseqs *header, int *extendScore, const int exhaustive, volatile int *excludeOut, FILE *out) {
 	
-	int i, j, j_u, l, end, HIT, gaps, score, Ms, MMs, Us, W1s, W1, U, M, MM;
+	int i, j, b, bn, j_u, l, end, HIT, gaps, score, Ms, MMs, Us, W1s, W1, U, M, MM;
 	int template, hitCounter, bestScore, bestScore_r, kmersize, mPos, hLen;
 	int seqend, m, mm, mlen;
-	unsigned *values, *last, n, SU, shifter, cPos, iPos, flag;
+	unsigned *values, *last, *Values[HASHMAPBATCH], n, SU, shifter, cPos, iPos, flag, probes;
 	short unsigned *values_s;
 	long unsigned mask, mmask, kmer, cmer, hmer, *seq;
 	char *include;
@@ -2482,9 +3028,10 @@ int save_kmers(const HashMapKMA *templates, const Penalties *rewards, int *bestT
 	j = 0;
 	qseq->N[0]++;
 	qseq->N[qseq->N[0]] = qseq->seqlen;
+	probes = quickProbes;
 	for(i = 1; i <= qseq->N[0] && !HIT; ++i) {
 		end = qseq->N[i] - kmersize + 1;
-		for(; j < end && !HIT; j += kmersize) {
+		for(; j < end && !HIT && probes; j += kmersize, --probes) {
 			getKmer_macro(kmer, seq, j, cPos, iPos, shifter);
 			cmer = flag ? getCmer(kmer, &mPos, &hLen, shifter, mlen, mmask) : kmer;
 			if(hashMap_get(templates, cmer)) {
@@ -2513,12 +3060,15 @@ int save_kmers(const HashMapKMA *templates, const Penalties *rewards, int *bestT
 			getKmer_macro(kmer, seq, j, cPos, iPos, (shifter + 2));
 			cmer = flag ? initCmer(kmer, &mPos, &hmer, &hLen, shifter + 2, kmersize, mlen, mmask) : kmer;
 			end = qseq->N[i];
+			b = 0;
+			bn = 0;
 			for(j_u = j + kmersize - 1; j_u < end; ++j_u) {
-				/* update k-mer */
-				kmer = updateKmer_macro(kmer, seq, j_u, mask);
-				cmer = flag ? updateCmer(cmer, &mPos, &hmer, &hLen, kmer, kmersize, mlen, mmask) : kmer;
-				/* lookup */
-				if((values = hashMap_get(templates, cmer))) {
+				/* update k-mers and lookup in batches */
+				if(b == bn) {
+					bn = getKmerBatch(templates, Values, seq, j_u, end, &kmer, &cmer, mask, flag, &mPos, &hmer, &hLen, kmersize, mlen, mmask);
+					b = 0;
+				}
+				if((values = Values[b++])) {
 					if(values == last) {
 						/*
 						gaps == 0 -> Match
@@ -2793,9 +3343,10 @@ int save_kmers(const HashMapKMA *templates, const Penalties *rewards, int *bestT
 	j = 0;
 	qseq_r->N[0]++;
 	qseq_r->N[qseq_r->N[0]] = qseq_r->seqlen;
+	probes = quickProbes;
 	for(i = 1; i <= qseq_r->N[0] && !HIT; ++i) {
 		end = qseq_r->N[i] - kmersize + 1;
-		for(;j < end && !HIT; j += kmersize) {
+		for(; j < end && !HIT && probes; j += kmersize, --probes) {
 			getKmer_macro(kmer, seq, j, cPos, iPos, shifter);
 			cmer = flag ? getCmer(kmer, &mPos, &hLen, shifter, mlen, mmask) : kmer;
 			if(hashMap_get(templates, cmer)) {
@@ -2824,12 +3375,15 @@ int save_kmers(const HashMapKMA *templates, const Penalties *rewards, int *bestT
 			getKmer_macro(kmer, seq, j, cPos, iPos, (shifter + 2));
 			cmer = flag ? initCmer(kmer, &mPos, &hmer, &hLen, shifter + 2, kmersize, mlen, mmask) : kmer;
 			end = qseq_r->N[i];
+			b = 0;
+			bn = 0;
 			for(j_u = j + kmersize - 1; j_u < end; ++j_u) {
-				/* update k-mer */
-				kmer = updateKmer_macro(kmer, seq, j_u, mask);
-				cmer = flag ? updateCmer(cmer, &mPos, &hmer, &hLen, kmer, kmersize, mlen, mmask) : kmer;
-				/* lookup */
-				if((values = hashMap_get(templates, cmer))) {
+				/* update k-mers and lookup in batches */
+				if(b == bn) {
+					bn = getKmerBatch(templates, Values, seq, j_u, end, &kmer, &cmer, mask, flag, &mPos, &hmer, &hLen, kmersize, mlen, mmask);
+					b = 0;
+				}
+				if((values = Values[b++])) {
 					if(values == last) {
 						/*
 						gaps == 0 -> Match
@@ -3066,10 +3620,10 @@ int save_kmers(const HashMapKMA *templates, const Penalties *rewards, int *bestT
 
 int save_kmers_count(const HashMapKMA *templates, const Penalties *rewards, int *bestTemplates, int *bestTemplates_r, int *Score, int *Score_r, CompDNA *qseq, CompDNA *qseq_r, Qseqs *header, int *extendScore, const int exhaustive, volatile int *excludeOut, FILE *out) {
 	
-	int i, j, end, hitCounter, bestScore, bestScore_r, reps, n, mPos, hLen;
+	int i, j, b, bn, end, hitCounter, bestScore, bestScore_r, reps, n, mPos, hLen;
 	int seqend;
-	unsigned kmersize, mlen, shifter, flag, SU, HIT, iPos, cPos;
-	unsigned *values, *last;
+	unsigned kmersize, mlen, shifter, flag, SU, HIT, iPos, cPos, probes;
+	unsigned *values, *last, *Values[HASHMAPBATCH];
 	short unsigned *values_s;
 	long unsigned mask, mmask, kmer, cmer, hmer, *seq;
 	
@@ -3101,9 +3655,10 @@ int save_kmers_count(const HashMapKMA *templates, const Penalties *rewards, int
 	j = 0;
 	qseq->N[0]++;
 	qseq->N[qseq->N[0]] = qseq->seqlen;
+	probes = quickProbes;
 	for(i = 1; i <= qseq->N[0] && !HIT; ++i) {
 		end = qseq->N[i] - kmersize + 1;
-		for(;j < end && !HIT; j += kmersize) {
+		for(; j < end && !HIT && probes; j += kmersize, --probes) {
 			getKmer_macro(kmer, seq, j, cPos, iPos, shifter);
 			cmer = flag ? getCmer(kmer, &mPos, &hLen, shifter, mlen, mmask) : kmer;
 			if(hashMap_get(templates, cmer)) {
@@ -3126,12 +3681,15 @@ int save_kmers_count(const HashMapKMA *templates, const Penalties *rewards, int
 			getKmer_macro(kmer, seq, j, cPos, iPos, (shifter + 2));
 			cmer = flag ? initCmer(kmer, &mPos, &hmer, &hLen, shifter + 2, kmersize, mlen, mmask) : kmer;
 			end = qseq->N[i];
+			b = 0;
+			bn = 0;
 			for(j += kmersize - 1; j < end; ++j) {
-				/* update k-mer */
-				kmer = updateKmer_macro(kmer, seq, j, mask);
-				cmer = flag ? updateCmer(cmer, &mPos, &hmer, &hLen, kmer, kmersize, mlen, mmask) : kmer;
-				/* lookup */
-				if((values = hashMap_get(templates, cmer))) {
+				/* update k-mers and lookup in batches */
+				if(b == bn) {
+					bn = getKmerBatch(templates, Values, seq, j, end, &kmer, &cmer, mask, flag, &mPos, &hmer, &hLen, kmersize, mlen, mmask);
+					b = 0;
+				}
+				if((values = Values[b++])) {
 					if(values == last) {
 						++reps;
 					} else {
@@ -3222,9 +3780,10 @@ int save_kmers_count(const HashMapKMA *templates, const Penalties *rewards, int
 	j = 0;
 	qseq_r->N[0]++;
 	qseq_r->N[qseq_r->N[0]] = qseq_r->seqlen;
+	probes = quickProbes;
 	for(i = 1; i <= qseq_r->N[0] && !HIT; ++i) {
 		end = qseq_r->N[i] - kmersize + 1;
-		for(;j < end && !HIT; j += kmersize) {
+		for(; j < end && !HIT && probes; j += kmersize, --probes) {
 			getKmer_macro(kmer, seq, j, cPos, iPos, shifter);
 			cmer = flag ? getCmer(kmer, &mPos, &hLen, shifter, mlen, mmask) : kmer;
 			if(hashMap_get(templates, cmer)) {
@@ -3248,12 +3807,15 @@ int save_kmers_count(const HashMapKMA *templates, const Penalties *rewards, int
 			getKmer_macro(kmer, seq, j, cPos, iPos, (shifter + 2));
 			cmer = flag ? initCmer(kmer, &mPos, &hmer, &hLen, shifter + 2, kmersize, mlen, mmask) : kmer;
 			end = qseq->N[i];
+			b = 0;
+			bn = 0;
 			for(j += kmersize - 1; j < end; ++j) {
-				/* update k-mer */
-				kmer = updateKmer_macro(kmer, seq, j, mask);
-				cmer = flag ? updateCmer(cmer, &mPos, &hmer, &hLen, kmer, kmersize, mlen, mmask) : kmer;
-				/* lookup */
-				if((values = hashMap_get(templates, cmer))) {
+				/* update k-mers and lookup in batches */
+				if(b == bn) {
+					bn = getKmerBatch(templates, Values, seq, j, end, &kmer, &cmer, mask, flag, &mPos, &hmer, &hLen, kmersize, mlen, mmask);
+					b = 0;
+				}
+				if((values = Values[b++])) {
 					if(values == last) {
 						++reps;
 					} else {
@@ -3798,6 +4360,16 @@ int save_kmers_forcePair(const HashMapKMA *templates, const Penalties *rewards,
 	}
 	*extendScore = 1;
 	
+	/* only the strands of the mate pairing with the hits above are scored */
+	if(kmersize <= qseq_r->seqlen) {
+		if(*bestTemplates == 0) {
+			*bestTemplates = -1;
+		}
+		if(*bestTemplates_r == 0) {
+			*bestTemplates_r = -1;
+		}
+	}
+	
 	/* get reverse */
 	/*if((hitCounter_r = get_kmers_for_pair_ptr(templates, rewards, bestTemplates_r, bestTemplates, Score_r, Score, qseq_r, extendScore, exhaustive)) && 
 		(qseq->seqlen + qseq_r->seqlen - hitCounter - hitCounter_r - (kmersize << 1)) < (hitCounter + hitCounter_r) * kmersize && 
@@ -3872,11 +4444,13 @@ int save_kmers_HMM(const HashMapKMA *templates, const Penalties *rewards, int *b
 	int i, j, k, l, N, n, i_r, j_r, j_u, seqlen, seqend, end, HIT, SU;
 	int hitCounter, template, bestScore, bestHits, start, stop, returner;
 	int start_cut, end_cut, deCon, DB_size, mPos, hLen, mPosR, hLenR, Ncheck;
-	int *regionTemplates;
+	int b, bn, p_u, p_r, *regionTemplates;
 	unsigned num, shifter, kmersize, mlen, flag, iPos, cPos;
 	unsigned *values, *last, *rlast, **VF_scores, **VR_scores;
+	unsigned *Values[HASHMAPBATCH << 1];
 	short unsigned *values_s;
 	long unsigned mask, mmask, kmer, cmer, hmer, kmerR, cmerR, hmerR;
+	long unsigned Keys[HASHMAPBATCH << 1];
 	int *tmpNs, reps, rreps;
 	double Ms, Ns, Ms_prev, Ns_prev, HMM_param[8];
 	char *include;
@@ -4173,6 +4747,8 @@ int save_kmers_HMM(const HashMapKMA *templates, const Penalties *rewards, int *b
 				kmerR <<= 2;
 			}
 			j_u = j + kmersize - 1;
+			b = 0;
+			bn = 0;
 			while(j < seqend) {
 				if(j == Ncheck) {
 					k = j;
@@ -4219,15 +4795,30 @@ int save_kmers_HMM(const HashMapKMA *templates, const Penalties *rewards, int *b
 					}
 					j_u = j + kmersize - 1;
 				} else {
-					/* update k-mer */
-					kmer = updateKmer_macro(kmer, qseq->seq, j_u, mask);
-					cmer = flag ? updateCmer(cmer, &mPos, &hmer, &hLen, kmer, kmersize, mlen, mmask) : kmer;
-					kmerR = updateKmerR_macro(kmerR, qseq_r->seq, j_r, shifter);
-					cmerR = flag ? updateCmerR(cmerR, &mPosR, &hmerR, &hLenR, kmerR, kmersize, mlen, mmask) : kmerR;
+					if(b == bn) {
+						/* update k-mers and lookup ahead, up to the next N */
+						bn = ((j < Ncheck && Ncheck < seqend) ? Ncheck : seqend) - j;
+						bn = bn < HASHMAPBATCH ? bn : HASHMAPBATCH;
+						p_u = j_u;
+						p_r = j_r;
+						for(b = 0; b < bn; ++b) {
+							kmer = updateKmer_macro(kmer, qseq->seq, p_u, mask);
+							cmer = flag ? updateCmer(cmer, &mPos, &hmer, &hLen, kmer, kmersize, mlen, mmask) : kmer;
+							kmerR = updateKmerR_macro(kmerR, qseq_r->seq, p_r, shifter);
+							cmerR = flag ? updateCmerR(cmerR, &mPosR, &hmerR, &hLenR, kmerR, kmersize, mlen, mmask) : kmerR;
+							Keys[b << 1] = cmer;
+							Keys[(b << 1) + 1] = cmerR;
+							++p_u;
+							--p_r;
+						}
+						hashMap_getBatch(templates, Keys, bn << 1, Values);
+						b = 0;
+					}
 					
-					/* lookup and save */
-					VF_scores[j] = hashMap_get(templates, cmer);
-					VR_scores[j] = hashMap_get(templates, cmerR);
+					/* save */
+					VF_scores[j] = Values[b << 1];
+					VR_scores[j] = Values[(b << 1) + 1];
+					++b;
 					
 					/* HMM */
 					if(VF_scores[j] || VR_scores[j]) {
@@ -5130,19 +5721,21 @@ int save_kmers_chain(const HashMapKMA *templates, const Penalties *rewards, int
 	static int *Sizes = 0, *template_lengths = 0, minlen = 0;
 	static double coverT = 0.5, mrs = 0.5;
 	static KmerAnker **tVF_scores, **tVR_scores;
+	static AnkerHeap **tHeaps;
 	static SeqmentTree **tSeqments;
 	int i, j, j_u, rc, Wl, W1, U, M, MM, Ms, MMs, Us, W1s, score, gaps, HIT;
 	int start, end, pos, shifter, kmersize, mlen, cover, len, template, test;
 	int cStart, cStart_r, cPos, iPos, len_len, mPos, hLen, flag, seqend, SU;
-	int VF_start, VR_start, *bests;
-	unsigned DB_size, hitCounter, hitCounter_r, ties, ties_len;
-	unsigned *values, *last;
+	int VF_start, VR_start, stride, dense, *bests;
+	unsigned DB_size, hitCounter, hitCounter_r, ties, ties_len, probes;
+	unsigned *values, *last, *pvalues;
 	short unsigned *values_s;
-	long unsigned mask, mmask, kmer, cmer, hmer, *seq;
+	long unsigned mask, mmask, kmer, cmer, hmer, pmer, *seq;
 	char *include;
 	double score_len;
 	KmerAnker *V_score, *V_scores, *VF_scores, *VR_scores, *tmp_score;
 	KmerAnker *best_score, *best_score_r, *best_score_len, *best_score_len_r;
+	AnkerHeap *VF_heap, *VR_heap;
 	SeqmentTree *chainSeqments;
 	
 	if(qseq == 0) {
@@ -5152,8 +5745,11 @@ int save_kmers_chain(const HashMapKMA *templates, const Penalties *rewards, int
 			i = *bestTemplates;
 			while(i--) {
 				free(tVF_scores[i]);
+				ankerHeap_destroy(tHeaps[i << 1]);
+				ankerHeap_destroy(tHeaps[(i << 1) + 1]);
 			}
 			free(tVF_scores);
+			free(tHeaps);
 		} else {
 			/* set coverT */
 			coverT = *((double *)(bestTemplates_r));
@@ -5164,17 +5760,20 @@ int save_kmers_chain(const HashMapKMA *templates, const Penalties *rewards, int
 			Sizes = smalloc(i * sizeof(int));
 			tVF_scores = smalloc(2 * i * sizeof(KmerAnker *));
 			tVR_scores = tVF_scores + i;
+			tHeaps = smalloc(2 * i * sizeof(AnkerHeap *));
 			tSeqments = calloc(i, sizeof(SeqmentTree *));
 			if(!tSeqments) {
 				ERROR();
 			}
 			while(i--) {
-				Sizes[i] = 1024;
+				Sizes[i] = 2048;
 				tVF_scores[i] = calloc(2048, sizeof(KmerAnker));
 				if(!tVF_scores[i]) {
 					ERROR();
 				}
 				tVR_scores[i] = tVF_scores[i] + 1024;
+				tHeaps[i << 1] = ankerHeap_init(1024);
+				tHeaps[(i << 1) + 1] = ankerHeap_init(1024);
 				tSeqments[i] = initializeSeqmentTree(64);
 			}
 		}
@@ -5203,22 +5802,19 @@ int save_kmers_chain(const HashMapKMA *templates, const Penalties *rewards, int
 	values_s = 0;
 	rc_comp(qseq, qseq_r);
 	
-	if(Sizes[*Score] < qseq->size) {
-		Sizes[*Score] = qseq->size;
-		free(tVF_scores[*Score]);
-		tVF_scores[*Score] = calloc(2 * qseq->size, sizeof(KmerAnker));
-		if(!tVF_scores[*Score]) {
-			ERROR();
-		} else {
-			tVR_scores[*Score] = tVF_scores[*Score] + qseq->size;
-		}
-	}
+	/* forward and rc ankers share one pool per thread */
+	tVF_scores[*Score] = ankerPool(tVF_scores[*Score], Sizes + *Score, qseq->size << 1);
+	tVR_scores[*Score] = tVF_scores[*Score] + (Sizes[*Score] >> 1);
 	VF_scores = tVF_scores[*Score];
 	VR_scores = tVR_scores[*Score];
 	chainSeqments = tSeqments[*Score];
 	chainSeqments->n = 0;
 	
 	/* get forward ankers */
+	stride = seedStride;
+	dense = -1;
+	pmer = 0xFFFFFFFFFFFFFFFF; /* no k-mer */
+	pvalues = 0;
 	hitCounter = 0;
 	V_scores = VF_scores;
 	V_scores->start = 0;
@@ -5231,9 +5827,10 @@ int save_kmers_chain(const HashMapKMA *templates, const Penalties *rewards, int
 	seq = qseq->seq;
 	++*(qseq->N);
 	qseq->N[*(qseq->N)] = qseq->seqlen;
+	probes = quickProbes;
 	for(i = 1; i <= *(qseq->N) && !HIT; ++i) {
 		end = qseq->N[i] - kmersize + 1;
-		for(; j < end && !HIT; j += kmersize) {
+		for(; j < end && !HIT && probes; j += kmersize, --probes) {
 			getKmer_macro(kmer, seq, j, cPos, iPos, shifter);
 			cmer = flag ? getCmer(kmer, &mPos, &hLen, shifter, mlen, mmask) : kmer;
 			if(hashMap_get(templates, cmer)) {
@@ -5262,8 +5859,12 @@ int save_kmers_chain(const HashMapKMA *templates, const Penalties *rewards, int
 				kmer = updateKmer_macro(kmer, seq, j_u, mask);
 				cmer = flag ? updateCmer(cmer, &mPos, &hmer, &hLen, kmer, kmersize, mlen, mmask) : kmer;
 				
-				/* lookup */
-				if((values = hashMap_get(templates, cmer))) {
+				/* lookup, neighbouring k-mers mostly share their minimizer */
+				if(cmer != pmer) {
+					pmer = cmer;
+					pvalues = hashMap_get(templates, cmer);
+				}
+				if((values = pvalues)) {
 					if(values == last) {
 						/*
 						gaps == 0 -> Match
@@ -5320,6 +5921,19 @@ int save_kmers_chain(const HashMapKMA *templates, const Penalties *rewards, int
 					++gaps;
 				}
 				++j;
+				
+				/* sparse seeding, only off long misses and resume a full window before the probed hit */
+				if(stride && dense < j && stride * kmersize < gaps) {
+					dense = j + seekAnker(templates, seq, j, 1, end - kmersize + 1 - j, stride);
+					pos = j < dense - stride * kmersize ? dense - stride * kmersize : j;
+					if(j < pos) {
+						gaps += pos - j;
+						j = pos;
+						getKmer_macro(kmer, seq, j, cPos, iPos, (shifter + 2));
+						cmer = flag ? initCmer(kmer, &mPos, &hmer, &hLen, shifter + 2, kmersize, mlen, mmask) : kmer;
+						j_u = j + kmersize - 2;
+					}
+				}
 			}
 			gaps += (qseq->N[i] + 1 - j); /* gap over N's */
 			j = end + 1;
@@ -5333,6 +5947,7 @@ int save_kmers_chain(const HashMapKMA *templates, const Penalties *rewards, int
 	
 	/* get rc ankers, in forward notation */
 	hitCounter_r = 0;
+	dense = -1;
 	V_scores = VR_scores;
 	V_scores->start = 0;
 	V_scores->end = 0;
@@ -5344,9 +5959,10 @@ int save_kmers_chain(const HashMapKMA *templates, const Penalties *rewards, int
 	++*(qseq_r->N);
 	qseq_r->N[*(qseq_r->N)] = qseq_r->seqlen;
 	rc = qseq->seqlen - kmersize;
+	probes = quickProbes;
 	for(i = 1; i <= *(qseq_r->N) && !HIT; ++i) {
 		end = qseq_r->N[i] - kmersize + 1;
-		for(; j < end && !HIT; j += kmersize) {
+		for(; j < end && !HIT && probes; j += kmersize, --probes) {
 			getKmer_macro(kmer, seq, j, cPos, iPos, shifter);
 			cmer = flag ? getCmer(kmer, &mPos, &hLen, shifter, mlen, mmask) : kmer;
 			
@@ -5378,8 +5994,12 @@ int save_kmers_chain(const HashMapKMA *templates, const Penalties *rewards, int
 				kmer = updateKmerR_macro(kmer, seq, rc, shifter);
 				cmer = flag ? updateCmerR(cmer, &mPos, &hmer, &hLen, kmer, kmersize, mlen, mmask) : kmer;
 				
-				/* lookup */
-				if((values = hashMap_get(templates, cmer))) {
+				/* lookup, neighbouring k-mers mostly share their minimizer */
+				if(cmer != pmer) {
+					pmer = cmer;
+					pvalues = hashMap_get(templates, cmer);
+				}
+				if((values = pvalues)) {
 					if(values == last) {
 						/*
 						gaps == 0 -> Match
@@ -5437,6 +6057,20 @@ int save_kmers_chain(const HashMapKMA *templates, const Penalties *rewards, int
 				}
 				++j;
 				--rc;
+				
+				/* sparse seeding */
+				if(stride && dense < j && stride * kmersize < gaps) {
+					dense = j + seekAnker(templates, seq, rc, -1, end - j, stride);
+					pos = j < dense - stride * kmersize ? dense - stride * kmersize : j;
+					if(j < pos) {
+						gaps += pos - j;
+						rc -= pos - j;
+						j = pos;
+						getKmer_macro(kmer, seq, (rc + 1), cPos, iPos, (shifter + 2));
+						cmer = flag ? initCmerR(kmer, &mPos, &hmer, &hLen, shifter + 2, kmersize, mlen, mmask) : kmer;
+						kmer <<= 2;
+					}
+				}
 			}
 			gaps += (qseq->N[i] + 1 - j); /* gap over N's */
 			j = qseq->N[i] + 1;
@@ -5647,6 +6281,10 @@ int save_kmers_chain(const HashMapKMA *templates, const Penalties *rewards, int
 	if(!(VR_scores = pruneAnkers(VR_scores, kmersize))) {
 		best_score_r->score = 0;
 	}
+	VF_heap = tHeaps[*Score << 1];
+	VR_heap = tHeaps[(*Score << 1) + 1];
+	ankerHeap_reset(VF_heap);
+	ankerHeap_reset(VR_heap);
 	
 	/* get best chain, 
 	start/end, score, template(s)
@@ -5856,7 +6494,7 @@ int save_kmers_chain(const HashMapKMA *templates, const Penalties *rewards, int
 			}
 			while(best_score && best_score->score == 0) {
 				/* find best anker */
-				if((best_score = getBestAnker(&VF_scores, &ties, template_lengths))) {
+				if((best_score = getBestAnkerHeap(VF_heap, &VF_scores, &ties, template_lengths))) {
 					if(kmersize < best_score->score && (tmp_score = getChainTemplates(best_score, rewards, template_lengths, qseq->seqlen, kmersize, mlen, bestTemplates, Score, extendScore, include))) {
 						/* check chain */
 						cStart = tmp_score->start;
@@ -5899,7 +6537,7 @@ int save_kmers_chain(const HashMapKMA *templates, const Penalties *rewards, int
 			}
 			while(best_score_r && best_score_r->score == 0) {
 				/* find best anker */
-				if((best_score_r = getBestAnker(&VR_scores, &ties, template_lengths))) {
+				if((best_score_r = getBestAnkerHeap(VR_heap, &VR_scores, &ties, template_lengths))) {
 					if(kmersize < best_score_r->score && (tmp_score = getChainTemplates(best_score_r, rewards, template_lengths, qseq->seqlen, kmersize, mlen, bestTemplates_r, Score, extendScore, include))) {
 						/* check chain */
 						cStart_r = tmp_score->start;
@@ -5949,18 +6587,20 @@ int save_kmers_sparse_chain(const HashMapKMA *templates, const Penalties *reward
 	static int *Sizes = 0, *template_lengths = 0, minlen = 0;
 	static double coverT = 0.5, mrs = 0.5;
 	static KmerAnker **tVF_scores;
+	static AnkerHeap **tHeaps;
 	static SeqmentTree **tSeqments;
 	int i, j, j_u, shifter, prefix_shifter, kmersize, DB_size, pos, start;
 	int Wl, W1, U, M, MM, Ms, MMs, Us, W1s, end, len, gaps, template, score;
 	int len_len, mlen, tflag, cPos, iPos, mPos, hLen, seqend, test, VF_start;
 	int *bests;
-	unsigned SU, HIT, cover, hitCounter, ties, ties_len, prefix_len, flag;
+	unsigned SU, HIT, cover, hitCounter, ties, ties_len, prefix_len, flag, probes;
 	unsigned *values, *last;
 	short unsigned *values_s;
 	long unsigned mask, mmask, prefix, kmer, cmer, hmer, *seq;
 	char *include;
 	double score_len;
 	KmerAnker *V_score, *VF_scores, *tmp_score, *best_score, *best_score_len;
+	AnkerHeap *VF_heap;
 	SeqmentTree *chainSeqments;
 	
 	if(qseq == 0) {
@@ -5970,8 +6610,10 @@ int save_kmers_sparse_chain(const HashMapKMA *templates, const Penalties *reward
 			i = *bestTemplates;
 			while(i--) {
 				free(tVF_scores[i]);
+				ankerHeap_destroy(tHeaps[i]);
 			}
 			free(tVF_scores);
+			free(tHeaps);
 		} else {
 			/* set coverT */
 			coverT = *((double *)(bestTemplates_r));
@@ -5981,6 +6623,7 @@ int save_kmers_sparse_chain(const HashMapKMA *templates, const Penalties *reward
 			i = *bestTemplates;
 			Sizes = smalloc(i * sizeof(int));
 			tVF_scores = smalloc(i * sizeof(KmerAnker *));
+			tHeaps = smalloc(i * sizeof(AnkerHeap *));
 			tSeqments = calloc(i, sizeof(SeqmentTree *));
 			if(!tSeqments) {
 				ERROR();
@@ -5991,6 +6634,7 @@ int save_kmers_sparse_chain(const HashMapKMA *templates, const Penalties *reward
 				if(!tVF_scores[i]) {
 					ERROR();
 				}
+				tHeaps[i] = ankerHeap_init(1024);
 				tSeqments[i] = initializeSeqmentTree(64);
 			}
 		}
@@ -6025,14 +6669,7 @@ int save_kmers_sparse_chain(const HashMapKMA *templates, const Penalties *reward
 	seqend = qseq->seqlen - kmersize + 1;
 	hLen = kmersize;
 	
-	if(Sizes[*Score] < qseq->size) {
-		Sizes[*Score] = qseq->size << 1;
-		free(tVF_scores[*Score]);
-		tVF_scores[*Score] = calloc(qseq->size, sizeof(KmerAnker));
-		if(!tVF_scores[*Score]) {
-			ERROR();
-		}
-	}
+	tVF_scores[*Score] = ankerPool(tVF_scores[*Score], Sizes + *Score, qseq->size);
 	VF_scores = tVF_scores[*Score];
 	chainSeqments = tSeqments[*Score];
 	chainSeqments->n = 0;
@@ -6187,9 +6824,10 @@ int save_kmers_sparse_chain(const HashMapKMA *templates, const Penalties *reward
 		j = 0;
 		++*(qseq->N);
 		qseq->N[*(qseq->N)] = qseq->seqlen;
+		probes = quickProbes;
 		for(i = 1; i <= *(qseq->N) && !HIT; ++i) {
 			end = qseq->N[i] - kmersize + 1;
-			for(; j < end && !HIT; j += kmersize) {
+			for(; j < end && !HIT && probes; j += kmersize, --probes) {
 				getKmer_macro(kmer, seq, j, cPos, iPos, shifter);
 				cmer = tflag ? getCmer(kmer, &mPos, &hLen, shifter, mlen, mmask) : kmer;
 				if(hashMap_get(templates, cmer)) {
@@ -6460,6 +7098,8 @@ int save_kmers_sparse_chain(const HashMapKMA *templates, const Penalties *reward
 		best_score->score = 0;
 		hitCounter = 0;
 	}
+	VF_heap = tHeaps[*Score];
+	ankerHeap_reset(VF_heap);
 	
 	/* get best chain, 
 	start/end, score, template(s)
@@ -6550,7 +7190,7 @@ int save_kmers_sparse_chain(const HashMapKMA *templates, const Penalties *reward
 		*bestTemplates = 0;
 		while(best_score->score == 0) {
 			/* find best anker */
-			if((best_score = getBestAnker(&VF_scores, &ties, template_lengths))) {
+			if((best_score = getBestAnkerHeap(VF_heap, &VF_scores, &ties, template_lengths))) {
 				if(kmersize < best_score->score && (tmp_score = getChainTemplates(best_score, rewards, template_lengths, qseq->seqlen, kmersize, mlen, bestTemplates, Score, extendScore, include))) {
 					/* check chain */
 					start = tmp_score->start;
@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include "compdna.h"
 #include "hashmapkma.h"
+#include "kmapool.h"
 #include "penalties.h"
 #include "qseqs.h"
 
@@ -27,7 +28,7 @@
 typedef struct kmerScan_thread KmerScan_thread;
 
 struct kmerScan_thread {
-	pthread_t id;
+	KmaWorker *id;
 	int num;
 	int exhaustive;
 	int sam;
@@ -42,7 +43,46 @@ struct kmerScan_thread {
 	struct kmerScan_thread *next;
 };
 
+typedef struct readBatch ReadBatch;
+struct readBatch {
+	int num;
+	int next;
+	int size;
+	unsigned readNum;
+	int *info;
+	long unsigned seqLen;
+	long unsigned seqSize;
+	long unsigned seqPos;
+	long unsigned *seq;
+	long unsigned NLen;
+	long unsigned NSize;
+	long unsigned NPos;
+	int *N;
+	long unsigned headerLen;
+	long unsigned headerSize;
+	long unsigned headerPos;
+	unsigned char *header;
+};
+
+typedef struct dupRead DupRead;
+struct dupRead {
+	int seqlen;
+	int complen;
+	int N;
+	int unmapped;
+	int h_len;
+	long unsigned len;
+	long unsigned *seq; /* packed read, then its N's */
+	unsigned char *header;
+	unsigned char *rec; /* records printed for it */
+};
+
 #define SAVEKMERS 1;
+#define READBATCH 4096
+#define READBATCHWORDS 1048576
+#define SCOREDENSE 4
+#define DUPREADS 65536
+#define SATCHECK 16384
 #endif
 
 /* pointers to combine functions */
@@ -56,12 +96,22 @@ extern int (*getSecondForce)(int*, int*, int*, int*, int*, int*);
 extern int (*getSecondPen)(int*, int*, int*, int*, int*, int*, int, int);
 extern int (*getF)(int*, int*, int*, int*, int*);
 extern int (*getR)(int*, int*, int*, int*, int*);
+void setQuickProbes(unsigned probes);
+void setSeedStride(int stride);
+void setDupReads(unsigned size);
+void setSaturation(double depth);
+void saturation_init(const int *template_lengths, int DB_size);
 int loadFsa(CompDNA *qseq, Qseqs *header, FILE *inputfile);
+ReadBatch * readBatch_init(int size);
+void readBatch_destroy(ReadBatch *batch);
+int loadFsaBatch(ReadBatch *batch, FILE *inputfile);
+int batchFsa(CompDNA *qseq, Qseqs *header, ReadBatch *batch);
 void * save_kmers_threaded(void *arg);
 int getBestMatch(int *bestTemplates, int *Score);
 int getProxiMatch(int *bestTemplates, int *Score);
 int getBestMatchSparse(int *bestTemplates, int *Score, int kmersize, int n_kmers, int M, int MM);
 int getProxiMatchSparse(int *bestTemplates, int *Score, int kmersize, int n_kmers, int M, int MM);
+int getKmerBatch(const HashMapKMA *templates, unsigned **values, const long unsigned *seq, int pos, int end, long unsigned *kmer, long unsigned *cmer, const long unsigned mask, const int flag, int *mPos, long unsigned *hmer, int *hLen, const int kmersize, const int mlen, const long unsigned mmask);
 int get_kmers_for_pair(const HashMapKMA *templates, const Penalties *rewards, int *bestTemplates, int *bestTemplates_r, int *Score, int *Score_r, CompDNA *qseq, int *extendScore, const int exhaustive);
 int get_kmers_for_pair_count(const HashMapKMA *templates, const Penalties *rewards, int *bestTemplates, int *bestTemplates_r, int *Score, int *Score_r, CompDNA *qseq, int *extendScore, const int exhaustive);
 int get_kmers_for_pair_Sparse(const HashMapKMA *templates, const Penalties *rewards, int *bestTemplates, int *bestTemplates_r, int *Score, int *Score_r, CompDNA *qseq, int *extendScore, const int exhaustive);
@@ -220,16 +220,18 @@ static void helpMessage(int status) {
 	fprintf(out, "# Options are:\tDesc:\t\t\t\t\tDefault:\tRequirements:\n");
 	fprintf(out, "#\t-t_db\tTemplate DB\t\t\t\tNone\t\tREQUIRED\n");
 	fprintf(out, "#\t-seqs\tComma separated list of templates\tPrint entire index.\n");
+	fprintf(out, "#\t-range\tTemplates first-last, e.g. a shard\tPrint entire index.\n");
 	fprintf(out, "#\t-h\tShows this help message\n");
 	exit(status);
 }
 
 int seq2fasta_main(int argc, char *argv[]) {
 	
-	int args, file_len, *template_lengths, *seqlist;
+	int i, args, file_len, *template_lengths, *seqlist, *range;
 	char *filename;
 	
 	seqlist = 0;
+	range = 0;
 	file_len = 0;
 	filename = 0;
 	args = 0;
@@ -244,6 +246,14 @@ int seq2fasta_main(int argc, char *argv[]) {
 			if(++args < argc) {
 				seqlist = intSplit(',', argv[args]);
 			}
+		} else if(strcmp(argv[args], "-range") == 0) {
+			if(++args < argc) {
+				range = intSplit('-', argv[args]);
+				if(*range != 2 || range[1] < 1 || range[2] < range[1]) {
+					fprintf(stderr, "Invalid range parsed.\n");
+					exit(1);
+				}
+			}
 		} else if(strcmp(argv[args], "-h") == 0) {
 			helpMessage(0);
 		} else {
@@ -258,6 +268,19 @@ int seq2fasta_main(int argc, char *argv[]) {
 	/* get lengths */
 	template_lengths = getLengths(filename);
 	
+	if(range) {
+		/* list the templates of the range */
+		if(*template_lengths <= range[2]) {
+			range[2] = *template_lengths - 1;
+		}
+		seqlist = smalloc((range[2] - range[1] + 2) * sizeof(int));
+		*seqlist = 0;
+		for(i = range[1]; i <= range[2]; ++i) {
+			seqlist[++*seqlist] = i;
+		}
+		free(range);
+	}
+	
 	if(seqlist) {
 		/* get sequences from list */
 		printFastaList(filename, template_lengths, seqlist);
@@ -17,14 +17,28 @@
  * limitations under the License.
 */
 
+#define _XOPEN_SOURCE 700 /* fmemopen */
 #include <ctype.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#undef _XOPEN_SOURCE
 #include "filebuff.h"
 #include "pherror.h"
 #include "qseqs.h"
 #include "seqparse.h"
+#include "seqscan.h"
+
+static const char *memName = 0;
+static const char *memBuff = 0;
+static long memSize = 0;
+
+void setMemInput(const char *name, const char *buff, long size) {
+	/* inputs named name are read from buff, instead of the disk */
+	memName = name;
+	memBuff = buff;
+	memSize = size;
+}
 
 int openAndDetermine(FileBuff *inputfile, char *filename) {
 	
@@ -35,6 +49,11 @@ int openAndDetermine(FileBuff *inputfile, char *filename) {
 	FASTQ = 0;
 	if(*filename == '-' && strcmp(filename + 1, "-") == 0) {
 		inputfile->file = stdin;
+	} else if(memName && strcmp(filename, memName) == 0) {
+		inputfile->file = fmemopen((void *)(memBuff), memSize, "rb");
+		if(!inputfile->file) {
+			ERROR();
+		}
 	} else {
 		openFileBuff(inputfile, filename, "rb");
 	}
@@ -43,8 +62,15 @@ int openAndDetermine(FileBuff *inputfile, char *filename) {
 		check = (short unsigned *) inputfile->buffer;
 		if(*check == 35615) {
 			FASTQ = 4;
-			init_gzFile(inputfile);
-			buffFileBuff = &BuffgzFileBuff;
+			if(1 < FileBuffThreads(0)) {
+				init_gzFile_MT(inputfile, FileBuffThreads(0));
+				buffFileBuff = &BuffgzFileBuff_MT;
+			} else {
+				init_gzFile(inputfile);
+				buffFileBuff = &BuffgzFileBuff;
+			}
+		} else if(inputfile->file != stdin && (!memName || strcmp(filename, memName)) && mmapFileBuff(inputfile)) {
+			buffFileBuff = &buff_FileBuffMmap;
 		} else {
 			buffFileBuff = &buff_FileBuff;
 		}
@@ -63,10 +89,62 @@ int openAndDetermine(FileBuff *inputfile, char *filename) {
 	return FASTQ;
 }
 
+static int getHeader(FileBuff *src, unsigned char **buffPtr, int *availPtr, Qseqs *header) {
+	
+	int len, n, avail;
+	unsigned char *buff, *seq, *nl;
+	
+	/* copy the header line in chunks, instead of byte wise */
+	avail = *availPtr;
+	buff = *buffPtr;
+	len = 0;
+	while(!(nl = memchr(buff, '\n', avail))) {
+		n = avail;
+		if(header->size <= len + n) {
+			header->size = (len + n) << 1;
+			if(!(header->seq = realloc(header->seq, header->size))) {
+				ERROR();
+			}
+		}
+		memcpy(header->seq + len, buff, n);
+		len += n;
+		if((avail = buffFileBuff(src)) == 0) {
+			return 0;
+		}
+		buff = src->buffer;
+	}
+	n = nl - buff + 1;
+	if(header->size <= len + n) {
+		header->size = (len + n) << 1;
+		if(!(header->seq = realloc(header->seq, header->size))) {
+			ERROR();
+		}
+	}
+	memcpy(header->seq + len, buff, n);
+	len += n;
+	buff += n;
+	if((avail -= n) == 0) {
+		if((avail = buffFileBuff(src)) == 0) {
+			return 0;
+		}
+		buff = src->buffer;
+	}
+	
+	/* chomp header */
+	seq = header->seq + len;
+	while(isspace(*--seq));
+	*++seq = 0;
+	header->len = seq - header->seq;
+	*buffPtr = buff;
+	*availPtr = avail;
+	
+	return 1;
+}
+
 int FileBuffgetFsa(FileBuff *src, Qseqs *header, Qseqs *qseq, char *trans) {
 	
 	unsigned char *buff, *seq;
-	int size, avail;
+	int size, avail, chunk, n, written;
 	
 	/* init */
 	avail = src->bytes;
@@ -80,56 +158,31 @@ int FileBuffgetFsa(FileBuff *src, Qseqs *header, Qseqs *qseq, char *trans) {
 	}
 	
 	/* get header */
-	seq = header->seq;
-	size = header->size;
-	while((*seq++ = *buff++) != '\n') {
-		if(--avail == 0) {
-			if((avail = buffFileBuff(src)) == 0) {
-				return 0;
-			}
-			buff = src->buffer;
-		}
-		if(--size == 0) {
-			size = header->size;
-			header->size <<= 1;
-			header->seq = realloc(header->seq, header->size);
-			if(!header->seq) {
-				ERROR();
-			}
-			seq = header->seq + size;
-		}
-	}
-	if(--avail == 0) {
-		if((avail = buffFileBuff(src)) == 0) {
-			return 0;
-		}
-		buff = src->buffer;
-	}
-	/* chomp header */
-	while(isspace(*--seq)) {
-		++size;
+	if(!getHeader(src, &buff, &avail, header)) {
+		return 0;
 	}
-	*++seq = 0;
-	header->len = header->size - size + 1;
 	/* get qseq */
 	seq = qseq->seq;
 	size = qseq->size;
-	while(*buff != '>') {
-		*seq = trans[*buff++];
-		if(((*seq) >> 3) == 0) {
-			if(--size == 0) {
-				size = qseq->size;
-				qseq->size <<= 1;
-				qseq->seq = realloc(qseq->seq, qseq->size);
-				if(!qseq->seq) {
-					ERROR();
-				}
-				seq = qseq->seq + size;
-			} else {
-				++seq;
+	while(1) {
+		chunk = avail < size ? avail : size;
+		n = transFsa(seq, buff, chunk, trans, &written);
+		seq += written;
+		size -= written;
+		buff += n;
+		avail -= n;
+		if(size == 0) {
+			size = qseq->size;
+			qseq->size <<= 1;
+			qseq->seq = realloc(qseq->seq, qseq->size);
+			if(!qseq->seq) {
+				ERROR();
 			}
+			seq = qseq->seq + size;
 		}
-		if(--avail == 0) {
+		if(n < chunk) { /* next header */
+			break;
+		} else if(avail == 0) {
 			if((avail = buffFileBuff(src)) == 0) {
 				/* chomp header */
 				while(*--seq == 8) {
@@ -160,8 +213,8 @@ int FileBuffgetFsa(FileBuff *src, Qseqs *header, Qseqs *qseq, char *trans) {
 
 int FileBuffgetFsaSeq(FileBuff *src, Qseqs *qseq, char *trans) {
 	
-	unsigned char *buff, *seq;
-	int size, avail;
+	unsigned char *buff, *seq, *nl;
+	int size, avail, chunk, n, written;
 	
 	/* init */
 	avail = src->bytes;
@@ -175,14 +228,14 @@ int FileBuffgetFsaSeq(FileBuff *src, Qseqs *qseq, char *trans) {
 	}
 	
 	/* skip header */
-	while(*buff++ != '\n') {
-		if(--avail == 0) {
-			if((avail = buffFileBuff(src)) == 0) {
-				return 0;
-			}
-			buff = src->buffer;
+	while(!(nl = memchr(buff, '\n', avail))) {
+		if((avail = buffFileBuff(src)) == 0) {
+			return 0;
 		}
+		buff = src->buffer;
 	}
+	avail -= nl - buff;
+	buff = nl + 1;
 	if(--avail == 0) {
 		if((avail = buffFileBuff(src)) == 0) {
 			return 0;
@@ -193,22 +246,25 @@ int FileBuffgetFsaSeq(FileBuff *src, Qseqs *qseq, char *trans) {
 	/* get qseq */
 	seq = qseq->seq;
 	size = qseq->size;
-	while(*buff != '>') {
-		*seq = trans[*buff++];
-		if(((*seq) >> 3) == 0) {
-			if(--size == 0) {
-				size = qseq->size;
-				qseq->size <<= 1;
-				qseq->seq = realloc(qseq->seq, qseq->size);
-				if(!qseq->seq) {
-					ERROR();
-				}
-				seq = qseq->seq + size;
-			} else {
-				++seq;
+	while(1) {
+		chunk = avail < size ? avail : size;
+		n = transFsa(seq, buff, chunk, trans, &written);
+		seq += written;
+		size -= written;
+		buff += n;
+		avail -= n;
+		if(size == 0) {
+			size = qseq->size;
+			qseq->size <<= 1;
+			qseq->seq = realloc(qseq->seq, qseq->size);
+			if(!qseq->seq) {
+				ERROR();
 			}
+			seq = qseq->seq + size;
 		}
-		if(--avail == 0) {
+		if(n < chunk) { /* next header */
+			break;
+		} else if(avail == 0) {
 			if((avail = buffFileBuff(src)) == 0) {
 				/* chomp header */
 				while(*--seq == 8) {
@@ -240,8 +296,8 @@ int FileBuffgetFsaSeq(FileBuff *src, Qseqs *qseq, char *trans) {
 
 int FileBuffgetFq(FileBuff *src, Qseqs *header, Qseqs *qseq, Qseqs *qual, char *trans) {
 	
-	unsigned char *buff, *seq;
-	int size, avail;
+	unsigned char *buff, *seq, *nl;
+	int size, avail, chunk, n;
 	
 	/* init */
 	avail = src->bytes;
@@ -260,49 +316,32 @@ int FileBuffgetFq(FileBuff *src, Qseqs *header, Qseqs *qseq, Qseqs *qual, char *
 	}
 	
 	/* get header */
-	seq = header->seq;
-	size = header->size;
-	while((*seq++ = *buff++) != '\n') {
-		if(--avail == 0) {
-			if((avail = buffFileBuff(src)) == 0) {
-				return 0;
-			}
-			buff = src->buffer;
-		}
-		if(--size == 0) {
-			size = header->size;
-			header->size <<= 1;
-			header->seq = realloc(header->seq, header->size);
-			if(!header->seq) {
-				ERROR();
-			}
-			seq = header->seq + size;
-		}
-	}
-	if(--avail == 0) {
-		if((avail = buffFileBuff(src)) == 0) {
-			return 0;
-		}
-		buff = src->buffer;
-	}
-	/* chomp header */
-	while(isspace(*--seq)) {
-		++size;
+	if(!getHeader(src, &buff, &avail, header)) {
+		return 0;
 	}
-	*++seq = 0;
-	header->len = header->size - size + 1;
 	
 	/* get qseq */
 	seq = qseq->seq;
 	size = qseq->size;
-	while((*seq++ = trans[*buff++]) != 16) {
-		if(--avail == 0) {
+	while(1) {
+		chunk = avail < size ? avail : size;
+		n = transLine(seq, buff, chunk, trans);
+		seq += n;
+		size -= n;
+		buff += n;
+		avail -= n;
+		if(n < chunk) { /* newline */
+			*seq++ = 16;
+			++buff;
+			break;
+		}
+		if(avail == 0) {
 			if((avail = buffFileBuff(src)) == 0) {
 				return 0;
 			}
 			buff = src->buffer;
 		}
-		if(--size == 0) {
+		if(size == 0) {
 			size = qseq->size;
 			qseq->size <<= 1;
 			qseq->seq = realloc(qseq->seq, qseq->size);
@@ -326,14 +365,14 @@ int FileBuffgetFq(FileBuff *src, Qseqs *header, Qseqs *qseq, Qseqs *qual, char *
 	qseq->len = qseq->size - size;
 	
 	/* skip info */
-	while(*buff++ != '\n') {
-		if(--avail == 0) {
-			if((avail = buffFileBuff(src)) == 0) {
-				return 0;
-			}
-			buff = src->buffer;
+	while(!(nl = memchr(buff, '\n', avail))) {
+		if((avail = buffFileBuff(src)) == 0) {
+			return 0;
 		}
+		buff = src->buffer;
 	}
+	avail -= nl - buff;
+	buff = nl + 1;
 	if(--avail == 0) {
 		if((avail = buffFileBuff(src)) == 0) {
 			return 0;
@@ -361,9 +400,9 @@ int FileBuffgetFq(FileBuff *src, Qseqs *header, Qseqs *qseq, Qseqs *qual, char *
 		while(size) {
 			if(size < avail) {
 				memcpy(seq, buff, size);
-				size = 0;
 				avail -= size;
 				buff += size;
+				size = 0;
 			} else {
 				memcpy(seq, buff, avail);
 				size -= avail;
@@ -404,8 +443,8 @@ int FileBuffgetFq(FileBuff *src, Qseqs *header, Qseqs *qseq, Qseqs *qual, char *
 
 int FileBuffgetFqSeq(FileBuff *src, Qseqs *qseq, Qseqs *qual, char *trans) {
 	
-	unsigned char *buff, *seq;
-	int size, avail;
+	unsigned char *buff, *seq, *nl;
+	int size, avail, chunk, n;
 	
 	/* init */
 	avail = src->bytes;
@@ -425,14 +464,14 @@ int FileBuffgetFqSeq(FileBuff *src, Qseqs *qseq, Qseqs *qual, char *trans) {
 	}
 	
 	/* skip header */
-	while(*buff++ != '\n') {
-		if(--avail == 0) {
-			if((avail = buffFileBuff(src)) == 0) {
-				return 0;
-			}
-			buff = src->buffer;
+	while(!(nl = memchr(buff, '\n', avail))) {
+		if((avail = buffFileBuff(src)) == 0) {
+			return 0;
 		}
+		buff = src->buffer;
 	}
+	avail -= nl - buff;
+	buff = nl + 1;
 	if(--avail == 0) {
 		if((avail = buffFileBuff(src)) == 0) {
 			return 0;
@@ -443,14 +482,25 @@ int FileBuffgetFqSeq(FileBuff *src, Qseqs *qseq, Qseqs *qual, char *trans) {
 	/* get qseq */
 	seq = qseq->seq;
 	size = qseq->size;
-	while((*seq++ = trans[*buff++]) != 16) {
-		if(--avail == 0) {
+	while(1) {
+		chunk = avail < size ? avail : size;
+		n = transLine(seq, buff, chunk, trans);
+		seq += n;
+		size -= n;
+		buff += n;
+		avail -= n;
+		if(n < chunk) { /* newline */
+			*seq++ = 16;
+			++buff;
+			break;
+		}
+		if(avail == 0) {
 			if((avail = buffFileBuff(src)) == 0) {
 				return 0;
 			}
 			buff = src->buffer;
 		}
-		if(--size == 0) {
+		if(size == 0) {
 			size = qseq->size;
 			qseq->size <<= 1;
 			qseq->seq = realloc(qseq->seq, qseq->size);
@@ -474,14 +524,14 @@ int FileBuffgetFqSeq(FileBuff *src, Qseqs *qseq, Qseqs *qual, char *trans) {
 	qseq->len = qseq->size - size;
 	
 	/* skip info */
-	while(*buff++ != '\n') {
-		if(--avail == 0) {
-			if((avail = buffFileBuff(src)) == 0) {
-				return 0;
-			}
-			buff = src->buffer;
+	while(!(nl = memchr(buff, '\n', avail))) {
+		if((avail = buffFileBuff(src)) == 0) {
+			return 0;
 		}
+		buff = src->buffer;
 	}
+	avail -= nl - buff;
+	buff = nl + 1;
 	if(--avail == 0) {
 		if((avail = buffFileBuff(src)) == 0) {
 			return 0;
@@ -509,9 +559,9 @@ int FileBuffgetFqSeq(FileBuff *src, Qseqs *qseq, Qseqs *qual, char *trans) {
 		while(size) {
 			if(size < avail) {
 				memcpy(seq, buff, size);
-				size = 0;
 				avail -= size;
 				buff += size;
+				size = 0;
 			} else {
 				memcpy(seq, buff, avail);
 				size -= avail;
@@ -526,14 +576,14 @@ int FileBuffgetFqSeq(FileBuff *src, Qseqs *qseq, Qseqs *qual, char *trans) {
 	qual->seq[qual->len] = 0;
 	
 	/* skip newline */
-	while(*buff++ != '\n') {
-		if(--avail == 0) {
-			if((avail = buffFileBuff(src)) == 0) {
-				return 0;
-			}
-			buff = src->buffer;
+	while(!(nl = memchr(buff, '\n', avail))) {
+		if((avail = buffFileBuff(src)) == 0) {
+			return 0;
 		}
+		buff = src->buffer;
 	}
+	avail -= nl - buff;
+	buff = nl + 1;
 	if(--avail == 0) {
 		if((avail = buffFileBuff(src)) == 0) {
 			return 1;
@@ -20,6 +20,8 @@
 #include "filebuff.h"
 #include "qseqs.h"
 
+/* read an input from memory */
+void setMemInput(const char *name, const char *buff, long size);
 /* determine format */
 int openAndDetermine(FileBuff *inputfile, char *filename);
 /* get entry from fastafile */
@@ -0,0 +1,1237 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <limits.h>
+#include <string.h>
+#include "kmacpu.h"
+#include "seqscan.h"
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SEQSCAN_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define SEQSCAN_NEON 1
+#endif
+
+int (*transLine)(unsigned char *, const unsigned char *, int, const char *) = &transLine_init;
+int (*transFsa)(unsigned char *, const unsigned char *, int, const char *, int *) = &transFsa_init;
+void (*packNuc)(long unsigned *, int *, const unsigned char *, int) = &packNuc_init;
+void (*rcWords)(long unsigned *, const long unsigned *, int) = &rcWords_init;
+void (*shiftWords)(long unsigned *, int, int) = &shiftWords_init;
+int (*findU32)(const unsigned *, int, unsigned) = &findU32_init;
+int (*findU16)(const short unsigned *, int, unsigned) = &findU16_init;
+long unsigned (*svbDecode)(unsigned *, const unsigned char *, const unsigned char *, int) = &svbDecode_init;
+unsigned (*maskQual)(unsigned char *, const unsigned char *, int, int, unsigned *) = &maskQual_init;
+void (*decodeNuc)(unsigned char *, int) = &decodeNuc_init;
+static unsigned char svbShuffle[256][16];
+static unsigned char svbLen[256];
+
+int transStd(const char *trans) {
+	
+	/* vector kernels hardcode the nucleotide codes */
+	return trans['A'] == 0 && trans['a'] == 0 && trans['C'] == 1 && 
+		trans['c'] == 1 && trans['G'] == 2 && trans['g'] == 2 && 
+		trans['T'] == 3 && trans['t'] == 3 && trans['\n'] == 16;
+}
+
+int transLine_scalar(unsigned char *dest, const unsigned char *src, int len, const char *trans) {
+	
+	const unsigned char *end;
+	
+	end = src + len;
+	while(src < end && (*dest++ = trans[*src]) != 16) {
+		++src;
+	}
+	
+	return len - (end - src);
+}
+
+int transFsa_scalar(unsigned char *dest, const unsigned char *src, int len, const char *trans, int *written) {
+	
+	unsigned char *seq;
+	const unsigned char *end;
+	
+	seq = dest;
+	end = src + len;
+	while(src < end && *src != '>') {
+		if(((*seq = trans[*src++]) >> 3) == 0) {
+			++seq;
+		}
+	}
+	*written = seq - dest;
+	
+	return len - (end - src);
+}
+
+void packNuc_scalar(long unsigned *dest, int *N, const unsigned char *seq, int seqlen) {
+	
+	int i, j, pos, end;
+	
+	N[0] = 0;
+	for(i = 0, pos = 0; i < seqlen; i += 32) {
+		end = (i + 32 < seqlen) ? i + 32 : seqlen;
+		pos = i >> 5;
+		for(j = i; j < end; ++j) {
+			if(seq[j] == 4) {
+				dest[pos] <<= 2;
+				N[++N[0]] = j;
+			} else {
+				dest[pos] = (dest[pos] << 2) | seq[j];
+			}
+		}
+	}
+	if(seqlen & 31) {
+		dest[pos] <<= (64 - ((seqlen & 31) << 1));
+	}
+}
+
+static inline void packNuc_word(long unsigned *dest, int *N, const unsigned char *seq, int i, int end) {
+	
+	long unsigned word;
+	
+	/* scalar fall back for a single word */
+	word = 0;
+	while(i < end) {
+		if(seq[i] == 4) {
+			word <<= 2;
+			N[++N[0]] = i;
+		} else {
+			word = (word << 2) | seq[i];
+		}
+		++i;
+	}
+	*dest = word;
+}
+
+static inline void packNuc_N(int *N, unsigned mask, int i) {
+	
+	while(mask) {
+		N[++N[0]] = i + __builtin_ctz(mask);
+		mask &= mask - 1;
+	}
+}
+
+static inline long unsigned rcWord(long unsigned mer) {
+	
+	/* complement, swap bases within bytes, then swap bytes */
+	mer = ~mer;
+	mer = ((mer >> 2) & 0x3333333333333333) | ((mer & 0x3333333333333333) << 2);
+	mer = ((mer >> 4) & 0x0F0F0F0F0F0F0F0F) | ((mer & 0x0F0F0F0F0F0F0F0F) << 4);
+	
+	return __builtin_bswap64(mer);
+}
+
+void rcWords_scalar(long unsigned *dest, const long unsigned *src, int n) {
+	
+	int i, j;
+	long unsigned carry;
+	
+	/* dest may be src */
+	for(i = 0, j = n - 1; i < j; ++i, --j) {
+		carry = rcWord(src[i]);
+		dest[i] = rcWord(src[j]);
+		dest[j] = carry;
+	}
+	if(i == j) {
+		dest[i] = rcWord(src[i]);
+	}
+}
+
+void shiftWords_scalar(long unsigned *seq, int n, int shift) {
+	
+	int i, r_shift;
+	
+	r_shift = 64 - shift;
+	for(i = 1; i < n; ++i) {
+		seq[i - 1] = (seq[i - 1] << shift) | (seq[i] >> r_shift);
+	}
+	seq[n - 1] <<= shift;
+}
+
+int findU32_scalar(const unsigned *list, int n, unsigned target) {
+	
+	int i;
+	
+	for(i = 0; i < n; ++i) {
+		if(list[i] == target) {
+			return i;
+		}
+	}
+	
+	return -1;
+}
+
+int findU16_scalar(const short unsigned *list, int n, unsigned target) {
+	
+	int i;
+	
+	for(i = 0; i < n; ++i) {
+		if(list[i] == target) {
+			return i;
+		}
+	}
+	
+	return -1;
+}
+
+unsigned maskQual_scalar(unsigned char *seq, const unsigned char *qual, int len, int minQ, unsigned *gc) {
+	
+	int i;
+	unsigned ns, g;
+	
+	ns = 0;
+	g = 0;
+	for(i = 0; i < len; ++i) {
+		if(seq[i] == 4 || qual[i] < minQ) {
+			seq[i] = 4;
+			++ns;
+		} else if(seq[i] == 1 || seq[i] == 2) {
+			++g;
+		}
+	}
+	*gc = g;
+	
+	return ns;
+}
+
+void decodeNuc_scalar(unsigned char *seq, int len) {
+	
+	static const char bases[6] = "ACGTN-";
+	
+	while(len--) {
+		*seq = bases[*seq];
+		++seq;
+	}
+}
+
+long unsigned svbEncode(unsigned char *ctrl, unsigned char *data, const unsigned *src, int n) {
+	
+	int i, code;
+	unsigned x;
+	unsigned char *start;
+	
+	/* 2 bit byte length per int, first int in the low bits */
+	start = data;
+	for(i = 0; i < n; ++i) {
+		x = src[i];
+		code = (x < 256) ? 0 : (x < 65536) ? 1 : (x < 16777216) ? 2 : 3;
+		if(!(i & 3)) {
+			ctrl[i >> 2] = 0;
+		}
+		ctrl[i >> 2] |= code << ((i & 3) << 1);
+		do {
+			*data++ = x;
+			x >>= 8;
+		} while(code--);
+	}
+	
+	return data - start;
+}
+
+long unsigned svbDecode_scalar(unsigned *dest, const unsigned char *ctrl, const unsigned char *data, int n) {
+	
+	int i, code;
+	unsigned x, shift;
+	const unsigned char *start;
+	
+	start = data;
+	for(i = 0; i < n; ++i) {
+		code = (ctrl[i >> 2] >> ((i & 3) << 1)) & 3;
+		x = 0;
+		shift = 0;
+		do {
+			x |= (unsigned)(*data++) << shift;
+			shift += 8;
+		} while(code--);
+		dest[i] = x;
+	}
+	
+	return data - start;
+}
+
+static void svbTables(void) {
+	
+	int c, i, j, code, pos;
+	
+	/* shuffle gathering 4 ints from the data bytes given by a control byte */
+	for(c = 0; c < 256; ++c) {
+		pos = 0;
+		for(i = 0; i < 4; ++i) {
+			code = (c >> (i << 1)) & 3;
+			for(j = 0; j < 4; ++j) {
+				svbShuffle[c][(i << 2) + j] = (j <= code) ? pos++ : 255;
+			}
+		}
+		svbLen[c] = pos;
+	}
+}
+
+#ifdef SEQSCAN_X86
+__attribute__((target("avx2")))
+static int transLine_avx2(unsigned char *dest, const unsigned char *src, int len, const char *trans) {
+	
+	int i, shift;
+	unsigned mask;
+	__m256i x, valid, lower, code;
+	const __m256i A = _mm256_set1_epi8('a');
+	const __m256i C = _mm256_set1_epi8('c');
+	const __m256i G = _mm256_set1_epi8('g');
+	const __m256i T = _mm256_set1_epi8('t');
+	const __m256i nibble = _mm256_setr_epi8(
+		0, 0, 0, 1, 3, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 
+		0, 0, 0, 1, 3, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0);
+	
+	if(!transStd(trans)) {
+		return transLine_scalar(dest, src, len, trans);
+	}
+	
+	lower = _mm256_set1_epi8(0x20);
+	i = 0;
+	while(i + 32 <= len) {
+		x = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(src + i)), lower);
+		valid = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(x, A), _mm256_cmpeq_epi8(x, C)), 
+			_mm256_or_si256(_mm256_cmpeq_epi8(x, G), _mm256_cmpeq_epi8(x, T)));
+		code = _mm256_shuffle_epi8(nibble, _mm256_and_si256(x, _mm256_set1_epi8(15)));
+		_mm256_storeu_si256((__m256i *)(dest + i), code);
+		mask = ~((unsigned) _mm256_movemask_epi8(valid));
+		if(mask == 0) {
+			i += 32;
+		} else {
+			/* resolve first non-ACGT in scalar */
+			shift = __builtin_ctz(mask);
+			i += shift;
+			if((dest[i] = trans[src[i]]) == 16) {
+				return i;
+			}
+			++i;
+		}
+	}
+	
+	return i + transLine_scalar(dest + i, src + i, len - i, trans);
+}
+
+__attribute__((target("avx2")))
+static int transFsa_avx2(unsigned char *dest, const unsigned char *src, int len, const char *trans, int *written) {
+	
+	int i, w, shift;
+	unsigned mask;
+	__m256i x, valid, lower, code;
+	const __m256i A = _mm256_set1_epi8('a');
+	const __m256i C = _mm256_set1_epi8('c');
+	const __m256i G = _mm256_set1_epi8('g');
+	const __m256i T = _mm256_set1_epi8('t');
+	const __m256i nibble = _mm256_setr_epi8(
+		0, 0, 0, 1, 3, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 
+		0, 0, 0, 1, 3, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0);
+	
+	if(!transStd(trans)) {
+		return transFsa_scalar(dest, src, len, trans, written);
+	}
+	
+	lower = _mm256_set1_epi8(0x20);
+	i = 0;
+	w = 0;
+	while(i + 32 <= len) {
+		x = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(src + i)), lower);
+		valid = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(x, A), _mm256_cmpeq_epi8(x, C)), 
+			_mm256_or_si256(_mm256_cmpeq_epi8(x, G), _mm256_cmpeq_epi8(x, T)));
+		code = _mm256_shuffle_epi8(nibble, _mm256_and_si256(x, _mm256_set1_epi8(15)));
+		_mm256_storeu_si256((__m256i *)(dest + w), code);
+		mask = ~((unsigned) _mm256_movemask_epi8(valid));
+		if(mask == 0) {
+			i += 32;
+			w += 32;
+		} else {
+			/* resolve first non-ACGT in scalar */
+			shift = __builtin_ctz(mask);
+			i += shift;
+			w += shift;
+			if(src[i] == '>') {
+				*written = w;
+				return i;
+			} else if(((dest[w] = trans[src[i]]) >> 3) == 0) {
+				++w;
+			}
+			++i;
+		}
+	}
+	i += transFsa_scalar(dest + w, src + i, len - i, trans, &shift);
+	*written = w + shift;
+	
+	return i;
+}
+
+__attribute__((target("sse4.2")))
+static int transLine_sse42(unsigned char *dest, const unsigned char *src, int len, const char *trans) {
+	
+	int i, shift;
+	unsigned mask;
+	__m128i x, valid, lower, code;
+	const __m128i A = _mm_set1_epi8('a');
+	const __m128i C = _mm_set1_epi8('c');
+	const __m128i G = _mm_set1_epi8('g');
+	const __m128i T = _mm_set1_epi8('t');
+	const __m128i nibble = _mm_setr_epi8(
+		0, 0, 0, 1, 3, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0);
+	
+	if(!transStd(trans)) {
+		return transLine_scalar(dest, src, len, trans);
+	}
+	
+	lower = _mm_set1_epi8(0x20);
+	i = 0;
+	while(i + 16 <= len) {
+		x = _mm_or_si128(_mm_loadu_si128((const __m128i *)(src + i)), lower);
+		valid = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(x, A), _mm_cmpeq_epi8(x, C)), 
+			_mm_or_si128(_mm_cmpeq_epi8(x, G), _mm_cmpeq_epi8(x, T)));
+		code = _mm_shuffle_epi8(nibble, _mm_and_si128(x, _mm_set1_epi8(15)));
+		_mm_storeu_si128((__m128i *)(dest + i), code);
+		mask = (~((unsigned) _mm_movemask_epi8(valid))) & 0xFFFF;
+		if(mask == 0) {
+			i += 16;
+		} else {
+			/* resolve first non-ACGT in scalar */
+			shift = __builtin_ctz(mask);
+			i += shift;
+			if((dest[i] = trans[src[i]]) == 16) {
+				return i;
+			}
+			++i;
+		}
+	}
+	
+	return i + transLine_scalar(dest + i, src + i, len - i, trans);
+}
+
+__attribute__((target("sse4.2")))
+static int transFsa_sse42(unsigned char *dest, const unsigned char *src, int len, const char *trans, int *written) {
+	
+	int i, w, shift;
+	unsigned mask;
+	__m128i x, valid, lower, code;
+	const __m128i A = _mm_set1_epi8('a');
+	const __m128i C = _mm_set1_epi8('c');
+	const __m128i G = _mm_set1_epi8('g');
+	const __m128i T = _mm_set1_epi8('t');
+	const __m128i nibble = _mm_setr_epi8(
+		0, 0, 0, 1, 3, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0);
+	
+	if(!transStd(trans)) {
+		return transFsa_scalar(dest, src, len, trans, written);
+	}
+	
+	lower = _mm_set1_epi8(0x20);
+	i = 0;
+	w = 0;
+	while(i + 16 <= len) {
+		x = _mm_or_si128(_mm_loadu_si128((const __m128i *)(src + i)), lower);
+		valid = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(x, A), _mm_cmpeq_epi8(x, C)), 
+			_mm_or_si128(_mm_cmpeq_epi8(x, G), _mm_cmpeq_epi8(x, T)));
+		code = _mm_shuffle_epi8(nibble, _mm_and_si128(x, _mm_set1_epi8(15)));
+		_mm_storeu_si128((__m128i *)(dest + w), code);
+		mask = (~((unsigned) _mm_movemask_epi8(valid))) & 0xFFFF;
+		if(mask == 0) {
+			i += 16;
+			w += 16;
+		} else {
+			/* resolve first non-ACGT in scalar */
+			shift = __builtin_ctz(mask);
+			i += shift;
+			w += shift;
+			if(src[i] == '>') {
+				*written = w;
+				return i;
+			} else if(((dest[w] = trans[src[i]]) >> 3) == 0) {
+				++w;
+			}
+			++i;
+		}
+	}
+	i += transFsa_scalar(dest + w, src + i, len - i, trans, &shift);
+	*written = w + shift;
+	
+	return i;
+}
+__attribute__((target("avx2")))
+static void packNuc_avx2(long unsigned *dest, int *N, const unsigned char *seq, int seqlen) {
+	
+	int i;
+	unsigned Nmask;
+	__m256i x, four, pairs, quads, gather;
+	const __m256i w2 = _mm256_set1_epi16(0x0104);
+	const __m256i w4 = _mm256_set1_epi32(0x00010010);
+	
+	four = _mm256_set1_epi8(4);
+	gather = _mm256_setr_epi8(
+		0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 
+		0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	N[0] = 0;
+	for(i = 0; i + 32 <= seqlen; i += 32, ++dest) {
+		x = _mm256_loadu_si256((const __m256i *)(seq + i));
+		if(~_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(x, four), four))) {
+			packNuc_word(dest, N, seq, i, i + 32);
+			continue;
+		}
+		Nmask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, four));
+		x = _mm256_and_si256(x, _mm256_set1_epi8(3));
+		/* 2 x 2 bits -> 4 bits -> 8 bits, first base highest */
+		pairs = _mm256_maddubs_epi16(x, w2);
+		quads = _mm256_shuffle_epi8(_mm256_madd_epi16(pairs, w4), gather);
+		*dest = __builtin_bswap64((long unsigned)(unsigned) _mm256_cvtsi256_si32(quads) | 
+			((long unsigned)(unsigned) _mm256_extract_epi32(quads, 4) << 32));
+		packNuc_N(N, Nmask, i);
+	}
+	if(i < seqlen) {
+		packNuc_word(dest, N, seq, i, seqlen);
+		*dest <<= (64 - ((seqlen & 31) << 1));
+	}
+}
+
+__attribute__((target("sse4.2")))
+static void packNuc_sse42(long unsigned *dest, int *N, const unsigned char *seq, int seqlen) {
+	
+	int i;
+	unsigned Nmask;
+	long unsigned word;
+	__m128i x, four, pairs, quads, gather, mask;
+	const __m128i w2 = _mm_set1_epi16(0x0104);
+	const __m128i w4 = _mm_set1_epi32(0x00010010);
+	
+	four = _mm_set1_epi8(4);
+	mask = _mm_set1_epi8(3);
+	gather = _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	N[0] = 0;
+	for(i = 0; i + 32 <= seqlen; i += 32, ++dest) {
+		x = _mm_loadu_si128((const __m128i *)(seq + i));
+		pairs = _mm_loadu_si128((const __m128i *)(seq + i + 16));
+		if((_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(x, four), four)) & _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(pairs, four), four))) != 0xFFFF) {
+			packNuc_word(dest, N, seq, i, i + 32);
+			continue;
+		}
+		Nmask = _mm_movemask_epi8(_mm_cmpeq_epi8(x, four)) | (_mm_movemask_epi8(_mm_cmpeq_epi8(pairs, four)) << 16);
+		/* 2 x 2 bits -> 4 bits -> 8 bits, first base highest */
+		quads = _mm_shuffle_epi8(_mm_madd_epi16(_mm_maddubs_epi16(_mm_and_si128(x, mask), w2), w4), gather);
+		word = (unsigned) _mm_cvtsi128_si32(quads);
+		quads = _mm_shuffle_epi8(_mm_madd_epi16(_mm_maddubs_epi16(_mm_and_si128(pairs, mask), w2), w4), gather);
+		word |= (long unsigned)(unsigned) _mm_cvtsi128_si32(quads) << 32;
+		*dest = __builtin_bswap64(word);
+		packNuc_N(N, Nmask, i);
+	}
+	if(i < seqlen) {
+		packNuc_word(dest, N, seq, i, seqlen);
+		*dest <<= (64 - ((seqlen & 31) << 1));
+	}
+}
+__attribute__((target("avx2")))
+static inline __m256i rcWord_avx2(__m256i x) {
+	
+	const __m256i lut = _mm256_setr_epi8(
+		15, 11, 7, 3, 14, 10, 6, 2, 13, 9, 5, 1, 12, 8, 4, 0, 
+		15, 11, 7, 3, 14, 10, 6, 2, 13, 9, 5, 1, 12, 8, 4, 0);
+	const __m256i rev = _mm256_setr_epi8(
+		15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 
+		15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+	const __m256i low = _mm256_set1_epi8(15);
+	
+	/* complement and reverse bases of each nibble by lookup, swap nibbles */
+	x = _mm256_or_si256(
+		_mm256_slli_epi16(_mm256_shuffle_epi8(lut, _mm256_and_si256(x, low)), 4), 
+		_mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), low)));
+	/* reverse all 32 bytes */
+	return _mm256_permute2x128_si256(_mm256_shuffle_epi8(x, rev), _mm256_shuffle_epi8(x, rev), 1);
+}
+
+__attribute__((target("avx2")))
+static void rcWords_avx2(long unsigned *dest, const long unsigned *src, int n) {
+	
+	int i, j;
+	__m256i front, back;
+	
+	/* dest may be src */
+	for(i = 0, j = n - 4; i + 4 <= j; i += 4, j -= 4) {
+		front = _mm256_loadu_si256((const __m256i *)(src + i));
+		back = _mm256_loadu_si256((const __m256i *)(src + j));
+		_mm256_storeu_si256((__m256i *)(dest + i), rcWord_avx2(back));
+		_mm256_storeu_si256((__m256i *)(dest + j), rcWord_avx2(front));
+	}
+	if(i < j + 4) {
+		rcWords_scalar(dest + i, src + i, j + 4 - i);
+	}
+}
+
+__attribute__((target("avx2")))
+static void shiftWords_avx2(long unsigned *seq, int n, int shift) {
+	
+	int i;
+	__m128i s, r;
+	__m256i x, y;
+	
+	s = _mm_cvtsi32_si128(shift);
+	r = _mm_cvtsi32_si128(64 - shift);
+	for(i = 0; i + 5 <= n; i += 4) {
+		x = _mm256_loadu_si256((const __m256i *)(seq + i));
+		y = _mm256_loadu_si256((const __m256i *)(seq + i + 1));
+		_mm256_storeu_si256((__m256i *)(seq + i), _mm256_or_si256(_mm256_sll_epi64(x, s), _mm256_srl_epi64(y, r)));
+	}
+	shiftWords_scalar(seq + i, n - i, shift);
+}
+__attribute__((target("avx2")))
+static int findU32_avx2(const unsigned *list, int n, unsigned target) {
+	
+	int i, mask;
+	__m256i t;
+	
+	t = _mm256_set1_epi32(target);
+	for(i = 0; i + 8 <= n; i += 8) {
+		mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(list + i)), t)));
+		if(mask) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+	if((n = findU32_scalar(list + i, n - i, target)) < 0) {
+		return -1;
+	}
+	
+	return i + n;
+}
+
+__attribute__((target("avx2")))
+static int findU16_avx2(const short unsigned *list, int n, unsigned target) {
+	
+	int i, mask;
+	__m256i t;
+	
+	if(USHRT_MAX < target) {
+		return -1;
+	}
+	t = _mm256_set1_epi16(target);
+	for(i = 0; i + 16 <= n; i += 16) {
+		mask = _mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)(list + i)), t));
+		if(mask) {
+			return i + (__builtin_ctz(mask) >> 1);
+		}
+	}
+	if((n = findU16_scalar(list + i, n - i, target)) < 0) {
+		return -1;
+	}
+	
+	return i + n;
+}
+
+__attribute__((target("sse4.2")))
+static int findU32_sse42(const unsigned *list, int n, unsigned target) {
+	
+	int i, mask;
+	__m128i t;
+	
+	t = _mm_set1_epi32(target);
+	for(i = 0; i + 4 <= n; i += 4) {
+		mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(list + i)), t)));
+		if(mask) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+	if((n = findU32_scalar(list + i, n - i, target)) < 0) {
+		return -1;
+	}
+	
+	return i + n;
+}
+
+__attribute__((target("sse4.2")))
+static int findU16_sse42(const short unsigned *list, int n, unsigned target) {
+	
+	int i, mask;
+	__m128i t;
+	
+	if(USHRT_MAX < target) {
+		return -1;
+	}
+	t = _mm_set1_epi16(target);
+	for(i = 0; i + 8 <= n; i += 8) {
+		mask = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)(list + i)), t));
+		if(mask) {
+			return i + (__builtin_ctz(mask) >> 1);
+		}
+	}
+	if((n = findU16_scalar(list + i, n - i, target)) < 0) {
+		return -1;
+	}
+	
+	return i + n;
+}
+
+__attribute__((target("sse4.2")))
+static long unsigned svbDecode_sse42(unsigned *dest, const unsigned char *ctrl, const unsigned char *data, int n) {
+	
+	int i;
+	const unsigned char *start;
+	
+	/* data must be readable 16 bytes past its end */
+	start = data;
+	for(i = 0; i + 4 <= n; i += 4, ++ctrl) {
+		_mm_storeu_si128((__m128i *)(dest + i), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) data), _mm_loadu_si128((const __m128i *) svbShuffle[*ctrl])));
+		data += svbLen[*ctrl];
+	}
+	data += svbDecode_scalar(dest + i, ctrl, data, n - i);
+	
+	return data - start;
+}
+
+__attribute__((target("avx2")))
+static unsigned maskQual_avx2(unsigned char *seq, const unsigned char *qual, int len, int minQ, unsigned *gc) {
+	
+	int i;
+	unsigned ns, g;
+	__m256i s, m, t, four, zero;
+	
+	if(255 < minQ) {
+		return maskQual_scalar(seq, qual, len, minQ, gc);
+	}
+	
+	/* qual < minQ where minQ - qual does not saturate to zero */
+	t = _mm256_set1_epi8(minQ < 0 ? 0 : minQ);
+	four = _mm256_set1_epi8(4);
+	zero = _mm256_setzero_si256();
+	ns = 0;
+	g = 0;
+	for(i = 0; i + 32 <= len; i += 32) {
+		s = _mm256_loadu_si256((const __m256i *)(seq + i));
+		m = _mm256_cmpeq_epi8(_mm256_subs_epu8(t, _mm256_loadu_si256((const __m256i *)(qual + i))), zero);
+		m = _mm256_or_si256(_mm256_cmpeq_epi8(s, four), _mm256_xor_si256(m, _mm256_set1_epi8(-1)));
+		s = _mm256_blendv_epi8(s, four, m);
+		_mm256_storeu_si256((__m256i *)(seq + i), s);
+		ns += __builtin_popcount(_mm256_movemask_epi8(m));
+		g += __builtin_popcount(_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(s, _mm256_set1_epi8(1)), _mm256_cmpeq_epi8(s, _mm256_set1_epi8(2)))));
+	}
+	ns += maskQual_scalar(seq + i, qual + i, len - i, minQ, gc);
+	*gc += g;
+	
+	return ns;
+}
+
+__attribute__((target("sse4.2")))
+static unsigned maskQual_sse42(unsigned char *seq, const unsigned char *qual, int len, int minQ, unsigned *gc) {
+	
+	int i;
+	unsigned ns, g;
+	__m128i s, m, t, four, zero;
+	
+	if(255 < minQ) {
+		return maskQual_scalar(seq, qual, len, minQ, gc);
+	}
+	
+	/* qual < minQ where minQ - qual does not saturate to zero */
+	t = _mm_set1_epi8(minQ < 0 ? 0 : minQ);
+	four = _mm_set1_epi8(4);
+	zero = _mm_setzero_si128();
+	ns = 0;
+	g = 0;
+	for(i = 0; i + 16 <= len; i += 16) {
+		s = _mm_loadu_si128((const __m128i *)(seq + i));
+		m = _mm_cmpeq_epi8(_mm_subs_epu8(t, _mm_loadu_si128((const __m128i *)(qual + i))), zero);
+		m = _mm_or_si128(_mm_cmpeq_epi8(s, four), _mm_xor_si128(m, _mm_set1_epi8(-1)));
+		s = _mm_blendv_epi8(s, four, m);
+		_mm_storeu_si128((__m128i *)(seq + i), s);
+		ns += __builtin_popcount(_mm_movemask_epi8(m));
+		g += __builtin_popcount(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(s, _mm_set1_epi8(1)), _mm_cmpeq_epi8(s, _mm_set1_epi8(2)))));
+	}
+	ns += maskQual_scalar(seq + i, qual + i, len - i, minQ, gc);
+	*gc += g;
+	
+	return ns;
+}
+
+__attribute__((target("avx2")))
+static void decodeNuc_avx2(unsigned char *seq, int len) {
+	
+	int i;
+	__m256i bases;
+	
+	bases = _mm256_setr_epi8(
+		'A', 'C', 'G', 'T', 'N', '-', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 
+		'A', 'C', 'G', 'T', 'N', '-', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	for(i = 0; i + 32 <= len; i += 32) {
+		_mm256_storeu_si256((__m256i *)(seq + i), _mm256_shuffle_epi8(bases, _mm256_loadu_si256((const __m256i *)(seq + i))));
+	}
+	decodeNuc_scalar(seq + i, len - i);
+}
+
+__attribute__((target("sse4.2")))
+static void decodeNuc_sse42(unsigned char *seq, int len) {
+	
+	int i;
+	__m128i bases;
+	
+	bases = _mm_setr_epi8('A', 'C', 'G', 'T', 'N', '-', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	for(i = 0; i + 16 <= len; i += 16) {
+		_mm_storeu_si128((__m128i *)(seq + i), _mm_shuffle_epi8(bases, _mm_loadu_si128((const __m128i *)(seq + i))));
+	}
+	decodeNuc_scalar(seq + i, len - i);
+}
+#endif
+
+#ifdef SEQSCAN_NEON
+static inline uint64_t neonMask(uint8x16_t valid) {
+	
+	/* 4 bits per byte of non-ACGT */
+	return ~vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(valid), 4)), 0);
+}
+
+static inline uint8x16_t neonTrans(const unsigned char *src, uint8x16_t *code) {
+	
+	uint8x16_t x;
+	static const unsigned char nibble[16] = {0, 0, 0, 1, 3, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0};
+	
+	x = vorrq_u8(vld1q_u8(src), vdupq_n_u8(0x20));
+	*code = vqtbl1q_u8(vld1q_u8(nibble), vandq_u8(x, vdupq_n_u8(15)));
+	
+	return vorrq_u8(
+		vorrq_u8(vceqq_u8(x, vdupq_n_u8('a')), vceqq_u8(x, vdupq_n_u8('c'))), 
+		vorrq_u8(vceqq_u8(x, vdupq_n_u8('g')), vceqq_u8(x, vdupq_n_u8('t'))));
+}
+
+static int transLine_neon(unsigned char *dest, const unsigned char *src, int len, const char *trans) {
+	
+	int i, shift;
+	uint64_t mask;
+	uint8x16_t code, valid;
+	
+	if(!transStd(trans)) {
+		return transLine_scalar(dest, src, len, trans);
+	}
+	
+	i = 0;
+	while(i + 16 <= len) {
+		valid = neonTrans(src + i, &code);
+		vst1q_u8(dest + i, code);
+		mask = neonMask(valid);
+		if(mask == 0) {
+			i += 16;
+		} else {
+			/* resolve first non-ACGT in scalar */
+			shift = __builtin_ctzll(mask) >> 2;
+			i += shift;
+			if((dest[i] = trans[src[i]]) == 16) {
+				return i;
+			}
+			++i;
+		}
+	}
+	
+	return i + transLine_scalar(dest + i, src + i, len - i, trans);
+}
+
+static int transFsa_neon(unsigned char *dest, const unsigned char *src, int len, const char *trans, int *written) {
+	
+	int i, w, shift;
+	uint64_t mask;
+	uint8x16_t code, valid;
+	
+	if(!transStd(trans)) {
+		return transFsa_scalar(dest, src, len, trans, written);
+	}
+	
+	i = 0;
+	w = 0;
+	while(i + 16 <= len) {
+		valid = neonTrans(src + i, &code);
+		vst1q_u8(dest + w, code);
+		mask = neonMask(valid);
+		if(mask == 0) {
+			i += 16;
+			w += 16;
+		} else {
+			/* resolve first non-ACGT in scalar */
+			shift = __builtin_ctzll(mask) >> 2;
+			i += shift;
+			w += shift;
+			if(src[i] == '>') {
+				*written = w;
+				return i;
+			} else if(((dest[w] = trans[src[i]]) >> 3) == 0) {
+				++w;
+			}
+			++i;
+		}
+	}
+	i += transFsa_scalar(dest + w, src + i, len - i, trans, &shift);
+	*written = w + shift;
+	
+	return i;
+}
+static inline unsigned neonPack(uint8x16_t x) {
+	
+	uint16x8_t pairs;
+	uint32x4_t quads;
+	
+	/* 2 x 2 bits -> 4 bits -> 8 bits, first base highest */
+	x = vandq_u8(x, vdupq_n_u8(3));
+	pairs = vreinterpretq_u16_u8(x);
+	pairs = vorrq_u16(vshlq_n_u16(vandq_u16(pairs, vdupq_n_u16(0xFF)), 2), vshrq_n_u16(pairs, 8));
+	quads = vreinterpretq_u32_u16(pairs);
+	quads = vorrq_u32(vshlq_n_u32(vandq_u32(quads, vdupq_n_u32(0xFFFF)), 4), vshrq_n_u32(quads, 16));
+	
+	return vget_lane_u32(vreinterpret_u32_u8(vmovn_u16(vcombine_u16(vmovn_u32(quads), vdup_n_u16(0)))), 0);
+}
+
+static void packNuc_neon(long unsigned *dest, int *N, const unsigned char *seq, int seqlen) {
+	
+	int i;
+	uint64_t m1, m2;
+	uint8x16_t x1, x2, four;
+	
+	four = vdupq_n_u8(4);
+	N[0] = 0;
+	for(i = 0; i + 32 <= seqlen; i += 32, ++dest) {
+		x1 = vld1q_u8(seq + i);
+		x2 = vld1q_u8(seq + i + 16);
+		if(4 < vmaxvq_u8(vmaxq_u8(x1, x2))) {
+			packNuc_word(dest, N, seq, i, i + 32);
+			continue;
+		}
+		*dest = __builtin_bswap64((long unsigned) neonPack(x1) | ((long unsigned) neonPack(x2) << 32));
+		/* 4 bits per byte of N */
+		m1 = neonMask(vmvnq_u8(vceqq_u8(x1, four)));
+		m2 = neonMask(vmvnq_u8(vceqq_u8(x2, four)));
+		while(m1) {
+			N[++N[0]] = i + (__builtin_ctzll(m1) >> 2);
+			m1 &= ~(15LLU << (__builtin_ctzll(m1) & ~3));
+		}
+		while(m2) {
+			N[++N[0]] = i + 16 + (__builtin_ctzll(m2) >> 2);
+			m2 &= ~(15LLU << (__builtin_ctzll(m2) & ~3));
+		}
+	}
+	if(i < seqlen) {
+		packNuc_word(dest, N, seq, i, seqlen);
+		*dest <<= (64 - ((seqlen & 31) << 1));
+	}
+}
+static inline uint8x16_t rcWord_neon(uint8x16_t x) {
+	
+	static const unsigned char lut[16] = {15, 11, 7, 3, 14, 10, 6, 2, 13, 9, 5, 1, 12, 8, 4, 0};
+	uint8x16_t tbl;
+	
+	/* complement and reverse bases of each nibble by lookup, swap nibbles */
+	tbl = vld1q_u8(lut);
+	x = vorrq_u8(vshlq_n_u8(vqtbl1q_u8(tbl, vandq_u8(x, vdupq_n_u8(15))), 4), vqtbl1q_u8(tbl, vshrq_n_u8(x, 4)));
+	/* reverse all 16 bytes */
+	x = vrev64q_u8(x);
+	
+	return vextq_u8(x, x, 8);
+}
+
+static void rcWords_neon(long unsigned *dest, const long unsigned *src, int n) {
+	
+	int i, j;
+	uint8x16_t front, back;
+	
+	/* dest may be src */
+	for(i = 0, j = n - 2; i + 2 <= j; i += 2, j -= 2) {
+		front = vld1q_u8((const unsigned char *)(src + i));
+		back = vld1q_u8((const unsigned char *)(src + j));
+		vst1q_u8((unsigned char *)(dest + i), rcWord_neon(back));
+		vst1q_u8((unsigned char *)(dest + j), rcWord_neon(front));
+	}
+	if(i < j + 2) {
+		rcWords_scalar(dest + i, src + i, j + 2 - i);
+	}
+}
+
+static void shiftWords_neon(long unsigned *seq, int n, int shift) {
+	
+	int i;
+	int64x2_t s, r;
+	uint64x2_t x, y;
+	
+	s = vdupq_n_s64(shift);
+	r = vdupq_n_s64(shift - 64);
+	for(i = 0; i + 3 <= n; i += 2) {
+		x = vld1q_u64((const uint64_t *)(seq + i));
+		y = vld1q_u64((const uint64_t *)(seq + i + 1));
+		vst1q_u64((uint64_t *)(seq + i), vorrq_u64(vshlq_u64(x, s), vshlq_u64(y, r)));
+	}
+	shiftWords_scalar(seq + i, n - i, shift);
+}
+static int findU32_neon(const unsigned *list, int n, unsigned target) {
+	
+	int i;
+	uint32x4_t t;
+	uint64_t mask;
+	
+	t = vdupq_n_u32(target);
+	for(i = 0; i + 4 <= n; i += 4) {
+		mask = vget_lane_u64(vreinterpret_u64_u16(vmovn_u32(vceqq_u32(vld1q_u32(list + i), t))), 0);
+		if(mask) {
+			return i + (__builtin_ctzll(mask) >> 4);
+		}
+	}
+	if((n = findU32_scalar(list + i, n - i, target)) < 0) {
+		return -1;
+	}
+	
+	return i + n;
+}
+
+static int findU16_neon(const short unsigned *list, int n, unsigned target) {
+	
+	int i;
+	uint16x8_t t;
+	uint64_t mask;
+	
+	if(USHRT_MAX < target) {
+		return -1;
+	}
+	t = vdupq_n_u16(target);
+	for(i = 0; i + 8 <= n; i += 8) {
+		mask = vget_lane_u64(vreinterpret_u64_u8(vmovn_u16(vceqq_u16(vld1q_u16(list + i), t))), 0);
+		if(mask) {
+			return i + (__builtin_ctzll(mask) >> 3);
+		}
+	}
+	if((n = findU16_scalar(list + i, n - i, target)) < 0) {
+		return -1;
+	}
+	
+	return i + n;
+}
+
+static long unsigned svbDecode_neon(unsigned *dest, const unsigned char *ctrl, const unsigned char *data, int n) {
+	
+	int i;
+	const unsigned char *start;
+	
+	/* data must be readable 16 bytes past its end */
+	start = data;
+	for(i = 0; i + 4 <= n; i += 4, ++ctrl) {
+		vst1q_u32(dest + i, vreinterpretq_u32_u8(vqtbl1q_u8(vld1q_u8(data), vld1q_u8(svbShuffle[*ctrl]))));
+		data += svbLen[*ctrl];
+	}
+	data += svbDecode_scalar(dest + i, ctrl, data, n - i);
+	
+	return data - start;
+}
+
+static unsigned maskQual_neon(unsigned char *seq, const unsigned char *qual, int len, int minQ, unsigned *gc) {
+	
+	int i;
+	unsigned ns, g;
+	uint8x16_t s, m, t, four, one;
+	
+	if(255 < minQ) {
+		return maskQual_scalar(seq, qual, len, minQ, gc);
+	}
+	
+	t = vdupq_n_u8(minQ < 0 ? 0 : minQ);
+	four = vdupq_n_u8(4);
+	one = vdupq_n_u8(1);
+	ns = 0;
+	g = 0;
+	for(i = 0; i + 16 <= len; i += 16) {
+		s = vld1q_u8(seq + i);
+		m = vorrq_u8(vceqq_u8(s, four), vcltq_u8(vld1q_u8(qual + i), t));
+		s = vbslq_u8(m, four, s);
+		vst1q_u8(seq + i, s);
+		ns += vaddvq_u8(vandq_u8(m, one));
+		g += vaddvq_u8(vandq_u8(vorrq_u8(vceqq_u8(s, one), vceqq_u8(s, vdupq_n_u8(2))), one));
+	}
+	ns += maskQual_scalar(seq + i, qual + i, len - i, minQ, gc);
+	*gc += g;
+	
+	return ns;
+}
+
+static void decodeNuc_neon(unsigned char *seq, int len) {
+	
+	int i;
+	uint8x16_t bases;
+	static const unsigned char table[16] = {'A', 'C', 'G', 'T', 'N', '-', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+	
+	bases = vld1q_u8(table);
+	for(i = 0; i + 16 <= len; i += 16) {
+		vst1q_u8(seq + i, vqtbl1q_u8(bases, vld1q_u8(seq + i)));
+	}
+	decodeNuc_scalar(seq + i, len - i);
+}
+#endif
+
+void seqscanInit(void) {
+	
+	static const KmaKernel kernels[] = {
+#ifdef SEQSCAN_X86
+		{CPU_AVX2, "avx2"},
+		{CPU_SSE42, "sse4.2"},
+#elif defined(SEQSCAN_NEON)
+		{CPU_NEON, "neon"},
+#endif
+		{0, "scalar"},
+		{0, 0}
+	};
+	unsigned need;
+	
+	/* pick the widest kernel supported by the running cpu */
+	svbTables();
+	need = kmaCpu_pick(CPU_SEQSCAN, kernels);
+#ifdef SEQSCAN_X86
+	if(need & CPU_AVX2) {
+		transLine = &transLine_avx2;
+		transFsa = &transFsa_avx2;
+		packNuc = &packNuc_avx2;
+		rcWords = &rcWords_avx2;
+		shiftWords = &shiftWords_avx2;
+		findU32 = &findU32_avx2;
+		findU16 = &findU16_avx2;
+		svbDecode = &svbDecode_sse42;
+		maskQual = &maskQual_avx2;
+		decodeNuc = &decodeNuc_avx2;
+	} else if(need & CPU_SSE42) {
+		transLine = &transLine_sse42;
+		transFsa = &transFsa_sse42;
+		packNuc = &packNuc_sse42;
+		rcWords = &rcWords_scalar;
+		shiftWords = &shiftWords_scalar;
+		findU32 = &findU32_sse42;
+		findU16 = &findU16_sse42;
+		svbDecode = &svbDecode_sse42;
+		maskQual = &maskQual_sse42;
+		decodeNuc = &decodeNuc_sse42;
+	} else {
+		transLine = &transLine_scalar;
+		transFsa = &transFsa_scalar;
+		packNuc = &packNuc_scalar;
+		rcWords = &rcWords_scalar;
+		shiftWords = &shiftWords_scalar;
+		findU32 = &findU32_scalar;
+		findU16 = &findU16_scalar;
+		svbDecode = &svbDecode_scalar;
+		maskQual = &maskQual_scalar;
+		decodeNuc = &decodeNuc_scalar;
+	}
+#elif defined(SEQSCAN_NEON)
+	if(need & CPU_NEON) {
+		transLine = &transLine_neon;
+		transFsa = &transFsa_neon;
+		packNuc = &packNuc_neon;
+		rcWords = &rcWords_neon;
+		shiftWords = &shiftWords_neon;
+		findU32 = &findU32_neon;
+		findU16 = &findU16_neon;
+		svbDecode = &svbDecode_neon;
+		maskQual = &maskQual_neon;
+		decodeNuc = &decodeNuc_neon;
+	} else {
+		transLine = &transLine_scalar;
+		transFsa = &transFsa_scalar;
+		packNuc = &packNuc_scalar;
+		rcWords = &rcWords_scalar;
+		shiftWords = &shiftWords_scalar;
+		findU32 = &findU32_scalar;
+		findU16 = &findU16_scalar;
+		svbDecode = &svbDecode_scalar;
+		maskQual = &maskQual_scalar;
+		decodeNuc = &decodeNuc_scalar;
+	}
+#else
+	transLine = &transLine_scalar;
+	transFsa = &transFsa_scalar;
+	packNuc = &packNuc_scalar;
+	rcWords = &rcWords_scalar;
+	shiftWords = &shiftWords_scalar;
+	findU32 = &findU32_scalar;
+	findU16 = &findU16_scalar;
+	svbDecode = &svbDecode_scalar;
+	maskQual = &maskQual_scalar;
+	decodeNuc = &decodeNuc_scalar;
+#endif
+}
+
+int transLine_init(unsigned char *dest, const unsigned char *src, int len, const char *trans) {
+	
+	seqscanInit();
+	
+	return transLine(dest, src, len, trans);
+}
+
+int transFsa_init(unsigned char *dest, const unsigned char *src, int len, const char *trans, int *written) {
+	
+	seqscanInit();
+	
+	return transFsa(dest, src, len, trans, written);
+}
+
+void packNuc_init(long unsigned *dest, int *N, const unsigned char *seq, int seqlen) {
+	
+	seqscanInit();
+	
+	packNuc(dest, N, seq, seqlen);
+}
+
+void rcWords_init(long unsigned *dest, const long unsigned *src, int n) {
+	
+	seqscanInit();
+	
+	rcWords(dest, src, n);
+}
+
+void shiftWords_init(long unsigned *seq, int n, int shift) {
+	
+	seqscanInit();
+	
+	shiftWords(seq, n, shift);
+}
+
+int findU32_init(const unsigned *list, int n, unsigned target) {
+	
+	seqscanInit();
+	
+	return findU32(list, n, target);
+}
+
+int findU16_init(const short unsigned *list, int n, unsigned target) {
+	
+	seqscanInit();
+	
+	return findU16(list, n, target);
+}
+
+long unsigned svbDecode_init(unsigned *dest, const unsigned char *ctrl, const unsigned char *data, int n) {
+	
+	seqscanInit();
+	
+	return svbDecode(dest, ctrl, data, n);
+}
+
+unsigned maskQual_init(unsigned char *seq, const unsigned char *qual, int len, int minQ, unsigned *gc) {
+	
+	seqscanInit();
+	
+	return maskQual(seq, qual, len, minQ, gc);
+}
+
+void decodeNuc_init(unsigned char *seq, int len) {
+	
+	seqscanInit();
+	
+	decodeNuc(seq, len);
+}
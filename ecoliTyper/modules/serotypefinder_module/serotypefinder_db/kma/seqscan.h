@@ -0,0 +1,61 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+/* translate a line, stopping at '\n' (16), returns bytes translated */
+extern int (*transLine)(unsigned char *, const unsigned char *, int, const char *);
+/* translate fasta sequence, skipping newlines and stopping at '>' */
+extern int (*transFsa)(unsigned char *, const unsigned char *, int, const char *, int *);
+/* pack nucleotides into 2-bit words, and list N positions */
+extern void (*packNuc)(long unsigned *, int *, const unsigned char *, int);
+/* reverse complement packed words, dest may be src */
+extern void (*rcWords)(long unsigned *, const long unsigned *, int);
+/* shift packed words left, carrying bases across words */
+extern void (*shiftWords)(long unsigned *, int, int);
+/* position of target in list, or -1 if absent */
+extern int (*findU32)(const unsigned *, int, unsigned);
+extern int (*findU16)(const short unsigned *, int, unsigned);
+/* stream-vbyte decode n ints, returns data bytes consumed */
+extern long unsigned (*svbDecode)(unsigned *, const unsigned char *, const unsigned char *, int);
+/* mask bases of quality below minQ as N, returns N's and sets GC count */
+extern unsigned (*maskQual)(unsigned char *, const unsigned char *, int, int, unsigned *);
+/* translate 0-5 back to ACGTN- in place */
+extern void (*decodeNuc)(unsigned char *, int);
+int transStd(const char *trans);
+int transLine_scalar(unsigned char *dest, const unsigned char *src, int len, const char *trans);
+int transFsa_scalar(unsigned char *dest, const unsigned char *src, int len, const char *trans, int *written);
+int transLine_init(unsigned char *dest, const unsigned char *src, int len, const char *trans);
+int transFsa_init(unsigned char *dest, const unsigned char *src, int len, const char *trans, int *written);
+void packNuc_scalar(long unsigned *dest, int *N, const unsigned char *seq, int seqlen);
+void packNuc_init(long unsigned *dest, int *N, const unsigned char *seq, int seqlen);
+void rcWords_scalar(long unsigned *dest, const long unsigned *src, int n);
+void shiftWords_scalar(long unsigned *seq, int n, int shift);
+void rcWords_init(long unsigned *dest, const long unsigned *src, int n);
+void shiftWords_init(long unsigned *seq, int n, int shift);
+int findU32_scalar(const unsigned *list, int n, unsigned target);
+int findU16_scalar(const short unsigned *list, int n, unsigned target);
+int findU32_init(const unsigned *list, int n, unsigned target);
+int findU16_init(const short unsigned *list, int n, unsigned target);
+long unsigned svbEncode(unsigned char *ctrl, unsigned char *data, const unsigned *src, int n);
+long unsigned svbDecode_scalar(unsigned *dest, const unsigned char *ctrl, const unsigned char *data, int n);
+long unsigned svbDecode_init(unsigned *dest, const unsigned char *ctrl, const unsigned char *data, int n);
+unsigned maskQual_scalar(unsigned char *seq, const unsigned char *qual, int len, int minQ, unsigned *gc);
+unsigned maskQual_init(unsigned char *seq, const unsigned char *qual, int len, int minQ, unsigned *gc);
+void decodeNuc_scalar(unsigned char *seq, int len);
+void decodeNuc_init(unsigned char *seq, int len);
+void seqscanInit(void);
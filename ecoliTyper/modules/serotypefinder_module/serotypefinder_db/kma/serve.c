@@ -0,0 +1,600 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#endif
+#include "kma.h"
+#include "pherror.h"
+#include "serve.h"
+#include "threader.h"
+#include "version.h"
+
+#ifdef _WIN32
+ServeDB * serveDB(const char *name, const char *prefix) {
+	return 0;
+}
+
+void serveRelease(ServeDB *src) {
+}
+
+char * serveRequest(int conn, int *len) {
+	return 0;
+}
+
+int serveJob(int conn, char *buff, int len, ServeDB *dbs) {
+	return 1;
+}
+
+int submitJob(char *sockname, char *dir, int argc, char **argv) {
+	fprintf(stderr, "kma serve is not available on windows.\n");
+	return 1;
+}
+
+int serve_main(int argc, char *argv[]) {
+	fprintf(stderr, "kma serve is not available on windows.\n");
+	return 1;
+}
+#else
+static ServeDB *serveDBs = 0;
+static volatile int serveExclude = 0;
+static int serveGen = 0;
+static int serveSlots = 0;
+static pid_t *servePids = 0;
+static int *serveGens = 0;
+
+ServeDB * serveDB(const char *name, const char *prefix) {
+	
+	int i, file_len, fd;
+	long unsigned pos, size;
+	char *filename;
+	volatile unsigned char *data, c;
+	struct stat st;
+	ServeDB *dest;
+	static const char *suffixes[5] = {".comp.b", ".decon.comp.b", ".seq.b", ".length.b", ".name"};
+	
+	dest = smalloc(sizeof(ServeDB));
+	dest->name = smalloc(strlen(name) + 1);
+	strcpy(dest->name, name);
+	dest->prefix = smalloc(strlen(prefix) + 1);
+	strcpy(dest->prefix, prefix);
+	dest->gen = 0;
+	dest->n = 0;
+	dest->next = 0;
+	
+	/* keep the files of the DB mapped, so jobs find them in memory */
+	file_len = strlen(prefix);
+	filename = smalloc(file_len + 64);
+	strcpy(filename, prefix);
+	for(i = 0; i < 5; ++i) {
+		strcpy(filename + file_len, suffixes[i]);
+		if((fd = open(filename, O_RDONLY)) < 0) {
+			filename[file_len] = 0;
+			if(i == 0) {
+				fprintf(stderr, "Could not open DB:\t%s\n", filename);
+				free(filename);
+				serveRelease(dest);
+				return 0;
+			}
+			errno = 0;
+			continue;
+		}
+		if(fstat(fd, &st) || !(size = st.st_size)) {
+			close(fd);
+			errno = 0;
+			continue;
+		}
+		data = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if(data == MAP_FAILED) {
+			ERROR();
+		}
+		
+		/* pin it if allowed, and touch every page otherwise */
+		if(mlock((void *) data, size)) {
+			errno = 0;
+			for(pos = 0, c = 0; pos < size; pos += 4096) {
+				c ^= data[pos];
+			}
+		}
+		dest->maps[dest->n] = (void *) data;
+		dest->sizes[dest->n++] = size;
+		fprintf(stderr, "# Resident:\t%s\t%lu\n", filename, size);
+	}
+	free(filename);
+	
+	return dest;
+}
+
+void serveRelease(ServeDB *src) {
+	
+	int i;
+	
+	for(i = 0; i < src->n; ++i) {
+		munlock(src->maps[i], src->sizes[i]);
+		munmap(src->maps[i], src->sizes[i]);
+	}
+	free(src->name);
+	free(src->prefix);
+	free(src);
+}
+
+static void serveCollect(void) {
+	
+	int i, oldest;
+	ServeDB *db, **prev;
+	
+	/* release swapped out DBs, once no job started before the swap is running */
+	oldest = INT_MAX;
+	for(i = 0; i < serveSlots; ++i) {
+		if(servePids[i] && serveGens[i] < oldest) {
+			oldest = serveGens[i];
+		}
+	}
+	prev = &serveDBs;
+	while((db = *prev)) {
+		if(db->gen && oldest >= db->gen) {
+			*prev = db->next;
+			fprintf(stderr, "# Released:\t%s\n", db->prefix);
+			serveRelease(db);
+		} else {
+			prev = &db->next;
+		}
+	}
+}
+
+static ServeDB * serveFind(const char *name) {
+	
+	ServeDB *db;
+	
+	for(db = serveDBs; db && (db->gen || strcmp(db->name, name)); db = db->next);
+	
+	return db;
+}
+
+static void * serveSwap_thread(void *arg) {
+	
+	int len;
+	char msg[16];
+	ServeDB *db, *dest;
+	ServeSwap *swap = arg;
+	
+	/* load the new version next to the served one, then let new jobs use it */
+	len = 1;
+	if((dest = serveDB(swap->name, swap->prefix))) {
+		lock(&serveExclude);
+		if((db = serveFind(swap->name))) {
+			db->gen = ++serveGen;
+			dest->next = serveDBs;
+			serveDBs = dest;
+			fprintf(stderr, "# Swapped:\t%s\t%s\n", swap->name, swap->prefix);
+			serveCollect();
+			len = 0;
+		} else {
+			serveRelease(dest);
+		}
+		unlock(&serveExclude);
+	}
+	
+	/* report */
+	len = sprintf(msg, "%d\n", len);
+	if(write(swap->conn, msg, len) != len) {
+		errno = 0;
+	}
+	close(swap->conn);
+	free(swap->name);
+	free(swap->prefix);
+	free(swap);
+	
+	return NULL;
+}
+
+static int serveSwap(int conn, char *buff, int len) {
+	
+	char *cwd, *name, *prefix;
+	pthread_t id;
+	ServeSwap *swap;
+	
+	/* working directory, "-swap", name and prefix */
+	cwd = buff;
+	name = cwd + strlen(cwd) + 1;
+	name += strlen(name) + 1;
+	prefix = name + strlen(name) + 1;
+	if(buff + len <= prefix || !*prefix) {
+		fprintf(stderr, "# Broken swap request.\n");
+		return 1;
+	}
+	lock(&serveExclude);
+	if(!serveFind(name)) {
+		unlock(&serveExclude);
+		fprintf(stderr, "# Not served:\t%s\n", name);
+		return 1;
+	}
+	unlock(&serveExclude);
+	
+	swap = smalloc(sizeof(ServeSwap));
+	swap->conn = conn;
+	swap->name = smalloc(strlen(name) + 1);
+	strcpy(swap->name, name);
+	swap->prefix = smalloc(strlen(cwd) + strlen(prefix) + 2);
+	if(*prefix == '/') {
+		strcpy(swap->prefix, prefix);
+	} else {
+		sprintf(swap->prefix, "%s/%s", cwd, prefix);
+	}
+	if((errno = pthread_create(&id, NULL, &serveSwap_thread, swap)) || (errno = pthread_detach(id))) {
+		ERROR();
+	}
+	
+	return 0;
+}
+
+char * serveRequest(int conn, int *len) {
+	
+	int size;
+	char *buff;
+	ssize_t bytes;
+	
+	/* read request until the terminating empty string */
+	size = 4096;
+	*len = 0;
+	buff = smalloc(size);
+	do {
+		if(*len == size) {
+			size <<= 1;
+			buff = realloc(buff, size);
+			if(!buff) {
+				ERROR();
+			}
+		}
+		if((bytes = read(conn, buff + *len, size - *len)) <= 0) {
+			fprintf(stderr, "# Broken job request.\n");
+			free(buff);
+			return 0;
+		}
+		*len += bytes;
+	} while(*len < 2 || buff[*len - 1] || buff[*len - 2]);
+	
+	return buff;
+}
+
+int serveJob(int conn, char *buff, int len, ServeDB *dbs) {
+	
+	int i, argc, fd, mapped, db, status;
+	char **argv, *ptr, *cwd, *dir, msg[16];
+	ServeDB *src;
+	
+	/* split the working and output directory, and the arguments */
+	argc = 0;
+	for(ptr = buff; ptr < buff + len - 1; ptr += strlen(ptr) + 1) {
+		++argc;
+	}
+	if(argc < 2) {
+		fprintf(stderr, "# Broken job request.\n");
+		return 1;
+	}
+	cwd = buff;
+	dir = buff + strlen(buff) + 1;
+	argv = smalloc((argc + 1) * sizeof(char *));
+	argc = 0;
+	argv[argc++] = "kma";
+	for(ptr = dir + strlen(dir) + 1; ptr < buff + len - 1; ptr += strlen(ptr) + 1) {
+		argv[argc++] = ptr;
+	}
+	
+	/* use the resident files through mmap, unless told otherwise */
+	mapped = 0;
+	db = 0;
+	for(i = 1; i < argc; ++i) {
+		if(*argv[i] == '-') {
+			db = strcmp(argv[i], "-t_db") == 0;
+		}
+		if(strcmp(argv[i], "-shm") == 0 || strcmp(argv[i], "-mmap") == 0) {
+			mapped = 1;
+		} else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc && *argv[i + 1] != '/' && *argv[i + 1] != '-') {
+			/* put relative output in the output directory */
+			ptr = smalloc(strlen(dir) + strlen(argv[i + 1]) + 2);
+			sprintf(ptr, "%s/%s", dir, argv[++i]);
+			argv[i] = ptr;
+		} else if(db && *argv[i] != '-') {
+			/* map on the version served when the job came in */
+			for(src = dbs; src && (src->gen || strcmp(src->name, argv[i])); src = src->next);
+			if(src) {
+				argv[i] = src->prefix;
+			}
+		}
+	}
+	if(!mapped) {
+		argv[argc++] = "-mmap";
+	}
+	argv[argc] = 0;
+	
+	/* run from the directory of the client, with output going to kma.log */
+	if(chdir(cwd) || (mkdir(dir, 0777) && errno != EEXIST)) {
+		fprintf(stderr, "Could not use output directory:\t%s\n", dir);
+		status = 1;
+	} else {
+		errno = 0;
+		ptr = smalloc(strlen(dir) + 16);
+		sprintf(ptr, "%s/kma.log", dir);
+		if((fd = open(ptr, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0) {
+			ERROR();
+		}
+		free(ptr);
+		fflush(stdout);
+		fflush(stderr);
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		close(fd);
+		if((fd = open("/dev/null", O_RDONLY)) >= 0) {
+			dup2(fd, STDIN_FILENO);
+			close(fd);
+		}
+		status = kma_main(argc, argv);
+		fflush(stdout);
+		fflush(stderr);
+	}
+	
+	/* report */
+	len = sprintf(msg, "%d\n", status);
+	if(write(conn, msg, len) != len) {
+		errno = 0;
+	}
+	close(conn);
+	
+	return status;
+}
+
+int submitJob(char *sockname, char *dir, int argc, char **argv) {
+	
+	int i, conn, len;
+	char msg[16], cwd[4096];
+	ssize_t bytes;
+	struct sockaddr_un addr;
+	
+	/* connect */
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, sockname, sizeof(addr.sun_path) - 1);
+	if((conn = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		ERROR();
+	} else if(connect(conn, (struct sockaddr *) &addr, sizeof(addr))) {
+		fprintf(stderr, "Could not connect to:\t%s\n", sockname);
+		return 1;
+	}
+	
+	/* send job */
+	if(!getcwd(cwd, sizeof(cwd))) {
+		ERROR();
+	}
+	if(write(conn, cwd, strlen(cwd) + 1) < 0 || write(conn, dir, strlen(dir) + 1) < 0) {
+		ERROR();
+	}
+	for(i = 0; i < argc; ++i) {
+		if(write(conn, argv[i], strlen(argv[i]) + 1) < 0) {
+			ERROR();
+		}
+	}
+	if(write(conn, "", 1) < 0) {
+		ERROR();
+	}
+	
+	/* wait for status */
+	len = 0;
+	while(len < 15 && (bytes = read(conn, msg + len, 15 - len)) > 0) {
+		len += bytes;
+	}
+	msg[len] = 0;
+	close(conn);
+	if(!len) {
+		fprintf(stderr, "Job did not finish:\t%s\n", dir);
+		return 1;
+	}
+	
+	return atoi(msg);
+}
+
+static void helpMessage(int exeStatus) {
+	FILE *helpOut;
+	if(exeStatus == 0) {
+		helpOut = stdout;
+	} else {
+		helpOut = stderr;
+	}
+	fprintf(helpOut, "# kma serve keeps databases resident, and runs kma jobs sent over a unix socket.\n");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "Options:", "Desc:", "Default:");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-sock", "Unix socket", "");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-t_db", "DB(s) to keep resident", "");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-j", "Max concurrent jobs", "1");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-job", "Submit job, rest is kma options", "");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-swap", "Serve DB from new prefix", "");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-v", "Version", "");
+	fprintf(helpOut, "# %16s\t%-32s\t%s\n", "-h", "Shows this help message", "");
+	fprintf(helpOut, "#\n");
+	fprintf(helpOut, "# Jobs run in their own output directory, with output in kma.log.\n");
+	exit(exeStatus);
+}
+
+int serve_main(int argc, char *argv[]) {
+	
+	int i, args, jobs, running, sock, conn, status, len;
+	char *sockname, *exeBasic, *buff;
+	pid_t pid;
+	struct sockaddr_un addr;
+	struct pollfd pfd;
+	ServeDB *db;
+	
+	/* init */
+	sockname = 0;
+	jobs = 1;
+	running = 0;
+	
+	/* PARSE COMMAND LINE OPTIONS */
+	args = 1;
+	while(args < argc) {
+		if(strcmp(argv[args], "-sock") == 0) {
+			if(++args < argc) {
+				sockname = argv[args];
+			}
+		} else if(strcmp(argv[args], "-t_db") == 0) {
+			while(++args < argc && *argv[args] != '-') {
+				if(!(db = serveDB(argv[args], argv[args]))) {
+					exit(1);
+				}
+				db->next = serveDBs;
+				serveDBs = db;
+			}
+			--args;
+		} else if(strcmp(argv[args], "-j") == 0) {
+			++args;
+			if(args < argc && argv[args][0] != '-') {
+				jobs = strtoul(argv[args], &exeBasic, 10);
+				if(*exeBasic != 0 || jobs < 1) {
+					fprintf(stderr, "Invalid number of jobs specified.\n");
+					exit(1);
+				}
+			} else {
+				--args;
+			}
+		} else if(strcmp(argv[args], "-job") == 0) {
+			if(!sockname || ++args == argc) {
+				fprintf(stderr, "-job needs -sock before it, and an output directory.\n");
+				helpMessage(1);
+			}
+			return submitJob(sockname, argv[args], argc - args - 1, argv + args + 1);
+		} else if(strcmp(argv[args], "-swap") == 0) {
+			if(!sockname || argc <= args + 2) {
+				fprintf(stderr, "-swap needs -sock before it, the served DB and the new one.\n");
+				helpMessage(1);
+			}
+			return submitJob(sockname, "-swap", 2, argv + args + 1);
+		} else if(strcmp(argv[args], "-v") == 0) {
+			fprintf(stdout, "KMA_serve-%s\n", KMA_VERSION);
+			exit(0);
+		} else if(strcmp(argv[args], "-h") == 0) {
+			helpMessage(0);
+		} else {
+			fprintf(stderr, "# Invalid option:\t%s\n", argv[args]);
+			fprintf(stderr, "# Printing help message:\n");
+			helpMessage(1);
+		}
+		++args;
+	}
+	if(!sockname) {
+		fprintf(stderr, "Insufficient number of agruments parsed.\n");
+		helpMessage(1);
+	}
+	
+	/* listen */
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, sockname, sizeof(addr.sun_path) - 1);
+	unlink(sockname);
+	errno = 0;
+	if((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 || bind(sock, (struct sockaddr *) &addr, sizeof(addr)) || listen(sock, 64)) {
+		fprintf(stderr, "Could not listen on:\t%s\n", sockname);
+		ERROR();
+	}
+	fprintf(stderr, "# Serving on:\t%s\n", sockname);
+	
+	/* fork a worker per job, at most jobs at a time */
+	serveSlots = jobs;
+	servePids = calloc(jobs, sizeof(pid_t));
+	serveGens = calloc(jobs, sizeof(int));
+	if(!servePids || !serveGens) {
+		ERROR();
+	}
+	while(1) {
+		while(0 < running && 0 < (pid = waitpid(-1, &status, running < jobs ? WNOHANG : 0))) {
+			lock(&serveExclude);
+			for(i = 0; i < jobs && servePids[i] != pid; ++i);
+			if(i < jobs) {
+				servePids[i] = 0;
+				--running;
+			}
+			serveCollect();
+			unlock(&serveExclude);
+		}
+		
+		/* wake up to reap finished jobs, so retired DBs are released */
+		errno = 0;
+		pfd.fd = sock;
+		pfd.events = POLLIN;
+		if(running && poll(&pfd, 1, 1000) <= 0) {
+			if(errno && errno != EINTR) {
+				ERROR();
+			}
+			errno = 0;
+			continue;
+		} else if((conn = accept(sock, 0, 0)) < 0) {
+			if(errno == EINTR) {
+				errno = 0;
+				continue;
+			}
+			ERROR();
+		} else if(!(buff = serveRequest(conn, &len))) {
+			close(conn);
+			continue;
+		}
+		
+		/* swaps load in the background, and answer when done */
+		if(strcmp(buff + strlen(buff) + 1, "-swap") == 0) {
+			if(serveSwap(conn, buff, len)) {
+				if(write(conn, "1\n", 2) != 2) {
+					errno = 0;
+				}
+				close(conn);
+			}
+			free(buff);
+			continue;
+		}
+		
+		/* the job is tied to the DBs served when it is forked */
+		lock(&serveExclude);
+		if((pid = fork()) < 0) {
+			ERROR();
+		} else if(pid == 0) {
+			close(sock);
+			exit(serveJob(conn, buff, len, serveDBs));
+		}
+		for(i = 0; servePids[i]; ++i);
+		servePids[i] = pid;
+		serveGens[i] = serveGen;
+		unlock(&serveExclude);
+		close(conn);
+		free(buff);
+		++running;
+	}
+	
+	return 0;
+}
+#endif
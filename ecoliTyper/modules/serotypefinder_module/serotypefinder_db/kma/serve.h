@@ -0,0 +1,54 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+
+#ifndef SERVE
+typedef struct serveDB ServeDB;
+typedef struct serveSwap ServeSwap;
+struct serveDB {
+	char *name; /* -t_db as given by jobs */
+	char *prefix; /* files served under that name */
+	int gen; /* generation it was swapped out in, 0 while served */
+	int n;
+	void *maps[5];
+	long unsigned sizes[5];
+	struct serveDB *next;
+};
+
+struct serveSwap {
+	int conn;
+	char *name;
+	char *prefix;
+};
+#define SERVE 1
+#endif
+
+/*
+ A job is sent as NUL terminated strings: the working directory of the
+ client, the output directory, the kma arguments and an empty string.
+ The exit status is returned as text. A swap is sent the same way, with
+ "-swap" as output directory, and the served name and new prefix as
+ arguments.
+*/
+ServeDB * serveDB(const char *name, const char *prefix);
+void serveRelease(ServeDB *src);
+char * serveRequest(int conn, int *len);
+int serveJob(int conn, char *buff, int len, ServeDB *dbs);
+int submitJob(char *sockname, char *dir, int argc, char **argv);
+int serve_main(int argc, char *argv[]);
@@ -38,6 +38,7 @@ typedef int key_t;
 #include "pherror.h"
 #include "hashmapkma.h"
 #include "shm.h"
+#include "shmposix.h"
 #include "stdnuc.h"
 #include "version.h"
 
@@ -406,6 +407,9 @@ static void helpMessage(int exeStatus) {
 	fprintf(helpOut, "#\t-t_db\t\tTemplate DB\t\t\tNone\t\tREQUIRED\n");
 	fprintf(helpOut, "#\t-destroy\tDestroy shared DB\t\tFalse\n");
 	fprintf(helpOut, "#\t-shmLvl\t\tLevel of shared memory\t\t1\n");
+	fprintf(helpOut, "#\t-posix\t\tShare *.comp.b with POSIX shm\tFalse\n");
+	fprintf(helpOut, "#\t-hugetlbfs\tShare on hugetlbfs mount, dir\tFalse\n");
+	fprintf(helpOut, "#\t-list\t\tList POSIX shared DBs\t\tFalse\n");
 	fprintf(helpOut, "#\t-shm-h\t\tExplain shm levels\n");
 	fprintf(helpOut, "#\t-v\t\tVersion\n");
 	fprintf(helpOut, "#\t-h\t\tShows this help message\n");
@@ -415,10 +419,10 @@ static void helpMessage(int exeStatus) {
 
 int shm_main(int argc, char *argv[]) {
 	
-	int args, file_len, destroy, status, *template_lengths;
+	int args, file_len, destroy, posix, status, *template_lengths;
 	unsigned shmLvl;
 	long unsigned *seq;
-	char *templatefilename, *template_names;
+	char *templatefilename, *template_names, *hugedir;
 	HashMapKMA *templates;
 	FILE *file;
 	
@@ -430,6 +434,8 @@ int shm_main(int argc, char *argv[]) {
 	/* SET DEFAULTS */
 	templatefilename = 0;
 	destroy = 0;
+	posix = 0;
+	hugedir = 0;
 	shmLvl = 1;
 	status = 0;
 	
@@ -448,6 +454,16 @@ int shm_main(int argc, char *argv[]) {
 			}
 		} else if(strcmp(argv[args], "-destroy") == 0) {
 			destroy = 1;
+		} else if(strcmp(argv[args], "-posix") == 0) {
+			posix = 1;
+		} else if(strcmp(argv[args], "-hugetlbfs") == 0) {
+			++args;
+			if(args < argc) {
+				hugedir = argv[args];
+				posix = 1;
+			}
+		} else if(strcmp(argv[args], "-list") == 0) {
+			return shmPosix_list(stdout);
 		} else if(strcmp(argv[args], "-shmLvl") == 0) {
 			++args;
 			if(args < argc) {
@@ -472,6 +488,7 @@ int shm_main(int argc, char *argv[]) {
 			fprintf(stderr, "#\t*.length.b\t\t4\n");
 			fprintf(stderr, "#\t*.seq.b\t\t\t8\n");
 			fprintf(stderr, "#\t*.name\t\t\t16\n");
+			fprintf(stderr, "# With -posix, *.comp.b and *.decon.comp.b are shared through POSIX shm.\n");
 			//fprintf(stderr, "#\tall\t\t\t31\n");
 			exit(0);
 		} else {
@@ -503,6 +520,9 @@ int shm_main(int argc, char *argv[]) {
 			if(!file) {
 				fprintf(stderr, "Error: %d (%s)\n", errno, strerror(errno));
 				status |= errno;
+			} else if(posix) {
+				status |= shmPosix_destroy(templatefilename);
+				fclose(file);
 			} else {
 				hashMapKMA_destroySHM(templates, file, templatefilename);
 				fclose(file);
@@ -517,6 +537,9 @@ int shm_main(int argc, char *argv[]) {
 			if(!file) {
 				fprintf(stderr, "Error: %d (%s)\n", errno, strerror(errno));
 				status |= errno;
+			} else if(posix) {
+				status |= shmPosix_destroy(templatefilename);
+				fclose(file);
 			} else {
 				hashMapKMA_destroySHM(templates, file, templatefilename);
 				fclose(file);
@@ -574,6 +597,9 @@ int shm_main(int argc, char *argv[]) {
 			if(!file) {
 				fprintf(stderr, "Error: %d (%s)\n", errno, strerror(errno));
 				status |= errno;
+			} else if(posix) {
+				status |= shmPosix_setup(templatefilename, hugedir);
+				fclose(file);
 			} else {
 				status |= hashMapKMA_setupSHM(templates, file, templatefilename);
 				hashMap_shm_detach(templates);
@@ -589,6 +615,9 @@ int shm_main(int argc, char *argv[]) {
 			if(!file) {
 				fprintf(stderr, "Error: %d (%s)\n", errno, strerror(errno));
 				status |= errno;
+			} else if(posix) {
+				status |= shmPosix_setup(templatefilename, hugedir);
+				fclose(file);
 			} else {
 				status |=  hashMapKMA_setupSHM(templates, file, templatefilename);
 				hashMap_shm_detach(templates);
@@ -0,0 +1,361 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#endif
+#include "hashmapkma.h"
+#include "kmmap.h"
+#include "pherror.h"
+#include "shmposix.h"
+#include "version.h"
+
+#ifdef _WIN32
+int shmPosix_setup(char *filename, char *hugedir) {
+	fprintf(stderr, "POSIX shm not available on Windows.\n");
+	return 1;
+}
+
+int shmPosix_destroy(char *filename) {
+	fprintf(stderr, "POSIX shm not available on Windows.\n");
+	return 1;
+}
+
+int shmPosix_attach(HashMapKMA *dest, char *filename) {
+	return 1;
+}
+
+void shmPosix_detach(HashMapKMA *dest) {
+	return;
+}
+
+int shmPosix_list(FILE *out) {
+	fprintf(stderr, "POSIX shm not available on Windows.\n");
+	return 1;
+}
+#else
+static char *shmPath = 0;
+
+static ShmEntry * shmRegistry(int create, int *fd) {
+	
+	long unsigned size;
+	ShmEntry *registry;
+	struct stat st;
+	
+	/* open and lock registry */
+	size = SHMENTRIES * sizeof(ShmEntry);
+	if((*fd = shm_open(SHMREGISTRY, create ? O_RDWR | O_CREAT : O_RDWR, 0666)) < 0) {
+		if(!create) {
+			errno = 0;
+			return 0;
+		}
+		ERROR();
+	} else if(lockf(*fd, F_LOCK, 0) || fstat(*fd, &st)) {
+		ERROR();
+	} else if(st.st_size < size) {
+		if(!create) {
+			close(*fd);
+			return 0;
+		} else if(ftruncate(*fd, size)) {
+			ERROR();
+		}
+	}
+	
+	registry = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+	if(registry == MAP_FAILED) {
+		ERROR();
+	}
+	
+	return registry;
+}
+
+static void shmRegistry_close(ShmEntry *registry, int fd) {
+	
+	munmap(registry, SHMENTRIES * sizeof(ShmEntry));
+	lseek(fd, 0, SEEK_SET);
+	if(lockf(fd, F_ULOCK, 0)) {
+		ERROR();
+	}
+	close(fd);
+}
+
+static ShmEntry * shmRegistry_find(ShmEntry *registry, char *path) {
+	
+	int i;
+	
+	for(i = 0; i < SHMENTRIES; ++i) {
+		if(strcmp(registry[i].path, path) == 0) {
+			return registry + i;
+		}
+	}
+	
+	return 0;
+}
+
+static int shmSegment_open(ShmEntry *entry, int flags) {
+	
+	if(entry->huge) {
+		return open(entry->segment, flags, 0644);
+	}
+	return shm_open(entry->segment, flags, 0644);
+}
+
+static int shmSegment_unlink(ShmEntry *entry) {
+	
+	if(entry->huge) {
+		return unlink(entry->segment);
+	}
+	return shm_unlink(entry->segment);
+}
+
+int shmPosix_setup(char *filename, char *hugedir) {
+	
+	int fd, seg, missing;
+	char *path;
+	unsigned *tail;
+	long unsigned hash;
+	unsigned char *data, *ptr;
+	ShmEntry *registry, *entry;
+	HashMapKMA head;
+	FILE *file;
+	struct stat st;
+	struct statvfs vst;
+	
+	/* get version of DB file */
+	if(!(path = realpath(filename, 0)) || sizeof(entry->path) <= strlen(path)) {
+		fprintf(stderr, "Invalid path:\t%s\n", filename);
+		free(path);
+		return 1;
+	}
+	file = sfopen(filename, "rb");
+	if(fstat(fileno(file), &st)) {
+		ERROR();
+	} else if(hashMapKMA_loadHead(&head, file)) {
+		fprintf(stderr, "Wrong format of DB:\t%s\n", filename);
+		fclose(file);
+		free(path);
+		return 1;
+	}
+	
+	/* older DBs lack kmersize and flag at the end, which padding would mask */
+	missing = feof(file) ? 1 : 0;
+	rewind(file);
+	
+	/* name segment after the path of the DB */
+	hash = 5381;
+	for(ptr = (unsigned char *) path; *ptr; ++ptr) {
+		hash = (hash << 5) + hash + *ptr;
+	}
+	registry = shmRegistry(1, &fd);
+	if((entry = shmRegistry_find(registry, path))) {
+		shmSegment_unlink(entry);
+		errno = 0;
+	} else if(!(entry = shmRegistry_find(registry, ""))) {
+		fprintf(stderr, "Registry is full, destroy some shared DBs first.\n");
+		shmRegistry_close(registry, fd);
+		fclose(file);
+		free(path);
+		return 1;
+	}
+	if(hugedir) {
+		entry->huge = 1;
+		if(sizeof(entry->segment) <= snprintf(entry->segment, sizeof(entry->segment), "%s/kma_%016lx", hugedir, hash)) {
+			fprintf(stderr, "Invalid path:\t%s\n", hugedir);
+			*entry->path = 0;
+			shmRegistry_close(registry, fd);
+			fclose(file);
+			free(path);
+			return 1;
+		}
+	} else {
+		entry->huge = 0;
+		sprintf(entry->segment, "/kma_%016lx", hash);
+	}
+	strcpy(entry->path, path);
+	entry->fsize = st.st_size;
+	entry->mtime = st.st_mtime;
+	strncpy(entry->version, KMA_VERSION, sizeof(entry->version) - 1);
+	entry->version[sizeof(entry->version) - 1] = 0;
+	entry->attach = 0;
+	free(path);
+	
+	/* create segment, rounded to the page size of its file system */
+	if((seg = shmSegment_open(entry, O_RDWR | O_CREAT | O_TRUNC)) < 0 || fstatvfs(seg, &vst)) {
+		fprintf(stderr, "Could not create shared DB:\t%s\n", entry->segment);
+		*entry->path = 0;
+		shmRegistry_close(registry, fd);
+		fclose(file);
+		return 1;
+	}
+	entry->size = st.st_size + missing * 2 * sizeof(unsigned);
+	entry->size = (entry->size + vst.f_bsize - 1) / vst.f_bsize * vst.f_bsize;
+	if(ftruncate(seg, entry->size)) {
+		fprintf(stderr, "Could not allocate shared DB:\t%s\n", entry->segment);
+		shmSegment_unlink(entry);
+		*entry->path = 0;
+		shmRegistry_close(registry, fd);
+		fclose(file);
+		close(seg);
+		return 1;
+	}
+	data = mmap(0, entry->size, PROT_READ | PROT_WRITE, MAP_SHARED, seg, 0);
+	close(seg);
+	if(data == MAP_FAILED) {
+		ERROR();
+	}
+	
+	/* load DB */
+	sfread(data, 1, st.st_size, file);
+	if(missing) {
+		tail = (unsigned *)(data + st.st_size);
+		*tail++ = head.mlen;
+		*tail = 0;
+	}
+	munmap(data, entry->size);
+	fclose(file);
+	fprintf(stderr, "# Shared:\t%s\t%s\t%lu\n", entry->path, entry->segment, entry->size);
+	shmRegistry_close(registry, fd);
+	
+	return 0;
+}
+
+int shmPosix_destroy(char *filename) {
+	
+	int fd;
+	char *path;
+	ShmEntry *registry, *entry;
+	
+	if(!(path = realpath(filename, 0)) || !(registry = shmRegistry(0, &fd))) {
+		fprintf(stderr, "No shared DB of:\t%s\n", filename);
+		free(path);
+		errno = 0;
+		return 1;
+	} else if(!(entry = shmRegistry_find(registry, path))) {
+		fprintf(stderr, "No shared DB of:\t%s\n", filename);
+		shmRegistry_close(registry, fd);
+		free(path);
+		return 1;
+	}
+	free(path);
+	
+	/* attached processes keep their mapping until they are done */
+	if(entry->attach) {
+		fprintf(stderr, "# Still attached by %d process(es):\t%s\n", entry->attach, entry->path);
+	}
+	if(shmSegment_unlink(entry)) {
+		fprintf(stderr, "Could not remove:\t%s\n", entry->segment);
+		errno = 0;
+	}
+	memset(entry, 0, sizeof(ShmEntry));
+	shmRegistry_close(registry, fd);
+	
+	return 0;
+}
+
+int shmPosix_attach(HashMapKMA *dest, char *filename) {
+	
+	int fd, seg;
+	char *path;
+	ShmEntry *registry, *entry;
+	FILE *file;
+	struct stat st;
+	
+	/* look DB up */
+	if(!(path = realpath(filename, 0)) || !(registry = shmRegistry(0, &fd))) {
+		free(path);
+		errno = 0;
+		return 1;
+	} else if(!(entry = shmRegistry_find(registry, path))) {
+		shmRegistry_close(registry, fd);
+		free(path);
+		return 1;
+	}
+	
+	/* a changed DB file, or one of another version, is not used */
+	if(stat(filename, &st) || st.st_size != entry->fsize || st.st_mtime != entry->mtime || strcmp(entry->version, KMA_VERSION)) {
+		fprintf(stderr, "# Shared DB is out of date, ignoring it:\t%s\n", filename);
+		shmRegistry_close(registry, fd);
+		free(path);
+		errno = 0;
+		return 1;
+	} else if((seg = shmSegment_open(entry, O_RDONLY)) < 0) {
+		fprintf(stderr, "# Shared DB is missing, ignoring it:\t%s\n", filename);
+		shmRegistry_close(registry, fd);
+		free(path);
+		errno = 0;
+		return 1;
+	}
+	file = fdopen(seg, "rb");
+	if(!file) {
+		ERROR();
+	}
+	hashMapKMAmmap(dest, file);
+	fclose(file);
+	dest->shmFlag |= 1024;
+	++entry->attach;
+	shmRegistry_close(registry, fd);
+	free(shmPath);
+	shmPath = path;
+	
+	return 0;
+}
+
+void shmPosix_detach(HashMapKMA *dest) {
+	
+	int fd;
+	ShmEntry *registry, *entry;
+	
+	if(dest && dest->shmFlag & 1024 && shmPath && (registry = shmRegistry(0, &fd))) {
+		if((entry = shmRegistry_find(registry, shmPath)) && entry->attach) {
+			--entry->attach;
+		}
+		shmRegistry_close(registry, fd);
+		free(shmPath);
+		shmPath = 0;
+	}
+}
+
+int shmPosix_list(FILE *out) {
+	
+	int i, fd;
+	ShmEntry *registry;
+	
+	fprintf(out, "#DB\tSegment\tSize\tHugepages\tVersion\tAttached\n");
+	if(!(registry = shmRegistry(0, &fd))) {
+		return 0;
+	}
+	for(i = 0; i < SHMENTRIES; ++i) {
+		if(*registry[i].path) {
+			fprintf(out, "%s\t%s\t%lu\t%d\t%s\t%d\n", registry[i].path, registry[i].segment, registry[i].size, registry[i].huge, registry[i].version, registry[i].attach);
+		}
+	}
+	shmRegistry_close(registry, fd);
+	
+	return 0;
+}
+#endif
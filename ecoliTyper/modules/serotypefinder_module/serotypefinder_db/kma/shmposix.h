@@ -0,0 +1,50 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include "hashmapkma.h"
+
+#ifndef SHMPOSIX
+typedef struct shmEntry ShmEntry;
+struct shmEntry {
+	char path[1024];
+	char segment[1024];
+	long unsigned size;
+	long unsigned fsize;
+	long mtime;
+	char version[16];
+	int huge;
+	int attach;
+};
+#define SHMPOSIX 1
+#define SHMREGISTRY "/kma_registry"
+#define SHMENTRIES 256
+#endif
+
+/*
+ The registry is a POSIX shared memory object of SHMENTRIES entries, telling
+ which DB files are loaded, where, from which version of the file and how
+ many processes have them attached. Segments hold the DB file verbatim, on
+ hugepages when placed on a hugetlbfs mount.
+*/
+int shmPosix_setup(char *filename, char *hugedir);
+int shmPosix_destroy(char *filename);
+int shmPosix_attach(HashMapKMA *dest, char *filename);
+void shmPosix_detach(HashMapKMA *dest);
+int shmPosix_list(FILE *out);
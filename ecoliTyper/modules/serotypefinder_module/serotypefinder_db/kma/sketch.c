@@ -0,0 +1,352 @@
+/* Philip T.L.C. Clausen Sep 2021 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2021, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "filebuff.h"
+#include "pherror.h"
+#include "qseqs.h"
+#include "runkma.h"
+#include "seq2fasta.h"
+#include "seqparse.h"
+#include "sketch.h"
+#include "stdnuc.h"
+
+static int cmpHash(const void *a, const void *b) {
+	
+	long unsigned x, y;
+	
+	x = *((long unsigned *) a);
+	y = *((long unsigned *) b);
+	
+	return x < y ? -1 : y < x;
+}
+
+int sketch_dump(char *templatefilename, unsigned kmersize, unsigned size) {
+	
+	int i, j, n, len, max, DB_size, file_len, *template_lengths;
+	unsigned shift;
+	long unsigned kmer, rmer, mask, h, nuc, *compseq, *hashes;
+	FILE *seqfile, *out;
+	
+	/* init */
+	template_lengths = getLengths(templatefilename);
+	DB_size = *template_lengths;
+	max = 0;
+	for(i = 1; i < DB_size; ++i) {
+		if(max < template_lengths[i]) {
+			max = template_lengths[i];
+		}
+	}
+	file_len = strlen(templatefilename);
+	strcat(templatefilename, ".seq.b");
+	seqfile = sfopen(templatefilename, "rb");
+	templatefilename[file_len] = 0;
+	strcat(templatefilename, ".sketch.b");
+	out = sfopen(templatefilename, "wb");
+	templatefilename[file_len] = 0;
+	compseq = smalloc(((max >> 5) + 1) * sizeof(long unsigned));
+	hashes = smalloc((max + 1) * sizeof(long unsigned));
+	mask = 0xFFFFFFFFFFFFFFFF >> (64 - (kmersize << 1));
+	shift = (kmersize - 1) << 1;
+	
+	sfwrite(&DB_size, sizeof(int), 1, out);
+	sfwrite(&kmersize, sizeof(unsigned), 1, out);
+	sfwrite(&size, sizeof(unsigned), 1, out);
+	for(i = 1; i < DB_size; ++i) {
+		len = template_lengths[i];
+		sfread(compseq, sizeof(long unsigned), (len >> 5) + 1, seqfile);
+		
+		/* hash canonical k-mers */
+		n = 0;
+		kmer = 0;
+		rmer = 0;
+		for(j = 0; j < len; ++j) {
+			nuc = getNuc(compseq, j);
+			kmer = ((kmer << 2) | nuc) & mask;
+			rmer = (rmer >> 2) | ((3 - nuc) << shift);
+			if(kmersize <= j + 1) {
+				h = kmer < rmer ? kmer : rmer;
+				sketchHash(h, h);
+				hashes[n++] = h;
+			}
+		}
+		
+		/* keep the smallest unique */
+		qsort(hashes, n, sizeof(long unsigned), cmpHash);
+		for(len = 0, j = 0; j < n && len < size; ++j) {
+			if(!len || hashes[len - 1] != hashes[j]) {
+				hashes[len++] = hashes[j];
+			}
+		}
+		sfwrite(&len, sizeof(unsigned), 1, out);
+		sfwrite(hashes, sizeof(long unsigned), len, out);
+	}
+	fclose(seqfile);
+	fclose(out);
+	free(compseq);
+	free(hashes);
+	free(template_lengths);
+	
+	return 0;
+}
+
+static void helpMessage(int status) {
+	
+	FILE *out;
+	
+	if(status) {
+		out = stderr;
+	} else {
+		out = stdout;
+	}
+	fprintf(out, "kma screen estimates how much of each template is contained in the input, from the sketches of kma index -sketch.\n");
+	fprintf(out, "# Options are:\tDesc:\t\t\t\t\tDefault:\tRequirements:\n");
+	fprintf(out, "#\t-i\tInput file(s), fasta or fastq\t\tstdin\n");
+	fprintf(out, "#\t-t_db\tSketched database\t\t\tNone\t\tREQUIRED\n");
+	fprintf(out, "#\t-o\tOutput file\t\t\t\tstdout\n");
+	fprintf(out, "#\t-mc\tMinimum containment (%%)\t\t\t0.0\n");
+	fprintf(out, "#\t-h\tShows this help message\n");
+	exit(status);
+}
+
+int screen_main(int argc, char *argv[]) {
+	
+	int i, j, args, file_len, fileCount, DB_size, FASTQ;
+	unsigned kmersize, size, n, shift, M, *counts, *templates, *next, *heads, *shared;
+	long unsigned kmer, rmer, mask, h, index, slotMask, tau, kmers, *hashes, *keys;
+	unsigned char *seen, *seq, *end;
+	char *templatefilename, *outputfilename, *trans, *exeBasic, **inputfiles;
+	double mc, cont, best;
+	int *template_lengths;
+	FILE *file, *out;
+	time_t t0, t1;
+	FileBuff *inputfile;
+	Qseqs *qseq, *qual, *name;
+	
+	templatefilename = 0;
+	outputfilename = 0;
+	inputfiles = 0;
+	fileCount = 0;
+	mc = 0;
+	args = 0;
+	while(++args < argc) {
+		if(strcmp(argv[args], "-i") == 0) {
+			for(i = args + 1; i < argc && (*argv[i] != '-' || strcmp(argv[i], "--") == 0); ++i);
+			inputfiles = argv + args + 1;
+			fileCount = i - args - 1;
+			args = i - 1;
+		} else if(strcmp(argv[args], "-t_db") == 0) {
+			if(++args < argc) {
+				templatefilename = smalloc(strlen(argv[args]) + 64);
+				strcpy(templatefilename, argv[args]);
+			}
+		} else if(strcmp(argv[args], "-o") == 0) {
+			if(++args < argc) {
+				outputfilename = argv[args];
+			}
+		} else if(strcmp(argv[args], "-mc") == 0) {
+			if(++args < argc) {
+				mc = strtod(argv[args], &exeBasic);
+				if(*exeBasic != 0) {
+					fprintf(stderr, "Invalid argument at \"-mc\".\n");
+					exit(1);
+				}
+			}
+		} else if(strcmp(argv[args], "-h") == 0) {
+			helpMessage(0);
+		} else {
+			fprintf(stderr, " Invalid option:\t%s\n", argv[args]);
+			helpMessage(1);
+		}
+	}
+	if(!templatefilename) {
+		fprintf(stderr, "Missing -t_db.\n");
+		helpMessage(1);
+	} else if(!fileCount) {
+		inputfiles = (char *[]){"--"};
+		fileCount = 1;
+	}
+	t0 = clock();
+	
+	/* load sketches */
+	file_len = strlen(templatefilename);
+	strcat(templatefilename, ".sketch.b");
+	file = sfopen(templatefilename, "rb");
+	templatefilename[file_len] = 0;
+	sfread(&DB_size, sizeof(int), 1, file);
+	sfread(&kmersize, sizeof(unsigned), 1, file);
+	sfread(&size, sizeof(unsigned), 1, file);
+	counts = calloc(DB_size, sizeof(unsigned));
+	shared = calloc(DB_size, sizeof(unsigned));
+	hashes = smalloc(((long unsigned)(DB_size) * size + 1) * sizeof(long unsigned));
+	templates = smalloc(((long unsigned)(DB_size) * size + 1) * sizeof(unsigned));
+	if(!counts || !shared) {
+		ERROR();
+	}
+	M = 0;
+	tau = 0;
+	for(i = 1; i < DB_size; ++i) {
+		sfread(&n, sizeof(unsigned), 1, file);
+		sfread(hashes + M, sizeof(long unsigned), n, file);
+		counts[i] = n;
+		/* templates with less than size k-mers need every input k-mer */
+		if(n && tau < (h = n < size ? 0xFFFFFFFFFFFFFFFF : hashes[M + n - 1])) {
+			tau = h;
+		}
+		for(j = 0; j < n; ++j) {
+			templates[M + j] = i;
+		}
+		M += n;
+	}
+	fclose(file);
+	
+	/* open addressing on the hashes, chaining the templates holding them */
+	for(slotMask = 1; slotMask < (M << 1); slotMask <<= 1);
+	keys = smalloc(slotMask * sizeof(long unsigned));
+	heads = smalloc(slotMask * sizeof(unsigned));
+	seen = calloc(slotMask, 1);
+	next = smalloc((M + 1) * sizeof(unsigned));
+	if(!seen) {
+		ERROR();
+	}
+	memset(heads, 255, slotMask * sizeof(unsigned));
+	--slotMask;
+	for(i = 0; i < M; ++i) {
+		for(index = hashes[i] & slotMask; heads[index] != UINT_MAX && keys[index] != hashes[i]; index = (index + 1) & slotMask);
+		keys[index] = hashes[i];
+		next[i] = heads[index];
+		heads[index] = i;
+	}
+	free(hashes);
+	
+	/* set to2Bit conversion, anything but ACGT breaks k-mers */
+	trans = smalloc(384);
+	memset(trans, 8, 384);
+	trans += 128;
+	for(i = 'A'; i <= 'Z'; ++i) {
+		trans[i] = 4;
+		trans[i + 32] = 4;
+	}
+	trans['\n'] = 16;
+	trans['A'] = 0;
+	trans['C'] = 1;
+	trans['G'] = 2;
+	trans['T'] = 3;
+	trans['a'] = 0;
+	trans['c'] = 1;
+	trans['g'] = 2;
+	trans['t'] = 3;
+	
+	/* stream input k-mers through the sketches */
+	mask = 0xFFFFFFFFFFFFFFFF >> (64 - (kmersize << 1));
+	shift = (kmersize - 1) << 1;
+	kmers = 0;
+	inputfile = setFileBuff(CHUNK);
+	qseq = setQseqs(1024);
+	qual = setQseqs(1024);
+	for(i = 0; i < fileCount; ++i) {
+		if(!((FASTQ = openAndDetermine(inputfile, inputfiles[i])) & 3)) {
+			fprintf(stderr, "Invalid input file:\t%s\n", inputfiles[i]);
+			exit(1);
+		}
+		while((FASTQ & 1) ? FileBuffgetFqSeq(inputfile, qseq, qual, trans) : FileBuffgetFsaSeq(inputfile, qseq, trans)) {
+			n = 0;
+			kmer = 0;
+			rmer = 0;
+			for(seq = qseq->seq, end = seq + qseq->len; seq < end; ++seq) {
+				if(3 < *seq) {
+					n = 0;
+				} else {
+					kmer = ((kmer << 2) | *seq) & mask;
+					rmer = (rmer >> 2) | ((long unsigned)(3 - *seq) << shift);
+					if(kmersize <= ++n) {
+						++kmers;
+						h = kmer < rmer ? kmer : rmer;
+						sketchHash(h, h);
+						if(h <= tau) {
+							for(index = h & slotMask; heads[index] != UINT_MAX && keys[index] != h; index = (index + 1) & slotMask);
+							if(heads[index] != UINT_MAX && !seen[index]) {
+								seen[index] = 1;
+								for(j = heads[index]; j != UINT_MAX; j = next[j]) {
+									++shared[templates[j]];
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+		if(FASTQ & 4) {
+			gzcloseFileBuff(inputfile);
+		} else {
+			closeFileBuff(inputfile);
+		}
+	}
+	destroyFileBuff(inputfile);
+	destroyQseqs(qseq);
+	destroyQseqs(qual);
+	
+	/* output containment */
+	if(!outputfilename || strcmp(outputfilename, "--") == 0) {
+		out = stdout;
+	} else {
+		out = sfopen(outputfilename, "w");
+	}
+	template_lengths = getLengths(templatefilename);
+	strcat(templatefilename, ".name");
+	file = sfopen(templatefilename, "rb");
+	templatefilename[file_len] = 0;
+	name = setQseqs(256);
+	best = 0;
+	fprintf(out, "#Template\tShared\tSketch\tContainment\tTemplate_length\n");
+	for(i = 1; i < DB_size; ++i) {
+		nameLoad(name, file);
+		cont = counts[i] ? 100.0 * shared[i] / counts[i] : 0;
+		if(best < cont) {
+			best = cont;
+		}
+		if(shared[i] && mc <= cont) {
+			fprintf(out, "%s\t%u\t%u\t%8.2f\t%d\n", name->seq, shared[i], counts[i], cont, template_lengths[i]);
+		}
+	}
+	fclose(file);
+	if(out != stdout) {
+		fclose(out);
+	}
+	t1 = clock();
+	fprintf(stderr, "# Screened %lu k-mers against %u sketched k-mers in %.2f s, best containment %.2f%%.\n", kmers, M, difftime(t1, t0) / 1000000, best);
+	
+	destroyQseqs(name);
+	free(template_lengths);
+	free(counts);
+	free(shared);
+	free(templates);
+	free(keys);
+	free(heads);
+	free(seen);
+	free(next);
+	free(trans - 128);
+	free(templatefilename);
+	
+	return 0;
+}
@@ -0,0 +1,36 @@
+/* Philip T.L.C. Clausen Sep 2021 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2021, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+
+/*
+ * Bottom-k sketches of the templates, *.sketch.b:
+ * unsigned DB_size, unsigned kmersize, unsigned size,
+ * then from template 1: unsigned n, and the n smallest hashes of its
+ * canonical k-mers in ascending order.
+ * A template holding fewer than size k-mers keeps all of them.
+ */
+#ifndef SKETCH
+#define SKETCHSIZE 1000
+#define sketchHash(h, kmer) h = (kmer ^ (kmer >> 30)) * 0xbf58476d1ce4e5b9; h = (h ^ (h >> 27)) * 0x94d049bb133111eb; h ^= h >> 31;
+#define SKETCH 1
+#endif
+
+int sketch_dump(char *templatefilename, unsigned kmersize, unsigned size);
+int screen_main(int argc, char *argv[]);
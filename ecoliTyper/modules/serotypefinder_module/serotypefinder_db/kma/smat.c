@@ -0,0 +1,350 @@
+/* Philip T.L.C. Clausen Sep 2021 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2021, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "assembly.h"
+#include "filebuff.h"
+#include "pherror.h"
+#include "smat.h"
+#include "stdnuc.h"
+
+static void smatInt(unsigned char *dest, unsigned src) {
+	
+	dest[0] = src;
+	dest[1] = src >> 8;
+	dest[2] = src >> 16;
+	dest[3] = src >> 24;
+}
+
+static void smatShort(unsigned char *dest, unsigned src) {
+	
+	dest[0] = src;
+	dest[1] = src >> 8;
+}
+
+static unsigned getSmatInt(const unsigned char *src) {
+	return src[0] | (src[1] << 8) | (src[2] << 16) | ((unsigned) src[3] << 24);
+}
+
+static unsigned getSmatShort(const unsigned char *src) {
+	return src[0] | (src[1] << 8);
+}
+
+static unsigned char * smatNext(FileBuff *dest, int len) {
+	
+	unsigned char *next;
+	
+	/* reserve len bytes in the output buffer */
+	if(dest->bytes < len) {
+		writeGzFileBuff(dest);
+	}
+	next = dest->next;
+	dest->next += len;
+	dest->bytes -= len;
+	
+	return next;
+}
+
+static int smatAlt(const short unsigned *counts, unsigned ref) {
+	
+	int i;
+	
+	for(i = 0; i < 6; ++i) {
+		if(counts[i] && i != ref) {
+			return 1;
+		}
+	}
+	
+	return 0;
+}
+
+static unsigned smatRef(long unsigned *template_seq, unsigned pos, int t_len, unsigned *i) {
+	
+	unsigned ref;
+	
+	/* rows past the template are insertions */
+	if(pos < t_len) {
+		ref = getNuc(template_seq, *i);
+		++*i;
+		return ref;
+	}
+	
+	return 5;
+}
+
+void initSparseMatrix(FileBuff *dest) {
+	memcpy(smatNext(dest, 8), SMAT_MAGIC, 8);
+}
+
+void updateSparseMatrix(FileBuff *dest, char *template_name, long unsigned *template_seq, AssemInfo *matrix, int t_len) {
+	
+	unsigned i, n, pos, ref, row, len, runs, alts, depth, nibble;
+	unsigned char *update;
+	Assembly *assembly;
+	
+	/* count runs and alt rows, alt rows extend the current run */
+	assembly = matrix->assmb;
+	runs = 0;
+	alts = 0;
+	depth = 0;
+	for(pos = 0, i = 0, n = matrix->len; n != 0; --n, pos = assembly[pos].next) {
+		ref = smatRef(template_seq, pos, t_len, &i);
+		if(smatAlt(assembly[pos].counts, ref)) {
+			++alts;
+			runs += !runs;
+		} else if(!runs || assembly[pos].counts[ref] != depth) {
+			++runs;
+			depth = assembly[pos].counts[ref];
+		}
+	}
+	
+	/* name, which may outgrow the buffer */
+	smatInt(smatNext(dest, 4), (len = strlen(template_name)));
+	while(len) {
+		if(dest->bytes == 0) {
+			writeGzFileBuff(dest);
+		}
+		n = len < dest->bytes ? len : dest->bytes;
+		memcpy(smatNext(dest, n), template_name, n);
+		template_name += n;
+		len -= n;
+	}
+	smatInt(smatNext(dest, 4), matrix->len);
+	
+	/* reference codes */
+	nibble = 0;
+	for(pos = 0, i = 0, row = 0; row < matrix->len; ++row, pos = assembly[pos].next) {
+		ref = smatRef(template_seq, pos, t_len, &i);
+		if(row & 1) {
+			*smatNext(dest, 1) = nibble | (ref << 4);
+		} else {
+			nibble = ref;
+		}
+	}
+	if(row & 1) {
+		*smatNext(dest, 1) = nibble;
+	}
+	
+	/* depth runs */
+	smatInt(smatNext(dest, 4), runs);
+	len = 0;
+	depth = 0;
+	for(pos = 0, i = 0, n = matrix->len; n != 0; --n, pos = assembly[pos].next) {
+		ref = smatRef(template_seq, pos, t_len, &i);
+		if(len && !smatAlt(assembly[pos].counts, ref) && assembly[pos].counts[ref] != depth) {
+			update = smatNext(dest, 6);
+			smatInt(update, len);
+			smatShort(update + 4, depth);
+			len = 0;
+		}
+		if(!len && !smatAlt(assembly[pos].counts, ref)) {
+			depth = assembly[pos].counts[ref];
+		}
+		++len;
+	}
+	if(len) {
+		update = smatNext(dest, 6);
+		smatInt(update, len);
+		smatShort(update + 4, depth);
+	}
+	
+	/* alt rows */
+	smatInt(smatNext(dest, 4), alts);
+	for(pos = 0, i = 0, row = 0; row < matrix->len; ++row, pos = assembly[pos].next) {
+		ref = smatRef(template_seq, pos, t_len, &i);
+		if(smatAlt(assembly[pos].counts, ref)) {
+			update = smatNext(dest, 16);
+			smatInt(update, row);
+			for(n = 0; n < 6; ++n) {
+				smatShort(update + 4 + (n << 1), assembly[pos].counts[n]);
+			}
+		}
+	}
+}
+
+static int smatRead(gzFile src, void *dest, unsigned len) {
+	
+	int check;
+	
+	if(len == 0) {
+		return 1;
+	} else if((check = gzread(src, dest, len)) == len) {
+		return 1;
+	} else if(check < 0) {
+		fprintf(stderr, "Gzip error %d\n", check);
+		exit(1);
+	}
+	
+	return 0;
+}
+
+static void * smatGrow(void *src, unsigned *size, unsigned len) {
+	
+	if(*size < len) {
+		free(src);
+		*size = len;
+		src = smalloc(len);
+	}
+	
+	return src;
+}
+
+static void printSparseMatrix(gzFile src, FILE *out) {
+	
+	int complete;
+	unsigned i, row, rows, runs, alts, run, depth, ref, altRow;
+	unsigned nameSize, refSize, runSize, altSize;
+	short unsigned counts[6];
+	unsigned char buff[8], *refs, *runBuff, *altBuff, *nextRun, *nextAlt;
+	char *name;
+	const char bases[6] = "ACGTN-";
+	
+	nameSize = 256;
+	refSize = 0;
+	runSize = 0;
+	altSize = 0;
+	name = smalloc(nameSize);
+	refs = 0;
+	runBuff = 0;
+	altBuff = 0;
+	complete = 1;
+	while(smatRead(src, buff, 4)) {
+		/* load template */
+		complete = 0;
+		i = getSmatInt(buff);
+		name = smatGrow(name, &nameSize, i + 1);
+		if(!smatRead(src, name, i) || !smatRead(src, buff, 4)) {
+			break;
+		}
+		name[i] = 0;
+		rows = getSmatInt(buff);
+		refs = smatGrow(refs, &refSize, (rows >> 1) + 1);
+		if(!smatRead(src, refs, (rows + 1) >> 1) || !smatRead(src, buff, 4)) {
+			break;
+		}
+		runs = getSmatInt(buff);
+		runBuff = smatGrow(runBuff, &runSize, runs * 6 + 1);
+		if(!smatRead(src, runBuff, runs * 6) || !smatRead(src, buff, 4)) {
+			break;
+		}
+		alts = getSmatInt(buff);
+		altBuff = smatGrow(altBuff, &altSize, alts * 16 + 1);
+		if(!smatRead(src, altBuff, alts * 16)) {
+			break;
+		}
+		
+		/* print it as updateMatrix does */
+		fprintf(out, "#%s\n", name);
+		nextRun = runBuff;
+		nextAlt = altBuff;
+		altRow = alts ? getSmatInt(nextAlt) : rows;
+		run = 0;
+		depth = 0;
+		for(row = 0; row < rows; ++row) {
+			if(run == 0 && runs) {
+				run = getSmatInt(nextRun);
+				depth = getSmatShort(nextRun + 4);
+				nextRun += 6;
+				--runs;
+			}
+			--run;
+			ref = (refs[row >> 1] >> ((row & 1) << 2)) & 15;
+			if(row == altRow) {
+				for(i = 0; i < 6; ++i) {
+					counts[i] = getSmatShort(nextAlt + 4 + (i << 1));
+				}
+				nextAlt += 16;
+				altRow = --alts ? getSmatInt(nextAlt) : rows;
+			} else {
+				memset(counts, 0, sizeof(counts));
+				counts[ref < 6 ? ref : 4] = depth;
+			}
+			fprintf(out, "%c\t%hu\t%hu\t%hu\t%hu\t%hu\t%hu\n", bases[ref < 6 ? ref : 4], counts[0], counts[1], counts[2], counts[3], counts[4], counts[5]);
+		}
+		fprintf(out, "\n");
+		complete = 1;
+	}
+	if(!complete) {
+		fprintf(stderr, "Truncated sparse matrix.\n");
+		exit(1);
+	}
+	
+	free(name);
+	free(refs);
+	free(runBuff);
+	free(altBuff);
+}
+
+static void helpMessage(int status) {
+	
+	FILE *out;
+	
+	if(status) {
+		out = stderr;
+	} else {
+		out = stdout;
+	}
+	fprintf(out, "kma smat prints a sparse assembly matrix (*.smat.gz) as the text of *.mat.gz to stdout.\n");
+	fprintf(out, "# Options are:\tDesc:\t\t\t\t\tDefault:\tRequirements:\n");
+	fprintf(out, "#\t-i\tSparse matrix, from -matrix sparse\tstdin\n");
+	fprintf(out, "#\t-h\tShows this help message\n");
+	exit(status);
+}
+
+int smat_main(int argc, char *argv[]) {
+	
+	int args;
+	char *filename, magic[8];
+	gzFile src;
+	
+	filename = 0;
+	args = 0;
+	while(++args < argc) {
+		if(strcmp(argv[args], "-i") == 0) {
+			if(++args < argc) {
+				filename = argv[args];
+			}
+		} else if(strcmp(argv[args], "-h") == 0) {
+			helpMessage(0);
+		} else {
+			helpMessage(1);
+		}
+	}
+	
+	if(!filename || strcmp(filename, "--") == 0) {
+		src = gzdopen(STDIN_FILENO, "rb");
+	} else {
+		src = gzopen(filename, "rb");
+	}
+	if(!src) {
+		ERROR();
+	} else if(!smatRead(src, magic, 8) || memcmp(magic, SMAT_MAGIC, 8) != 0) {
+		fprintf(stderr, "Not a sparse kma matrix.\n");
+		exit(1);
+	}
+	
+	printSparseMatrix(src, stdout);
+	gzclose(src);
+	
+	return 0;
+}
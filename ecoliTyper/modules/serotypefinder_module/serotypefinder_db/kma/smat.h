@@ -0,0 +1,38 @@
+/* Philip T.L.C. Clausen Sep 2021 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2021, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+
+#include "assembly.h"
+#include "filebuff.h"
+
+/*
+ * Sparse -matrix output, a gzipped binary stream of:
+ * magic "KMAsmat\1", then per template (little endian):
+ * u32 name length, name,
+ * u32 rows, reference codes as nibbles (0-3: ACGT, 4: N, 5: -),
+ * u32 runs, runs of (u32 rows, u16 depth) covering all rows,
+ * u32 alts, alt rows of (u32 row, u16 counts[6]).
+ * Rows not in alts only have counts on their reference base,
+ * given by the depth of their run.
+ */
+#define SMAT_MAGIC "KMAsmat\1"
+
+void initSparseMatrix(FileBuff *dest);
+void updateSparseMatrix(FileBuff *dest, char *template_name, long unsigned *template_seq, AssemInfo *matrix, int t_len);
+int smat_main(int argc, char *argv[]);
@@ -17,6 +17,8 @@
  * limitations under the License.
 */
 #define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -28,15 +30,18 @@
 #include "hashtable.h"
 #include "kmapipe.h"
 #include "kmmap.h"
+#include "numa.h"
 #include "pherror.h"
 #include "runinput.h"
 #include "qc.h"
 #include "qseqs.h"
 #include "savekmers.h"
 #include "seqparse.h"
+#include "shmposix.h"
 #include "sparse.h"
 #include "stdnuc.h"
 #include "stdstat.h"
+#include "threader.h"
 #ifdef _WIN32
 typedef int key_t;
 #define ftok(charPtr, integer) (0)
@@ -243,6 +248,33 @@ void save_kmers_sparse(const HashMapKMA *templates, HashMap_kmers *foundKmers, C
 	}
 }
 
+void * save_kmers_sparse_threaded(void *arg) {
+	
+	static volatile int lock[1] = {0};
+	volatile int *excludeIn = lock;
+	SparseThread *thread = arg;
+	CompKmers *Kmers;
+	
+	/* count k-mers of batches read from the shared input */
+	Kmers = smalloc(sizeof(CompKmers));
+	allocCompKmers(Kmers, SPARSEBATCH);
+	thread->Ntot = 0;
+	while(1) {
+		lock(excludeIn);
+		Kmers->n = fread(Kmers->kmers, sizeof(long unsigned), Kmers->size, thread->inputfile);
+		unlock(excludeIn);
+		if(!Kmers->n) {
+			break;
+		}
+		thread->Ntot += Kmers->n;
+		save_kmers_sparse(thread->templates, thread->foundKmers, Kmers);
+	}
+	free(Kmers->kmers);
+	free(Kmers);
+	
+	return NULL;
+}
+
 void run_input_sparse(const HashMapKMA *templates, char **inputfiles, int fileCount, int minPhred, int hardmaskQ, int minQ, int fiveClip, int threeClip, int minlen, int maxlen, int kmersize, char *trans, const double *prob, QCstat *qcreport, FILE *out) {
 	
 	int fileCounter, phredScale, start, end, len;
@@ -335,7 +367,7 @@ void run_input_sparse(const HashMapKMA *templates, char **inputfiles, int fileCo
 	destroyFileBuff(inputfile);
 }
 
-int save_kmers_sparse_batch(char *templatefilename, char *outputfilename, char *exePrev, double ID_t, double Depth_t, double evalue, char ss, unsigned shm) {
+int save_kmers_sparse_batch(char *templatefilename, char *outputfilename, char *exePrev, double ID_t, double Depth_t, double evalue, char ss, unsigned shm, int thread_num) {
 	
 	int i, file_len, stop, template, status, contamination, score_add, deCon;
 	unsigned *Scores, *w_Scores, *SearchList;
@@ -350,9 +382,9 @@ int save_kmers_sparse_batch(char *templatefilename, char *outputfilename, char *
 	time_t t0, t1;
 	HashMapKMA *templates;
 	HashMap_kmers *foundKmers;
-	HashTable *kmerList, *deConTable, *node, *prev, **Collecter;
-	Hit Nhits, w_Nhits;
-	CompKmers *Kmers;
+	KmerList *kmerList, *deConList;
+	Hit Nhits, w_Nhits, withdrawn;
+	SparseThread *thread, *threads;
 	
 	/* here */
 	/* split input up */
@@ -377,7 +409,9 @@ int save_kmers_sparse_batch(char *templatefilename, char *outputfilename, char *
 	templates = smalloc(sizeof(HashMapKMA));
 	hashMap_get = &hashMap_getGlobal;
 	if((shm & 1) || (deCon && (shm & 2))) {
-		hashMapKMA_load_shm(templates, templatefile, templatefilename);
+		if(shmPosix_attach(templates, templatefilename)) {
+			hashMapKMA_load_shm(templates, templatefile, templatefilename);
+		}
 	} else if(shm & 32) {
 		hashMapKMAmmap(templates, templatefile);
 	} else {
@@ -388,6 +422,7 @@ int save_kmers_sparse_batch(char *templatefilename, char *outputfilename, char *
 	}
 	fclose(templatefile);
 	templatefilename[file_len] = 0;
+	hugePagesReport(stderr);
 	
 	/* load template attributes */
 	template_names = load_DBs_Sparse(templatefilename, &template_lengths, &template_ulengths, shm);
@@ -425,13 +460,45 @@ int save_kmers_sparse_batch(char *templatefilename, char *outputfilename, char *
 	t0 = clock();
 	fprintf(stderr, "# Finding k-mers\n");
 	
-	Kmers = smalloc(sizeof(CompKmers));
-	allocCompKmers(Kmers, 1024);
-	Ntot = 0;
-	/* count kmers */
-	while((Kmers->n = fread(Kmers->kmers, sizeof(long unsigned), Kmers->size, inputfile))) {
-		Ntot += Kmers->n;
-		save_kmers_sparse(templates, foundKmers, Kmers);
+	/* count kmers, on private tables merged at the end */
+	threads = 0;
+	for(i = 1; i < thread_num; ++i) {
+		thread = smalloc(sizeof(SparseThread));
+		thread->templates = numaTemplates(templates, i);
+		thread->foundKmers = smalloc(sizeof(HashMap_kmers));
+		thread->foundKmers->flag = foundKmers->flag;
+		hashMap_kmers_initialize(thread->foundKmers, foundKmers->size + 1);
+		thread->inputfile = inputfile;
+		thread->next = threads;
+		if((errno = pthread_create(&thread->id, numaThread(i), &save_kmers_sparse_threaded, thread))) {
+			fprintf(stderr, "Error: %d (%s)\n", errno, strerror(errno));
+			fprintf(stderr, "Will continue with %d threads.\n", i);
+			free(thread->foundKmers->table);
+			free(thread->foundKmers);
+			free(thread);
+			i = thread_num;
+		} else {
+			threads = thread;
+		}
+	}
+	thread = smalloc(sizeof(SparseThread));
+	thread->templates = templates;
+	thread->foundKmers = foundKmers;
+	thread->inputfile = inputfile;
+	save_kmers_sparse_threaded(thread);
+	Ntot = thread->Ntot;
+	free(thread);
+	while(threads) {
+		thread = threads;
+		threads = thread->next;
+		if((errno = pthread_join(thread->id, NULL))) {
+			ERROR();
+		}
+		Ntot += thread->Ntot;
+		hashMap_kmers_merge(foundKmers, thread->foundKmers);
+		free(thread->foundKmers->table);
+		free(thread->foundKmers);
+		free(thread);
 	}
 	kmaPipe(0, 0, inputfile, &status);
 	if(kmaPipe == &kmaPipeFork) {
@@ -459,6 +526,7 @@ int save_kmers_sparse_batch(char *templatefilename, char *outputfilename, char *
 	if(ss == 'n') {
 		/* collect scores */
 		kmerList = collect_Kmers(templates, Scores, Scores_tot, foundKmers, &Nhits);
+		kmerList_destroy(kmerList);
 		
 		fprintf(stderr, "# Total number of matches: %lu of %lu kmers\n", Nhits.tot, Ntot);
 		
@@ -468,11 +536,12 @@ int save_kmers_sparse_batch(char *templatefilename, char *outputfilename, char *
 			cover = 100.0 * Scores[template] / template_ulengths[template];
 			depth = 1.0 * score / template_lengths[template];
 			
-			expected = 1.0 * (Nhits.tot - score) * template_ulengths[template] / (templates->n - template_ulengths[template] + etta);
-			q_value = (score - expected) * (score - expected) / (score + expected);
-			p_value = p_chisqr(q_value);
 			/* validate best match */
 			if(cover && ID_t <= cover && Depth_t <= depth) {
+				/* only reported templates need a p_value */
+				expected = 1.0 * (Nhits.tot - score) * template_ulengths[template] / (templates->n - template_ulengths[template] + etta);
+				q_value = (score - expected) * (score - expected) / (score + expected);
+				p_value = p_chisqr(q_value);
 				/* output results */
 				query_cover = 100.0 * Scores_tot[template] / Ntot;
 				/* calc tot values */
@@ -486,10 +555,7 @@ int save_kmers_sparse_batch(char *templatefilename, char *outputfilename, char *
 	} else if(deCon) {
 		/* start by removing contamination and collect scores */
 		contamination = templates->DB_size;
-		Collecter = collect_Kmers_deCon(templates, Scores, Scores_tot, foundKmers, &Nhits, contamination);
-		kmerList = Collecter[0];
-		deConTable = Collecter[1];
-		free(Collecter);
+		kmerList = collect_Kmers_deCon(templates, Scores, Scores_tot, foundKmers, &Nhits, contamination, &deConList);
 		
 		fprintf(stderr, "# Total number of matches: %lu of %lu kmers\n", Nhits.tot, Ntot);
 		/* copy scores */
@@ -613,32 +679,9 @@ int save_kmers_sparse_batch(char *templatefilename, char *outputfilename, char *
 			/* validate best match */
 			if(cover && ID_t <= cover && Depth_t <= depth) {
 				/* with draw contamination k-mers matching this template */
-				score_add = 0;
-				score_tot_add = 0;
-				if(deConTable != 0) {
-					prev = 0;
-					node = deConTable;
-					while(node != 0) {
-						if(intpos_bin(node->value, template) != -1) {
-							++score_add;
-							score_tot_add += node->key;
-							if(prev == 0) {
-								deConTable = node->next;
-								free(node->value);
-								free(node);
-								node = deConTable;
-							} else {
-								prev->next = node->next;
-								free(node->value);
-								free(node);
-								node = prev->next;
-							}
-						} else {
-							prev = node;
-							node = node->next;
-						}
-					}
-				}
+				withdrawn = withDraw_Kmers(0, 0, deConList, template);
+				score_add = withdrawn.n;
+				score_tot_add = withdrawn.tot;
 				
 				/* Calculate new attributes */
 				query_cover = 100.0 * (w_Scores_tot[template] + score_tot_add) / Ntot;
@@ -654,7 +697,9 @@ int save_kmers_sparse_batch(char *templatefilename, char *outputfilename, char *
 					template_names[template], template, score, (int) expected, template_lengths[template], query_cover, cover, depth, tot_query_cover, tot_cover, tot_depth, q_value, p_value);
 				
 				/* update scores */
-				kmerList = withDraw_Kmers(w_Scores, w_Scores_tot, kmerList, template, &w_Nhits);
+				withdrawn = withDraw_Kmers(w_Scores, w_Scores_tot, kmerList, template);
+				w_Nhits.n -= withdrawn.n;
+				w_Nhits.tot -= withdrawn.tot;
 				
 				if(w_Scores[template] != 0 || w_Scores_tot[template] != 0) {
 					fprintf(stderr, "# Failed updating the scores\n");
@@ -662,13 +707,15 @@ int save_kmers_sparse_batch(char *templatefilename, char *outputfilename, char *
 				} else {
 					SearchList[template] = 0;
 				}
-				if(kmerList == 0) {
+				if(kmerList->n == 0) {
 					stop = 1;
 				}
 			} else {
 				stop = 1;
 			}
 		}
+		kmerList_destroy(kmerList);
+		kmerList_destroy(deConList);
 	} else {
 		/* collect scores */
 		kmerList = collect_Kmers(templates, Scores, Scores_tot, foundKmers, &Nhits);
@@ -690,7 +737,7 @@ int save_kmers_sparse_batch(char *templatefilename, char *outputfilename, char *
 		w_Nhits.n = Nhits.n;
 		w_Nhits.tot = Nhits.tot;
 		
-		if(kmerList == 0) {
+		if(kmerList->n == 0) {
 			stop = 1;
 		}
 		
@@ -801,22 +848,27 @@ int save_kmers_sparse_batch(char *templatefilename, char *outputfilename, char *
 					template_names[template], template, score, (int) expected, template_ulengths[template], query_cover, cover, depth, tot_query_cover, tot_cover, tot_depth, q_value, p_value);
 				
 				/* update scores */
-				kmerList = withDraw_Kmers(w_Scores, w_Scores_tot, kmerList, template, &w_Nhits);
+				withdrawn = withDraw_Kmers(w_Scores, w_Scores_tot, kmerList, template);
+				w_Nhits.n -= withdrawn.n;
+				w_Nhits.tot -= withdrawn.tot;
 				if(w_Scores[template] != 0 || w_Scores_tot[template] != 0) {
 					fprintf(stderr, "# Failed updating the scores\n");
 					SearchList[template] = 0;
 				} else {
 					SearchList[template] = 0;
 				}
-				if(kmerList == 0) {
+				if(kmerList->n == 0) {
 					stop = 1;
 				}
 			} else {
 				stop = 1;
 			}
 		}
+		kmerList_destroy(kmerList);
 	}
 	fclose(sparse_out);
+	mmapLoadReport(stderr);
+	shmPosix_detach(templates);
 	t1 = clock();
 	fprintf(stderr, "# Total for finding and outputting best matches: %.2f s.\n#\n", difftime(t1, t0) / 1000000);
 	
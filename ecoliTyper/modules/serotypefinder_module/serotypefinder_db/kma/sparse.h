@@ -17,13 +17,31 @@
  * limitations under the License.
 */
 #define _XOPEN_SOURCE 600
+#include <pthread.h>
+#include <stdio.h>
 #include "compkmers.h"
 #include "hashmapkma.h"
+#include "hashmapkmers.h"
 #include "hashtable.h"
 #include "qc.h"
 
+#ifndef SPARSE
+typedef struct sparseThread SparseThread;
+struct sparseThread {
+	pthread_t id;
+	const HashMapKMA *templates;
+	HashMap_kmers *foundKmers;
+	FILE *inputfile;
+	long unsigned Ntot;
+	struct sparseThread *next;
+};
+#define SPARSEBATCH 16384 /* k-mers read by a thread at a time */
+#define SPARSE 1
+#endif
+
 int translateToKmersAndDump(long unsigned *Kmers, int n, int max, unsigned char *qseq, int seqlen, const HashMapKMA *templates, FILE *out);
 char ** load_DBs_Sparse(char *templatefilename, unsigned **template_lengths, unsigned **template_ulengths, unsigned shm);
 void save_kmers_sparse(const HashMapKMA *templates, HashMap_kmers *foundKmers, CompKmers *compressor);
+void * save_kmers_sparse_threaded(void *arg);
 void run_input_sparse(const HashMapKMA *templates, char **inputfiles, int fileCount, int minPhred, int hardmaskQ, int minQ, int fiveClip, int threeClip, int minlen, int maxlen, int kmersize, char *trans, const double *prob, QCstat *qcreport, FILE *out);
-int save_kmers_sparse_batch(char *templatefilename, char *outputfilename, char *exePrev, double ID_t, double Depth_t, double evalue, char ss, unsigned shm);
+int save_kmers_sparse_batch(char *templatefilename, char *outputfilename, char *exePrev, double ID_t, double Depth_t, double evalue, char ss, unsigned shm, int thread_num);
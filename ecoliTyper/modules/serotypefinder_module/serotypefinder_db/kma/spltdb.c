@@ -17,15 +17,24 @@
  * limitations under the License.
 */
 #define _XOPEN_SOURCE 600
+#include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <netdb.h>
+#include <poll.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
 #include "align.h"
 #include "alnfrags.h"
+#include "aout.h"
 #include "assembly.h"
 #include "chain.h"
 #include "compdna.h"
@@ -34,13 +43,19 @@
 #include "filebuff.h"
 #include "frags.h"
 #include "hashmapcci.h"
+#include "kma.h"
 #include "kmapipe.h"
+#include "kmapool.h"
+#include "kmatrace.h"
+#include "kmers.h"
 #include "nw.h"
+#include "pack.h"
 #include "pherror.h"
 #include "printconsensus.h"
 #include "qseqs.h"
 #include "runkma.h"
 #include "sam.h"
+#include "smat.h"
 #include "spltdb.h"
 #include "stdnuc.h"
 #include "stdstat.h"
@@ -398,6 +413,417 @@ unsigned get_ankers_spltDB(int *infoSize, int *out_Tem, CompDNA *qseq, Qseqs *he
 	return num;
 }
 
+static int spltDB_parse(char *outputfilename, int file_len) {
+	
+	int status;
+	char *cmd[2];
+	FILE *out;
+	
+	/* parse the input once, to *.in */
+	strcpy(outputfilename + file_len, ".in");
+	out = sfopen(outputfilename, "wb");
+	cmd[0] = "-s1";
+	cmd[1] = (char *) out;
+	status = kma_main(0, cmd);
+	fclose(out);
+	outputfilename[file_len] = 0;
+	
+	return status;
+}
+
+int spltDB_map(char **templatefilenames, int targetNum, char *outputfilename, int thread_num, unsigned exhaustive, Penalties *rewards, int minlen, double mrs, double coverT, double minFrac, unsigned shm) {
+	
+	int i, file_len, status, exit_status;
+	char *templatefilename;
+	pid_t *pids;
+	FILE *out;
+	
+	/* parse the input once */
+	file_len = strlen(outputfilename);
+	status = spltDB_parse(outputfilename, file_len);
+	
+	/* map it on each DB in a process of its own, sharing the threads */
+	if((thread_num /= targetNum) < 1) {
+		thread_num = 1;
+	}
+	fflush(stderr);
+	fflush(stdout);
+	pids = smalloc(targetNum * sizeof(pid_t));
+	for(i = 0; i < targetNum; ++i) {
+		if((pids[i] = fork()) < 0) {
+			ERROR();
+		} else if(pids[i] == 0) {
+			sprintf(outputfilename + file_len, ".%d", i);
+			out = sfopen(outputfilename, "wb");
+			strcpy(outputfilename + file_len, ".in");
+			templatefilename = smalloc(strlen(templatefilenames[i]) + 64);
+			strcpy(templatefilename, templatefilenames[i]);
+			kmaPipe = &kmaPipeFile;
+			exit_status = save_kmers_batch(templatefilename, outputfilename, shm, thread_num, exhaustive, rewards, out, 0, minlen, mrs, coverT, minFrac);
+			fclose(out);
+			kmaTrace_flush();
+			_exit(exit_status ? 1 : 0);
+		}
+	}
+	
+	/* wait for the mappings */
+	for(i = 0; i < targetNum; ++i) {
+		while(waitpid(pids[i], &exit_status, 0) == -1 && errno == EINTR) {
+			usleep(100);
+		}
+		if(!WIFEXITED(exit_status) || WEXITSTATUS(exit_status)) {
+			status = 1;
+		}
+	}
+	free(pids);
+	strcpy(outputfilename + file_len, ".in");
+	remove(outputfilename);
+	outputfilename[file_len] = 0;
+	
+	return status;
+}
+
+static FILE *netIn = 0;
+
+static FILE * kmaPipeNet(const char *cmd, const char *type, FILE *ioStream, int *status) {
+	
+	/* stand in for a pipe, with the parsed input coming over the connection */
+	if(cmd && type) {
+		return netIn;
+	}
+	/* a stalled or broken connection is not a complete input */
+	*status = ferror(ioStream) ? 1 : 0;
+	*status |= fclose(ioStream) ? 1 : 0;
+	
+	return 0;
+}
+
+static int netSplit(char *src, char *host, char *port) {
+	
+	int len;
+	char *sep;
+	
+	/* [host:]port, with IPv6 hosts in brackets, defaulting to loopback */
+	if(*src == '[') {
+		if(!(sep = strchr(src, ']')) || sep[1] != ':') {
+			return 1;
+		}
+		len = sep - src - 1;
+		++src;
+		sep += 2;
+	} else if((sep = strchr(src, ':'))) {
+		if(strchr(sep + 1, ':')) {
+			return 1;
+		}
+		len = sep - src;
+		++sep;
+	} else {
+		len = 0;
+		sep = src;
+	}
+	if(SPLTNET_HOSTLEN <= len || SPLTNET_PORTLEN <= (int) strlen(sep) || !*sep) {
+		return 1;
+	}
+	if(len) {
+		strncpy(host, src, len);
+		host[len] = 0;
+	} else {
+		strcpy(host, "127.0.0.1");
+	}
+	strcpy(port, sep);
+	
+	return 0;
+}
+
+static int netTimeout(int conn) {
+	
+	struct timeval timeout;
+	
+	/* give up on peers that stall */
+	timeout.tv_sec = SPLTNET_TIMEOUT;
+	timeout.tv_usec = 0;
+	
+	return setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) || setsockopt(conn, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+static pid_t spltNet_job(int conn, int sock, char *templatefilename, int thread_num, unsigned exhaustive, Penalties *rewards, int minlen, double mrs, double coverT, double minFrac, unsigned shm) {
+	
+	int trailer[2];
+	pid_t pid;
+	FILE *out;
+	
+	/* map one job in a process of its own */
+	fflush(stderr);
+	fflush(stdout);
+	if((pid = fork()) < 0) {
+		ERROR();
+	} else if(pid == 0) {
+		close(sock);
+		if(netTimeout(conn) || !(netIn = fdopen(conn, "rb")) || !(out = fdopen(dup(conn), "wb"))) {
+			ERROR();
+		}
+		kmaPipe = &kmaPipeNet;
+		trailer[0] = save_kmers_batch(templatefilename, "-s1", shm, thread_num, exhaustive, rewards, out, 0, minlen, mrs, coverT, minFrac);
+		trailer[1] = SPLTNET_MAGIC;
+		sfwrite(trailer, sizeof(int), 2, out);
+		fclose(out);
+		kmaTrace_flush();
+		_exit(0);
+	}
+	close(conn);
+	
+	return pid;
+}
+
+int spltDB_serve(char *listenAddr, char *templatefilename, int thread_num, unsigned exhaustive, Penalties *rewards, int minlen, double mrs, double coverT, double minFrac, unsigned shm) {
+	
+	int sock, conn, one, status, queued, exit_status, queue[SPLTNET_QUEUE];
+	char host[SPLTNET_HOSTLEN], port[SPLTNET_PORTLEN];
+	pid_t pid, done;
+	struct addrinfo hints, *res, *src;
+	struct pollfd listener;
+	
+	/* listen, on loopback unless a host is given */
+	if(netSplit(listenAddr, host, port)) {
+		fprintf(stderr, "Invalid argument at \"-listen\".\n");
+		exit(1);
+	}
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	if((status = getaddrinfo(host, port, &hints, &res))) {
+		fprintf(stderr, "Could not resolve:\t%s\t%s\n", host, gai_strerror(status));
+		exit(1);
+	}
+	sock = -1;
+	one = 1;
+	for(src = res; src && sock < 0; src = src->ai_next) {
+		if(0 <= (sock = socket(src->ai_family, src->ai_socktype, src->ai_protocol)) && (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) || bind(sock, src->ai_addr, src->ai_addrlen) || listen(sock, SPLTNET_QUEUE))) {
+			close(sock);
+			sock = -1;
+		}
+	}
+	freeaddrinfo(res);
+	if(sock < 0) {
+		fprintf(stderr, "Could not listen on:\t%s\n", listenAddr);
+		exit(1);
+	}
+	errno = 0;
+	fprintf(stderr, "# Mapping on:\t%s:%s\n", host, port);
+	
+	/*
+	Map one job at a time, queueing the connections that come in
+	meanwhile. Finished jobs are reaped between polls, so accepting
+	never waits on a job.
+	*/
+	listener.fd = sock;
+	listener.events = POLLIN;
+	queued = 0;
+	pid = 0;
+	while(1) {
+		while(0 < (done = waitpid(-1, &exit_status, WNOHANG))) {
+			if(done == pid) {
+				pid = 0;
+			}
+		}
+		if(!pid && queued) {
+			pid = spltNet_job(*queue, sock, templatefilename, thread_num, exhaustive, rewards, minlen, mrs, coverT, minFrac, shm);
+			memmove(queue, queue + 1, --queued * sizeof(int));
+		}
+		
+		/* wake up once a second while a job runs, to reap it */
+		if((status = poll(&listener, 1, pid ? 1000 : -1)) <= 0) {
+			if(status < 0 && errno != EINTR) {
+				ERROR();
+			}
+			errno = 0;
+			continue;
+		}
+		if((conn = accept(sock, 0, 0)) < 0) {
+			if(errno != EINTR && errno != ECONNABORTED) {
+				ERROR();
+			}
+			errno = 0;
+		} else if(queued == SPLTNET_QUEUE) {
+			fprintf(stderr, "Too many queued jobs, closing connection.\n");
+			close(conn);
+		} else {
+			queue[queued++] = conn;
+		}
+	}
+	
+	return 0;
+}
+
+static int netConnect(char *hostport) {
+	
+	int conn, status;
+	char host[SPLTNET_HOSTLEN], port[SPLTNET_PORTLEN];
+	struct addrinfo hints, *res, *src;
+	
+	/* [host:]port */
+	if(netSplit(hostport, host, port)) {
+		fprintf(stderr, "Invalid host:\t%s\n", hostport);
+		exit(1);
+	}
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if((status = getaddrinfo(host, port, &hints, &res))) {
+		fprintf(stderr, "Could not resolve:\t%s\t%s\n", host, gai_strerror(status));
+		exit(1);
+	}
+	
+	conn = -1;
+	for(src = res; src && conn < 0; src = src->ai_next) {
+		if(0 <= (conn = socket(src->ai_family, src->ai_socktype, src->ai_protocol)) && connect(conn, src->ai_addr, src->ai_addrlen)) {
+			close(conn);
+			conn = -1;
+		}
+	}
+	freeaddrinfo(res);
+	if(conn < 0) {
+		fprintf(stderr, "Could not connect to:\t%s\n", hostport);
+		exit(1);
+	}
+	errno = 0;
+	
+	return conn;
+}
+
+static void * spltNet_send(void *arg) {
+	
+	int len, n, sent;
+	unsigned char *buff;
+	SpltNet *dest = arg;
+	FILE *in;
+	
+	/* send the parsed input, and close our end of the stream */
+	buff = smalloc(CHUNK);
+	in = sfopen(dest->infile, "rb");
+	while(!dest->status && (len = fread(buff, 1, CHUNK, in))) {
+		n = 0;
+		while(n < len) {
+			if(0 < (sent = send(dest->conn, buff + n, len - n, MSG_NOSIGNAL))) {
+				n += sent;
+			} else if(errno != EINTR) {
+				fprintf(stderr, "Lost connection to:\t%s\n", dest->host);
+				dest->status = 1;
+				break;
+			}
+		}
+	}
+	fclose(in);
+	free(buff);
+	shutdown(dest->conn, SHUT_WR);
+	
+	return NULL;
+}
+
+static void * spltNet_receive(void *arg) {
+	
+	int n, trailer[2];
+	size_t len, hold;
+	unsigned char *buff;
+	SpltNet *dest = arg;
+	FILE *out;
+	
+	/*
+	The mapping is written as it comes, holding back the last bytes
+	received, as they end in the exit status of the shard.
+	*/
+	buff = smalloc(CHUNK + sizeof(trailer));
+	out = sfopen(dest->outfile, "wb");
+	hold = 0;
+	while((n = recv(dest->conn, buff + hold, CHUNK, 0))) {
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		len = hold + n;
+		hold = len < sizeof(trailer) ? len : sizeof(trailer);
+		sfwrite(buff, 1, len - hold, out);
+		memmove(buff, buff + len - hold, hold);
+	}
+	fclose(out);
+	memcpy(trailer, buff, hold);
+	if(n < 0 || hold != sizeof(trailer) || trailer[1] != SPLTNET_MAGIC) {
+		fprintf(stderr, "Incomplete mapping from:\t%s\n", dest->host);
+		dest->err = 1;
+	} else {
+		dest->err = trailer[0] ? 1 : 0;
+	}
+	free(buff);
+	
+	return NULL;
+}
+
+int spltDB_net(int targetNum, char *outputfilename, char *hosts) {
+	
+	int i, file_len, status;
+	char *list, *host, *next;
+	SpltNet *shards, *shard;
+	
+	/* connect to the shards, splitting a copy of the host list */
+	file_len = strlen(outputfilename);
+	shards = smalloc(targetNum * sizeof(SpltNet));
+	list = smalloc(strlen(hosts) + 1);
+	strcpy(list, hosts);
+	host = list;
+	for(i = 0, shard = shards; i < targetNum; ++i, ++shard) {
+		if(!host) {
+			fprintf(stderr, "Need a host for each -t_db.\n");
+			exit(1);
+		}
+		if((next = strchr(host, ','))) {
+			*next++ = 0;
+		}
+		shard->host = host;
+		shard->conn = netConnect(host);
+		shard->status = 0;
+		shard->err = 0;
+		shard->infile = smalloc(file_len + 64);
+		shard->outfile = smalloc(file_len + 64);
+		sprintf(shard->infile, "%s.in", outputfilename);
+		sprintf(shard->outfile, "%s.%d", outputfilename, i);
+		host = next;
+	}
+	if(host) {
+		fprintf(stderr, "Need a host for each -t_db.\n");
+		exit(1);
+	}
+	
+	/* parse the input once */
+	status = spltDB_parse(outputfilename, file_len);
+	
+	/* send it to each shard, and collect their mappings while they map */
+	fprintf(stderr, "# Mapping on %d shards\n", targetNum);
+	for(i = 0, shard = shards; i < targetNum; ++i, ++shard) {
+		if((errno = pthread_create(&shard->sender, NULL, &spltNet_send, shard)) || (errno = pthread_create(&shard->receiver, NULL, &spltNet_receive, shard))) {
+			ERROR();
+		}
+	}
+	for(i = 0, shard = shards; i < targetNum; ++i, ++shard) {
+		if((errno = pthread_join(shard->sender, NULL)) || (errno = pthread_join(shard->receiver, NULL))) {
+			ERROR();
+		}
+		status |= shard->status | shard->err;
+		close(shard->conn);
+		free(shard->infile);
+		free(shard->outfile);
+	}
+	free(shards);
+	free(list);
+	strcpy(outputfilename + file_len, ".in");
+	remove(outputfilename);
+	outputfilename[file_len] = 0;
+	
+	return status;
+}
+
 int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename, int argc, char **argv, int ConClave, int kmersize, int minlen, Penalties *rewards, int extendedFeatures, double ID_t, double Depth_t, int mq, double scoreT, double mrc, double evalue, double support, int bcd, int ref_fsa, int print_matrix, int print_all, long unsigned tsv, int vcf, int xml, int sam, int nc, int nf, unsigned shm, int thread_num, int maxFrag, int verbose) {
 	
 	/* https://www.youtube.com/watch?v=LtXEMwSG5-8 */
@@ -421,6 +847,8 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 	time_t t0, t1;
 	struct tm *tm;
 	FileBuff *frag_out, *frag_out_all, *matrix_out, *vcf_out;
+	VcfPool *vcf_pool;
+	ConsPool *cons_pool;
 	Aln *aligned, *gap_align;
 	Assem *aligned_assem;
 	Frag **alignFrags;
@@ -508,11 +936,11 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 	/* open outputfiles */
 	file_len = strlen(outputfilename);
 	strcat(outputfilename, ".res");
-	res_out = sfopen(outputfilename, "w");
+	res_out = outFopenPtr(outputfilename, "w");
 	outputfilename[file_len] = 0;
 	if(tsv) {
 		strcat(outputfilename, ".tsv");
-		tsv_out = sfopen(outputfilename, "w");
+		tsv_out = outFopenPtr(outputfilename, "w");
 		outputfilename[file_len] = 0;
 	} else {
 		tsv_out = 0;
@@ -529,24 +957,27 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 	consensus_out = 0;
 	if(nc == 0) {
 		strcat(outputfilename, ".aln");
-		alignment_out = sfopen(outputfilename, "w");
+		alignment_out = outFopenPtr(outputfilename, "w");
 		outputfilename[file_len] = 0;
 		strcat(outputfilename, ".fsa");
-		consensus_out = sfopen(outputfilename, "w");
+		consensus_out = outFopenPtr(outputfilename, "w");
 		outputfilename[file_len] = 0;
 	} else if((nc & 1) == 0) {
 		strcat(outputfilename, ".fsa");
-		consensus_out = sfopen(outputfilename, "w");
+		consensus_out = outFopenPtr(outputfilename, "w");
 		outputfilename[file_len] = 0;
 	}
-	frag_out_raw = tmpF(0);
+	frag_out_raw = tmpM(0);
 	if(!frag_out_raw) {
 		ERROR();
 	}
 	if(print_matrix) {
 		matrix_out = gzInitFileBuff(CHUNK);
-		strcat(outputfilename, ".mat.gz");
+		strcat(outputfilename, print_matrix == 2 ? ".smat.gz" : ".mat.gz");
 		openFileBuff(matrix_out, outputfilename, "wb");
+		if(print_matrix == 2) {
+			initSparseMatrix(matrix_out);
+		}
 		outputfilename[file_len] = 0;
 	} else {
 		matrix_out = 0;
@@ -569,7 +1000,7 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 	}
 	if(extendedFeatures) {
 		strcat(outputfilename, ".mapstat");
-		extendedFeatures_out = sfopen(outputfilename, "wb");
+		extendedFeatures_out = outFopenPtr(outputfilename, "wb");
 		outputfilename[file_len] = 0;
 		fprintf(extendedFeatures_out, "## method\tKMA\n");
 		fprintf(extendedFeatures_out, "## version\t%s\n", KMA_VERSION);
@@ -811,6 +1242,7 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 		fclose(inputfiles[i]);
 	}
 	
+	fragFlush();
 	i = 0;
 	sfwrite(&i, sizeof(int), 1, frag_out_raw);
 	fflush(frag_out_raw);
@@ -907,7 +1339,11 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 	if(vcf) {
 		templatefilename = 0;
 		initialiseVcf(vcf_out, templatefilename);
+		vcf_pool = 1 < thread_num ? vcfPool_init(vcf_out, thread_num, evalue, support, bcd, vcf) : 0;
+	} else {
+		vcf_pool = 0;
 	}
+	cons_pool = consensus_out && 1 < thread_num ? consPool_init(alignment_out, consensus_out, ref_fsa, thread_num) : 0;
 	
 	/* preallocate assembly matrices */
 	matrix = smalloc(sizeof(AssemInfo));
@@ -923,7 +1359,7 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 	} else {
 		matrix->size++;
 	}
-	matrix->assmb = smalloc(matrix->size * sizeof(Assembly));
+	matrix->assmb = smalloc_tag(MEM_ASSEMBLY, matrix->size * sizeof(Assembly));
 	aligned_assem->size = matrix->size;
 	aligned_assem->t = smalloc(aligned_assem->size);
 	aligned_assem->s = smalloc(aligned_assem->size);
@@ -938,15 +1374,7 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 	threads = 0;
 	while(i < thread_num) {
 		/* allocate matrices */
-		NWmatrices = smalloc(sizeof(NWmat));
-		NWmatrices->NW_s = 1024 * 1024;
-		NWmatrices->NW_q = 1024;
-		NWmatrices->E = smalloc(NWmatrices->NW_s);
-		NWmatrices->D[0] = smalloc((NWmatrices->NW_q << 1) * sizeof(int));
-		NWmatrices->P[0] = smalloc((NWmatrices->NW_q << 1) * sizeof(int));
-		NWmatrices->D[1] = NWmatrices->D[0] + NWmatrices->NW_q;
-		NWmatrices->P[1] = NWmatrices->P[0] + NWmatrices->NW_q;
-		NWmatrices->rewards = rewards;
+		NWmatrices = NWmat_init(1024, 1024 * 1024, rewards);
 		
 		aligned = smalloc(sizeof(Aln));
 		gap_align = smalloc(sizeof(Aln));
@@ -991,7 +1419,7 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 		threads = thread;
 		
 		/* start thread */
-		if((errno = pthread_create(&thread->id, NULL, assembly_KMA_Ptr, thread))) {
+		if((errno = kmaPool_create(&thread->id, -1, assembly_KMA_Ptr, thread))) {
 			fprintf(stderr, "Error: %d (%s)\n", errno, strerror(errno));
 			fprintf(stderr, "Will continue with %d threads.\n", i);
 			threads = thread->next;
@@ -1003,15 +1431,7 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 	}
 	
 	/* start main thread */
-	NWmatrices = smalloc(sizeof(NWmat));
-	NWmatrices->NW_s = 1024 * 1024;
-	NWmatrices->NW_q = 1024;
-	NWmatrices->E = smalloc(NWmatrices->NW_s);
-	NWmatrices->D[0] = smalloc((NWmatrices->NW_q << 1) * sizeof(int));
-	NWmatrices->P[0] = smalloc((NWmatrices->NW_q << 1) * sizeof(int));
-	NWmatrices->D[1] = NWmatrices->D[0] + NWmatrices->NW_q;
-	NWmatrices->P[1] = NWmatrices->P[0] + NWmatrices->NW_q;
-	NWmatrices->rewards = rewards;
+	NWmatrices = NWmat_init(1024, 1024 * 1024, rewards);
 	
 	aligned = smalloc(sizeof(Aln));
 	gap_align = smalloc(sizeof(Aln));
@@ -1074,14 +1494,11 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 	templatefilename = *templatefilenames++;
 	file_len = strlen(templatefilename);
 	strcat(templatefilename, ".seq.b");
-	seq_in_no = open(templatefilename, O_RDONLY);
+	seq_in_no = packOpen(templatefilename, &seqin_size);
 	if(seq_in_no == -1) {
 		ERROR();
 	}
-	seqin_size = 4 * lseek(seq_in_no, 0, SEEK_END);
-	if(lseek(seq_in_no, 0, SEEK_SET) != 0) {
-		ERROR();
-	}
+	seqin_size *= 4;
 	thread->seq_in = seq_in_no;
 	templatefilename[file_len] = 0;
 	strcat(templatefilename, ".name");
@@ -1111,14 +1528,11 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 			templatefilename[file_len] = 0;
 			strcat(templatefilename, ".seq.b");
 			close(seq_in_no);
-			seq_in_no = open(templatefilename, O_RDONLY);
+			seq_in_no = packOpen(templatefilename, &seqin_size);
 			if(seq_in_no == -1) {
 				ERROR();
 			}
-			seqin_size = 4 * lseek(seq_in_no, 0, SEEK_END);
-			if(lseek(seq_in_no, 0, SEEK_SET) != 0) {
-				ERROR();
-			}
+			seqin_size *= 4;
 			thread->seq_in = seq_in_no;
 			templatefilename[file_len] = 0;
 			seq_seeker = 0;
@@ -1199,17 +1613,25 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 						printsv(tsv_out, tsv, thread->template_name, aligned_assem, t_len, readCounts[template], read_score, expected, q_value, p_value, alignment_scores[template], template_name->seq);
 					}
 					if(consensus_out) {
-						printConsensus(aligned_assem, thread->template_name, alignment_out, consensus_out, ref_fsa);
+						if(cons_pool) {
+							consPush(cons_pool, aligned_assem, thread->template_name);
+						} else {
+							printConsensus(aligned_assem, thread->template_name, alignment_out, consensus_out, ref_fsa);
+						}
 					}
 					/* print matrix */
 					if(matrix_out) {
-						updateMatrix(matrix_out, thread->template_name, thread->template_index->seq, matrix, t_len);
+						updateMatrixPtr(matrix_out, thread->template_name, thread->template_index->seq, matrix, t_len);
 					}
 					if(extendedFeatures) {
 						printExtendedFeatures(thread->template_name, aligned_assem, fragmentCounts[template], readCounts[template], extendedFeatures_out);
 					}
 					if(vcf) {
-						updateVcf(thread->template_name, aligned_assem->t, evalue, support, bcd, t_len, matrix, vcf, vcf_out);
+						if(vcf_pool) {
+							vcfPush(vcf_pool, thread->template_name, aligned_assem, t_len, matrix);
+						} else {
+							updateVcf(thread->template_name, aligned_assem->t, evalue, support, bcd, t_len, matrix, vcf, vcf_out);
+						}
 					}
 				}
 			} else {
@@ -1252,10 +1674,13 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 	assembly_KMA_Ptr(thread);
 	for(thread = threads; thread != 0; thread = thread->next) {
 		/* join thread */
-		if((errno = pthread_join(thread->id, NULL))) {
+		if((errno = kmaPool_join(thread->id, NULL))) {
 			ERROR();
 		}
 	}
+	if(cons_pool) {
+		consPool_close(cons_pool);
+	}
 	
 	/* Close files */
 	close(seq_in_no);
@@ -1278,13 +1703,22 @@ int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename,
 		fclose(extendedFeatures_out);
 	}
 	if(vcf) {
+		if(vcf_pool) {
+			vcfPool_close(vcf_pool);
+		}
 		destroyGzFileBuff(vcf_out);
 	}
 	if(xml) {
 		closeCapXML(xml_out);
 	}
+	if(sam) {
+		samclose();
+	}
 	
 	t1 = clock();
+	if(verbose) {
+		kmaPool_report(stderr);
+	}
 	fprintf(stderr, "# Total time used for local assembly: %.2f s.\n#\n", difftime(t1, t0) / 1000000);
 	
 	return status;
@@ -17,7 +17,9 @@
  * limitations under the License.
 */
 #define _XOPEN_SOURCE 600
+#include <pthread.h>
 #include "compdna.h"
+#include "penalties.h"
 #include "qseqs.h"
 
 #ifndef SPLTDB
@@ -29,10 +31,32 @@ struct spltDBbuff {
 	struct spltDBbuff *next;
 	struct spltDBbuff *prev;
 };
+
+typedef struct spltNet SpltNet;
+struct spltNet {
+	int conn;
+	int status;
+	int err;
+	char *host;
+	char *infile;
+	char *outfile;
+	pthread_t sender;
+	pthread_t receiver;
+};
 #define SPLTDB 1
+#define SPLTNET_MAGIC 1263419730
+#define SPLTNET_QUEUE 16
+#define SPLTNET_TIMEOUT 600
+#define SPLTNET_HOSTLEN 1025
+#define SPLTNET_PORTLEN 32
 #endif
 
 int print_ankers_spltDB(int *out_Tem, CompDNA *qseq, int rc_flag, const Qseqs *header, const int flag, FILE *out);
 int print_ankers_Sparse_spltDB(int *out_Tem, CompDNA *qseq, int rc_flag, const Qseqs *header, const int flag, FILE *out);
 unsigned get_ankers_spltDB(int *infoSize, int *out_Tem, CompDNA *qseq, Qseqs *header, int *flag, FILE *inputfile);
+int spltDB_map(char **templatefilenames, int targetNum, char *outputfilename, int thread_num, unsigned exhaustive, Penalties *rewards, int minlen, double mrs, double coverT, double minFrac, unsigned shm);
+/* a shard worker, mapping the parsed input sent to [host:]port on its DB */
+int spltDB_serve(char *listenAddr, char *templatefilename, int thread_num, unsigned exhaustive, Penalties *rewards, int minlen, double mrs, double coverT, double minFrac, unsigned shm);
+/* map on the shard workers at hosts, "host:port,...", one per DB */
+int spltDB_net(int targetNum, char *outputfilename, char *hosts);
 int runKMA_spltDB(char **templatefilenames, int targetNum, char *outputfilename, int argc, char **argv, int ConClave, int kmersize, int minlen, Penalties *rewards, int extendedFeatures, double ID_t, double Depth_t, int mq, double scoreT, double mrc, double evalue, double support, int bcd, int ref_fsa, int print_matrix, int print_all, long unsigned tsv, int vcf, int xml, int sam, int nc, int nf, unsigned shm, int thread_num, int maxFrag, int verbose);
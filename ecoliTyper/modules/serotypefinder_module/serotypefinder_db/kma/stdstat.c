@@ -19,6 +19,7 @@
 
 #include <math.h>
 #include "stdstat.h"
+#include "threader.h"
 
 int (*cmp)(int, int) = &cmp_or;
 
@@ -146,6 +147,150 @@ double p_chisqr(long double q) {
 	return 1 - 1.772453850 * erf(sqrt(0.5 * q)) / tgamma(0.5);
 }
 
+static double chisqrQuantile(double evalue) {
+	
+	/* smallest q in [0, 49] with p_chisqr(q) <= evalue, 
+	   p_chisqr is decreasing in q */
+	double lo, hi, mid;
+	
+	if(evalue < p_chisqr(49)) {
+		return 50;
+	} else if(p_chisqr(0) <= evalue) {
+		return 0;
+	}
+	lo = 0;
+	hi = 49;
+	mid = 24.5;
+	while(lo < mid && mid < hi) {
+		if(p_chisqr(mid) <= evalue) {
+			hi = mid;
+		} else {
+			lo = mid;
+		}
+		mid = lo + (hi - lo) / 2;
+	}
+	
+	return hi;
+}
+
+static double chisqrE[CHISQRCACHE], chisqrQ[CHISQRCACHE];
+static int chisqrCached = 0;
+static volatile int chisqrExclude = 0;
+
+double chisqrThreshold(double evalue) {
+	
+	/* quantiles of earlier evalues, a pair is written before the count
+	   publishing it is stored, and only read after the count is loaded */
+	int i, n;
+	double t;
+	
+	n = __atomic_load_n(&chisqrCached, __ATOMIC_ACQUIRE);
+	for(i = 0; i < n; ++i) {
+		if(chisqrE[i] == evalue) {
+			return chisqrQ[i];
+		}
+	}
+	t = chisqrQuantile(evalue);
+	
+	/* publish new pair, while there is room */
+	lock(&chisqrExclude);
+	n = chisqrCached;
+	for(i = 0; i < n && chisqrE[i] != evalue; ++i);
+	if(i == n && n < CHISQRCACHE) {
+		chisqrE[n] = evalue;
+		chisqrQ[n] = t;
+		__atomic_store_n(&chisqrCached, n + 1, __ATOMIC_RELEASE);
+	}
+	unlock(&chisqrExclude);
+	
+	return t;
+}
+
+int chisqrTest(long double q, double evalue) {
+	
+	/* p_chisqr(q) <= evalue, with the quantile of evalue cached */
+	double t;
+	
+	if(q < 0 || 49 < q) {
+		return p_chisqr(q) <= evalue;
+	}
+	t = chisqrThreshold(evalue);
+	
+	/* only evaluate p_chisqr close to the quantile */
+	if(q < t * (1 - 1e-9)) {
+		return 0;
+	} else if(t * (1 + 1e-9) < q) {
+		return 1;
+	}
+	return p_chisqr(q) <= evalue;
+}
+
+static int chisqrFilterExact(long unsigned score, int t_len, long unsigned tot_ulen, long unsigned Nhits, double evalue, double scoreT) {
+	
+	long double expected, q_value;
+	
+	expected = t_len;
+	expected /= MAX(1, (tot_ulen - t_len));
+	expected *= (Nhits - score);
+	q_value = score - expected;
+	q_value /= (expected + score);
+	q_value *= score - expected;
+	
+	return cmp((p_chisqr(q_value) <= evalue && score > expected), (score >= scoreT * t_len));
+}
+
+void chisqrFilter(long unsigned *scores, int *lengths, int n, long unsigned tot_ulen, double evalue, double scoreT) {
+	
+	/* zero the scores of insignificant templates in [1, n), 
+	   by comparing q with the cached quantile of evalue instead of 
+	   computing p-values, only templates too close to the thresholds 
+	   are redone exactly. The 64 bit to double conversions keep the 
+	   block loop scalar, there is no SSE/AVX kernel for it as in seqscan.c */
+	int i, j, m, sig, len;
+	long unsigned Nhits, score;
+	double t, tLo, tHi, e, q, eps;
+	double E[CHISQRLANES], Q[CHISQRLANES];
+	
+	Nhits = 0;
+	for(i = 1; i < n; ++i) {
+		Nhits += scores[i];
+	}
+	t = chisqrThreshold(evalue);
+	tLo = t * (1 - 1e-9);
+	/* above 49 p-values come from the table in fastp */
+	tHi = (t <= 49 && fastp(49) <= evalue) ? t * (1 + 1e-9) : HUGE_VAL;
+	eps = 1e-9;
+	
+	for(i = 1; i < n; i += CHISQRLANES) {
+		m = n - i < CHISQRLANES ? n - i : CHISQRLANES;
+		for(j = 0; j < m; ++j) {
+			score = scores[i + j];
+			len = lengths[i + j];
+			e = len;
+			e /= (tot_ulen - len) < 1 ? 1 : (tot_ulen - len);
+			e *= (double)(Nhits - score);
+			q = score - e;
+			Q[j] = q * q / (e + score);
+			E[j] = e;
+		}
+		for(j = 0; j < m; ++j) {
+			if((score = scores[i + j])) {
+				len = lengths[i + j];
+				q = Q[j];
+				e = E[j];
+				if(q < 0 || (tLo <= q && q <= tHi) || (score - eps * score <= e && e <= score + eps * score)) {
+					sig = chisqrFilterExact(score, len, tot_ulen, Nhits, evalue, scoreT);
+				} else {
+					sig = cmp((tHi < q && score > e), (score >= scoreT * len));
+				}
+				if(!sig) {
+					scores[i + j] = 0;
+				}
+			}
+		}
+	}
+}
+
 double power(double x, unsigned n) {
 	
 	double y;
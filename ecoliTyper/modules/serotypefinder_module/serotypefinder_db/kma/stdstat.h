@@ -19,6 +19,8 @@
 
 #define MIN(X, Y) ((X) < (Y) ? (X) : (Y))
 #define MAX(X, Y) ((X) < (Y) ? (Y) : (X))
+#define CHISQRLANES 256
+#define CHISQRCACHE 8
 #define NORM(X) (((X) < 0) ? -(X) : (X))
 #define murmur(index, kmer) index = (3323198485ul ^ kmer) * 0x5bd1e995; index ^= index >> 15;
 #define murmur3(index, kmer) index = kmer * 0xcc9e2d51; index = (index << 15) | (index >> 17); index *= 0x1b873593; index = (index << 13) | (index >> 19); index ^= index >> 16; index *= 0x85ebca6b; index ^= index >> 13; index *= 0xc2b2ae35; index ^= index >> 16; 
@@ -29,6 +31,9 @@ int cmp_and(int t, int q);
 int cmp_true(int t, int q);
 double fastp(long double q);
 double p_chisqr(long double q);
+double chisqrThreshold(double evalue);
+int chisqrTest(long double q, double evalue);
+void chisqrFilter(long unsigned *scores, int *lengths, int n, long unsigned tot_ulen, double evalue, double scoreT);
 double power(double x, unsigned n);
 double binP(int n, int k, double p);
 unsigned minimum(unsigned *src, unsigned n);
@@ -0,0 +1,93 @@
+/* Philip T.L.C. Clausen Jan 2017 plan@dtu.dk */
+
+/*
+ * Copyright (c) 2017, Philip Clausen, Technical University of Denmark
+ * All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *		http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#define _GNU_SOURCE /* syscall */
+#include <errno.h>
+#include <time.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#undef _XOPEN_SOURCE
+#include "kmastat.h"
+#include "kmatrace.h"
+#include "threader.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpuRelax() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define cpuRelax() __asm__ __volatile__("yield")
+#else
+#define cpuRelax()
+#endif
+
+int lockWait(volatile int *exclude, long time) {
+	
+	int i, err;
+	long unsigned t0;
+	struct timespec wait;
+	
+	/* spin briefly, the holder is likely on another core */
+	t0 = (kmaStats || 0 <= kmaTraceFd) ? kmaStat_ns() : 0;
+	for(i = 0; i < SPINLOCK; ++i) {
+		cpuRelax();
+		if(*exclude == 0 && __sync_bool_compare_and_swap(exclude, 0, 1)) {
+			if(t0) {
+				kmaStat_add(STAT_LOCKWAIT, kmaStat_ns() - t0);
+			}
+			return 1;
+		}
+	}
+	
+	/* mark as contended (2) and park, 
+	   the timeout guards against words released without unlock */
+	wait.tv_sec = 0;
+	err = errno;
+	while(__sync_lock_test_and_set(exclude, 2)) {
+		wait.tv_nsec = time < 1000000000 ? time : 999999999;
+#ifdef __linux__
+		syscall(SYS_futex, exclude, FUTEX_WAIT_PRIVATE, 2, &wait, NULL, 0);
+#else
+		nanosleep(&wait, NULL);
+#endif
+		if(time < PARKMAX) {
+			time <<= 1;
+		}
+	}
+	/* timeouts and wake races are not errors of the caller, keep its errno */
+	errno = err;
+	if(t0) {
+		kmaStat_add(STAT_LOCKWAIT, kmaStat_ns() - t0);
+		kmaTrace_end("lock", "wait", t0, -1);
+	}
+	
+	return 1;
+}
+
+void unlockWake(volatile int *exclude) {
+	
+	if(__sync_fetch_and_and(exclude, 0) == 2) {
+#ifdef __linux__
+		int err = errno;
+		syscall(SYS_futex, exclude, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+		errno = err;
+#endif
+	}
+}
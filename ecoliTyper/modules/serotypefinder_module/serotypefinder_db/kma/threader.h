@@ -21,14 +21,20 @@
 #if _POSIX_C_SOURCE >= 199309L
 #include <time.h>
 #define sleepSpec(time)((const struct timespec[]){{0, time}})
-#define lock(exclude) while(__sync_lock_test_and_set(exclude, 1)) {while(*exclude) {nanosleep(sleepSpec(100000),NULL);}}
-#define lockTime(exclude, time) while(__sync_lock_test_and_set(exclude, 1)) {while(*exclude) {nanosleep(sleepSpec((time << 10)),NULL);}}
-#define unlock(exclude) (__sync_lock_release(exclude))
-#define wait_atomic(src) while(src) {nanosleep(sleepSpec(100000),NULL);}
+#define lock(exclude) ((void)(__sync_bool_compare_and_swap(exclude, 0, 1) || lockWait(exclude, 100000)))
+#define lockTime(exclude, time) ((void)(__sync_bool_compare_and_swap(exclude, 0, 1) || lockWait(exclude, (time << 10))))
+#define unlock(exclude) (unlockWake(exclude))
+#define wait_atomic(src) for(int spin_ = SPINLOCK; src; spin_ ? --spin_ : nanosleep(sleepSpec(100000),NULL))
 #else
 #include <unistd.h>
-#define lock(exclude) while(__sync_lock_test_and_set(exclude, 1)) {while(*exclude) {usleep(100);}}
-#define lockTime(exclude, spin) while(__sync_lock_test_and_set(exclude, 1)) {while(*exclude) {usleep(spin);}}
-#define unlock(exclude) (__sync_lock_release(exclude))
-#define wait_atomic(src) while(src) {usleep(100);}
+#define lock(exclude) ((void)(__sync_bool_compare_and_swap(exclude, 0, 1) || lockWait(exclude, 100000)))
+#define lockTime(exclude, spin) ((void)(__sync_bool_compare_and_swap(exclude, 0, 1) || lockWait(exclude, (spin << 10))))
+#define unlock(exclude) (unlockWake(exclude))
+#define wait_atomic(src) for(int spin_ = SPINLOCK; src; spin_ ? --spin_ : usleep(100))
 #endif
+#define SPINLOCK 128
+#define PARKMAX 16777216
+
+/* spin, then park on the lock word until woken by unlock */
+int lockWait(volatile int *exclude, long time);
+void unlockWake(volatile int *exclude);
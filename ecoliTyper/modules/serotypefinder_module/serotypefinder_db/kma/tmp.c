@@ -16,10 +16,12 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
 */
-#define _XOPEN_SOURCE 600
+#define _GNU_SOURCE /* fopencookie */
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/types.h>
+#undef _XOPEN_SOURCE
 #include "pherror.h"
 #include "threader.h"
 #include "tmp.h"
@@ -90,3 +92,162 @@ FILE * tmpF(const char *location) {
 	
 	return file;
 }
+
+#ifdef __GLIBC__
+static volatile long unsigned tmpMemUsed = 0;
+static long unsigned tmpMemBudget = 0;
+
+static int tmpMemSpill(TmpMem *src) {
+	
+	/* move stream to disk, keeping the position */
+	if(!(src->disk = tmpF(0))) {
+		return 1;
+	}
+	if(src->len && fwrite(src->buff, 1, src->len, src->disk) != src->len) {
+		return 1;
+	}
+	if(fseeko(src->disk, src->pos, SEEK_SET)) {
+		return 1;
+	}
+	free(src->buff);
+	__sync_sub_and_fetch(&tmpMemUsed, src->size);
+	src->buff = 0;
+	src->size = 0;
+	
+	return 0;
+}
+
+static ssize_t tmpMemRead(void *cookie, char *dest, size_t size) {
+	
+	TmpMem *src = cookie;
+	
+	if(src->disk) {
+		size = fread(dest, 1, size, src->disk);
+		return ferror(src->disk) ? -1 : size;
+	}
+	if(src->len <= src->pos) {
+		return 0;
+	} else if(src->len - src->pos < size) {
+		size = src->len - src->pos;
+	}
+	memcpy(dest, src->buff + src->pos, size);
+	src->pos += size;
+	
+	return size;
+}
+
+static ssize_t tmpMemWrite(void *cookie, const char *buff, size_t size) {
+	
+	long unsigned newSize;
+	TmpMem *dest = cookie;
+	
+	if(!dest->disk && dest->size < dest->pos + size) {
+		/* grow within the budget, or spill */
+		newSize = dest->size ? dest->size << 1 : TMPMEMCHUNK;
+		while(newSize < dest->pos + size) {
+			newSize <<= 1;
+		}
+		if(tmpMemBudget < __sync_add_and_fetch(&tmpMemUsed, newSize - dest->size)) {
+			__sync_sub_and_fetch(&tmpMemUsed, newSize - dest->size);
+			if(tmpMemSpill(dest)) {
+				return -1;
+			}
+		} else if(!(dest->buff = realloc(dest->buff, newSize))) {
+			ERROR();
+		} else {
+			dest->size = newSize;
+		}
+	}
+	if(dest->disk) {
+		return fwrite(buff, 1, size, dest->disk) == size ? size : -1;
+	}
+	if(dest->len < dest->pos) {
+		memset(dest->buff + dest->len, 0, dest->pos - dest->len);
+	}
+	memcpy(dest->buff + dest->pos, buff, size);
+	dest->pos += size;
+	if(dest->len < dest->pos) {
+		dest->len = dest->pos;
+	}
+	
+	return size;
+}
+
+static int tmpMemSeek(void *cookie, off64_t *offset, int whence) {
+	
+	off64_t pos;
+	TmpMem *src = cookie;
+	
+	if(src->disk) {
+		if(fseeko(src->disk, *offset, whence)) {
+			return -1;
+		}
+		*offset = ftello(src->disk);
+		return 0;
+	}
+	if(whence == SEEK_SET) {
+		pos = *offset;
+	} else if(whence == SEEK_CUR) {
+		pos = src->pos + *offset;
+	} else if(whence == SEEK_END) {
+		pos = src->len + *offset;
+	} else {
+		return -1;
+	}
+	if(pos < 0) {
+		return -1;
+	}
+	*offset = (src->pos = pos);
+	
+	return 0;
+}
+
+static int tmpMemClose(void *cookie) {
+	
+	int status;
+	TmpMem *src = cookie;
+	
+	status = 0;
+	if(src->disk) {
+		status = fclose(src->disk);
+	} else {
+		__sync_sub_and_fetch(&tmpMemUsed, src->size);
+		free(src->buff);
+	}
+	free(src);
+	
+	return status;
+}
+#endif
+
+FILE * tmpM(long unsigned budget) {
+	
+#ifdef __GLIBC__
+	FILE *file;
+	TmpMem *src;
+	cookie_io_functions_t funcs = {&tmpMemRead, &tmpMemWrite, &tmpMemSeek, &tmpMemClose};
+	
+	if(budget) {
+		/* set memory budget shared by all memory tmp streams */
+		tmpMemBudget = budget;
+		return 0;
+	} else if(!tmpMemBudget) {
+		return tmpF(0);
+	}
+	
+	src = smalloc(sizeof(TmpMem));
+	src->len = 0;
+	src->size = 0;
+	src->pos = 0;
+	src->buff = 0;
+	src->disk = 0;
+	if(!(file = fopencookie(src, "wb+", funcs))) {
+		free(src);
+		return tmpF(0);
+	}
+	
+	return file;
+#else
+	return budget ? 0 : tmpF(0);
+#endif
+}
@@ -19,4 +19,18 @@
 
 #include <stdio.h>
 
+#ifndef TMPMEM
+typedef struct tmpMem TmpMem;
+struct tmpMem {
+	long unsigned len;
+	long unsigned size;
+	long unsigned pos;
+	unsigned char *buff;
+	FILE *disk;
+};
+#define TMPMEM 1
+#define TMPMEMCHUNK 1048576
+#endif
+
 FILE * tmpF(const char *location);
+FILE * tmpM(long unsigned budget);
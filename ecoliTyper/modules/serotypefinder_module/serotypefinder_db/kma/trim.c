@@ -16,21 +16,30 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
 */
+#define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <zlib.h>
+#include "bgzf.h"
 #include "compdna.h"
+#include "filebuff.h"
 #include "pherror.h"
+#include "qpack.h"
 #include "runinput.h"
 #include "qc.h"
 #include "qseqs.h"
+#include "seqparse.h"
+#include "seqscan.h"
+#include "threader.h"
 #include "trim.h"
 
 void printTrimFsa(Qseqs *header, Qseqs *qseq, Qseqs *qual, CompDNA *compressor, FILE *out) {
 	
-	const char bases[6] = "ACGTN-";
 	static FILE *OUT = 0;
-	int i, error;
-	unsigned char *ptr;
+	int error;
 	
 	/* init */
 	if(!OUT) {
@@ -40,12 +49,7 @@ void printTrimFsa(Qseqs *header, Qseqs *qseq, Qseqs *qual, CompDNA *compressor,
 	error = 0;
 	
 	/* translate to human readable bases */
-	ptr = qseq->seq;
-	i = qseq->len + 1;
-	while(--i) {
-		*ptr = bases[*ptr];
-		++ptr;
-	}
+	decodeNuc(qseq->seq, qseq->len);
 	
 	/* print */
 	if(qual) {
@@ -69,10 +73,8 @@ void printTrimFsa(Qseqs *header, Qseqs *qseq, Qseqs *qual, CompDNA *compressor,
 
 void printTrimFsa_pair(Qseqs *header, Qseqs *qseq, Qseqs *qual, Qseqs *header_r, Qseqs *qseq_r, Qseqs *qual_r, CompDNA *compressor, FILE *out) {
 	
-	const char bases[6] = "ACGTN-";
 	static FILE *OUT = 0;
-	int i, error;
-	unsigned char *ptr;
+	int error;
 	
 	/* init */
 	if(!OUT) {
@@ -82,18 +84,8 @@ void printTrimFsa_pair(Qseqs *header, Qseqs *qseq, Qseqs *qual, Qseqs *header_r,
 	error = 0;
 	
 	/* translate to human readable bases */
-	ptr = qseq->seq;
-	i = qseq->len + 1;
-	while(--i) {
-		*ptr = bases[*ptr];
-		++ptr;
-	}
-	ptr = qseq_r->seq;
-	i = qseq_r->len + 1;
-	while(--i) {
-		*ptr = bases[*ptr];
-		++ptr;
-	}
+	decodeNuc(qseq->seq, qseq->len);
+	decodeNuc(qseq_r->seq, qseq_r->len);
 	
 	/* print */
 	if(qual) {
@@ -125,6 +117,367 @@ void printTrimFsa_pair(Qseqs *header, Qseqs *qseq, Qseqs *qual, Qseqs *header_r,
 	}
 }
 
+static void trimPrint(Qseqs *dest, Qseqs *header, Qseqs *qseq, Qseqs *qual, int start, int len) {
+	
+	unsigned size;
+	unsigned char *ptr;
+	
+	/* make room */
+	size = dest->len + header->len + (len << 1) + 4;
+	if(dest->size < size) {
+		dest->size = size << 1;
+		dest->seq = realloc(dest->seq, dest->size);
+		if(!dest->seq) {
+			ERROR();
+		}
+	}
+	
+	/* append record as text */
+	ptr = dest->seq + dest->len;
+	memcpy(ptr, header->seq, header->len);
+	ptr += header->len;
+	*ptr++ = '\n';
+	decodeNuc(qseq->seq + start, len);
+	memcpy(ptr, qseq->seq + start, len);
+	ptr += len;
+	if(qual) {
+		memcpy(ptr, "\n+\n", 3);
+		ptr += 3;
+		memcpy(ptr, qual->seq + start, len);
+		ptr += len;
+	}
+	*ptr++ = '\n';
+	dest->len = ptr - dest->seq;
+}
+
+static int trimStat(TrimPool *pool, TrimBatch *batch, int i, int *start, int *end, QCstat *qcreport) {
+	
+	if(batch->FASTQ & 1) {
+		return phredStat(batch->qseq[i]->seq, batch->qual[i]->seq, batch->qseq[i]->len, pool->prob - batch->phredScale, batch->phredScale + pool->minPhred, pool->minQ, pool->minmaskQ, pool->fiveClip, pool->threeClip, pool->minlen, pool->maxlen, start, end, qcreport);
+	}
+	return fsastat(batch->qseq[i]->seq, batch->qseq[i]->len, pool->minlen, pool->maxlen, start, end, qcreport);
+}
+
+static void trimBatch(TrimPool *pool, TrimBatch *batch, QCstat *qcreport) {
+	
+	int i, minlen, len, len2, start, start2, end, end2;
+	Qseqs **header, **qseq, **qual, *out, *out_int;
+	
+	minlen = pool->minlen;
+	header = batch->header;
+	qseq = batch->qseq;
+	qual = (batch->FASTQ & 1) ? batch->qual : 0;
+	out = batch->out[0];
+	out_int = batch->out[1];
+	out->len = 0;
+	out_int->len = 0;
+	batch->count = 0;
+	
+	if(!batch->paired) {
+		for(i = 0; i < batch->num; ++i) {
+			len = trimStat(pool, batch, i, &start, &end, qcreport);
+			if(minlen <= len) {
+				trimPrint(out, header[i], qseq[i], qual ? qual[i] : 0, start, end - start);
+				++batch->count;
+			}
+		}
+	} else {
+		for(i = 0; i < batch->num; i += 2) {
+			len = trimStat(pool, batch, i, &start, &end, qcreport);
+			len2 = trimStat(pool, batch, i + 1, &start2, &end2, qcreport);
+			if(minlen <= len && minlen <= len2) {
+				trimPrint(out_int, header[i], qseq[i], qual ? qual[i] : 0, start, end - start);
+				trimPrint(out_int, header[i + 1], qseq[i + 1], qual ? qual[i + 1] : 0, start2, end2 - start2);
+				++batch->count;
+			} else if(minlen <= len) {
+				trimPrint(out, header[i], qseq[i], qual ? qual[i] : 0, start, end - start);
+				++batch->count;
+			} else if(minlen <= len2) {
+				trimPrint(out, header[i + 1], qseq[i + 1], qual ? qual[i + 1] : 0, start2, end2 - start2);
+				++batch->count;
+			}
+		}
+	}
+}
+
+void * trimPool_thread(void *arg) {
+	
+	long unsigned seq;
+	TrimPool *pool = arg;
+	TrimBatch *batch;
+	QCstat *qcreport;
+	
+	/* QC is kept per trimmer, so it needs no locking */
+	qcreport = pool->qcstats ? pool->qcstats[__sync_fetch_and_add(&pool->thread_i, 1)] : 0;
+	
+	while(1) {
+		/* claim the next batch */
+		seq = __sync_fetch_and_add(&pool->next, 1);
+		batch = pool->batches + (seq % pool->size);
+		wait_atomic((batch->status != 1 || batch->seq != seq) && !pool->stop);
+		if(batch->status != 1 || batch->seq != seq) {
+			break;
+		}
+		
+		/* trim and format */
+		trimBatch(pool, batch, qcreport);
+		
+		/* deliver in input order */
+		wait_atomic(pool->written != seq);
+		if(batch->out[0]->len) {
+			bgzfWrite(pool->out[0], batch->out[0]->seq, batch->out[0]->len);
+		}
+		if(batch->out[1] != batch->out[0] && batch->out[1]->len) {
+			bgzfWrite(pool->out[1], batch->out[1]->seq, batch->out[1]->len);
+		}
+		pool->count += batch->count;
+		batch->status = 0;
+		__sync_synchronize();
+		++pool->written;
+	}
+	
+	return NULL;
+}
+
+TrimPool * trimPool_init(int thread_num, int minPhred, int minmaskQ, int minQ, int fiveClip, int threeClip, int minlen, int maxlen, const double *prob, QCstat *qcreport, BgzfFile *out, BgzfFile *out_int) {
+	
+	int i, j;
+	TrimPool *dest;
+	TrimBatch *batch;
+	
+	dest = smalloc(sizeof(TrimPool));
+	dest->thread_num = thread_num < 1 ? 1 : thread_num;
+	dest->size = dest->thread_num << 1;
+	dest->minPhred = minPhred < minQ ? minQ : minPhred;
+	dest->minmaskQ = minmaskQ;
+	dest->minQ = minQ;
+	dest->fiveClip = fiveClip;
+	dest->threeClip = threeClip;
+	dest->minlen = minlen;
+	dest->maxlen = maxlen;
+	dest->thread_i = 0;
+	dest->stop = 0;
+	dest->filled = 0;
+	dest->next = 0;
+	dest->written = 0;
+	dest->count = 0;
+	dest->prob = prob;
+	dest->qcreport = qcreport;
+	dest->out[0] = out;
+	dest->out[1] = out_int;
+	
+	/* batches of reads, in flight between reader, trimmers and writer */
+	dest->batches = smalloc(dest->size * sizeof(TrimBatch));
+	for(i = 0, batch = dest->batches; i < dest->size; ++i, ++batch) {
+		batch->status = 0;
+		batch->num = 0;
+		batch->paired = 0;
+		batch->FASTQ = 0;
+		batch->phredScale = 33;
+		batch->seq = 0;
+		batch->count = 0;
+		batch->header = smalloc(3 * TRIMBATCH * sizeof(Qseqs *));
+		batch->qseq = batch->header + TRIMBATCH;
+		batch->qual = batch->qseq + TRIMBATCH;
+		for(j = 0; j < 3 * TRIMBATCH; ++j) {
+			batch->header[j] = setQseqs(256);
+		}
+		batch->out[0] = setQseqs(TRIMBATCH << 8);
+		batch->out[1] = out == out_int ? batch->out[0] : setQseqs(TRIMBATCH << 8);
+	}
+	if(qcreport) {
+		dest->qcstats = smalloc(dest->thread_num * sizeof(QCstat *));
+		for(i = 0; i < dest->thread_num; ++i) {
+			if(!(dest->qcstats[i] = init_QCstat(qcreport->verbose))) {
+				ERROR();
+			}
+		}
+	} else {
+		dest->qcstats = 0;
+	}
+	
+	/* start trimmers */
+	dest->ids = smalloc(dest->thread_num * sizeof(pthread_t));
+	for(i = 0; i < dest->thread_num; ++i) {
+		if((errno = pthread_create(dest->ids + i, NULL, &trimPool_thread, dest))) {
+			ERROR();
+		}
+	}
+	
+	return dest;
+}
+
+static TrimBatch * trimPool_next(TrimPool *pool, int paired, int FASTQ, int phredScale) {
+	
+	TrimBatch *batch;
+	
+	/* wait for the next slot to be written */
+	batch = pool->batches + (pool->filled % pool->size);
+	wait_atomic(batch->status);
+	batch->num = 0;
+	batch->paired = paired;
+	batch->FASTQ = FASTQ;
+	batch->phredScale = phredScale;
+	
+	return batch;
+}
+
+static void trimPool_push(TrimPool *pool, TrimBatch *batch) {
+	
+	if(batch->num) {
+		batch->seq = pool->filled;
+		__sync_synchronize();
+		batch->status = 1;
+		++pool->filled;
+	}
+}
+
+static int trimGet(FileBuff *src, TrimBatch *batch, int i, char *trans) {
+	
+	if(batch->FASTQ & 1) {
+		return FileBuffgetFq(src, batch->header[i], batch->qseq[i], batch->qual[i], trans);
+	}
+	return FileBuffgetFsa(src, batch->header[i], batch->qseq[i], trans);
+}
+
+long unsigned trimPool_run(TrimPool *pool, char **inputfiles, int fileCount, int paired, char *trans) {
+	
+	int i, fileCounter, phredScale, step, n;
+	unsigned FASTQ, FASTQ2;
+	long unsigned count, org_count;
+	char *filename;
+	FileBuff *inputfile, *inputfile2, *mate;
+	TrimBatch *batch;
+	
+	/* paired is 0 for single end, 1 for paired files and 2 for interleaved */
+	inputfile = setFileBuff(CHUNK);
+	inputfile2 = paired == 1 ? setFileBuff(CHUNK) : 0;
+	mate = paired == 1 ? inputfile2 : inputfile;
+	step = paired ? 2 : 1;
+	phredScale = 33;
+	FASTQ2 = 0;
+	count = pool->count;
+	org_count = 0;
+	
+	for(fileCounter = 0; fileCounter < fileCount; ++fileCounter) {
+		filename = inputfiles[fileCounter];
+		
+		/* determine filetype and open it */
+		FASTQ = openAndDetermine(inputfile, filename);
+		if(paired == 1) {
+			filename = inputfiles[++fileCounter];
+			FASTQ2 = openAndDetermine(inputfile2, filename);
+			if(FASTQ == FASTQ2) {
+				fprintf(stderr, "# Reading inputfile:\t%s %s\n", inputfiles[fileCounter-1], filename);
+			} else {
+				fprintf(stderr, "Inputfiles:\t%s %s\nAre in different format.\n", inputfiles[fileCounter-1], filename);
+				FASTQ = 0;
+				errno = 1;
+			}
+		} else if(FASTQ & 3) {
+			fprintf(stderr, "%s\t%s\n", "# Reading inputfile: ", filename);
+		}
+		
+		/* get phred scale */
+		if(FASTQ & 1) {
+			phredScale = getPhredFileBuff(inputfile);
+			if(phredScale == 0 && paired == 1) {
+				phredScale = getPhredFileBuff(inputfile2);
+			}
+			fprintf(stderr, "# Phred scale:\t%d\n", phredScale);
+		}
+		
+		/* fill batches, trimming is done by the pool */
+		if(FASTQ & 3) {
+			batch = trimPool_next(pool, paired, FASTQ, phredScale);
+			while(1) {
+				n = batch->num;
+				if(paired) {
+					n = trimGet(inputfile, batch, n, trans) | trimGet(mate, batch, n + 1, trans);
+				} else {
+					n = trimGet(inputfile, batch, n, trans);
+				}
+				if(!n) {
+					break;
+				}
+				++org_count;
+				if(TRIMBATCH <= (batch->num += step)) {
+					trimPool_push(pool, batch);
+					batch = trimPool_next(pool, paired, FASTQ, phredScale);
+				}
+			}
+			trimPool_push(pool, batch);
+		}
+		
+		if(FASTQ & 4) {
+			gzcloseFileBuff(inputfile);
+		} else {
+			closeFileBuff(inputfile);
+		}
+		if(paired == 1) {
+			if(FASTQ2 & 4) {
+				gzcloseFileBuff(inputfile2);
+			} else {
+				closeFileBuff(inputfile2);
+			}
+		}
+	}
+	
+	/* wait for the last batches to be written */
+	wait_atomic(pool->written != pool->filled);
+	count = pool->count - count;
+	if(pool->qcreport) {
+		pool->qcreport->fragcount += count;
+		pool->qcreport->org_fragcount += org_count;
+		n = !paired || pool->qcreport->Eeq;
+		for(i = 0; i < pool->thread_num && !n; ++i) {
+			n = pool->qcstats[i]->Eeq != 0;
+		}
+		if(n) {
+			pool->qcreport->phredScale = phredScale;
+		}
+	}
+	destroyFileBuff(inputfile);
+	if(inputfile2) {
+		destroyFileBuff(inputfile2);
+	}
+	
+	return count;
+}
+
+void trimPool_destroy(TrimPool *pool) {
+	
+	int i, j;
+	TrimBatch *batch;
+	
+	/* stop trimmers */
+	pool->stop = 1;
+	for(i = 0; i < pool->thread_num; ++i) {
+		pthread_join(pool->ids[i], NULL);
+	}
+	
+	for(i = 0, batch = pool->batches; i < pool->size; ++i, ++batch) {
+		for(j = 0; j < 3 * TRIMBATCH; ++j) {
+			destroyQseqs(batch->header[j]);
+		}
+		free(batch->header);
+		if(batch->out[1] != batch->out[0]) {
+			destroyQseqs(batch->out[1]);
+		}
+		destroyQseqs(batch->out[0]);
+	}
+	if(pool->qcstats) {
+		for(i = 0; i < pool->thread_num; ++i) {
+			merge_QCstat(pool->qcreport, pool->qcstats[i]);
+			destroy_QCstat(pool->qcstats[i]);
+		}
+		free(pool->qcstats);
+	}
+	free(pool->batches);
+	free(pool->ids);
+	free(pool);
+}
+
 static int helpMessage(FILE *out) {
 	
 	fprintf(out, "#kma trim trims sequences\n");
@@ -141,6 +494,9 @@ static int helpMessage(FILE *out) {
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-eq", "Minimum average quality", "0");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-5p", "Trim 5 prime", "0");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-3p", "Trim 3 prime", "0");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-gz", "Gzip (BGZF) compress output", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-pack", "Write packed queries for kma -ipk", "False");
+	fprintf(out, "# %16s\t%-32s\t%s\n", "-t", "Number of threads", "1");
 	fprintf(out, "# %16s\t%-32s\t%s\n", "-h", "Shows this helpmessage", "");
 	
 	return (out == stderr);
@@ -182,11 +538,14 @@ int trim_main(int argc, char *argv[]) {
 		0.00000000000000000000000015848932, 0.00000000000000000000000012589254, 0.00000000000000000000000010000000, 0.00000000000000000000000007943282, 0.00000000000000000000000006309573, 0.00000000000000000000000005011872, 0.00000000000000000000000003981072, 0.00000000000000000000000003162278};
 	int i, args, fileCounter, fileCounter_PE, fileCounter_INT, fileCount;
 	int minPhred, minmaskQ, minQ, fiveClip, threeClip, minlen, maxlen;
+	int thread_num, gz, pack;
 	long unsigned totFrags;
 	char **inputfiles, **inputfiles_PE, **inputfiles_INT;
 	char *to2Bit, *outputfilename, *exeBasic;
 	FILE *out, *out_int, *out_json;
 	QCstat *qcreport; 
+	BgzfFile *bout, *bout_int;
+	TrimPool *pool;
 	
 	/* set defaults */
 	minPhred = 20;
@@ -196,6 +555,9 @@ int trim_main(int argc, char *argv[]) {
 	threeClip = 0;
 	minlen = 16;
 	maxlen = 2147483647;
+	thread_num = 1;
+	gz = 0;
+	pack = 0;
 	fileCounter = 0;
 	fileCounter_PE = 0;
 	fileCounter_INT = 0;
@@ -350,6 +712,19 @@ int trim_main(int argc, char *argv[]) {
 					exit(4);
 				}
 			}
+		} else if(strcmp(argv[args], "-gz") == 0) {
+			gz = 1;
+		} else if(strcmp(argv[args], "-pack") == 0) {
+			pack = 1;
+		} else if(strcmp(argv[args], "-t") == 0) {
+			++args;
+			if(args < argc) {
+				thread_num = strtoul(argv[args], &exeBasic, 10);
+				if(*exeBasic != 0 || thread_num < 1) {
+					fprintf(stderr, "Invalid argument at \"-t\".\n");
+					exit(1);
+				}
+			}
 		} else if(strcmp(argv[args], "-h") == 0) {
 			return helpMessage(stdout);
 		} else {
@@ -361,12 +736,28 @@ int trim_main(int argc, char *argv[]) {
 	}
 	
 	/* set ptrs */
-	if(outputfilename) {
+	if(pack) {
+		/* SE and PE records share one file, which is rewound on close */
+		if(!outputfilename) {
+			fprintf(stderr, "\"-pack\" needs an output file, \"-o\".\n");
+			exit(1);
+		}
+		i = strlen(outputfilename);
+		sprintf(outputfilename + i, ".qpk");
+		out = sfopen(outputfilename, "wb");
+		out_int = out;
+		if(qcreport) {
+			sprintf(outputfilename + i, ".json");
+			out_json = sfopen(outputfilename, "wb");
+		}
+		outputfilename[i] = 0;
+		qpackOpen(out);
+	} else if(outputfilename) {
 		i = strlen(outputfilename);
-		sprintf(outputfilename + i, ".fq");
+		sprintf(outputfilename + i, gz ? ".fq.gz" : ".fq");
 		out = sfopen(outputfilename, "wb");
 		if(fileCounter_PE + fileCounter_INT) {
-			sprintf(outputfilename + i, "_int.fq");
+			sprintf(outputfilename + i, gz ? "_int.fq.gz" : "_int.fq");
 			out_int = sfopen(outputfilename, "wb");
 		}
 		if(qcreport) {
@@ -375,10 +766,15 @@ int trim_main(int argc, char *argv[]) {
 		}
 		outputfilename[i] = 0;
 	}
-	printFsa_ptr = &printTrimFsa;
-	printFsa_ptr(0, 0, 0, 0, out);
-	printFsa_pair_ptr = &printTrimFsa_pair;
-	printFsa_pair_ptr(0, 0, 0, 0, 0, 0, 0, out_int);
+	if(pack) {
+		printFsa_ptr = &printFsa;
+		printFsa_pair_ptr = &printFsa_pair;
+	} else {
+		printFsa_ptr = &printTrimFsa;
+		printFsa_ptr(0, 0, 0, 0, out);
+		printFsa_pair_ptr = &printTrimFsa_pair;
+		printFsa_pair_ptr(0, 0, 0, 0, 0, 0, 0, out_int);
+	}
 	
 	/* set to2Bit conversion */
 	to2Bit = smalloc(384); /* 128 * 3 = 384 -> OS independent */
@@ -433,19 +829,50 @@ int trim_main(int argc, char *argv[]) {
 		minPhred = minmaskQ;
 	}
 	
-	/* SE */
-	if(fileCounter > 0) {
-		totFrags += run_input(inputfiles, fileCounter, minPhred, minmaskQ, minQ, fiveClip, threeClip, minlen, maxlen, to2Bit, prob, qcreport, out);
-	}
-	
-	/* PE */
-	if(fileCounter_PE > 0) {
-		totFrags += run_input_PE(inputfiles_PE, fileCounter_PE, minPhred, minmaskQ, minQ, fiveClip, threeClip, minlen, maxlen, to2Bit, prob, qcreport, out);
+	if((thread_num == 1 && !gz) || pack) {
+		/* SE */
+		if(fileCounter > 0) {
+			totFrags += run_input(inputfiles, fileCounter, minPhred, minmaskQ, minQ, fiveClip, threeClip, minlen, maxlen, to2Bit, prob, qcreport, out);
+		}
+		
+		/* PE */
+		if(fileCounter_PE > 0) {
+			totFrags += run_input_PE(inputfiles_PE, fileCounter_PE, minPhred, minmaskQ, minQ, fiveClip, threeClip, minlen, maxlen, to2Bit, prob, qcreport, out);
+		}
+		
+		/* INT */
+		if(fileCounter_INT > 0) {
+			totFrags += run_input_INT(inputfiles_INT, fileCounter_INT, minPhred, minmaskQ, minQ, fiveClip, threeClip, minlen, maxlen, to2Bit, prob, qcreport, out);
+		}
+	} else {
+		/* read in batches, trim in parallel and write in order */
+		bout = bgzfOpen(out, thread_num, 1, !gz);
+		if(out_int == out || !(fileCounter_PE + fileCounter_INT)) {
+			bout_int = bout;
+		} else {
+			bout_int = bgzfOpen(out_int, thread_num, 1, !gz);
+		}
+		pool = trimPool_init(thread_num, minPhred, minmaskQ, minQ, fiveClip, threeClip, minlen, maxlen, prob, qcreport, bout, bout_int);
+		if(fileCounter > 0) {
+			totFrags += trimPool_run(pool, inputfiles, fileCounter, 0, to2Bit);
+		}
+		if(fileCounter_PE > 0) {
+			totFrags += trimPool_run(pool, inputfiles_PE, fileCounter_PE, 1, to2Bit);
+		}
+		if(fileCounter_INT > 0) {
+			totFrags += trimPool_run(pool, inputfiles_INT, fileCounter_INT, 2, to2Bit);
+		}
+		trimPool_destroy(pool);
+		if(bout_int != bout && bgzfClose(bout_int) != Z_OK) {
+			ERROR();
+		}
+		if(bgzfClose(bout) != Z_OK) {
+			ERROR();
+		}
 	}
 	
-	/* INT */
-	if(fileCounter_INT > 0) {
-		totFrags += run_input_INT(inputfiles_INT, fileCounter_INT, minPhred, minmaskQ, minQ, fiveClip, threeClip, minlen, maxlen, to2Bit, prob, qcreport, out);
+	if(pack) {
+		qpackClose(out, totFrags);
 	}
 	
 	/* print QC */
@@ -459,7 +886,7 @@ int trim_main(int argc, char *argv[]) {
 	if(out != stdout) {
 		fclose(out);
 	}
-	if(out_int != stdout) {
+	if(out_int != stdout && out_int != out) {
 		fclose(out_int);
 	}
 	if(out_json != stderr) {
@@ -16,10 +16,61 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
 */
+#include <pthread.h>
 #include <stdio.h>
+#include "bgzf.h"
 #include "compdna.h"
+#include "qc.h"
 #include "qseqs.h"
 
+#ifndef TRIM
+typedef struct trimBatch TrimBatch;
+typedef struct trimPool TrimPool;
+struct trimBatch {
+	volatile int status; /* 0 free, 1 filled */
+	int num;
+	int paired;
+	int FASTQ;
+	int phredScale;
+	volatile long unsigned seq;
+	long unsigned count;
+	Qseqs **header;
+	Qseqs **qseq;
+	Qseqs **qual;
+	Qseqs *out[2]; /* single and paired output, same when shared */
+};
+
+struct trimPool {
+	int thread_num;
+	int size;
+	volatile int thread_i;
+	int minPhred;
+	int minmaskQ;
+	int minQ;
+	int fiveClip;
+	int threeClip;
+	int minlen;
+	int maxlen;
+	volatile int stop;
+	volatile long unsigned filled;
+	long unsigned next;
+	volatile long unsigned written;
+	long unsigned count;
+	const double *prob;
+	QCstat *qcreport;
+	QCstat **qcstats; /* per trimmer, merged when the pool is destroyed */
+	BgzfFile *out[2];
+	TrimBatch *batches;
+	pthread_t *ids;
+};
+#define TRIM 1
+#define TRIMBATCH 2048
+#endif
+
 void printTrimFsa(Qseqs *header, Qseqs *qseq, Qseqs *qual, CompDNA *compressor, FILE *out);
 void printTrimFsa_pair(Qseqs *header, Qseqs *qseq, Qseqs *qual, Qseqs *header_r, Qseqs *qseq_r, Qseqs *qual_r, CompDNA *compressor, FILE *out);
+TrimPool * trimPool_init(int thread_num, int minPhred, int minmaskQ, int minQ, int fiveClip, int threeClip, int minlen, int maxlen, const double *prob, QCstat *qcreport, BgzfFile *out, BgzfFile *out_int);
+void * trimPool_thread(void *arg);
+long unsigned trimPool_run(TrimPool *pool, char **inputfiles, int fileCount, int paired, char *trans);
+void trimPool_destroy(TrimPool *pool);
 int trim_main(int argc, char *argv[]);
@@ -24,7 +24,9 @@
 #include "hashmapcci.h"
 #include "pherror.h"
 #include "qualcheck.h"
+#include "radix.h"
 #include "stdnuc.h"
+#include "stdstat.h"
 #include "updateindex.h"
 
 int (*update_DB)(HashMap *, CompDNA *, unsigned, int, double, double, unsigned *, unsigned *, Qseqs *) = &updateDBs;
@@ -76,6 +78,123 @@ int updateDBs(HashMap *templates, CompDNA *qseq, unsigned template, int MinKlen,
 	return n;
 }
 
+int countDBs(HashMap *templates, CompDNA *qseq) {
+	
+	int i, j, end, seqend;
+	unsigned n;
+	
+	if(qseq->seqlen < templates->kmersize) {
+		return 0;
+	}
+	
+	/* count the k-mers updateDBs would add */
+	qseq->N[0]++;
+	qseq->N[qseq->N[0]] = qseq->seqlen;
+	seqend = qseq->seqlen - templates->kmersize + 1;
+	n = 0;
+	for(i = 1, j = 0; i <= qseq->N[0] && j < seqend; ++i) {
+		end = qseq->N[i];
+		j += templates->kmersize - 1;
+		if(j < end) {
+			n += end - j;
+		}
+		j = end + 1;
+	}
+	qseq->N[0]--;
+	
+	return n;
+}
+
+void updateDBs_shard(HashMap *templates, CompDNA *qseq, unsigned template, unsigned shard, unsigned shard_num) {
+	
+	int i, j, end, shifter, mPos, hLen, seqend;
+	unsigned kmersize, mlen, flag, cPos, iPos;
+	long unsigned mask, mmask, kmer, cmer, hmer, index, *seq;
+	
+	if(qseq->seqlen < templates->kmersize) {
+		return;
+	}
+	
+	/* set parameters */
+	qseq->N[0]++;
+	qseq->N[qseq->N[0]] = qseq->seqlen;
+	seq = qseq->seq;
+	kmersize = templates->kmersize;
+	shifter = 64 - (kmersize << 1);
+	mask = 0xFFFFFFFFFFFFFFFF >> shifter;
+	mlen = templates->mlen;
+	mmask = 0xFFFFFFFFFFFFFFFF >> (64 - (mlen << 1));
+	flag = templates->flag;
+	seqend = qseq->seqlen - kmersize + 1;
+	hLen = kmersize;
+	
+	/* iterate sequence, keeping the k-mers belonging to this shard */
+	for(i = 1, j = 0; i <= qseq->N[0] && j < seqend; ++i) {
+		/* init k-mer */
+		getKmer_macro(kmer, seq, j, cPos, iPos, (shifter + 2));
+		cmer = flag ? initCmer(kmer, &mPos, &hmer, &hLen, shifter + 2, kmersize, mlen, mmask) : kmer;
+		end = qseq->N[i];
+		for(j += kmersize - 1; j < end; ++j) {
+			/* update k-mer */
+			kmer = updateKmer_macro(kmer, seq, j, mask);
+			cmer = flag ? updateCmer(cmer, &mPos, &hmer, &hLen, kmer, kmersize, mlen, mmask) : kmer;
+			
+			/* update shard */
+			murmur(index, cmer);
+			if((index >> 32) % shard_num == shard) {
+				hashMap_addKMA(templates, cmer, template);
+			}
+		}
+		j = end + 1;
+	}
+	qseq->N[0]--;
+}
+
+void updateDBs_pairs(HashMap *templates, KmerPairs *pairs, CompDNA *qseq, unsigned template, long unsigned pos) {
+	
+	int i, j, end, shifter, mPos, hLen, seqend;
+	unsigned kmersize, mlen, flag, cPos, iPos, *values;
+	long unsigned mask, mmask, kmer, cmer, hmer, *keys, *seq;
+	
+	if(qseq->seqlen < templates->kmersize) {
+		return;
+	}
+	
+	/* set parameters */
+	qseq->N[0]++;
+	qseq->N[qseq->N[0]] = qseq->seqlen;
+	seq = qseq->seq;
+	kmersize = templates->kmersize;
+	shifter = 64 - (kmersize << 1);
+	mask = 0xFFFFFFFFFFFFFFFF >> shifter;
+	mlen = templates->mlen;
+	mmask = 0xFFFFFFFFFFFFFFFF >> (64 - (mlen << 1));
+	flag = templates->flag;
+	seqend = qseq->seqlen - kmersize + 1;
+	hLen = kmersize;
+	keys = pairs->keys + pos;
+	values = pairs->values + pos;
+	
+	/* iterate sequence, writing the pairs from pos and on */
+	for(i = 1, j = 0; i <= qseq->N[0] && j < seqend; ++i) {
+		/* init k-mer */
+		getKmer_macro(kmer, seq, j, cPos, iPos, (shifter + 2));
+		cmer = flag ? initCmer(kmer, &mPos, &hmer, &hLen, shifter + 2, kmersize, mlen, mmask) : kmer;
+		end = qseq->N[i];
+		for(j += kmersize - 1; j < end; ++j) {
+			/* update k-mer */
+			kmer = updateKmer_macro(kmer, seq, j, mask);
+			cmer = flag ? updateCmer(cmer, &mPos, &hmer, &hLen, kmer, kmersize, mlen, mmask) : kmer;
+			
+			/* add pair */
+			*keys++ = cmer;
+			*values++ = template;
+		}
+		j = end + 1;
+	}
+	qseq->N[0]--;
+}
+
 int updateDBs_sparse(HashMap *templates, CompDNA *qseq, unsigned template, int MinKlen, double homQ, double homT, unsigned *template_ulengths, unsigned *template_slengths, Qseqs *header) {
 	
 	int i, j, end, rc, prefix_len, prefix_shifter, mPos, hLen, seqend;
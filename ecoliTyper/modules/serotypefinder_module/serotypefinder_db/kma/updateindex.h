@@ -20,10 +20,14 @@
 #include <stdio.h>
 #include "compdna.h"
 #include "hashmap.h"
+#include "radix.h"
 
 extern int (*update_DB)(HashMap *, CompDNA *, unsigned, int, double, double, unsigned *, unsigned *, Qseqs *);
 extern void (*updateAnnotsPtr)(CompDNA *, int, int, FILE *, unsigned **, unsigned **, unsigned **);
 int updateDBs(HashMap *templates, CompDNA *qseq, unsigned template, int MinKlen, double homQ, double homT, unsigned *template_ulengths, unsigned *template_slengths, Qseqs *header);
+int countDBs(HashMap *templates, CompDNA *qseq);
+void updateDBs_shard(HashMap *templates, CompDNA *qseq, unsigned template, unsigned shard, unsigned shard_num);
+void updateDBs_pairs(HashMap *templates, KmerPairs *pairs, CompDNA *qseq, unsigned template, long unsigned pos);
 int updateDBs_sparse(HashMap *templates, CompDNA *qseq, unsigned template, int MinKlen, double homQ, double homT, unsigned *template_ulengths, unsigned *template_slengths, Qseqs *header);
 void updateAnnots(CompDNA *qseq, int DB_size, int kmerindex, FILE *seq_out, unsigned **template_lengths, unsigned **template_ulengths, unsigned **template_slengths);
 void updateAnnots_sparse(CompDNA *qseq, int DB_size, int kmerindex, FILE *seq_out, unsigned **template_lengths, unsigned **template_ulengths, unsigned **template_slengths);
@@ -19,10 +19,68 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "pherror.h"
 #include "qseqs.h"
 #include "updatescores.h"
 
+static __thread FragBuff *fragLocal = 0;
+
+static void fragWrite(FILE *out, const int *buffer, int n, const unsigned char *qseq, int q_len, const Qseqs *header, const int *start, const int *end, const int *templates, int counter, long unsigned mate) {
+	
+	long unsigned len;
+	unsigned char *ptr;
+	FragBuff *dest;
+	
+	/* records of this thread are collected, and written in blocks, 
+	   room for the mate is made with the first read of a pair */
+	len = n * sizeof(int) + q_len + header->len + 3 * counter * sizeof(int);
+	if(!(dest = fragLocal)) {
+		dest = smalloc(sizeof(FragBuff));
+		dest->len = 0;
+		dest->size = FRAGBUFF;
+		dest->buff = smalloc(FRAGBUFF);
+		fragLocal = dest;
+	} else if(dest->out != out || dest->size < dest->len + len + mate) {
+		sfwrite(dest->buff, 1, dest->len, dest->out);
+		dest->len = 0;
+	}
+	dest->out = out;
+	if(dest->size < len + mate) {
+		free(dest->buff);
+		dest->size = (len + mate) << 1;
+		dest->buff = smalloc(dest->size);
+	}
+	
+	ptr = dest->buff + dest->len;
+	memcpy(ptr, buffer, n * sizeof(int));
+	ptr += n * sizeof(int);
+	memcpy(ptr, qseq, q_len);
+	ptr += q_len;
+	memcpy(ptr, header->seq, header->len);
+	ptr += header->len;
+	if(counter) {
+		memcpy(ptr, start, counter * sizeof(int));
+		ptr += counter * sizeof(int);
+		memcpy(ptr, end, counter * sizeof(int));
+		ptr += counter * sizeof(int);
+		memcpy(ptr, templates, counter * sizeof(int));
+	}
+	dest->len += len;
+}
+
+void fragFlush(void) {
+	
+	FragBuff *src;
+	
+	if((src = fragLocal)) {
+		sfwrite(src->buff, 1, src->len, src->out);
+		free(src->buff);
+		free(src);
+		fragLocal = 0;
+	}
+}
+
 void update_Scores_MEM(unsigned char *qseq, int q_len, int counter, int score, int *start, int *end, int *template, Qseqs *header, int flag, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, FILE *frag_out_raw) {
 	
 	int i, buffer[5];
@@ -34,12 +92,7 @@ void update_Scores_MEM(unsigned char *qseq, int q_len, int counter, int score, i
 	buffer[3] = header->len;
 	buffer[4] = flag;
 	counter = abs(counter);
-	sfwrite(buffer, sizeof(int), 5, frag_out_raw);
-	sfwrite(qseq, 1, q_len, frag_out_raw);
-	sfwrite(header->seq, 1, header->len, frag_out_raw);
-	sfwrite(start, sizeof(int), counter, frag_out_raw);
-	sfwrite(end, sizeof(int), counter, frag_out_raw);
-	sfwrite(template, sizeof(int), counter, frag_out_raw);
+	fragWrite(frag_out_raw, buffer, 5, qseq, q_len, header, start, end, template, counter, 0);
 	
 	/* update scores */
 	if(counter == 1) { /* Only one best match */
@@ -72,19 +125,12 @@ void update_Scores_pe_MEM(unsigned char *qseq, int q_len, unsigned char *qseq_r,
 	buffer[3] = header->len;
 	buffer[4] = flag;
 	counter = abs(counter);
-	sfwrite(buffer, sizeof(int), 5, frag_out_raw);
-	sfwrite(qseq, 1, q_len, frag_out_raw);
-	sfwrite(header->seq, 1, header->len, frag_out_raw);
-	sfwrite(start, sizeof(int), counter, frag_out_raw);
-	sfwrite(end, sizeof(int), counter, frag_out_raw);
-	sfwrite(template, sizeof(int), counter, frag_out_raw);
+	fragWrite(frag_out_raw, buffer, 5, qseq, q_len, header, start, end, template, counter, 3 * sizeof(int) + qr_len + header_r->len);
 	
 	buffer[0] = qr_len;
 	buffer[1] = header_r->len;
 	buffer[2] = flag_r;
-	sfwrite(buffer, sizeof(int), 3, frag_out_raw);
-	sfwrite(qseq_r, 1, qr_len, frag_out_raw);
-	sfwrite(header_r->seq, 1, header_r->len, frag_out_raw);
+	fragWrite(frag_out_raw, buffer, 3, qseq_r, qr_len, header_r, 0, 0, 0, 0, 0);
 	
 	/* update scores */
 	if(counter == 1) { /* Only one best match */
@@ -192,12 +238,7 @@ void update_Scores_nanoold(unsigned char *qseq, int q_len, double minFrac, int c
 	buffer[3] = header->len;
 	buffer[4] = flag;
 	counter = abs(counter);
-	sfwrite(buffer, sizeof(int), 5, frag_out_raw);
-	sfwrite(qseq, 1, q_len, frag_out_raw);
-	sfwrite(header->seq, 1, header->len, frag_out_raw);
-	sfwrite(bestStart, sizeof(int), counter, frag_out_raw);
-	sfwrite(bestEnd, sizeof(int), counter, frag_out_raw);
-	sfwrite(bestTemplates, sizeof(int), counter, frag_out_raw);
+	fragWrite(frag_out_raw, buffer, 5, qseq, q_len, header, bestStart, bestEnd, bestTemplates, counter, 0);
 }
 
 int update_Scores(unsigned char *qseq, int q_len, double minFrac, int counter, int bestReadScore, double bestScore, int *start, int *end, int *templates, int *Scores, int *Lengths, Qseqs *header, int flag, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, FILE *frag_out_raw) {
@@ -287,12 +328,7 @@ int update_Scores(unsigned char *qseq, int q_len, double minFrac, int counter, i
 	buffer[3] = header->len;
 	buffer[4] = flag;
 	counter = abs(counter);
-	sfwrite(buffer, sizeof(int), 5, frag_out_raw);
-	sfwrite(qseq, 1, q_len, frag_out_raw);
-	sfwrite(header->seq, 1, header->len, frag_out_raw);
-	sfwrite(bestStart, sizeof(int), counter, frag_out_raw);
-	sfwrite(bestEnd, sizeof(int), counter, frag_out_raw);
-	sfwrite(bestTemplates, sizeof(int), counter, frag_out_raw);
+	fragWrite(frag_out_raw, buffer, 5, qseq, q_len, header, bestStart, bestEnd, bestTemplates, counter, 0);
 	
 	return counter;
 }
@@ -377,12 +413,7 @@ int update_Scores_se(unsigned char *qseq, int q_len, double minFrac, int counter
 	buffer[3] = header->len;
 	buffer[4] = flag;
 	counter = abs(counter);
-	sfwrite(buffer, sizeof(int), 5, frag_out_raw);
-	sfwrite(qseq, 1, q_len, frag_out_raw);
-	sfwrite(header->seq, 1, header->len, frag_out_raw);
-	sfwrite(bestStart, sizeof(int), counter, frag_out_raw);
-	sfwrite(bestEnd, sizeof(int), counter, frag_out_raw);
-	sfwrite(bestTemplates, sizeof(int), counter, frag_out_raw);
+	fragWrite(frag_out_raw, buffer, 5, qseq, q_len, header, bestStart, bestEnd, bestTemplates, counter, 0);
 	
 	return counter;
 }
@@ -470,19 +501,12 @@ int update_Scores_pe(unsigned char *qseq, int q_len, unsigned char *qseq_r, int
 	buffer[3] = header->len;
 	buffer[4] = flag;
 	counter = abs(counter);
-	sfwrite(buffer, sizeof(int), 5, frag_out_raw);
-	sfwrite(qseq, 1, q_len, frag_out_raw);
-	sfwrite(header->seq, 1, header->len, frag_out_raw);
-	sfwrite(bestStart, sizeof(int), counter, frag_out_raw);
-	sfwrite(bestEnd, sizeof(int), counter, frag_out_raw);
-	sfwrite(bestTemplates, sizeof(int), counter, frag_out_raw);
+	fragWrite(frag_out_raw, buffer, 5, qseq, q_len, header, bestStart, bestEnd, bestTemplates, counter, 3 * sizeof(int) + qr_len + header_r->len);
 	
 	buffer[0] = qr_len;
 	buffer[1] = header_r->len;
 	buffer[2] = flag_r;
-	sfwrite(buffer, sizeof(int), 3, frag_out_raw);
-	sfwrite(qseq_r, 1, qr_len, frag_out_raw);
-	sfwrite(header_r->seq, 1, header_r->len, frag_out_raw);
+	fragWrite(frag_out_raw, buffer, 3, qseq_r, qr_len, header_r, 0, 0, 0, 0, 0);
 	
 	return counter;
 }
@@ -498,12 +522,7 @@ void update_Scores_old(unsigned char *qseq, int q_len, int counter, int score, i
 	buffer[3] = header->len;
 	buffer[4] = flag;
 	counter = abs(counter);
-	sfwrite(buffer, sizeof(int), 5, frag_out_raw);
-	sfwrite(qseq, 1, q_len, frag_out_raw);
-	sfwrite(header->seq, 1, header->len, frag_out_raw);
-	sfwrite(start, sizeof(int), counter, frag_out_raw);
-	sfwrite(end, sizeof(int), counter, frag_out_raw);
-	sfwrite(template, sizeof(int), counter, frag_out_raw);
+	fragWrite(frag_out_raw, buffer, 5, qseq, q_len, header, start, end, template, counter, 0);
 	
 	/* update scores */
 	if(counter == 1) { //Only one best match
@@ -536,19 +555,12 @@ void update_Scores_pe_old(unsigned char *qseq, int q_len, unsigned char *qseq_r,
 	buffer[3] = header->len;
 	buffer[4] = flag;
 	counter = abs(counter);
-	sfwrite(buffer, sizeof(int), 5, frag_out_raw);
-	sfwrite(qseq, 1, q_len, frag_out_raw);
-	sfwrite(header->seq, 1, header->len, frag_out_raw);
-	sfwrite(start, sizeof(int), counter, frag_out_raw);
-	sfwrite(end, sizeof(int), counter, frag_out_raw);
-	sfwrite(template, sizeof(int), counter, frag_out_raw);
+	fragWrite(frag_out_raw, buffer, 5, qseq, q_len, header, start, end, template, counter, 3 * sizeof(int) + qr_len + header_r->len);
 	
 	buffer[0] = qr_len;
 	buffer[1] = header_r->len;
 	buffer[2] = flag_r;
-	sfwrite(buffer, sizeof(int), 3, frag_out_raw);
-	sfwrite(qseq_r, 1, qr_len, frag_out_raw);
-	sfwrite(header_r->seq, 1, header_r->len, frag_out_raw);
+	fragWrite(frag_out_raw, buffer, 3, qseq_r, qr_len, header_r, 0, 0, 0, 0, 0);
 	
 	/* update scores */
 	if(counter == 1) { /* Only one best match */
@@ -20,6 +20,20 @@
 #include <stdio.h>
 #include "qseqs.h"
 
+#ifndef FRAGBUFF
+typedef struct fragBuff FragBuff;
+struct fragBuff {
+	FILE *out;
+	long unsigned len;
+	long unsigned size;
+	unsigned char *buff;
+};
+#define FRAGBUFF 1048576
+#endif
+
+/* write the fragments buffered by this thread, hold the output lock */
+void fragFlush(void);
+
 void update_Scores_MEM(unsigned char *qseq, int q_len, int counter, int score, int *start, int *end, int *template, Qseqs *header, int flag, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, FILE *frag_out_raw);
 void update_Scores_pe_MEM(unsigned char *qseq, int q_len, unsigned char *qseq_r, int qr_len, int counter, int score, int *start, int *end, int *template, Qseqs *header, Qseqs *header_r, int flag, int flag_r, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, FILE *frag_out_raw);
 int update_Scores(unsigned char *qseq, int q_len, double minFrac, int counter, int bestReadScore, double bestScore, int *start, int *end, int *templates, int *Scores, int *Lengths, Qseqs *header, int flag, long unsigned *alignment_scores, long unsigned *uniq_alignment_scores, FILE *frag_out_raw);
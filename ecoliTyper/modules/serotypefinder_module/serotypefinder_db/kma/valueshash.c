@@ -22,18 +22,26 @@
 #include "valueshash.h"
 
 long unsigned (*valuesKeyPtr)(unsigned *, int);
-int (*cmpValuesPtr)(unsigned *, unsigned *, unsigned);
+int (*cmpValuesPtr)(unsigned *, unsigned *);
 
 ValuesHash * initialize_hashValues(long unsigned size, int DB_size) {
 	
+	long unsigned slots;
 	ValuesHash *dest;
 	
+	/* start small, the number of distinct value lists is usually far
+	   below the number of k-mers given as size */
+	slots = 1024;
+	while(slots < size && slots < 1048576) {
+		slots <<= 1;
+	}
+	
 	dest = smalloc(sizeof(ValuesHash));
 	dest->n = 0;
-	dest->size = size;
+	dest->size = slots - 1;
 	dest->DB_size = DB_size;
 	
-	dest->table = calloc(size, sizeof(ValuesTable *));
+	dest->table = calloc(slots, sizeof(ValuesSlot));
 	if(!dest->table) {
 		ERROR();
 	}
@@ -44,17 +52,48 @@ ValuesHash * initialize_hashValues(long unsigned size, int DB_size) {
 void valuesHash_destroy(ValuesHash *src) {
 	
 	long unsigned i;
-	ValuesTable *node, *next;
 	
-	i = src->size;
+	i = src->size + 1;
 	while(i--) {
-		for(node = src->table[i]; node != 0; node = next) {
-			next = node->next;
-			free(node);
+		free(src->table[i].node);
+	}
+	free(src->table);
+	free(src);
+}
+
+ValuesTable * valuesHash_list(ValuesHash *src) {
+	
+	long unsigned i;
+	ValuesTable *node, *table;
+	
+	/* link the nodes, and free the hash */
+	table = 0;
+	i = src->size + 1;
+	while(i--) {
+		if((node = src->table[i].node)) {
+			node->next = table;
+			table = node;
 		}
 	}
 	free(src->table);
 	free(src);
+	
+	return table;
+}
+
+static inline long unsigned valuesMix(long unsigned key, long unsigned value) {
+	
+	key = (key ^ value) * 0xFF51AFD7ED558CCD;
+	
+	return key ^ (key >> 32);
+}
+
+static inline long unsigned valuesFinal(long unsigned key) {
+	
+	key ^= key >> 29;
+	key *= 0xC4CEB9FE1A85EC53;
+	
+	return key ^ (key >> 32);
 }
 
 long unsigned valuesKey(unsigned *values, int DB_size) {
@@ -62,12 +101,12 @@ long unsigned valuesKey(unsigned *values, int DB_size) {
 	unsigned i;
 	long unsigned key;
 	
-	key = 0;
+	key = 0x9E3779B97F4A7C15;
 	for(i = 0; i <= *values; ++i) {
-		key = key * DB_size + values[i];
+		key = valuesMix(key, values[i]);
 	}
 	
-	return key;
+	return valuesFinal(key);
 }
 
 long unsigned huValuesKey(unsigned *valuesOrg, int DB_size) {
@@ -77,12 +116,12 @@ long unsigned huValuesKey(unsigned *valuesOrg, int DB_size) {
 	short unsigned *values;
 	
 	values = (short unsigned *)(valuesOrg);
-	key = 0;
+	key = 0x9E3779B97F4A7C15;
 	for(i = 0; i <= *values; ++i) {
-		key = key * DB_size + values[i];
+		key = valuesMix(key, values[i]);
 	}
 	
-	return key;
+	return valuesFinal(key);
 }
 
 unsigned uSize(unsigned *values) {
@@ -95,12 +134,11 @@ unsigned huSize(unsigned *valuesOrg) {
 	return *values + 1;
 }
 
-int cmpValues(unsigned *s1, unsigned *s2, unsigned len) {
+int cmpValues(unsigned *s1, unsigned *s2) {
 	
-	if(len == 0) {
-		return 1;
-	}
+	unsigned len;
 	
+	len = *s1 + 1;
 	while(len--) {
 		if(s1[len] != s2[len]) {
 			return 0;
@@ -110,19 +148,14 @@ int cmpValues(unsigned *s1, unsigned *s2, unsigned len) {
 	return 1;
 }
 
-int cmpHuValues(unsigned *s1_org, unsigned *s2_org, unsigned len_org) {
+int cmpHuValues(unsigned *s1_org, unsigned *s2_org) {
 	
-	short unsigned *s1, *s2, len;
+	unsigned len;
+	short unsigned *s1, *s2;
 	
-	len = len_org;
-	--len;
-	
-	if(len == 0) {
-		return 1;
-	}
 	s1 = (short unsigned *)(s1_org);
 	s2 = (short unsigned *)(s2_org);
-	
+	len = *s1 + 1;
 	while(len--) {
 		if(s1[len] != s2[len]) {
 			return 0;
@@ -132,24 +165,53 @@ int cmpHuValues(unsigned *s1_org, unsigned *s2_org, unsigned len_org) {
 	return 1;
 }
 
+static void valuesHash_grow(ValuesHash *src) {
+	
+	long unsigned i, index, size;
+	ValuesSlot *table, *slot;
+	
+	/* double and reinsert on the stored fingerprints */
+	table = src->table;
+	size = src->size + 1;
+	src->size = (size << 1) - 1;
+	src->table = calloc(size << 1, sizeof(ValuesSlot));
+	if(!src->table) {
+		ERROR();
+	}
+	for(i = 0; i < size; ++i) {
+		if(table[i].node) {
+			index = table[i].key & src->size;
+			while((slot = src->table + index)->node) {
+				index = (index + 1) & src->size;
+			}
+			*slot = table[i];
+		}
+	}
+	free(table);
+}
+
 long unsigned valuesHash_add(ValuesHash *src, unsigned *newValues, long unsigned v_index) {
 	
-	/* return 0 if values are new, 
+	/* return v_index if values are new, 
 	else return first index of seen value */
 	
-	unsigned *values;
-	long unsigned index;
+	long unsigned key, index;
+	ValuesSlot *slot;
 	ValuesTable *node;
 	
-	/* get index */
-	index = valuesKeyPtr(newValues, src->DB_size) % src->size;
+	/* keep load at most 1/2 */
+	if(src->size < (src->n << 1)) {
+		valuesHash_grow(src);
+	}
 	
-	/* search for values */
-	for(node = src->table[index]; node != 0; node = node->next) {
-		values = node->values;
-		if(*values == *newValues && cmpValuesPtr(values + 1, newValues + 1, newValues[0])) { // Value exists
-			return node->v_index;
+	/* search for values, comparing fingerprints first */
+	key = valuesKeyPtr(newValues, src->DB_size);
+	index = key & src->size;
+	while((slot = src->table + index)->node) {
+		if(slot->key == key && cmpValuesPtr(slot->node->values, newValues)) {
+			return slot->node->v_index;
 		}
+		index = (index + 1) & src->size;
 	}
 	
 	/* new values */
@@ -157,8 +219,9 @@ long unsigned valuesHash_add(ValuesHash *src, unsigned *newValues, long unsigned
 	node = smalloc(sizeof(ValuesTable));
 	node->v_index = v_index;
 	node->values = newValues;
-	node->next = src->table[index];
-	src->table[index] = node;
+	node->next = 0;
+	slot->key = key;
+	slot->node = node;
 	
 	return v_index;
 }
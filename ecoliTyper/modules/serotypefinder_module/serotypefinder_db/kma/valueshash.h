@@ -20,6 +20,7 @@
 
 #ifndef VALUESHASH
 typedef struct valuesTable ValuesTable;
+typedef struct valuesSlot ValuesSlot;
 typedef struct valuesHash ValuesHash;
 
 struct valuesTable {
@@ -28,23 +29,29 @@ struct valuesTable {
 	struct valuesTable *next;
 };
 
+struct valuesSlot {
+	long unsigned key;			// fingerprint of values
+	struct valuesTable *node;
+};
+
 struct valuesHash {
 	long unsigned n;
-	long unsigned size;
-	struct valuesTable **table;
+	long unsigned size;			// slots - 1
+	struct valuesSlot *table;	// open addressing, linear probing
 	int DB_size;
 };
 #define VALUESHASH 1
 #endif
 
 extern long unsigned (*valuesKeyPtr)(unsigned *, int);
-extern int (*cmpValuesPtr)(unsigned *, unsigned *, unsigned);
+extern int (*cmpValuesPtr)(unsigned *, unsigned *);
 ValuesHash * initialize_hashValues(long unsigned size, int DB_size);
 void valuesHash_destroy(ValuesHash *src);
+ValuesTable * valuesHash_list(ValuesHash *src);
 long unsigned valuesKey(unsigned *values, int DB_size);
 long unsigned huValuesKey(unsigned *valuesOrg, int DB_size);
 unsigned uSize(unsigned *values);
 unsigned huSize(unsigned *valuesOrg);
-int cmpValues(unsigned *s1, unsigned *s2, unsigned len);
-int cmpHuValues(unsigned *s1_org, unsigned *s2_org, unsigned len_org);
+int cmpValues(unsigned *s1, unsigned *s2);
+int cmpHuValues(unsigned *s1_org, unsigned *s2_org);
 long unsigned valuesHash_add(ValuesHash *src, unsigned *newValues, long unsigned v_index);
@@ -19,15 +19,26 @@
 #define _XOPEN_SOURCE 600
 #include <ctype.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "assembly.h"
 #include "filebuff.h"
+#include "pherror.h"
 #include "stdnuc.h"
 #include "stdstat.h"
+#include "threader.h"
 #include "version.h"
 #include "vcf.h"
 
+/* like wait_atomic, but backs off to 10 ms while there is nothing to do */
+#if _POSIX_C_SOURCE >= 199309L
+#define wait_idle(src) for(long idle_ = 100000; src; nanosleep(sleepSpec(idle_), NULL), idle_ = idle_ < 10000000 ? idle_ << 1 : idle_)
+#else
+#define wait_idle(src) for(long idle_ = 100000; src; usleep(idle_ / 1000), idle_ = idle_ < 10000000 ? idle_ << 1 : idle_)
+#endif
+
 char * noFolder(const char *src) {
 	
 	int pos;
@@ -48,6 +59,8 @@ void initialiseVcf(FileBuff *fileP, char *templateFilename) {
 	unsigned check, avail;
 	char *update;
 	
+	/* bgzip compatible, also without threads */
+	bgzfFileBuff(fileP);
 	update = (char *) fileP->next;
 	avail = fileP->bytes;
 	
@@ -94,7 +107,22 @@ void initialiseVcf(FileBuff *fileP, char *templateFilename) {
 	
 }
 
-void updateVcf(char *template_name, unsigned char *template_seq, double evalue, double support, int bcd, int t_len, AssemInfo *matrix, int filter, FileBuff *fileP) {
+static void growVcfBuff(FileBuff *dest) {
+	
+	int len;
+	
+	/* keep the records of a template in memory */
+	len = dest->buffSize - dest->bytes;
+	dest->buffSize <<= 1;
+	dest->buffer = realloc(dest->buffer, dest->buffSize);
+	if(!dest->buffer) {
+		ERROR();
+	}
+	dest->next = dest->buffer + len;
+	dest->bytes = dest->buffSize - len;
+}
+
+static void formatVcf(char *template_name, unsigned char *template_seq, double evalue, double support, int bcd, int t_len, AssemInfo *matrix, int filter, FileBuff *fileP, void (*flush)(FileBuff *)) {
 	
 	static const char nuc2num[256] = {
 		8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
@@ -189,10 +217,11 @@ void updateVcf(char *template_name, unsigned char *template_seq, double evalue,
 			RAF = (double) bestScore / DP;
 			DEL = assembly[pos].counts[5];
 			Q = pow(depthUpdate - (bestScore << 1), 2) / depthUpdate;
-			P = p_chisqr(Q);
 			
 			/* discard unimportant changes */
-			if(nuc != bestNuc || (t_len <= nextPos && *template_seq == '-') || DP < bcd || evalue < P || AD < support * DP) {
+			if(nuc != bestNuc || (t_len <= nextPos && *template_seq == '-') || DP < bcd || !chisqrTest(Q, evalue) || AD < support * DP) {
+				P = p_chisqr(Q);
+				
 				/* QUAL */
 				//QUAL = lnConst * log(P);
 				QUAL = lnConst * log(binP(DP, AD, 0.25));
@@ -209,7 +238,7 @@ void updateVcf(char *template_name, unsigned char *template_seq, double evalue,
 				
 				if(avail < template_name_length + 167) {
 					fileP->bytes = avail;
-					writeGzFileBuff(fileP);
+					flush(fileP);
 					avail = fileP->bytes;
 					update = (char *) fileP->next;
 				}
@@ -262,7 +291,7 @@ void updateVcf(char *template_name, unsigned char *template_seq, double evalue,
 			FILTER = (char *) FAIL;
 			if(avail < template_name_length + 105) {
 				fileP->bytes = avail;
-				writeGzFileBuff(fileP);
+				flush(fileP);
 				avail = fileP->bytes;
 				update = (char *) fileP->next;
 			}
@@ -280,3 +309,191 @@ void updateVcf(char *template_name, unsigned char *template_seq, double evalue,
 	fileP->bytes = avail;
 	
 }
+
+void updateVcf(char *template_name, unsigned char *template_seq, double evalue, double support, int bcd, int t_len, AssemInfo *matrix, int filter, FileBuff *fileP) {
+	formatVcf(template_name, template_seq, evalue, support, bcd, t_len, matrix, filter, fileP, &writeGzFileBuff);
+}
+
+VcfPool * vcfPool_init(FileBuff *dest, int thread_num, double evalue, double support, int bcd, int filter) {
+	
+	int i;
+	VcfPool *pool;
+	VcfSlot *slot;
+	
+	pool = smalloc(sizeof(VcfPool));
+	pool->thread_num = thread_num;
+	pool->size = thread_num << 1;
+	pool->bcd = bcd;
+	pool->filter = filter;
+	pool->evalue = evalue;
+	pool->support = support;
+	pool->stop = 0;
+	pool->excludeIn = 0;
+	pool->filled = 0;
+	pool->formatted = 0;
+	pool->written = 0;
+	pool->dest = dest;
+	pool->slots = smalloc(pool->size * sizeof(VcfSlot));
+	for(i = 0, slot = pool->slots; i < pool->size; ++i, ++slot) {
+		slot->status = 0;
+		slot->t_len = 0;
+		slot->nameSize = 256;
+		slot->tSize = 1024;
+		slot->template_name = smalloc(slot->nameSize);
+		slot->t = smalloc(slot->tSize);
+		slot->matrix.len = 0;
+		slot->matrix.size = 1024;
+		slot->matrix.assmb = smalloc_tag(MEM_ASSEMBLY, slot->matrix.size * sizeof(Assembly));
+		slot->buff = smalloc(sizeof(FileBuff));
+		slot->buff->buffSize = 65536;
+		slot->buff->bytes = slot->buff->buffSize;
+		slot->buff->buffer = smalloc(slot->buff->buffSize);
+		slot->buff->next = slot->buff->buffer;
+	}
+	
+	pool->ids = smalloc(thread_num * sizeof(pthread_t));
+	for(i = 0; i < thread_num; ++i) {
+		if((errno = pthread_create(pool->ids + i, NULL, &vcfPool_format, pool))) {
+			ERROR();
+		}
+	}
+	if((errno = pthread_create(&pool->writer, NULL, &vcfPool_write, pool))) {
+		ERROR();
+	}
+	
+	return pool;
+}
+
+void * vcfPool_format(void *arg) {
+	
+	VcfPool *pool = arg;
+	VcfSlot *slot;
+	volatile int *excludeIn = &pool->excludeIn;
+	
+	while(1) {
+		/* claim filled templates, in order */
+		lock(excludeIn);
+		slot = pool->slots + (pool->formatted % pool->size);
+		wait_idle(slot->status != 1 && !pool->stop);
+		if(slot->status != 1) {
+			unlock(excludeIn);
+			break;
+		}
+		slot->status = 2;
+		++pool->formatted;
+		unlock(excludeIn);
+		
+		formatVcf(slot->template_name, slot->t, pool->evalue, pool->support, pool->bcd, slot->t_len, &slot->matrix, pool->filter, slot->buff, &growVcfBuff);
+		__sync_synchronize();
+		slot->status = 3;
+	}
+	
+	return NULL;
+}
+
+void * vcfPool_write(void *arg) {
+	
+	int len, n;
+	unsigned char *next;
+	VcfPool *pool = arg;
+	VcfSlot *slot;
+	FileBuff *dest;
+	
+	/* write formatted templates in order, off the producing threads */
+	dest = pool->dest;
+	while(1) {
+		slot = pool->slots + (pool->written % pool->size);
+		wait_idle(slot->status != 3 && !pool->stop);
+		if(slot->status != 3) {
+			break;
+		}
+		next = slot->buff->buffer;
+		len = slot->buff->buffSize - slot->buff->bytes;
+		while(len) {
+			if(dest->bytes == 0) {
+				writeGzFileBuff(dest);
+			}
+			n = len < dest->bytes ? len : dest->bytes;
+			memcpy(dest->next, next, n);
+			dest->next += n;
+			dest->bytes -= n;
+			next += n;
+			len -= n;
+		}
+		slot->buff->next = slot->buff->buffer;
+		slot->buff->bytes = slot->buff->buffSize;
+		__sync_synchronize();
+		slot->status = 0;
+		++pool->written;
+	}
+	
+	return NULL;
+}
+
+void vcfPush(VcfPool *pool, char *template_name, Assem *aligned_assem, int t_len, AssemInfo *matrix) {
+	
+	int len;
+	VcfSlot *slot;
+	
+	/* wait for a free slot */
+	slot = pool->slots + (pool->filled % pool->size);
+	wait_atomic(slot->status);
+	
+	/* copy the template, as matrix and aligned_assem are reused */
+	len = strlen(template_name) + 1;
+	if(slot->nameSize < len) {
+		free(slot->template_name);
+		slot->nameSize = len << 1;
+		slot->template_name = smalloc(slot->nameSize);
+	}
+	memcpy(slot->template_name, template_name, len);
+	len = matrix->len < 1 ? 1 : matrix->len;
+	if(slot->matrix.size < len) {
+		sfree_tag(MEM_ASSEMBLY, slot->matrix.assmb, slot->matrix.size * sizeof(Assembly));
+		slot->matrix.size = len << 1;
+		slot->matrix.assmb = smalloc_tag(MEM_ASSEMBLY, slot->matrix.size * sizeof(Assembly));
+	}
+	memcpy(slot->matrix.assmb, matrix->assmb, len * sizeof(Assembly));
+	slot->matrix.len = matrix->len;
+	len = matrix->len < aligned_assem->size ? matrix->len + 1 : aligned_assem->size;
+	if(slot->tSize < len) {
+		free(slot->t);
+		slot->tSize = len << 1;
+		slot->t = smalloc(slot->tSize);
+	}
+	memcpy(slot->t, aligned_assem->t, len);
+	slot->t_len = t_len;
+	
+	__sync_synchronize();
+	slot->status = 1;
+	++pool->filled;
+}
+
+void vcfPool_close(VcfPool *pool) {
+	
+	int i;
+	VcfSlot *slot;
+	
+	/* drain */
+	wait_atomic(pool->written != pool->filled);
+	pool->stop = 1;
+	for(i = 0; i < pool->thread_num; ++i) {
+		if((errno = pthread_join(pool->ids[i], NULL))) {
+			ERROR();
+		}
+	}
+	if((errno = pthread_join(pool->writer, NULL))) {
+		ERROR();
+	}
+	
+	for(i = 0, slot = pool->slots; i < pool->size; ++i, ++slot) {
+		free(slot->template_name);
+		free(slot->t);
+		sfree_tag(MEM_ASSEMBLY, slot->matrix.assmb, slot->matrix.size * sizeof(Assembly));
+		free(slot->buff->buffer);
+		free(slot->buff);
+	}
+	free(pool->slots);
+	free(pool->ids);
+	free(pool);
+}
@@ -17,9 +17,51 @@
  * limitations under the License.
 */
 #define _XOPEN_SOURCE 600
+#include <pthread.h>
 #include "assembly.h"
 #include "filebuff.h"
 
+#ifndef VCF
+typedef struct vcfSlot VcfSlot;
+typedef struct vcfPool VcfPool;
+struct vcfSlot {
+	volatile int status; /* 0 free, 1 filled, 2 formatting, 3 formatted */
+	int t_len;
+	int nameSize;
+	int tSize;
+	char *template_name;
+	unsigned char *t;
+	AssemInfo matrix;
+	FileBuff *buff;
+};
+
+struct vcfPool {
+	int thread_num;
+	int size;
+	int bcd;
+	int filter;
+	double evalue;
+	double support;
+	volatile int stop;
+	volatile int excludeIn;
+	long unsigned filled;
+	long unsigned formatted;
+	volatile long unsigned written;
+	FileBuff *dest;
+	VcfSlot *slots;
+	pthread_t *ids;
+	pthread_t writer;
+};
+#define VCF 1
+#endif
+
 char * noFolder(const char *src);
 void initialiseVcf(FileBuff *fileP, char *templateFilename);
 void updateVcf(char *template_name, unsigned char *template_seq, double evalue, double support, int bcd, int t_len, AssemInfo *matrix, int filter, FileBuff *fileP);
+/* templates are copied in by the main thread, formatted in parallel, and
+   written in template order by a dedicated thread */
+VcfPool * vcfPool_init(FileBuff *dest, int thread_num, double evalue, double support, int bcd, int filter);
+void * vcfPool_format(void *arg);
+void * vcfPool_write(void *arg);
+void vcfPush(VcfPool *pool, char *template_name, Assem *aligned_assem, int t_len, AssemInfo *matrix);
+void vcfPool_close(VcfPool *pool);
@@ -19,6 +19,8 @@
 #define _XOPEN_SOURCE 600
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include "nw.h"
 #include "penalties.h"
@@ -151,7 +153,7 @@ void hitXML(FILE *out, const int template, const unsigned char *template_name, c
 	volatile int *lock = &Lock;
 	int i, Ms, MMs, W1s, Us, gap, pos, **d;
 	unsigned char *t, *q;
-	char *s, bases[6] = "ACGTN-";
+	char *s, *buff, *next, bases[6] = "ACGTN-";
 	
 	/* get stats */
 	d = rewards->d;
@@ -196,35 +198,41 @@ void hitXML(FILE *out, const int template, const unsigned char *template_name, c
 	}
 	pos += W1s * (0 < rewards->W1) + Us * (0 < rewards->U);
 	
-	/* print stats */
+	/* format the hit, outside the lock */
+	buff = smalloc(2048 + strlen((char *) template_name) + strlen((char *) aligned->q) + strlen((char *) aligned->t) + strlen(aligned->s));
+	next = buff;
+	next += sprintf(next, "\t<Hit_id>gnl|BL_ORD_ID|%d</Hit_id>\n", template + 1);
+	next += sprintf(next, "\t<Hit_def>%s</Hit_def>\n", template_name);
+	next += sprintf(next, "\t<Hit_accession>%d</Hit_accession>\n", template);
+	next += sprintf(next, "\t<Hit_len>%d</Hit_len>\n", aligned->len);
+	next += sprintf(next, "\t<Hit_hsps>\n");
+	next += sprintf(next, "\t\t<Hsp>\n");
+	next += sprintf(next, "\t\t\t<Hsp_num>1</Hsp_num>\n");
+	next += sprintf(next, "\t\t\t<Hsp_bit-score>%d</Hsp_bit-score>\n", aligned->score);
+	next += sprintf(next, "\t\t\t<Hsp_score>%d</Hsp_score>\n", aligned->mapQ);
+	next += sprintf(next, "\t\t\t<Hsp_evalue>%f</Hsp_evalue>\n", pow(10, aligned->mapQ / (-10.0)));
+	next += sprintf(next, "\t\t\t<Hsp_query-from>%d</Hsp_query-from>\n", ((flag & 16) ? (aligned->end) : (aligned->start)) + 1);
+	next += sprintf(next, "\t\t\t<Hsp_query-to>%d</Hsp_query-to>\n", ((flag & 16) ? (aligned->start) : (aligned->end)) + 1);
+	next += sprintf(next, "\t\t\t<Hsp_hit-from>%d</Hsp_hit-from>\n", alnStat->pos + 1);
+	next += sprintf(next, "\t\t\t<Hsp_hit-to>%d</Hsp_hit-to>\n", alnStat->pos + alnStat->len - alnStat->tGaps + 1);
+	next += sprintf(next, "\t\t\t<Hsp_query-frame>%d</Hsp_query-frame>\n", aligned->start % 3);
+	next += sprintf(next, "\t\t\t<Hsp_hit-frame>%d</Hsp_hit-frame>\n", alnStat->pos % 3);
+	next += sprintf(next, "\t\t\t<Hsp_identity>%d</Hsp_identity>\n", Ms);
+	next += sprintf(next, "\t\t\t<Hsp_positive>%d</Hsp_positive>\n", pos);
+	next += sprintf(next, "\t\t\t<Hsp_gaps>%d</Hsp_gaps>\n", W1s + Us);
+	next += sprintf(next, "\t\t\t<Hsp_align-len>%d</Hsp_align-len>\n", aligned->len);
+	next += sprintf(next, "\t\t\t<Hsp_qseq>%s</Hsp_qseq>\n", aligned->q);
+	next += sprintf(next, "\t\t\t<Hsp_hseq>%s</Hsp_hseq>\n", aligned->t);
+	next += sprintf(next, "\t\t\t<Hsp_midline>%s</Hsp_midline>\n", aligned->s);
+	next += sprintf(next, "\t\t</Hsp>\n");
+	next += sprintf(next, "\t</Hit_hsps>\n");
+	next += sprintf(next, "</Hit>\n");
+	
+	/* number and print it */
 	lock(lock);
 	fprintf(out, "<Hit>\n");
 	fprintf(out, "\t<Hit_num>%d</Hit_num>\n", ++num);
-	fprintf(out, "\t<Hit_id>gnl|BL_ORD_ID|%d</Hit_id>\n", template + 1);
-	fprintf(out, "\t<Hit_def>%s</Hit_def>\n", template_name);
-	fprintf(out, "\t<Hit_accession>%d</Hit_accession>\n", template);
-	fprintf(out, "\t<Hit_len>%d</Hit_len>\n", aligned->len);
-	fprintf(out, "\t<Hit_hsps>\n");
-	fprintf(out, "\t\t<Hsp>\n");
-	fprintf(out, "\t\t\t<Hsp_num>1</Hsp_num>\n");
-	fprintf(out, "\t\t\t<Hsp_bit-score>%d</Hsp_bit-score>\n", aligned->score);
-	fprintf(out, "\t\t\t<Hsp_score>%d</Hsp_score>\n", aligned->mapQ);
-	fprintf(out, "\t\t\t<Hsp_evalue>%f</Hsp_evalue>\n", pow(10, aligned->mapQ / (-10.0)));
-	fprintf(out, "\t\t\t<Hsp_query-from>%d</Hsp_query-from>\n", ((flag & 16) ? (aligned->end) : (aligned->start)) + 1);
-	fprintf(out, "\t\t\t<Hsp_query-to>%d</Hsp_query-to>\n", ((flag & 16) ? (aligned->start) : (aligned->end)) + 1);
-	fprintf(out, "\t\t\t<Hsp_hit-from>%d</Hsp_hit-from>\n", alnStat->pos + 1);
-	fprintf(out, "\t\t\t<Hsp_hit-to>%d</Hsp_hit-to>\n", alnStat->pos + alnStat->len - alnStat->tGaps + 1);
-	fprintf(out, "\t\t\t<Hsp_query-frame>%d</Hsp_query-frame>\n", aligned->start % 3);
-	fprintf(out, "\t\t\t<Hsp_hit-frame>%d</Hsp_hit-frame>\n", alnStat->pos % 3);
-	fprintf(out, "\t\t\t<Hsp_identity>%d</Hsp_identity>\n", Ms);
-	fprintf(out, "\t\t\t<Hsp_positive>%d</Hsp_positive>\n", pos);
-	fprintf(out, "\t\t\t<Hsp_gaps>%d</Hsp_gaps>\n", W1s + Us);
-	fprintf(out, "\t\t\t<Hsp_align-len>%d</Hsp_align-len>\n", aligned->len);
-	fprintf(out, "\t\t\t<Hsp_qseq>%s</Hsp_qseq>\n", aligned->q);
-	fprintf(out, "\t\t\t<Hsp_hseq>%s</Hsp_hseq>\n", aligned->t);
-	fprintf(out, "\t\t\t<Hsp_midline>%s</Hsp_midline>\n", aligned->s);
-	fprintf(out, "\t\t</Hsp>\n");
-	fprintf(out, "\t</Hit_hsps>\n");
-	fprintf(out, "</Hit>\n");
+	sfwrite(buff, 1, next - buff, out);
 	unlock(lock);
+	free(buff);
 }